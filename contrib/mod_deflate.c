@@ -34,7 +34,7 @@
 #include "conf.h"
 #include "privs.h"
 
-#define MOD_DEFLATE_VERSION		"mod_deflate/0.5.7"
+#define MOD_DEFLATE_VERSION		"mod_deflate/0.5.8"
 
 /* Make sure the version of proftpd is as necessary. */
 #if PROFTPD_VERSION_NUMBER < 0x0001030504
@@ -46,7 +46,7 @@ module deflate_module;
 static int deflate_enabled = FALSE;
 static int deflate_engine = FALSE;
 static int deflate_logfd = -1;
-static pr_netio_t *deflate_netio = NULL;
+static pr_netio_filter_t *deflate_filter = NULL;
 
 /* Draft-recommended ZLIB defaults:
  *
@@ -82,10 +82,17 @@ static size_t deflate_zbuflen = 0;
 static size_t deflate_zbufsz = 0;
 
 static Byte *deflate_rbuf = NULL;
-static size_t deflate_rbuflen = 0;
 static size_t deflate_rbufsz = 0;
 
-#define DEFLATE_NETIO_NOTE	"mod_deflate.z_stream"
+/* The zlib stream for the current transfer, and whether it is set up for
+ * deflating (PR_NETIO_IO_WR) or inflating (PR_NETIO_IO_RD) data.
+ */
+static z_stream deflate_zstrm;
+static int deflate_zstrm_mode = 0;
+
+/* Whether the end of the compressed data being read has been seen. */
+static int deflate_zeof = FALSE;
+
 static int deflate_zerrno = 0;
 
 static const char *trace_channel = "deflate";
@@ -130,318 +137,231 @@ static const char *deflate_zstrerror(int zerrno) {
   return zstr;
 }
 
-/* NetIO callbacks
+/* NetIO filter callbacks
  */
 
-static int deflate_netio_close_cb(pr_netio_stream_t *nstrm) {
+static void deflate_zstream_end(void) {
   int res;
 
-  if (nstrm->strm_type == PR_NETIO_STRM_DATA) {
-    z_stream *zstrm;
+  if (deflate_zstrm_mode == PR_NETIO_IO_WR) {
+    res = deflateEnd(&deflate_zstrm);
+    if (res != Z_OK &&
+        res != Z_DATA_ERROR) {
+      pr_trace_msg(trace_channel, 3,
+        "error ending deflation: [%d] %s", res,
+        deflate_zstrm.msg ? deflate_zstrm.msg : deflate_zstrerror(res));
 
-    zstrm = pr_table_get(nstrm->notes, DEFLATE_NETIO_NOTE, NULL);
-    if (zstrm == NULL) {
-      return 0;
+      (void) pr_log_writefile(deflate_logfd, MOD_DEFLATE_VERSION,
+        "error ending deflation: [%d] %s", res,
+        deflate_zstrm.msg ? deflate_zstrm.msg : deflate_zstrerror(res));
     }
 
-    if (nstrm->strm_mode == PR_NETIO_IO_WR) {
-      if (zstrm->total_in > 0) {
-        float ratio;
-
-        ratio = ((float) zstrm->total_out / (float) zstrm->total_in);
+  } else if (deflate_zstrm_mode == PR_NETIO_IO_RD) {
+    res = inflateEnd(&deflate_zstrm);
+    if (res != Z_OK) {
+      pr_trace_msg(trace_channel, 3,
+        "error ending inflation: [%d] %s", res,
+        deflate_zstrm.msg ? deflate_zstrm.msg : deflate_zstrerror(res));
 
-        (void) pr_log_writefile(deflate_logfd, MOD_DEFLATE_VERSION,
-          "%s: deflated %lu bytes to %lu bytes (%0.2lf%% compression)",
-          session.curr_cmd, zstrm->total_in, zstrm->total_out,
-          (1.0 - ratio) * 100.0);
-      }
-
-      res = deflateEnd(zstrm);
-      if (res != Z_OK) {
-        pr_trace_msg(trace_channel, 3,
-          "close: error closing deflating netio: [%d] %s", res,
-          zstrm->msg ? zstrm->msg : deflate_zstrerror(res));
-
-        (void) pr_log_writefile(deflate_logfd, MOD_DEFLATE_VERSION,
-          "error closing deflating netio: [%d] %s", res,
-          zstrm->msg ? zstrm->msg : deflate_zstrerror(res));
-      }
-
-    } else if (nstrm->strm_mode == PR_NETIO_IO_RD) {
-      if (zstrm->total_in > 0) {
-        float ratio;
-
-        ratio = ((float) zstrm->total_in / (float) zstrm->total_out);
-
-        (void) pr_log_writefile(deflate_logfd, MOD_DEFLATE_VERSION,
-          "%s: inflated %lu bytes to %lu bytes (%0.2lf%% compression)",
-          session.curr_cmd, zstrm->total_in, zstrm->total_out,
-          (1.0 - ratio) * 100.0);
-      }
-
-      res = inflateEnd(zstrm);
-      if (res != Z_OK) {
-        pr_trace_msg(trace_channel, 3,
-          "close: error closing inflating netio: [%d] %s", res,
-          zstrm->msg ? zstrm->msg : deflate_zstrerror(res));
-
-        (void) pr_log_writefile(deflate_logfd, MOD_DEFLATE_VERSION,
-          "error closing inflating netio: [%d] %s", res,
-          zstrm->msg ? zstrm->msg : deflate_zstrerror(res));
-      }
+      (void) pr_log_writefile(deflate_logfd, MOD_DEFLATE_VERSION,
+        "error ending inflation: [%d] %s", res,
+        deflate_zstrm.msg ? deflate_zstrm.msg : deflate_zstrerror(res));
     }
   }
 
-  res = close(nstrm->strm_fd);
-  nstrm->strm_fd = -1;
-  pr_table_remove(nstrm->notes, DEFLATE_NETIO_NOTE, NULL);
-
-  return res;
+  deflate_zstrm_mode = 0;
 }
 
-static pr_netio_stream_t *deflate_netio_open_cb(pr_netio_stream_t *nstrm,
-    int fd, int mode) {
+static int deflate_filter_start_cb(pr_netio_filter_t *filter,
+    pr_netio_stream_t *nstrm) {
+  int res;
 
-  nstrm->strm_fd = fd;
-  nstrm->strm_mode = mode;
+  /* Clean up after the previous transfer, if it was aborted. */
+  deflate_zstream_end();
 
-  if (nstrm->strm_type == PR_NETIO_STRM_DATA) {
-    int res;
-    z_stream *zstrm;
+  /* Set the initial ZLIB parameters. */
+  memset(&deflate_zstrm, 0, sizeof(z_stream));
+  deflate_zstrm.zalloc = Z_NULL;
+  deflate_zstrm.zfree = Z_NULL;
+  deflate_zstrm.opaque = Z_NULL;
+  deflate_zstrm.next_in = Z_NULL;
+  deflate_zstrm.next_out = Z_NULL;
 
-    /* Set the initial ZLIB parameters. */
-    zstrm = pcalloc(nstrm->strm_pool, sizeof(z_stream));
-    zstrm->zalloc = Z_NULL;
-    zstrm->zfree = Z_NULL;
-    zstrm->opaque = Z_NULL;
-    zstrm->next_in = Z_NULL;
-    zstrm->next_out = Z_NULL;
-    zstrm->avail_in = 0;
-    zstrm->avail_out = 0;
+  memset(deflate_zbuf_ptr, '\0', deflate_zbufsz);
+  deflate_zbuf = deflate_zbuf_ptr;
+  deflate_zbuflen = 0;
+  deflate_zeof = FALSE;
+
+  if (nstrm->strm_mode == PR_NETIO_IO_WR) {
+    /* Initialize the zlib data for deflation. */
+    res = deflateInit2(&deflate_zstrm, deflate_compression_level, Z_DEFLATED,
+      deflate_window_bits, deflate_mem_level, deflate_strategy);
+    if (res != Z_OK) {
+      pr_trace_msg(trace_channel, 3,
+        "start: error initializing for deflation: [%d] %s", res,
+        deflate_zstrm.msg ? deflate_zstrm.msg : deflate_zstrerror(res));
 
-    if (pr_table_add(nstrm->notes,
-        pstrdup(nstrm->strm_pool, DEFLATE_NETIO_NOTE), zstrm,
-        sizeof(z_stream *)) < 0) {
       (void) pr_log_writefile(deflate_logfd, MOD_DEFLATE_VERSION,
-        "error stashing '%s' note: %s", DEFLATE_NETIO_NOTE, strerror(errno));
-      errno = EPERM;
-      return NULL;
-    }
+        "error initializing for deflation: [%d] %s", res,
+        deflate_zstrm.msg ? deflate_zstrm.msg : deflate_zstrerror(res));
 
-    memset(deflate_zbuf_ptr, '\0', deflate_zbufsz);
-    deflate_zbuf = deflate_zbuf_ptr;
+      errno = EINVAL;
+      return -1;
+    }
 
-    if (nstrm->strm_mode == PR_NETIO_IO_WR) {
-      /* Initialize the zlib data for deflation. */
-      res = deflateInit2(zstrm, deflate_compression_level, Z_DEFLATED,
-        deflate_window_bits, deflate_mem_level, deflate_strategy);
-
-      switch (res) {
-        case Z_OK:
-          zstrm->next_out = deflate_zbuf;
-          zstrm->avail_out = deflate_zbufsz;
-          break;
-
-        case Z_MEM_ERROR:
-        case Z_STREAM_ERROR:
-          pr_trace_msg(trace_channel, 3,
-            "open: error initializing for deflation: [%d] %s", res,
-            zstrm->msg ? zstrm->msg : deflate_zstrerror(res));
-
-          (void) pr_log_writefile(deflate_logfd, MOD_DEFLATE_VERSION,
-            "error initializing for deflation: [%d] %s", res,
-            zstrm->msg ? zstrm->msg : deflate_zstrerror(res));
-
-          errno = EINVAL;
-          return NULL;
-      }
+  } else {
+    /* Initialize the zlib data for inflation.
+     *
+     * The magic number 32 here from the zlib.h documentation; it enables
+     * the automatic header detection of zlib/gzip headers.
+     */
+    res = inflateInit2(&deflate_zstrm, deflate_window_bits + 32);
+    if (res != Z_OK) {
+      pr_trace_msg(trace_channel, 3,
+        "start: error initializing for inflation: [%d] %s", res,
+        deflate_zstrm.msg ? deflate_zstrm.msg : deflate_zstrerror(res));
 
-    } else if (nstrm->strm_mode == PR_NETIO_IO_RD) {
-      /* Initialize the zlib data for inflation.
-       *
-       * The magic number 32 here from the zlib.h documentation; it enables
-       * the automatic header detection of zlib/gzip headers.
-       */
-      res = inflateInit2(zstrm, deflate_window_bits + 32);
-
-      switch (res) {
-        case Z_OK:
-          zstrm->next_out = deflate_zbuf;
-          zstrm->avail_out = deflate_zbufsz;
-          break;
-
-        case Z_MEM_ERROR:
-        case Z_STREAM_ERROR:
-          pr_trace_msg(trace_channel, 3,
-            "open: error initializing for inflation: [%d] %s", res,
-            zstrm->msg ? zstrm->msg : deflate_zstrerror(res));
-
-          (void) pr_log_writefile(deflate_logfd, MOD_DEFLATE_VERSION,
-            "error initializing for inflation: [%d] %s", res, 
-            zstrm->msg ? zstrm->msg : deflate_zstrerror(res));
-
-          errno = EINVAL;
-          return NULL;
-      }
+      (void) pr_log_writefile(deflate_logfd, MOD_DEFLATE_VERSION,
+        "error initializing for inflation: [%d] %s", res,
+        deflate_zstrm.msg ? deflate_zstrm.msg : deflate_zstrerror(res));
 
-      /* These are used by the read callback; ensure they are initialised to
-       * zero before every read data transfer.
-       */
-      deflate_rbuflen = 0;
-      deflate_zbuflen = 0;
+      errno = EINVAL;
+      return -1;
     }
   }
 
-  return nstrm;
+  deflate_zstrm_mode = nstrm->strm_mode;
+  return 0;
 }
 
-static int deflate_netio_read_cb(pr_netio_stream_t *nstrm, char *buf,
-    size_t bufsz) {
+static int deflate_filter_finish_cb(pr_netio_filter_t *filter,
+    pr_netio_stream_t *nstrm) {
+  z_stream *zstrm = &deflate_zstrm;
+  int res = 0;
 
-  if (bufsz == 0) {
-    return 0;
-  }
+  if (deflate_zstrm_mode == PR_NETIO_IO_WR) {
+    zstrm->next_in = Z_NULL;
+    zstrm->avail_in = 0;
 
-  if (nstrm->strm_type == PR_NETIO_STRM_DATA) {
-    int datalen = 0, nread = 0, res, xerrno;
-    size_t copylen = 0;
-    z_stream *zstrm;
+    /* Write out whatever is left of the compressed data. */
+    do {
+      size_t datalen;
 
-    zstrm = pr_table_get(nstrm->notes, DEFLATE_NETIO_NOTE, NULL);
-    if (zstrm == NULL) {
-      pr_trace_msg(trace_channel, 2,
-        "no zstream found in stream data for reading");
-      errno = EIO;
-      return -1;
-    }
+      zstrm->next_out = deflate_zbuf_ptr;
+      zstrm->avail_out = deflate_zbufsz;
 
-    res = 0;
+      deflate_zerrno = deflate(zstrm, Z_FINISH);
 
-    /* If we have data leftover in deflate_zbuf, start by copying all of that
-     * into the provided buffer.  Only read more data from the network and
-     * inflate it when there's no leftover data.
-     */
+      pr_trace_msg(trace_channel, 19,
+        "finish: post-deflate zstream state: avail_in = %d, avail_out = %d "
+        "(zerrno = %s)", zstrm->avail_in, zstrm->avail_out,
+        deflate_zstrerror(deflate_zerrno));
 
-    if (deflate_zbuflen > 0) {
-      if (bufsz >= deflate_zbuflen) {
-        /* Excellent.  We can consume all of the data in the deflate_zbuf
-         * buffer.
-         */
-
-        pr_trace_msg(trace_channel, 9, "read: returning %lu bytes of "
-          "previously uncompressed data; no data read from client",
-          (unsigned long) deflate_zbuflen);
-
-        memcpy(buf, deflate_zbuf, deflate_zbuflen);
-        res = deflate_zbuflen;
-
-        /* Reset the pointer to the start of the buffer. */
-        deflate_zbuf = deflate_zbuf_ptr;
-        deflate_zbuflen = 0;
-
-        /* Manually adjust the "raw" bytes in counter, so that it will
-         * be accurate for %I logging.
-         *
-         * We subtract the number we are returning here, since our return
-         * value will simply be added back to the counter in pr_netio_read().
-         * And if our subtraction causes an underflow, it's still OK since
-         * the subsequent addition will overflow, and get the value back to
-         * what it should be.
-         */
-        session.total_raw_in -= res;
-
-        return res;
+      if (deflate_zerrno != Z_OK &&
+          deflate_zerrno != Z_STREAM_END) {
+        pr_trace_msg(trace_channel, 3,
+          "finish: error deflating data: [%d] %s: %s", deflate_zerrno,
+          deflate_zstrerror(deflate_zerrno),
+          zstrm->msg ? zstrm->msg : "unavailable");
+
+        (void) pr_log_writefile(deflate_logfd, MOD_DEFLATE_VERSION,
+          "error deflating data: [%d] %s", deflate_zerrno,
+          zstrm->msg ? zstrm->msg : deflate_zstrerror(deflate_zerrno));
+
+        errno = EIO;
+        res = -1;
+        break;
       }
 
-      /* The given buffer can't hold all of our already-inflated data; but
-       * maybe it can hold some of it?
-       */
+      datalen = deflate_zbufsz - zstrm->avail_out;
+      if (datalen > 0 &&
+          pr_netio_filter_write(filter, nstrm, (char *) deflate_zbuf_ptr,
+            datalen) < 0) {
+        (void) pr_log_writefile(deflate_logfd, MOD_DEFLATE_VERSION,
+          "error writing compressed data: %s", strerror(errno));
+        res = -1;
+        break;
+      }
 
-      pr_trace_msg(trace_channel, 9, "read: returning %lu bytes of previously "
-        "uncompressed data (of %lu bytes total); no data read from client",
-        (unsigned long) bufsz, (unsigned long) deflate_zbuflen);
+    } while (deflate_zerrno != Z_STREAM_END);
 
-      memcpy(buf, deflate_zbuf, bufsz);
-      res = bufsz;
+    if (zstrm->total_in > 0) {
+      float ratio;
 
-      deflate_zbuf += bufsz;
-      deflate_zbuflen -= bufsz;
+      ratio = ((float) zstrm->total_out / (float) zstrm->total_in);
 
-      /* Manually adjust the "raw" bytes in counter, so that it will
-       * be accurate for %I logging.
-       *
-       * We subtract the number we are returning here, since our return
-       * value will simply be added back to the counter in pr_netio_read().
-       * And if our subtraction causes an underflow, it's still OK since
-       * the subsequent addition will overflow, and get the value back to
-       * what it should be.
-       */
-      session.total_raw_in -= res;
+      (void) pr_log_writefile(deflate_logfd, MOD_DEFLATE_VERSION,
+        "%s: deflated %lu bytes to %lu bytes (%0.2lf%% compression)",
+        session.curr_cmd, zstrm->total_in, zstrm->total_out,
+        (1.0 - ratio) * 100.0);
+    }
+
+  } else if (deflate_zstrm_mode == PR_NETIO_IO_RD) {
+    if (zstrm->total_in > 0) {
+      float ratio;
 
-      return res;
+      ratio = ((float) zstrm->total_in / (float) zstrm->total_out);
+
+      (void) pr_log_writefile(deflate_logfd, MOD_DEFLATE_VERSION,
+        "%s: inflated %lu bytes to %lu bytes (%0.2lf%% compression)",
+        session.curr_cmd, zstrm->total_in, zstrm->total_out,
+        (1.0 - ratio) * 100.0);
     }
+  }
 
-    /* If we reach this point, then the deflate_zbuf buffer is empty of
-     * uncompressed data.  We might have some compressed data left over from
-     * the previous inflate() call that we need to process
-     * (i.e. zstrm->avail_in > 0), though.
-     *
-     * Try to read more deta in from the network.  If we get no data, AND
-     * zstrm->avail_in is zero, then we've reached EOF.  Otherwise, add the
-     * new data to the inflator, and see if we can make some progress.
-     */
+  deflate_zstream_end();
+  return res;
+}
 
-    datalen = deflate_rbufsz - deflate_rbuflen;
+static int deflate_filter_read_cb(pr_netio_filter_t *filter,
+    pr_netio_stream_t *nstrm, char *buf, size_t bufsz) {
+  z_stream *zstrm = &deflate_zstrm;
+  size_t copylen;
 
-    /* Read in some data from the stream's fd. */
-    nread = read(nstrm->strm_fd, deflate_rbuf, datalen);
-    if (nread < 0) {
-      xerrno = errno;
+  if (bufsz == 0) {
+    return 0;
+  }
 
-      (void) pr_log_writefile(deflate_logfd, MOD_DEFLATE_VERSION,
-        "error reading from socket %d: %s", nstrm->strm_fd, strerror(xerrno));
+  if (deflate_zstrm_mode != PR_NETIO_IO_RD) {
+    pr_trace_msg(trace_channel, 2,
+      "no zstream found in stream data for reading");
+    errno = EIO;
+    return -1;
+  }
 
-      errno = xerrno;
-      return -1;
+  /* Only read more data from the layer beneath us, and inflate it, once
+   * there is no leftover inflated data in deflate_zbuf.
+   */
+  while (deflate_zbuflen == 0) {
+    if (deflate_zeof) {
+      return 0;
     }
 
-    if (nread == 0) {
-      if (zstrm->avail_in == 0) {
-        /* EOF.  We know we can return zero here because the deflate_zbuf
-         * is empty (see above comment), and we haven't read any more data
-         * in from the network.
-         */
+    if (zstrm->avail_in == 0) {
+      int nread;
+
+      nread = pr_netio_filter_read(filter, nstrm, (char *) deflate_rbuf,
+        deflate_rbufsz, 1);
+      if (nread < 0) {
+        (void) pr_log_writefile(deflate_logfd, MOD_DEFLATE_VERSION,
+          "error reading compressed data: %s", strerror(errno));
+        return nread;
+      }
+
+      if (nread == 0) {
         pr_trace_msg(trace_channel, 8,
           "read: read EOF from client, returning 0");
         return 0;
       }
-    }
 
-    pr_trace_msg(trace_channel, 9,
-      "read: read %d bytes of compressed data from client", nread);
-
-    /* Manually adjust the "raw" bytes in counter, so that it will
-     * be accurate for %I logging.
-     */
-    session.total_raw_in += nread;
-
-    if (zstrm->avail_in > 0) {
       pr_trace_msg(trace_channel, 9,
-        "read: processing %d bytes of leftover compressed data from client, "
-        "plus %d additional new bytes from client", zstrm->avail_in, nread);
+        "read: read %d bytes of compressed data from client", nread);
 
-    } else {
-      pr_trace_msg(trace_channel, 9, "read: processing %d bytes from client",
-        nread);
+      zstrm->next_in = deflate_rbuf;
+      zstrm->avail_in = nread;
     }
 
-    datalen = nread;
-    zstrm->next_in = deflate_rbuf;
-    zstrm->avail_in += datalen;
-
-    copylen = 0;
-
-    zstrm->next_out = deflate_zbuf;
+    zstrm->next_out = deflate_zbuf_ptr;
     zstrm->avail_out = deflate_zbufsz;
 
     pr_trace_msg(trace_channel, 19,
@@ -449,202 +369,97 @@ static int deflate_netio_read_cb(pr_netio_stream_t *nstrm, char *buf,
       zstrm->avail_in, zstrm->avail_out);
 
     deflate_zerrno = inflate(zstrm, Z_SYNC_FLUSH);
-    xerrno = errno;
 
     pr_trace_msg(trace_channel, 19,
       "read: post-inflate zstream state: avail_in = %d, avail_out = %d "
       "(zerrno = %s)", zstrm->avail_in, zstrm->avail_out,
       deflate_zstrerror(deflate_zerrno));
 
-    errno = xerrno;
-
     switch (deflate_zerrno) {
-      case Z_OK:
       case Z_STREAM_END:
-        copylen = deflate_zbufsz - zstrm->avail_out;
-
-        /* Allocate more space for the data if necessary. */
-        if ((deflate_zbuflen + copylen) > deflate_zbufsz) {
-          size_t new_bufsz;
-          Byte *tmp;
-
-          new_bufsz = deflate_zbufsz;
-          while ((deflate_zbuflen + copylen) > new_bufsz) {
-            pr_signals_handle();
-            new_bufsz *= 2;
-          }
-
-          pr_trace_msg(trace_channel, 9,
-            "read: allocated new deflate buffer (size %lu)",
-            (unsigned long) new_bufsz);
-
-          tmp = palloc(session.pool, new_bufsz);
-          memcpy(tmp, deflate_zbuf, deflate_zbuflen);
-
-          deflate_zbuf_ptr = deflate_zbuf = tmp;
-          deflate_zbufsz = new_bufsz;
-        } 
+        deflate_zeof = TRUE;
+        break;
 
+      case Z_OK:
+      case Z_BUF_ERROR:
         break;
 
       default:
         pr_trace_msg(trace_channel, 3,
-          "read: error inflating %lu bytes of data: [%d] %s: %s",
-          (unsigned long) datalen, deflate_zerrno,
+          "read: error inflating data: [%d] %s: %s", deflate_zerrno,
           deflate_zstrerror(deflate_zerrno),
           zstrm->msg ? zstrm->msg : "unavailable");
 
-        errno = xerrno;
         (void) pr_log_writefile(deflate_logfd, MOD_DEFLATE_VERSION,
-          "error inflating %lu bytes of data: [%d] %s",
-          (unsigned long) datalen, deflate_zerrno,
+          "error inflating data: [%d] %s", deflate_zerrno,
           zstrm->msg ? zstrm->msg : deflate_zstrerror(deflate_zerrno));
 
         errno = EIO;
         return -1;
     }
 
+    deflate_zbuf = deflate_zbuf_ptr;
     deflate_zbuflen = deflate_zbufsz - zstrm->avail_out;
-
-    /* Now all we have to do is return EAGAIN, so that the FSIO API calls
-     * us back immediately.  That will hit the check for deflate_zbuflen
-     * earlier in this function, and return the data we just decompressed.
-     */
-    errno = EAGAIN;
-    return -1;
   }
 
-  return read(nstrm->strm_fd, buf, bufsz);
-}
-
-static int deflate_netio_shutdown_cb(pr_netio_stream_t *nstrm, int how) {
-
-  if (nstrm->strm_type == PR_NETIO_STRM_DATA) {
-    int res = 0;
-    z_stream *zstrm;
-
-    zstrm = pr_table_get(nstrm->notes, DEFLATE_NETIO_NOTE, NULL);
-    if (zstrm == NULL) {
-      return 0;
-    }
-
-    if (nstrm->strm_mode == PR_NETIO_IO_WR) {
-      zstrm->next_in = Z_NULL;
-      zstrm->avail_in = 0;
-
-      pr_trace_msg(trace_channel, 19,
-        "shutdown: pre-deflate zstream state: avail_in = %d, avail_out = %d",
-        zstrm->avail_in, zstrm->avail_out);
-
-      deflate_zerrno = deflate(zstrm, Z_FINISH);
-
-      pr_trace_msg(trace_channel, 19,
-        "shutdown: post-inflate zstream state: avail_in = %d, avail_out = %d "
-        "(zerrno = %s)", zstrm->avail_in, zstrm->avail_out,
-        deflate_zstrerror(deflate_zerrno));
-
-      if (deflate_zerrno != Z_OK &&
-          deflate_zerrno != Z_STREAM_END) {
-        pr_trace_msg(trace_channel, 3,
-          "shutdown: error deflating data: [%d] %s: %s", deflate_zerrno,
-          deflate_zstrerror(deflate_zerrno),
-          zstrm->msg ? zstrm->msg : "unavailable");
-
-        (void) pr_log_writefile(deflate_logfd, MOD_DEFLATE_VERSION,
-          "error deflating data: [%d] %s", deflate_zerrno,
-          zstrm->msg ? zstrm->msg : deflate_zstrerror(deflate_zerrno));
-
-      } else {
-        size_t datalen, offset;
-
-        datalen = deflate_zbufsz - zstrm->avail_out;
-        offset = 0;
-
-        while (datalen > 0) {
-          res = write(nstrm->strm_fd, deflate_zbuf + offset, datalen);
-          if (res < 0) {
-            if (errno == EINTR ||
-                errno == EAGAIN) {
-              /* The socket might be busy, especially if the peer is a bit
-               * slow in reading data from it.
-               */
-              pr_signals_handle();
-              continue;
-            }
-
-            (void) pr_log_writefile(deflate_logfd, MOD_DEFLATE_VERSION,
-              "error writing to socket %d: %s", nstrm->strm_fd,
-              strerror(errno));
-            return -1;
-          }
-
-          /* Manually update the "raw" bytes counter, so that it will be
-           * accurate for %O logging.
-           */
-          session.total_raw_out += res;
+  copylen = deflate_zbuflen;
+  if (copylen > bufsz) {
+    copylen = bufsz;
+  }
 
-          /* Watch out for short writes. */
-          if (res == datalen) {
-            break;
-          }
+  pr_trace_msg(trace_channel, 9, "read: returning %lu bytes of "
+    "uncompressed data (of %lu bytes available)", (unsigned long) copylen,
+    (unsigned long) deflate_zbuflen);
 
-          offset += res;
-          datalen -= res;
-        }
-      }
+  memcpy(buf, deflate_zbuf, copylen);
+  deflate_zbuf += copylen;
+  deflate_zbuflen -= copylen;
 
-      return 0;
-    }
-  }
-
-  return shutdown(nstrm->strm_fd, how);
+  return (int) copylen;
 }
 
-static int deflate_netio_write_cb(pr_netio_stream_t *nstrm, char *buf,
-    size_t buflen) {
+static int deflate_filter_write_cb(pr_netio_filter_t *filter,
+    pr_netio_stream_t *nstrm, char *buf, size_t buflen) {
+  z_stream *zstrm = &deflate_zstrm;
 
   if (buflen == 0) {
     return 0;
   }
 
-  if (nstrm->strm_type == PR_NETIO_STRM_DATA) {
-    int res = 0, xerrno;
-    size_t datalen, offset = 0;
-    z_stream *zstrm;
+  if (deflate_zstrm_mode != PR_NETIO_IO_WR) {
+    pr_trace_msg(trace_channel, 2,
+      "no zstream found in stream data for writing");
+    errno = EIO;
+    return -1;
+  }
 
-    zstrm = pr_table_get(nstrm->notes, DEFLATE_NETIO_NOTE, NULL);
-    if (zstrm == NULL) {
-      pr_trace_msg(trace_channel, 2,
-        "no zstream found in stream data for writing");
-      errno = EIO;
-      return -1;
-    }
+  /* Deflate the data to be written out. */
+  zstrm->next_in = (Bytef *) buf;
+  zstrm->avail_in = buflen;
 
-    /* Deflate the data to be written out. */
-    zstrm->next_in = (Bytef *) buf;
-    zstrm->avail_in = buflen;
+  do {
+    size_t datalen;
+
+    zstrm->next_out = deflate_zbuf_ptr;
+    zstrm->avail_out = deflate_zbufsz;
 
     pr_trace_msg(trace_channel, 19,
       "write: pre-deflate zstream state: avail_in = %d, avail_out = %d",
       zstrm->avail_in, zstrm->avail_out);
 
     deflate_zerrno = deflate(zstrm, Z_SYNC_FLUSH);
-    xerrno = errno;
 
     pr_trace_msg(trace_channel, 19,
-      "write: post-inflate zstream state: avail_in = %d, avail_out = %d "
+      "write: post-deflate zstream state: avail_in = %d, avail_out = %d "
       "(zerrno = %s)", zstrm->avail_in, zstrm->avail_out,
       deflate_zstrerror(deflate_zerrno));
 
-    errno = xerrno;
-
-    if (deflate_zerrno != Z_OK) {
+    if (deflate_zerrno != Z_OK &&
+        deflate_zerrno != Z_BUF_ERROR) {
       pr_trace_msg(trace_channel, 3, "write: error deflating data: [%d] %s: %s",
         deflate_zerrno, deflate_zstrerror(deflate_zerrno),
         zstrm->msg ? zstrm->msg : "unavailable");
 
-      errno = xerrno;
-
       (void) pr_log_writefile(deflate_logfd, MOD_DEFLATE_VERSION,
         "error deflating data: [%d] %s", deflate_zerrno,
         zstrm->msg ? zstrm->msg : deflate_zstrerror(deflate_zerrno));
@@ -654,66 +469,21 @@ static int deflate_netio_write_cb(pr_netio_stream_t *nstrm, char *buf,
     }
 
     datalen = deflate_zbufsz - zstrm->avail_out;
-
-    while (datalen > 0) {
-      pr_signals_handle();
-
-      res = write(nstrm->strm_fd, deflate_zbuf + offset, datalen);
-      if (res < 0) {
-        if (errno == EINTR ||
-            errno == EAGAIN) {
-          /* The socket might be busy, especially if the peer is a bit
-           * slow in reading data from it.
-           */
-          pr_signals_handle();
-          continue;
-        }
-
-        (void) pr_log_writefile(deflate_logfd, MOD_DEFLATE_VERSION,
-          "error writing to socket %d: %s", nstrm->strm_fd, strerror(errno));
-        return -1;
-      }
-
-      /* Manually adjust the "raw" bytes counter, so that it will be
-       * accurate for %O logging.
-       */
-      session.total_raw_out += res;
-
+    if (datalen > 0 &&
+        pr_netio_filter_write(filter, nstrm, (char *) deflate_zbuf_ptr,
+          datalen) < 0) {
       (void) pr_log_writefile(deflate_logfd, MOD_DEFLATE_VERSION,
-        "wrote %d (of %lu) bytes of compressed of data to socket %d", res,
-        (unsigned long) datalen, nstrm->strm_fd);
-
-      /* Watch out for short writes */
-      if (res == datalen) {
-        zstrm->next_out = deflate_zbuf;
-        zstrm->avail_out = deflate_zbufsz;
-        break;
-
-      } else {
-        offset += res;
-        datalen -= res;
-      }
+        "error writing compressed data: %s", strerror(errno));
+      return -1;
     }
 
-    /* Manually adjust the "raw" bytes in counter, so that it will
-     * be accurate for %O logging.
-     *
-     * We subtract the number we are returning here, since our return
-     * value will simply be added back to the counter in pr_netio_write().
-     * And if our subtraction causes an underflow, it's still OK since
-     * the subsequent addition will overflow, and get the value back to
-     * what it should be.
-     */
-
-    res = (buflen - zstrm->avail_in);
-    session.total_raw_out -= res;
-
-    pr_trace_msg(trace_channel, 9, "write: returning %d for %lu bytes",
-      res, (unsigned long) buflen);
-    return res;
-  }
+    /* If deflate() filled the buffer, there may be more output pending. */
+  } while (zstrm->avail_in > 0 ||
+           zstrm->avail_out == 0);
 
-  return write(nstrm->strm_fd, buf, buflen);
+  pr_trace_msg(trace_channel, 9, "write: deflated %lu bytes",
+    (unsigned long) buflen);
+  return (int) buflen;
 }
 
 /* Configuration handlers
@@ -834,42 +604,26 @@ MODRET deflate_mode(cmd_rec *cmd) {
   cmd->argv[1][0] = toupper(cmd->argv[1][0]);
 
   if (cmd->argv[1][0] == 'Z') {
-    if (session.rfc2228_mech) {
-      (void) pr_log_writefile(deflate_logfd, MOD_DEFLATE_VERSION,
-        "declining MODE Z (RFC2228 mechanism '%s' in effect)",
-        session.rfc2228_mech);
-      pr_log_debug(DEBUG2, MOD_DEFLATE_VERSION
-        ": declining MODE Z (RFC2228 mechanism '%s' in effect)",
-        session.rfc2228_mech);
-
-      pr_response_add_err(R_504, _("Unable to handle MODE Z at this time"));
-      return PR_ERROR(cmd);
-    }
-
     if (deflate_enabled) {
       pr_response_add(R_200, _("OK"));
       return PR_HANDLED(cmd);
     }
 
-    /* Need to install some sort of NetIO handlers here, to handle
-     * compression.
-     */
-
-    deflate_netio = pr_alloc_netio2(session.pool, &deflate_module);
-    deflate_netio->close = deflate_netio_close_cb;
-    deflate_netio->open = deflate_netio_open_cb;
-    deflate_netio->read = deflate_netio_read_cb;
-    deflate_netio->shutdown = deflate_netio_shutdown_cb;
-    deflate_netio->write = deflate_netio_write_cb;
-
-    /* XXX Report on any previously registered NetIO streams (e.g. mod_tls)?
-     * Doing so would require a new pr_netio_ function, e.g. pr_netio_get().
+    /* Compression is done by a NetIO filter; it sits on top of any block
+     * mode framing (MODE B), and any NetIO (e.g. mod_tls) beneath that.
      */
-    pr_unregister_netio(PR_NETIO_STRM_DATA);
+    if (deflate_filter == NULL) {
+      deflate_filter = pr_alloc_netio_filter(session.pool, &deflate_module,
+        "deflate");
+      deflate_filter->start = deflate_filter_start_cb;
+      deflate_filter->finish = deflate_filter_finish_cb;
+      deflate_filter->read = deflate_filter_read_cb;
+      deflate_filter->write = deflate_filter_write_cb;
+    }
 
-    if (pr_register_netio(deflate_netio, PR_NETIO_STRM_DATA) < 0) {
+    if (pr_push_netio_filter(deflate_filter, PR_NETIO_STRM_DATA) < 0) {
       (void) pr_log_writefile(deflate_logfd, MOD_DEFLATE_VERSION,
-        "error registering netio: %s", strerror(errno));
+        "error adding netio filter: %s", strerror(errno));
 
     } else {
       deflate_enabled = TRUE;
@@ -880,24 +634,17 @@ MODRET deflate_mode(cmd_rec *cmd) {
 
   } else {
     if (deflate_enabled) {
-      /* Switch to some other transmission mode.  Remove our NetIO.
-       * XXX Ideally, we would restore the previous NetIO.
-       */
-
-      if (pr_unregister_netio(PR_NETIO_STRM_DATA) < 0) {
+      /* Switch to some other transmission mode.  Remove our filter. */
+      if (pr_remove_netio_filter(PR_NETIO_STRM_DATA, "deflate") < 0) {
         (void) pr_log_writefile(deflate_logfd, MOD_DEFLATE_VERSION,
-          "error unregistering netio: %s", strerror(errno));
+          "error removing netio filter: %s", strerror(errno));
 
       } else {
         (void) pr_log_writefile(deflate_logfd, MOD_DEFLATE_VERSION,
-          "%s %s: unregistered netio", cmd->argv[0], cmd->argv[1]);
-      }
-
-      if (deflate_netio) {
-        destroy_pool(deflate_netio->pool);
-        deflate_netio = NULL;
+          "%s %s: removed netio filter", cmd->argv[0], cmd->argv[1]);
       }
 
+      deflate_zstream_end();
       deflate_enabled = FALSE;
     }
   }
@@ -969,7 +716,6 @@ static int deflate_sess_init(void) {
 
   deflate_rbufsz = pr_config_get_xfer_bufsz();
   deflate_rbuf = palloc(session.pool, deflate_rbufsz);
-  deflate_rbuflen = 0;
 
   return 0;
 }
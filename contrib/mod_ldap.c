@@ -42,6 +42,8 @@
 #include <lber.h>
 #include <ldap.h>
 
+module ldap_module;
+
 static int ldap_logfd = -1;
 
 #if LDAP_API_VERSION >= 2000
@@ -173,9 +175,34 @@ static gid_t ldap_defaultgid = -1;
 static int ldap_use_tls = 0;
 #endif
 
+static unsigned long ldap_opts = 0UL;
+#define PR_LDAP_OPT_COMBINED_USER_LOOKUP	0x0001
+#define PR_LDAP_OPT_PERSISTENT_CONNECTION	0x0002
+
 static LDAP *ld = NULL;
+
+/* Set when the (persistent) connection was last bound as a user, for an
+ * auth bind, rather than as the LDAPBindDN.
+ */
+static int ld_bound_as_user = FALSE;
+
 static array_header *cached_quota = NULL;
 static array_header *cached_ssh_pubkeys = NULL;
+static char *cached_ssh_pubkeys_user = NULL;
+
+/* Cache of the user and group entries found (or not found, in which case
+ * both pw and gr are NULL) by this session, for LDAPCacheTTL seconds.  The
+ * entries are keyed by search base and filter.
+ */
+struct ldap_cache_entry {
+  time_t expires;
+  char *dn;
+  struct passwd *pw;
+  struct group *gr;
+};
+
+static int ldap_cache_ttl = 0;
+static pr_table_t *ldap_cache = NULL;
 
 static void pr_ldap_unbind(void) {
   int res;
@@ -197,13 +224,38 @@ static void pr_ldap_unbind(void) {
   }
 
   ld = NULL;
+  ld_bound_as_user = FALSE;
 }
 
-static int do_ldap_connect(LDAP **conn_ld, int do_bind) {
-  int res, version;
+static int do_ldap_bind(LDAP *conn_ld) {
+  int res;
 #ifdef HAS_LDAP_SASL_BIND_S
   struct berval bindcred;
-#endif
+
+  bindcred.bv_val = ldap_dnpass;
+  bindcred.bv_len = ldap_dnpass != NULL ? strlen(ldap_dnpass) : 0;
+  res = ldap_sasl_bind_s(conn_ld, ldap_dn, NULL, &bindcred, NULL, NULL,
+    NULL);
+#else /* HAS_LDAP_SASL_BIND_S */
+  res = ldap_simple_bind_s(conn_ld, ldap_dn, ldap_dnpass);
+#endif /* HAS_LDAP_SASL_BIND_S */
+
+  if (res != LDAP_SUCCESS) {
+    (void) pr_log_writefile(ldap_logfd, MOD_LDAP_VERSION,
+      "bind as DN '%s' failed: %s", ldap_dn ? ldap_dn : "(anonymous)",
+      ldap_err2string(res));
+    return -1;
+  }
+
+  (void) pr_log_writefile(ldap_logfd, MOD_LDAP_VERSION,
+    "successfully bound as DN '%s' with password %s",
+    ldap_dn ? ldap_dn : "(anonymous)",
+    ldap_dnpass ? "(see config)" : "(none)");
+  return 0;
+}
+
+static int do_ldap_connect(LDAP **conn_ld, int do_bind) {
+  int res, version;
 
 #ifdef HAS_LDAP_INITIALIZE
   (void) pr_log_writefile(ldap_logfd, MOD_LDAP_VERSION,
@@ -254,6 +306,22 @@ static int do_ldap_connect(LDAP **conn_ld, int do_bind) {
   (void) pr_log_writefile(ldap_logfd, MOD_LDAP_VERSION,
     "set LDAP protocol version to %d", version);
 
+#ifdef LDAP_OPT_X_KEEPALIVE_IDLE
+  if (ldap_opts & PR_LDAP_OPT_PERSISTENT_CONNECTION) {
+    int idle = 60;
+
+    /* Have TCP keepalives detect a dead persistent connection, and keep
+     * any firewall state for it alive, while the session is idle.
+     */
+    res = ldap_set_option(*conn_ld, LDAP_OPT_X_KEEPALIVE_IDLE, &idle);
+    if (res != LDAP_OPT_SUCCESS) {
+      (void) pr_log_writefile(ldap_logfd, MOD_LDAP_VERSION,
+        "error setting LDAP keepalive idle option to %d: %s", idle,
+        ldap_err2string(res));
+    }
+  }
+#endif /* LDAP_OPT_X_KEEPALIVE_IDLE */
+
 #ifdef HAS_LDAP_INITIALIZE
   (void) pr_log_writefile(ldap_logfd, MOD_LDAP_VERSION,
     "connected to URL %s", ldap_server_url ? ldap_server_url : "(null)");
@@ -279,27 +347,10 @@ static int do_ldap_connect(LDAP **conn_ld, int do_bind) {
 #endif /* LDAP_OPT_X_TLS */
 
   if (do_bind == TRUE) {
-#ifdef HAS_LDAP_SASL_BIND_S
-    bindcred.bv_val = ldap_dnpass;
-    bindcred.bv_len = ldap_dnpass != NULL ? strlen(ldap_dnpass) : 0;
-    res = ldap_sasl_bind_s(*conn_ld, ldap_dn, NULL, &bindcred, NULL, NULL,
-      NULL);
-#else /* HAS_LDAP_SASL_BIND_S */
-    res = ldap_simple_bind_s(*conn_ld, ldap_dn, ldap_dnpass);
-#endif /* HAS_LDAP_SASL_BIND_S */
-
-    if (res != LDAP_SUCCESS) {
-      (void) pr_log_writefile(ldap_logfd, MOD_LDAP_VERSION,
-        "bind as DN '%s' failed: %s", ldap_dn ? ldap_dn : "(anonymous)",
-        ldap_err2string(res));
+    if (do_ldap_bind(*conn_ld) < 0) {
       pr_ldap_unbind();
       return -1;
     }
-
-    (void) pr_log_writefile(ldap_logfd, MOD_LDAP_VERSION,
-      "successfully bound as DN '%s' with password %s",
-      ldap_dn ? ldap_dn : "(anonymous)",
-      ldap_dnpass ? "(see config)" : "(none)");
   }
 
 #ifdef LDAP_OPT_DEREF
@@ -465,6 +516,17 @@ static LDAPMessage *pr_ldap_search(char *basedn, char *filter, char *attrs[],
     if (pr_ldap_connect(&ld, TRUE) == -1) {
       return NULL;
     }
+
+  } else if (ld_bound_as_user == TRUE) {
+    /* The connection was used for an auth bind; bind as the LDAPBindDN
+     * again before searching.
+     */
+    if (do_ldap_bind(ld) < 0) {
+      pr_ldap_unbind();
+      return NULL;
+    }
+
+    ld_bound_as_user = FALSE;
   }
 
   res = LDAP_SEARCH(ld, basedn, ldap_search_scope, filter, attrs,
@@ -496,11 +558,110 @@ static LDAPMessage *pr_ldap_search(char *basedn, char *filter, char *attrs[],
   return result;
 }
 
+static struct ldap_cache_entry *ldap_cache_get(const char *key) {
+  struct ldap_cache_entry *lce;
+
+  if (ldap_cache == NULL) {
+    return NULL;
+  }
+
+  lce = pr_table_get(ldap_cache, key, NULL);
+  if (lce == NULL) {
+    return NULL;
+  }
+
+  if (lce->expires <= time(NULL)) {
+    (void) pr_table_remove(ldap_cache, key, NULL);
+    return NULL;
+  }
+
+  return lce;
+}
+
+static void ldap_cache_add(const char *key, char *dn, struct passwd *pw,
+    struct group *gr) {
+  struct ldap_cache_entry *lce;
+
+  if (ldap_cache_ttl <= 0) {
+    return;
+  }
+
+  if (ldap_cache == NULL) {
+    ldap_cache = pr_table_alloc(session.pool, 0);
+  }
+
+  lce = pcalloc(session.pool, sizeof(struct ldap_cache_entry));
+  lce->expires = time(NULL) + ldap_cache_ttl;
+  lce->dn = dn ? pstrdup(session.pool, dn) : NULL;
+
+  /* Cache copies, as the callers may modify the structs they are given. */
+  if (pw != NULL) {
+    lce->pw = pcalloc(session.pool, sizeof(struct passwd));
+    memcpy(lce->pw, pw, sizeof(struct passwd));
+  }
+
+  if (gr != NULL) {
+    lce->gr = pcalloc(session.pool, sizeof(struct group));
+    memcpy(lce->gr, gr, sizeof(struct group));
+  }
+
+  (void) pr_table_remove(ldap_cache, key, NULL);
+  if (pr_table_add(ldap_cache, pstrdup(session.pool, key), lce,
+      sizeof(struct ldap_cache_entry)) < 0) {
+    (void) pr_log_writefile(ldap_logfd, MOD_LDAP_VERSION,
+      "error caching entry: %s", strerror(errno));
+  }
+}
+
+static void parse_quota(pool *p, const char *replace, char *str);
+
+/* Picks the quota and SSH public key attributes, requested along with the
+ * user attributes by CombinedUserLookup, out of the user's entry, so that
+ * the later quota and publickey lookups need not search for them again.
+ */
+static void pr_ldap_parse_user_extras(LDAPMessage *e, const char *user) {
+  LDAP_VALUE_T **values;
+
+  values = LDAP_GET_VALUES(ld, e, ldap_attr_ftpquota);
+  if (values != NULL) {
+    parse_quota(session.pool, user,
+      pstrdup(session.pool, LDAP_VALUE(values, 0)));
+    LDAP_VALUE_FREE(values);
+
+  } else {
+    /* A quota profile DN is only searched for when the quota is needed. */
+    values = LDAP_GET_VALUES(ld, e, ldap_attr_ftpquota_profiledn);
+    if (values != NULL) {
+      LDAP_VALUE_FREE(values);
+
+    } else if (ldap_default_quota != NULL) {
+      parse_quota(session.pool, user,
+        pstrdup(session.pool, ldap_default_quota));
+    }
+  }
+
+  values = LDAP_GET_VALUES(ld, e, ldap_attr_ssh_pubkey);
+  if (values != NULL) {
+    int num_keys, i;
+
+    num_keys = LDAP_COUNT_VALUES(values);
+    cached_ssh_pubkeys = make_array(session.pool, num_keys, sizeof(char *));
+    for (i = 0; i < num_keys; ++i) {
+      *((char **) push_array(cached_ssh_pubkeys)) = pstrdup(session.pool,
+        LDAP_VALUE(values, i));
+    }
+    cached_ssh_pubkeys_user = pstrdup(session.pool, user);
+
+    LDAP_VALUE_FREE(values);
+  }
+}
+
 static struct passwd *pr_ldap_user_lookup(pool *p, char *filter_template,
     const char *replace, char *basedn, char *attrs[], char **user_dn) {
-  char *filter, *dn;
-  int i = 0;
+  char *filter, *dn, *key, **search_attrs;
+  int i = 0, combined = FALSE;
   struct passwd *pw;
+  struct ldap_cache_entry *lce;
   LDAPMessage *result, *e;
   LDAP_VALUE_T **values;
 
@@ -509,7 +670,52 @@ static struct passwd *pr_ldap_user_lookup(pool *p, char *filter_template,
     return NULL;
   }
 
-  result = pr_ldap_search(basedn, filter, attrs, 2, TRUE);
+  key = pstrcat(p, "user ", basedn, " ", filter, " ", attrs[0], NULL);
+  lce = ldap_cache_get(key);
+  if (lce != NULL) {
+    (void) pr_log_writefile(ldap_logfd, MOD_LDAP_VERSION,
+      "using cached %s for filter %s under base DN %s",
+      lce->pw ? "entry" : "lack of entries", filter, basedn);
+
+    if (lce->pw == NULL) {
+      return NULL;
+    }
+
+    if (user_dn) {
+      *user_dn = lce->dn;
+    }
+
+    pw = pcalloc(session.pool, sizeof(struct passwd));
+    memcpy(pw, lce->pw, sizeof(struct passwd));
+    return pw;
+  }
+
+  search_attrs = attrs;
+
+  if ((ldap_opts & PR_LDAP_OPT_COMBINED_USER_LOOKUP) &&
+      filter_template == ldap_user_name_filter) {
+    register unsigned int j;
+    unsigned int nattrs = 0;
+
+    /* Fetch the quota and SSH public key attributes in the same search. */
+    while (attrs[nattrs] != NULL) {
+      nattrs++;
+    }
+
+    search_attrs = pcalloc(p, sizeof(char *) * (nattrs + 4));
+    for (j = 0; j < nattrs; j++) {
+      search_attrs[j] = attrs[j];
+    }
+
+    search_attrs[j++] = ldap_attr_ftpquota;
+    search_attrs[j++] = ldap_attr_ftpquota_profiledn;
+    search_attrs[j++] = ldap_attr_ssh_pubkey;
+    search_attrs[j] = NULL;
+
+    combined = TRUE;
+  }
+
+  result = pr_ldap_search(basedn, filter, search_attrs, 2, TRUE);
   if (result == NULL) {
     return NULL;
   }
@@ -529,6 +735,7 @@ static struct passwd *pr_ldap_user_lookup(pool *p, char *filter_template,
     /* No LDAP entries for this user. */
     (void) pr_log_writefile(ldap_logfd, MOD_LDAP_VERSION,
       "no entries for filter %s under base DN %s", filter, basedn);
+    ldap_cache_add(key, NULL, NULL, NULL);
     return NULL;
   }
 
@@ -736,8 +943,14 @@ static struct passwd *pr_ldap_user_lookup(pool *p, char *filter_template,
     *user_dn = ldap_get_dn(ld, e);
   }
 
+  if (combined) {
+    pr_ldap_parse_user_extras(e, replace);
+  }
+
   ldap_msgfree(result);
 
+  ldap_cache_add(key, user_dn ? *user_dn : NULL, pw, NULL);
+
   (void) pr_log_writefile(ldap_logfd, MOD_LDAP_VERSION,
     "found user %s, UID %lu, GID %lu, homedir %s, shell %s",
     pw->pw_name, (unsigned long) pw->pw_uid, (unsigned long) pw->pw_gid,
@@ -747,9 +960,10 @@ static struct passwd *pr_ldap_user_lookup(pool *p, char *filter_template,
 
 static struct group *pr_ldap_group_lookup(pool *p, char *filter_template,
     const char *replace, char *attrs[]) {
-  char *filter, *dn;
+  char *filter, *dn, *key;
   int i = 0, value_count = 0, value_offset;
   struct group *gr;
+  struct ldap_cache_entry *lce;
   LDAPMessage *result, *e;
   LDAP_VALUE_T **values;
 
@@ -764,6 +978,22 @@ static struct group *pr_ldap_group_lookup(pool *p, char *filter_template,
     return NULL;
   }
 
+  key = pstrcat(p, "group ", ldap_gid_basedn, " ", filter, NULL);
+  lce = ldap_cache_get(key);
+  if (lce != NULL) {
+    (void) pr_log_writefile(ldap_logfd, MOD_LDAP_VERSION,
+      "using cached %s for filter %s under base DN %s",
+      lce->gr ? "entry" : "lack of entries", filter, ldap_gid_basedn);
+
+    if (lce->gr == NULL) {
+      return NULL;
+    }
+
+    gr = pcalloc(session.pool, sizeof(struct group));
+    memcpy(gr, lce->gr, sizeof(struct group));
+    return gr;
+  }
+
   result = pr_ldap_search(ldap_gid_basedn, filter, attrs, 2, TRUE);
   if (result == NULL) {
     return NULL;
@@ -776,6 +1006,7 @@ static struct group *pr_ldap_group_lookup(pool *p, char *filter_template,
     /* No LDAP entries found for this user. */
     (void) pr_log_writefile(ldap_logfd, MOD_LDAP_VERSION,
       "no group entries for filter %s", filter);
+    ldap_cache_add(key, NULL, NULL, NULL);
     return NULL;
   }
 
@@ -834,6 +1065,8 @@ static struct group *pr_ldap_group_lookup(pool *p, char *filter_template,
 
   ldap_msgfree(result);
 
+  ldap_cache_add(key, NULL, NULL, gr);
+
   (void) pr_log_writefile(ldap_logfd, MOD_LDAP_VERSION,
     "found group %s, GID %lu", gr->gr_name, (unsigned long) gr->gr_gid);
   for (i = 0; i < value_count; ++i) {
@@ -848,7 +1081,7 @@ static void parse_quota(pool *p, const char *replace, char *str) {
   char **elts, *token;
 
   if (cached_quota == NULL) {
-    cached_quota = make_array(p, 9, sizeof(char *));
+    cached_quota = make_array(session.pool, 9, sizeof(char *));
   }
 
   elts = (char **) cached_quota->elts;
@@ -1039,11 +1272,12 @@ static unsigned char pr_ldap_ssh_pubkey_lookup(pool *p, char *filter_template,
   }
 
   num_keys = LDAP_COUNT_VALUES(values);
-  cached_ssh_pubkeys = make_array(p, num_keys, sizeof(char *));
+  cached_ssh_pubkeys = make_array(session.pool, num_keys, sizeof(char *));
   for (i = 0; i < num_keys; ++i) {
-    *((char **) push_array(cached_ssh_pubkeys)) = pstrdup(p,
+    *((char **) push_array(cached_ssh_pubkeys)) = pstrdup(session.pool,
       LDAP_VALUE(values, i));
   }
+  cached_ssh_pubkeys_user = pstrdup(session.pool, replace);
   LDAP_VALUE_FREE(values);
 
   ldap_msgfree(result);
@@ -1153,7 +1387,7 @@ MODRET handle_ldap_ssh_pubkey_lookup(cmd_rec *cmd) {
   }
 
   if (cached_ssh_pubkeys != NULL &&
-      strcasecmp(((char **) cached_ssh_pubkeys->elts)[0], cmd->argv[0]) == 0) {
+      strcasecmp(cached_ssh_pubkeys_user, cmd->argv[0]) == 0) {
 
     (void) pr_log_writefile(ldap_logfd, MOD_LDAP_VERSION,
       "returning cached SSH public keys for user %s", cmd->argv[0]);
@@ -1187,6 +1421,13 @@ MODRET ldap_auth_endpwent(cmd_rec *cmd) {
     return PR_DECLINED(cmd);
   }
 
+  if (ldap_opts & PR_LDAP_OPT_PERSISTENT_CONNECTION) {
+    /* Keep the connection for the next lookups; it is unbound when the
+     * session ends.
+     */
+    return PR_HANDLED(cmd);
+  }
+
   pr_ldap_unbind();
   return PR_HANDLED(cmd);
 }
@@ -1457,7 +1698,21 @@ MODRET ldap_auth_check(cmd_rec *cmd) {
       return PR_DECLINED(cmd);
     }
 
-    if (pr_ldap_connect(&ld_auth, FALSE) == -1) {
+    if (ldap_opts & PR_LDAP_OPT_PERSISTENT_CONNECTION) {
+      /* Bind as the user on the persistent connection, rather than opening
+       * another connection just for this bind.
+       */
+      if (ld == NULL &&
+          pr_ldap_connect(&ld, FALSE) == -1) {
+        (void) pr_log_writefile(ldap_logfd, MOD_LDAP_VERSION,
+          "unable to check login: LDAP connection failed");
+        return PR_DECLINED(cmd);
+      }
+
+      ld_auth = ld;
+      ld_bound_as_user = TRUE;
+
+    } else if (pr_ldap_connect(&ld_auth, FALSE) == -1) {
       (void) pr_log_writefile(ldap_logfd, MOD_LDAP_VERSION,
         "unable to check login: LDAP connection failed");
       return PR_DECLINED(cmd);
@@ -1481,11 +1736,15 @@ MODRET ldap_auth_check(cmd_rec *cmd) {
 
       (void) pr_log_writefile(ldap_logfd, MOD_LDAP_VERSION,
         "invalid credentials used for %s", ldap_authbind_dn);
-      LDAP_UNBIND(ld_auth);
+      if (ld_auth != ld) {
+        LDAP_UNBIND(ld_auth);
+      }
       return PR_ERROR(cmd);
     }
 
-    LDAP_UNBIND(ld_auth);
+    if (ld_auth != ld) {
+      LDAP_UNBIND(ld_auth);
+    }
     session.auth_mech = "mod_ldap.c";
     return PR_HANDLED(cmd);
   }
@@ -1607,6 +1866,39 @@ MODRET set_ldaplog(cmd_rec *cmd) {
   return PR_HANDLED(cmd);
 }
 
+/* usage: LDAPOptions opt1 ... */
+MODRET set_ldapoptions(cmd_rec *cmd) {
+  config_rec *c;
+  unsigned long opts = 0UL;
+  register unsigned int i;
+
+  if (cmd->argc-1 == 0) {
+    CONF_ERROR(cmd, "wrong number of parameters");
+  }
+
+  CHECK_CONF(cmd, CONF_ROOT|CONF_VIRTUAL|CONF_GLOBAL);
+
+  c = add_config_param(cmd->argv[0], 1, NULL);
+
+  for (i = 1; i < cmd->argc; i++) {
+    if (strcasecmp(cmd->argv[i], "CombinedUserLookup") == 0) {
+      opts |= PR_LDAP_OPT_COMBINED_USER_LOOKUP;
+
+    } else if (strcasecmp(cmd->argv[i], "PersistentConnection") == 0) {
+      opts |= PR_LDAP_OPT_PERSISTENT_CONNECTION;
+
+    } else {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "unknown LDAPOption '",
+        cmd->argv[i], "'", NULL));
+    }
+  }
+
+  c->argv[0] = pcalloc(c->pool, sizeof(unsigned long));
+  *((unsigned long *) c->argv[0]) = opts;
+
+  return PR_HANDLED(cmd);
+}
+
 MODRET set_ldapprotoversion(cmd_rec *cmd) {
   int i = 0;
   config_rec *c;
@@ -1821,6 +2113,26 @@ MODRET set_ldapauthbinds(cmd_rec *cmd) {
   return PR_HANDLED(cmd);
 }
 
+/* usage: LDAPCacheTTL secs */
+MODRET set_ldapcachettl(cmd_rec *cmd) {
+  config_rec *c;
+  int ttl;
+
+  CHECK_ARGS(cmd, 1);
+  CHECK_CONF(cmd, CONF_ROOT|CONF_VIRTUAL|CONF_GLOBAL);
+
+  if (pr_str_get_duration(cmd->argv[1], &ttl) < 0) {
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "error parsing TTL value '",
+      cmd->argv[1], "': ", strerror(errno), NULL));
+  }
+
+  c = add_config_param(cmd->argv[0], 1, NULL);
+  c->argv[0] = pcalloc(c->pool, sizeof(int));
+  *((int *) c->argv[0]) = ttl;
+
+  return PR_HANDLED(cmd);
+}
+
 MODRET set_ldapdefaultauthscheme(cmd_rec *cmd) {
   CHECK_ARGS(cmd, 1);
   CHECK_CONF(cmd, CONF_ROOT|CONF_VIRTUAL|CONF_GLOBAL);
@@ -2042,6 +2354,15 @@ MODRET set_ldapdefaultquota(cmd_rec *cmd) {
   return PR_HANDLED(cmd);
 }
 
+/* Event handlers
+ */
+
+static void ldap_exit_ev(const void *event_data, void *user_data) {
+  if (ld != NULL) {
+    pr_ldap_unbind();
+  }
+}
+
 /* Initialization routines
  */
 
@@ -2099,6 +2420,20 @@ static int ldap_sess_init(void) {
     ldap_protocol_version = *((int *) ptr);
   }
 
+  ptr = get_param_ptr(main_server->conf, "LDAPOptions", FALSE);
+  if (ptr) {
+    ldap_opts = *((unsigned long *) ptr);
+  }
+
+  ptr = get_param_ptr(main_server->conf, "LDAPCacheTTL", FALSE);
+  if (ptr) {
+    ldap_cache_ttl = *((int *) ptr);
+  }
+
+  if (ldap_opts & PR_LDAP_OPT_PERSISTENT_CONNECTION) {
+    pr_event_register(&ldap_module, "core.exit", ldap_exit_ev, NULL);
+  }
+
   c = find_config(main_server->conf, CONF_PARAM, "LDAPServer", FALSE);
   if (c != NULL) {
     ldap_servers = c->argv[0];
@@ -2303,6 +2638,7 @@ static conftable ldap_conftab[] = {
   { "LDAPAttr",			set_ldapattr,			NULL },
   { "LDAPAuthBinds",		set_ldapauthbinds,		NULL },
   { "LDAPBindDN",		set_ldapdninfo,			NULL },
+  { "LDAPCacheTTL",		set_ldapcachettl,		NULL },
   { "LDAPDefaultAuthScheme",	set_ldapdefaultauthscheme,	NULL },
   { "LDAPDefaultGID",		set_ldapdefaultgid,		NULL },
   { "LDAPDefaultQuota",		set_ldapdefaultquota,		NULL },
@@ -2316,6 +2652,7 @@ static conftable ldap_conftab[] = {
 				set_ldapgenhdirprefixnouname,	NULL },
   { "LDAPGroups",		set_ldapgrouplookups,		NULL },
   { "LDAPLog",			set_ldaplog,			NULL },
+  { "LDAPOptions",		set_ldapoptions,		NULL },
   { "LDAPProtocolVersion",	set_ldapprotoversion,		NULL },
   { "LDAPQueryTimeout",		set_ldapquerytimeout,		NULL },
   { "LDAPSearchScope",		set_ldapsearchscope,		NULL },
@@ -441,9 +441,11 @@ static int setup_env(pool *p, char *user) {
   c = find_config(main_server->conf, CONF_PARAM, "TransferLog", FALSE);
   if (c == NULL) {
     xferlog = PR_XFERLOG_PATH;
+    xferlog_set_format(PR_XFERLOG_FMT_TEXT);
 
   } else {
     xferlog = c->argv[0];
+    xferlog_set_format(*((int *) c->argv[1]));
   }
 
   if (strncasecmp(xferlog, "none", 5) == 0) {
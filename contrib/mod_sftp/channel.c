@@ -111,8 +111,13 @@ static struct ssh2_channel *alloc_channel(const char *type,
 
   chan->local_channel_id = channelno++;
 
+  /* When auto-tuning, the configured window is the starting point; the
+   * window only ever grows above it.
+   */
   chan->local_windowsz = chan_window_size;
+  chan->local_max_windowsz = chan->local_windowsz;
   chan->local_max_packetsz = chan_packet_size;
+  gettimeofday(&(chan->window_adjust_ts), NULL);
 
   chan->remote_channel_id = remote_channel_id;
   chan->remote_windowsz = remote_windowsz;
@@ -128,6 +133,31 @@ static struct ssh2_channel *alloc_channel(const char *type,
   return chan;
 }
 
+static void log_channel_window_stats(struct ssh2_channel *chan) {
+  if (chan->total_recvd_bytes == 0) {
+    return;
+  }
+
+  pr_trace_msg(trace_channel, 8, "channel ID %lu window stats: received %"
+    PR_LU " bytes, sent %u window adjusts, window grew %u %s to %lu bytes, "
+    "last RTT %lu usecs", (unsigned long) chan->local_channel_id,
+    (pr_off_t) chan->total_recvd_bytes, chan->window_adjust_count,
+    chan->window_grow_count, chan->window_grow_count != 1 ? "times" : "time",
+    (unsigned long) chan->local_max_windowsz,
+    (unsigned long) chan->window_rtt_usecs);
+
+  if (sftp_opts & SFTP_OPT_AUTO_CHANNEL_WINDOW) {
+    (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
+      "channel ID %lu: received %" PR_LU " bytes, %u window adjusts, "
+      "window grew %u %s to %lu bytes (last RTT %lu usecs)",
+      (unsigned long) chan->local_channel_id,
+      (pr_off_t) chan->total_recvd_bytes, chan->window_adjust_count,
+      chan->window_grow_count, chan->window_grow_count != 1 ? "times" : "time",
+      (unsigned long) chan->local_max_windowsz,
+      (unsigned long) chan->window_rtt_usecs);
+  }
+}
+
 static void destroy_channel(uint32_t channel_id) {
   register unsigned int i;
   struct ssh2_channel **chans;
@@ -152,6 +182,7 @@ static void destroy_channel(uint32_t channel_id) {
           (chans[i]->finish)(channel_id);
         }
 
+        log_channel_window_stats(chans[i]);
         chans[i] = NULL;
         channel_count--;
         break;
@@ -473,6 +504,90 @@ static int handle_channel_close(struct ssh2_packet *pkt) {
   return 0;
 }
 
+static uint32_t get_channel_rtt(void) {
+#if defined(TCP_INFO)
+  struct tcp_info ti;
+  socklen_t len;
+
+  len = sizeof(ti);
+  memset(&ti, 0, len);
+  if (getsockopt(sftp_conn->rfd, IPPROTO_TCP, TCP_INFO, &ti, &len) == 0) {
+    return ti.tcpi_rtt;
+  }
+
+  pr_trace_msg(trace_channel, 9, "error obtaining TCP_INFO: %s",
+    strerror(errno));
+#endif /* TCP_INFO */
+
+  return 0;
+}
+
+/* Auto-tune the local window, in the manner of receive-buffer autotuning:
+ * if the client used up the entire window within a couple of round trips,
+ * the window (rather than the link) is what limits the client's sending
+ * rate, so double the window, up to the maximum allowed by RFC 4254.
+ */
+static void tune_channel_window(struct ssh2_channel *chan) {
+  struct timeval now;
+  uint64_t elapsed_usecs, rate = 0, bdp;
+  uint32_t rtt_usecs;
+
+  gettimeofday(&now, NULL);
+  elapsed_usecs = ((now.tv_sec - chan->window_adjust_ts.tv_sec) * 1000000) +
+    (now.tv_usec - chan->window_adjust_ts.tv_usec);
+  if (elapsed_usecs == 0) {
+    elapsed_usecs = 1;
+  }
+
+  rtt_usecs = get_channel_rtt();
+  if (rtt_usecs > 0) {
+    chan->window_rtt_usecs = rtt_usecs;
+
+  } else {
+    /* Without a measured RTT, assume a WAN-ish 100ms. */
+    rtt_usecs = 100000;
+  }
+
+  /* Observed throughput (bytes/sec) over this window, and the implied
+   * bandwidth-delay product.
+   */
+  rate = (chan->window_recvd_bytes * 1000000) / elapsed_usecs;
+  bdp = (rate * rtt_usecs) / 1000000;
+
+  pr_trace_msg(trace_channel, 17, "channel ID %lu: received %" PR_LU
+    " bytes in %" PR_LU " usecs (%" PR_LU " bytes/sec, RTT %lu usecs, BDP %"
+    PR_LU " bytes), window %lu bytes", (unsigned long) chan->local_channel_id,
+    (pr_off_t) chan->window_recvd_bytes, (pr_off_t) elapsed_usecs,
+    (pr_off_t) rate, (unsigned long) rtt_usecs, (pr_off_t) bdp,
+    (unsigned long) chan->local_max_windowsz);
+
+  if (elapsed_usecs <= (2 * (uint64_t) rtt_usecs) ||
+      (bdp * 2) > chan->local_max_windowsz) {
+    uint32_t prev_windowsz;
+
+    prev_windowsz = chan->local_max_windowsz;
+    if (chan->local_max_windowsz > (SFTP_SSH2_CHANNEL_WINDOW_SIZE / 2)) {
+      chan->local_max_windowsz = SFTP_SSH2_CHANNEL_WINDOW_SIZE;
+
+    } else {
+      chan->local_max_windowsz *= 2;
+    }
+
+    if (chan->local_max_windowsz != prev_windowsz) {
+      chan->window_grow_count++;
+
+      pr_trace_msg(trace_channel, 9, "channel ID %lu: growing window from "
+        "%lu to %lu bytes (%" PR_LU " bytes/sec, RTT %lu usecs)",
+        (unsigned long) chan->local_channel_id, (unsigned long) prev_windowsz,
+        (unsigned long) chan->local_max_windowsz, (pr_off_t) rate,
+        (unsigned long) rtt_usecs);
+    }
+  }
+
+  chan->window_adjust_ts = now;
+  chan->window_recvd_bytes = 0;
+}
+
 static int process_channel_data(struct ssh2_channel *chan,
     struct ssh2_packet *pkt, unsigned char *data, uint32_t datalen) {
   int res;
@@ -489,19 +604,29 @@ static int process_channel_data(struct ssh2_channel *chan,
     datalen);
 
   chan->local_windowsz -= datalen;
+  chan->window_recvd_bytes += datalen;
+  chan->total_recvd_bytes += datalen;
 
-  if (chan->local_windowsz < (chan->local_max_packetsz * 3)) {
+  if (chan->local_windowsz < (chan->local_max_packetsz * 3) ||
+      ((sftp_opts & SFTP_OPT_AUTO_CHANNEL_WINDOW) &&
+       chan->local_windowsz < (chan->local_max_windowsz / 2))) {
     unsigned char *buf, *ptr;
     uint32_t buflen, bufsz, window_adjlen;
     struct ssh2_packet *resp;
 
     /* Need to send a CHANNEL_WINDOW_ADJUST message to the client, so that
-     * they know to send more data.
+     * they know to send more data.  When auto-tuning, we adjust once half
+     * of the window has been used, so that the client need not stall
+     * waiting for the adjustment.
      */
     buflen = bufsz = 128;
     ptr = buf = palloc(pkt->pool, bufsz);
 
-    window_adjlen = chan_window_size - chan->local_windowsz;
+    if (sftp_opts & SFTP_OPT_AUTO_CHANNEL_WINDOW) {
+      tune_channel_window(chan);
+    }
+
+    window_adjlen = chan->local_max_windowsz - chan->local_windowsz;
 
     sftp_msg_write_byte(&buf, &buflen, SFTP_SSH2_MSG_CHANNEL_WINDOW_ADJUST);
     sftp_msg_write_int(&buf, &buflen, chan->remote_channel_id);
@@ -524,6 +649,7 @@ static int process_channel_data(struct ssh2_channel *chan,
 
     destroy_pool(resp->pool); 
     chan->local_windowsz += window_adjlen;
+    chan->window_adjust_count++;
   }
 
   return res;
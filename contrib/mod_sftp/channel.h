@@ -52,10 +52,23 @@ struct ssh2_channel {
   uint32_t local_windowsz;
   uint32_t local_max_packetsz;
 
+  /* The size to which the local window is replenished; this grows over
+   * time when the window is auto-tuned.
+   */
+  uint32_t local_max_windowsz;
+
   uint32_t remote_channel_id;
   uint32_t remote_windowsz;
   uint32_t remote_max_packetsz;
 
+  /* Local window statistics, for auto-tuning and logging. */
+  struct timeval window_adjust_ts;
+  uint64_t window_recvd_bytes;
+  uint64_t total_recvd_bytes;
+  unsigned int window_adjust_count;
+  unsigned int window_grow_count;
+  uint32_t window_rtt_usecs;
+
   struct ssh2_channel_databuf *outgoing;
 
   int recvd_eof, sent_eof;
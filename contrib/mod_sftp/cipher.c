@@ -191,11 +191,17 @@ static int set_cipher_iv(struct sftp_cipher *cipher, const EVP_MD *hash,
     _exit(1);
   }
 
-  EVP_DigestInit(&ctx, hash);
-  if (sftp_interop_supports_feature(SFTP_SSH2_FEAT_CIPHER_USE_K)) {
-    EVP_DigestUpdate(&ctx, k, klen);
+  if (!sftp_interop_supports_feature(SFTP_SSH2_FEAT_CIPHER_USE_K)) {
+    k = NULL;
+    klen = 0;
+  }
+
+  if (sftp_crypto_kdf_init(&ctx, hash, k, klen, h, hlen) < 0) {
+    (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
+      "error initializing message digest: %s", sftp_crypto_get_errors());
+    free(iv);
+    return -1;
   }
-  EVP_DigestUpdate(&ctx, h, hlen);
   EVP_DigestUpdate(&ctx, letter, sizeof(char));
   EVP_DigestUpdate(&ctx, (char *) id, id_len);
   EVP_DigestFinal(&ctx, iv, &iv_len);
@@ -208,11 +214,13 @@ static int set_cipher_iv(struct sftp_cipher *cipher, const EVP_MD *hash,
 
     pr_signals_handle();
 
-    EVP_DigestInit(&ctx, hash);
-    if (sftp_interop_supports_feature(SFTP_SSH2_FEAT_CIPHER_USE_K)) {
-      EVP_DigestUpdate(&ctx, k, klen);
+    if (sftp_crypto_kdf_init(&ctx, hash, k, klen, h, hlen) < 0) {
+      (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
+        "error initializing message digest: %s", sftp_crypto_get_errors());
+      pr_memscrub(iv, iv_sz);
+      free(iv);
+      return -1;
     }
-    EVP_DigestUpdate(&ctx, h, hlen);
     EVP_DigestUpdate(&ctx, iv, len);
     EVP_DigestFinal(&ctx, iv + len, &len);
 
@@ -258,9 +266,12 @@ static int set_cipher_key(struct sftp_cipher *cipher, const EVP_MD *hash,
     _exit(1);
   }
 
-  EVP_DigestInit(&ctx, hash);
-  EVP_DigestUpdate(&ctx, k, klen);
-  EVP_DigestUpdate(&ctx, h, hlen);
+  if (sftp_crypto_kdf_init(&ctx, hash, k, klen, h, hlen) < 0) {
+    (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
+      "error initializing message digest: %s", sftp_crypto_get_errors());
+    free(key);
+    return -1;
+  }
   EVP_DigestUpdate(&ctx, letter, sizeof(char));
   EVP_DigestUpdate(&ctx, (char *) id, id_len);
   EVP_DigestFinal(&ctx, key, &key_len);
@@ -273,9 +284,13 @@ static int set_cipher_key(struct sftp_cipher *cipher, const EVP_MD *hash,
 
     pr_signals_handle();
 
-    EVP_DigestInit(&ctx, hash);
-    EVP_DigestUpdate(&ctx, k, klen);
-    EVP_DigestUpdate(&ctx, h, hlen);
+    if (sftp_crypto_kdf_init(&ctx, hash, k, klen, h, hlen) < 0) {
+      (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
+        "error initializing message digest: %s", sftp_crypto_get_errors());
+      pr_memscrub(key, key_sz);
+      free(key);
+      return -1;
+    }
     EVP_DigestUpdate(&ctx, key, len);
     EVP_DigestFinal(&ctx, key + len, &len);
 
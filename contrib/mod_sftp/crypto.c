@@ -165,6 +165,15 @@ static struct sftp_digest digests[] = {
   { NULL, NULL, NULL, 0, FALSE, FALSE }
 };
 
+/* Cached digest state for the key derivation prefix, HASH(K || H), shared by
+ * all of the IVs, keys, and MAC keys derived from a single key exchange.
+ * The exchange hash H already covers K, so H alone identifies the prefix.
+ */
+static EVP_MD_CTX kdf_ctx;
+static const EVP_MD *kdf_md = NULL;
+static unsigned char kdf_h[EVP_MAX_MD_SIZE];
+static uint32_t kdf_hlen = 0;
+
 static const char *trace_channel = "ssh2";
 
 static void ctr_incr(unsigned char *ctr, size_t len) {
@@ -1069,6 +1078,79 @@ size_t sftp_crypto_get_size(size_t first, size_t second) {
 #endif /* !roundup */
 }
 
+/* Initialize the given digest context with the SSH2 key derivation prefix,
+ * i.e. K || H.  If K is NULL, only H is used (for clients which do not use
+ * K when deriving IVs).  The K || H state is computed once per exchange hash,
+ * and then copied for each subsequent derivation.
+ */
+int sftp_crypto_kdf_init(EVP_MD_CTX *ctx, const EVP_MD *hash,
+    const unsigned char *k, uint32_t klen, const char *h, uint32_t hlen) {
+
+  if (ctx == NULL ||
+      hash == NULL ||
+      h == NULL ||
+      hlen > sizeof(kdf_h)) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (k == NULL) {
+#if OPENSSL_VERSION_NUMBER >= 0x000907000L
+    if (EVP_DigestInit(ctx, hash) != 1 ||
+        EVP_DigestUpdate(ctx, h, hlen) != 1) {
+      return -1;
+    }
+#else
+    EVP_DigestInit(ctx, hash);
+    EVP_DigestUpdate(ctx, h, hlen);
+#endif
+    return 0;
+  }
+
+  if (kdf_md != hash ||
+      kdf_hlen != hlen ||
+      memcmp(kdf_h, h, hlen) != 0) {
+    sftp_crypto_kdf_clear();
+
+#if OPENSSL_VERSION_NUMBER >= 0x000907000L
+    if (EVP_DigestInit(&kdf_ctx, hash) != 1 ||
+        EVP_DigestUpdate(&kdf_ctx, k, klen) != 1 ||
+        EVP_DigestUpdate(&kdf_ctx, h, hlen) != 1) {
+      EVP_MD_CTX_cleanup(&kdf_ctx);
+      return -1;
+    }
+#else
+    EVP_DigestInit(&kdf_ctx, hash);
+    EVP_DigestUpdate(&kdf_ctx, k, klen);
+    EVP_DigestUpdate(&kdf_ctx, h, hlen);
+#endif
+
+    memcpy(kdf_h, h, hlen);
+    kdf_hlen = hlen;
+    kdf_md = hash;
+
+    pr_trace_msg(trace_channel, 19,
+      "computed key derivation prefix for %s", EVP_MD_name(hash));
+  }
+
+  if (EVP_MD_CTX_copy(ctx, &kdf_ctx) != 1) {
+    return -1;
+  }
+
+  return 0;
+}
+
+void sftp_crypto_kdf_clear(void) {
+  if (kdf_md == NULL) {
+    return;
+  }
+
+  EVP_MD_CTX_cleanup(&kdf_ctx);
+  pr_memscrub(kdf_h, sizeof(kdf_h));
+  kdf_hlen = 0;
+  kdf_md = NULL;
+}
+
 void sftp_crypto_free(int flags) {
 
   /* Only call EVP_cleanup() et al if other OpenSSL-using modules are not
@@ -38,4 +38,11 @@ const char *sftp_crypto_get_kexinit_digest_list(pool *);
 
 size_t sftp_crypto_get_size(size_t, size_t);
 
+/* Key derivation prefix (K || H) handling, shared across all of the keys
+ * derived from a single key exchange.
+ */
+int sftp_crypto_kdf_init(EVP_MD_CTX *, const EVP_MD *, const unsigned char *,
+  uint32_t, const char *, uint32_t);
+void sftp_crypto_kdf_clear(void);
+
 #endif
@@ -0,0 +1,477 @@
+/*
+ * ProFTPD - mod_sftp Curve25519 routines
+ * Copyright (c) 2016 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+/* Field elements are integers modulo 2^255 - 19.  Where the compiler provides
+ * a 128-bit integer type, they are represented using five 51-bit limbs (as
+ * in the public domain curve25519-donna-c64); otherwise, sixteen 16-bit limbs
+ * are used, following the public domain TweetNaCl implementation.  Both are
+ * constant-time: there are no secret-dependent branches or memory accesses.
+ */
+
+#include "mod_sftp.h"
+#include "curve25519.h"
+
+static const unsigned char curve25519_basepoint[SFTP_CURVE25519_SIZE] = { 9 };
+
+#if defined(__SIZEOF_INT128__)
+typedef uint64_t curve25519_fe[5];
+typedef unsigned __int128 curve25519_uint128;
+
+#define CURVE25519_MASK51	((((uint64_t) 1) << 51) - 1)
+
+static const curve25519_fe curve25519_121665 = { 121665, 0, 0, 0, 0 };
+
+static void fe_zero(curve25519_fe o) {
+  o[0] = o[1] = o[2] = o[3] = o[4] = 0;
+}
+
+static void fe_one(curve25519_fe o) {
+  fe_zero(o);
+  o[0] = 1;
+}
+
+static void fe_copy(curve25519_fe o, const curve25519_fe a) {
+  memcpy(o, a, sizeof(curve25519_fe));
+}
+
+static void fe_add(curve25519_fe o, const curve25519_fe a,
+    const curve25519_fe b) {
+  register unsigned int i;
+
+  for (i = 0; i < 5; i++) {
+    o[i] = a[i] + b[i];
+  }
+}
+
+/* Computes a - b by adding 4p first, so that the limbs never underflow;
+ * b is always a reduced multiplication result here.
+ */
+static void fe_sub(curve25519_fe o, const curve25519_fe a,
+    const curve25519_fe b) {
+  o[0] = a[0] + 0x1fffffffffffb4ULL - b[0];
+  o[1] = a[1] + 0x1ffffffffffffcULL - b[1];
+  o[2] = a[2] + 0x1ffffffffffffcULL - b[2];
+  o[3] = a[3] + 0x1ffffffffffffcULL - b[3];
+  o[4] = a[4] + 0x1ffffffffffffcULL - b[4];
+}
+
+static void fe_mul(curve25519_fe o, const curve25519_fe a,
+    const curve25519_fe b) {
+  curve25519_uint128 r0, r1, r2, r3, r4;
+  uint64_t b1_19, b2_19, b3_19, b4_19, c;
+
+  /* 2^255 = 19 mod 2^255 - 19 */
+  b1_19 = b[1] * 19;
+  b2_19 = b[2] * 19;
+  b3_19 = b[3] * 19;
+  b4_19 = b[4] * 19;
+
+  r0 = (curve25519_uint128) a[0] * b[0] +
+       (curve25519_uint128) a[1] * b4_19 +
+       (curve25519_uint128) a[2] * b3_19 +
+       (curve25519_uint128) a[3] * b2_19 +
+       (curve25519_uint128) a[4] * b1_19;
+
+  r1 = (curve25519_uint128) a[0] * b[1] +
+       (curve25519_uint128) a[1] * b[0] +
+       (curve25519_uint128) a[2] * b4_19 +
+       (curve25519_uint128) a[3] * b3_19 +
+       (curve25519_uint128) a[4] * b2_19;
+
+  r2 = (curve25519_uint128) a[0] * b[2] +
+       (curve25519_uint128) a[1] * b[1] +
+       (curve25519_uint128) a[2] * b[0] +
+       (curve25519_uint128) a[3] * b4_19 +
+       (curve25519_uint128) a[4] * b3_19;
+
+  r3 = (curve25519_uint128) a[0] * b[3] +
+       (curve25519_uint128) a[1] * b[2] +
+       (curve25519_uint128) a[2] * b[1] +
+       (curve25519_uint128) a[3] * b[0] +
+       (curve25519_uint128) a[4] * b4_19;
+
+  r4 = (curve25519_uint128) a[0] * b[4] +
+       (curve25519_uint128) a[1] * b[3] +
+       (curve25519_uint128) a[2] * b[2] +
+       (curve25519_uint128) a[3] * b[1] +
+       (curve25519_uint128) a[4] * b[0];
+
+  r1 += (uint64_t) (r0 >> 51);
+  r2 += (uint64_t) (r1 >> 51);
+  r3 += (uint64_t) (r2 >> 51);
+  r4 += (uint64_t) (r3 >> 51);
+  c = (uint64_t) (r4 >> 51);
+
+  o[0] = (uint64_t) r0 & CURVE25519_MASK51;
+  o[1] = (uint64_t) r1 & CURVE25519_MASK51;
+  o[2] = (uint64_t) r2 & CURVE25519_MASK51;
+  o[3] = (uint64_t) r3 & CURVE25519_MASK51;
+  o[4] = (uint64_t) r4 & CURVE25519_MASK51;
+
+  o[0] += c * 19;
+  o[1] += o[0] >> 51;
+  o[0] &= CURVE25519_MASK51;
+}
+
+/* Swap p and q if b is 1, without branching on b. */
+static void fe_cswap(curve25519_fe p, curve25519_fe q, int b) {
+  register unsigned int i;
+  uint64_t t, mask = ((uint64_t) 0) - (uint64_t) b;
+
+  for (i = 0; i < 5; i++) {
+    t = mask & (p[i] ^ q[i]);
+    p[i] ^= t;
+    q[i] ^= t;
+  }
+}
+
+static uint64_t fe_load64(const unsigned char *p) {
+  register unsigned int i;
+  uint64_t v = 0;
+
+  for (i = 0; i < 8; i++) {
+    v |= ((uint64_t) p[i]) << (8 * i);
+  }
+
+  return v;
+}
+
+static void fe_unpack(curve25519_fe o, const unsigned char *n) {
+  o[0] = fe_load64(n) & CURVE25519_MASK51;
+  o[1] = (fe_load64(n + 6) >> 3) & CURVE25519_MASK51;
+  o[2] = (fe_load64(n + 12) >> 6) & CURVE25519_MASK51;
+  o[3] = (fe_load64(n + 19) >> 1) & CURVE25519_MASK51;
+
+  /* Per RFC 7748, the most significant bit of the u-coordinate is masked. */
+  o[4] = (fe_load64(n + 24) >> 12) & CURVE25519_MASK51;
+}
+
+static void fe_carry_full(uint64_t *t) {
+  t[1] += t[0] >> 51; t[0] &= CURVE25519_MASK51;
+  t[2] += t[1] >> 51; t[1] &= CURVE25519_MASK51;
+  t[3] += t[2] >> 51; t[2] &= CURVE25519_MASK51;
+  t[4] += t[3] >> 51; t[3] &= CURVE25519_MASK51;
+  t[0] += 19 * (t[4] >> 51); t[4] &= CURVE25519_MASK51;
+}
+
+static void fe_pack(unsigned char *o, const curve25519_fe n) {
+  register unsigned int i;
+  uint64_t t[5], w;
+
+  fe_copy(t, n);
+  fe_carry_full(t);
+  fe_carry_full(t);
+
+  /* t is now below 2^255 + small; offset by 19, so that values of p and
+   * above wrap past 2^255, then remove the offset again using 2^255 - 19,
+   * dropping the 2^255 bit.
+   */
+  t[0] += 19;
+  fe_carry_full(t);
+
+  t[0] += (((uint64_t) 1) << 51) - 19;
+  t[1] += (((uint64_t) 1) << 51) - 1;
+  t[2] += (((uint64_t) 1) << 51) - 1;
+  t[3] += (((uint64_t) 1) << 51) - 1;
+  t[4] += (((uint64_t) 1) << 51) - 1;
+
+  t[1] += t[0] >> 51; t[0] &= CURVE25519_MASK51;
+  t[2] += t[1] >> 51; t[1] &= CURVE25519_MASK51;
+  t[3] += t[2] >> 51; t[2] &= CURVE25519_MASK51;
+  t[4] += t[3] >> 51; t[3] &= CURVE25519_MASK51;
+  t[4] &= CURVE25519_MASK51;
+
+  for (i = 0; i < 4; i++) {
+    switch (i) {
+      case 0:
+        w = t[0] | (t[1] << 51);
+        break;
+
+      case 1:
+        w = (t[1] >> 13) | (t[2] << 38);
+        break;
+
+      case 2:
+        w = (t[2] >> 26) | (t[3] << 25);
+        break;
+
+      default:
+        w = (t[3] >> 39) | (t[4] << 12);
+        break;
+    }
+
+    o[8*i+0] = (unsigned char) w;
+    o[8*i+1] = (unsigned char) (w >> 8);
+    o[8*i+2] = (unsigned char) (w >> 16);
+    o[8*i+3] = (unsigned char) (w >> 24);
+    o[8*i+4] = (unsigned char) (w >> 32);
+    o[8*i+5] = (unsigned char) (w >> 40);
+    o[8*i+6] = (unsigned char) (w >> 48);
+    o[8*i+7] = (unsigned char) (w >> 56);
+  }
+
+  pr_memscrub(t, sizeof(t));
+}
+
+#else
+typedef int64_t curve25519_fe[16];
+
+static const curve25519_fe curve25519_121665 = { 0xDB41, 1 };
+
+static void fe_zero(curve25519_fe o) {
+  memset(o, 0, sizeof(curve25519_fe));
+}
+
+static void fe_one(curve25519_fe o) {
+  fe_zero(o);
+  o[0] = 1;
+}
+
+static void fe_copy(curve25519_fe o, const curve25519_fe a) {
+  memcpy(o, a, sizeof(curve25519_fe));
+}
+
+static void fe_carry(curve25519_fe o) {
+  register unsigned int i;
+  int64_t c;
+
+  for (i = 0; i < 16; i++) {
+    o[i] += ((int64_t) 1 << 16);
+    c = o[i] >> 16;
+    o[(i + 1) * (i < 15)] += c - 1 + 37 * (c - 1) * (i == 15);
+    o[i] -= c * ((int64_t) 1 << 16);
+  }
+}
+
+/* Swap p and q if b is 1, without branching on b. */
+static void fe_cswap(curve25519_fe p, curve25519_fe q, int b) {
+  register unsigned int i;
+  int64_t t, c = ~(b - 1);
+
+  for (i = 0; i < 16; i++) {
+    t = c & (p[i] ^ q[i]);
+    p[i] ^= t;
+    q[i] ^= t;
+  }
+}
+
+static void fe_pack(unsigned char *o, const curve25519_fe n) {
+  register unsigned int i, j;
+  int b;
+  curve25519_fe m, t;
+
+  fe_copy(t, n);
+
+  fe_carry(t);
+  fe_carry(t);
+  fe_carry(t);
+
+  /* Reduce mod 2^255 - 19, twice, to get the canonical representation. */
+  for (j = 0; j < 2; j++) {
+    m[0] = t[0] - 0xffed;
+    for (i = 1; i < 15; i++) {
+      m[i] = t[i] - 0xffff - ((m[i-1] >> 16) & 1);
+      m[i-1] &= 0xffff;
+    }
+
+    m[15] = t[15] - 0x7fff - ((m[14] >> 16) & 1);
+    b = (int) ((m[15] >> 16) & 1);
+    m[14] &= 0xffff;
+    fe_cswap(t, m, 1 - b);
+  }
+
+  for (i = 0; i < 16; i++) {
+    o[2*i] = t[i] & 0xff;
+    o[2*i+1] = t[i] >> 8;
+  }
+
+  pr_memscrub(m, sizeof(m));
+  pr_memscrub(t, sizeof(t));
+}
+
+static void fe_unpack(curve25519_fe o, const unsigned char *n) {
+  register unsigned int i;
+
+  for (i = 0; i < 16; i++) {
+    o[i] = n[2*i] + ((int64_t) n[2*i+1] << 8);
+  }
+
+  /* Per RFC 7748, the most significant bit of the u-coordinate is masked. */
+  o[15] &= 0x7fff;
+}
+
+static void fe_add(curve25519_fe o, const curve25519_fe a,
+    const curve25519_fe b) {
+  register unsigned int i;
+
+  for (i = 0; i < 16; i++) {
+    o[i] = a[i] + b[i];
+  }
+}
+
+static void fe_sub(curve25519_fe o, const curve25519_fe a,
+    const curve25519_fe b) {
+  register unsigned int i;
+
+  for (i = 0; i < 16; i++) {
+    o[i] = a[i] - b[i];
+  }
+}
+
+static void fe_mul(curve25519_fe o, const curve25519_fe a,
+    const curve25519_fe b) {
+  register unsigned int i, j;
+  int64_t t[31];
+
+  memset(t, 0, sizeof(t));
+
+  for (i = 0; i < 16; i++) {
+    for (j = 0; j < 16; j++) {
+      t[i+j] += a[i] * b[j];
+    }
+  }
+
+  /* 2^256 = 38 mod 2^255 - 19 */
+  for (i = 0; i < 15; i++) {
+    t[i] += 38 * t[i+16];
+  }
+
+  for (i = 0; i < 16; i++) {
+    o[i] = t[i];
+  }
+
+  fe_carry(o);
+  fe_carry(o);
+}
+#endif /* !__SIZEOF_INT128__ */
+
+static void fe_sq(curve25519_fe o, const curve25519_fe a) {
+  fe_mul(o, a, a);
+}
+
+/* Inversion via Fermat's little theorem: a^(p-2). */
+static void fe_invert(curve25519_fe o, const curve25519_fe a) {
+  register int i;
+  curve25519_fe c;
+
+  fe_copy(c, a);
+
+  for (i = 253; i >= 0; i--) {
+    fe_sq(c, c);
+    if (i != 2 &&
+        i != 4) {
+      fe_mul(c, c, a);
+    }
+  }
+
+  fe_copy(o, c);
+}
+
+int sftp_curve25519_scalarmult(unsigned char *out, const unsigned char *scalar,
+    const unsigned char *point) {
+  register int i;
+  unsigned char z[SFTP_CURVE25519_SIZE], zero = 0;
+  curve25519_fe x, a, b, c, d, e, f;
+  int r;
+
+  if (out == NULL ||
+      scalar == NULL ||
+      point == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  /* Clamp the scalar, per RFC 7748. */
+  memcpy(z, scalar, sizeof(z));
+  z[31] = (z[31] & 127) | 64;
+  z[0] &= 248;
+
+  fe_unpack(x, point);
+
+  fe_copy(b, x);
+  fe_one(a);
+  fe_zero(c);
+  fe_one(d);
+
+  /* The Montgomery ladder. */
+  for (i = 254; i >= 0; i--) {
+    r = (z[i >> 3] >> (i & 7)) & 1;
+
+    fe_cswap(a, b, r);
+    fe_cswap(c, d, r);
+
+    fe_add(e, a, c);
+    fe_sub(a, a, c);
+    fe_add(c, b, d);
+    fe_sub(b, b, d);
+    fe_sq(d, e);
+    fe_sq(f, a);
+    fe_mul(a, c, a);
+    fe_mul(c, b, e);
+    fe_add(e, a, c);
+    fe_sub(a, a, c);
+    fe_sq(b, a);
+    fe_sub(c, d, f);
+    fe_mul(a, c, curve25519_121665);
+    fe_add(a, a, d);
+    fe_mul(c, c, a);
+    fe_mul(a, d, f);
+    fe_mul(d, b, x);
+    fe_sq(b, e);
+
+    fe_cswap(a, b, r);
+    fe_cswap(c, d, r);
+  }
+
+  fe_invert(c, c);
+  fe_mul(a, a, c);
+  fe_pack(out, a);
+
+  pr_memscrub(z, sizeof(z));
+  pr_memscrub(a, sizeof(a));
+  pr_memscrub(b, sizeof(b));
+  pr_memscrub(c, sizeof(c));
+  pr_memscrub(d, sizeof(d));
+  pr_memscrub(e, sizeof(e));
+  pr_memscrub(f, sizeof(f));
+
+  /* Reject the all-zero output (RFC 7748, Section 6.1), checking every byte
+   * regardless of the outcome.
+   */
+  for (i = 0; i < SFTP_CURVE25519_SIZE; i++) {
+    zero |= out[i];
+  }
+
+  if (zero == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  return 0;
+}
+
+int sftp_curve25519_scalarmult_base(unsigned char *out,
+    const unsigned char *scalar) {
+  return sftp_curve25519_scalarmult(out, scalar, curve25519_basepoint);
+}
@@ -0,0 +1,46 @@
+/*
+ * ProFTPD - mod_sftp Curve25519 routines
+ * Copyright (c) 2016 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#include "mod_sftp.h"
+
+#ifndef MOD_SFTP_CURVE25519_H
+#define MOD_SFTP_CURVE25519_H
+
+/* Size, in bytes, of Curve25519 private keys, public keys, and shared
+ * secrets.
+ */
+#define SFTP_CURVE25519_SIZE		32
+
+/* Computes the X25519 function (RFC 7748) of the given scalar and the
+ * u-coordinate of the given point.  Returns -1 if the result is the
+ * all-zero value, i.e. if the point was of low order.
+ */
+int sftp_curve25519_scalarmult(unsigned char *out, const unsigned char *scalar,
+  const unsigned char *point);
+
+/* Computes the public key for the given private key. */
+int sftp_curve25519_scalarmult_base(unsigned char *out,
+  const unsigned char *scalar);
+
+#endif /* MOD_SFTP_CURVE25519_H */
@@ -202,6 +202,17 @@ struct fxp_handle {
    */
   size_t fh_bytes_xferred;
 
+  /* For the FastDataPath SFTPOption: set once the READ/WRITE access checks
+   * have passed for this handle, after which subsequent READ/WRITE requests
+   * bypass the per-request command dispatch.  The counts of such requests
+   * are logged when the handle is closed.
+   */
+  int fh_fast_path;
+  off_t fh_max_store;
+  cmd_rec *fh_xfer_cmd;
+  time_t fh_scoreboard_ts;
+  unsigned long fh_fast_nreqs;
+
   void *dirh;
   const char *dir;
 };
@@ -276,6 +287,14 @@ struct fxp_session {
 static struct fxp_session *fxp_session = NULL, *fxp_sessions = NULL;
 
 static const char *trace_channel = "sftp";
+static pr_trace_chan_t trace_chan = PR_TRACE_CHAN("sftp");
+
+/* Whether any module registers its own handlers for the READ/WRITE
+ * requests; such modules always see the full per-request dispatch, even
+ * when the FastDataPath SFTPOption is used.  -1 means "not yet checked".
+ */
+static int fxp_read_hooked = -1;
+static int fxp_write_hooked = -1;
 
 /* Necessary prototypes */
 static struct fxp_handle *fxp_handle_get(const char *);
@@ -2975,15 +2994,20 @@ static struct fxp_packet *fxp_packet_read(uint32_t channel_id,
   uint32_t buflen;
 
   if (datalen) {
-    pr_trace_msg(trace_channel, 9,
-      "reading SFTP data from SSH2 packet buffer (%lu bytes)",
-      (unsigned long) *datalen);
+    if (pr_trace_chan_enabled(&trace_chan, 9)) {
+      pr_trace_msg(trace_channel, 9,
+        "reading SFTP data from SSH2 packet buffer (%lu bytes)",
+        (unsigned long) *datalen);
+    }
+
     fxp_packet_add_cache(*data, *datalen);
   }
 
   buflen = fxp_packet_get_cache(&buf);
-  pr_trace_msg(trace_channel, 19,
-    "using %lu bytes of SSH2 packet buffer data", (unsigned long) buflen);
+  if (pr_trace_chan_enabled(&trace_chan, 19)) {
+    pr_trace_msg(trace_channel, 19,
+      "using %lu bytes of SSH2 packet buffer data", (unsigned long) buflen);
+  }
 
   fxp = fxp_packet_get_packet(channel_id);
 
@@ -3003,10 +3027,12 @@ static struct fxp_packet *fxp_packet_read(uint32_t channel_id,
     fxp->packet_len = sftp_msg_read_int(fxp->pool, &buf, &buflen);
     fxp->state |= FXP_PACKET_HAVE_PACKET_LEN;
 
-    pr_trace_msg(trace_channel, 19,
-      "read SFTP request packet len %lu from SSH2 packet buffer "
-      "(%lu bytes remaining in buffer)", (unsigned long) fxp->packet_len,
-      (unsigned long) buflen);
+    if (pr_trace_chan_enabled(&trace_chan, 19)) {
+      pr_trace_msg(trace_channel, 19,
+        "read SFTP request packet len %lu from SSH2 packet buffer "
+        "(%lu bytes remaining in buffer)", (unsigned long) fxp->packet_len,
+        (unsigned long) buflen);
+    }
 
     if (buflen == 0) {
       fxp_packet_set_packet(fxp);
@@ -3017,9 +3043,11 @@ static struct fxp_packet *fxp_packet_read(uint32_t channel_id,
     }
 
   } else {
-    pr_trace_msg(trace_channel, 19,
-      "already have SFTP request packet len %lu from previous buffer data",
-      (unsigned long) fxp->packet_len);
+    if (pr_trace_chan_enabled(&trace_chan, 19)) {
+      pr_trace_msg(trace_channel, 19,
+        "already have SFTP request packet len %lu from previous buffer data",
+        (unsigned long) fxp->packet_len);
+    }
   }
 
   if (!(fxp->state & FXP_PACKET_HAVE_REQUEST_TYPE)) {
@@ -3036,10 +3064,12 @@ static struct fxp_packet *fxp_packet_read(uint32_t channel_id,
     fxp->request_type = sftp_msg_read_byte(fxp->pool, &buf, &buflen);
     fxp->state |= FXP_PACKET_HAVE_REQUEST_TYPE;
 
-    pr_trace_msg(trace_channel, 19,
-      "read SFTP request type %d from SSH2 packet buffer "
-      "(%lu bytes remaining in buffer)", (int) fxp->request_type,
-      (unsigned long) buflen);
+    if (pr_trace_chan_enabled(&trace_chan, 19)) {
+      pr_trace_msg(trace_channel, 19,
+        "read SFTP request type %d from SSH2 packet buffer "
+        "(%lu bytes remaining in buffer)", (int) fxp->request_type,
+        (unsigned long) buflen);
+    }
 
     if (buflen == 0) {
       fxp_packet_set_packet(fxp);
@@ -3050,9 +3080,11 @@ static struct fxp_packet *fxp_packet_read(uint32_t channel_id,
     }
 
   } else {
-    pr_trace_msg(trace_channel, 19,
-      "already have SFTP request type %d from previous buffer data",
-      fxp->request_type);
+    if (pr_trace_chan_enabled(&trace_chan, 19)) {
+      pr_trace_msg(trace_channel, 19,
+        "already have SFTP request type %d from previous buffer data",
+        fxp->request_type);
+    }
   }
 
   if (!(fxp->state & FXP_PACKET_HAVE_PAYLOAD_SIZE)) {
@@ -3060,15 +3092,19 @@ static struct fxp_packet *fxp_packet_read(uint32_t channel_id,
     fxp->payload_sz = fxp->packet_len - 1;
     fxp->state |= FXP_PACKET_HAVE_PAYLOAD_SIZE;
 
-    pr_trace_msg(trace_channel, 19,
-      "read SFTP request payload size %lu from SSH2 packet buffer "
-      "(%lu bytes remaining in buffer)", (unsigned long) fxp->payload_sz,
-      (unsigned long) buflen);
+    if (pr_trace_chan_enabled(&trace_chan, 19)) {
+      pr_trace_msg(trace_channel, 19,
+        "read SFTP request payload size %lu from SSH2 packet buffer "
+        "(%lu bytes remaining in buffer)", (unsigned long) fxp->payload_sz,
+        (unsigned long) buflen);
+    }
 
   } else {
-    pr_trace_msg(trace_channel, 19,
-      "already have SFTP request payload size %lu from previous buffer data",
-      (unsigned long) fxp->payload_sz);
+    if (pr_trace_chan_enabled(&trace_chan, 19)) {
+      pr_trace_msg(trace_channel, 19,
+        "already have SFTP request payload size %lu from previous buffer data",
+        (unsigned long) fxp->payload_sz);
+    }
   }
 
   if (!(fxp->state & FXP_PACKET_HAVE_REQUEST_ID)) {
@@ -3087,10 +3123,12 @@ static struct fxp_packet *fxp_packet_read(uint32_t channel_id,
       fxp->request_id = sftp_msg_read_int(fxp->pool, &buf, &buflen);
       fxp->payload_sz -= sizeof(uint32_t);
 
-      pr_trace_msg(trace_channel, 19,
-        "read SFTP request ID %lu from SSH2 packet buffer "
-        "(%lu bytes remaining in buffer)", (unsigned long) fxp->request_id,
-        (unsigned long) buflen);
+      if (pr_trace_chan_enabled(&trace_chan, 19)) {
+        pr_trace_msg(trace_channel, 19,
+          "read SFTP request ID %lu from SSH2 packet buffer "
+          "(%lu bytes remaining in buffer)", (unsigned long) fxp->request_id,
+          (unsigned long) buflen);
+      }
     }
 
     fxp->state |= FXP_PACKET_HAVE_REQUEST_ID;
@@ -3104,9 +3142,11 @@ static struct fxp_packet *fxp_packet_read(uint32_t channel_id,
     }
 
   } else {
-    pr_trace_msg(trace_channel, 19,
-      "already have SFTP request ID %lu from previous buffer data",
-      (unsigned long) fxp->request_id);
+    if (pr_trace_chan_enabled(&trace_chan, 19)) {
+      pr_trace_msg(trace_channel, 19,
+        "already have SFTP request ID %lu from previous buffer data",
+        (unsigned long) fxp->request_id);
+    }
   }
 
   if (!(fxp->state & FXP_PACKET_HAVE_PAYLOAD)) {
@@ -3159,11 +3199,13 @@ static struct fxp_packet *fxp_packet_read(uint32_t channel_id,
      * payload data.
      */
     if (buflen == payload_remaining) {
-      pr_trace_msg(trace_channel, 19,
-        "filling remaining SFTP request payload (%lu of %lu total bytes) "
-        "from SSH2 packet buffer (%lu bytes in buffer)",
-        (unsigned long) payload_remaining, (unsigned long) fxp->payload_sz,
-        (unsigned long) buflen);
+      if (pr_trace_chan_enabled(&trace_chan, 19)) {
+        pr_trace_msg(trace_channel, 19,
+          "filling remaining SFTP request payload (%lu of %lu total bytes) "
+          "from SSH2 packet buffer (%lu bytes in buffer)",
+          (unsigned long) payload_remaining, (unsigned long) fxp->payload_sz,
+          (unsigned long) buflen);
+      }
 
       memcpy(fxp->payload + fxp->payload_len, buf, buflen);
       fxp->payload_len = buflen;
@@ -3173,8 +3215,12 @@ static struct fxp_packet *fxp_packet_read(uint32_t channel_id,
       fxp_packet_clear_cache();
       *have_cache = FALSE;
 
-      pr_trace_msg(trace_channel, 19, "completely filled payload of %lu bytes "
-        "(0 bytes remaining in buffer)", (unsigned long) fxp->payload_sz);
+      if (pr_trace_chan_enabled(&trace_chan, 19)) {
+        pr_trace_msg(trace_channel, 19,
+          "completely filled payload of %lu bytes "
+          "(0 bytes remaining in buffer)", (unsigned long) fxp->payload_sz);
+      }
+
       return fxp;
     }
 
@@ -3182,11 +3228,13 @@ static struct fxp_packet *fxp_packet_read(uint32_t channel_id,
      * payload data.
      */
     if (buflen > payload_remaining) {
-      pr_trace_msg(trace_channel, 19,
-        "filling remaining SFTP request payload (%lu of %lu total bytes) "
-        "from SSH2 packet buffer (%lu bytes in buffer)",
-        (unsigned long) payload_remaining, (unsigned long) fxp->payload_sz,
-        (unsigned long) buflen);
+      if (pr_trace_chan_enabled(&trace_chan, 19)) {
+        pr_trace_msg(trace_channel, 19,
+          "filling remaining SFTP request payload (%lu of %lu total bytes) "
+          "from SSH2 packet buffer (%lu bytes in buffer)",
+          (unsigned long) payload_remaining, (unsigned long) fxp->payload_sz,
+          (unsigned long) buflen);
+      }
 
       memcpy(fxp->payload + fxp->payload_len, buf, payload_remaining);
       fxp->payload_len += payload_remaining;
@@ -3200,20 +3248,26 @@ static struct fxp_packet *fxp_packet_read(uint32_t channel_id,
       fxp_packet_add_cache(buf, buflen);
       *have_cache = TRUE;
 
-      pr_trace_msg(trace_channel, 19, "completely filled payload of %lu bytes "
-        "(%lu bytes remaining in buffer)", (unsigned long) fxp->payload_sz,
-        (unsigned long) buflen);
+      if (pr_trace_chan_enabled(&trace_chan, 19)) {
+        pr_trace_msg(trace_channel, 19,
+          "completely filled payload of %lu bytes "
+          "(%lu bytes remaining in buffer)", (unsigned long) fxp->payload_sz,
+          (unsigned long) buflen);
+      }
+
       return fxp;
     }
 
     /* Third (and remaining) case: the packet buffer is smaller than the size
      * of the remaining payload data.
      */
-    pr_trace_msg(trace_channel, 19,
-      "filling remaining SFTP request payload (%lu of %lu total bytes) "
-      "from SSH2 packet buffer (%lu bytes in buffer)",
-      (unsigned long) payload_remaining, (unsigned long) fxp->payload_sz,
-      (unsigned long) buflen);
+    if (pr_trace_chan_enabled(&trace_chan, 19)) {
+      pr_trace_msg(trace_channel, 19,
+        "filling remaining SFTP request payload (%lu of %lu total bytes) "
+        "from SSH2 packet buffer (%lu bytes in buffer)",
+        (unsigned long) payload_remaining, (unsigned long) fxp->payload_sz,
+        (unsigned long) buflen);
+    }
 
     memcpy(fxp->payload + fxp->payload_len, buf, buflen);
     fxp->payload_len += buflen;
@@ -3223,9 +3277,11 @@ static struct fxp_packet *fxp_packet_read(uint32_t channel_id,
     *have_cache = FALSE;
 
   } else {
-    pr_trace_msg(trace_channel, 19,
-      "already have SFTP payload (%lu bytes) from previous buffer data",
-      (unsigned long) fxp->payload_sz);
+    if (pr_trace_chan_enabled(&trace_chan, 19)) {
+      pr_trace_msg(trace_channel, 19,
+        "already have SFTP payload (%lu bytes) from previous buffer data",
+        (unsigned long) fxp->payload_sz);
+    }
   }
 
   return NULL;
@@ -5245,6 +5301,22 @@ static int fxp_handle_close(struct fxp_packet *fxp) {
 
   pr_timer_remove(PR_TIMER_STALLED, ANY_MODULE);
 
+  if (fxh->fh_fast_nreqs > 0) {
+    const char *req;
+
+    req = (fxh->fh_flags == O_RDONLY ? "READ" : "WRITE");
+
+    pr_trace_msg(trace_channel, 9, "handled %lu %s %s for '%s' using fast "
+      "data path (%" PR_LU " bytes)", fxh->fh_fast_nreqs, req,
+      fxh->fh_fast_nreqs != 1 ? "requests" : "request",
+      fxh->fh->fh_path, (pr_off_t) fxh->fh_bytes_xferred);
+    (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
+      "FastDataPath: %lu %s %s for '%s' (%" PR_LU " bytes)",
+      fxh->fh_fast_nreqs, req,
+      fxh->fh_fast_nreqs != 1 ? "requests" : "request",
+      fxh->fh->fh_path, (pr_off_t) fxh->fh_bytes_xferred);
+  }
+
   if (fxh->fh != NULL) {
     char *curr_path = NULL, *real_path = NULL;
     cmd_rec *cmd2 = NULL;
@@ -8165,6 +8237,331 @@ static int fxp_handle_opendir(struct fxp_packet *fxp) {
   return fxp_packet_write(resp);
 }
 
+/* FastDataPath support.  Once a handle has passed the full READ/WRITE
+ * checks, the access decision cannot change for the lifetime of that handle
+ * (the path, user and configuration stay the same), so later READ/WRITE
+ * requests can skip the cmd_rec allocation, the PRE/POST/LOG_CMD dispatch,
+ * and the scoreboard/proctitle updates.  Failed requests are still
+ * dispatched (and thus logged) individually.
+ */
+
+static int fxp_have_cmd_handlers(const char *name) {
+  int idx = -1;
+
+  if (pr_stash_get_symbol(PR_SYM_CMD, name, NULL, &idx) != NULL) {
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
+static int fxp_handle_use_fast_path(struct fxp_handle *fxh, int is_read) {
+  if (!(sftp_opts & SFTP_OPT_FAST_DATA_PATH)) {
+    return FALSE;
+  }
+
+  if (fxh == NULL ||
+      fxh->fh == NULL ||
+      fxh->fh_fast_path == FALSE) {
+    return FALSE;
+  }
+
+  if (is_read) {
+    if (fxp_read_hooked < 0) {
+      fxp_read_hooked = fxp_have_cmd_handlers("READ");
+      pr_trace_msg(trace_channel, 9, "READ requests have module handlers: %s",
+        fxp_read_hooked ? "true" : "false");
+    }
+
+    return fxp_read_hooked ? FALSE : TRUE;
+  }
+
+  if (fxp_write_hooked < 0) {
+    fxp_write_hooked = fxp_have_cmd_handlers("WRITE");
+    pr_trace_msg(trace_channel, 9, "WRITE requests have module handlers: %s",
+      fxp_write_hooked ? "true" : "false");
+  }
+
+  return fxp_write_hooked ? FALSE : TRUE;
+}
+
+static void fxp_handle_set_fast_path(pool *p, struct fxp_handle *fxh,
+    const char *xfer_cmd, struct stat *st) {
+
+  if (!(sftp_opts & SFTP_OPT_FAST_DATA_PATH) ||
+      fxh->fh_fast_path == TRUE) {
+    return;
+  }
+
+  /* Only regular files; anything else still needs the per-request fstat(2)
+   * and seek handling.
+   */
+  if (!S_ISREG(st->st_mode)) {
+    return;
+  }
+
+  if (strcmp(xfer_cmd, C_RETR) != 0) {
+    config_rec *c;
+
+    c = find_config(get_dir_ctxt(p, fxh->fh->fh_path), CONF_PARAM,
+      "MaxStoreFileSize", FALSE);
+    if (c != NULL) {
+      fxh->fh_max_store = *((off_t *) c->argv[0]);
+    }
+  }
+
+  /* Keep a cmd_rec around for TransferRate throttling. */
+  fxh->fh_xfer_cmd = fxp_cmd_alloc(fxh->pool, xfer_cmd, NULL);
+  fxh->fh_fast_path = TRUE;
+
+  pr_trace_msg(trace_channel, 15, "using fast data path for handle '%s'",
+    fxh->name);
+}
+
+static int fxp_handle_fast_error(struct fxp_packet *fxp,
+    struct fxp_handle *fxh, const char *req, const char *name, int xerrno,
+    unsigned char *buf, uint32_t bufsz) {
+  unsigned char *ptr;
+  uint32_t buflen, status_code;
+  const char *reason;
+  struct fxp_packet *resp;
+  cmd_rec *cmd;
+
+  ptr = buf;
+  buflen = bufsz;
+
+  cmd = fxp_cmd_alloc(fxp->pool, req, (char *) name);
+  cmd->cmd_class = (strcmp(req, "READ") == 0 ? CL_READ : CL_WRITE);
+  fxp_set_filehandle_note(cmd, fxh);
+
+  status_code = fxp_errno2status(xerrno, &reason);
+
+  pr_trace_msg(trace_channel, 8, "sending response: STATUS %lu '%s' "
+    "('%s' [%d])", (unsigned long) status_code, reason,
+    xerrno != EOF ? strerror(xerrno) : "End of file", xerrno);
+
+  fxp_status_write(&buf, &buflen, fxp->request_id, status_code, reason,
+    NULL);
+
+  pr_cmd_dispatch_phase(cmd, POST_CMD_ERR, 0);
+  pr_cmd_dispatch_phase(cmd, LOG_CMD_ERR, 0);
+
+  resp = fxp_packet_create(fxp->pool, fxp->channel_id);
+  resp->payload = ptr;
+  resp->payload_sz = (bufsz - buflen);
+
+  return fxp_packet_write(resp);
+}
+
+static int fxp_handle_fast_read(struct fxp_packet *fxp,
+    struct fxp_handle *fxh, const char *name, uint64_t offset,
+    uint32_t datalen) {
+  unsigned char *buf, *data = NULL, *ptr;
+  int res;
+  uint32_t buflen, bufsz;
+  time_t now;
+  struct fxp_packet *resp;
+
+  if (pr_trace_chan_enabled(&trace_chan, 7)) {
+    pr_trace_msg(trace_channel, 7, "received request: READ %s %" PR_LU " %lu",
+      name, (pr_off_t) offset, (unsigned long) datalen);
+  }
+
+  buflen = bufsz = datalen + 64;
+  buf = ptr = palloc(fxp->pool, bufsz);
+
+  if (pr_fsio_lseek(fxh->fh, offset, SEEK_SET) < 0) {
+    int xerrno = errno;
+
+    (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
+      "error seeking to offset (%" PR_LU " bytes) for '%s': %s",
+      (pr_off_t) offset, fxh->fh->fh_path, strerror(xerrno));
+
+    return fxp_handle_fast_error(fxp, fxh, "READ", name, xerrno, buf, bufsz);
+  }
+
+  pr_throttle_init(fxh->fh_xfer_cmd);
+
+  if (datalen) {
+    data = palloc(fxp->pool, datalen);
+  }
+
+  res = pr_fsio_read(fxh->fh, (char *) data, datalen);
+
+  if (pr_data_get_timeout(PR_DATA_TIMEOUT_NO_TRANSFER) > 0) {
+    pr_timer_reset(PR_TIMER_NOXFER, ANY_MODULE);
+  }
+
+  if (pr_data_get_timeout(PR_DATA_TIMEOUT_STALLED) > 0) {
+    pr_timer_reset(PR_TIMER_STALLED, ANY_MODULE);
+  }
+
+  if (res < 0) {
+    int xerrno = errno;
+
+    (void) pr_trace_msg("fileperms", 1, "READ, user '%s' (UID %lu, GID %lu): "
+      "error reading from '%s': %s", session.user,
+      (unsigned long) session.uid, (unsigned long) session.gid,
+      fxh->fh->fh_path, strerror(xerrno));
+
+    (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
+      "error reading from '%s': %s", fxh->fh->fh_path, strerror(xerrno));
+
+    return fxp_handle_fast_error(fxp, fxh, "READ", name, xerrno, buf, bufsz);
+  }
+
+  fxh->fh_fast_nreqs++;
+
+  if (res == 0) {
+    uint32_t status_code;
+    const char *reason;
+
+    /* EOF; note that reading past the end of the file also lands here. */
+    pr_throttle_pause(offset, TRUE);
+
+    status_code = fxp_errno2status(EOF, &reason);
+
+    pr_trace_msg(trace_channel, 8, "sending response: STATUS %lu '%s' "
+      "('%s' [%d])", (unsigned long) status_code, reason, "End of file", EOF);
+
+    fxp_status_write(&buf, &buflen, fxp->request_id, status_code, reason,
+      NULL);
+
+  } else {
+    pr_throttle_pause(offset, FALSE);
+
+    if (pr_trace_chan_enabled(&trace_chan, 8)) {
+      pr_trace_msg(trace_channel, 8, "sending response: DATA (%lu bytes)",
+        (unsigned long) res);
+    }
+
+    sftp_msg_write_byte(&buf, &buflen, SFTP_SSH2_FXP_DATA);
+    sftp_msg_write_int(&buf, &buflen, fxp->request_id);
+    sftp_msg_write_data(&buf, &buflen, data, res, TRUE);
+
+    fxh->fh_bytes_xferred += res;
+    session.xfer.total_bytes += res;
+    session.total_bytes += res;
+
+    /* Keep the scoreboard progress current, but at most once a second. */
+    now = time(NULL);
+    if (now != fxh->fh_scoreboard_ts) {
+      pr_scoreboard_entry_update(session.pid,
+        PR_SCORE_XFER_DONE, (off_t) (offset + res),
+        NULL);
+      fxh->fh_scoreboard_ts = now;
+    }
+  }
+
+  resp = fxp_packet_create(fxp->pool, fxp->channel_id);
+  resp->payload = ptr;
+  resp->payload_sz = (bufsz - buflen);
+
+  return fxp_packet_write(resp);
+}
+
+static int fxp_handle_fast_write(struct fxp_packet *fxp,
+    struct fxp_handle *fxh, const char *name, uint64_t offset,
+    unsigned char *data, uint32_t datalen) {
+  unsigned char *buf, *ptr;
+  int res;
+  uint32_t buflen, bufsz, status_code;
+  struct fxp_packet *resp;
+
+  if (pr_trace_chan_enabled(&trace_chan, 7)) {
+    pr_trace_msg(trace_channel, 7, "received request: WRITE %s %" PR_LU " %lu",
+      name, (pr_off_t) offset, (unsigned long) datalen);
+  }
+
+  buflen = bufsz = FXP_RESPONSE_DATA_DEFAULT_SZ;
+  buf = ptr = palloc(fxp->pool, bufsz);
+
+  fxh->fh_bytes_xferred += datalen;
+
+  if (pr_fsio_lseek(fxh->fh, offset, SEEK_SET) < 0) {
+    int xerrno = errno;
+
+    (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
+      "error seeking to offset (%" PR_LU " bytes) for '%s': %s",
+      (pr_off_t) offset, fxh->fh->fh_path, strerror(xerrno));
+
+    return fxp_handle_fast_error(fxp, fxh, "WRITE", name, xerrno, buf, bufsz);
+  }
+
+  pr_throttle_init(fxh->fh_xfer_cmd);
+
+  res = pr_fsio_write(fxh->fh, (char *) data, datalen);
+
+  if (pr_data_get_timeout(PR_DATA_TIMEOUT_NO_TRANSFER) > 0) {
+    pr_timer_reset(PR_TIMER_NOXFER, ANY_MODULE);
+  }
+
+  if (pr_data_get_timeout(PR_DATA_TIMEOUT_STALLED) > 0) {
+    pr_timer_reset(PR_TIMER_STALLED, ANY_MODULE);
+  }
+
+  pr_throttle_pause(offset, FALSE);
+
+  if (res < 0) {
+    int xerrno = errno;
+
+    (void) pr_trace_msg("fileperms", 1, "WRITE, user '%s' (UID %lu, GID %lu): "
+      "error writing to '%s': %s", session.user,
+      (unsigned long) session.uid, (unsigned long) session.gid,
+      fxh->fh->fh_path, strerror(xerrno));
+
+    (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
+      "error writing to '%s': %s", fxh->fh->fh_path, strerror(xerrno));
+
+    return fxp_handle_fast_error(fxp, fxh, "WRITE", name, xerrno, buf, bufsz);
+  }
+
+  if (fxh->fh_max_store > 0) {
+    struct stat st;
+
+    if (pr_fsio_fstat(fxh->fh, &st) == 0 &&
+        st.st_size > fxh->fh_max_store) {
+#if defined(EFBIG)
+      int xerrno = EFBIG;
+#elif defined(ENOSPC)
+      int xerrno = ENOSPC;
+#else
+      int xerrno = EIO;
+#endif
+
+      pr_log_pri(PR_LOG_NOTICE, "MaxStoreFileSize (%" PR_LU " %s) reached: "
+        "aborting transfer of '%s'", (pr_off_t) fxh->fh_max_store,
+        fxh->fh_max_store != 1 ? "bytes" : "byte", fxh->fh->fh_path);
+
+      (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
+        "error writing %" PR_LU " bytes to '%s': %s "
+        "(MaxStoreFileSize %" PR_LU " exceeded)", (pr_off_t) datalen,
+        fxh->fh->fh_path, strerror(xerrno), (pr_off_t) fxh->fh_max_store);
+
+      return fxp_handle_fast_error(fxp, fxh, "WRITE", name, xerrno, buf,
+        bufsz);
+    }
+  }
+
+  fxh->fh_fast_nreqs++;
+
+  status_code = SSH2_FX_OK;
+
+  if (pr_trace_chan_enabled(&trace_chan, 8)) {
+    pr_trace_msg(trace_channel, 8, "sending response: STATUS %lu '%s'",
+      (unsigned long) status_code, fxp_strerror(status_code));
+  }
+
+  fxp_status_write(&buf, &buflen, fxp->request_id, status_code,
+    fxp_strerror(status_code), NULL);
+
+  resp = fxp_packet_create(fxp->pool, fxp->channel_id);
+  resp->payload = ptr;
+  resp->payload_sz = (bufsz - buflen);
+
+  return fxp_packet_write(resp);
+}
+
 static int fxp_handle_read(struct fxp_packet *fxp) {
   unsigned char *buf, *data = NULL, *ptr;
   char *cmd_name, *name;
@@ -8192,6 +8589,11 @@ static int fxp_handle_read(struct fxp_packet *fxp) {
   }
 #endif
 
+  fxh = fxp_handle_get(name);
+  if (fxp_handle_use_fast_path(fxh, TRUE)) {
+    return fxp_handle_fast_read(fxp, fxh, name, offset, datalen);
+  }
+
   cmd = fxp_cmd_alloc(fxp->pool, "READ", name);
   cmd->cmd_class = CL_READ;
 
@@ -8203,13 +8605,14 @@ static int fxp_handle_read(struct fxp_packet *fxp) {
   pr_proctitle_set("%s - %s: READ %s %" PR_LU " %lu", session.user,
     session.proc_prefix, name, (pr_off_t) offset, (unsigned long) datalen);
 
-  pr_trace_msg(trace_channel, 7, "received request: READ %s %" PR_LU " %lu",
-    name, (pr_off_t) offset, (unsigned long) datalen);
+  if (pr_trace_chan_enabled(&trace_chan, 7)) {
+    pr_trace_msg(trace_channel, 7, "received request: READ %s %" PR_LU " %lu",
+      name, (pr_off_t) offset, (unsigned long) datalen);
+  }
 
   buflen = bufsz = datalen + 64;
   buf = ptr = palloc(fxp->pool, bufsz);
 
-  fxh = fxp_handle_get(name);
   if (fxh == NULL) {
     uint32_t status_code;
 
@@ -8467,8 +8870,10 @@ static int fxp_handle_read(struct fxp_packet *fxp) {
 
   pr_throttle_pause(offset, FALSE);
 
-  pr_trace_msg(trace_channel, 8, "sending response: DATA (%lu bytes)",
-    (unsigned long) res);
+  if (pr_trace_chan_enabled(&trace_chan, 8)) {
+    pr_trace_msg(trace_channel, 8, "sending response: DATA (%lu bytes)",
+      (unsigned long) res);
+  }
 
   sftp_msg_write_byte(&buf, &buflen, SFTP_SSH2_FXP_DATA);
   sftp_msg_write_int(&buf, &buflen, fxp->request_id);
@@ -8481,6 +8886,8 @@ static int fxp_handle_read(struct fxp_packet *fxp) {
   fxh->fh_bytes_xferred += res;
   session.xfer.total_bytes += res;
   session.total_bytes += res;
+
+  fxp_handle_set_fast_path(fxp->pool, fxh, C_RETR, &st);
   
   pr_cmd_dispatch_phase(cmd, POST_CMD, 0);
   pr_cmd_dispatch_phase(cmd, LOG_CMD, 0);
@@ -10964,6 +11371,11 @@ static int fxp_handle_write(struct fxp_packet *fxp) {
 
   session.xfer.total_bytes += datalen;
   session.total_bytes += datalen;
+
+  fxh = fxp_handle_get(name);
+  if (fxp_handle_use_fast_path(fxh, FALSE)) {
+    return fxp_handle_fast_write(fxp, fxh, name, offset, data, datalen);
+  }
  
   memset(cmd_arg, '\0', sizeof(cmd_arg)); 
   snprintf(cmd_arg, sizeof(cmd_arg)-1, "%s %" PR_LU " %lu", name,
@@ -10979,13 +11391,14 @@ static int fxp_handle_write(struct fxp_packet *fxp) {
   pr_proctitle_set("%s - %s: WRITE %s %" PR_LU " %lu", session.user,
     session.proc_prefix, name, (pr_off_t) offset, (unsigned long) datalen);
 
-  pr_trace_msg(trace_channel, 7, "received request: WRITE %s %" PR_LU " %lu",
-    name, (pr_off_t) offset, (unsigned long) datalen);
+  if (pr_trace_chan_enabled(&trace_chan, 7)) {
+    pr_trace_msg(trace_channel, 7, "received request: WRITE %s %" PR_LU " %lu",
+      name, (pr_off_t) offset, (unsigned long) datalen);
+  }
 
   buflen = bufsz = FXP_RESPONSE_DATA_DEFAULT_SZ;
   buf = ptr = palloc(fxp->pool, bufsz);
 
-  fxh = fxp_handle_get(name);
   if (fxh == NULL) {
     pr_trace_msg(trace_channel, 17,
       "%s: unable to find handle for name '%s': %s", cmd->argv[0], name,
@@ -11278,10 +11691,14 @@ static int fxp_handle_write(struct fxp_packet *fxp) {
     }
   }
 
+  fxp_handle_set_fast_path(fxp->pool, fxh, cmd2->argv[0], &st);
+
   status_code = SSH2_FX_OK;
 
-  pr_trace_msg(trace_channel, 8, "sending response: STATUS %lu '%s'",
-    (unsigned long) status_code, fxp_strerror(status_code));
+  if (pr_trace_chan_enabled(&trace_chan, 8)) {
+    pr_trace_msg(trace_channel, 8, "sending response: STATUS %lu '%s'",
+      (unsigned long) status_code, fxp_strerror(status_code));
+  }
 
   fxp_status_write(&buf, &buflen, fxp->request_id, status_code,
     fxp_strerror(status_code), NULL);
@@ -11578,16 +11995,20 @@ int sftp_fxp_handle_packet(pool *p, void *ssh2, uint32_t channel_id,
     session.curr_phase = PRE_CMD;
 
     if (fxp->request_id) {
-      pr_trace_msg(trace_channel, 6,
-        "received %s (%d) SFTP request (request ID %lu, channel ID %lu)",
-        fxp_get_request_type_desc(fxp->request_type), fxp->request_type,
-        (unsigned long) fxp->request_id, (unsigned long) channel_id);
+      if (pr_trace_chan_enabled(&trace_chan, 6)) {
+        pr_trace_msg(trace_channel, 6,
+          "received %s (%d) SFTP request (request ID %lu, channel ID %lu)",
+          fxp_get_request_type_desc(fxp->request_type), fxp->request_type,
+          (unsigned long) fxp->request_id, (unsigned long) channel_id);
+      }
 
     } else {
-      pr_trace_msg(trace_channel, 6,
-        "received %s (%d) SFTP request (channel ID %lu)",
-        fxp_get_request_type_desc(fxp->request_type), fxp->request_type,
-        (unsigned long) channel_id);
+      if (pr_trace_chan_enabled(&trace_chan, 6)) {
+        pr_trace_msg(trace_channel, 6,
+          "received %s (%d) SFTP request (channel ID %lu)",
+          fxp_get_request_type_desc(fxp->request_type), fxp->request_type,
+          (unsigned long) channel_id);
+      }
     }
 
     fxp_session = fxp_get_session(channel_id);
@@ -36,7 +36,9 @@
 #include "disconnect.h"
 #include "interop.h"
 #include "tap.h"
+#include "curve25519.h"
 
+extern xaset_t *server_list;
 extern module sftp_module;
 
 /* For managing the kexinit process */
@@ -117,12 +119,23 @@ struct sftp_kex {
   EC_KEY *ec;
   EC_POINT *client_point;
 #endif /* PR_USE_OPENSSL_ECC */
+
+  /* Using Curve25519? */
+  int use_curve25519;
+  unsigned char curve25519_priv[SFTP_CURVE25519_SIZE];
+  unsigned char curve25519_pub[SFTP_CURVE25519_SIZE];
+  unsigned char *curve25519_client_pub;
 };
 
 static struct sftp_kex *kex_first_kex = NULL;
 static struct sftp_kex *kex_rekey_kex = NULL;
 static int kex_sent_kexinit = FALSE;
 
+/* When the current rekey started, for measuring how long the data transfer
+ * stalls while the new keys are negotiated.
+ */
+static struct timeval kex_rekey_start_tv;
+
 /* Diffie-Hellman group moduli */
 
 static const char *dh_group1_str =
@@ -163,6 +176,19 @@ static unsigned char kex_digest_buf[EVP_MAX_MD_SIZE];
  */
 static FILE *kex_dhparams_fp = NULL;
 
+/* The DH parameters from each SFTPDHParamFile, parsed once by the daemon
+ * process and inherited by the session processes, so that each group
+ * exchange need not read and parse the entire file again.
+ */
+struct kex_dhparams {
+  struct kex_dhparams *next;
+  const char *path;
+  array_header *dhs;
+};
+
+static pool *kex_dhparams_pool = NULL;
+static struct kex_dhparams *kex_dhparams_list = NULL;
+
 /* Necessary prototypes. */
 static struct ssh2_packet *read_kex_packet(pool *, struct sftp_kex *, int,
   char *, unsigned int, ...);
@@ -468,6 +494,95 @@ static const unsigned char *calculate_kexrsa_h(struct sftp_kex *kex,
   return kex_digest_buf;
 }
 
+static const unsigned char *calculate_curve25519_h(struct sftp_kex *kex,
+    const unsigned char *hostkey_data, size_t hostkey_datalen, const BIGNUM *k,
+    uint32_t *hlen) {
+  EVP_MD_CTX ctx;
+  unsigned char *buf, *ptr;
+  uint32_t buflen, bufsz;
+
+  bufsz = buflen = 4096;
+
+  /* XXX Is this buffer large enough? Too large? */
+  ptr = buf = sftp_msg_getbuf(kex_pool, bufsz);
+
+  /* Write all of the data into the buffer in the SSH2 format, and hash it.
+   * The ordering of these fields is described in RFC5656, with the public
+   * keys written as strings, per RFC8731.
+   */
+
+  /* First, the version strings */
+  sftp_msg_write_string(&buf, &buflen, kex->client_version);
+  sftp_msg_write_string(&buf, &buflen, kex->server_version);
+
+  /* Client's KEXINIT */
+  sftp_msg_write_int(&buf, &buflen, kex->client_kexinit_payload_len + 1);
+  sftp_msg_write_byte(&buf, &buflen, SFTP_SSH2_MSG_KEXINIT);
+  sftp_msg_write_data(&buf, &buflen, kex->client_kexinit_payload,
+    kex->client_kexinit_payload_len, FALSE);
+
+  /* Server's KEXINIT */
+  sftp_msg_write_int(&buf, &buflen, kex->server_kexinit_payload_len + 1);
+  sftp_msg_write_byte(&buf, &buflen, SFTP_SSH2_MSG_KEXINIT);
+  sftp_msg_write_data(&buf, &buflen, kex->server_kexinit_payload,
+    kex->server_kexinit_payload_len, FALSE);
+
+  /* Hostkey data */
+  sftp_msg_write_data(&buf, &buflen, hostkey_data, hostkey_datalen, TRUE);
+
+  /* Client's key */
+  sftp_msg_write_data(&buf, &buflen, kex->curve25519_client_pub,
+    SFTP_CURVE25519_SIZE, TRUE);
+
+  /* Server's key */
+  sftp_msg_write_data(&buf, &buflen, kex->curve25519_pub,
+    SFTP_CURVE25519_SIZE, TRUE);
+
+  /* Shared secret */
+  sftp_msg_write_mpint(&buf, &buflen, k);
+
+  /* In OpenSSL 0.9.6, many of the EVP_Digest* functions returned void, not
+   * int.  Without these ugly OpenSSL version preprocessor checks, the
+   * compiler will error out with "void value not ignored as it ought to be".
+   */
+
+#if OPENSSL_VERSION_NUMBER >= 0x000907000L
+  if (EVP_DigestInit(&ctx, kex->hash) != 1) {
+    (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
+      "error initializing message digest: %s", sftp_crypto_get_errors());
+    pr_memscrub(ptr, bufsz);
+    return NULL;
+  }
+#else
+  EVP_DigestInit(&ctx, kex->hash);
+#endif
+
+#if OPENSSL_VERSION_NUMBER >= 0x000907000L
+  if (EVP_DigestUpdate(&ctx, ptr, (bufsz - buflen)) != 1) {
+    (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
+      "error updating message digest: %s", sftp_crypto_get_errors());
+    pr_memscrub(ptr, bufsz);
+    return NULL;
+  }
+#else
+  EVP_DigestUpdate(&ctx, ptr, (bufsz - buflen));
+#endif
+
+#if OPENSSL_VERSION_NUMBER >= 0x000907000L
+  if (EVP_DigestFinal(&ctx, kex_digest_buf, hlen) != 1) {
+    (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
+      "error finalizing message digest: %s", sftp_crypto_get_errors());
+    pr_memscrub(ptr, bufsz);
+    return NULL;
+  }
+#else
+  EVP_DigestFinal(&ctx, kex_digest_buf, hlen);
+#endif
+
+  pr_memscrub(ptr, bufsz);
+  return kex_digest_buf;
+}
+
 #ifdef PR_USE_OPENSSL_ECC
 static const unsigned char *calculate_ecdh_h(struct sftp_kex *kex,
     const unsigned char *hostkey_data, size_t hostkey_datalen, const BIGNUM *k,
@@ -1105,6 +1220,32 @@ static int finish_ecdh(struct sftp_kex *kex) {
 
 #endif /* PR_USE_OPENSSL_ECC */
 
+static int create_curve25519(struct sftp_kex *kex) {
+  if (RAND_bytes(kex->curve25519_priv, SFTP_CURVE25519_SIZE) != 1) {
+    (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
+      "error generating Curve25519 private key: %s", sftp_crypto_get_errors());
+    return -1;
+  }
+
+  pr_trace_msg(trace_channel, 12, "generating Curve25519 key");
+  if (sftp_curve25519_scalarmult_base(kex->curve25519_pub,
+      kex->curve25519_priv) < 0) {
+    (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
+      "error generating Curve25519 public key");
+    pr_memscrub(kex->curve25519_priv, SFTP_CURVE25519_SIZE);
+    return -1;
+  }
+
+  kex->hash = EVP_sha256();
+  return 0;
+}
+
+static int finish_curve25519(struct sftp_kex *kex) {
+  pr_memscrub(kex->curve25519_priv, SFTP_CURVE25519_SIZE);
+  kex->curve25519_client_pub = NULL;
+  return 0;
+}
+
 static array_header *parse_namelist(pool *p, const char *names) {
   char *ptr;
   array_header *list;
@@ -1206,6 +1347,9 @@ static const char *get_shared_name(pool *p, const char *c2s_names,
 }
 
 static const char *kex_exchanges[] = {
+  "curve25519-sha256",
+  "curve25519-sha256@libssh.org",
+
 #ifdef PR_USE_OPENSSL_ECC
   "ecdh-sha2-nistp256",
   "ecdh-sha2-nistp384",
@@ -1438,6 +1582,8 @@ static void destroy_kex(struct sftp_kex *kex) {
       pr_memscrub((char *) kex->h, kex->hlen);
       kex->hlen = 0;
     }
+
+    pr_memscrub(kex->curve25519_priv, SFTP_CURVE25519_SIZE);
   }
 
   kex_first_kex = kex_rekey_kex = NULL;
@@ -1518,6 +1664,19 @@ static int setup_kex_algo(struct sftp_kex *kex, const char *algo) {
     return 0;
 #endif
 
+  } else if (strncmp(algo, "curve25519-sha256", 18) == 0 ||
+             strncmp(algo, "curve25519-sha256@libssh.org", 29) == 0) {
+    if (create_curve25519(kex) < 0) {
+      (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
+        "error using '%s' as the key exchange algorithm: %s", algo,
+        strerror(errno));
+      return -1;
+    }
+
+    kex->session_names->kex_algo = algo;
+    kex->use_curve25519 = TRUE;
+    return 0;
+
 #ifdef PR_USE_OPENSSL_ECC
   } else if (strncmp(algo, "ecdh-sha2-nistp256", 19) == 0) {
     if (create_ecdh(kex, SFTP_ECDH_SHA256) < 0) {
@@ -2163,21 +2322,23 @@ static int read_dh_init(struct ssh2_packet *pkt, struct sftp_kex *kex) {
 static int set_session_keys(struct sftp_kex *kex) {
   const char *k, *v;
 
+  /* All of the keys, for both directions, are derived from the same
+   * K || H prefix; it is hashed once, and scrubbed once all of the keys
+   * have been set.
+   */
   if (sftp_cipher_set_read_key(kex_pool, kex->hash, kex->k, kex->h,
-      kex->hlen) < 0)
-    return -1;
-
-  if (sftp_cipher_set_write_key(kex_pool, kex->hash, kex->k, kex->h,
-      kex->hlen) < 0)
-    return -1;
-
-  if (sftp_mac_set_read_key(kex_pool, kex->hash, kex->k, kex->h,
-      kex->hlen) < 0)
+      kex->hlen) < 0 ||
+      sftp_cipher_set_write_key(kex_pool, kex->hash, kex->k, kex->h,
+      kex->hlen) < 0 ||
+      sftp_mac_set_read_key(kex_pool, kex->hash, kex->k, kex->h,
+      kex->hlen) < 0 ||
+      sftp_mac_set_write_key(kex_pool, kex->hash, kex->k, kex->h,
+      kex->hlen) < 0) {
+    sftp_crypto_kdf_clear();
     return -1;
+  }
 
-  if (sftp_mac_set_write_key(kex_pool, kex->hash, kex->k, kex->h,
-      kex->hlen) < 0)
-    return -1;
+  sftp_crypto_kdf_clear();
 
   if (sftp_compress_init_read(SFTP_COMPRESS_FL_NEW_KEY) < 0)
     return -1;
@@ -2233,8 +2394,22 @@ static int set_session_keys(struct sftp_kex *kex) {
     kex_rekey_timeout_timerno = -1;
   }
 
-  if (kex_rekey_kex != NULL) {
-    pr_trace_msg("ssh2", 3, "rekey KEX completed");
+  if (kex_rekey_start_tv.tv_sec != 0) {
+    struct timeval now;
+    unsigned long elapsed_ms;
+
+    gettimeofday(&now, NULL);
+    elapsed_ms = (unsigned long) (((now.tv_sec - kex_rekey_start_tv.tv_sec) *
+      1000L) + ((now.tv_usec - kex_rekey_start_tv.tv_usec) / 1000L));
+
+    pr_trace_msg("ssh2", 3, "%s rekey KEX completed (%lu ms)",
+      kex_rekey_kex != NULL ? "server-initiated" : "client-initiated",
+      elapsed_ms);
+    (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
+      "rekey (%s) stalled data transfer for %lu ms",
+      kex->session_names->kex_algo, elapsed_ms);
+
+    kex_rekey_start_tv.tv_sec = kex_rekey_start_tv.tv_usec = 0;
   }
 
   sftp_ssh2_packet_rekey_reset();
@@ -2454,6 +2629,76 @@ static int read_dh_gex(struct ssh2_packet *pkt, uint32_t *min, uint32_t *pref,
   return 0;
 }
 
+static array_header *get_dhparams(const char *path) {
+  struct kex_dhparams *dhp;
+
+  for (dhp = kex_dhparams_list; dhp; dhp = dhp->next) {
+    if (strcmp(dhp->path, path) == 0) {
+      return dhp->dhs;
+    }
+  }
+
+  return NULL;
+}
+
+/* Select a DH from the given list, using the same policy as when reading
+ * the SFTPDHParamFile directly: a random DH of the preferred size, else of
+ * the smallest larger size, else of the largest smaller size.
+ */
+static DH *select_dhparams(array_header *dhs, uint32_t min, uint32_t pref,
+    uint32_t max) {
+  register unsigned int i;
+  DH **elts, *dh = NULL;
+  int best_nbits = 0, count = 0;
+
+  elts = dhs->elts;
+  for (i = 0; i < dhs->nelts; i++) {
+    int nbits, better = FALSE;
+
+    nbits = DH_size(elts[i]) * 8;
+    if (nbits < min ||
+        nbits > max) {
+      continue;
+    }
+
+    if (count == 0) {
+      better = TRUE;
+
+    } else if (nbits != best_nbits) {
+      if (best_nbits == pref) {
+        better = FALSE;
+
+      } else if (nbits == pref) {
+        better = TRUE;
+
+      } else if (nbits > pref) {
+        better = (best_nbits < pref || nbits < best_nbits);
+
+      } else {
+        better = (best_nbits < pref && nbits > best_nbits);
+      }
+    }
+
+    if (better) {
+      best_nbits = nbits;
+      count = 0;
+    }
+
+    if (nbits == best_nbits) {
+      /* Reservoir sampling, so that each DH of the chosen size is equally
+       * likely to be picked.  As below, rand(3) is good enough here.
+       */
+      count++;
+      if (count == 1 ||
+          (int) (rand() / (RAND_MAX / count + 1)) == 0) {
+        dh = elts[i];
+      }
+    }
+  }
+
+  return dh;
+}
+
 static int get_dh_gex_group(struct sftp_kex *kex, uint32_t min,
     uint32_t pref, uint32_t max) {
   const char *dhparam_path;
@@ -2466,7 +2711,54 @@ static int get_dh_gex_group(struct sftp_kex *kex, uint32_t min,
     dhparam_path = c->argv[0];
   }
 
-  if (dhparam_path) {
+  if (dhparam_path != NULL &&
+      get_dhparams(dhparam_path) != NULL) {
+    DH *dh;
+
+    pr_trace_msg(trace_channel, 15,
+      "using preloaded DH parameters from SFTPDHParamFile '%s' for group "
+      "exchange", dhparam_path);
+
+    dh = select_dhparams(get_dhparams(dhparam_path), min, pref, max);
+    if (dh != NULL) {
+      pr_trace_msg(trace_channel, 20, "client requested min %lu, pref %lu, "
+        "max %lu sizes for DH group exchange, selected DH of %lu bits",
+        (unsigned long) min, (unsigned long) pref, (unsigned long) max,
+        (unsigned long) DH_size(dh) * 8);
+
+      kex->dh->p = BN_dup(dh->p);
+      kex->dh->g = BN_dup(dh->g);
+
+      if (kex->dh->p == NULL ||
+          kex->dh->g == NULL) {
+        (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
+          "error copying selected DH P/G: %s", sftp_crypto_get_errors());
+        (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
+          "WARNING: using fixed modulus for DH group exchange");
+
+        if (kex->dh->p != NULL) {
+          BN_clear_free(kex->dh->p);
+          kex->dh->p = NULL;
+        }
+
+        if (kex->dh->g != NULL) {
+          BN_clear_free(kex->dh->g);
+          kex->dh->g = NULL;
+        }
+
+        use_fixed_modulus = TRUE;
+      }
+
+    } else {
+      (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
+        "unable to find suitable DH in SFTPDHParamFile '%s' for %lu-%lu "
+        "bit sizes", dhparam_path, (unsigned long) min, (unsigned long) max);
+      (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
+        "WARNING: using fixed modulus for DH group exchange");
+      use_fixed_modulus = TRUE;
+    }
+
+  } else if (dhparam_path) {
     if (kex_dhparams_fp != NULL) {
       /* Rewind to the start of the file. */
       fseek(kex_dhparams_fp, 0, SEEK_SET);
@@ -3189,6 +3481,183 @@ static int handle_kex_rsa(struct sftp_kex *kex) {
   return 0;
 }
 
+static int read_curve25519_init(struct ssh2_packet *pkt,
+    struct sftp_kex *kex) {
+  unsigned char *buf;
+  uint32_t buflen, publen;
+
+  buf = pkt->payload;
+  buflen = pkt->payload_len;
+
+  /* Read in the client's Curve25519 public key, Q_C. */
+  publen = sftp_msg_read_int(pkt->pool, &buf, &buflen);
+  if (publen != SFTP_CURVE25519_SIZE) {
+    (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
+      "invalid client Curve25519 public key length (%lu bytes), expected "
+      "%u bytes", (unsigned long) publen, SFTP_CURVE25519_SIZE);
+    errno = EINVAL;
+    return -1;
+  }
+
+  kex->curve25519_client_pub = sftp_msg_read_data(kex_pool, &buf, &buflen,
+    publen);
+  return 0;
+}
+
+static int write_curve25519_reply(struct ssh2_packet *pkt,
+    struct sftp_kex *kex) {
+  const unsigned char *h;
+  const unsigned char *hostkey_data, *hsig;
+  unsigned char *buf, *ptr;
+  unsigned char secret[SFTP_CURVE25519_SIZE];
+  uint32_t bufsz, buflen, hlen = 0;
+  size_t hostkey_datalen, hsiglen;
+  BIGNUM *k = NULL;
+
+  /* Compute the shared secret */
+  pr_trace_msg(trace_channel, 12, "computing Curve25519 key");
+  if (sftp_curve25519_scalarmult(secret, kex->curve25519_priv,
+      kex->curve25519_client_pub) < 0) {
+    (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
+      "error computing Curve25519 shared secret: invalid client public key");
+    pr_memscrub(secret, sizeof(secret));
+    return -1;
+  }
+
+  k = BN_new();
+  if (k == NULL) {
+    (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
+      "error allocating new BIGNUM: %s", sftp_crypto_get_errors());
+    pr_memscrub(secret, sizeof(secret));
+    return -1;
+  }
+
+  /* Per RFC8731, the shared secret is treated as an unsigned fixed-length
+   * integer, in network byte order.
+   */
+  if (BN_bin2bn(secret, sizeof(secret), k) == NULL) {
+    (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
+      "error converting Curve25519 shared secret to BN: %s",
+      sftp_crypto_get_errors());
+    pr_memscrub(secret, sizeof(secret));
+    BN_clear_free(k);
+    return -1;
+  }
+
+  pr_memscrub(secret, sizeof(secret));
+  kex->k = k;
+
+  /* Get the hostkey data; it will be part of the data we hash in order
+   * to create the session key.
+   */
+  hostkey_data = sftp_keys_get_hostkey_data(pkt->pool, kex->use_hostkey_type,
+    &hostkey_datalen);
+  if (hostkey_data == NULL) {
+    (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
+      "error converting hostkey for signing: %s", strerror(errno));
+
+    BN_clear_free(kex->k);
+    kex->k = NULL;
+    return -1;
+  }
+
+  /* Calculate H */
+  h = calculate_curve25519_h(kex, hostkey_data, hostkey_datalen, k, &hlen);
+  if (h == NULL) {
+    pr_memscrub((char *) hostkey_data, hostkey_datalen);
+    BN_clear_free(kex->k);
+    kex->k = NULL;
+    return -1;
+  }
+
+  kex->h = palloc(pkt->pool, hlen);
+  kex->hlen = hlen;
+  memcpy((char *) kex->h, h, kex->hlen);
+
+  /* Save H as the session ID */
+  sftp_session_set_id(h, hlen);
+
+  /* Sign H with our hostkey */
+  hsig = sftp_keys_sign_data(pkt->pool, kex->use_hostkey_type, h, hlen,
+    &hsiglen);
+  if (hsig == NULL) {
+    (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION, "error signing H");
+    pr_memscrub((char *) hostkey_data, hostkey_datalen);
+    BN_clear_free(kex->k);
+    kex->k = NULL;
+    return -1;
+  }
+
+  /* XXX Is this large enough?  Too large? */
+  buflen = bufsz = 4096;
+  ptr = buf = palloc(pkt->pool, bufsz);
+
+  sftp_msg_write_byte(&buf, &buflen, SFTP_SSH2_MSG_KEX_ECDH_REPLY);
+  sftp_msg_write_data(&buf, &buflen, hostkey_data, hostkey_datalen, TRUE);
+  sftp_msg_write_data(&buf, &buflen, kex->curve25519_pub,
+    SFTP_CURVE25519_SIZE, TRUE);
+  sftp_msg_write_data(&buf, &buflen, hsig, hsiglen, TRUE);
+
+  /* Scrub any sensitive data when done */
+  pr_memscrub((char *) hostkey_data, hostkey_datalen);
+  pr_memscrub((char *) hsig, hsiglen);
+
+  pkt->payload = ptr;
+  pkt->payload_len = (bufsz - buflen);
+
+  return 0;
+}
+
+static int handle_kex_curve25519(struct ssh2_packet *pkt,
+    struct sftp_kex *kex) {
+  int res;
+  cmd_rec *cmd;
+  const char *req;
+
+  /* Curve25519 uses the same messages as ECDH, per RFC8731. */
+  req = "ECDH_INIT";
+  cmd = pr_cmd_alloc(pkt->pool, 1, pstrdup(pkt->pool, req));
+  cmd->arg = "(data)";
+  cmd->cmd_class = CL_AUTH;
+
+  pr_trace_msg(trace_channel, 9, "reading %s message from client", req);
+
+  res = read_curve25519_init(pkt, kex);
+  if (res < 0) {
+    pr_cmd_dispatch_phase(cmd, LOG_CMD_ERR, 0);
+
+    destroy_pool(pkt->pool);
+    SFTP_DISCONNECT_CONN(SFTP_SSH2_DISCONNECT_KEY_EXCHANGE_FAILED, NULL);
+  }
+
+  pr_cmd_dispatch_phase(cmd, LOG_CMD, 0);
+  destroy_pool(pkt->pool);
+
+  /* Send our key exchange reply. */
+  pkt = sftp_ssh2_packet_create(kex_pool);
+  res = write_curve25519_reply(pkt, kex);
+  if (res < 0) {
+    destroy_pool(pkt->pool);
+    SFTP_DISCONNECT_CONN(SFTP_SSH2_DISCONNECT_KEY_EXCHANGE_FAILED, NULL);
+  }
+
+  /* Don't clean up the private key in the kex struct until after we've
+   * written out a reply.
+   */
+  finish_curve25519(kex);
+
+  pr_trace_msg(trace_channel, 9, "writing %s message to client", req);
+
+  res = sftp_ssh2_packet_write(sftp_conn->wfd, pkt);
+  if (res < 0) {
+    destroy_pool(pkt->pool);
+    SFTP_DISCONNECT_CONN(SFTP_SSH2_DISCONNECT_KEY_EXCHANGE_FAILED, NULL);
+  }
+
+  destroy_pool(pkt->pool);
+  return 0;
+}
+
 #ifdef PR_USE_OPENSSL_ECC
 static int read_ecdh_init(struct ssh2_packet *pkt, struct sftp_kex *kex) {
   unsigned char *buf;
@@ -3523,6 +3992,8 @@ int sftp_kex_handle(struct ssh2_packet *pkt) {
     kex = kex_rekey_kex;
 
   } else {
+    /* Client-initiated rekey. */
+    gettimeofday(&kex_rekey_start_tv, NULL);
     kex = create_kex(kex_pool);
   }
 
@@ -3671,6 +4142,10 @@ int sftp_kex_handle(struct ssh2_packet *pkt) {
         /* This handles the case of SFTP_SSH2_MSG_KEX_DH_GEX_REQUEST_OLD as
          * well; that ID has the same value as the KEX_DH_INIT ID.
          */
+        if (kex->use_curve25519) {
+          res = handle_kex_curve25519(pkt, kex);
+
+        } else
 #ifdef PR_USE_OPENSSL_ECC
         if (kex->use_ecdh) {
           res = handle_kex_ecdh(pkt, kex);
@@ -3703,11 +4178,7 @@ int sftp_kex_handle(struct ssh2_packet *pkt) {
 
       default:
         (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
-#ifdef PR_USE_OPENSSL_ECC
           "expecting KEX_DH_INIT, KEX_ECDH_INIT or KEX_DH_GEX_GROUP message, "
-#else
-          "expecting KEX_DH_INIT or KEX_DH_GEX_GROUP message, "
-#endif /* PR_USE_OPENSSL_ECC */
           "received %s (%d), disconnecting",
           sftp_ssh2_packet_get_mesg_type_desc(mesg_type), mesg_type);
         destroy_kex(kex);
@@ -3797,6 +4268,87 @@ int sftp_kex_handle(struct ssh2_packet *pkt) {
   return 0;
 }
 
+int sftp_kex_load_dhparams(void) {
+  server_rec *s;
+
+  sftp_kex_free_dhparams();
+
+  kex_dhparams_pool = make_sub_pool(permanent_pool);
+  pr_pool_tag(kex_dhparams_pool, "SFTP DH params pool");
+
+  for (s = (server_rec *) server_list->xas_list; s; s = s->next) {
+    config_rec *c;
+    const char *path;
+    struct kex_dhparams *dhp;
+    FILE *fp;
+    DH *dh;
+
+    path = PR_CONFIG_DIR "/dhparams.pem";
+    c = find_config(s->conf, CONF_PARAM, "SFTPDHParamFile", FALSE);
+    if (c) {
+      path = c->argv[0];
+    }
+
+    if (get_dhparams(path) != NULL) {
+      continue;
+    }
+
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+      pr_log_debug(DEBUG5, MOD_SFTP_VERSION
+        ": unable to read SFTPDHParamFile '%s': %s", path, strerror(errno));
+      continue;
+    }
+
+    dhp = pcalloc(kex_dhparams_pool, sizeof(struct kex_dhparams));
+    dhp->path = pstrdup(kex_dhparams_pool, path);
+    dhp->dhs = make_array(kex_dhparams_pool, 8, sizeof(DH *));
+
+    while ((dh = PEM_read_DHparams(fp, NULL, NULL, NULL)) != NULL) {
+      pr_signals_handle();
+      *((DH **) push_array(dhp->dhs)) = dh;
+    }
+
+    if (!feof(fp)) {
+      pr_log_debug(DEBUG5, MOD_SFTP_VERSION
+        ": error reading DH params from SFTPDHParamFile '%s': %s", path,
+        sftp_crypto_get_errors());
+    }
+
+    fclose(fp);
+
+    pr_log_debug(DEBUG8, MOD_SFTP_VERSION
+      ": loaded %u DH params from SFTPDHParamFile '%s'", dhp->dhs->nelts,
+      path);
+
+    dhp->next = kex_dhparams_list;
+    kex_dhparams_list = dhp;
+  }
+
+  return 0;
+}
+
+void sftp_kex_free_dhparams(void) {
+  struct kex_dhparams *dhp;
+
+  for (dhp = kex_dhparams_list; dhp; dhp = dhp->next) {
+    register unsigned int i;
+    DH **dhs;
+
+    dhs = dhp->dhs->elts;
+    for (i = 0; i < dhp->dhs->nelts; i++) {
+      DH_free(dhs[i]);
+    }
+  }
+
+  kex_dhparams_list = NULL;
+
+  if (kex_dhparams_pool != NULL) {
+    destroy_pool(kex_dhparams_pool);
+    kex_dhparams_pool = NULL;
+  }
+}
+
 int sftp_kex_free(void) {
   if (kex_dhparams_fp != NULL) {
     (void) fclose(kex_dhparams_fp);
@@ -3894,6 +4446,7 @@ int sftp_kex_rekey(void) {
   pr_trace_msg(trace_channel, 17, "sending rekey KEXINIT");
 
   sftp_sess_state |= SFTP_SESS_STATE_REKEYING;
+  gettimeofday(&kex_rekey_start_tv, NULL);
   sftp_kex_init(NULL, NULL);
 
   kex_rekey_kex = create_kex(kex_pool);
@@ -33,6 +33,10 @@ int sftp_kex_handle(struct ssh2_packet *);
 int sftp_kex_init(const char *, const char *);
 int sftp_kex_free(void);
 
+/* Preload/free the SFTPDHParamFile DH parameters, in the daemon process. */
+int sftp_kex_load_dhparams(void);
+void sftp_kex_free_dhparams(void);
+
 int sftp_kex_rekey(void);
 int sftp_kex_rekey_set_interval(int);
 int sftp_kex_rekey_set_timeout(int);
@@ -75,6 +75,13 @@ struct sftp_pkey {
   char *host_pkey;
   void *host_pkey_ptr;
   server_rec *server;
+
+  /* The host key, as parsed once by the daemon process when obtaining the
+   * passphrase, so that session processes need not read and decrypt it
+   * again.
+   */
+  const char *path;
+  EVP_PKEY *pkey;
 };
 
 #define SFTP_PASSPHRASE_TIMEOUT		10
@@ -93,6 +100,9 @@ struct sftp_pkey_data {
 
 static const char *trace_channel = "ssh2";
 
+/* Necessary prototypes. */
+static int has_req_perms(int);
+
 static void prepare_provider_fds(int stdout_fd, int stderr_fd) {
   long nfiles = 0;
   register unsigned int i = 0;
@@ -570,7 +580,7 @@ static int get_passphrase(struct sftp_pkey *k, const char *path) {
   char prompt[256];
   FILE *fp;
   EVP_PKEY *pkey = NULL;
-  int fd, prompt_fd = -1, res, xerrno;
+  int fd, keep_pkey, prompt_fd = -1, res, xerrno;
   struct sftp_pkey_data pdata;
   register unsigned int attempt;
 
@@ -600,6 +610,12 @@ static int get_passphrase(struct sftp_pkey *k, const char *path) {
     }
   }
 
+  /* Only keep the parsed key for the session processes if the file has the
+   * permissions they would require; otherwise, let them read it (and
+   * complain) themselves.
+   */
+  keep_pkey = (has_req_perms(fd) == 0);
+
   fp = fdopen(fd, "r");
   if (fp == NULL) {
     xerrno = errno;
@@ -684,7 +700,13 @@ static int get_passphrase(struct sftp_pkey *k, const char *path) {
 #endif
   }
 
-  EVP_PKEY_free(pkey);
+  if (keep_pkey) {
+    k->pkey = pkey;
+
+  } else {
+    EVP_PKEY_free(pkey);
+  }
+
   return 0;
 }
 
@@ -720,11 +742,40 @@ static struct sftp_pkey *lookup_pkey(void) {
       free(k->host_pkey_ptr);
       k->host_pkey = k->host_pkey_ptr = NULL;
     }
+
+    if (k->pkey) {
+      EVP_PKEY_free(k->pkey);
+      k->pkey = NULL;
+    }
   }
 
   return pkey;
 }
 
+/* Look for a host key already parsed by the daemon process for the current
+ * server.  Ownership of the key passes to the caller.
+ */
+static EVP_PKEY *lookup_parsed_hostkey(const char *path) {
+  struct sftp_pkey *k;
+
+  for (k = sftp_pkey_list; k; k = k->next) {
+    EVP_PKEY *pkey;
+
+    if (k->server != main_server ||
+        k->pkey == NULL ||
+        k->path == NULL ||
+        strcmp(k->path, path) != 0) {
+      continue;
+    }
+
+    pkey = k->pkey;
+    k->pkey = NULL;
+    return pkey;
+  }
+
+  return NULL;
+}
+
 static void scrub_pkeys(void) {
   struct sftp_pkey *k;
  
@@ -743,6 +794,11 @@ static void scrub_pkeys(void) {
       free(k->host_pkey_ptr);
       k->host_pkey = k->host_pkey_ptr = NULL;
     }
+
+    if (k->pkey) {
+      EVP_PKEY_free(k->pkey);
+      k->pkey = NULL;
+    }
   }
 
   sftp_pkey_list = NULL;
@@ -1916,6 +1972,17 @@ static int load_file_hostkey(pool *p, const char *path) {
   FILE *fp;
   EVP_PKEY *pkey;
 
+  if (server_pkey == NULL) {
+    server_pkey = lookup_pkey();
+  }
+
+  pkey = lookup_parsed_hostkey(path);
+  if (pkey != NULL) {
+    pr_trace_msg(trace_channel, 9,
+      "using host key from '%s' already parsed by daemon process", path);
+    return handle_hostkey(p, pkey, NULL, 0, path, NULL);
+  }
+
   pr_signals_block();
   PRIVS_ROOT
 
@@ -2916,6 +2983,7 @@ void sftp_keys_get_passphrases(void) {
       k = pcalloc(s->pool, sizeof(struct sftp_pkey));      
       k->pkeysz = PEM_BUFSIZE;
       k->server = s;
+      k->path = c->argv[0];
 
       if (get_passphrase(k, c->argv[0]) < 0) {
         int xerrno = errno;
@@ -388,38 +388,12 @@ static int set_mac_key(struct sftp_mac *mac, const EVP_MD *hash,
    * compiler will error out with "void value not ignored as it ought to be".
    */
 
-#if OPENSSL_VERSION_NUMBER >= 0x000907000L
-  if (EVP_DigestInit(&ctx, hash) != 1) {
+  if (sftp_crypto_kdf_init(&ctx, hash, k, klen, h, hlen) < 0) {
     (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
       "error initializing message digest: %s", sftp_crypto_get_errors());
     free(key);
     return -1;
   }
-#else
-  EVP_DigestInit(&ctx, hash);
-#endif
-
-#if OPENSSL_VERSION_NUMBER >= 0x000907000L
-  if (EVP_DigestUpdate(&ctx, k, klen) != 1) {
-    (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
-      "error updating message digest with K: %s", sftp_crypto_get_errors());
-    free(key);
-    return -1;
-  }
-#else
-  EVP_DigestUpdate(&ctx, k, klen);
-#endif
-
-#if OPENSSL_VERSION_NUMBER >= 0x000907000L
-  if (EVP_DigestUpdate(&ctx, h, hlen) != 1) {
-    (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
-      "error updating message digest with H: %s", sftp_crypto_get_errors());
-    free(key);
-    return -1;
-  }
-#else
-  EVP_DigestUpdate(&ctx, h, hlen);
-#endif
 
 #if OPENSSL_VERSION_NUMBER >= 0x000907000L
   if (EVP_DigestUpdate(&ctx, letter, sizeof(char)) != 1) {
@@ -465,41 +439,13 @@ static int set_mac_key(struct sftp_mac *mac, const EVP_MD *hash,
 
     pr_signals_handle();
 
-#if OPENSSL_VERSION_NUMBER >= 0x000907000L
-    if (EVP_DigestInit(&ctx, hash) != 1) {
+    if (sftp_crypto_kdf_init(&ctx, hash, k, klen, h, hlen) < 0) {
       (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
         "error initializing message digest: %s", sftp_crypto_get_errors());
       pr_memscrub(key, key_sz);
       free(key);
       return -1;
     }
-#else
-    EVP_DigestInit(&ctx, hash);
-#endif
-
-#if OPENSSL_VERSION_NUMBER >= 0x000907000L
-    if (EVP_DigestUpdate(&ctx, k, klen) != 1) {
-      (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
-        "error updating message digest with K: %s", sftp_crypto_get_errors());
-      pr_memscrub(key, key_sz);
-      free(key);
-      return -1;
-    }
-#else
-    EVP_DigestUpdate(&ctx, k, klen);
-#endif
-
-#if OPENSSL_VERSION_NUMBER >= 0x000907000L
-    if (EVP_DigestUpdate(&ctx, h, hlen) != 1) {
-      (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
-        "error updating message digest with H: %s", sftp_crypto_get_errors());
-      pr_memscrub(key, key_sz);
-      free(key);
-      return -1;
-    }
-#else
-    EVP_DigestUpdate(&ctx, h, hlen);
-#endif
 
 #if OPENSSL_VERSION_NUMBER >= 0x000907000L
     if (EVP_DigestUpdate(&ctx, key, len) != 1) {
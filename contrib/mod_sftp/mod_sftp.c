@@ -1118,7 +1118,9 @@ MODRET set_sftpkeyexchanges(cmd_rec *cmd) {
   CHECK_CONF(cmd, CONF_ROOT|CONF_VIRTUAL|CONF_GLOBAL);
 
   for (i = 1; i < cmd->argc; i++) {
-    if (strncmp(cmd->argv[i], "diffie-hellman-group1-sha1", 27) != 0 &&
+    if (strncmp(cmd->argv[i], "curve25519-sha256", 18) != 0 &&
+        strncmp(cmd->argv[i], "curve25519-sha256@libssh.org", 29) != 0 &&
+        strncmp(cmd->argv[i], "diffie-hellman-group1-sha1", 27) != 0 &&
         strncmp(cmd->argv[i], "diffie-hellman-group14-sha1", 28) != 0 &&
 #if (OPENSSL_VERSION_NUMBER > 0x000907000L && defined(OPENSSL_FIPS)) || \
     (OPENSSL_VERSION_NUMBER > 0x000908000L)
@@ -1231,9 +1233,15 @@ MODRET set_sftpoptions(cmd_rec *cmd) {
     } else if (strncmp(cmd->argv[i], "MatchKeySubject", 16) == 0) {
       opts |= SFTP_OPT_MATCH_KEY_SUBJECT;
 
-    } else if (strcmp(cmd->argv[1], "AllowInsecureLogin") == 0) {
+    } else if (strcmp(cmd->argv[i], "AutoChannelWindow") == 0) {
+      opts |= SFTP_OPT_AUTO_CHANNEL_WINDOW;
+
+    } else if (strcmp(cmd->argv[i], "AllowInsecureLogin") == 0) {
       opts |= SFTP_OPT_ALLOW_INSECURE_LOGIN;
 
+    } else if (strcmp(cmd->argv[i], "FastDataPath") == 0) {
+      opts |= SFTP_OPT_FAST_DATA_PATH;
+
     } else {
       CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, ": unknown SFTPOption '",
         cmd->argv[i], "'", NULL));
@@ -1482,6 +1490,11 @@ static void sftp_postparse_ev(const void *event_data, void *user_data) {
 
   sftp_keys_get_passphrases();
 
+  /* Parse the DH parameters for group exchanges once, here, so that all
+   * session processes share them.
+   */
+  sftp_kex_load_dhparams();
+
   /* Initialize the interoperability checks here, so that all session
    * processes share the compiled regexes in memory.
    */
@@ -1496,6 +1509,9 @@ static void sftp_restart_ev(const void *event_data, void *user_data) {
   /* Clear the host keys. */
   sftp_keys_free();
 
+  /* Clear the preloaded DH parameters. */
+  sftp_kex_free_dhparams();
+
   /* Clear the client banner regexes. */
   sftp_interop_free();
 }
@@ -1504,6 +1520,7 @@ static void sftp_shutdown_ev(const void *event_data, void *user_data) {
   sftp_interop_free();
   sftp_keystore_free();
   sftp_keys_free();
+  sftp_kex_free_dhparams();
   sftp_mac_free();
   sftp_utf8_free();
 
@@ -92,6 +92,21 @@ struct scp_path {
   void *dirh;
   struct scp_path *dir_spi;
 
+  /* For recursive downloads, the next path in the directory is read, and
+   * the file opened (with readahead requested), while we wait for the
+   * client to confirm the current path.  Only files which pass the <Limit>
+   * checks are opened; the PRE_CMD handlers for a prefetched path are still
+   * run when it is actually sent.
+   */
+  struct scp_path *dir_next_spi;
+  int prefetched;
+
+  /* For uploads, the MaxStoreFileSize for this file, looked up once rather
+   * than for every data packet.
+   */
+  off_t max_store;
+  int have_max_store;
+
   /* For supporting the HiddenStores directive. */
   int hiddenstore;
 
@@ -290,6 +305,8 @@ static void reset_path(struct scp_path *sp) {
   sp->recvlen = 0;
   sp->hiddenstore = FALSE;
   sp->file_existed = FALSE;
+  sp->max_store = 0;
+  sp->have_max_store = FALSE;
 
   sp->wrote_errors = FALSE;
 }
@@ -1014,15 +1031,21 @@ static int recv_finfo(pool *p, uint32_t channel_id, struct scp_path *sp,
 static int recv_data(pool *p, uint32_t channel_id, struct scp_path *sp,
     unsigned char *data, uint32_t datalen) {
   uint32_t writelen;
-  config_rec *c;
   off_t nbytes_max_store = 0;
 
   /* Check MaxStoreFileSize */
-  c = find_config(get_dir_ctxt(p, sp->fh->fh_path), CONF_PARAM,
-    "MaxStoreFileSize", FALSE);
-  if (c != NULL) {
-    nbytes_max_store = *((off_t *) c->argv[0]);
+  if (sp->have_max_store == FALSE) {
+    config_rec *c;
+
+    c = find_config(get_dir_ctxt(p, sp->fh->fh_path), CONF_PARAM,
+      "MaxStoreFileSize", FALSE);
+    if (c != NULL) {
+      sp->max_store = *((off_t *) c->argv[0]);
+    }
+
+    sp->have_max_store = TRUE;
   }
+  nbytes_max_store = sp->max_store;
 
   writelen = datalen;
   if (writelen > (sp->filesz - sp->recvlen)) {
@@ -1786,9 +1809,131 @@ static int send_data(pool *p, uint32_t channel_id, struct scp_path *sp,
   return 0;
 }
 
+static struct scp_path *read_dir_path(struct scp_path *sp) {
+  struct dirent *dent;
+
+  while ((dent = pr_fsio_readdir(sp->dirh)) != NULL) {
+    struct scp_path *spi;
+    size_t pathlen;
+
+    pr_signals_handle();
+
+    /* Skip "." and "..". */
+    if (strncmp(dent->d_name, ".", 2) == 0 ||
+        strncmp(dent->d_name, "..", 3) == 0) {
+      continue;
+    }
+
+    /* Add these to the list of paths that need to be sent. */
+    spi = pcalloc(scp_pool, sizeof(struct scp_path));
+    spi->path = pdircat(scp_pool, sp->path, dent->d_name, NULL);
+    pathlen = strlen(spi->path);
+
+    /* Trim any trailing path separators.  It's important. */
+    while (pathlen > 1 &&
+           spi->path[pathlen-1] == '/') {
+      pr_signals_handle();
+      spi->path[pathlen-1] = '\0';
+      pathlen--;
+    }
+
+    spi->best_path = dir_canonical_vpath(scp_pool, spi->path);
+
+    if (pathlen > 0) {
+      return spi;
+    }
+  }
+
+  return NULL;
+}
+
+/* Read the next path in the directory, and for regular files, open the
+ * file and ask the kernel to start reading its first chunk, so that the
+ * disk I/O overlaps with the round trip for the client's confirmation of
+ * the path just sent.
+ */
+static void prefetch_dir_path(pool *p, struct scp_path *sp) {
+  struct scp_path *spi;
+  struct stat st;
+  cmd_rec *cmd;
+  int allowed;
+
+  if (sp->dirh == NULL ||
+      sp->dir_next_spi != NULL) {
+    return;
+  }
+
+  spi = read_dir_path(sp);
+  if (spi == NULL) {
+    return;
+  }
+
+  sp->dir_next_spi = spi;
+
+  if (pr_fsio_stat(spi->path, &st) < 0 ||
+      !S_ISREG(st.st_mode)) {
+    return;
+  }
+
+  /* Do not open files which the client is not allowed to read. */
+  cmd = scp_cmd_alloc(p, C_RETR, spi->path);
+  allowed = dir_check(p, cmd, G_READ, spi->best_path, NULL);
+  destroy_pool(cmd->pool);
+
+  if (!allowed) {
+    pr_trace_msg(trace_channel, 17, "not prefetching '%s': blocked by "
+      "<Limit> configuration", spi->path);
+    return;
+  }
+
+  spi->fh = pr_fsio_open(spi->best_path, O_RDONLY|O_NONBLOCK);
+  if (spi->fh == NULL) {
+    /* We'll find out about any errors when the path is sent. */
+    return;
+  }
+
+  spi->prefetched = TRUE;
+
+#if defined(POSIX_FADV_WILLNEED)
+  if (spi->fh->fh_fd >= 0) {
+    off_t len;
+
+    len = pr_config_get_server_xfer_bufsz(PR_NETIO_IO_WR);
+    if (len > st.st_size) {
+      len = st.st_size;
+    }
+
+    (void) posix_fadvise(spi->fh->fh_fd, 0, len, POSIX_FADV_WILLNEED);
+  }
+#endif /* POSIX_FADV_WILLNEED */
+
+  pr_trace_msg(trace_channel, 17, "prefetched '%s'", spi->path);
+}
+
+/* Close any files prefetched, but not yet sent, for the directories being
+ * sent under the given path.
+ */
+static void close_prefetched_paths(struct scp_path *sp) {
+  while (sp != NULL) {
+    struct scp_path *spi;
+
+    spi = sp->dir_next_spi;
+    if (spi != NULL &&
+        spi->prefetched) {
+      pr_trace_msg(trace_channel, 17, "closing prefetched '%s'", spi->path);
+
+      pr_fsio_close(spi->fh);
+      spi->fh = NULL;
+      spi->prefetched = FALSE;
+    }
+
+    sp = sp->dir_spi;
+  }
+}
+
 static int send_dir(pool *p, uint32_t channel_id, struct scp_path *sp,
     struct stat *st) {
-  struct dirent *dent;
+  struct scp_path *spi;
   int res = 0;
 
   if (sp->dirh == NULL) {
@@ -1822,51 +1967,34 @@ static int send_dir(pool *p, uint32_t channel_id, struct scp_path *sp,
     memset(&session.xfer, 0, sizeof(session.xfer));
 
     sp->dir_spi = NULL;
+
+    /* While the client confirms this path, get the next one ready. */
+    prefetch_dir_path(p, sp);
     return 0;
   }
 
-  while ((dent = pr_fsio_readdir(sp->dirh)) != NULL) {
-    struct scp_path *spi;
-    size_t pathlen;
-
-    pr_signals_handle();
-
-    /* Skip "." and "..". */
-    if (strncmp(dent->d_name, ".", 2) == 0 ||
-        strncmp(dent->d_name, "..", 3) == 0) {
-      continue;
-    }
-
-    /* Add these to the list of paths that need to be sent. */
-    spi = pcalloc(scp_pool, sizeof(struct scp_path));
-    spi->path = pdircat(scp_pool, sp->path, dent->d_name, NULL);
-    pathlen = strlen(spi->path);
-
-    /* Trim any trailing path separators.  It's important. */
-    while (pathlen > 1 &&
-           spi->path[pathlen-1] == '/') {
-      pr_signals_handle();
-      spi->path[pathlen-1] = '\0';
-      pathlen--;
-    }
-
-    spi->best_path = dir_canonical_vpath(scp_pool, spi->path);
+  spi = sp->dir_next_spi;
+  if (spi != NULL) {
+    sp->dir_next_spi = NULL;
 
-    if (pathlen > 0) {
-      sp->dir_spi = spi;
+  } else {
+    spi = read_dir_path(sp);
+  }
 
-      res = send_path(p, channel_id, spi);
-      if (res == 1) {
-        /* Clear out any transfer-specific data. */
-        if (session.xfer.p) {
-          destroy_pool(session.xfer.p);
-        }
+  if (spi != NULL) {
+    sp->dir_spi = spi;
 
-        memset(&session.xfer, 0, sizeof(session.xfer));
+    res = send_path(p, channel_id, spi);
+    if (res == 1) {
+      /* Clear out any transfer-specific data. */
+      if (session.xfer.p) {
+        destroy_pool(session.xfer.p);
       }
 
-      return res;
+      memset(&session.xfer, 0, sizeof(session.xfer));
     }
+
+    return res;
   }
 
   if (sp->dirh) {
@@ -1907,9 +2035,11 @@ static int send_path(pool *p, uint32_t channel_id, struct scp_path *sp) {
   session.curr_cmd_rec = cmd;
 
   /* First, dispatch the command to the PRE_CMD handlers.  They might,
-   * for example, change the path.
+   * for example, change the path.  A prefetched path has been opened, but
+   * not yet checked.
    */
-  if (sp->fh == NULL) {
+  if (sp->fh == NULL ||
+      sp->prefetched) {
     /* Note, however, that SCP also has to deal with directories, which will
      * be blocked by the PRE_CMD RETR handler in mod_xfer.
      */
@@ -1922,6 +2052,12 @@ static int send_path(pool *p, uint32_t channel_id, struct scp_path *sp) {
           "scp download of '%s' blocked by '%s' handler", sp->path,
           cmd->argv[0]);
 
+        if (sp->prefetched) {
+          pr_fsio_close(sp->fh);
+          sp->fh = NULL;
+          sp->prefetched = FALSE;
+        }
+
         (void) pr_cmd_dispatch_phase(cmd, POST_CMD_ERR, 0);
         (void) pr_cmd_dispatch_phase(cmd, LOG_CMD_ERR, 0);
 
@@ -1937,6 +2073,13 @@ static int send_path(pool *p, uint32_t channel_id, struct scp_path *sp) {
 
     if (strcmp(sp->path, cmd->arg) != 0) {
       sp->path = pstrdup(scp_session->pool, cmd->arg);
+
+      if (sp->prefetched) {
+        /* The prefetched file is no longer the one to send. */
+        pr_fsio_close(sp->fh);
+        sp->fh = NULL;
+        sp->prefetched = FALSE;
+      }
     }
   }
 
@@ -1968,6 +2111,14 @@ static int send_path(pool *p, uint32_t channel_id, struct scp_path *sp) {
     return 1;
   }
 
+  if (sp->prefetched &&
+      !S_ISREG(st.st_mode)) {
+    /* The path changed since it was prefetched. */
+    pr_fsio_close(sp->fh);
+    sp->fh = NULL;
+    sp->prefetched = FALSE;
+  }
+
   if (!S_ISREG(st.st_mode)
 #ifdef S_ISFIFO
       && !S_ISFIFO(st.st_mode)
@@ -2013,13 +2164,20 @@ static int send_path(pool *p, uint32_t channel_id, struct scp_path *sp) {
     }
   }
 
-  if (sp->fh == NULL) {
+  if (sp->fh == NULL ||
+      sp->prefetched) {
     sp->best_path = dir_canonical_vpath(scp_pool, sp->path);
 
     if (!dir_check(p, cmd, G_READ, sp->best_path, NULL)) {
       (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
         "scp download of '%s' blocked by <Limit> configuration", sp->best_path);
 
+      if (sp->prefetched) {
+        pr_fsio_close(sp->fh);
+        sp->fh = NULL;
+        sp->prefetched = FALSE;
+      }
+
       (void) pr_cmd_dispatch_phase(cmd, POST_CMD_ERR, 0);
       (void) pr_cmd_dispatch_phase(cmd, LOG_CMD_ERR, 0);
 
@@ -2032,7 +2190,13 @@ static int send_path(pool *p, uint32_t channel_id, struct scp_path *sp) {
       return 1;
     }
 
-    sp->fh = pr_fsio_open(sp->best_path, O_RDONLY|O_NONBLOCK);
+    if (sp->prefetched) {
+      sp->prefetched = FALSE;
+
+    } else {
+      sp->fh = pr_fsio_open(sp->best_path, O_RDONLY|O_NONBLOCK);
+    }
+
     if (sp->fh == NULL) {
       int xerrno = errno;
 
@@ -2614,6 +2778,11 @@ int sftp_scp_close_session(uint32_t channel_id) {
           for (i = 0; i < sess->paths->nelts; i++) {
             struct scp_path *elt = elts[i];
 
+            /* Files opened ahead of time were never transferred, so there
+             * is nothing to log or delete for them.
+             */
+            close_prefetched_paths(elt);
+
             if (elt->fh != NULL) {
               count++;
             }
@@ -40,6 +40,8 @@
 # include <openssl/evp.h>
 #endif
 
+#include <sys/un.h>
+
 /* default information for tables and fields */
 #define MOD_SQL_DEF_USERTABLE			"users"
 #define MOD_SQL_DEF_USERNAMEFIELD		"userid"
@@ -78,6 +80,14 @@
 
 /* SQLLog flags */
 #define SQL_LOG_FL_IGNORE_ERRORS	0x001
+#define SQL_LOG_FL_QUEUE		0x002
+
+/* SQLLogQueue defines */
+#define SQL_LOGQ_DEFAULT_INTERVAL	5
+#define SQL_LOGQ_MAX_BATCH_ROWS		100
+
+#define SQL_LOGQ_OVERFLOW_FLUSH		1
+#define SQL_LOGQ_OVERFLOW_DROP		2
 
 /* authmask defines */
 #define SQL_AUTH_USERS             (1<<0)
@@ -115,6 +125,16 @@ static off_t sql_dele_filesz = 0;
  */
 #define SQL_MAX_STMT_LEN	4096
 
+/* SQLBroker defines */
+#define SQL_BROKER_DEFAULT_NWORKERS	2
+#define SQL_BROKER_MAX_NWORKERS		64
+#define SQL_BROKER_MAX_CLIENTS		1024
+#define SQL_BROKER_MAX_MSGSZ		(16 * 1024 * 1024)
+#define SQL_BROKER_NULL_LEN		0xffffffff
+
+/* The number of leading request strings, before the command arguments. */
+#define SQL_BROKER_REQ_NHDRS		5
+
 static char *sql_prepare_where(int, cmd_rec *, int, ...);
 #define SQL_PREPARE_WHERE_FL_NO_TAGS	0x00001
 
@@ -132,8 +152,16 @@ MODRET cmd_setgrent(cmd_rec *);
 MODRET sql_lookup(cmd_rec *);
 static cmdtable *sql_set_backend(const char *);
 
+static int sql_broker_handle(cmd_rec *, char *, modret_t **);
+static int sql_openlog(void);
+
 static pool *sql_pool = NULL;
 
+/* The path of the SQLBroker socket, if session backend calls are to be
+ * forwarded to the broker processes.
+ */
+static const char *sql_broker_path = NULL;
+
 static const char *trace_channel = "sql";
 
 /*
@@ -491,6 +519,11 @@ static modret_t *_sql_dispatch(cmd_rec *cmd, char *cmdname) {
   modret_t *mr = NULL;
   register unsigned int i = 0;
 
+  if (sql_broker_path != NULL &&
+      sql_broker_handle(cmd, cmdname, &mr) == 0) {
+    return mr;
+  }
+
   for (i = 0; sql_cmdtable[i].command; i++) {
     if (strcmp(cmdname, sql_cmdtable[i].command) == 0) {
       pr_signals_block();
@@ -3239,6 +3272,427 @@ static char *named_query_type(cmd_rec *cmd, char *name) {
   return NULL;
 }
 
+/* SQLLogQueue support
+ *
+ * When configured, the SQLLog statements of a session are queued, rather
+ * than executed in the command path.  The queue is flushed when its timer
+ * fires, when it is full (unless the overflow policy is to drop new
+ * statements), and at session end.  When flushing, consecutive INSERT
+ * statements for the same table and connection are sent as a single
+ * multi-row INSERT.
+ */
+
+struct sql_logq_stmt {
+  struct sql_logq_stmt *next;
+  const char *conn_name;
+  const char *type;
+  const char *table;
+  const char *text;
+  int flags;
+};
+
+static pool *sql_logq_pool = NULL;
+static struct sql_logq_stmt *sql_logq_head = NULL, *sql_logq_tail = NULL;
+static unsigned int sql_logq_count = 0;
+static unsigned int sql_logq_max = 0;
+static int sql_logq_overflow = SQL_LOGQ_OVERFLOW_FLUSH;
+static unsigned long sql_logq_ndropped = 0;
+
+static void sql_logq_flush(int flags) {
+  struct sql_logq_stmt *stmts;
+  cmdtable *prev_cmdtable;
+  pool *tmp_pool;
+
+  if (sql_logq_head == NULL) {
+    return;
+  }
+
+  /* Detach the queued statements first; an error when executing them may
+   * end the session, which flushes the queue again.
+   */
+  stmts = sql_logq_head;
+  tmp_pool = sql_logq_pool;
+
+  sql_logq_head = sql_logq_tail = NULL;
+  sql_logq_count = 0;
+  sql_logq_pool = make_sub_pool(session.pool);
+  pr_pool_tag(sql_logq_pool, "SQLLogQueue pool");
+
+  if (sql_logq_ndropped > 0) {
+    sql_log(DEBUG_WARN, "SQLLogQueue full, dropped %lu %s", sql_logq_ndropped,
+      sql_logq_ndropped != 1 ? "statements" : "statement");
+    sql_logq_ndropped = 0;
+  }
+
+  prev_cmdtable = sql_cmdtable;
+
+  while (stmts != NULL) {
+    struct sql_logq_stmt *stmt;
+    char *query, *cmdname;
+    int stmt_flags;
+    unsigned int nrows = 1;
+    modret_t *mr;
+
+    stmt = stmts;
+    stmts = stmts->next;
+
+    /* Errors are only ignored if they are ignored for every statement in
+     * the batch.
+     */
+    stmt_flags = (stmt->flags & SQL_LOG_FL_IGNORE_ERRORS);
+
+    if (strcasecmp(stmt->type, SQL_INSERT_C) == 0) {
+      query = pstrcat(tmp_pool, "INTO ", stmt->table, " VALUES (", stmt->text,
+        ")", NULL);
+
+      while (stmts != NULL &&
+             nrows < SQL_LOGQ_MAX_BATCH_ROWS &&
+             strcasecmp(stmts->type, SQL_INSERT_C) == 0 &&
+             strcmp(stmts->conn_name, stmt->conn_name) == 0 &&
+             strcmp(stmts->table, stmt->table) == 0) {
+        query = pstrcat(tmp_pool, query, ", (", stmts->text, ")", NULL);
+        stmt_flags &= (stmts->flags & SQL_LOG_FL_IGNORE_ERRORS);
+
+        stmts = stmts->next;
+        nrows++;
+      }
+
+      cmdname = "sql_insert";
+
+    } else if (strcasecmp(stmt->type, SQL_UPDATE_C) == 0) {
+      query = pstrcat(tmp_pool, stmt->table, " SET ", stmt->text, NULL);
+      cmdname = "sql_update";
+
+    } else {
+      query = pstrdup(tmp_pool, stmt->text);
+      cmdname = "sql_query";
+    }
+
+    pr_trace_msg(trace_channel, 15,
+      "flushing SQLLogQueue statement (%u %s) for connection '%s'", nrows,
+      nrows != 1 ? "rows" : "row", stmt->conn_name);
+
+    set_named_conn_backend(stmt->conn_name);
+    mr = _sql_dispatch(_sql_make_cmd(tmp_pool, 2, stmt->conn_name, query),
+      cmdname);
+    sql_cmdtable = prev_cmdtable;
+
+    (void) check_response(mr, flags|stmt_flags);
+  }
+
+  destroy_pool(tmp_pool);
+}
+
+static int sql_logq_flush_cb(CALLBACK_FRAME) {
+  sql_logq_flush(0);
+
+  /* Always restart the timer. */
+  return 1;
+}
+
+static void sql_logq_add(const char *conn_name, const char *type,
+    const char *table, const char *text, int flags) {
+  struct sql_logq_stmt *stmt;
+
+  if (sql_logq_count >= sql_logq_max) {
+    if (sql_logq_overflow == SQL_LOGQ_OVERFLOW_DROP) {
+      sql_logq_ndropped++;
+      return;
+    }
+
+    sql_log(DEBUG_FUNC, "SQLLogQueue full (%u statements), flushing",
+      sql_logq_count);
+    sql_logq_flush(0);
+  }
+
+  stmt = pcalloc(sql_logq_pool, sizeof(struct sql_logq_stmt));
+  stmt->conn_name = pstrdup(sql_logq_pool, conn_name);
+  stmt->type = type;
+  stmt->table = table;
+  stmt->text = pstrdup(sql_logq_pool, text);
+  stmt->flags = flags;
+
+  if (sql_logq_tail != NULL) {
+    sql_logq_tail->next = stmt;
+
+  } else {
+    sql_logq_head = stmt;
+  }
+
+  sql_logq_tail = stmt;
+  sql_logq_count++;
+}
+
+/* Prepared statement support
+ *
+ * With the UsePreparedStatements SQLOption, a named query is compiled (once
+ * per session) into statement text with '?' parameter placeholders for its
+ * tags, and executed using the backend's "sql_execute" handler, if any,
+ * which prepares the statement once per connection.  Tag values are then
+ * bound as parameters, rather than escaped and substituted into the query.
+ *
+ * A tag may be used as a parameter if it appears outside of a quoted string,
+ * or if it is the entire contents of a quoted string (e.g. '%u').  Queries
+ * using tags in any other way, e.g. as part of a longer string, are
+ * executed as usual.
+ */
+
+#define SQL_STMT_PARAM_SHORT		1
+#define SQL_STMT_PARAM_LONG		2
+#define SQL_STMT_PARAM_NUMERIC		3
+
+struct sql_stmt_param {
+  int type;
+  char short_tag;
+  char *long_tag;
+};
+
+struct sql_stmt {
+  struct sql_stmt *next;
+  config_rec *c;
+
+  /* The statement text, or NULL if the query cannot be prepared. */
+  char *text;
+  array_header *params;
+};
+
+static struct sql_stmt *sql_stmts = NULL;
+
+static int sql_has_backend_cmd(const char *cmdname) {
+  register unsigned int i;
+
+  for (i = 0; sql_cmdtable[i].command; i++) {
+    if (strcmp(cmdname, sql_cmdtable[i].command) == 0) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+/* Parses the tag at ptr (which points to the '%'), adding it to the
+ * parameter list.  Returns a pointer to the character after the tag, or
+ * NULL if the tag is malformed.
+ */
+static char *sql_stmt_parse_tag(pool *p, char *ptr, array_header *params) {
+  struct sql_stmt_param *param;
+
+  param = push_array(params);
+  memset(param, 0, sizeof(struct sql_stmt_param));
+
+  ptr++;
+
+  if (*ptr == '{') {
+    register unsigned int i;
+    char *end;
+    size_t taglen;
+
+    end = strchr(++ptr, '}');
+    if (end == NULL ||
+        end == ptr) {
+      return NULL;
+    }
+
+    param->long_tag = pstrndup(p, ptr, end - ptr);
+    param->type = SQL_STMT_PARAM_NUMERIC;
+
+    /* Numeric tags are checked the same way as in process_named_query(). */
+    taglen = strlen(param->long_tag);
+    for (i = 0; i < taglen-1; i++) {
+      if (!PR_ISDIGIT(param->long_tag[i])) {
+        param->type = SQL_STMT_PARAM_LONG;
+        break;
+      }
+    }
+
+    return end + 1;
+  }
+
+  if (*ptr == '\0') {
+    return NULL;
+  }
+
+  param->type = SQL_STMT_PARAM_SHORT;
+  param->short_tag = *ptr;
+
+  return ptr + 1;
+}
+
+static struct sql_stmt *sql_stmt_get(config_rec *c) {
+  struct sql_stmt *stmt;
+  char *ptr, *text;
+  size_t len = 0;
+
+  for (stmt = sql_stmts; stmt; stmt = stmt->next) {
+    if (stmt->c == c) {
+      return stmt;
+    }
+  }
+
+  stmt = pcalloc(sql_pool, sizeof(struct sql_stmt));
+  stmt->c = c;
+  stmt->params = make_array(sql_pool, 2, sizeof(struct sql_stmt_param));
+
+  stmt->next = sql_stmts;
+  sql_stmts = stmt;
+
+  /* The statement text is never longer than the query text. */
+  text = pcalloc(sql_pool, strlen(c->argv[1]) + 1);
+
+  ptr = c->argv[1];
+  while (*ptr) {
+    if (*ptr == '\'' ||
+        *ptr == '"') {
+      char quote, *end;
+
+      quote = *ptr;
+      end = ptr + 1;
+
+      while (*end) {
+        if (*end == quote) {
+          if (*(end + 1) != quote) {
+            break;
+          }
+
+          end++;
+        }
+
+        end++;
+      }
+
+      if (*end == '\0') {
+        sql_log(DEBUG_INFO, "named query '%s' has an unterminated string, "
+          "not using prepared statement", c->name);
+        return stmt;
+      }
+
+      if (memchr(ptr + 1, '%', end - ptr - 1) != NULL) {
+        char *tag_end;
+
+        /* A double-quoted string is an identifier in standard SQL (and only
+         * a string in some backends), which cannot be bound as a parameter;
+         * leave such tags to be escaped into the query text.
+         */
+        if (quote == '"') {
+          sql_log(DEBUG_INFO, "named query '%s' uses tags within double "
+            "quotes, not using prepared statement", c->name);
+          return stmt;
+        }
+
+        tag_end = ptr[1] == '%' ?
+          sql_stmt_parse_tag(sql_pool, ptr + 1, stmt->params) : NULL;
+        if (tag_end != end) {
+          sql_log(DEBUG_INFO, "named query '%s' uses tags within a string, "
+            "not using prepared statement", c->name);
+          return stmt;
+        }
+
+        text[len++] = '?';
+
+      } else {
+        memcpy(text + len, ptr, end - ptr + 1);
+        len += (end - ptr + 1);
+      }
+
+      ptr = end + 1;
+      continue;
+    }
+
+    if (*ptr == '%') {
+      ptr = sql_stmt_parse_tag(sql_pool, ptr, stmt->params);
+      if (ptr == NULL) {
+        sql_log(DEBUG_INFO, "named query '%s' has a malformed tag, "
+          "not using prepared statement", c->name);
+        return stmt;
+      }
+
+      text[len++] = '?';
+      continue;
+    }
+
+    if (*ptr == '?') {
+      sql_log(DEBUG_INFO, "named query '%s' contains '?', not using prepared "
+        "statement", c->name);
+      return stmt;
+    }
+
+    text[len++] = *ptr++;
+  }
+
+  text[len] = '\0';
+
+  /* Construct the full statement, based on the type of query. */
+  if (strcasecmp(c->argv[0], SQL_UPDATE_C) == 0) {
+    stmt->text = pstrcat(sql_pool, "UPDATE ", c->argv[2], " SET ", text,
+      NULL);
+
+  } else if (strcasecmp(c->argv[0], SQL_INSERT_C) == 0) {
+    stmt->text = pstrcat(sql_pool, "INSERT INTO ", c->argv[2], " VALUES (",
+      text, ")", NULL);
+
+  } else if (strcasecmp(c->argv[0], SQL_SELECT_C) == 0) {
+    stmt->text = pstrcat(sql_pool, "SELECT ", text, NULL);
+
+  } else {
+    stmt->text = text;
+  }
+
+  pr_trace_msg(trace_channel, 12, "compiled named query '%s' to statement "
+    "'%s' (%d %s)", c->name, stmt->text, stmt->params->nelts,
+    stmt->params->nelts != 1 ? "parameters" : "parameter");
+  return stmt;
+}
+
+static modret_t *sql_stmt_execute(cmd_rec *cmd, const char *conn_name,
+    struct sql_stmt *stmt) {
+  register unsigned int i;
+  struct sql_stmt_param *params;
+  cmd_rec *exec_cmd;
+
+  exec_cmd = _sql_make_cmd(cmd->tmp_pool, 0);
+  exec_cmd->argc = stmt->params->nelts + 2;
+  exec_cmd->argv = pcalloc(exec_cmd->pool,
+    sizeof(char *) * (exec_cmd->argc + 1));
+  exec_cmd->argv[0] = (char *) conn_name;
+  exec_cmd->argv[1] = stmt->text;
+
+  params = stmt->params->elts;
+  for (i = 0; i < stmt->params->nelts; i++) {
+    const char *val = NULL;
+
+    switch (params[i].type) {
+      case SQL_STMT_PARAM_NUMERIC: {
+        int num;
+
+        num = resolve_numeric_tag(cmd, params[i].long_tag);
+        if (num < 0) {
+          return PR_ERROR_MSG(cmd, MOD_SQL_VERSION,
+            "out-of-bounds numeric reference in query");
+        }
+
+        val = cmd->argv[num+2];
+        break;
+      }
+
+      case SQL_STMT_PARAM_LONG:
+        val = resolve_long_tag(cmd, params[i].long_tag);
+        if (val == NULL) {
+          return PR_ERROR_MSG(cmd, MOD_SQL_VERSION,
+            "malformed reference %{?} in query");
+        }
+        break;
+
+      case SQL_STMT_PARAM_SHORT:
+        val = resolve_short_tag(cmd, params[i].short_tag);
+        break;
+    }
+
+    exec_cmd->argv[i+2] = (char *) val;
+  }
+
+  return _sql_dispatch(exec_cmd, "sql_execute");
+}
+
 static modret_t *process_named_query(cmd_rec *cmd, char *name, int flags) {
   config_rec *c;
   char *conn_name, *query = NULL, *tmp = NULL, *argp = NULL;
@@ -3259,6 +3713,24 @@ static modret_t *process_named_query(cmd_rec *cmd, char *name, int flags) {
     conn_name = get_query_named_conn(c);
     set_named_conn_backend(conn_name);
 
+    /* Queued statements are executed later as text, so that they may be
+     * batched.
+     */
+    if ((pr_sql_opts & SQL_OPT_USE_PREPARED_STATEMENTS) &&
+        !(flags & SQL_LOG_FL_QUEUE) &&
+        sql_has_backend_cmd("sql_execute")) {
+      struct sql_stmt *stmt;
+
+      stmt = sql_stmt_get(c);
+      if (stmt->text != NULL) {
+        mr = sql_stmt_execute(cmd, conn_name, stmt);
+        set_named_conn_backend(NULL);
+
+        sql_log(DEBUG_FUNC, "<<< process_named_query '%s'", name);
+        return mr;
+      }
+    }
+
     /* Select string fixup */
     memset(outs, '\0', sizeof(outs));
     outsp = outs;
@@ -3380,7 +3852,14 @@ static modret_t *process_named_query(cmd_rec *cmd, char *name, int flags) {
     *outsp = '\0';
 
     /* Construct our return data based on the type of query */
-    if (strcasecmp(c->argv[0], SQL_UPDATE_C) == 0) {
+    if ((flags & SQL_LOG_FL_QUEUE) &&
+        strcasecmp(c->argv[0], SQL_SELECT_C) != 0) {
+      sql_logq_add(conn_name, c->argv[0],
+        strcasecmp(c->argv[0], SQL_FREEFORM_C) != 0 ? c->argv[2] : NULL,
+        outs, flags);
+      mr = PR_HANDLED(cmd);
+
+    } else if (strcasecmp(c->argv[0], SQL_UPDATE_C) == 0) {
       query = pstrcat(cmd->tmp_pool, c->argv[2], " SET ", outs, NULL);
       mr = _sql_dispatch(_sql_make_cmd(cmd->tmp_pool, 2, conn_name, query), 
         "sql_update");
@@ -3428,6 +3907,10 @@ MODRET process_sqllog(cmd_rec *cmd, config_rec *c, const char *label,
     if (strcasecmp(type, SQL_UPDATE_C) == 0 ||
         strcasecmp(type, SQL_FREEFORM_C) == 0 ||
         strcasecmp(type, SQL_INSERT_C) == 0) {
+      if (sql_logq_max > 0) {
+        flags |= SQL_LOG_FL_QUEUE;
+      }
+
       mr = process_named_query(cmd, qname, flags);
       if (check_response(mr, flags) < 0)
         return mr;
@@ -5458,6 +5941,9 @@ MODRET set_sqloptions(cmd_rec *cmd) {
     } else if (strcasecmp(cmd->argv[i], "IgnoreConfigFile") == 0) {
       opts |= SQL_OPT_IGNORE_CONFIG_FILE;
 
+    } else if (strcasecmp(cmd->argv[i], "UsePreparedStatements") == 0) {
+      opts |= SQL_OPT_USE_PREPARED_STATEMENTS;
+
     } else {
       CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "unknown SQLOption '",
         cmd->argv[i], "'", NULL));
@@ -5745,6 +6231,56 @@ MODRET set_sqllogfile(cmd_rec *cmd) {
   return PR_HANDLED(cmd);
 }
 
+/* usage: SQLLogQueue max-statements [interval ["flush"|"drop"]] */
+MODRET set_sqllogqueue(cmd_rec *cmd) {
+  config_rec *c;
+  int count, interval = SQL_LOGQ_DEFAULT_INTERVAL;
+  int overflow = SQL_LOGQ_OVERFLOW_FLUSH;
+
+  if (cmd->argc < 2 ||
+      cmd->argc > 4) {
+    CONF_ERROR(cmd, "wrong number of parameters");
+  }
+
+  CHECK_CONF(cmd, CONF_ROOT|CONF_VIRTUAL|CONF_GLOBAL);
+
+  count = atoi(cmd->argv[1]);
+  if (count < 1) {
+    CONF_ERROR(cmd, "max-statements must be greater than zero");
+  }
+
+  if (cmd->argc >= 3) {
+    if (pr_str_get_duration(cmd->argv[2], &interval) < 0 ||
+        interval < 1) {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "invalid interval '",
+        cmd->argv[2], "'", NULL));
+    }
+  }
+
+  if (cmd->argc == 4) {
+    if (strcasecmp(cmd->argv[3], "flush") == 0) {
+      overflow = SQL_LOGQ_OVERFLOW_FLUSH;
+
+    } else if (strcasecmp(cmd->argv[3], "drop") == 0) {
+      overflow = SQL_LOGQ_OVERFLOW_DROP;
+
+    } else {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "unknown overflow policy '",
+        cmd->argv[3], "'", NULL));
+    }
+  }
+
+  c = add_config_param(cmd->argv[0], 3, NULL, NULL, NULL);
+  c->argv[0] = palloc(c->pool, sizeof(unsigned int));
+  *((unsigned int *) c->argv[0]) = count;
+  c->argv[1] = palloc(c->pool, sizeof(int));
+  *((int *) c->argv[1]) = interval;
+  c->argv[2] = palloc(c->pool, sizeof(int));
+  *((int *) c->argv[2]) = overflow;
+
+  return PR_HANDLED(cmd);
+}
+
 /* usage: SQLLogOnEvent event query-name ["IGNORE_ERRORS"] */
 MODRET set_sqllogonevent(cmd_rec *cmd) {
   config_rec *c;
@@ -6277,6 +6813,43 @@ MODRET set_sqlbackend(cmd_rec *cmd) {
   return PR_HANDLED(cmd);
 }
 
+/* usage: SQLBroker path [nprocs] */
+MODRET set_sqlbroker(cmd_rec *cmd) {
+  config_rec *c;
+  struct sockaddr_un sockun;
+  int nworkers = SQL_BROKER_DEFAULT_NWORKERS;
+
+  if (cmd->argc < 2 ||
+      cmd->argc > 3) {
+    CONF_ERROR(cmd, "wrong number of parameters");
+  }
+
+  CHECK_CONF(cmd, CONF_ROOT);
+
+  if (pr_fs_valid_path(cmd->argv[1]) < 0) {
+    CONF_ERROR(cmd, "must be an absolute path");
+  }
+
+  if (strlen(cmd->argv[1]) >= sizeof(sockun.sun_path)) {
+    CONF_ERROR(cmd, "path too long");
+  }
+
+  if (cmd->argc == 3) {
+    nworkers = atoi(cmd->argv[2]);
+    if (nworkers < 1 ||
+        nworkers > SQL_BROKER_MAX_NWORKERS) {
+      CONF_ERROR(cmd, "number of processes must be between 1 and 64");
+    }
+  }
+
+  c = add_config_param(cmd->argv[0], 2, NULL, NULL);
+  c->argv[0] = pstrdup(c->pool, cmd->argv[1]);
+  c->argv[1] = palloc(c->pool, sizeof(unsigned int));
+  *((unsigned int *) c->argv[1]) = nworkers;
+
+  return PR_HANDLED(cmd);
+}
+
 MODRET set_sqlminid(cmd_rec *cmd) {
   config_rec *c;
   unsigned long val;
@@ -6411,47 +6984,905 @@ MODRET set_sqldefaultgid(cmd_rec *cmd) {
   return PR_HANDLED(cmd);
 }
 
-/* Event handlers
+/* SQLBroker support
+ *
+ * The daemon process listens on a Unix domain socket, and forks a number of
+ * broker processes which accept connections on it.  Each broker keeps its
+ * backend connections (one per distinct connection definition) open for as
+ * long as it runs.  Session processes then forward their backend calls to a
+ * broker, rather than connecting to the database themselves.
+ *
+ * Messages, in both directions, are a 32-bit length, a 32-bit count of
+ * strings, then each string as a 32-bit length and its bytes; a length of
+ * SQL_BROKER_NULL_LEN is a NULL string.  A request is the backend name, the
+ * backend command, the user, password, and info of the connection named by
+ * the first command argument (or NULLs), then the command arguments.  A
+ * response is "e", the error numeric, and the error message; or "h" and the
+ * type of data ("n" for none, "s" for a string, "d" for sql_data_t, followed
+ * by the row and field counts, then the values); or "d" (declined).
  */
 
-static void sql_chroot_ev(const void *event_data, void *user_data) {
-  /* Loop through our list of named connections, making sure that any
-   * with a connection policy of PERSESSION are opened.
-   */
-  if (sql_named_conns != NULL) {
-    pool *tmp_pool;
-    struct sql_named_conn *snc;
+/* The backend commands which may be forwarded to a broker. */
+static const char *sql_broker_cmds[] = {
+  "sql_checkauth",
+  "sql_escapestring",
+  "sql_execute",
+  "sql_insert",
+  "sql_procedure",
+  "sql_query",
+  "sql_select",
+  "sql_update",
+  NULL
+};
 
-    tmp_pool = make_sub_pool(session.pool);
+static unsigned int sql_broker_nworkers = 0;
+static pid_t sql_broker_pids[SQL_BROKER_MAX_NWORKERS];
+static int sql_broker_fd = -1;
 
-    for (snc = sql_named_conns; snc; snc = snc->next) {
-      pr_signals_handle();
+/* Connection definitions.  In session processes, these are the definitions
+ * of the configured connections, by name; in broker processes, these are the
+ * backend connections, under names of the broker's own choosing.
+ */
+struct sql_broker_conn {
+  struct sql_broker_conn *next;
+  const char *conn_name;
+  const char *backend;
+  const char *user;
+  const char *passwd;
+  const char *info;
+  int opened;
+};
 
-      if (snc->conn_policy == SQL_CONN_POLICY_PERSESSION) {
-        cmd_rec *cmd;
-        modret_t *mr; 
+static struct sql_broker_conn *sql_broker_conns = NULL;
+static unsigned int sql_broker_nconns = 0;
+static array_header *sql_broker_prepared = NULL;
+static volatile int sql_broker_terminated = FALSE;
+static int sql_broker_daemon_started = FALSE;
 
-        cmd = _sql_make_cmd(tmp_pool, 1, snc->conn_name);
-        mr = _sql_dispatch(cmd, "sql_open");
-        (void) check_response(mr, 0);
-        SQL_FREE_CMD(cmd);
-      }
-    }
+static int sql_broker_is_forwarded(const char *cmdname) {
+  register unsigned int i;
 
-    destroy_pool(tmp_pool);
+  for (i = 0; sql_broker_cmds[i] != NULL; i++) {
+    if (strcmp(sql_broker_cmds[i], cmdname) == 0) {
+      return TRUE;
+    }
   }
-}
 
-static void sql_exit_ev(const void *event_data, void *user_data) {
-  config_rec *c;
-  cmd_rec *cmd;
-  modret_t *mr;
+  return FALSE;
+}
 
-  if (cmap.engine == 0) {
-    return;
+static int sql_broker_strcmp(const char *s1, const char *s2) {
+  if (s1 == NULL ||
+      s2 == NULL) {
+    return s1 == s2 ? 0 : 1;
   }
 
-  /* handle EXIT queries */
+  return strcmp(s1, s2);
+}
+
+static int sql_broker_io(int fd, void *buf, size_t len, int writing) {
+  char *ptr = buf;
+
+  while (len > 0) {
+    ssize_t res;
+
+    if (writing) {
+      res = write(fd, ptr, len);
+
+    } else {
+      res = read(fd, ptr, len);
+    }
+
+    if (res < 0) {
+      if (errno == EINTR) {
+        if (sql_broker_terminated) {
+          return -1;
+        }
+
+        continue;
+      }
+
+      return -1;
+    }
+
+    if (res == 0) {
+      errno = EPIPE;
+      return -1;
+    }
+
+    ptr += res;
+    len -= res;
+  }
+
+  return 0;
+}
+
+static int sql_broker_send(pool *p, int fd, unsigned int argc, char **argv) {
+  register unsigned int i;
+  size_t bufsz;
+  uint32_t len;
+  char *buf, *ptr;
+
+  bufsz = sizeof(uint32_t) * 2;
+  for (i = 0; i < argc; i++) {
+    bufsz += sizeof(uint32_t) + (argv[i] ? strlen(argv[i]) : 0);
+  }
+
+  if (bufsz > SQL_BROKER_MAX_MSGSZ) {
+    errno = EMSGSIZE;
+    return -1;
+  }
+
+  buf = ptr = palloc(p, bufsz);
+
+  len = bufsz - sizeof(uint32_t);
+  memcpy(ptr, &len, sizeof(uint32_t));
+  ptr += sizeof(uint32_t);
+
+  len = argc;
+  memcpy(ptr, &len, sizeof(uint32_t));
+  ptr += sizeof(uint32_t);
+
+  for (i = 0; i < argc; i++) {
+    len = argv[i] ? strlen(argv[i]) : SQL_BROKER_NULL_LEN;
+    memcpy(ptr, &len, sizeof(uint32_t));
+    ptr += sizeof(uint32_t);
+
+    if (argv[i] != NULL) {
+      memcpy(ptr, argv[i], len);
+      ptr += len;
+    }
+  }
+
+  return sql_broker_io(fd, buf, bufsz, TRUE);
+}
+
+static char **sql_broker_recv(pool *p, int fd, unsigned int *argc) {
+  register unsigned int i;
+  uint32_t msglen, count, len;
+  char *buf, *ptr, **argv;
+
+  if (sql_broker_io(fd, &msglen, sizeof(uint32_t), FALSE) < 0) {
+    return NULL;
+  }
+
+  if (msglen < sizeof(uint32_t) ||
+      msglen > SQL_BROKER_MAX_MSGSZ) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  buf = ptr = palloc(p, msglen);
+  if (sql_broker_io(fd, buf, msglen, FALSE) < 0) {
+    return NULL;
+  }
+
+  memcpy(&count, ptr, sizeof(uint32_t));
+  ptr += sizeof(uint32_t);
+  msglen -= sizeof(uint32_t);
+
+  if (count > msglen / sizeof(uint32_t)) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  argv = pcalloc(p, sizeof(char *) * (count + 1));
+  for (i = 0; i < count; i++) {
+    if (msglen < sizeof(uint32_t)) {
+      errno = EINVAL;
+      return NULL;
+    }
+
+    memcpy(&len, ptr, sizeof(uint32_t));
+    ptr += sizeof(uint32_t);
+    msglen -= sizeof(uint32_t);
+
+    if (len == SQL_BROKER_NULL_LEN) {
+      continue;
+    }
+
+    if (len > msglen) {
+      errno = EINVAL;
+      return NULL;
+    }
+
+    argv[i] = pstrndup(p, ptr, len);
+    ptr += len;
+    msglen -= len;
+  }
+
+  *argc = count;
+  return argv;
+}
+
+/* Session process functions */
+
+static int sql_broker_connect(void) {
+  struct sockaddr_un sockun;
+  int fd, res, xerrno;
+
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+
+  memset(&sockun, 0, sizeof(sockun));
+  sockun.sun_family = AF_UNIX;
+  sstrncpy(sockun.sun_path, sql_broker_path, sizeof(sockun.sun_path));
+
+  PRIVS_ROOT
+  res = connect(fd, (struct sockaddr *) &sockun, sizeof(sockun));
+  xerrno = errno;
+  PRIVS_RELINQUISH
+
+  if (res < 0) {
+    (void) close(fd);
+
+    errno = xerrno;
+    return -1;
+  }
+
+  (void) fcntl(fd, F_SETFD, FD_CLOEXEC);
+  sql_broker_fd = fd;
+
+  sql_log(DEBUG_INFO, "using SQLBroker at '%s'", sql_broker_path);
+  return 0;
+}
+
+/* Stop using the broker for the rest of this session; backend calls are
+ * then dispatched to the backend directly, as when no SQLBroker is
+ * configured.
+ */
+static void sql_broker_disable(const char *reason) {
+  sql_log(DEBUG_WARN, "SQLBroker at '%s' unavailable (%s), using backend "
+    "connections directly", sql_broker_path, reason);
+  pr_trace_msg(trace_channel, 3, "SQLBroker at '%s' unavailable (%s)",
+    sql_broker_path, reason);
+
+  if (sql_broker_fd >= 0) {
+    (void) close(sql_broker_fd);
+    sql_broker_fd = -1;
+  }
+
+  sql_broker_path = NULL;
+}
+
+static const char *sql_broker_backend_name(void) {
+  struct sql_backend *sb;
+
+  for (sb = sql_backends; sb; sb = sb->next) {
+    if (sb->cmdtab == sql_cmdtable) {
+      return sb->backend;
+    }
+  }
+
+  return NULL;
+}
+
+static modret_t *sql_broker_decode(cmd_rec *cmd, unsigned int argc,
+    char **argv) {
+  sql_data_t *sd;
+  unsigned long i, count;
+
+  if (argc == 3 &&
+      strcmp(argv[0], "e") == 0) {
+    return PR_ERROR_MSG(cmd, argv[1], argv[2]);
+  }
+
+  if (argc == 1 &&
+      strcmp(argv[0], "d") == 0) {
+    return PR_DECLINED(cmd);
+  }
+
+  if (argc < 2 ||
+      strcmp(argv[0], "h") != 0) {
+    return NULL;
+  }
+
+  if (strcmp(argv[1], "n") == 0) {
+    return PR_HANDLED(cmd);
+  }
+
+  if (argc == 3 &&
+      strcmp(argv[1], "s") == 0) {
+    return mod_create_data(cmd, argv[2]);
+  }
+
+  if (argc < 4 ||
+      strcmp(argv[1], "d") != 0) {
+    return NULL;
+  }
+
+  sd = pcalloc(cmd->tmp_pool, sizeof(sql_data_t));
+  sd->rnum = strtoul(argv[2], NULL, 10);
+  sd->fnum = strtoul(argv[3], NULL, 10);
+
+  count = sd->rnum * sd->fnum;
+  if (count != argc - 4 ||
+      (sd->fnum > 0 && count / sd->fnum != sd->rnum)) {
+    return NULL;
+  }
+
+  sd->data = pcalloc(cmd->tmp_pool, sizeof(char *) * (count + 1));
+  for (i = 0; i < count; i++) {
+    sd->data[i] = argv[i + 4];
+  }
+
+  return mod_create_data(cmd, sd);
+}
+
+/* Returns 0 if the broker handled the command, setting the result, or -1 if
+ * the command should be dispatched to the backend as usual.
+ */
+static int sql_broker_handle(cmd_rec *cmd, char *cmdname, modret_t **mr) {
+  register unsigned int i;
+  struct sql_broker_conn *conn = NULL;
+  const char *backend;
+  unsigned int argc, resc;
+  char **argv, **resv;
+  pool *p;
+
+  if (strcmp(cmdname, "sql_defineconnection") == 0) {
+    /* Remember the definition, for forwarding along with requests.  The
+     * definition is still handed to the backend as well, in case we need
+     * to fall back to using it directly.
+     */
+    if (cmd->argc >= 4) {
+      conn = pcalloc(sql_pool, sizeof(struct sql_broker_conn));
+      conn->conn_name = pstrdup(sql_pool, cmd->argv[0]);
+      conn->user = pstrdup(sql_pool, cmd->argv[1]);
+      conn->passwd = pstrdup(sql_pool, cmd->argv[2]);
+      conn->info = pstrdup(sql_pool, cmd->argv[3]);
+      conn->next = sql_broker_conns;
+      sql_broker_conns = conn;
+    }
+
+    return -1;
+  }
+
+  if (strcmp(cmdname, "sql_open") != 0 &&
+      sql_broker_is_forwarded(cmdname) == FALSE) {
+    return -1;
+  }
+
+  if (sql_broker_fd < 0 &&
+      sql_broker_connect() < 0) {
+    sql_broker_disable(strerror(errno));
+    return -1;
+  }
+
+  /* Connections are opened by the broker, not by us. */
+  if (strcmp(cmdname, "sql_open") == 0) {
+    *mr = PR_HANDLED(cmd);
+    return 0;
+  }
+
+  backend = sql_broker_backend_name();
+  if (backend == NULL) {
+    return -1;
+  }
+
+  if (cmd->argc > 0) {
+    for (conn = sql_broker_conns; conn; conn = conn->next) {
+      if (sql_broker_strcmp(conn->conn_name, cmd->argv[0]) == 0) {
+        break;
+      }
+    }
+  }
+
+  p = cmd->tmp_pool ? cmd->tmp_pool : cmd->pool;
+
+  argc = SQL_BROKER_REQ_NHDRS + cmd->argc;
+  argv = pcalloc(p, sizeof(char *) * argc);
+  argv[0] = (char *) backend;
+  argv[1] = cmdname;
+
+  if (conn != NULL) {
+    argv[2] = (char *) conn->user;
+    argv[3] = (char *) conn->passwd;
+    argv[4] = (char *) conn->info;
+  }
+
+  for (i = 0; i < cmd->argc; i++) {
+    argv[SQL_BROKER_REQ_NHDRS + i] = cmd->argv[i];
+  }
+
+  if (sql_broker_send(p, sql_broker_fd, argc, argv) < 0) {
+    sql_broker_disable(strerror(errno));
+    return -1;
+  }
+
+  resv = sql_broker_recv(p, sql_broker_fd, &resc);
+  if (resv == NULL) {
+    sql_broker_disable(strerror(errno));
+    return -1;
+  }
+
+  *mr = sql_broker_decode(cmd, resc, resv);
+  if (*mr == NULL &&
+      !(resc == 1 && strcmp(resv[0], "d") == 0)) {
+    sql_broker_disable("malformed response");
+    return -1;
+  }
+
+  return 0;
+}
+
+/* Broker process functions */
+
+static void sql_broker_signal_cb(int signo) {
+  sql_broker_terminated = TRUE;
+}
+
+static int sql_broker_send_response(pool *p, int fd, const char *cmdname,
+    modret_t *mr) {
+  array_header *res;
+
+  res = make_array(p, 4, sizeof(char *));
+
+  if (MODRET_ISERROR(mr)) {
+    *((char **) push_array(res)) = "e";
+    *((char **) push_array(res)) = mr->mr_numeric;
+    *((char **) push_array(res)) = mr->mr_message;
+
+  } else if (MODRET_ISDECLINED(mr)) {
+    *((char **) push_array(res)) = "d";
+
+  } else {
+    *((char **) push_array(res)) = "h";
+
+    if (!MODRET_HASDATA(mr)) {
+      *((char **) push_array(res)) = "n";
+
+    } else if (strcmp(cmdname, "sql_escapestring") == 0) {
+      *((char **) push_array(res)) = "s";
+      *((char **) push_array(res)) = mr->data;
+
+    } else if (strcmp(cmdname, "sql_checkauth") == 0) {
+      *((char **) push_array(res)) = "n";
+
+    } else {
+      sql_data_t *sd = mr->data;
+      unsigned long i, count;
+      char buf[64];
+
+      *((char **) push_array(res)) = "d";
+
+      snprintf(buf, sizeof(buf)-1, "%lu", sd->rnum);
+      *((char **) push_array(res)) = pstrdup(p, buf);
+      snprintf(buf, sizeof(buf)-1, "%lu", sd->fnum);
+      *((char **) push_array(res)) = pstrdup(p, buf);
+
+      count = sd->rnum * sd->fnum;
+      for (i = 0; i < count; i++) {
+        *((char **) push_array(res)) = sd->data[i];
+      }
+    }
+  }
+
+  return sql_broker_send(p, fd, res->nelts, res->elts);
+}
+
+/* Finds, or defines and opens, the broker's backend connection for the
+ * given definition.
+ */
+static struct sql_broker_conn *sql_broker_get_conn(pool *p,
+    const char *backend, char **def, modret_t **mr) {
+  struct sql_broker_conn *conn;
+  cmd_rec *cmd;
+
+  for (conn = sql_broker_conns; conn; conn = conn->next) {
+    if (strcmp(conn->backend, backend) == 0 &&
+        sql_broker_strcmp(conn->user, def[0]) == 0 &&
+        sql_broker_strcmp(conn->passwd, def[1]) == 0 &&
+        sql_broker_strcmp(conn->info, def[2]) == 0) {
+      break;
+    }
+  }
+
+  if (conn == NULL) {
+    char name[32];
+
+    snprintf(name, sizeof(name)-1, "broker%u", ++sql_broker_nconns);
+    name[sizeof(name)-1] = '\0';
+
+    conn = pcalloc(sql_pool, sizeof(struct sql_broker_conn));
+    conn->conn_name = pstrdup(sql_pool, name);
+    conn->backend = pstrdup(sql_pool, backend);
+    conn->user = def[0] ? pstrdup(sql_pool, def[0]) : NULL;
+    conn->passwd = def[1] ? pstrdup(sql_pool, def[1]) : NULL;
+    conn->info = pstrdup(sql_pool, def[2]);
+
+    cmd = _sql_make_cmd(p, 5, conn->conn_name, conn->user, conn->passwd,
+      conn->info, "0");
+    *mr = _sql_dispatch(cmd, "sql_defineconnection");
+    if (MODRET_ISERROR(*mr)) {
+      return NULL;
+    }
+
+    conn->next = sql_broker_conns;
+    sql_broker_conns = conn;
+
+    sql_log(DEBUG_INFO, "defined backend connection '%s' for '%s'",
+      conn->conn_name, conn->info);
+  }
+
+  if (!conn->opened) {
+    /* Keep the connection open after this first use. */
+    pr_sql_conn_policy = SQL_CONN_POLICY_PERSESSION;
+
+    cmd = _sql_make_cmd(p, 1, conn->conn_name);
+    *mr = _sql_dispatch(cmd, "sql_open");
+    if (MODRET_ISERROR(*mr)) {
+      return NULL;
+    }
+
+    conn->opened = TRUE;
+  }
+
+  return conn;
+}
+
+/* Handles one request from a client.  Returns -1 if the client connection
+ * should be closed.
+ */
+static int sql_broker_handle_request(int fd) {
+  register unsigned int i;
+  struct sql_backend *sb;
+  struct sql_broker_conn *conn = NULL;
+  unsigned int argc;
+  char **argv;
+  cmd_rec *cmd;
+  modret_t *mr = NULL;
+  pool *tmp_pool;
+  int res;
+
+  tmp_pool = make_sub_pool(sql_pool);
+  pr_pool_tag(tmp_pool, "SQLBroker request pool");
+
+  argv = sql_broker_recv(tmp_pool, fd, &argc);
+  if (argv == NULL) {
+    destroy_pool(tmp_pool);
+    return -1;
+  }
+
+  cmd = _sql_make_cmd(tmp_pool, 0);
+
+  if (argc < SQL_BROKER_REQ_NHDRS + 1 ||
+      argv[0] == NULL ||
+      argv[1] == NULL ||
+      sql_broker_is_forwarded(argv[1]) == FALSE) {
+    res = sql_broker_send_response(tmp_pool, fd, "",
+      PR_ERROR_MSG(cmd, MOD_SQL_VERSION, "unsupported backend command"));
+    destroy_pool(tmp_pool);
+    return res;
+  }
+
+  sb = sql_get_backend(argv[0]);
+  if (sb == NULL) {
+    res = sql_broker_send_response(tmp_pool, fd, "",
+      PR_ERROR_MSG(cmd, MOD_SQL_VERSION, "unknown backend"));
+    destroy_pool(tmp_pool);
+    return res;
+  }
+
+  sql_cmdtable = sb->cmdtab;
+
+  for (i = 0; i < sql_broker_prepared->nelts; i++) {
+    if (((cmdtable **) sql_broker_prepared->elts)[i] == sb->cmdtab) {
+      break;
+    }
+  }
+
+  if (i == sql_broker_prepared->nelts) {
+    pool *conn_pool;
+
+    conn_pool = make_sub_pool(sql_pool);
+    pr_pool_tag(conn_pool, "SQLBroker backend pool");
+
+    (void) _sql_dispatch(_sql_make_cmd(tmp_pool, 1, conn_pool),
+      "sql_prepare");
+    *((cmdtable **) push_array(sql_broker_prepared)) = sb->cmdtab;
+  }
+
+  if (argv[4] != NULL) {
+    conn = sql_broker_get_conn(tmp_pool, sb->backend, &(argv[2]), &mr);
+    if (conn == NULL) {
+      res = sql_broker_send_response(tmp_pool, fd, argv[1], mr);
+      destroy_pool(tmp_pool);
+      return res;
+    }
+
+    argv[SQL_BROKER_REQ_NHDRS] = (char *) conn->conn_name;
+  }
+
+  cmd->argc = argc - SQL_BROKER_REQ_NHDRS;
+  cmd->argv = &(argv[SQL_BROKER_REQ_NHDRS]);
+
+  mr = _sql_dispatch(cmd, argv[1]);
+
+  if (MODRET_ISERROR(mr) &&
+      conn != NULL) {
+    /* The connection may have gone away; reopen it for the next request. */
+    (void) _sql_dispatch(_sql_make_cmd(tmp_pool, 2, conn->conn_name, "1"),
+      "sql_close");
+    conn->opened = FALSE;
+  }
+
+  res = sql_broker_send_response(tmp_pool, fd, argv[1], mr);
+  destroy_pool(tmp_pool);
+  return res;
+}
+
+static void sql_broker_worker_loop(int listenfd) {
+  int clients[SQL_BROKER_MAX_CLIENTS];
+  unsigned int nclients = 0;
+
+  while (!sql_broker_terminated) {
+    register unsigned int i;
+    fd_set rfds;
+    int fd, maxfd, res;
+
+    FD_ZERO(&rfds);
+    maxfd = -1;
+
+    if (nclients < SQL_BROKER_MAX_CLIENTS) {
+      FD_SET(listenfd, &rfds);
+      maxfd = listenfd;
+    }
+
+    for (i = 0; i < nclients; i++) {
+      FD_SET(clients[i], &rfds);
+      if (clients[i] > maxfd) {
+        maxfd = clients[i];
+      }
+    }
+
+    res = select(maxfd + 1, &rfds, NULL, NULL, NULL);
+    if (res < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      pr_log_pri(PR_LOG_WARNING, MOD_SQL_VERSION
+        ": SQLBroker process error waiting for requests: %s",
+        strerror(errno));
+      break;
+    }
+
+    for (i = 0; i < nclients; i++) {
+      if (!FD_ISSET(clients[i], &rfds)) {
+        continue;
+      }
+
+      if (sql_broker_handle_request(clients[i]) < 0) {
+        (void) close(clients[i]);
+
+        clients[i--] = clients[--nclients];
+      }
+    }
+
+    if (FD_ISSET(listenfd, &rfds)) {
+      /* The listening socket is shared with the other brokers, and is
+       * non-blocking, so another broker may have accepted this client.
+       */
+      fd = accept(listenfd, NULL, NULL);
+      if (fd >= 0) {
+        if (fd >= FD_SETSIZE) {
+          (void) close(fd);
+
+        } else {
+          (void) fcntl(fd, F_SETFD, FD_CLOEXEC);
+          clients[nclients++] = fd;
+        }
+      }
+    }
+  }
+}
+
+static pid_t sql_broker_start_worker(int listenfd) {
+  register unsigned int i;
+  pid_t pid;
+
+  pid = fork();
+  switch (pid) {
+    case -1:
+      pr_log_pri(PR_LOG_ALERT, MOD_SQL_VERSION
+        ": unable to fork SQLBroker process: %s", strerror(errno));
+      return 0;
+
+    case 0:
+      /* We're the child. */
+      break;
+
+    default:
+      /* We're the parent. */
+      return pid;
+  }
+
+  /* Reset the cached PID, so that it is correctly reflected in the logs. */
+  session.pid = getpid();
+
+  (void) signal(SIGALRM, SIG_IGN);
+  (void) signal(SIGHUP, SIG_IGN);
+  (void) signal(SIGUSR1, SIG_IGN);
+  (void) signal(SIGUSR2, SIG_IGN);
+  (void) signal(SIGCHLD, SIG_DFL);
+  (void) signal(SIGINT, sql_broker_signal_cb);
+  (void) signal(SIGTERM, sql_broker_signal_cb);
+
+  pr_event_unregister(&sql_module, NULL, NULL);
+
+  /* Our own backend calls go to the backends. */
+  sql_broker_path = NULL;
+  sql_broker_conns = NULL;
+  sql_broker_prepared = make_array(sql_pool, 2, sizeof(cmdtable *));
+
+  (void) sql_openlog();
+  pr_proctitle_set("(SQL broker)");
+
+  sql_log(DEBUG_INFO, "SQLBroker process %lu started",
+    (unsigned long) session.pid);
+
+  sql_broker_worker_loop(listenfd);
+
+  /* Close our backend connections. */
+  for (i = 0; i < sql_broker_prepared->nelts; i++) {
+    sql_cmdtable = ((cmdtable **) sql_broker_prepared->elts)[i];
+    (void) _sql_dispatch(_sql_make_cmd(sql_pool, 0), "sql_exit");
+  }
+
+  sql_log(DEBUG_INFO, "SQLBroker process %lu exiting",
+    (unsigned long) session.pid);
+  exit(0);
+}
+
+/* Daemon process functions */
+
+static int sql_broker_start(const char *path, unsigned int nworkers) {
+  register unsigned int i;
+  struct sockaddr_un sockun;
+  int fd, res, xerrno;
+
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+
+  memset(&sockun, 0, sizeof(sockun));
+  sockun.sun_family = AF_UNIX;
+  sstrncpy(sockun.sun_path, path, sizeof(sockun.sun_path));
+
+  /* Only root (i.e. our session processes, using their root privs) may
+   * connect to the broker.
+   */
+  PRIVS_ROOT
+  (void) unlink(path);
+  res = bind(fd, (struct sockaddr *) &sockun, sizeof(sockun));
+  if (res == 0) {
+    res = chmod(path, 0600);
+  }
+  xerrno = errno;
+  PRIVS_RELINQUISH
+
+  if (res < 0 ||
+      listen(fd, 128) < 0) {
+    xerrno = errno;
+
+    (void) close(fd);
+    errno = xerrno;
+    return -1;
+  }
+
+  (void) fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+  sql_broker_nworkers = 0;
+  for (i = 0; i < nworkers; i++) {
+    pid_t pid;
+
+    pid = sql_broker_start_worker(fd);
+    if (pid == 0) {
+      break;
+    }
+
+    sql_broker_pids[sql_broker_nworkers++] = pid;
+  }
+
+  /* The brokers have their own copies of the listening socket. */
+  (void) close(fd);
+
+  if (sql_broker_nworkers == 0) {
+    PRIVS_ROOT
+    (void) unlink(path);
+    PRIVS_RELINQUISH
+
+    errno = EAGAIN;
+    return -1;
+  }
+
+  return 0;
+}
+
+static void sql_broker_stop(void) {
+  register unsigned int i;
+
+  for (i = 0; i < sql_broker_nworkers; i++) {
+    time_t start_time;
+
+    if (kill(sql_broker_pids[i], SIGTERM) < 0) {
+      continue;
+    }
+
+    start_time = time(NULL);
+    while (waitpid(sql_broker_pids[i], NULL, WNOHANG) == 0) {
+      if (time(NULL) - start_time > 3) {
+        (void) kill(sql_broker_pids[i], SIGKILL);
+        (void) waitpid(sql_broker_pids[i], NULL, 0);
+        break;
+      }
+
+      pr_timer_usleep(100 * 1000);
+    }
+  }
+
+  sql_broker_nworkers = 0;
+
+  if (sql_broker_path != NULL) {
+    PRIVS_ROOT
+    (void) unlink(sql_broker_path);
+    PRIVS_RELINQUISH
+
+    sql_broker_path = NULL;
+  }
+}
+
+/* Event handlers
+ */
+
+static void sql_chroot_ev(const void *event_data, void *user_data) {
+  /* Loop through our list of named connections, making sure that any
+   * with a connection policy of PERSESSION are opened.
+   */
+  if (sql_named_conns != NULL) {
+    pool *tmp_pool;
+    struct sql_named_conn *snc;
+
+    tmp_pool = make_sub_pool(session.pool);
+
+    for (snc = sql_named_conns; snc; snc = snc->next) {
+      pr_signals_handle();
+
+      if (snc->conn_policy == SQL_CONN_POLICY_PERSESSION) {
+        cmd_rec *cmd;
+        modret_t *mr; 
+
+        cmd = _sql_make_cmd(tmp_pool, 1, snc->conn_name);
+        mr = _sql_dispatch(cmd, "sql_open");
+        (void) check_response(mr, 0);
+        SQL_FREE_CMD(cmd);
+      }
+    }
+
+    destroy_pool(tmp_pool);
+  }
+}
+
+static void sql_exit_ev(const void *event_data, void *user_data) {
+  config_rec *c;
+  cmd_rec *cmd;
+  modret_t *mr;
+
+  if (cmap.engine == 0) {
+    return;
+  }
+
+  /* Flush any queued SQLLog statements, and execute any further ones
+   * directly.
+   */
+  sql_logq_flush(SQL_LOG_FL_IGNORE_ERRORS);
+  sql_logq_max = 0;
+
+  /* handle EXIT queries */
   c = find_config(main_server->conf, CONF_PARAM, "SQLLog_EXIT", FALSE);
 
   while (c) {
@@ -6512,6 +7943,56 @@ static void sql_preparse_ev(const void *event_data, void *user_data) {
 }
 #endif /* PR_SHARED_MODULE */
 
+static void sql_broker_postparse_ev(const void *event_data, void *user_data) {
+  config_rec *c;
+  unsigned int nworkers;
+
+  /* The brokers are started once the daemon is up (see the startup event
+   * handler), and then again after each restart.
+   */
+  if (sql_broker_daemon_started == FALSE) {
+    return;
+  }
+
+  c = find_config(main_server->conf, CONF_PARAM, "SQLBroker", FALSE);
+  if (c == NULL) {
+    return;
+  }
+
+  if (ServerType != SERVER_STANDALONE) {
+    pr_log_debug(DEBUG0, MOD_SQL_VERSION
+      ": SQLBroker not supported for ServerType inetd, ignoring");
+    return;
+  }
+
+  nworkers = *((unsigned int *) c->argv[1]);
+
+  if (sql_broker_start(c->argv[0], nworkers) < 0) {
+    pr_log_pri(PR_LOG_NOTICE, MOD_SQL_VERSION
+      ": notice: unable to start SQLBroker at '%s': %s",
+      (char *) c->argv[0], strerror(errno));
+    return;
+  }
+
+  sql_broker_path = c->argv[0];
+  pr_log_debug(DEBUG2, MOD_SQL_VERSION
+    ": started %u SQLBroker %s at '%s'", sql_broker_nworkers,
+    sql_broker_nworkers != 1 ? "processes" : "process", sql_broker_path);
+}
+
+static void sql_broker_restart_ev(const void *event_data, void *user_data) {
+  sql_broker_stop();
+}
+
+static void sql_broker_shutdown_ev(const void *event_data, void *user_data) {
+  sql_broker_stop();
+}
+
+static void sql_broker_startup_ev(const void *event_data, void *user_data) {
+  sql_broker_daemon_started = TRUE;
+  sql_broker_postparse_ev(NULL, NULL);
+}
+
 static void sql_eventlog_ev(const void *event_data, void *user_data) {
   const char *event_name;
   int res;
@@ -6532,6 +8013,12 @@ static int sql_init(void) {
 #else
   pr_event_register(&sql_module, "core.preparse", sql_preparse_ev, NULL);
 #endif /* PR_SHARED_MODULE */
+  pr_event_register(&sql_module, "core.postparse", sql_broker_postparse_ev,
+    NULL);
+  pr_event_register(&sql_module, "core.restart", sql_broker_restart_ev, NULL);
+  pr_event_register(&sql_module, "core.shutdown", sql_broker_shutdown_ev,
+    NULL);
+  pr_event_register(&sql_module, "core.startup", sql_broker_startup_ev, NULL);
 
   /* Register our built-in auth handlers. */
   (void) sql_register_authtype("Backend", sql_auth_backend);
@@ -7162,6 +8649,29 @@ static int sql_sess_init(void) {
     sql_log(DEBUG_INFO, "sql_bcred          : %s", cmap.sql_bcred);
   }
 
+  c = find_config(main_server->conf, CONF_PARAM, "SQLLogQueue", FALSE);
+  if (c != NULL &&
+      (cmap.engine & SQL_ENGINE_FL_LOG)) {
+    int interval;
+
+    sql_logq_max = *((unsigned int *) c->argv[0]);
+    interval = *((int *) c->argv[1]);
+    sql_logq_overflow = *((int *) c->argv[2]);
+
+    sql_logq_pool = make_sub_pool(session.pool);
+    pr_pool_tag(sql_logq_pool, "SQLLogQueue pool");
+
+    if (pr_timer_add(interval, -1, &sql_module, sql_logq_flush_cb,
+        "SQLLogQueue flush") < 0) {
+      sql_log(DEBUG_WARN, "error adding SQLLogQueue timer: %s",
+        strerror(errno));
+    }
+
+    sql_log(DEBUG_INFO, "SQLLogQueue        : %u statements, %d secs, %s",
+      sql_logq_max, interval,
+      sql_logq_overflow == SQL_LOGQ_OVERFLOW_DROP ? "drop" : "flush");
+  }
+
   sql_log(DEBUG_FUNC, "%s", "<<< sql_sess_init");
 
   destroy_pool(tmp_pool);
@@ -7185,6 +8695,7 @@ static conftable sql_conftab[] = {
   { "SQLAuthenticate",	set_sqlauthenticate,	NULL },
   { "SQLAuthTypes",	set_sqlauthtypes,	NULL },
   { "SQLBackend",	set_sqlbackend,		NULL },
+  { "SQLBroker",	set_sqlbroker,		NULL },
   { "SQLEngine",	set_sqlengine,		NULL },
   { "SQLOptions",	set_sqloptions,		NULL },
 
@@ -7212,6 +8723,7 @@ static conftable sql_conftab[] = {
   { "SQLLog", set_sqllog, NULL },
   { "SQLLogFile", set_sqllogfile, NULL },
   { "SQLLogOnEvent", set_sqllogonevent, NULL },
+  { "SQLLogQueue", set_sqllogqueue, NULL },
   { "SQLNamedQuery", set_sqlnamedquery, NULL },
   { "SQLShowInfo", set_sqlshowinfo, NULL },
 
@@ -87,6 +87,14 @@ typedef struct sql_data_struct sql_data_t;
 
 #define MOD_SQL_API_V2 "mod_sql_api_v2"
 
+/* Backends may also implement cmd_execute ("sql_execute"), for prepared
+ *  statements: argv[0] is the connection name, argv[1] the statement text,
+ *  using '?' for parameters, and the remaining arguments the parameter
+ *  values.  The statement should be prepared once per connection, and the
+ *  result returned as for cmd_select (with no rows, for statements which do
+ *  not return any).
+ */
+
 /* SQLOption values */
 extern unsigned long pr_sql_opts;
 
@@ -94,6 +102,7 @@ extern unsigned long pr_sql_opts;
 #define SQL_OPT_USE_NORMALIZED_GROUP_SCHEMA     0x0002
 #define SQL_OPT_NO_RECONNECT                    0x0004
 #define SQL_OPT_IGNORE_CONFIG_FILE		0x0008
+#define SQL_OPT_USE_PREPARED_STATEMENTS		0x0010
 
 /* SQL connection policy */
 extern unsigned int pr_sql_conn_policy;
@@ -171,10 +171,28 @@ struct db_conn_struct {
 
   MYSQL *mysql;
 
+  /* Prepared statements, by statement text. */
+  array_header *stmts;
 };
 
 typedef struct db_conn_struct db_conn_t;
 
+#if MYSQL_VERSION_ID >= 40102
+/*
+ * The prepared statement API appeared in MySQL 4.1.2.  Prepared statements
+ * only last as long as the MySQL connection, so they are closed (and
+ * forgotten) whenever the connection is closed.
+ */
+# define SQL_MYSQL_USE_STMTS	1
+
+struct stmt_entry_struct {
+  char *text;
+  MYSQL_STMT *stmt;
+};
+
+typedef struct stmt_entry_struct stmt_entry_t;
+#endif /* MySQL 4.1.2 and later */
+
 /*
  * This struct is a wrapper for whatever backend data is needed to access 
  * the database, and supports named connections, connection counting, and 
@@ -676,6 +694,18 @@ MODRET cmd_close(cmd_rec *cmd) {
    * timers.
    */
   if (((--entry->connections) == 0 ) || ((cmd->argc == 2) && (cmd->argv[1]))) {
+#ifdef SQL_MYSQL_USE_STMTS
+    if (conn->stmts != NULL) {
+      register unsigned int i;
+
+      for (i = 0; i < conn->stmts->nelts; i++) {
+        mysql_stmt_close(((stmt_entry_t *) conn->stmts->elts)[i].stmt);
+      }
+
+      conn->stmts->nelts = 0;
+    }
+#endif /* SQL_MYSQL_USE_STMTS */
+
     mysql_close(conn->mysql);
     conn->mysql = NULL;
     entry->connections = 0;
@@ -1354,6 +1384,260 @@ MODRET cmd_query(cmd_rec *cmd) {
   return dmr;
 }
 
+#ifdef SQL_MYSQL_USE_STMTS
+/*
+ * _build_stmt_data: the prepared statement equivalent of _build_data;
+ *  fetches the rows of a executed statement into a modret.
+ */
+static modret_t *_build_stmt_data(cmd_rec *cmd, db_conn_t *conn,
+    MYSQL_STMT *stmt) {
+  register unsigned int i;
+  MYSQL_RES *meta = NULL;
+  MYSQL_FIELD *fields = NULL;
+  MYSQL_BIND *binds = NULL;
+  my_bool *is_null = NULL;
+  unsigned long *lens = NULL;
+  my_bool update_max_len = TRUE;
+  sql_data_t *sd = NULL;
+  char **data = NULL;
+  unsigned long cnt = 0;
+  int res;
+
+  sd = (sql_data_t *) pcalloc(cmd->tmp_pool, sizeof(sql_data_t));
+
+  meta = mysql_stmt_result_metadata(stmt);
+  if (meta == NULL) {
+    /* No result set, e.g. an INSERT or UPDATE. */
+    sd->data = (char **) pcalloc(cmd->tmp_pool, sizeof(char *));
+    return mod_create_data(cmd, (void *) sd);
+  }
+
+  /* Have MySQL compute the longest value of each column, so that the
+   * result buffers can be sized accordingly.
+   */
+  mysql_stmt_attr_set(stmt, STMT_ATTR_UPDATE_MAX_LENGTH, &update_max_len);
+
+  if (mysql_stmt_store_result(stmt) != 0) {
+    mysql_free_result(meta);
+    return PR_ERROR_MSG(cmd, MOD_SQL_MYSQL_VERSION,
+      pstrdup(cmd->tmp_pool, mysql_stmt_error(stmt)));
+  }
+
+  sd->rnum = (unsigned long) mysql_stmt_num_rows(stmt);
+  sd->fnum = (unsigned long) mysql_num_fields(meta);
+  fields = mysql_fetch_fields(meta);
+
+  binds = pcalloc(cmd->tmp_pool, sizeof(MYSQL_BIND) * sd->fnum);
+  is_null = pcalloc(cmd->tmp_pool, sizeof(my_bool) * sd->fnum);
+  lens = pcalloc(cmd->tmp_pool, sizeof(unsigned long) * sd->fnum);
+
+  for (i = 0; i < sd->fnum; i++) {
+    unsigned long len;
+
+    /* The max_length of numeric columns is not necessarily that of their
+     * string representation; leave room enough for those.
+     */
+    len = fields[i].max_length;
+    if (len < 64) {
+      len = 64;
+    }
+
+    binds[i].buffer_type = MYSQL_TYPE_STRING;
+    binds[i].buffer_length = len + 1;
+    binds[i].buffer = pcalloc(cmd->tmp_pool, binds[i].buffer_length);
+    binds[i].is_null = &is_null[i];
+    binds[i].length = &lens[i];
+  }
+
+  mysql_free_result(meta);
+
+  if (mysql_stmt_bind_result(stmt, binds) != 0) {
+    mysql_stmt_free_result(stmt);
+    return PR_ERROR_MSG(cmd, MOD_SQL_MYSQL_VERSION,
+      pstrdup(cmd->tmp_pool, mysql_stmt_error(stmt)));
+  }
+
+  data = (char **) pcalloc(cmd->tmp_pool,
+    sizeof(char *) * ((sd->rnum * sd->fnum) + 1));
+
+  while ((res = mysql_stmt_fetch(stmt)) == 0) {
+    for (i = 0; i < sd->fnum; i++) {
+      /* NULL values are returned as NULL, just as mysql_fetch_row does. */
+      data[cnt++] = is_null[i] ? NULL :
+        pstrndup(cmd->tmp_pool, binds[i].buffer,
+          lens[i] < binds[i].buffer_length ? lens[i] :
+            binds[i].buffer_length - 1);
+    }
+  }
+
+  mysql_stmt_free_result(stmt);
+
+  if (res != MYSQL_NO_DATA) {
+    return PR_ERROR_MSG(cmd, MOD_SQL_MYSQL_VERSION,
+      pstrdup(cmd->tmp_pool, mysql_stmt_error(stmt)));
+  }
+
+  data[cnt] = NULL;
+  sd->data = data;
+
+  return mod_create_data(cmd, (void *) sd);
+}
+
+/*
+ * cmd_execute: executes a prepared statement, preparing it first if it
+ *  has not yet been prepared on this connection.
+ *
+ * Inputs:
+ *  cmd->argv[0]: connection name
+ *  cmd->argv[1]: statement text, using '?' for parameters
+ *  cmd->argv[2]..: parameter values
+ *
+ * Returns:
+ *  either a properly filled error modret_t if the statement failed, or a
+ *  modret_t with the result data filled in (with no rows, for statements
+ *  which do not return any).
+ *
+ * Notes:
+ *  The parameter values are bound as strings; MySQL converts them as
+ *  needed, as it would for quoted values in a query.
+ *
+ *  A statement whose execution fails is closed and forgotten, so that it
+ *  will be prepared anew on the next use (e.g. after MySQL reconnected
+ *  automatically, which invalidates all prepared statements).
+ */
+MODRET cmd_execute(cmd_rec *cmd) {
+  register unsigned int i;
+  conn_entry_t *entry = NULL;
+  db_conn_t *conn = NULL;
+  stmt_entry_t *se = NULL;
+  modret_t *cmr = NULL;
+  modret_t *dmr = NULL;
+  MYSQL_BIND *params = NULL;
+  unsigned long *lens = NULL;
+  unsigned int nparams;
+  cmd_rec *close_cmd;
+
+  sql_log(DEBUG_FUNC, "%s", "entering \tmysql cmd_execute");
+
+  _sql_check_cmd(cmd, "cmd_execute");
+
+  if (cmd->argc < 2) {
+    sql_log(DEBUG_FUNC, "%s", "exiting \tmysql cmd_execute");
+    return PR_ERROR_MSG(cmd, MOD_SQL_MYSQL_VERSION, "badly formed request");
+  }
+
+  /* get the named connection */
+  entry = _sql_get_connection(cmd->argv[0]);
+  if (!entry) {
+    sql_log(DEBUG_FUNC, "%s", "exiting \tmysql cmd_execute");
+    return PR_ERROR_MSG(cmd, MOD_SQL_MYSQL_VERSION, "unknown named connection");
+  }
+
+  conn = (db_conn_t *) entry->data;
+
+  cmr = cmd_open(cmd);
+  if (MODRET_ERROR(cmr)) {
+    sql_log(DEBUG_FUNC, "%s", "exiting \tmysql cmd_execute");
+    return cmr;
+  }
+
+  if (conn->stmts == NULL) {
+    conn->stmts = make_array(conn_pool, 4, sizeof(stmt_entry_t));
+  }
+
+  for (i = 0; i < conn->stmts->nelts; i++) {
+    stmt_entry_t *e = &((stmt_entry_t *) conn->stmts->elts)[i];
+
+    if (strcmp(e->text, cmd->argv[1]) == 0) {
+      se = e;
+      break;
+    }
+  }
+
+  if (se == NULL) {
+    MYSQL_STMT *stmt;
+
+    stmt = mysql_stmt_init(conn->mysql);
+    if (stmt == NULL) {
+      dmr = _build_error(cmd, conn);
+
+      close_cmd = _sql_make_cmd(cmd->tmp_pool, 1, entry->name);
+      cmd_close(close_cmd);
+      SQL_FREE_CMD(close_cmd);
+
+      sql_log(DEBUG_FUNC, "%s", "exiting \tmysql cmd_execute");
+      return dmr;
+    }
+
+    if (mysql_stmt_prepare(stmt, cmd->argv[1], strlen(cmd->argv[1])) != 0) {
+      dmr = PR_ERROR_MSG(cmd, MOD_SQL_MYSQL_VERSION,
+        pstrdup(cmd->tmp_pool, mysql_stmt_error(stmt)));
+      mysql_stmt_close(stmt);
+
+      close_cmd = _sql_make_cmd(cmd->tmp_pool, 1, entry->name);
+      cmd_close(close_cmd);
+      SQL_FREE_CMD(close_cmd);
+
+      sql_log(DEBUG_FUNC, "%s", "exiting \tmysql cmd_execute");
+      return dmr;
+    }
+
+    sql_log(DEBUG_INFO, "prepared statement \"%s\"", cmd->argv[1]);
+
+    se = push_array(conn->stmts);
+    se->text = pstrdup(conn_pool, cmd->argv[1]);
+    se->stmt = stmt;
+  }
+
+  nparams = cmd->argc - 2;
+  if (nparams != mysql_stmt_param_count(se->stmt)) {
+    sql_log(DEBUG_FUNC, "%s", "exiting \tmysql cmd_execute");
+    return PR_ERROR_MSG(cmd, MOD_SQL_MYSQL_VERSION, "badly formed request");
+  }
+
+  if (nparams > 0) {
+    params = pcalloc(cmd->tmp_pool, sizeof(MYSQL_BIND) * nparams);
+    lens = pcalloc(cmd->tmp_pool, sizeof(unsigned long) * nparams);
+
+    for (i = 0; i < nparams; i++) {
+      lens[i] = strlen(cmd->argv[i+2]);
+
+      params[i].buffer_type = MYSQL_TYPE_STRING;
+      params[i].buffer = cmd->argv[i+2];
+      params[i].buffer_length = lens[i];
+      params[i].length = &lens[i];
+    }
+  }
+
+  /* log the statement */
+  sql_log(DEBUG_INFO, "statement \"%s\" (%u %s)", se->text, nparams,
+    nparams != 1 ? "parameters" : "parameter");
+
+  if ((nparams > 0 && mysql_stmt_bind_param(se->stmt, params) != 0) ||
+      mysql_stmt_execute(se->stmt) != 0) {
+    dmr = PR_ERROR_MSG(cmd, MOD_SQL_MYSQL_VERSION,
+      pstrdup(cmd->tmp_pool, mysql_stmt_error(se->stmt)));
+
+  } else {
+    dmr = _build_stmt_data(cmd, conn, se->stmt);
+  }
+
+  if (MODRET_ERROR(dmr)) {
+    /* Forget the statement; it will be prepared again next time. */
+    mysql_stmt_close(se->stmt);
+    *se = ((stmt_entry_t *) conn->stmts->elts)[--conn->stmts->nelts];
+  }
+
+  /* close the connection, return the data. */
+  close_cmd = _sql_make_cmd(cmd->tmp_pool, 1, entry->name);
+  cmd_close(close_cmd);
+  SQL_FREE_CMD(close_cmd);
+
+  sql_log(DEBUG_FUNC, "%s", "exiting \tmysql cmd_execute");
+  return dmr;
+}
+#endif /* SQL_MYSQL_USE_STMTS */
+
 /*
  * cmd_escapestring: certain strings sent to a database should be properly
  *  escaped -- for instance, quotes need to be escaped to insure that 
@@ -1643,6 +1927,9 @@ static cmdtable sql_mysql_cmdtable[] = {
   { CMD, "sql_cleanup",          G_NONE, cmd_cleanup,          FALSE, FALSE },
   { CMD, "sql_defineconnection", G_NONE, cmd_defineconnection, FALSE, FALSE },
   { CMD, "sql_escapestring",     G_NONE, cmd_escapestring,     FALSE, FALSE },
+#ifdef SQL_MYSQL_USE_STMTS
+  { CMD, "sql_execute",          G_NONE, cmd_execute,          FALSE, FALSE },
+#endif /* SQL_MYSQL_USE_STMTS */
   { CMD, "sql_exit",             G_NONE, cmd_exit,             FALSE, FALSE },
   { CMD, "sql_identify",         G_NONE, cmd_identify,         FALSE, FALSE },
   { CMD, "sql_insert",           G_NONE, cmd_insert,           FALSE, FALSE },
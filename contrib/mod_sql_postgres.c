@@ -84,10 +84,27 @@ struct db_conn_struct {
 
   PGconn *postgres;
   PGresult *result;
+
+  /* Prepared statements, by statement text. */
+  array_header *stmts;
 };
 
 typedef struct db_conn_struct db_conn_t;
 
+/*
+ * stmt_entry_struct: a statement prepared (or to be prepared) on a
+ *  connection.  Prepared statements only last as long as the database
+ *  session, so they are marked as unprepared whenever the connection is
+ *  closed or reset.
+ */
+struct stmt_entry_struct {
+  char *text;
+  char *name;
+  int prepared;
+};
+
+typedef struct stmt_entry_struct stmt_entry_t;
+
 /*
  * This struct is a wrapper for whatever backend data is needed to access 
  * the database, and supports named connections, connection counting, and 
@@ -209,6 +226,22 @@ static int sql_timer_cb(CALLBACK_FRAME) {
   return 0;
 }
 
+/*
+ * _sql_reset_stmts: marks all of the statements prepared on the given
+ *  connection as unprepared, e.g. after the connection was closed.
+ */
+static void _sql_reset_stmts(db_conn_t *conn) {
+  register unsigned int i;
+
+  if (conn->stmts == NULL) {
+    return;
+  }
+
+  for (i = 0; i < conn->stmts->nelts; i++) {
+    ((stmt_entry_t **) conn->stmts->elts)[i]->prepared = FALSE;
+  }
+}
+
 /* 
  * _build_error: constructs a modret_t filled with error information;
  *  mod_sql_postgres calls this function and returns the resulting mod_ret_t
@@ -406,6 +439,7 @@ MODRET cmd_open(cmd_rec *cmd) {
        */
       if (!(pr_sql_opts & SQL_OPT_NO_RECONNECT)) {
         PQreset(conn->postgres);
+        _sql_reset_stmts(conn);
 
         if (PQstatus(conn->postgres) == CONNECTION_OK) {
           entry->connections++;
@@ -593,6 +627,7 @@ MODRET cmd_close(cmd_rec *cmd) {
   if (((--entry->connections) == 0 ) || ((cmd->argc == 2) && (cmd->argv[1]))) {
     PQfinish(conn->postgres);
     conn->postgres = NULL;
+    _sql_reset_stmts(conn);
     entry->connections = 0;
 
     if (entry->timer) {
@@ -1276,6 +1311,181 @@ MODRET cmd_query(cmd_rec *cmd) {
   return dmr;
 }
 
+/*
+ * cmd_execute: executes a prepared statement, preparing it first if it
+ *  has not yet been prepared on this connection.
+ *
+ * Inputs:
+ *  cmd->argv[0]: connection name
+ *  cmd->argv[1]: statement text, using '?' for parameters
+ *  cmd->argv[2]..: parameter values
+ *
+ * Returns:
+ *  either a properly filled error modret_t if the statement failed, or a
+ *  modret_t with the result data filled in (with no rows, for statements
+ *  which do not return any).
+ *
+ * Notes:
+ *  Postgres uses $1, $2, etc for parameters, rather than '?', so the
+ *  statement text is rewritten when it is prepared.
+ */
+MODRET cmd_execute(cmd_rec *cmd) {
+  register unsigned int i;
+  conn_entry_t *entry = NULL;
+  db_conn_t *conn = NULL;
+  stmt_entry_t *stmt = NULL;
+  modret_t *cmr = NULL;
+  modret_t *dmr = NULL;
+  const char **params = NULL;
+  int nparams;
+  cmd_rec *close_cmd;
+
+  sql_log(DEBUG_FUNC, "%s", "entering \tpostgres cmd_execute");
+
+  _sql_check_cmd(cmd, "cmd_execute");
+
+  if (cmd->argc < 2) {
+    sql_log(DEBUG_FUNC, "%s", "exiting \tpostgres cmd_execute");
+    return PR_ERROR_MSG(cmd, MOD_SQL_POSTGRES_VERSION, "badly formed request");
+  }
+
+  /* get the named connection */
+  entry = _sql_get_connection(cmd->argv[0]);
+  if (!entry) {
+    sql_log(DEBUG_FUNC, "%s", "exiting \tpostgres cmd_execute");
+    return PR_ERROR_MSG(cmd, MOD_SQL_POSTGRES_VERSION,
+      "unknown named connection");
+  }
+
+  conn = (db_conn_t *) entry->data;
+
+  cmr = cmd_open(cmd);
+  if (MODRET_ERROR(cmr)) {
+    sql_log(DEBUG_FUNC, "%s", "exiting \tpostgres cmd_execute");
+    return cmr;
+  }
+
+  if (conn->stmts == NULL) {
+    conn->stmts = make_array(conn_pool, 4, sizeof(stmt_entry_t *));
+  }
+
+  for (i = 0; i < conn->stmts->nelts; i++) {
+    stmt_entry_t *e = ((stmt_entry_t **) conn->stmts->elts)[i];
+
+    if (strcmp(e->text, cmd->argv[1]) == 0) {
+      stmt = e;
+      break;
+    }
+  }
+
+  if (stmt == NULL) {
+    char name[32];
+
+    memset(name, '\0', sizeof(name));
+    snprintf(name, sizeof(name)-1, "proftpd_stmt_%u", conn->stmts->nelts);
+
+    stmt = pcalloc(conn_pool, sizeof(stmt_entry_t));
+    stmt->text = pstrdup(conn_pool, cmd->argv[1]);
+    stmt->name = pstrdup(conn_pool, name);
+    *((stmt_entry_t **) push_array(conn->stmts)) = stmt;
+  }
+
+  nparams = cmd->argc - 2;
+
+  if (!stmt->prepared) {
+    char *text, *ptr, quote = '\0';
+    int n = 0;
+
+    /* Rewrite the '?' placeholders (outside of quoted strings) as $n. */
+    text = "";
+    for (ptr = stmt->text; *ptr; ptr++) {
+      char buf[16];
+
+      if (quote) {
+        if (*ptr == quote) {
+          quote = '\0';
+        }
+
+      } else if (*ptr == '\'' ||
+                 *ptr == '"') {
+        quote = *ptr;
+
+      } else if (*ptr == '?') {
+        memset(buf, '\0', sizeof(buf));
+        snprintf(buf, sizeof(buf)-1, "$%d", ++n);
+        text = pstrcat(cmd->tmp_pool, text, buf, NULL);
+        continue;
+      }
+
+      memset(buf, '\0', sizeof(buf));
+      buf[0] = *ptr;
+      text = pstrcat(cmd->tmp_pool, text, buf, NULL);
+    }
+
+    sql_log(DEBUG_INFO, "preparing statement \"%s\"", text);
+
+    conn->result = PQprepare(conn->postgres, stmt->name, text, n, NULL);
+    if (conn->result == NULL ||
+        PQresultStatus(conn->result) != PGRES_COMMAND_OK) {
+      dmr = _build_error(cmd, conn);
+
+      if (conn->result) PQclear(conn->result);
+
+      close_cmd = _sql_make_cmd(cmd->tmp_pool, 1, entry->name);
+      cmd_close(close_cmd);
+      SQL_FREE_CMD(close_cmd);
+
+      sql_log(DEBUG_FUNC, "%s", "exiting \tpostgres cmd_execute");
+      return dmr;
+    }
+
+    PQclear(conn->result);
+    stmt->prepared = TRUE;
+  }
+
+  if (nparams > 0) {
+    params = pcalloc(cmd->tmp_pool, sizeof(char *) * nparams);
+    for (i = 0; i < nparams; i++) {
+      params[i] = cmd->argv[i+2];
+    }
+  }
+
+  /* log the statement */
+  sql_log(DEBUG_INFO, "statement \"%s\" (%d %s)", stmt->text, nparams,
+    nparams != 1 ? "parameters" : "parameter");
+
+  /* perform the query.  if it doesn't work, log the error, close the
+   * connection then return the error from the query processing.
+   */
+  if (!(conn->result = PQexecPrepared(conn->postgres, stmt->name, nparams,
+      params, NULL, NULL, 0)) ||
+      ((PQresultStatus(conn->result) != PGRES_TUPLES_OK) &&
+       (PQresultStatus(conn->result) != PGRES_COMMAND_OK))) {
+    dmr = _build_error(cmd, conn);
+
+    if (conn->result) PQclear(conn->result);
+
+    close_cmd = _sql_make_cmd(cmd->tmp_pool, 1, entry->name);
+    cmd_close(close_cmd);
+    SQL_FREE_CMD(close_cmd);
+
+    sql_log(DEBUG_FUNC, "%s", "exiting \tpostgres cmd_execute");
+    return dmr;
+  }
+
+  /* A statement without results yields no rows. */
+  dmr = _build_data(cmd, conn);
+  PQclear(conn->result);
+
+  /* close the connection, return the data. */
+  close_cmd = _sql_make_cmd(cmd->tmp_pool, 1, entry->name);
+  cmd_close(close_cmd);
+  SQL_FREE_CMD(close_cmd);
+
+  sql_log(DEBUG_FUNC, "%s", "exiting \tpostgres cmd_execute");
+  return dmr;
+}
+
 /*
  * cmd_escapestring: certain strings sent to a database should be properly
  *  escaped -- for instance, quotes need to be escaped to insure that 
@@ -1486,6 +1696,7 @@ static cmdtable sql_postgres_cmdtable[] = {
   { CMD, "sql_close",            G_NONE, cmd_close,            FALSE, FALSE },
   { CMD, "sql_defineconnection", G_NONE, cmd_defineconnection, FALSE, FALSE },
   { CMD, "sql_escapestring",     G_NONE, cmd_escapestring,     FALSE, FALSE },
+  { CMD, "sql_execute",          G_NONE, cmd_execute,          FALSE, FALSE },
   { CMD, "sql_exit",             G_NONE, cmd_exit,             FALSE, FALSE },
   { CMD, "sql_identify",         G_NONE, cmd_identify,         FALSE, FALSE },
   { CMD, "sql_insert",           G_NONE, cmd_insert,           FALSE, FALSE },
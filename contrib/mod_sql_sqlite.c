@@ -50,8 +50,17 @@ typedef struct db_conn_struct {
 
   sqlite3 *dbh;
 
+  /* Prepared statements, by statement text. */
+  array_header *stmts;
+
 } db_conn_t;
 
+typedef struct stmt_entry_struct {
+  char *text;
+  sqlite3_stmt *stmt;
+
+} stmt_entry_t;
+
 typedef struct conn_entry_struct {
   char *name;
   void *data;
@@ -205,6 +214,131 @@ static int exec_stmt(cmd_rec *cmd, db_conn_t *conn, char *stmt, char **errstr) {
   return 0;
 }
 
+static sqlite3_stmt *sql_sqlite_get_stmt(cmd_rec *cmd, db_conn_t *conn,
+    char *text, char **errstr) {
+  register unsigned int i;
+  stmt_entry_t *entry = NULL;
+  int res;
+
+  if (conn->stmts == NULL) {
+    conn->stmts = make_array(conn_pool, 4, sizeof(stmt_entry_t *));
+  }
+
+  for (i = 0; i < conn->stmts->nelts; i++) {
+    stmt_entry_t *e = ((stmt_entry_t **) conn->stmts->elts)[i];
+
+    if (strcmp(e->text, text) == 0) {
+      entry = e;
+      break;
+    }
+  }
+
+  if (entry == NULL) {
+    entry = pcalloc(conn_pool, sizeof(stmt_entry_t));
+    entry->text = pstrdup(conn_pool, text);
+    *((stmt_entry_t **) push_array(conn->stmts)) = entry;
+  }
+
+  if (entry->stmt == NULL) {
+    PRIVS_ROOT
+    res = sqlite3_prepare_v2(conn->dbh, text, -1, &(entry->stmt), NULL);
+    PRIVS_RELINQUISH
+
+    if (res != SQLITE_OK) {
+      *errstr = pstrdup(cmd->pool, sqlite3_errmsg(conn->dbh));
+      sql_log(DEBUG_FUNC, "error preparing '%s': (%d) %s", text, res,
+        *errstr);
+
+      entry->stmt = NULL;
+      return NULL;
+    }
+
+    sql_log(DEBUG_INFO, "prepared statement \"%s\"", text);
+  }
+
+  return entry->stmt;
+}
+
+/* Steps through the results of the given statement, collecting any rows in
+ * result_list, as exec_cb() does.
+ */
+static int exec_prepared_stmt(cmd_rec *cmd, db_conn_t *conn,
+    sqlite3_stmt *stmt, char **errstr) {
+  unsigned int nretries = 0;
+  int res;
+
+  while (TRUE) {
+    PRIVS_ROOT
+    res = sqlite3_step(stmt);
+    PRIVS_RELINQUISH
+
+    if (res == SQLITE_ROW) {
+      register int i;
+      int ncols;
+      char ***row;
+
+      ncols = sqlite3_column_count(stmt);
+      if (result_list == NULL) {
+        result_ncols = ncols;
+        result_list = make_array(cmd->tmp_pool, ncols, sizeof(char **));
+      }
+
+      row = push_array(result_list);
+      *row = pcalloc(cmd->tmp_pool, sizeof(char *) * ncols);
+
+      for (i = 0; i < ncols; i++) {
+        const char *val;
+
+        val = (const char *) sqlite3_column_text(stmt, i);
+        (*row)[i] = pstrdup(cmd->tmp_pool, val ? val : "NULL");
+      }
+
+      continue;
+    }
+
+    if (res == SQLITE_DONE) {
+      break;
+    }
+
+    if (res == SQLITE_BUSY) {
+      struct timeval tv;
+
+      /* Discard any partial results, and start again. */
+      sqlite3_reset(stmt);
+      result_ncols = 0;
+      result_list = NULL;
+
+      nretries++;
+      sql_log(DEBUG_FUNC, "attempt #%u, database busy, trying '%s' again",
+        nretries, sqlite3_sql(stmt));
+
+      /* Sleep for short bit, then try again. */
+      tv.tv_sec = 0;
+      tv.tv_usec = 500000L;
+
+      if (select(0, NULL, NULL, NULL, &tv) < 0) {
+        if (errno == EINTR) {
+          pr_signals_handle();
+        }
+      }
+
+      continue;
+    }
+
+    *errstr = pstrdup(cmd->pool, sqlite3_errmsg(conn->dbh));
+    sql_log(DEBUG_FUNC, "error executing '%s': (%d) %s", sqlite3_sql(stmt),
+      res, *errstr);
+
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    return -1;
+  }
+
+  sqlite3_reset(stmt);
+  sqlite3_clear_bindings(stmt);
+  return 0;
+}
+
 static int query_start(cmd_rec *cmd, db_conn_t *conn, int flags,
     char **errstr) {
   char *start_txn = NULL;
@@ -407,6 +541,22 @@ MODRET sql_sqlite_close(cmd_rec *cmd) {
       (cmd->argc == 2 && cmd->argv[1])) {
 
     if (conn->dbh) {
+      if (conn->stmts != NULL) {
+        register unsigned int i;
+        stmt_entry_t **stmts = conn->stmts->elts;
+
+        /* The statements must be finalized before the database can be
+         * closed.  The cache entries themselves are kept, for when the
+         * connection is reopened.
+         */
+        for (i = 0; i < conn->stmts->nelts; i++) {
+          if (stmts[i]->stmt != NULL) {
+            sqlite3_finalize(stmts[i]->stmt);
+            stmts[i]->stmt = NULL;
+          }
+        }
+      }
+
       if (sqlite3_close(conn->dbh) != SQLITE_OK) {
         sql_log(DEBUG_FUNC, "error closing SQLite database: %s",
           sqlite3_errmsg(conn->dbh));
@@ -472,6 +622,7 @@ MODRET sql_sqlite_def_conn(cmd_rec *cmd) {
   conn->user = pstrdup(conn_pool, cmd->argv[1]);
   conn->pass = pstrdup(conn_pool, cmd->argv[2]);
   conn->dsn = pstrdup(conn_pool, cmd->argv[3]);
+  conn->stmts = NULL;
 
   /* Insert the new conn_info into the connection hash */
   entry = sql_sqlite_add_conn(conn_pool, name, (void *) conn);
@@ -502,6 +653,89 @@ MODRET sql_sqlite_def_conn(cmd_rec *cmd) {
   return PR_HANDLED(cmd);
 }
 
+MODRET sql_sqlite_execute(cmd_rec *cmd) {
+  register unsigned int i;
+  conn_entry_t *entry = NULL;
+  db_conn_t *conn = NULL;
+  modret_t *mr = NULL;
+  char *errstr = NULL;
+  sqlite3_stmt *stmt;
+  cmd_rec *close_cmd;
+
+  sql_log(DEBUG_FUNC, "%s", "entering \tsqlite cmd_execute");
+
+  if (cmd->argc < 2) {
+    sql_log(DEBUG_FUNC, "%s", "exiting \tsqlite cmd_execute");
+    return PR_ERROR_MSG(cmd, MOD_SQL_SQLITE_VERSION, "badly formed request");
+  }
+
+  /* Get the named connection. */
+  entry = sql_sqlite_get_conn(cmd->argv[0]);
+  if (entry == NULL) {
+    sql_log(DEBUG_FUNC, "%s", "exiting \tsqlite cmd_execute");
+    return PR_ERROR_MSG(cmd, MOD_SQL_SQLITE_VERSION,
+      "unknown named connection");
+  }
+
+  conn = (db_conn_t *) entry->data;
+
+  mr = sql_sqlite_open(cmd);
+  if (MODRET_ERROR(mr)) {
+    sql_log(DEBUG_FUNC, "%s", "exiting \tsqlite cmd_execute");
+    return mr;
+  }
+
+  stmt = sql_sqlite_get_stmt(cmd, conn, cmd->argv[1], &errstr);
+  if (stmt == NULL) {
+    close_cmd = pr_cmd_alloc(cmd->tmp_pool, 1, entry->name);
+    sql_sqlite_close(close_cmd);
+    destroy_pool(close_cmd->pool);
+
+    sql_log(DEBUG_FUNC, "%s", "exiting \tsqlite cmd_execute");
+    return PR_ERROR_MSG(cmd, MOD_SQL_SQLITE_VERSION, errstr);
+  }
+
+  if ((int) (cmd->argc - 2) != sqlite3_bind_parameter_count(stmt)) {
+    close_cmd = pr_cmd_alloc(cmd->tmp_pool, 1, entry->name);
+    sql_sqlite_close(close_cmd);
+    destroy_pool(close_cmd->pool);
+
+    sql_log(DEBUG_FUNC, "%s", "exiting \tsqlite cmd_execute");
+    return PR_ERROR_MSG(cmd, MOD_SQL_SQLITE_VERSION,
+      "wrong number of statement parameters");
+  }
+
+  for (i = 2; i < cmd->argc; i++) {
+    sqlite3_bind_text(stmt, i - 1, cmd->argv[i], -1, SQLITE_TRANSIENT);
+  }
+
+  /* Log the statement. */
+  sql_log(DEBUG_INFO, "statement \"%s\" (%u %s)", cmd->argv[1],
+    cmd->argc - 2, cmd->argc - 2 != 1 ? "parameters" : "parameter");
+
+  if (exec_prepared_stmt(cmd, conn, stmt, &errstr) < 0) {
+    result_ncols = 0;
+    result_list = NULL;
+
+    close_cmd = pr_cmd_alloc(cmd->tmp_pool, 1, entry->name);
+    sql_sqlite_close(close_cmd);
+    destroy_pool(close_cmd->pool);
+
+    sql_log(DEBUG_FUNC, "%s", "exiting \tsqlite cmd_execute");
+    return PR_ERROR_MSG(cmd, MOD_SQL_SQLITE_VERSION, errstr);
+  }
+
+  mr = sql_sqlite_get_data(cmd);
+
+  /* Close the connection, return the data. */
+  close_cmd = pr_cmd_alloc(cmd->tmp_pool, 1, entry->name);
+  sql_sqlite_close(close_cmd);
+  destroy_pool(close_cmd->pool);
+
+  sql_log(DEBUG_FUNC, "%s", "exiting \tsqlite cmd_execute");
+  return mr;
+}
+
 MODRET sql_sqlite_exit(cmd_rec *cmd) {
   register unsigned int i = 0;
 
@@ -998,6 +1232,7 @@ static cmdtable sql_sqlite_cmdtable[] = {
   { CMD, "sql_cleanup",		G_NONE, sql_sqlite_cleanup,	FALSE, FALSE },
   { CMD, "sql_defineconnection",G_NONE, sql_sqlite_def_conn,	FALSE, FALSE },
   { CMD, "sql_escapestring",	G_NONE, sql_sqlite_quote,	FALSE, FALSE },
+  { CMD, "sql_execute",		G_NONE, sql_sqlite_execute,	FALSE, FALSE },
   { CMD, "sql_exit",		G_NONE,	sql_sqlite_exit,	FALSE, FALSE },
   { CMD, "sql_identify",	G_NONE, sql_sqlite_identify,	FALSE, FALSE },
   { CMD, "sql_insert",		G_NONE, sql_sqlite_insert,	FALSE, FALSE },
@@ -62,7 +62,7 @@
 #endif /* PR_USE_OPENSSL_ECC */
 
 
-#ifdef HAVE_MLOCK
+#if defined(HAVE_MLOCK) || defined(HAVE_SYS_MMAN_H)
 # include <sys/mman.h>
 #endif
 
@@ -84,6 +84,42 @@ extern xaset_t *server_list;
  * Last updated on 2013-01-13.
  */
 
+/* Creates DH parameters from the given prime and generator. */
+static DH *get_dh(unsigned char *p, size_t plen, unsigned char *g,
+    size_t glen) {
+  DH *dh;
+  BIGNUM *dh_p, *dh_g;
+
+  dh = DH_new();
+  if (dh == NULL)
+    return NULL;
+
+  dh_p = BN_bin2bn(p, plen, NULL);
+  dh_g = BN_bin2bn(g, glen, NULL);
+
+  if (dh_p == NULL ||
+      dh_g == NULL) {
+    BN_free(dh_p);
+    BN_free(dh_g);
+    DH_free(dh);
+    return NULL;
+  }
+
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+  if (DH_set0_pqg(dh, dh_p, NULL, dh_g) != 1) {
+    BN_free(dh_p);
+    BN_free(dh_g);
+    DH_free(dh);
+    return NULL;
+  }
+#else
+  dh->p = dh_p;
+  dh->g = dh_g;
+#endif /* OpenSSL-1.1.0 and later */
+
+  return dh;
+}
+
 /*
 -----BEGIN DH PARAMETERS-----
 MEYCQQC6VcB8+WFeFz/HQnk/vXreozxdppNBY4gN8rdzitjTDppPBswzU4ZL/hBS
@@ -105,22 +141,7 @@ static unsigned char dh512_g[] = {
 };
 
 static DH *get_dh512(void) {
-  DH *dh;
-
-  dh = DH_new();
-  if (dh == NULL)
-    return NULL;
-
-  dh->p = BN_bin2bn(dh512_p, sizeof(dh512_p), NULL);
-  dh->g = BN_bin2bn(dh512_g, sizeof(dh512_g), NULL);
-
-  if (dh->p == NULL ||
-      dh->g == NULL) {
-    DH_free(dh);
-    return NULL;
-  }
-
-  return dh;
+  return get_dh(dh512_p, sizeof(dh512_p), dh512_g, sizeof(dh512_g));
 }
 
 /*
@@ -147,22 +168,7 @@ static unsigned char dh768_g[] = {
 };
 
 static DH *get_dh768(void) {
-  DH *dh;
-
-  dh = DH_new();
-  if (dh == NULL)
-    return NULL;
-
-  dh->p = BN_bin2bn(dh768_p, sizeof(dh768_p), NULL);
-  dh->g = BN_bin2bn(dh768_g, sizeof(dh768_g), NULL);
-
-  if (dh->p == NULL ||
-      dh->g == NULL) {
-    DH_free(dh);
-    return NULL;
-  }
-
-  return dh;
+  return get_dh(dh768_p, sizeof(dh768_p), dh768_g, sizeof(dh768_g));
 }
 
 /*
@@ -192,22 +198,7 @@ static unsigned char dh1024_g[] = {
 };
 
 static DH *get_dh1024(void) {
-  DH *dh;
-
-  dh = DH_new();
-  if (dh == NULL)
-    return NULL;
-
-  dh->p = BN_bin2bn(dh1024_p, sizeof(dh1024_p), NULL);
-  dh->g = BN_bin2bn(dh1024_g, sizeof(dh1024_g), NULL);
-
-  if (dh->p == NULL ||
-      dh->g == NULL) {
-    DH_free(dh);
-    return NULL;
-  }
-
-  return(dh);
+  return get_dh(dh1024_p, sizeof(dh1024_p), dh1024_g, sizeof(dh1024_g));
 }
 
 /*
@@ -244,22 +235,7 @@ static unsigned char dh1536_g[] = {
 };
 
 static DH *get_dh1536(void) {
-  DH *dh;
-
-  dh = DH_new();
-  if (dh == NULL)
-    return NULL;
-
-  dh->p = BN_bin2bn(dh1536_p, sizeof(dh1536_p), NULL);
-  dh->g = BN_bin2bn(dh1536_g, sizeof(dh1536_g), NULL);
-
-  if (dh->p == NULL ||
-      dh->g == NULL) {
-    DH_free(dh);
-    return NULL;
-  }
-
-  return dh;
+  return get_dh(dh1536_p, sizeof(dh1536_p), dh1536_g, sizeof(dh1536_g));
 }
 
 /*
@@ -303,22 +279,7 @@ static unsigned char dh2048_g[] = {
 };
 
 static DH *get_dh2048(void) {
-  DH *dh;
-
-  dh = DH_new();
-  if (dh == NULL)
-    return NULL;
-
-  dh->p = BN_bin2bn(dh2048_p, sizeof(dh2048_p), NULL);
-  dh->g = BN_bin2bn(dh2048_g, sizeof(dh2048_g), NULL);
-
-  if (dh->p == NULL ||
-      dh->g == NULL) {
-    DH_free(dh);
-    return NULL;
-  }
-
-  return dh;
+  return get_dh(dh2048_p, sizeof(dh2048_p), dh2048_g, sizeof(dh2048_g));
 }
 
 /* ASN1_BIT_STRING_cmp was renamed in 0.9.5 */
@@ -326,6 +287,20 @@ static DH *get_dh2048(void) {
 # define M_ASN1_BIT_STRING_cmp ASN1_BIT_STRING_cmp
 #endif
 
+/* OpenSSL-1.1.0 made most structures opaque, and added accessors for the
+ * fields we use; provide those accessors for older versions.
+ */
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+# define SSL_CTX_get_default_passwd_cb(ctx) \
+    ((ctx)->default_passwd_callback)
+# define SSL_CTX_get_default_passwd_cb_userdata(ctx) \
+    ((ctx)->default_passwd_callback_userdata)
+# define X509_REVOKED_get0_serialNumber(revoked) \
+    ((revoked)->serialNumber)
+# define X509_STORE_CTX_get0_store(ctx) \
+    ((ctx)->ctx)
+#endif /* OpenSSL older than 1.1.0 */
+
 /* From src/dirtree.c */
 extern int ServerUseReverseDNS;
 
@@ -446,6 +421,8 @@ static unsigned char *tls_authenticated = NULL;
 #define TLS_OPT_ALLOW_CLIENT_RENEGOTIATIONS		0x0400
 #define TLS_OPT_VERIFY_CERT_CN				0x0800
 #define TLS_OPT_ALLOW_WEAK_DH				0x1000
+#define TLS_OPT_KERNEL_TLS				0x2000
+#define TLS_OPT_PREFER_ECDSA				0x4000
 
 /* mod_tls SSCN modes */
 #define TLS_SSCN_MODE_SERVER				0
@@ -457,6 +434,7 @@ static unsigned int tls_sscn_mode = TLS_SSCN_MODE_SERVER;
 
 /* mod_tls OCSP constants */
 #define TLS_OCSP_RESP_MAX_AGE_SECS	300
+#define TLS_OCSP_RESPONDER_TIMEOUT_SECS	5
 
 static char *tls_cipher_suite = NULL;
 static char *tls_crl_file = NULL, *tls_crl_path = NULL;
@@ -493,6 +471,51 @@ static unsigned char tls_renegotiate_required = TRUE;
 
 #define TLS_NETIO_NOTE		"mod_tls.SSL"
 
+/* Per-stream state, hung off the stream's strm_data pointer.  The SSL
+ * object is also stashed in the stream notes under TLS_NETIO_NOTE, but
+ * keeping it here spares a table lookup on every read and write.
+ */
+struct tls_netio_strm {
+  SSL *ssl;
+
+  /* Plaintext waiting to be sealed into a TLS record, for data write
+   * streams only; see tls_netio_write_cb().
+   */
+  unsigned char *wbuf;
+  size_t wbuflen;
+
+  /* Length of a record write which OpenSSL asked us to retry. */
+  size_t wretry;
+
+  /* Set when the kernel seals our records (kTLS); mod_xfer may then write
+   * to the socket directly using sendfile(2), so we must not hold any
+   * plaintext back.
+   */
+  int ktls_tx;
+
+  /* Bytes sealed into records since the last (re)start of the record size
+   * slow start, and when we last wrote a record.
+   */
+  off_t wsealed;
+  time_t wlast;
+};
+
+/* Record sizing for data write streams: start with records that fit in a
+ * single TCP segment, so that the client can decrypt the first bytes
+ * without waiting for more segments; once the connection has carried
+ * TLS_DATA_SLOW_START_BYTES, switch to full-size records, and fall back to
+ * small records after TLS_DATA_IDLE_RESET_SECS of idleness.
+ */
+#define TLS_DATA_SMALL_RECORD_SIZE	1360
+#define TLS_DATA_MAX_RECORD_SIZE	16384
+#define TLS_DATA_SLOW_START_BYTES	(64 * 1024)
+#define TLS_DATA_IDLE_RESET_SECS	1
+
+/* Set on the data write stream when the kernel is encrypting the records
+ * for that stream (kTLS), so that mod_xfer may use sendfile(2).
+ */
+#define TLS_KTLS_TX_NOTE	"mod_tls.ktls-tx"
+
 static pr_netio_t *tls_ctrl_netio = NULL;
 static pr_netio_stream_t *tls_ctrl_rd_nstrm = NULL;
 static pr_netio_stream_t *tls_ctrl_wr_nstrm = NULL;
@@ -506,7 +529,42 @@ static tls_sess_cache_t *tls_sess_cache = NULL;
 /* OpenSSL variables */
 static SSL *ctrl_ssl = NULL;
 static SSL_CTX *ssl_ctx = NULL;
-static X509_STORE *tls_crl_store = NULL;
+
+/* Indexed CRLs; see tls_crl_init(). */
+#define TLS_CRL_MIN_BUCKETS		16
+
+struct tls_crl_serial {
+  struct tls_crl_serial *next;
+  ASN1_INTEGER *serial;
+};
+
+struct tls_crl_entry {
+  struct tls_crl_entry *next;
+  X509_CRL *crl;
+  X509_NAME *issuer;
+  unsigned long issuer_hash;
+
+  /* Hash table of the revoked serial numbers. */
+  struct tls_crl_serial **buckets;
+  unsigned int nbuckets;
+
+  /* The key which last verified the CRL signature. */
+  EVP_PKEY *verified_pkey;
+};
+
+struct tls_crl_set {
+  struct tls_crl_set *next;
+  const char *crl_file, *crl_path;
+  struct tls_crl_entry *crls;
+  unsigned int ncrls;
+  unsigned long nrevoked;
+};
+
+static pool *tls_crl_pool = NULL;
+static struct tls_crl_set *tls_crl_sets = NULL;
+static struct tls_crl_set *tls_crl_set = NULL;
+static struct tls_crl_set *tls_crl_set_get(const char *, const char *);
+
 static array_header *tls_tmp_dhs = NULL;
 static RSA *tls_tmp_rsa = NULL;
 
@@ -538,6 +596,13 @@ static char *tls_x509_name_oneline(X509_NAME *);
 static int tls_readmore(int);
 static int tls_writemore(int);
 
+static void tls_key_worker_attach(SSL_CTX *);
+static void tls_prefer_ecdsa(SSL_CTX *);
+
+static SSL *tls_netio_get_ssl(pr_netio_stream_t *);
+static void tls_netio_set_ssl(pr_netio_stream_t *, SSL *);
+static void tls_netio_clear_ssl(pr_netio_stream_t *);
+
 /* Session cache API */
 static tls_sess_cache_t *tls_sess_cache_get_cache(const char *);
 static long tls_sess_cache_get_cache_mode(void);
@@ -549,10 +614,211 @@ static int tls_sess_cache_remove(void);
 static int tls_sess_cache_status(pr_ctrls_t *, int);
 #endif /* PR_USE_CTRLS */
 static int tls_sess_cache_add_sess_cb(SSL *, SSL_SESSION *);
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+static SSL_SESSION *tls_sess_cache_get_sess_cb(SSL *, const unsigned char *,
+  int, int *);
+#else
 static SSL_SESSION *tls_sess_cache_get_sess_cb(SSL *, unsigned char *, int,
   int *);
+#endif /* OpenSSL-1.1.x and later */
 static void tls_sess_cache_delete_sess_cb(SSL_CTX *, SSL_SESSION *);
 
+/* Session tickets (RFC 5077)
+ *
+ * The ticket keys are generated in the daemon process, and are inherited by
+ * the session processes when they are forked.  This way, a ticket issued by
+ * one session process can be decrypted by any other session process, without
+ * the IPC needed by the session cache providers.  The daemon process rotates
+ * the keys periodically (and on demand, via the "tls sesstickets rotate"
+ * control action), keeping the most recent keys for decrypting tickets
+ * which were issued before the rotation.
+ */
+#if defined(SSL_CTRL_SET_TLSEXT_TICKET_KEY_CB)
+# define TLS_USE_SESSION_TICKETS	1
+#endif /* SSL_CTRL_SET_TLSEXT_TICKET_KEY_CB */
+
+#define TLS_TICKET_NAME_LEN		16
+#define TLS_TICKET_KEY_LEN		32
+
+/* Defaults: rotate keys every 12 hours, keeping the 3 most recent keys. */
+#define TLS_TICKET_KEY_DEFAULT_AGE	43200
+#define TLS_TICKET_KEY_DEFAULT_COUNT	3
+#define TLS_TICKET_KEY_MAX_COUNT	100
+
+struct tls_ticket_key {
+  unsigned char key_name[TLS_TICKET_NAME_LEN];
+  unsigned char cipher_key[TLS_TICKET_KEY_LEN];
+  unsigned char hmac_key[TLS_TICKET_KEY_LEN];
+  time_t created;
+};
+
+/* Newest key first. */
+static struct tls_ticket_key tls_ticket_keys[TLS_TICKET_KEY_MAX_COUNT];
+static unsigned int tls_ticket_key_count = 0;
+static unsigned int tls_ticket_key_max_count = TLS_TICKET_KEY_DEFAULT_COUNT;
+static int tls_ticket_key_max_age = TLS_TICKET_KEY_DEFAULT_AGE;
+static int tls_ticket_key_timerno = -1;
+
+/* Set by the ticket key callback when a ticket is successfully decrypted
+ * during the current handshake.
+ */
+static int tls_ticket_key_used = FALSE;
+
+/* Handshake statistics for this session, logged at session end. */
+static struct {
+  unsigned int count;
+  unsigned int resumed;
+  unsigned int ticket_resumed;
+  unsigned long cpu_usecs;
+} tls_handshake_stats;
+
+/* Handshake latency histograms, shared by all session processes, and
+ * reported by the "tls handshakes" control action.  The buckets are 1 ms
+ * wide below 10 ms, then 10 ms wide below 100 ms, 100 ms wide below 1 sec,
+ * and 1 sec wide below 10 secs; the last bucket holds everything slower.
+ *
+ * The counters are updated without locking; under contention an update may
+ * occasionally be lost, which is acceptable for these statistics.
+ */
+#define TLS_HANDSHAKE_HIST_NBUCKETS	38
+
+struct tls_handshake_hist {
+  unsigned long count;
+  unsigned long max_msecs;
+  unsigned long buckets[TLS_HANDSHAKE_HIST_NBUCKETS];
+};
+
+struct tls_shared_stats {
+  time_t since;
+
+  struct tls_handshake_hist full;
+  struct tls_handshake_hist resumed;
+
+  unsigned long key_worker_requests;
+  unsigned long key_worker_timeouts;
+  unsigned long key_worker_fallbacks;
+};
+
+static struct tls_shared_stats *tls_shared_stats = NULL;
+
+/* The shared statistics are updated by many session processes at once, so
+ * use atomic operations where the compiler provides them; otherwise, the
+ * numbers are only approximate.
+ */
+#if defined(__GNUC__) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 1))
+# define TLS_USE_ATOMIC_STATS
+# define TLS_STATS_INCR(v)	(void) __sync_fetch_and_add(&(v), 1)
+#else
+# define TLS_STATS_INCR(v)	(v)++
+#endif
+
+/* Key workers
+ *
+ * When TLSKeyWorkers is configured, the daemon process forks a small pool of
+ * key worker processes, which hold the RSA server keys.  The session
+ * processes send their RSA private key operations to the workers, rather
+ * than doing them themselves, so that a storm of new connections cannot
+ * occupy more CPUs with handshakes than there are workers.
+ *
+ * Requests are datagrams on a single socket pair, shared by all of the
+ * processes; each worker takes the next request from the queue.  Each
+ * request carries its own reply socket (via SCM_RIGHTS).  The queue is
+ * bounded by the socket buffer; once it is full, the session processes wait
+ * (up to the configured timeout) to enqueue their requests.
+ */
+#if OPENSSL_VERSION_NUMBER >= 0x10002000L && \
+    defined(SCM_RIGHTS)
+# define TLS_USE_KEY_WORKERS
+#endif
+
+#define TLS_KEY_WORKER_MAX_COUNT		64
+#define TLS_KEY_WORKER_DEFAULT_TIMEOUT		5
+
+#ifdef TLS_USE_KEY_WORKERS
+/* Large enough for 8192-bit RSA keys. */
+#define TLS_KEY_WORKER_MAX_DATALEN		1024
+
+#define TLS_KEY_WORKER_OP_PRIV_ENC		1
+#define TLS_KEY_WORKER_OP_PRIV_DEC		2
+
+struct tls_key_worker_req {
+  unsigned char key_id[SHA_DIGEST_LENGTH];
+  int op;
+  int padding;
+  int datalen;
+  unsigned char data[TLS_KEY_WORKER_MAX_DATALEN];
+};
+
+struct tls_key_worker_resp {
+  int res;
+  unsigned char data[TLS_KEY_WORKER_MAX_DATALEN];
+};
+
+struct tls_key_worker_key {
+  struct tls_key_worker_key *next;
+  unsigned char key_id[SHA_DIGEST_LENGTH];
+  RSA *rsa;
+};
+
+static RSA_METHOD *tls_key_worker_rsa_meth = NULL;
+#endif /* TLS_USE_KEY_WORKERS */
+
+static unsigned int tls_key_worker_count = 0;
+static int tls_key_worker_timeout = TLS_KEY_WORKER_DEFAULT_TIMEOUT;
+static pid_t tls_key_worker_pids[TLS_KEY_WORKER_MAX_COUNT];
+static unsigned int tls_key_worker_npids = 0;
+
+/* The request queue: workers read from [0], session processes write to
+ * [1].
+ */
+static int tls_key_worker_fds[2] = { -1, -1 };
+
+static int tls_key_workers_restarting = FALSE;
+
+/* OCSP
+ *
+ * Verified responses from OCSP responders are cached, keyed by the cert ID,
+ * as files in the TLSOCSPCache directory; the session processes thus share
+ * the responses, and only query the responder once the cached response for
+ * a cert is no longer valid (see its nextUpdate time).
+ *
+ * For OCSP stapling, the daemon process fetches the responses for the
+ * configured server certs, and refreshes them before they expire; the
+ * session processes inherit these responses when forked.
+ */
+static SSL_CTX *tls_ocsp_ssl_ctx = NULL;
+
+#if defined(SSL_CTRL_SET_TLSEXT_STATUS_REQ_CB) && \
+    OPENSSL_VERSION_NUMBER >= 0x10000000L
+# define TLS_USE_OCSP_STAPLING	1
+#endif /* SSL_CTRL_SET_TLSEXT_STATUS_REQ_CB */
+
+/* How often the daemon checks whether stapled responses need refreshing,
+ * and how long before their nextUpdate time they are refreshed.
+ */
+#define TLS_OCSP_STAPLING_INTERVAL_SECS		60
+#define TLS_OCSP_STAPLING_REFRESH_SECS		300
+
+#ifdef TLS_USE_OCSP_STAPLING
+struct tls_ocsp_staple {
+  struct tls_ocsp_staple *next;
+  server_rec *server;
+  const char *url;
+  const char *subj_name;
+  X509 *cert;
+  OCSP_CERTID *cert_id;
+  OCSP_RESPONSE *resp;
+  time_t fetched;
+};
+
+static pool *tls_ocsp_staple_pool = NULL;
+static struct tls_ocsp_staple *tls_ocsp_staples = NULL;
+static int tls_ocsp_staple_timerno = -1;
+
+static int tls_ocsp_stapling_cb(SSL *, void *);
+#endif /* TLS_USE_OCSP_STAPLING */
+
 #ifdef PR_USE_CTRLS
 static pool *tls_act_pool = NULL;
 static ctrls_acttab_t tls_acttab[];
@@ -581,7 +847,11 @@ static void tls_diags_cb(const SSL *ssl, int where, int ret) {
     int ssl_state;
 
     ssl_state = SSL_get_state(ssl);
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+    if (ssl_state == TLS_ST_OK) {
+#else
     if (ssl_state == SSL_ST_OK) {
+#endif /* OpenSSL-1.1.0 and later */
       str = "ok";
     }
   }
@@ -591,8 +861,12 @@ static void tls_diags_cb(const SSL *ssl, int where, int ret) {
 
     ssl_state = SSL_get_state(ssl);
 
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+    if (ssl_state == TLS_ST_SR_CLNT_HELLO) {
+#else
     if (ssl_state == SSL3_ST_SR_CLNT_HELLO_A ||
         ssl_state == SSL23_ST_SR_CLNT_HELLO_A) {
+#endif /* OpenSSL-1.1.0 and later */
 
       /* If we have already completed our initial handshake, then this might
        * a session renegotiation.
@@ -618,8 +892,8 @@ static void tls_diags_cb(const SSL *ssl, int where, int ret) {
               "aborting connection");
 
             tls_end_sess(ctrl_ssl, PR_NETIO_STRM_CTRL, 0);
-            pr_table_remove(tls_ctrl_rd_nstrm->notes, TLS_NETIO_NOTE, NULL);
-            pr_table_remove(tls_ctrl_wr_nstrm->notes, TLS_NETIO_NOTE, NULL);
+            tls_netio_clear_ssl(tls_ctrl_rd_nstrm);
+            tls_netio_clear_ssl(tls_ctrl_wr_nstrm);
             ctrl_ssl = NULL;
 
             pr_session_disconnect(&tls_module, PR_SESS_DISCONNECT_CONFIG_ACL,
@@ -628,7 +902,11 @@ static void tls_diags_cb(const SSL *ssl, int where, int ret) {
         }
       }
 
-#if OPENSSL_VERSION_NUMBER >= 0x009080cfL
+#if OPENSSL_VERSION_NUMBER >= 0x009080cfL && \
+    OPENSSL_VERSION_NUMBER < 0x10100000L
+    /* In OpenSSL-1.1.0 and later, a renegotiation is seen as a ClientHello,
+     * as handled above.
+     */
     } else if (ssl_state & SSL_ST_RENEGOTIATE) {
       if ((ssl == ctrl_ssl && !tls_ctrl_need_init_handshake) ||
           (ssl != ctrl_ssl && !tls_data_need_init_handshake)) {
@@ -654,8 +932,8 @@ static void tls_diags_cb(const SSL *ssl, int where, int ret) {
               "aborting connection");
 
             tls_end_sess(ctrl_ssl, PR_NETIO_STRM_CTRL, 0);
-            pr_table_remove(tls_ctrl_rd_nstrm->notes, TLS_NETIO_NOTE, NULL);
-            pr_table_remove(tls_ctrl_wr_nstrm->notes, TLS_NETIO_NOTE, NULL);
+            tls_netio_clear_ssl(tls_ctrl_rd_nstrm);
+            tls_netio_clear_ssl(tls_ctrl_wr_nstrm);
             ctrl_ssl = NULL;
 
             pr_session_disconnect(&tls_module, PR_SESS_DISCONNECT_CONFIG_ACL,
@@ -2357,8 +2635,8 @@ static int tls_renegotiate_timeout_cb(CALLBACK_FRAME) {
       tls_log("%s", "requested TLS renegotiation timed out on control channel");
       tls_log("%s", "shutting down control channel TLS session");
       tls_end_sess(ctrl_ssl, PR_NETIO_STRM_CTRL, 0);
-      pr_table_remove(tls_ctrl_rd_nstrm->notes, TLS_NETIO_NOTE, NULL);
-      pr_table_remove(tls_ctrl_wr_nstrm->notes, TLS_NETIO_NOTE, NULL);
+      tls_netio_clear_ssl(tls_ctrl_rd_nstrm);
+      tls_netio_clear_ssl(tls_ctrl_wr_nstrm);
       ctrl_ssl = NULL;
     }
   }
@@ -2367,7 +2645,7 @@ static int tls_renegotiate_timeout_cb(CALLBACK_FRAME) {
       (tls_flags & TLS_SESS_DATA_RENEGOTIATING)) {
     SSL *ssl;
 
-    ssl = pr_table_get(tls_data_wr_nstrm->notes, TLS_NETIO_NOTE, NULL);
+    ssl = tls_netio_get_ssl(tls_data_wr_nstrm);
     if (!SSL_renegotiate_pending(ssl)) {
       tls_log("%s", "data channel TLS session renegotiated");
       tls_flags &= ~TLS_SESS_DATA_RENEGOTIATING;
@@ -2376,8 +2654,8 @@ static int tls_renegotiate_timeout_cb(CALLBACK_FRAME) {
       tls_log("%s", "requested TLS renegotiation timed out on data channel");
       tls_log("%s", "shutting down data channel TLS session");
       tls_end_sess(ssl, PR_NETIO_STRM_DATA, 0);
-      pr_table_remove(tls_data_rd_nstrm->notes, TLS_NETIO_NOTE, NULL);
-      pr_table_remove(tls_data_wr_nstrm->notes, TLS_NETIO_NOTE, NULL);
+      tls_netio_clear_ssl(tls_data_rd_nstrm);
+      tls_netio_clear_ssl(tls_data_wr_nstrm);
     }
   }
 
@@ -2441,8 +2719,8 @@ static DH *tls_dh_cb(SSL *ssl, int is_export, int keylen) {
    */
   pkey = SSL_get_privatekey(ssl);
   if (pkey != NULL) {
-    if (EVP_PKEY_type(pkey->type) == EVP_PKEY_RSA ||
-        EVP_PKEY_type(pkey->type) == EVP_PKEY_DSA) {
+    if (EVP_PKEY_type(EVP_PKEY_id(pkey)) == EVP_PKEY_RSA ||
+        EVP_PKEY_type(EVP_PKEY_id(pkey)) == EVP_PKEY_DSA) {
       pkeylen = EVP_PKEY_bits(pkey);
 
       if (pkeylen < TLS_DH_MIN_LEN) {
@@ -2596,7 +2874,10 @@ static DH *tls_dh_cb(SSL *ssl, int is_export, int keylen) {
   return dh;
 }
 
-#ifdef PR_USE_OPENSSL_ECC
+/* OpenSSL-1.1.x and later choose the ECDH curve automatically, and no
+ * longer have the tmp ECDH callback.
+ */
+#if defined(PR_USE_OPENSSL_ECC) && OPENSSL_VERSION_NUMBER < 0x10100000L
 static EC_KEY *tls_ecdh_cb(SSL *ssl, int is_export, int keylen) {
   static EC_KEY *ecdh = NULL;
   static int init = 0;
@@ -2617,7 +2898,7 @@ static EC_KEY *tls_ecdh_cb(SSL *ssl, int is_export, int keylen) {
 
   return ecdh;
 }
-#endif /* PR_USE_OPENSSL_ECC */
+#endif /* PR_USE_OPENSSL_ECC and older than OpenSSL-1.1.x */
 
 /* Post 0.9.7a, RSA blinding is turned on by default, so there is no need to
  * do this manually.
@@ -2661,98 +2942,317 @@ static void tls_blinding_on(SSL *ssl) {
 }
 #endif
 
-static int tls_init_ctx(void) {
-  config_rec *c;
-  int ssl_opts = tls_ssl_opts;
-  long ssl_mode = 0;
-
-  if (pr_define_exists("TLS_USE_FIPS") &&
-      ServerType == SERVER_INETD) {
-#ifdef OPENSSL_FIPS
-    if (!FIPS_mode()) {
-      /* Make sure OpenSSL is set to use the default RNG, as per an email
-       * discussion on the OpenSSL developer list:
-       *
-       *  "The internal FIPS logic uses the default RNG to see the FIPS RNG
-       *   as part of the self test process..."
-       */
-      RAND_set_rand_method(NULL);
-
-      if (!FIPS_mode_set(1)) {
-        const char *errstr;
+static void tls_ticket_keys_scrub(void) {
+  pr_memscrub(tls_ticket_keys, sizeof(tls_ticket_keys));
+  tls_ticket_key_count = 0;
+}
 
-        errstr = tls_get_errors();
-        tls_log("unable to use FIPS mode: %s", errstr);
-        pr_log_pri(PR_LOG_ERR, MOD_TLS_VERSION
-          ": unable to use FIPS mode: %s", errstr);
+#ifdef TLS_USE_SESSION_TICKETS
+static int tls_ticket_key_rotate(void) {
+  struct tls_ticket_key *k;
 
-        errno = EPERM;
-        return -1;
+  if (tls_ticket_key_count == tls_ticket_key_max_count &&
+      tls_ticket_key_count > 0) {
+    /* Drop the oldest key. */
+    pr_memscrub(&(tls_ticket_keys[tls_ticket_key_count-1]),
+      sizeof(struct tls_ticket_key));
+    tls_ticket_key_count--;
+  }
 
-      } else {
-        pr_log_pri(PR_LOG_NOTICE, MOD_TLS_VERSION ": FIPS mode enabled");
-      }
+  memmove(&(tls_ticket_keys[1]), &(tls_ticket_keys[0]),
+    sizeof(struct tls_ticket_key) * tls_ticket_key_count);
 
-    } else {
-      pr_log_pri(PR_LOG_DEBUG, MOD_TLS_VERSION ": FIPS mode already enabled");
-    }
-#else
-    pr_log_pri(PR_LOG_WARNING, MOD_TLS_VERSION ": FIPS mode requested, but " OPENSSL_VERSION_TEXT " not built with FIPS support");
-#endif /* OPENSSL_FIPS */
-  }
+  k = &(tls_ticket_keys[0]);
+  if (RAND_bytes(k->key_name, sizeof(k->key_name)) != 1 ||
+      RAND_bytes(k->cipher_key, sizeof(k->cipher_key)) != 1 ||
+      RAND_bytes(k->hmac_key, sizeof(k->hmac_key)) != 1) {
+    pr_log_pri(PR_LOG_WARNING, MOD_TLS_VERSION
+      ": error generating session ticket key: %s", tls_get_errors());
 
-  if (ssl_ctx != NULL) {
-    SSL_CTX_free(ssl_ctx);
-    ssl_ctx = NULL;
-  }
+    memmove(&(tls_ticket_keys[0]), &(tls_ticket_keys[1]),
+      sizeof(struct tls_ticket_key) * tls_ticket_key_count);
+    pr_memscrub(&(tls_ticket_keys[tls_ticket_key_count]),
+      sizeof(struct tls_ticket_key));
 
-  ssl_ctx = SSL_CTX_new(SSLv23_server_method());
-  if (ssl_ctx == NULL) {
-    pr_log_debug(DEBUG0, MOD_TLS_VERSION ": error: SSL_CTX_new(): %s",
-      tls_get_errors());
+    errno = EPERM;
     return -1;
   }
 
-#if OPENSSL_VERSION_NUMBER > 0x000906000L
-  /* The SSL_MODE_AUTO_RETRY mode was added in 0.9.6. */
-  ssl_mode |= SSL_MODE_AUTO_RETRY;
-#endif
+  k->created = time(NULL);
+  tls_ticket_key_count++;
 
-#if OPENSSL_VERSION_NUMBER >= 0x1000001fL
-  /* The SSL_MODE_RELEASE_BUFFERS mode was added in 1.0.0a. */
-  ssl_mode |= SSL_MODE_RELEASE_BUFFERS;
-#endif
+  pr_log_debug(DEBUG5, MOD_TLS_VERSION
+    ": generated new session ticket key (%u of %u %s kept)",
+    tls_ticket_key_count, tls_ticket_key_max_count,
+    tls_ticket_key_max_count != 1 ? "keys" : "key");
+  return 0;
+}
 
-  if (ssl_mode != 0) {
-    SSL_CTX_set_mode(ssl_ctx, ssl_mode);
-  }
+static int tls_ticket_key_timer_cb(CALLBACK_FRAME) {
+  (void) tls_ticket_key_rotate();
 
-  /* If using OpenSSL-0.9.7 or greater, prevent session resumptions on
-   * renegotiations (more secure).
-   */
-#if OPENSSL_VERSION_NUMBER > 0x000907000L
-  ssl_opts |= SSL_OP_NO_SESSION_RESUMPTION_ON_RENEGOTIATION;
-#endif
+  /* Always restart the timer. */
+  return 1;
+}
 
-  /* Disable SSL tickets, for now. */
-#ifdef SSL_OP_NO_TICKET
-  ssl_opts |= SSL_OP_NO_TICKET;
-#endif
+static int tls_ticket_key_cb(SSL *ssl, unsigned char *key_name,
+    unsigned char *iv, EVP_CIPHER_CTX *cipher_ctx, HMAC_CTX *hmac_ctx,
+    int enc) {
+  register unsigned int i;
+  struct tls_ticket_key *k = NULL;
 
-  /* Disable SSL compression. */
-#ifdef SSL_OP_NO_COMPRESSION
-  ssl_opts |= SSL_OP_NO_COMPRESSION;
-#endif /* SSL_OP_NO_COMPRESSION */
+  if (enc == 1) {
+    /* Encrypt a new ticket, using the newest key. */
+    if (tls_ticket_key_count == 0) {
+      pr_trace_msg(trace_channel, 3, "%s",
+        "no session ticket keys available, not issuing ticket");
+      return 0;
+    }
 
-#ifdef SSL_OP_CIPHER_SERVER_PREFERENCE
-  c = find_config(main_server->conf, CONF_PARAM, "TLSServerCipherPreference",
-    FALSE);
-  if (c != NULL) {
-    int use_server_pref;
+    k = &(tls_ticket_keys[0]);
 
-    use_server_pref = *((int *) c->argv[0]);
-    if (use_server_pref == TRUE) {
-      ssl_opts |= SSL_OP_CIPHER_SERVER_PREFERENCE;
+    if (RAND_bytes(iv, EVP_MAX_IV_LENGTH) != 1) {
+      tls_log("error generating session ticket IV: %s", tls_get_errors());
+      return -1;
+    }
+
+    memcpy(key_name, k->key_name, TLS_TICKET_NAME_LEN);
+    EVP_EncryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), NULL, k->cipher_key, iv);
+    HMAC_Init_ex(hmac_ctx, k->hmac_key, TLS_TICKET_KEY_LEN, EVP_sha256(),
+      NULL);
+
+    pr_trace_msg(trace_channel, 19, "%s", "issued session ticket");
+    return 1;
+  }
+
+  /* Decrypt a ticket presented by the client. */
+  for (i = 0; i < tls_ticket_key_count; i++) {
+    if (memcmp(key_name, tls_ticket_keys[i].key_name,
+        TLS_TICKET_NAME_LEN) == 0) {
+      k = &(tls_ticket_keys[i]);
+      break;
+    }
+  }
+
+  if (k == NULL) {
+    /* Unknown (or expired) key; a full handshake will be done. */
+    pr_trace_msg(trace_channel, 9, "%s",
+      "client presented session ticket for unknown key, ignoring");
+    return 0;
+  }
+
+  HMAC_Init_ex(hmac_ctx, k->hmac_key, TLS_TICKET_KEY_LEN, EVP_sha256(), NULL);
+  EVP_DecryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), NULL, k->cipher_key, iv);
+  tls_ticket_key_used = TRUE;
+
+  /* If the ticket was not encrypted using the newest key, ask OpenSSL to
+   * issue a new ticket, using the newest key.
+   */
+  return (i == 0 ? 1 : 2);
+}
+
+/* Sessions resumed from tickets are not found in the session cache, thus we
+ * check such data channel sessions against the control channel session by
+ * comparing their master secrets.
+ */
+static int tls_sess_master_key_matches(SSL_SESSION *ctrl_sess,
+    SSL_SESSION *data_sess) {
+  const unsigned char *ctrl_key, *data_key;
+  size_t ctrl_keylen, data_keylen;
+# if OPENSSL_VERSION_NUMBER >= 0x10100000L
+  unsigned char ctrl_buf[SSL_MAX_MASTER_KEY_LENGTH];
+  unsigned char data_buf[SSL_MAX_MASTER_KEY_LENGTH];
+  int res;
+
+  ctrl_keylen = SSL_SESSION_get_master_key(ctrl_sess, ctrl_buf,
+    sizeof(ctrl_buf));
+  data_keylen = SSL_SESSION_get_master_key(data_sess, data_buf,
+    sizeof(data_buf));
+  ctrl_key = ctrl_buf;
+  data_key = data_buf;
+# else
+  /* XXX Directly accessing these fields cannot be a Good Thing. */
+  ctrl_key = ctrl_sess->master_key;
+  ctrl_keylen = ctrl_sess->master_key_length;
+  data_key = data_sess->master_key;
+  data_keylen = data_sess->master_key_length;
+# endif
+
+  if (ctrl_keylen == 0 ||
+      ctrl_keylen != data_keylen) {
+    return FALSE;
+  }
+
+# if OPENSSL_VERSION_NUMBER >= 0x10100000L
+  res = (CRYPTO_memcmp(ctrl_key, data_key, ctrl_keylen) == 0);
+  pr_memscrub(ctrl_buf, sizeof(ctrl_buf));
+  pr_memscrub(data_buf, sizeof(data_buf));
+  return res;
+# else
+  return (CRYPTO_memcmp(ctrl_key, data_key, ctrl_keylen) == 0);
+# endif
+}
+#endif /* TLS_USE_SESSION_TICKETS */
+
+/* Generates the initial session ticket keys, and starts the rotation timer,
+ * in the daemon process.
+ */
+static void tls_ticket_keys_init(void) {
+  server_rec *s;
+  config_rec *c;
+  int use_tickets = FALSE;
+
+  for (s = (server_rec *) server_list->xas_list; s; s = s->next) {
+    c = find_config(s->conf, CONF_PARAM, "TLSSessionTickets", FALSE);
+    if (c != NULL &&
+        *((int *) c->argv[0]) == TRUE) {
+      use_tickets = TRUE;
+      break;
+    }
+  }
+
+  pr_timer_remove(tls_ticket_key_timerno, &tls_module);
+  tls_ticket_key_timerno = -1;
+
+  if (use_tickets == FALSE) {
+    tls_ticket_keys_scrub();
+    return;
+  }
+
+#ifdef TLS_USE_SESSION_TICKETS
+  tls_ticket_key_max_age = TLS_TICKET_KEY_DEFAULT_AGE;
+  tls_ticket_key_max_count = TLS_TICKET_KEY_DEFAULT_COUNT;
+
+  c = find_config(main_server->conf, CONF_PARAM, "TLSSessionTicketKeys",
+    FALSE);
+  if (c != NULL) {
+    tls_ticket_key_max_age = *((int *) c->argv[0]);
+    tls_ticket_key_max_count = *((unsigned int *) c->argv[1]);
+  }
+
+  /* On restarts, keep the existing keys, dropping any which are now in
+   * excess of the configured count.
+   */
+  while (tls_ticket_key_count > tls_ticket_key_max_count) {
+    tls_ticket_key_count--;
+    pr_memscrub(&(tls_ticket_keys[tls_ticket_key_count]),
+      sizeof(struct tls_ticket_key));
+  }
+
+  if (tls_ticket_key_count == 0) {
+    if (tls_ticket_key_rotate() < 0) {
+      return;
+    }
+  }
+
+  tls_ticket_key_timerno = pr_timer_add(tls_ticket_key_max_age, -1,
+    &tls_module, tls_ticket_key_timer_cb, "TLS session ticket key rotation");
+#else
+  pr_log_pri(PR_LOG_NOTICE, MOD_TLS_VERSION
+    ": TLSSessionTickets not supported (OpenSSL version is too old)");
+#endif /* TLS_USE_SESSION_TICKETS */
+}
+
+static int tls_init_ctx(void) {
+  config_rec *c;
+  int ssl_opts = tls_ssl_opts;
+  long ssl_mode = 0;
+
+  if (pr_define_exists("TLS_USE_FIPS") &&
+      ServerType == SERVER_INETD) {
+#ifdef OPENSSL_FIPS
+    if (!FIPS_mode()) {
+      /* Make sure OpenSSL is set to use the default RNG, as per an email
+       * discussion on the OpenSSL developer list:
+       *
+       *  "The internal FIPS logic uses the default RNG to see the FIPS RNG
+       *   as part of the self test process..."
+       */
+      RAND_set_rand_method(NULL);
+
+      if (!FIPS_mode_set(1)) {
+        const char *errstr;
+
+        errstr = tls_get_errors();
+        tls_log("unable to use FIPS mode: %s", errstr);
+        pr_log_pri(PR_LOG_ERR, MOD_TLS_VERSION
+          ": unable to use FIPS mode: %s", errstr);
+
+        errno = EPERM;
+        return -1;
+
+      } else {
+        pr_log_pri(PR_LOG_NOTICE, MOD_TLS_VERSION ": FIPS mode enabled");
+      }
+
+    } else {
+      pr_log_pri(PR_LOG_DEBUG, MOD_TLS_VERSION ": FIPS mode already enabled");
+    }
+#else
+    pr_log_pri(PR_LOG_WARNING, MOD_TLS_VERSION ": FIPS mode requested, but " OPENSSL_VERSION_TEXT " not built with FIPS support");
+#endif /* OPENSSL_FIPS */
+  }
+
+  if (ssl_ctx != NULL) {
+    SSL_CTX_free(ssl_ctx);
+    ssl_ctx = NULL;
+  }
+
+  ssl_ctx = SSL_CTX_new(SSLv23_server_method());
+  if (ssl_ctx == NULL) {
+    pr_log_debug(DEBUG0, MOD_TLS_VERSION ": error: SSL_CTX_new(): %s",
+      tls_get_errors());
+    return -1;
+  }
+
+#if OPENSSL_VERSION_NUMBER > 0x000906000L
+  /* The SSL_MODE_AUTO_RETRY mode was added in 0.9.6. */
+  ssl_mode |= SSL_MODE_AUTO_RETRY;
+#endif
+
+#if OPENSSL_VERSION_NUMBER >= 0x1000001fL
+  /* The SSL_MODE_RELEASE_BUFFERS mode was added in 1.0.0a. */
+  ssl_mode |= SSL_MODE_RELEASE_BUFFERS;
+#endif
+
+  if (ssl_mode != 0) {
+    SSL_CTX_set_mode(ssl_ctx, ssl_mode);
+  }
+
+  /* If using OpenSSL-0.9.7 or greater, prevent session resumptions on
+   * renegotiations (more secure).
+   */
+#if OPENSSL_VERSION_NUMBER > 0x000907000L
+  ssl_opts |= SSL_OP_NO_SESSION_RESUMPTION_ON_RENEGOTIATION;
+#endif
+
+  /* Disable SSL session tickets; they are enabled per-server, as
+   * configured, in tls_init_server().
+   */
+#ifdef SSL_OP_NO_TICKET
+  ssl_opts |= SSL_OP_NO_TICKET;
+#endif
+
+#ifdef TLS_USE_SESSION_TICKETS
+  if (tls_ticket_key_count > 0) {
+    SSL_CTX_set_tlsext_ticket_key_cb(ssl_ctx, tls_ticket_key_cb);
+  }
+#endif /* TLS_USE_SESSION_TICKETS */
+
+  /* Disable SSL compression. */
+#ifdef SSL_OP_NO_COMPRESSION
+  ssl_opts |= SSL_OP_NO_COMPRESSION;
+#endif /* SSL_OP_NO_COMPRESSION */
+
+#ifdef SSL_OP_CIPHER_SERVER_PREFERENCE
+  c = find_config(main_server->conf, CONF_PARAM, "TLSServerCipherPreference",
+    FALSE);
+  if (c != NULL) {
+    int use_server_pref;
+
+    use_server_pref = *((int *) c->argv[0]);
+    if (use_server_pref == TRUE) {
+      ssl_opts |= SSL_OP_CIPHER_SERVER_PREFERENCE;
     }
   }
 #endif /* SSL_OP_CIPHER_SERVER_PREFERENCE */
@@ -2868,9 +3368,9 @@ static int tls_init_ctx(void) {
   }
 
   SSL_CTX_set_tmp_dh_callback(ssl_ctx, tls_dh_cb);
-#ifdef PR_USE_OPENSSL_ECC
+#if defined(PR_USE_OPENSSL_ECC) && OPENSSL_VERSION_NUMBER < 0x10100000L
   SSL_CTX_set_tmp_ecdh_callback(ssl_ctx, tls_ecdh_cb);
-#endif /* PR_USE_OPENSSL_ECC */
+#endif /* PR_USE_OPENSSL_ECC and older than OpenSSL-1.1.x */
 
   if (tls_seed_prng() < 0) {
     pr_log_debug(DEBUG1, MOD_TLS_VERSION ": unable to properly seed PRNG");
@@ -2980,6 +3480,30 @@ static int tls_init_server(void) {
     enabled_proto_count != 1 ? "protocols" : "protocol only");
   SSL_CTX_set_options(ssl_ctx, disabled_proto);
 
+#ifdef TLS_USE_SESSION_TICKETS
+  c = find_config(main_server->conf, CONF_PARAM, "TLSSessionTickets", FALSE);
+  if (c != NULL &&
+      *((int *) c->argv[0]) == TRUE) {
+    if (tls_ticket_key_count > 0) {
+      pr_log_debug(DEBUG8, MOD_TLS_VERSION ": enabling session tickets");
+      SSL_CTX_clear_options(ssl_ctx, SSL_OP_NO_TICKET);
+
+    } else {
+      pr_log_debug(DEBUG3, MOD_TLS_VERSION
+        ": no session ticket keys available, disabling session tickets");
+    }
+  }
+#endif /* TLS_USE_SESSION_TICKETS */
+
+#ifdef TLS_USE_OCSP_STAPLING
+  c = find_config(main_server->conf, CONF_PARAM, "TLSStapling", FALSE);
+  if (c != NULL &&
+      *((int *) c->argv[0]) == TRUE) {
+    pr_log_debug(DEBUG8, MOD_TLS_VERSION ": enabling OCSP stapling");
+    SSL_CTX_set_tlsext_status_cb(ssl_ctx, tls_ocsp_stapling_cb);
+  }
+#endif /* TLS_USE_OCSP_STAPLING */
+
   tls_ca_cert = get_param_ptr(main_server->conf, "TLSCACertificateFile", FALSE);
   tls_ca_path = get_param_ptr(main_server->conf, "TLSCACertificatePath", FALSE);
 
@@ -3152,8 +3676,8 @@ static int tls_init_server(void) {
       return -1;
     }
 
-    cert = PEM_read_X509(fh, NULL, ssl_ctx->default_passwd_callback,
-      ssl_ctx->default_passwd_callback_userdata);
+    cert = PEM_read_X509(fh, NULL, SSL_CTX_get_default_passwd_cb(ssl_ctx),
+      SSL_CTX_get_default_passwd_cb_userdata(ssl_ctx));
     if (cert == NULL) {
       PRIVS_RELINQUISH
       tls_log("error reading TLSRSACertificateFile '%s': %s", tls_rsa_cert_file,
@@ -3208,6 +3732,8 @@ static int tls_init_server(void) {
         tls_rsa_key_file, tls_get_errors());
       return -1;
     }
+
+    tls_key_worker_attach(ssl_ctx);
   }
 
   if (tls_dsa_cert_file != NULL) {
@@ -3225,8 +3751,8 @@ static int tls_init_server(void) {
       return -1;
     }
 
-    cert = PEM_read_X509(fh, NULL, ssl_ctx->default_passwd_callback,
-      ssl_ctx->default_passwd_callback_userdata);
+    cert = PEM_read_X509(fh, NULL, SSL_CTX_get_default_passwd_cb(ssl_ctx),
+      SSL_CTX_get_default_passwd_cb_userdata(ssl_ctx));
     if (cert == NULL) {
       PRIVS_RELINQUISH
       tls_log("error reading TLSDSACertificateFile '%s': %s", tls_dsa_cert_file,
@@ -3298,8 +3824,8 @@ static int tls_init_server(void) {
       return -1;
     }
 
-    cert = PEM_read_X509(fh, NULL, ssl_ctx->default_passwd_callback,
-      ssl_ctx->default_passwd_callback_userdata);
+    cert = PEM_read_X509(fh, NULL, SSL_CTX_get_default_passwd_cb(ssl_ctx),
+      SSL_CTX_get_default_passwd_cb_userdata(ssl_ctx));
     if (cert == NULL) {
       PRIVS_RELINQUISH
       tls_log("error reading TLSECCertificateFile '%s': %s", tls_ec_cert_file,
@@ -3435,7 +3961,7 @@ static int tls_init_server(void) {
 
     if (pkey &&
         tls_pkey) {
-      switch (EVP_PKEY_type(pkey->type)) {
+      switch (EVP_PKEY_type(EVP_PKEY_id(pkey))) {
         case EVP_PKEY_RSA:
           tls_pkey->flags |= TLS_PKEY_USE_RSA;
           tls_pkey->flags &= ~(TLS_PKEY_USE_DSA|TLS_PKEY_USE_EC);
@@ -3496,7 +4022,7 @@ static int tls_init_server(void) {
      * pointer around until after the handling of a cert chain file.
      */
     if (pkey != NULL) {
-      switch (EVP_PKEY_type(pkey->type)) {
+      switch (EVP_PKEY_type(EVP_PKEY_id(pkey))) {
         case EVP_PKEY_RSA:
           server_rsa_cert = cert;
           break;
@@ -3631,37 +4157,24 @@ static int tls_init_server(void) {
   }
 #endif /* PR_USE_OPENSSL_ECC */
 
-  /* Set up the CRL. */
-  if (tls_crl_file || tls_crl_path) {
-    tls_crl_store = X509_STORE_new();
-    if (tls_crl_store == NULL) {
-      tls_log("error creating CRL store: %s", tls_get_errors());
-      return -1;
-    }
-
-    if (X509_STORE_load_locations(tls_crl_store, tls_crl_file,
-        tls_crl_path) == 0) {
-
-      if (tls_crl_file && !tls_crl_path) {
-        tls_log("error loading TLSCARevocationFile '%s': %s",
-          tls_crl_file, tls_get_errors());
-
-      } else if (!tls_crl_file && tls_crl_path) {
-        tls_log("error loading TLSCARevocationPath '%s': %s",
-          tls_crl_path, tls_get_errors());
+  PRIVS_RELINQUISH
 
-      } else {
-        tls_log("error loading TLSCARevocationFile '%s', "
-          "TLSCARevocationPath '%s': %s", tls_crl_file, tls_crl_path,
-          tls_get_errors());
-      }
-    }
+  /* Set up the CRLs, using the indices built by the daemon process. */
+  if (tls_crl_file || tls_crl_path) {
+    tls_crl_set = tls_crl_set_get(tls_crl_file, tls_crl_path);
+    tls_log("using %u %s (%lu revoked %s) for verifying certificates",
+      tls_crl_set->ncrls, tls_crl_set->ncrls != 1 ? "CRLs" : "CRL",
+      tls_crl_set->nrevoked,
+      tls_crl_set->nrevoked != 1 ? "serials" : "serial");
   }
 
-  PRIVS_RELINQUISH
-
   SSL_CTX_set_cipher_list(ssl_ctx, tls_cipher_suite);
 
+  if ((tls_opts & TLS_OPT_PREFER_ECDSA) &&
+      tls_ec_cert_file != NULL) {
+    tls_prefer_ecdsa(ssl_ctx);
+  }
+
 #if OPENSSL_VERSION_NUMBER > 0x000907000L
   /* Lookup/process any configured TLSRenegotiate parameters. */
   c = find_config(main_server->conf, CONF_PARAM, "TLSRenegotiate", FALSE);
@@ -3710,86 +4223,940 @@ static int tls_get_block(conn_t *conn) {
   return TRUE;
 }
 
-static int tls_accept(conn_t *conn, unsigned char on_data) {
-  int blocking, res = 0, xerrno = 0;
-  long cache_mode = 0;
-  char *subj = NULL;
-  static unsigned char logged_data = FALSE;
-  SSL *ssl = NULL;
-  BIO *rbio = NULL, *wbio = NULL;
+/* Determine whether OpenSSL was able to offload the record encryption for
+ * the data connection to the kernel (kTLS).  If so, the data write stream is
+ * marked, letting mod_xfer use sendfile(2) for downloads, as the kernel will
+ * then produce the TLS records itself.
+ */
+static void tls_setup_ktls(SSL *ssl) {
+#ifdef SSL_OP_ENABLE_KTLS
+  if (BIO_get_ktls_send(SSL_get_wbio(ssl))) {
+    if (pr_table_add(tls_data_wr_nstrm->notes,
+        pstrdup(tls_data_wr_nstrm->strm_pool, TLS_KTLS_TX_NOTE),
+        "TRUE", 0) < 0) {
+      pr_trace_msg(trace_channel, 3, "error stashing '%s' note: %s",
+        TLS_KTLS_TX_NOTE, strerror(errno));
 
-  if (!ssl_ctx) {
-    tls_log("%s", "unable to start session: null SSL_CTX");
-    return -1;
-  }
+    } else {
+      struct tls_netio_strm *ts;
 
-  ssl = SSL_new(ssl_ctx);
-  if (ssl == NULL) {
-    tls_log("error: unable to start session: %s",
-      ERR_error_string(ERR_get_error(), NULL));
-    return -2;
-  }
+      ts = tls_data_wr_nstrm->strm_data;
+      if (ts != NULL) {
+        ts->ktls_tx = TRUE;
+      }
 
-  /* This works with either rfd or wfd (I hope). */
-  rbio = BIO_new_socket(conn->rfd, FALSE);
-  wbio = BIO_new_socket(conn->wfd, FALSE);
-  SSL_set_bio(ssl, rbio, wbio);
+      pr_trace_msg(trace_channel, 9,
+        "using kernel TLS (kTLS) for sending data using cipher %s",
+        SSL_get_cipher_name(ssl));
+    }
 
-  /* If configured, set a timer for the handshake. */
-  if (tls_handshake_timeout) {
-    tls_handshake_timer_id = pr_timer_add(tls_handshake_timeout, -1,
-      &tls_module, tls_handshake_timeout_cb, "SSL/TLS handshake");
+  } else {
+    pr_trace_msg(trace_channel, 9,
+      "kernel TLS (kTLS) not available for sending data using %s cipher %s",
+      SSL_get_version(ssl), SSL_get_cipher_name(ssl));
   }
+#endif /* SSL_OP_ENABLE_KTLS */
+}
 
-  if (on_data) {
+/* Handshake latency statistics */
 
-    /* Make sure that TCP_NODELAY is enabled for the handshake. */
-    pr_inet_set_proto_nodelay(conn->pool, conn, 1);
+static void tls_shared_stats_init(void) {
+#if defined(HAVE_SYS_MMAN_H) && (defined(MAP_ANON) || defined(MAP_ANONYMOUS))
+  void *ptr;
+# ifndef MAP_ANON
+#  define MAP_ANON	MAP_ANONYMOUS
+# endif /* MAP_ANON */
 
-    /* Make sure that TCP_CORK (aka TCP_NOPUSH) is DISABLED for the handshake.
-     * This socket option is set via the pr_inet_set_proto_opts() call made
-     * in mod_core, upon handling the PASV/EPSV command.
-     */
-    (void) pr_inet_set_proto_cork(conn->wfd, 0);
+  if (tls_shared_stats != NULL) {
+    /* Keep the statistics across restarts. */
+    return;
+  }
 
-    cache_mode = SSL_CTX_get_session_cache_mode(ssl_ctx);
-    if (!(cache_mode & SSL_SESS_CACHE_OFF)) {
-      /* Disable STORING of any new session IDs in the session cache. We DO
-       * want to allow LOOKUP of session IDs in the session cache, however.
-       */
-      long data_cache_mode;
-      data_cache_mode = SSL_SESS_CACHE_SERVER|SSL_SESS_CACHE_NO_INTERNAL_STORE;
-      SSL_CTX_set_session_cache_mode(ssl_ctx, data_cache_mode);
-    }
+  /* Created by the daemon process, and inherited by the session processes;
+   * the mapping is shared, so their updates are visible to the daemon.
+   */
+  ptr = mmap(NULL, sizeof(struct tls_shared_stats), PROT_READ|PROT_WRITE,
+    MAP_SHARED|MAP_ANON, -1, 0);
+  if (ptr == MAP_FAILED) {
+    pr_log_debug(DEBUG0, MOD_TLS_VERSION
+      ": error allocating shared handshake statistics: %s", strerror(errno));
+    return;
   }
 
-  retry:
+  tls_shared_stats = ptr;
+  memset(tls_shared_stats, 0, sizeof(struct tls_shared_stats));
+  tls_shared_stats->since = time(NULL);
+#endif /* HAVE_SYS_MMAN_H */
+}
 
-  blocking = tls_get_block(conn);
-  if (blocking) {
-    /* Put the connection in non-blocking mode for the duration of the
-     * SSL handshake.  This lets us handle EAGAIN/retries better (i.e.
-     * without spinning in a tight loop and consuming the CPU).
-     */
-    pr_inet_set_nonblock(conn->pool, conn);
+static unsigned int tls_handshake_hist_bucket(unsigned long msecs) {
+  if (msecs < 10) {
+    return msecs;
   }
 
-  pr_signals_handle();
-  res = SSL_accept(ssl);
-  if (res == -1) {
-    xerrno = errno;
+  if (msecs < 100) {
+    return 9 + (msecs / 10);
   }
 
-  if (blocking) {
-    /* Return the connection to blocking mode. */
-    pr_inet_set_block(conn->pool, conn);
+  if (msecs < 1000) {
+    return 18 + (msecs / 100);
   }
 
-  if (res < 1) {
-    const char *msg = "unable to accept TLS connection";
-    int errcode = SSL_get_error(ssl, res);
+  if (msecs < 10000) {
+    return 27 + (msecs / 1000);
+  }
 
-    pr_signals_handle();
+  return TLS_HANDSHAKE_HIST_NBUCKETS - 1;
+}
+
+/* Returns the (exclusive) upper bound, in millisecs, of the given bucket. */
+static unsigned long tls_handshake_hist_bound(unsigned int i) {
+  if (i < 10) {
+    return i + 1;
+  }
+
+  if (i < 19) {
+    return (i - 8) * 10;
+  }
+
+  if (i < 28) {
+    return (i - 17) * 100;
+  }
+
+  return (i - 26) * 1000;
+}
+
+static void tls_handshake_hist_add(struct tls_handshake_hist *hist,
+    unsigned long msecs) {
+  unsigned long max_msecs;
+
+  TLS_STATS_INCR(hist->count);
+  TLS_STATS_INCR(hist->buckets[tls_handshake_hist_bucket(msecs)]);
+
+  max_msecs = hist->max_msecs;
+  while (msecs > max_msecs) {
+#ifdef TLS_USE_ATOMIC_STATS
+    if (__sync_bool_compare_and_swap(&(hist->max_msecs), max_msecs, msecs)) {
+      break;
+    }
+
+    max_msecs = hist->max_msecs;
+#else
+    hist->max_msecs = msecs;
+    break;
+#endif /* TLS_USE_ATOMIC_STATS */
+  }
+}
+
+/* Returns the upper bound, in millisecs, of the given percentile. */
+static unsigned long tls_handshake_hist_percentile(
+    struct tls_handshake_hist *hist, unsigned int pct) {
+  register unsigned int i;
+  unsigned long target, seen = 0;
+
+  target = ((hist->count * pct) + 99) / 100;
+
+  for (i = 0; i < TLS_HANDSHAKE_HIST_NBUCKETS - 1; i++) {
+    seen += hist->buckets[i];
+    if (seen >= target) {
+      unsigned long bound;
+
+      bound = tls_handshake_hist_bound(i);
+      return bound < hist->max_msecs + 1 ? bound : hist->max_msecs + 1;
+    }
+  }
+
+  return hist->max_msecs + 1;
+}
+
+/* Key workers */
+
+#ifdef TLS_USE_KEY_WORKERS
+static int tls_key_worker_get_key_id(RSA *rsa, unsigned char *key_id) {
+  const BIGNUM *n;
+  unsigned char *buf;
+  int buflen;
+
+# if OPENSSL_VERSION_NUMBER >= 0x10100000L
+  RSA_get0_key(rsa, &n, NULL, NULL);
+# else
+  n = rsa->n;
+# endif /* OpenSSL-1.1.0 and later */
+
+  if (n == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  buflen = BN_num_bytes(n);
+  buf = malloc(buflen);
+  if (buf == NULL) {
+    errno = ENOMEM;
+    return -1;
+  }
+
+  BN_bn2bin(n, buf);
+  SHA1(buf, buflen, key_id);
+  free(buf);
+
+  return 0;
+}
+
+/* Waits until the given fd is readable (or writable), or until the given
+ * deadline passes.
+ */
+static int tls_key_worker_wait(int fd, int for_write, time_t deadline) {
+  while (TRUE) {
+    fd_set fds;
+    struct timeval tv;
+    time_t now;
+    int res;
+
+    now = time(NULL);
+    if (now >= deadline) {
+      errno = ETIMEDOUT;
+      return -1;
+    }
+
+    FD_ZERO(&fds);
+    FD_SET(fd, &fds);
+
+    tv.tv_sec = deadline - now;
+    tv.tv_usec = 0;
+
+    res = select(fd + 1, for_write ? NULL : &fds, for_write ? &fds : NULL,
+      NULL, &tv);
+    if (res < 0) {
+      if (errno == EINTR) {
+        pr_signals_handle();
+        continue;
+      }
+
+      return -1;
+    }
+
+    if (res > 0) {
+      return 0;
+    }
+  }
+}
+
+/* Sends the given private key operation to the key workers, and waits for
+ * the result.  Returns the length of the result, or -1 (with ETIMEDOUT
+ * if the workers did not answer in time).
+ */
+static int tls_key_worker_request(int op, RSA *rsa, int padding, int flen,
+    const unsigned char *from, unsigned char *to) {
+  struct tls_key_worker_req req;
+  struct tls_key_worker_resp resp;
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  char cbuf[CMSG_SPACE(sizeof(int))];
+  int fds[2], res, xerrno;
+  ssize_t len;
+  time_t deadline;
+
+  if (flen < 0 ||
+      flen > TLS_KEY_WORKER_MAX_DATALEN ||
+      RSA_size(rsa) > TLS_KEY_WORKER_MAX_DATALEN) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  memset(&req, 0, sizeof(req));
+  if (tls_key_worker_get_key_id(rsa, req.key_id) < 0) {
+    return -1;
+  }
+
+  req.op = op;
+  req.padding = padding;
+  req.datalen = flen;
+  memcpy(req.data, from, flen);
+
+  if (socketpair(AF_UNIX, SOCK_DGRAM, 0, fds) < 0) {
+    return -1;
+  }
+
+  memset(&msg, 0, sizeof(msg));
+  iov.iov_base = &req;
+  iov.iov_len = sizeof(req);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = cbuf;
+  msg.msg_controllen = sizeof(cbuf);
+
+  cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(cmsg), &(fds[1]), sizeof(int));
+
+  deadline = time(NULL) + tls_key_worker_timeout;
+
+  if (tls_shared_stats != NULL) {
+    TLS_STATS_INCR(tls_shared_stats->key_worker_requests);
+  }
+
+  /* The queue socket is non-blocking; if the queue is full, wait for the
+   * workers to drain it.
+   */
+  while (TRUE) {
+    if (sendmsg(tls_key_worker_fds[1], &msg, 0) == (ssize_t) sizeof(req)) {
+      break;
+    }
+
+    if (errno != EAGAIN &&
+        errno != EWOULDBLOCK &&
+        errno != ENOBUFS &&
+        errno != EINTR) {
+      xerrno = errno;
+      (void) close(fds[0]);
+      (void) close(fds[1]);
+      errno = xerrno;
+      return -1;
+    }
+
+    if (tls_key_worker_wait(tls_key_worker_fds[1], TRUE, deadline) < 0) {
+      xerrno = errno;
+      (void) close(fds[0]);
+      (void) close(fds[1]);
+      errno = xerrno;
+      return -1;
+    }
+  }
+
+  /* The worker now holds its own reference to the reply socket. */
+  (void) close(fds[1]);
+
+  res = tls_key_worker_wait(fds[0], FALSE, deadline);
+  if (res == 0) {
+    len = recv(fds[0], &resp, sizeof(resp), 0);
+    if (len != (ssize_t) sizeof(resp)) {
+      if (len >= 0) {
+        errno = EPERM;
+      }
+
+      res = -1;
+    }
+  }
+
+  xerrno = errno;
+  (void) close(fds[0]);
+
+  if (res < 0) {
+    errno = xerrno;
+    return -1;
+  }
+
+  if (resp.res < 0 ||
+      resp.res > RSA_size(rsa)) {
+    errno = EPERM;
+    return -1;
+  }
+
+  memcpy(to, resp.data, resp.res);
+  return resp.res;
+}
+
+static int tls_key_worker_rsa_op(int op, int flen, const unsigned char *from,
+    unsigned char *to, RSA *rsa, int padding) {
+  const RSA_METHOD *meth;
+  int res;
+
+  res = tls_key_worker_request(op, rsa, padding, flen, from, to);
+  if (res >= 0) {
+    return res;
+  }
+
+  if (errno == ETIMEDOUT) {
+    /* The workers are saturated.  Rather than add to the load by doing
+     * the operation ourselves, fail this handshake.
+     */
+    tls_log("TLS key workers busy (no response within %d %s), failing "
+      "handshake", tls_key_worker_timeout,
+      tls_key_worker_timeout != 1 ? "secs" : "sec");
+
+    if (tls_shared_stats != NULL) {
+      TLS_STATS_INCR(tls_shared_stats->key_worker_timeouts);
+    }
+
+    RSAerr(op == TLS_KEY_WORKER_OP_PRIV_ENC ? RSA_F_RSA_PRIVATE_ENCRYPT :
+      RSA_F_RSA_PRIVATE_DECRYPT, ERR_R_INTERNAL_ERROR);
+    return -1;
+  }
+
+  /* The workers are not available (e.g. they have exited); use the key
+   * we hold ourselves.
+   */
+  pr_trace_msg(trace_channel, 3,
+    "error using TLS key workers (%s), using local key", strerror(errno));
+
+  if (tls_shared_stats != NULL) {
+    TLS_STATS_INCR(tls_shared_stats->key_worker_fallbacks);
+  }
+
+# if OPENSSL_VERSION_NUMBER >= 0x10100000L
+  meth = RSA_PKCS1_OpenSSL();
+  if (op == TLS_KEY_WORKER_OP_PRIV_ENC) {
+    return (RSA_meth_get_priv_enc(meth))(flen, from, to, rsa, padding);
+  }
+
+  return (RSA_meth_get_priv_dec(meth))(flen, from, to, rsa, padding);
+# else
+  meth = RSA_PKCS1_SSLeay();
+  if (op == TLS_KEY_WORKER_OP_PRIV_ENC) {
+    return (meth->rsa_priv_enc)(flen, from, to, rsa, padding);
+  }
+
+  return (meth->rsa_priv_dec)(flen, from, to, rsa, padding);
+# endif /* OpenSSL-1.1.0 and later */
+}
+
+static int tls_key_worker_priv_enc(int flen, const unsigned char *from,
+    unsigned char *to, RSA *rsa, int padding) {
+  return tls_key_worker_rsa_op(TLS_KEY_WORKER_OP_PRIV_ENC, flen, from, to, rsa,
+    padding);
+}
+
+static int tls_key_worker_priv_dec(int flen, const unsigned char *from,
+    unsigned char *to, RSA *rsa, int padding) {
+  return tls_key_worker_rsa_op(TLS_KEY_WORKER_OP_PRIV_DEC, flen, from, to, rsa,
+    padding);
+}
+#endif /* TLS_USE_KEY_WORKERS */
+
+/* Arranges for the private key operations of the RSA key loaded into the
+ * given SSL_CTX to be done by the key workers.
+ */
+static void tls_key_worker_attach(SSL_CTX *ctx) {
+#ifdef TLS_USE_KEY_WORKERS
+  EVP_PKEY *pkey;
+  RSA *rsa;
+
+  if (tls_key_worker_fds[1] < 0) {
+    return;
+  }
+
+  pkey = SSL_CTX_get0_privatekey(ctx);
+  if (pkey == NULL ||
+      EVP_PKEY_id(pkey) != EVP_PKEY_RSA) {
+    return;
+  }
+
+  if (tls_key_worker_rsa_meth == NULL) {
+# if OPENSSL_VERSION_NUMBER >= 0x10100000L
+    tls_key_worker_rsa_meth = RSA_meth_dup(RSA_PKCS1_OpenSSL());
+    if (tls_key_worker_rsa_meth == NULL) {
+      tls_log("error allocating RSA method for key workers: %s",
+        tls_get_errors());
+      return;
+    }
+
+    RSA_meth_set1_name(tls_key_worker_rsa_meth, "mod_tls key workers");
+    RSA_meth_set_priv_enc(tls_key_worker_rsa_meth, tls_key_worker_priv_enc);
+    RSA_meth_set_priv_dec(tls_key_worker_rsa_meth, tls_key_worker_priv_dec);
+# else
+    static RSA_METHOD meth;
+
+    memcpy(&meth, RSA_PKCS1_SSLeay(), sizeof(RSA_METHOD));
+    meth.name = "mod_tls key workers";
+    meth.rsa_priv_enc = tls_key_worker_priv_enc;
+    meth.rsa_priv_dec = tls_key_worker_priv_dec;
+    tls_key_worker_rsa_meth = &meth;
+# endif /* OpenSSL-1.1.0 and later */
+  }
+
+  rsa = EVP_PKEY_get1_RSA(pkey);
+  if (rsa == NULL) {
+    return;
+  }
+
+  if (RSA_set_method(rsa, tls_key_worker_rsa_meth) != 1) {
+    tls_log("error using key workers for RSA key: %s", tls_get_errors());
+
+  } else {
+    pr_trace_msg(trace_channel, 9, "using TLS key workers for RSA key");
+  }
+
+  RSA_free(rsa);
+#endif /* TLS_USE_KEY_WORKERS */
+}
+
+#ifdef TLS_USE_KEY_WORKERS
+static struct tls_key_worker_key *tls_key_worker_load_keys(pool *p) {
+  tls_pkey_t *k;
+  struct tls_key_worker_key *keys = NULL;
+
+  for (k = tls_pkey_list; k; k = k->next) {
+    config_rec *c;
+    FILE *fh;
+    EVP_PKEY *pkey;
+    struct tls_key_worker_key *key;
+    int xerrno;
+
+    c = find_config(k->server->conf, CONF_PARAM, "TLSRSACertificateKeyFile",
+      FALSE);
+    if (c == NULL) {
+      c = find_config(k->server->conf, CONF_PARAM, "TLSRSACertificateFile",
+        FALSE);
+    }
+
+    if (c == NULL) {
+      continue;
+    }
+
+    PRIVS_ROOT
+    fh = fopen(c->argv[0], "r");
+    xerrno = errno;
+    PRIVS_RELINQUISH
+
+    if (fh == NULL) {
+      pr_log_pri(PR_LOG_NOTICE, MOD_TLS_VERSION
+        ": TLS key worker unable to read '%s': %s", (char *) c->argv[0],
+        strerror(xerrno));
+      continue;
+    }
+
+    k->flags |= TLS_PKEY_USE_RSA;
+    k->flags &= ~(TLS_PKEY_USE_DSA|TLS_PKEY_USE_EC);
+
+    pkey = PEM_read_PrivateKey(fh, NULL, tls_pkey_cb, k);
+    fclose(fh);
+
+    if (pkey == NULL ||
+        EVP_PKEY_id(pkey) != EVP_PKEY_RSA) {
+      pr_log_pri(PR_LOG_NOTICE, MOD_TLS_VERSION
+        ": TLS key worker unable to use RSA key in '%s': %s",
+        (char *) c->argv[0], tls_get_errors());
+
+      if (pkey != NULL) {
+        EVP_PKEY_free(pkey);
+      }
+
+      continue;
+    }
+
+    key = pcalloc(p, sizeof(struct tls_key_worker_key));
+    key->rsa = EVP_PKEY_get1_RSA(pkey);
+    EVP_PKEY_free(pkey);
+
+    if (tls_key_worker_get_key_id(key->rsa, key->key_id) < 0) {
+      RSA_free(key->rsa);
+      continue;
+    }
+
+    key->next = keys;
+    keys = key;
+  }
+
+  return keys;
+}
+
+static void tls_key_worker_handle(struct tls_key_worker_key *keys) {
+  struct tls_key_worker_req req;
+  struct tls_key_worker_resp resp;
+  struct tls_key_worker_key *key;
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  char cbuf[CMSG_SPACE(sizeof(int))];
+  int fd = -1;
+  ssize_t len;
+
+  memset(&msg, 0, sizeof(msg));
+  iov.iov_base = &req;
+  iov.iov_len = sizeof(req);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = cbuf;
+  msg.msg_controllen = sizeof(cbuf);
+
+  /* All of the workers are woken for each request; only one will get it. */
+  len = recvmsg(tls_key_worker_fds[0], &msg, MSG_DONTWAIT);
+  if (len < 0) {
+    return;
+  }
+
+  for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET &&
+        cmsg->cmsg_type == SCM_RIGHTS) {
+      memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+    }
+  }
+
+  if (fd < 0) {
+    return;
+  }
+
+  memset(&resp, 0, sizeof(resp));
+  resp.res = -1;
+
+  if (len == (ssize_t) sizeof(req) &&
+      req.datalen >= 0 &&
+      req.datalen <= TLS_KEY_WORKER_MAX_DATALEN) {
+    for (key = keys; key; key = key->next) {
+      if (memcmp(key->key_id, req.key_id, SHA_DIGEST_LENGTH) == 0) {
+        break;
+      }
+    }
+
+    if (key != NULL &&
+        RSA_size(key->rsa) <= TLS_KEY_WORKER_MAX_DATALEN) {
+      if (req.op == TLS_KEY_WORKER_OP_PRIV_ENC) {
+        resp.res = RSA_private_encrypt(req.datalen, req.data, resp.data,
+          key->rsa, req.padding);
+
+      } else if (req.op == TLS_KEY_WORKER_OP_PRIV_DEC) {
+        resp.res = RSA_private_decrypt(req.datalen, req.data, resp.data,
+          key->rsa, req.padding);
+      }
+
+      if (resp.res < 0) {
+        ERR_clear_error();
+      }
+    }
+  }
+
+  if (send(fd, &resp, sizeof(resp), MSG_DONTWAIT) < 0) {
+    pr_trace_msg(trace_channel, 3,
+      "TLS key worker error sending response: %s", strerror(errno));
+  }
+
+  (void) close(fd);
+}
+
+static void tls_key_worker_main(pid_t daemon_pid) {
+  pool *p;
+  struct tls_key_worker_key *keys;
+
+  signal(SIGHUP, SIG_IGN);
+  signal(SIGINT, SIG_DFL);
+  signal(SIGTERM, SIG_DFL);
+  signal(SIGCHLD, SIG_DFL);
+  signal(SIGUSR1, SIG_IGN);
+  signal(SIGUSR2, SIG_IGN);
+
+  (void) close(tls_key_worker_fds[1]);
+  tls_key_worker_fds[1] = -1;
+
+  p = make_sub_pool(permanent_pool);
+  pr_pool_tag(p, "TLS Key Worker Pool");
+
+  keys = tls_key_worker_load_keys(p);
+
+  /* We no longer need the passphrases, nor root privileges. */
+  tls_scrub_pkeys();
+  PRIVS_REVOKE
+
+  if (keys == NULL) {
+    pr_log_pri(PR_LOG_NOTICE, MOD_TLS_VERSION
+      ": TLS key worker has no RSA keys to use, exiting");
+    _exit(1);
+  }
+
+  while (TRUE) {
+    fd_set rfds;
+    struct timeval tv;
+    int res;
+
+    /* Exit along with the daemon process. */
+    if (getppid() != daemon_pid) {
+      break;
+    }
+
+    FD_ZERO(&rfds);
+    FD_SET(tls_key_worker_fds[0], &rfds);
+
+    tv.tv_sec = 1;
+    tv.tv_usec = 0;
+
+    res = select(tls_key_worker_fds[0] + 1, &rfds, NULL, NULL, &tv);
+    if (res > 0) {
+      tls_key_worker_handle(keys);
+    }
+  }
+
+  _exit(0);
+}
+#endif /* TLS_USE_KEY_WORKERS */
+
+/* Reorders the configured ciphers so that those using ECDSA certificates
+ * come first, and makes the server's order take precedence.  When both RSA
+ * and EC certificates are configured, this means that ECDSA, whose signing
+ * operations are much cheaper for the server than RSA private key
+ * operations, is used with all clients which support it.
+ */
+static void tls_prefer_ecdsa(SSL_CTX *ctx) {
+  STACK_OF(SSL_CIPHER) *ciphers;
+  SSL *ssl = NULL;
+  char *ecdsa_list = "", *other_list = "", *cipher_list;
+  register int i;
+  pool *tmp_pool;
+
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+  ciphers = SSL_CTX_get_ciphers(ctx);
+#else
+  /* SSL_CTX_get_ciphers() is only provided by OpenSSL 1.1.0 and later, so
+   * use the ciphers of an SSL made from the ctx.
+   */
+  ssl = SSL_new(ctx);
+  if (ssl == NULL) {
+    tls_log("error getting ciphers for TLSOption PreferECDSA: %s",
+      tls_get_errors());
+    return;
+  }
+
+  ciphers = SSL_get_ciphers(ssl);
+#endif /* OpenSSL 1.1.0 or later */
+
+  if (ciphers == NULL) {
+    if (ssl != NULL) {
+      SSL_free(ssl);
+    }
+
+    return;
+  }
+
+  tmp_pool = make_sub_pool(session.pool);
+
+  for (i = 0; i < sk_SSL_CIPHER_num(ciphers); i++) {
+    const char *name;
+
+    name = SSL_CIPHER_get_name(sk_SSL_CIPHER_value(ciphers, i));
+    if (strstr(name, "-ECDSA-") != NULL) {
+      ecdsa_list = pstrcat(tmp_pool, ecdsa_list, *ecdsa_list ? ":" : "",
+        name, NULL);
+
+    } else {
+      other_list = pstrcat(tmp_pool, other_list, *other_list ? ":" : "",
+        name, NULL);
+    }
+  }
+
+  if (ssl != NULL) {
+    SSL_free(ssl);
+  }
+
+  if (*ecdsa_list == '\0') {
+    tls_log("%s", "TLSOption PreferECDSA: no ECDSA ciphers configured, "
+      "ignoring");
+    destroy_pool(tmp_pool);
+    return;
+  }
+
+  cipher_list = pstrcat(tmp_pool, ecdsa_list, *other_list ? ":" : "",
+    other_list, NULL);
+  if (SSL_CTX_set_cipher_list(ctx, cipher_list) != 1) {
+    tls_log("error reordering ciphers for TLSOption PreferECDSA: %s",
+      tls_get_errors());
+
+  } else {
+#ifdef SSL_OP_CIPHER_SERVER_PREFERENCE
+    SSL_CTX_set_options(ctx, SSL_OP_CIPHER_SERVER_PREFERENCE);
+#endif /* SSL_OP_CIPHER_SERVER_PREFERENCE */
+    pr_trace_msg(trace_channel, 9, "preferring ECDSA ciphers: %s",
+      cipher_list);
+  }
+
+  destroy_pool(tmp_pool);
+}
+
+static void tls_key_workers_stop(void) {
+  register unsigned int i;
+
+  for (i = 0; i < tls_key_worker_npids; i++) {
+    if (kill(tls_key_worker_pids[i], SIGTERM) < 0 &&
+        errno != ESRCH) {
+      pr_log_debug(DEBUG3, MOD_TLS_VERSION
+        ": error stopping TLS key worker (PID %lu): %s",
+        (unsigned long) tls_key_worker_pids[i], strerror(errno));
+    }
+  }
+
+  tls_key_worker_npids = 0;
+
+  if (tls_key_worker_fds[0] >= 0) {
+    (void) close(tls_key_worker_fds[0]);
+    tls_key_worker_fds[0] = -1;
+  }
+
+  if (tls_key_worker_fds[1] >= 0) {
+    (void) close(tls_key_worker_fds[1]);
+    tls_key_worker_fds[1] = -1;
+  }
+}
+
+/* Forks the configured number of key workers.  Done by the daemon process
+ * once it has daemonized (and on restarts), since the workers exit when
+ * their parent does.
+ */
+static void tls_key_workers_start(void) {
+#ifdef TLS_USE_KEY_WORKERS
+  register unsigned int i;
+  pid_t daemon_pid;
+
+  if (tls_key_worker_count == 0 ||
+      ServerType == SERVER_INETD) {
+    return;
+  }
+
+  if (socketpair(AF_UNIX, SOCK_DGRAM, 0, tls_key_worker_fds) < 0) {
+    pr_log_pri(PR_LOG_NOTICE, MOD_TLS_VERSION
+      ": error creating TLS key worker queue: %s", strerror(errno));
+    return;
+  }
+
+  (void) fcntl(tls_key_worker_fds[0], F_SETFD, FD_CLOEXEC);
+  (void) fcntl(tls_key_worker_fds[1], F_SETFD, FD_CLOEXEC);
+
+  daemon_pid = getpid();
+
+  for (i = 0; i < tls_key_worker_count; i++) {
+    pid_t pid;
+
+    pid = fork();
+    if (pid < 0) {
+      pr_log_pri(PR_LOG_NOTICE, MOD_TLS_VERSION
+        ": error starting TLS key worker: %s", strerror(errno));
+      break;
+    }
+
+    if (pid == 0) {
+      tls_key_worker_main(daemon_pid);
+    }
+
+    tls_key_worker_pids[tls_key_worker_npids++] = pid;
+  }
+
+  /* Only the workers read from the queue. */
+  (void) close(tls_key_worker_fds[0]);
+  tls_key_worker_fds[0] = -1;
+
+  if (tls_key_worker_npids == 0) {
+    tls_key_workers_stop();
+    return;
+  }
+
+  if (fcntl(tls_key_worker_fds[1], F_SETFL,
+      fcntl(tls_key_worker_fds[1], F_GETFL) | O_NONBLOCK) < 0) {
+    pr_log_debug(DEBUG0, MOD_TLS_VERSION
+      ": error making TLS key worker queue non-blocking: %s",
+      strerror(errno));
+  }
+
+  pr_log_debug(DEBUG2, MOD_TLS_VERSION ": started %u TLS key %s",
+    tls_key_worker_npids, tls_key_worker_npids != 1 ? "workers" : "worker");
+#endif /* TLS_USE_KEY_WORKERS */
+}
+
+static unsigned long tls_get_cpu_usecs(void) {
+  struct rusage ru;
+
+  if (getrusage(RUSAGE_SELF, &ru) < 0) {
+    return 0;
+  }
+
+  return ((ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000UL) +
+    ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+static int tls_accept(conn_t *conn, unsigned char on_data) {
+  int blocking, res = 0, xerrno = 0;
+  long cache_mode = 0;
+  unsigned long handshake_start_usecs, handshake_usecs;
+  struct timeval handshake_start_tv;
+  char *subj = NULL;
+  static unsigned char logged_data = FALSE;
+  SSL *ssl = NULL;
+  BIO *rbio = NULL, *wbio = NULL;
+
+  if (!ssl_ctx) {
+    tls_log("%s", "unable to start session: null SSL_CTX");
+    return -1;
+  }
+
+  ssl = SSL_new(ssl_ctx);
+  if (ssl == NULL) {
+    tls_log("error: unable to start session: %s",
+      ERR_error_string(ERR_get_error(), NULL));
+    return -2;
+  }
+
+  /* This works with either rfd or wfd (I hope). */
+  rbio = BIO_new_socket(conn->rfd, FALSE);
+  wbio = BIO_new_socket(conn->wfd, FALSE);
+  SSL_set_bio(ssl, rbio, wbio);
+
+#ifdef SSL_OP_ENABLE_KTLS
+  /* The record keys can only be handed to the kernel by OpenSSL itself, as
+   * part of the handshake; this requires the socket BIOs set above.
+   */
+  if (on_data &&
+      (tls_opts & TLS_OPT_KERNEL_TLS)) {
+    SSL_set_options(ssl, SSL_OP_ENABLE_KTLS);
+  }
+#endif /* SSL_OP_ENABLE_KTLS */
+
+  /* If configured, set a timer for the handshake. */
+  if (tls_handshake_timeout) {
+    tls_handshake_timer_id = pr_timer_add(tls_handshake_timeout, -1,
+      &tls_module, tls_handshake_timeout_cb, "SSL/TLS handshake");
+  }
+
+  if (on_data) {
+
+    /* Make sure that TCP_NODELAY is enabled for the handshake. */
+    pr_inet_set_proto_nodelay(conn->pool, conn, 1);
+
+    /* Make sure that TCP_CORK (aka TCP_NOPUSH) is DISABLED for the handshake.
+     * This socket option is set via the pr_inet_set_proto_opts() call made
+     * in mod_core, upon handling the PASV/EPSV command.
+     */
+    (void) pr_inet_set_proto_cork(conn->wfd, 0);
+
+    cache_mode = SSL_CTX_get_session_cache_mode(ssl_ctx);
+    if (!(cache_mode & SSL_SESS_CACHE_OFF)) {
+      /* Disable STORING of any new session IDs in the session cache. We DO
+       * want to allow LOOKUP of session IDs in the session cache, however.
+       */
+      long data_cache_mode;
+      data_cache_mode = SSL_SESS_CACHE_SERVER|SSL_SESS_CACHE_NO_INTERNAL_STORE;
+      SSL_CTX_set_session_cache_mode(ssl_ctx, data_cache_mode);
+    }
+  }
+
+  tls_ticket_key_used = FALSE;
+  handshake_start_usecs = tls_get_cpu_usecs();
+  gettimeofday(&handshake_start_tv, NULL);
+
+  retry:
+
+  blocking = tls_get_block(conn);
+  if (blocking) {
+    /* Put the connection in non-blocking mode for the duration of the
+     * SSL handshake.  This lets us handle EAGAIN/retries better (i.e.
+     * without spinning in a tight loop and consuming the CPU).
+     */
+    pr_inet_set_nonblock(conn->pool, conn);
+  }
+
+  pr_signals_handle();
+  res = SSL_accept(ssl);
+  if (res == -1) {
+    xerrno = errno;
+  }
+
+  if (blocking) {
+    /* Return the connection to blocking mode. */
+    pr_inet_set_block(conn->pool, conn);
+  }
+
+  if (res < 1) {
+    const char *msg = "unable to accept TLS connection";
+    int errcode = SSL_get_error(ssl, res);
+
+    pr_signals_handle();
 
     if (tls_handshake_timed_out) {
       tls_log("TLS negotiation timed out (%u seconds)", tls_handshake_timeout);
@@ -3878,6 +5245,39 @@ static int tls_accept(conn_t *conn, unsigned char on_data) {
   /* Disable the handshake timer. */
   pr_timer_remove(tls_handshake_timer_id, &tls_module);
 
+  /* Track the CPU spent on handshakes, and how many of them were resumed,
+   * for reporting in the TLSLog at session end.
+   */
+  handshake_usecs = tls_get_cpu_usecs() - handshake_start_usecs;
+  tls_handshake_stats.count++;
+  tls_handshake_stats.cpu_usecs += handshake_usecs;
+
+  if (SSL_session_reused(ssl)) {
+    tls_handshake_stats.resumed++;
+
+    if (tls_ticket_key_used) {
+      tls_handshake_stats.ticket_resumed++;
+    }
+  }
+
+  if (tls_shared_stats != NULL) {
+    struct timeval now;
+    unsigned long msecs;
+
+    gettimeofday(&now, NULL);
+    msecs = ((now.tv_sec - handshake_start_tv.tv_sec) * 1000) +
+      ((now.tv_usec - handshake_start_tv.tv_usec) / 1000);
+
+    tls_handshake_hist_add(SSL_session_reused(ssl) ?
+      &(tls_shared_stats->resumed) : &(tls_shared_stats->full), msecs);
+  }
+
+  pr_trace_msg(trace_channel, 9, "%s handshake took %lu usecs CPU (%s)",
+    on_data ? "data" : "ctrl", handshake_usecs,
+    SSL_session_reused(ssl) ?
+      (tls_ticket_key_used ? "resumed using session ticket" : "resumed") :
+      "full");
+
   /* Manually update the raw bytes counters with the network IO from the
    * SSL handshake.
    */
@@ -3892,12 +5292,8 @@ static int tls_accept(conn_t *conn, unsigned char on_data) {
 
     ctrl_ssl = ssl;
 
-    pr_table_add(tls_ctrl_rd_nstrm->notes,
-      pstrdup(tls_ctrl_rd_nstrm->strm_pool, TLS_NETIO_NOTE),
-      ssl, sizeof(SSL *));
-    pr_table_add(tls_ctrl_wr_nstrm->notes,
-      pstrdup(tls_ctrl_wr_nstrm->strm_pool, TLS_NETIO_NOTE),
-      ssl, sizeof(SSL *));
+    tls_netio_set_ssl(tls_ctrl_rd_nstrm, ssl);
+    tls_netio_set_ssl(tls_ctrl_wr_nstrm, ssl);
 
 #if OPENSSL_VERSION_NUMBER >= 0x009080dfL
     if (SSL_get_secure_renegotiation_support(ssl) == 1) {
@@ -3929,12 +5325,8 @@ static int tls_accept(conn_t *conn, unsigned char on_data) {
   } else if (conn == session.d) {
     pr_buffer_t *strm_buf;
 
-    pr_table_add(tls_data_rd_nstrm->notes,
-      pstrdup(tls_data_rd_nstrm->strm_pool, TLS_NETIO_NOTE),
-      ssl, sizeof(SSL *));
-    pr_table_add(tls_data_wr_nstrm->notes,
-      pstrdup(tls_data_wr_nstrm->strm_pool, TLS_NETIO_NOTE),
-      ssl, sizeof(SSL *));
+    tls_netio_set_ssl(tls_data_rd_nstrm, ssl);
+    tls_netio_set_ssl(tls_data_wr_nstrm, ssl);
 
     /* Clear any data from the NetIO stream buffers which may have been read
      * in before the SSL/TLS handshake occurred (Bug#3624).
@@ -4022,8 +5414,8 @@ static int tls_accept(conn_t *conn, unsigned char on_data) {
         tls_log("client did not reuse SSL session, rejecting data connection "
           "(see the NoSessionReuseRequired TLSOptions parameter)");
         tls_end_sess(ssl, PR_NETIO_STRM_DATA, 0);
-        pr_table_remove(tls_data_rd_nstrm->notes, TLS_NETIO_NOTE, NULL);
-        pr_table_remove(tls_data_wr_nstrm->notes, TLS_NETIO_NOTE, NULL);
+        tls_netio_clear_ssl(tls_data_rd_nstrm);
+        tls_netio_clear_ssl(tls_data_wr_nstrm);
         return -1;
 
       } else {
@@ -4059,14 +5451,21 @@ static int tls_accept(conn_t *conn, unsigned char on_data) {
  
           matching_sess_id = SSL_has_matching_session_id(ctrl_ssl, sess_id,
             sess_id_len);
+# ifdef TLS_USE_SESSION_TICKETS
+          if (matching_sess_id == 0 &&
+              tls_ticket_key_used == TRUE) {
+            matching_sess_id = tls_sess_master_key_matches(ctrl_sess,
+              data_sess);
+          }
+# endif /* TLS_USE_SESSION_TICKETS */
           if (matching_sess_id == 0) {
 #endif
             tls_log("Client did not reuse SSL session from control channel, "
               "rejecting data connection (see the NoSessionReuseRequired "
               "TLSOptions parameter)");
             tls_end_sess(ssl, PR_NETIO_STRM_DATA, 0);
-            pr_table_remove(tls_data_rd_nstrm->notes, TLS_NETIO_NOTE, NULL);
-            pr_table_remove(tls_data_wr_nstrm->notes, TLS_NETIO_NOTE, NULL);
+            tls_netio_clear_ssl(tls_data_rd_nstrm);
+            tls_netio_clear_ssl(tls_data_wr_nstrm);
             return -1;
 
           } else {
@@ -4109,8 +5508,8 @@ static int tls_accept(conn_t *conn, unsigned char on_data) {
           tls_log("BUG: unable to determine whether client reused SSL session: SSL_get_session() for control connection return NULL");
           tls_log("rejecting data connection (see TLSOption NoSessionReuseRequired)");
           tls_end_sess(ssl, PR_NETIO_STRM_DATA, 0);
-          pr_table_remove(tls_data_rd_nstrm->notes, TLS_NETIO_NOTE, NULL);
-          pr_table_remove(tls_data_wr_nstrm->notes, TLS_NETIO_NOTE, NULL);
+          tls_netio_clear_ssl(tls_data_rd_nstrm);
+          tls_netio_clear_ssl(tls_data_wr_nstrm);
           return -1;
         }
 
@@ -4119,12 +5518,16 @@ static int tls_accept(conn_t *conn, unsigned char on_data) {
         tls_log("BUG: unable to determine whether client reused SSL session: SSL_get_session() for control connection return NULL");
         tls_log("rejecting data connection (see TLSOption NoSessionReuseRequired)");
         tls_end_sess(ssl, PR_NETIO_STRM_DATA, 0);
-        pr_table_remove(tls_data_rd_nstrm->notes, TLS_NETIO_NOTE, NULL);
-        pr_table_remove(tls_data_wr_nstrm->notes, TLS_NETIO_NOTE, NULL);
+        tls_netio_clear_ssl(tls_data_rd_nstrm);
+        tls_netio_clear_ssl(tls_data_wr_nstrm);
         return -1;
       }
     }
 
+    if (tls_opts & TLS_OPT_KERNEL_TLS) {
+      tls_setup_ktls(ssl);
+    }
+
     /* Only be verbose with the first TLS data connection, otherwise there
      * might be too much noise.
      */
@@ -4288,12 +5691,8 @@ static int tls_connect(conn_t *conn) {
   if (conn == session.d) {
     pr_buffer_t *strm_buf;
 
-    pr_table_add(tls_data_rd_nstrm->notes,
-      pstrdup(tls_data_rd_nstrm->strm_pool, TLS_NETIO_NOTE),
-      ssl, sizeof(SSL *));
-    pr_table_add(tls_data_wr_nstrm->notes,
-      pstrdup(tls_data_wr_nstrm->strm_pool, TLS_NETIO_NOTE),
-      ssl, sizeof(SSL *));
+    tls_netio_set_ssl(tls_data_rd_nstrm, ssl);
+    tls_netio_set_ssl(tls_data_wr_nstrm, ssl);
 
     /* Clear any data from the NetIO stream buffers which may have been read
      * in before the SSL/TLS handshake occurred (Bug#3624).
@@ -4344,10 +5743,8 @@ static void tls_cleanup(int flags) {
   }
 #endif
 
-  if (tls_crl_store) {
-    X509_STORE_free(tls_crl_store);
-    tls_crl_store = NULL;
-  }
+  /* The CRL indices belong to the daemon process. */
+  tls_crl_set = NULL;
 
   if (ssl_ctx) {
     SSL_CTX_free(ssl_ctx);
@@ -4768,11 +6165,24 @@ static int tls_dotlogin_allow(const char *user) {
   }
 
   while ((file_cert = PEM_read_X509(fp, NULL, NULL, NULL))) {
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+    const ASN1_BIT_STRING *client_sig = NULL, *file_sig = NULL;
+#endif /* OpenSSL-1.1.x and later */
+
     pr_signals_handle();
 
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+    X509_get0_signature(&client_sig, NULL, client_cert);
+    X509_get0_signature(&file_sig, NULL, file_cert);
+
+    if (!ASN1_STRING_cmp(client_sig, file_sig)) {
+      allow_user = TRUE;
+    }
+#else
     if (!M_ASN1_BIT_STRING_cmp(client_cert->signature, file_cert->signature)) {
       allow_user = TRUE;
     }
+#endif /* OpenSSL-1.1.x and later */
 
     X509_free(file_cert);
     if (allow_user) {
@@ -5240,85 +6650,86 @@ static void tls_setup_cert_dn_environ(const char *env_prefix, X509_NAME *name) {
   register unsigned int i = 0;
   char *k, *v;
 
-  for (i = 0; i < sk_X509_NAME_ENTRY_num(name->entries); i++) {
-    X509_NAME_ENTRY *entry = sk_X509_NAME_ENTRY_value(name->entries, i);
-    int nid = OBJ_obj2nid(entry->object);
+  for (i = 0; i < X509_NAME_entry_count(name); i++) {
+    X509_NAME_ENTRY *entry = X509_NAME_get_entry(name, i);
+    ASN1_STRING *value = X509_NAME_ENTRY_get_data(entry);
+    int nid = OBJ_obj2nid(X509_NAME_ENTRY_get_object(entry));
 
     switch (nid) {
       case NID_countryName:
         k = pstrcat(session.pool, env_prefix, "C", NULL);
-        v = pstrndup(session.pool, (const char *) entry->value->data,
-          entry->value->length);
+        v = pstrndup(session.pool, (const char *) value->data,
+          value->length);
         pr_env_set(session.pool, k, v);
         break;
 
       case NID_commonName:
         k = pstrcat(session.pool, env_prefix, "CN", NULL);
-        v = pstrndup(session.pool, (const char *) entry->value->data,
-          entry->value->length);
+        v = pstrndup(session.pool, (const char *) value->data,
+          value->length);
         pr_env_set(session.pool, k, v);
         break;
 
       case NID_description:
         k = pstrcat(main_server->pool, env_prefix, "D", NULL);
-        v = pstrndup(main_server->pool, (const char *) entry->value->data,
-          entry->value->length);
+        v = pstrndup(main_server->pool, (const char *) value->data,
+          value->length);
         pr_env_set(main_server->pool, k, v);
         break;
 
       case NID_givenName:
         k = pstrcat(main_server->pool, env_prefix, "G", NULL);
-        v = pstrndup(main_server->pool, (const char *) entry->value->data,
-          entry->value->length);
+        v = pstrndup(main_server->pool, (const char *) value->data,
+          value->length);
         pr_env_set(main_server->pool, k, v);
         break;
 
       case NID_initials:
         k = pstrcat(main_server->pool, env_prefix, "I", NULL);
-        v = pstrndup(main_server->pool, (const char *) entry->value->data,
-          entry->value->length);
+        v = pstrndup(main_server->pool, (const char *) value->data,
+          value->length);
         pr_env_set(main_server->pool, k, v);
         break;
 
       case NID_localityName:
         k = pstrcat(main_server->pool, env_prefix, "L", NULL);
-        v = pstrndup(main_server->pool, (const char *) entry->value->data,
-          entry->value->length);
+        v = pstrndup(main_server->pool, (const char *) value->data,
+          value->length);
         pr_env_set(main_server->pool, k, v);
         break;
 
       case NID_organizationName:
         k = pstrcat(main_server->pool, env_prefix, "O", NULL);
-        v = pstrndup(main_server->pool, (const char *) entry->value->data,
-          entry->value->length);
+        v = pstrndup(main_server->pool, (const char *) value->data,
+          value->length);
         pr_env_set(main_server->pool, k, v);
         break;
 
       case NID_organizationalUnitName:
         k = pstrcat(main_server->pool, env_prefix, "OU", NULL);
-        v = pstrndup(main_server->pool, (const char *) entry->value->data,
-          entry->value->length);
+        v = pstrndup(main_server->pool, (const char *) value->data,
+          value->length);
         pr_env_set(main_server->pool, k, v);
         break;
 
       case NID_stateOrProvinceName:
         k = pstrcat(main_server->pool, env_prefix, "ST", NULL);
-        v = pstrndup(main_server->pool, (const char *) entry->value->data,
-          entry->value->length);
+        v = pstrndup(main_server->pool, (const char *) value->data,
+          value->length);
         pr_env_set(main_server->pool, k, v);
         break;
 
       case NID_surname:
         k = pstrcat(main_server->pool, env_prefix, "S", NULL);
-        v = pstrndup(main_server->pool, (const char *) entry->value->data,
-          entry->value->length);
+        v = pstrndup(main_server->pool, (const char *) value->data,
+          value->length);
         pr_env_set(main_server->pool, k, v);
         break;
 
       case NID_title:
         k = pstrcat(main_server->pool, env_prefix, "T", NULL);
-        v = pstrndup(main_server->pool, (const char *) entry->value->data,
-          entry->value->length);
+        v = pstrndup(main_server->pool, (const char *) value->data,
+          value->length);
         pr_env_set(main_server->pool, k, v);
         break;
 
@@ -5328,15 +6739,15 @@ static void tls_setup_cert_dn_environ(const char *env_prefix, X509_NAME *name) {
       case NID_uniqueIdentifier:
 #endif
         k = pstrcat(main_server->pool, env_prefix, "UID", NULL);
-        v = pstrndup(main_server->pool, (const char *) entry->value->data,
-          entry->value->length);
+        v = pstrndup(main_server->pool, (const char *) value->data,
+          value->length);
         pr_env_set(main_server->pool, k, v);
         break;
 
       case NID_pkcs9_emailAddress:
         k = pstrcat(main_server->pool, env_prefix, "Email", NULL);
-        v = pstrndup(main_server->pool, (const char *) entry->value->data,
-          entry->value->length);
+        v = pstrndup(main_server->pool, (const char *) value->data,
+          value->length);
         pr_env_set(main_server->pool, k, v);
         break;
 
@@ -5354,6 +6765,7 @@ static void tls_setup_cert_environ(const char *env_prefix, X509 *cert) {
   if (tls_opts & TLS_OPT_STD_ENV_VARS) {
     char buf[80] = {'\0'};
     ASN1_INTEGER *serial = X509_get_serialNumber(cert);
+    ASN1_OBJECT *algo = NULL;
 
     memset(buf, '\0', sizeof(buf));
     snprintf(buf, sizeof(buf) - 1, "%lu", X509_get_version(cert) + 1);
@@ -5422,7 +6834,13 @@ static void tls_setup_cert_environ(const char *env_prefix, X509 *cert) {
     BIO_free(bio);
 
     bio = BIO_new(BIO_s_mem());
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+    X509_ALGOR_get0((const ASN1_OBJECT **) &algo, NULL, NULL,
+      X509_get0_tbs_sigalg(cert));
+    i2a_ASN1_OBJECT(bio, algo);
+#else
     i2a_ASN1_OBJECT(bio, cert->cert_info->signature->algorithm);
+#endif /* OpenSSL-1.1.x and later */
     datalen = BIO_get_mem_data(bio, &data);
     data[datalen] = '\0';
 
@@ -5433,7 +6851,9 @@ static void tls_setup_cert_environ(const char *env_prefix, X509 *cert) {
     BIO_free(bio);
 
     bio = BIO_new(BIO_s_mem());
-    i2a_ASN1_OBJECT(bio, cert->cert_info->key->algor->algorithm);
+    X509_PUBKEY_get0_param(&algo, NULL, NULL, NULL,
+      X509_get_X509_PUBKEY(cert));
+    i2a_ASN1_OBJECT(bio, algo);
     datalen = BIO_get_mem_data(bio, &data);
     data[datalen] = '\0';
 
@@ -5481,13 +6901,15 @@ static void tls_setup_environ(SSL *ssl) {
     ssl_session = SSL_get_session(ssl);
     if (ssl_session) {
       char buf[SSL_MAX_SSL_SESSION_ID_LENGTH*2+1];
+      const unsigned char *sess_id;
+      unsigned int sess_id_len = 0;
       register unsigned int i = 0;
 
       /* Have to obtain a stringified session ID the hard way. */
+      sess_id = SSL_SESSION_get_id(ssl_session, &sess_id_len);
       memset(buf, '\0', sizeof(buf));
-      for (i = 0; i < ssl_session->session_id_length; i++) {
-        snprintf(&(buf[i*2]), sizeof(buf) - (i*2) - 1, "%02X",
-          ssl_session->session_id[i]);
+      for (i = 0; i < sess_id_len; i++) {
+        snprintf(&(buf[i*2]), sizeof(buf) - (i*2) - 1, "%02X", sess_id[i]);
       }
       buf[sizeof(buf)-1] = '\0';
 
@@ -5627,7 +7049,9 @@ static int tls_verify_cb(int ok, X509_STORE_CTX *ctx) {
   if (!ok) {
     X509 *cert = X509_STORE_CTX_get_current_cert(ctx);
     int depth = X509_STORE_CTX_get_error_depth(ctx);
-    verify_err = ctx->error;
+    int err;
+
+    verify_err = X509_STORE_CTX_get_error(ctx);
 
     tls_log("error: unable to verify certificate at depth %d", depth);
     tls_log("error: cert subject: %s", tls_x509_name_oneline(
@@ -5639,7 +7063,8 @@ static int tls_verify_cb(int ok, X509_STORE_CTX *ctx) {
     if (depth > tls_verify_depth)
       X509_STORE_CTX_set_error(ctx, X509_V_ERR_CERT_CHAIN_TOO_LONG);
 
-    switch (ctx->error) {
+    err = X509_STORE_CTX_get_error(ctx);
+    switch (err) {
       case X509_V_ERR_CERT_CHAIN_TOO_LONG:
       case X509_V_ERR_CERT_HAS_EXPIRED:
       case X509_V_ERR_CERT_REVOKED:
@@ -5649,7 +7074,7 @@ static int tls_verify_cb(int ok, X509_STORE_CTX *ctx) {
       case X509_V_ERR_UNABLE_TO_VERIFY_LEAF_SIGNATURE:
       case X509_V_ERR_APPLICATION_VERIFICATION:
         tls_log("client certificate failed verification: %s",
-          X509_verify_cert_error_string(ctx->error));
+          X509_verify_cert_error_string(err));
         ok = 0;
         break;
 
@@ -5658,7 +7083,7 @@ static int tls_verify_cb(int ok, X509_STORE_CTX *ctx) {
         int count = X509_PURPOSE_get_count();
 
         tls_log("client certificate failed verification: %s",
-          X509_verify_cert_error_string(ctx->error));
+          X509_verify_cert_error_string(err));
 
         for (i = 0; i < count; i++) {
           X509_PURPOSE *purp = X509_PURPOSE_get0(i);
@@ -5669,40 +7094,339 @@ static int tls_verify_cb(int ok, X509_STORE_CTX *ctx) {
         break;
       }
 
-      default:
-        tls_log("error verifying client certificate: [%d] %s",
-          ctx->error, X509_verify_cert_error_string(ctx->error));
-        ok = 0;
-        break;
+      default:
+        tls_log("error verifying client certificate: [%d] %s",
+          err, X509_verify_cert_error_string(err));
+        ok = 0;
+        break;
+    }
+  }
+
+  if (ok) {
+    pr_event_generate("mod_tls.verify-client", NULL);
+
+  } else {
+    pr_event_generate("mod_tls.verify-client-failed", &verify_err);
+  }
+
+  return ok;
+}
+
+/* CRL index
+ *
+ * The CRLs configured via TLSCARevocationFile/TLSCARevocationPath are parsed
+ * once, by the daemon process (at startup, and on restart), rather than by
+ * every session process.  The serial numbers revoked by each CRL are indexed
+ * in a hash table, so that checking whether a certificate has been revoked
+ * does not require scanning the entire revoked list.  The session processes
+ * inherit these indices, read-only, when forked.
+ */
+
+static unsigned int tls_crl_serial_hash(ASN1_INTEGER *serial) {
+  register int i;
+  unsigned int h = 2166136261U;
+
+  for (i = 0; i < serial->length; i++) {
+    h ^= serial->data[i];
+    h *= 16777619U;
+  }
+
+  return h;
+}
+
+static void tls_crl_set_add_crl(struct tls_crl_set *set, X509_CRL *crl) {
+  register int i;
+  struct tls_crl_entry *entry, *last;
+  STACK_OF(X509_REVOKED) *revoked_list;
+  int nrevoked;
+
+  entry = pcalloc(tls_crl_pool, sizeof(struct tls_crl_entry));
+  entry->crl = crl;
+  entry->issuer = X509_CRL_get_issuer(crl);
+  entry->issuer_hash = X509_NAME_hash(entry->issuer);
+
+  revoked_list = X509_CRL_get_REVOKED(crl);
+  nrevoked = revoked_list != NULL ? sk_X509_REVOKED_num(revoked_list) : 0;
+
+  /* Size the table to the next power of two, for a load factor of at
+   * most one.
+   */
+  entry->nbuckets = TLS_CRL_MIN_BUCKETS;
+  while (entry->nbuckets < (unsigned int) nrevoked) {
+    entry->nbuckets <<= 1;
+  }
+
+  entry->buckets = pcalloc(tls_crl_pool,
+    sizeof(struct tls_crl_serial *) * entry->nbuckets);
+
+  for (i = 0; i < nrevoked; i++) {
+    X509_REVOKED *revoked;
+    struct tls_crl_serial *serial;
+    unsigned int idx;
+
+    revoked = sk_X509_REVOKED_value(revoked_list, i);
+
+    serial = palloc(tls_crl_pool, sizeof(struct tls_crl_serial));
+    serial->serial = (ASN1_INTEGER *) X509_REVOKED_get0_serialNumber(revoked);
+
+    idx = tls_crl_serial_hash(serial->serial) & (entry->nbuckets - 1);
+    serial->next = entry->buckets[idx];
+    entry->buckets[idx] = serial;
+  }
+
+  /* Keep the CRLs in the order in which they were configured. */
+  if (set->crls == NULL) {
+    set->crls = entry;
+
+  } else {
+    for (last = set->crls; last->next; last = last->next);
+    last->next = entry;
+  }
+
+  set->ncrls++;
+  set->nrevoked += nrevoked;
+}
+
+static int tls_crl_set_load_file(struct tls_crl_set *set, const char *path) {
+  BIO *bio;
+  X509_CRL *crl;
+  int count = 0;
+
+  PRIVS_ROOT
+  bio = BIO_new_file(path, "r");
+  PRIVS_RELINQUISH
+
+  if (bio == NULL) {
+    return -1;
+  }
+
+  while ((crl = PEM_read_bio_X509_CRL(bio, NULL, NULL, NULL)) != NULL) {
+    pr_signals_handle();
+
+    tls_crl_set_add_crl(set, crl);
+    count++;
+  }
+
+  /* Reading past the last CRL in the file leaves an error on the queue. */
+  ERR_clear_error();
+  BIO_free(bio);
+
+  return count;
+}
+
+static int tls_crl_is_hash_name(const char *name) {
+  register unsigned int i;
+  size_t namelen;
+
+  namelen = strlen(name);
+  if (namelen < 11) {
+    return FALSE;
+  }
+
+  for (i = 0; i < 8; i++) {
+    if (!PR_ISXDIGIT(name[i])) {
+      return FALSE;
+    }
+  }
+
+  if (name[8] != '.' ||
+      name[9] != 'r') {
+    return FALSE;
+  }
+
+  for (i = 10; i < namelen; i++) {
+    if (!PR_ISDIGIT(name[i])) {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+static struct tls_crl_set *tls_crl_set_load(const char *crl_file,
+    const char *crl_path) {
+  struct tls_crl_set *set;
+
+  if (tls_crl_pool == NULL) {
+    tls_crl_pool = make_sub_pool(permanent_pool);
+    pr_pool_tag(tls_crl_pool, "TLS CRL Pool");
+  }
+
+  set = pcalloc(tls_crl_pool, sizeof(struct tls_crl_set));
+  set->crl_file = crl_file ? pstrdup(tls_crl_pool, crl_file) : NULL;
+  set->crl_path = crl_path ? pstrdup(tls_crl_pool, crl_path) : NULL;
+
+  if (crl_file != NULL) {
+    if (tls_crl_set_load_file(set, crl_file) < 0) {
+      pr_log_pri(PR_LOG_NOTICE, MOD_TLS_VERSION
+        ": error loading TLSCARevocationFile '%s': %s", crl_file,
+        tls_get_errors());
+    }
+  }
+
+  if (crl_path != NULL) {
+    DIR *dirh;
+
+    PRIVS_ROOT
+    dirh = opendir(crl_path);
+    PRIVS_RELINQUISH
+
+    if (dirh != NULL) {
+      struct dirent *dent;
+      pool *tmp_pool;
+
+      tmp_pool = make_sub_pool(tls_crl_pool);
+
+      while ((dent = readdir(dirh)) != NULL) {
+        pr_signals_handle();
+
+        /* As for OpenSSL's hashed directory lookups, only the files named
+         * hash-value.rN are read.  This skips the CRL files to which these
+         * names are usually symlinked, which would otherwise be read twice.
+         */
+        if (tls_crl_is_hash_name(dent->d_name) == FALSE) {
+          continue;
+        }
+
+        (void) tls_crl_set_load_file(set,
+          pdircat(tmp_pool, crl_path, dent->d_name, NULL));
+      }
+
+      closedir(dirh);
+      destroy_pool(tmp_pool);
+
+    } else {
+      pr_log_pri(PR_LOG_NOTICE, MOD_TLS_VERSION
+        ": error loading TLSCARevocationPath '%s': %s", crl_path,
+        strerror(errno));
+    }
+  }
+
+  pr_log_debug(DEBUG5, MOD_TLS_VERSION
+    ": indexed %lu revoked %s from %u %s", set->nrevoked,
+    set->nrevoked != 1 ? "serials" : "serial", set->ncrls,
+    set->ncrls != 1 ? "CRLs" : "CRL");
+
+  set->next = tls_crl_sets;
+  tls_crl_sets = set;
+
+  return set;
+}
+
+/* Returns the CRL set for the given TLSCARevocationFile/TLSCARevocationPath,
+ * loading it if needed (e.g. when the paths were configured only for a
+ * <VirtualHost> selected by the HOST command).
+ */
+static struct tls_crl_set *tls_crl_set_get(const char *crl_file,
+    const char *crl_path) {
+  struct tls_crl_set *set;
+
+  for (set = tls_crl_sets; set; set = set->next) {
+    if (((crl_file == NULL && set->crl_file == NULL) ||
+         (crl_file != NULL && set->crl_file != NULL &&
+          strcmp(crl_file, set->crl_file) == 0)) &&
+        ((crl_path == NULL && set->crl_path == NULL) ||
+         (crl_path != NULL && set->crl_path != NULL &&
+          strcmp(crl_path, set->crl_path) == 0))) {
+      return set;
+    }
+  }
+
+  return tls_crl_set_load(crl_file, crl_path);
+}
+
+static void tls_crl_sets_free(void) {
+  struct tls_crl_set *set;
+  struct tls_crl_entry *entry;
+
+  for (set = tls_crl_sets; set; set = set->next) {
+    for (entry = set->crls; entry; entry = entry->next) {
+      X509_CRL_free(entry->crl);
+
+      if (entry->verified_pkey != NULL) {
+        EVP_PKEY_free(entry->verified_pkey);
+      }
+    }
+  }
+
+  tls_crl_sets = NULL;
+  tls_crl_set = NULL;
+
+  if (tls_crl_pool != NULL) {
+    destroy_pool(tls_crl_pool);
+    tls_crl_pool = NULL;
+  }
+}
+
+/* Parses and indexes the configured CRLs, in the daemon process, for
+ * inheriting by the session processes.
+ */
+static void tls_crl_init(void) {
+  server_rec *s;
+
+  tls_crl_sets_free();
+
+  for (s = (server_rec *) server_list->xas_list; s; s = s->next) {
+    const char *crl_file, *crl_path;
+
+    crl_file = get_param_ptr(s->conf, "TLSCARevocationFile", FALSE);
+    crl_path = get_param_ptr(s->conf, "TLSCARevocationPath", FALSE);
+
+    if (crl_file != NULL ||
+        crl_path != NULL) {
+      (void) tls_crl_set_get(crl_file, crl_path);
+    }
+  }
+}
+
+/* Returns the next CRL, after the given CRL (if any), issued by the given
+ * name.
+ */
+static struct tls_crl_entry *tls_crl_find(struct tls_crl_set *set,
+    struct tls_crl_entry *entry, X509_NAME *name) {
+  unsigned long name_hash;
+
+  name_hash = X509_NAME_hash(name);
+
+  for (entry = (entry ? entry->next : set->crls); entry; entry = entry->next) {
+    if (entry->issuer_hash == name_hash &&
+        X509_NAME_cmp(entry->issuer, name) == 0) {
+      return entry;
     }
   }
 
-  if (ok) {
-    pr_event_generate("mod_tls.verify-client", NULL);
+  return NULL;
+}
 
-  } else {
-    pr_event_generate("mod_tls.verify-client-failed", &verify_err);
+static int tls_crl_is_revoked(struct tls_crl_entry *entry,
+    ASN1_INTEGER *serial) {
+  struct tls_crl_serial *revoked;
+  unsigned int idx;
+
+  idx = tls_crl_serial_hash(serial) & (entry->nbuckets - 1);
+
+  for (revoked = entry->buckets[idx]; revoked; revoked = revoked->next) {
+    if (ASN1_INTEGER_cmp(revoked->serial, serial) == 0) {
+      return TRUE;
+    }
   }
 
-  return ok;
+  return FALSE;
 }
 
 /* This routine is (very much!) based on the work by Ralf S. Engelschall
  * <rse@engelshall.com>.  Comments by Ralf.
  */
 static int tls_verify_crl(int ok, X509_STORE_CTX *ctx) {
-  X509_OBJECT obj;
   X509_NAME *subject = NULL, *issuer = NULL;
   X509 *xs = NULL;
-  X509_CRL *crl = NULL;
-  X509_STORE_CTX store_ctx;
-  int n, res;
-  register int i = 0;
+  struct tls_crl_entry *entry;
+  int i, res;
 
-  /* Unless a revocation store for CRLs was created we cannot do any
-   * CRL-based verification, of course.
+  /* Unless CRLs were configured (and indexed) we cannot do any CRL-based
+   * verification, of course.
    */
-  if (!tls_crl_store) {
+  if (tls_crl_set == NULL) {
     return ok;
   }
 
@@ -5751,24 +7475,11 @@ static int tls_verify_crl(int ok, X509_STORE_CTX *ctx) {
    * well, of course.
    */
 
-  /* Try to retrieve a CRL corresponding to the _subject_ of
-   * the current certificate in order to verify its integrity.
+  /* Try to retrieve the CRLs corresponding to the _subject_ of
+   * the current certificate in order to verify their integrity.
    */
-  memset(&obj, 0, sizeof(obj));
-#if OPENSSL_VERSION_NUMBER > 0x000907000L
-  if (X509_STORE_CTX_init(&store_ctx, tls_crl_store, NULL, NULL) <= 0) {
-    tls_log("error initializing CRL store context: %s", tls_get_errors());
-    return ok;
-  }
-#else
-  X509_STORE_CTX_init(&store_ctx, tls_crl_store, NULL, NULL);
-#endif
-
-  res = X509_STORE_get_by_subject(&store_ctx, X509_LU_CRL, subject, &obj);
-  crl = obj.data.crl;
-
-  if (res > 0 &&
-      crl != NULL) {
+  for (entry = tls_crl_find(tls_crl_set, NULL, subject); entry;
+       entry = tls_crl_find(tls_crl_set, entry, subject)) {
     EVP_PKEY *pubkey;
     char buf[512];
     int len;
@@ -5778,10 +7489,10 @@ static int tls_verify_crl(int ok, X509_STORE_CTX *ctx) {
     X509_NAME_print(b, issuer, 0);
 
     BIO_printf(b, ", lastUpdate: ");
-    ASN1_UTCTIME_print(b, crl->crl->lastUpdate);
+    ASN1_UTCTIME_print(b, X509_CRL_get_lastUpdate(entry->crl));
 
     BIO_printf(b, ", nextUpdate: ");
-    ASN1_UTCTIME_print(b, crl->crl->nextUpdate);
+    ASN1_UTCTIME_print(b, X509_CRL_get_nextUpdate(entry->crl));
 
     len = BIO_read(b, buf, sizeof(buf) - 1);
     if (len >= sizeof(buf)) {
@@ -5795,8 +7506,26 @@ static int tls_verify_crl(int ok, X509_STORE_CTX *ctx) {
 
     pubkey = X509_get_pubkey(xs);
 
-    /* Verify the signature on this CRL */
-    res = X509_CRL_verify(crl, pubkey);
+    /* Verify the signature on this CRL.  Verifying the signature of a large
+     * CRL is expensive, so we remember the key which last verified it.
+     */
+    if (pubkey != NULL &&
+        entry->verified_pkey != NULL &&
+        EVP_PKEY_cmp(entry->verified_pkey, pubkey) == 1) {
+      res = 1;
+
+    } else {
+      res = X509_CRL_verify(entry->crl, pubkey);
+      if (res > 0 &&
+          pubkey != NULL) {
+        if (entry->verified_pkey != NULL) {
+          EVP_PKEY_free(entry->verified_pkey);
+        }
+
+        entry->verified_pkey = pubkey;
+        pubkey = NULL;
+      }
+    }
 
     if (pubkey) {
       EVP_PKEY_free(pubkey);
@@ -5806,18 +7535,14 @@ static int tls_verify_crl(int ok, X509_STORE_CTX *ctx) {
       tls_log("invalid signature on CRL: %s", tls_get_errors());
 
       X509_STORE_CTX_set_error(ctx, X509_V_ERR_CRL_SIGNATURE_FAILURE);
-      X509_OBJECT_free_contents(&obj);
-      X509_STORE_CTX_cleanup(&store_ctx);
       return FALSE;
     }
 
     /* Check date of CRL to make sure it's not expired */
-    i = X509_cmp_current_time(X509_CRL_get_nextUpdate(crl));
+    i = X509_cmp_current_time(X509_CRL_get_nextUpdate(entry->crl));
     if (i == 0) {
       tls_log("CRL has invalid nextUpdate field: %s", tls_get_errors());
       X509_STORE_CTX_set_error(ctx, X509_V_ERR_ERROR_IN_CRL_NEXT_UPDATE_FIELD);
-      X509_OBJECT_free_contents(&obj);
-      X509_STORE_CTX_cleanup(&store_ctx);
       return FALSE;
     }
 
@@ -5829,169 +7554,516 @@ static int tls_verify_crl(int ok, X509_STORE_CTX *ctx) {
       tls_log("%s", "CRL is expired, revoking all certificates until an "
         "updated CRL is obtained");
       X509_STORE_CTX_set_error(ctx, X509_V_ERR_CRL_HAS_EXPIRED);
-      X509_OBJECT_free_contents(&obj);
-      X509_STORE_CTX_cleanup(&store_ctx);
       return FALSE;
     }
+  }
+
+  /* Try to retrieve the CRLs corresponding to the _issuer_ of
+   * the current certificate in order to check for revocation.
+   */
+  for (entry = tls_crl_find(tls_crl_set, NULL, issuer); entry;
+       entry = tls_crl_find(tls_crl_set, entry, issuer)) {
+
+    /* Check if the current certificate is revoked by this CRL */
+    if (tls_crl_is_revoked(entry, X509_get_serialNumber(xs)) == TRUE) {
+      long serial = ASN1_INTEGER_get(X509_get_serialNumber(xs));
+      char *cp = tls_x509_name_oneline(issuer);
+
+      tls_log("certificate with serial number %ld (0x%lX) revoked per CRL "
+        "from issuer '%s'", serial, serial, cp ? cp : "(ERROR)");
+
+      X509_STORE_CTX_set_error(ctx, X509_V_ERR_CERT_REVOKED);
+      return FALSE;
+    }
+  }
+
+  return ok;
+}
+
+#if OPENSSL_VERSION_NUMBER > 0x000907000L
+/* Waits, until the given deadline, for the connection to the OCSP responder
+ * to become readable or writable, as the BIO requires.
+ */
+static int tls_ocsp_wait(BIO *bio, time_t deadline) {
+  int fd = -1, res;
+  fd_set fds;
+  struct timeval tv;
+  time_t now;
+
+  if (BIO_get_fd(bio, &fd) < 0 ||
+      fd < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  while (TRUE) {
+    now = time(NULL);
+    if (now >= deadline) {
+      errno = ETIMEDOUT;
+      return -1;
+    }
+
+    FD_ZERO(&fds);
+    FD_SET(fd, &fds);
+
+    tv.tv_sec = deadline - now;
+    tv.tv_usec = 0;
+
+    if (BIO_should_read(bio)) {
+      res = select(fd + 1, &fds, NULL, NULL, &tv);
+
+    } else {
+      res = select(fd + 1, NULL, &fds, NULL, &tv);
+    }
+
+    if (res < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      return -1;
+    }
+
+    if (res == 0) {
+      errno = ETIMEDOUT;
+      return -1;
+    }
+
+    return 0;
+  }
+}
+
+/* Sends the given request to the OCSP responder at the given URL, and
+ * returns the response, or NULL on error.  The entire exchange with the
+ * responder, including connecting to it, must complete within
+ * TLS_OCSP_RESPONDER_TIMEOUT_SECS.
+ */
+static OCSP_RESPONSE *tls_ocsp_query(const char *url, OCSP_REQUEST *req) {
+  BIO *conn;
+  char *host = NULL, *port = NULL, *uri = NULL;
+  int res, use_ssl = 0, timed_out = FALSE;
+  OCSP_REQ_CTX *req_ctx;
+  OCSP_RESPONSE *resp = NULL;
+  time_t deadline;
+
+  if (OCSP_parse_url((char *) url, &host, &port, &uri, &use_ssl) != 1) {
+    tls_log("error parsing OCSP URL '%s': %s", url, tls_get_errors());
+    return NULL;
+  }
+
+  /* XXX Need to check for NULL host, uri. */
+
+  if (port == NULL) {
+    if (use_ssl == 1) {
+#ifdef OPENSSL_strdup
+      port = OPENSSL_strdup("443");
+#else
+      port = OPENSSL_malloc(4);
+      sstrncpy(port, "443", 3);
+#endif /* OPENSSL_strdup */
+
+    } else {
+#ifdef OPENSSL_strdup
+      port = OPENSSL_strdup("80");
+#else
+      port = OPENSSL_malloc(3);
+      sstrncpy(port, "80", 2);
+#endif /* OPENSSL_strdup */
+    }
+  }
+
+  tls_log("connecting to OCSP responder at host '%s', port '%s', URI '%s'%s",
+    host, port, uri, use_ssl ? ", using SSL/TLS" : "");
+
+  /* Connect to the OCSP responder indicated */
+  conn = BIO_new_connect(host);
+  if (conn == NULL) {
+    tls_log("error creating connection BIO: %s", tls_get_errors());
+
+    OPENSSL_free(host);
+    OPENSSL_free(port);
+    OPENSSL_free(uri);
+
+    return NULL;
+  }
+
+  BIO_set_conn_port(conn, port);
+
+  /* If use_ssl is true, we need to push an SSL BIO onto the BIO chain, so
+   * that SSL/TLS actually happens.  The SSL_CTX object used for this is
+   * allocated once, and reused for any later queries.
+   */
+  if (use_ssl == 1) {
+    if (tls_ocsp_ssl_ctx == NULL) {
+      /* Note: this code used openssl/apps/ocsp.c as a model. */
+      tls_ocsp_ssl_ctx = SSL_CTX_new(SSLv23_client_method());
+      if (tls_ocsp_ssl_ctx != NULL) {
+        SSL_CTX_set_mode(tls_ocsp_ssl_ctx, SSL_MODE_AUTO_RETRY);
+
+      } else {
+        tls_log("error allocating SSL_CTX object for OCSP verification: %s",
+          tls_get_errors());
+      }
+    }
+
+    if (tls_ocsp_ssl_ctx != NULL) {
+      BIO *ocsp_ssl_bio;
+
+      ocsp_ssl_bio = BIO_new_ssl(tls_ocsp_ssl_ctx, 1);
+      if (ocsp_ssl_bio != NULL) {
+        conn = BIO_push(ocsp_ssl_bio, conn);
+      }
+    }
+  }
+
+  /* Use non-blocking IO, so that an unresponsive responder cannot stall
+   * the handshake (or the daemon process) indefinitely.
+   */
+  deadline = time(NULL) + TLS_OCSP_RESPONDER_TIMEOUT_SECS;
+  BIO_set_nbio(conn, 1);
+
+  res = BIO_do_connect(conn);
+  while (res <= 0 &&
+         BIO_should_retry(conn)) {
+    if (tls_ocsp_wait(conn, deadline) < 0) {
+      timed_out = (errno == ETIMEDOUT);
+      break;
+    }
+
+    res = BIO_do_connect(conn);
+  }
+
+  if (res <= 0) {
+    tls_log("error connecting to OCSP URL '%s': %s", url,
+      timed_out ? "timed out" : tls_get_errors());
+
+    BIO_free_all(conn);
+    OPENSSL_free(host);
+    OPENSSL_free(port);
+    OPENSSL_free(uri);
+
+    /* XXX Should we give the client the benefit of the doubt, and allow
+     * it to connect even though we can't talk to its OCSP responder?  Or
+     * do we fail-close, and penalize the client if the OCSP responder is
+     * down (e.g. for maintenance)?
+     */
+
+    return NULL;
+  }
+
+  if (tls_opts & TLS_OPT_ENABLE_DIAGS) {
+    BIO *bio;
+
+    bio = BIO_new(BIO_s_mem());
+    if (bio != NULL) {
+      if (OCSP_REQUEST_print(bio, req, 0) == 1) {
+        char *data = NULL;
+        long datalen;
+
+        datalen = BIO_get_mem_data(bio, &data);
+        if (data != NULL) {
+          data[datalen] = '\0';
+          tls_log("sending OCSP request (%ld bytes):\n%s", datalen, data);
+        }
+      }
+
+      BIO_free(bio);
+    }
+  }
+
+#if OPENSSL_VERSION_NUMBER >= 0x10000000L
+  req_ctx = OCSP_sendreq_new(conn, uri, NULL, -1);
+  if (req_ctx != NULL) {
+    if (OCSP_REQ_CTX_add1_header(req_ctx, "Host", host) != 1 ||
+        OCSP_REQ_CTX_set1_req(req_ctx, req) != 1) {
+      OCSP_REQ_CTX_free(req_ctx);
+      req_ctx = NULL;
+    }
+  }
+#else
+  req_ctx = OCSP_sendreq_new(conn, uri, req, -1);
+#endif /* OpenSSL-1.0.0 and later */
+
+  if (req_ctx == NULL) {
+    tls_log("error sending request to OCSP responder at '%s': %s", url,
+      tls_get_errors());
+
+    BIO_free_all(conn);
+    OPENSSL_free(host);
+    OPENSSL_free(port);
+    OPENSSL_free(uri);
+
+    return NULL;
+  }
+
+  res = OCSP_sendreq_nbio(&resp, req_ctx);
+  while (res == -1) {
+    if (tls_ocsp_wait(conn, deadline) < 0) {
+      timed_out = (errno == ETIMEDOUT);
+      break;
+    }
+
+    res = OCSP_sendreq_nbio(&resp, req_ctx);
+  }
+
+  OCSP_REQ_CTX_free(req_ctx);
+  BIO_free_all(conn);
+  OPENSSL_free(host);
+  OPENSSL_free(port);
+  OPENSSL_free(uri);
+
+  if (res != 1) {
+    tls_log("error receiving response from OCSP responder at '%s': %s", url,
+      timed_out ? "timed out" : tls_get_errors());
+    return NULL;
+  }
+
+  if (tls_opts & TLS_OPT_ENABLE_DIAGS) {
+    BIO *bio;
+
+    bio = BIO_new(BIO_s_mem());
+    if (bio != NULL) {
+      if (OCSP_RESPONSE_print(bio, resp, 0) == 1) {
+        char *data = NULL;
+        long datalen;
+
+        datalen = BIO_get_mem_data(bio, &data);
+        if (data != NULL) {
+          data[datalen] = '\0';
+          tls_log("received OCSP response (%ld bytes):\n%s", datalen, data);
+        }
+      }
+
+      BIO_free(bio);
+    }
+  }
+
+  return resp;
+}
+
+/* Returns TRUE if the given response contains a current status for the
+ * given cert ID.  If refresh_secs is non-zero, the status must remain
+ * current for that many more seconds.  Responses without a nextUpdate time
+ * are considered current for max_age seconds, unless max_age is -1.
+ */
+static int tls_ocsp_resp_is_current(OCSP_RESPONSE *resp, OCSP_CERTID *cert_id,
+    int refresh_secs, long max_age) {
+  OCSP_BASICRESP *basic_resp;
+  int res, ocsp_cert_status, ocsp_reason;
+  ASN1_GENERALIZEDTIME *revtime, *thisupd, *nextupd;
+
+  basic_resp = OCSP_response_get1_basic(resp);
+  if (basic_resp == NULL) {
+    ERR_clear_error();
+    return FALSE;
+  }
+
+  res = OCSP_resp_find_status(basic_resp, cert_id, &ocsp_cert_status,
+    &ocsp_reason, &revtime, &thisupd, &nextupd);
+  if (res == 1) {
+    res = OCSP_check_validity(thisupd, nextupd, TLS_OCSP_RESP_MAX_AGE_SECS,
+      nextupd != NULL ? -1 : max_age);
+  }
+
+  if (res == 1 &&
+      nextupd != NULL &&
+      refresh_secs > 0) {
+    time_t refresh_time;
+
+    refresh_time = time(NULL) + refresh_secs;
+    if (X509_cmp_time(nextupd, &refresh_time) <= 0) {
+      res = 0;
+    }
+  }
+
+  OCSP_BASICRESP_free(basic_resp);
+  ERR_clear_error();
 
-    X509_OBJECT_free_contents(&obj);
+  return (res == 1 ? TRUE : FALSE);
+}
+
+/* Returns the path of the TLSOCSPCache file for the given cert ID, or NULL
+ * if there is no TLSOCSPCache.
+ */
+static const char *tls_ocsp_cache_get_path(pool *p, OCSP_CERTID *cert_id) {
+  register unsigned int i;
+  static const char *hex_digits = "0123456789abcdef";
+  const char *cache_dir;
+  unsigned char *der = NULL, md[EVP_MAX_MD_SIZE];
+  unsigned int mdlen = 0;
+  int derlen, res;
+  char *file_name;
+
+  cache_dir = get_param_ptr(main_server->conf, "TLSOCSPCache", FALSE);
+  if (cache_dir == NULL) {
+    return NULL;
   }
 
-  /* Try to retrieve a CRL corresponding to the _issuer_ of
-   * the current certificate in order to check for revocation.
-   */
-  memset(&obj, 0, sizeof(obj));
-
-  res = X509_STORE_get_by_subject(&store_ctx, X509_LU_CRL, issuer, &obj);
-  crl = obj.data.crl;
+  derlen = i2d_OCSP_CERTID(cert_id, &der);
+  if (derlen <= 0) {
+    tls_log("error encoding OCSP cert ID: %s", tls_get_errors());
+    return NULL;
+  }
 
-  if (res > 0 &&
-      crl != NULL) {
+  res = EVP_Digest(der, derlen, md, &mdlen, EVP_sha1(), NULL);
+  OPENSSL_free(der);
 
-    /* Check if the current certificate is revoked by this CRL */
-    n = sk_X509_REVOKED_num(X509_CRL_get_REVOKED(crl));
+  if (res != 1) {
+    tls_log("error digesting OCSP cert ID: %s", tls_get_errors());
+    return NULL;
+  }
 
-    for (i = 0; i < n; i++) {
-      X509_REVOKED *revoked;
-      ASN1_INTEGER *sn;
+  file_name = pcalloc(p, (mdlen * 2) + 5);
+  for (i = 0; i < mdlen; i++) {
+    file_name[i * 2] = hex_digits[(md[i] >> 4) & 0x0f];
+    file_name[(i * 2) + 1] = hex_digits[md[i] & 0x0f];
+  }
+  sstrncpy(file_name + (mdlen * 2), ".der", 5);
 
-      revoked = sk_X509_REVOKED_value(X509_CRL_get_REVOKED(crl), i);
-      sn = revoked->serialNumber;
+  return pdircat(p, cache_dir, file_name, NULL);
+}
 
-      if (ASN1_INTEGER_cmp(sn, X509_get_serialNumber(xs)) == 0) {
-        long serial = ASN1_INTEGER_get(sn);
-        char *cp = tls_x509_name_oneline(issuer);
+/* Returns the cached response for the given cert ID, if there is one and
+ * it is still current.  Stale responses are removed from the cache.
+ */
+static OCSP_RESPONSE *tls_ocsp_cache_get(pool *p, OCSP_CERTID *cert_id) {
+  const char *path;
+  BIO *bio;
+  OCSP_RESPONSE *resp;
 
-        tls_log("certificate with serial number %ld (0x%lX) revoked per CRL "
-          "from issuer '%s'", serial, serial, cp ? cp : "(ERROR)");
+  path = tls_ocsp_cache_get_path(p, cert_id);
+  if (path == NULL) {
+    return NULL;
+  }
 
-        X509_STORE_CTX_set_error(ctx, X509_V_ERR_CERT_REVOKED);
-        X509_OBJECT_free_contents(&obj);
-        X509_STORE_CTX_cleanup(&store_ctx);
-        return FALSE;
-      }
-    }
+  PRIVS_ROOT
+  bio = BIO_new_file(path, "r");
+  PRIVS_RELINQUISH
 
-    X509_OBJECT_free_contents(&obj);
+  if (bio == NULL) {
+    ERR_clear_error();
+    pr_trace_msg(trace_channel, 17, "no cached OCSP response found at '%s'",
+      path);
+    return NULL;
   }
 
-  X509_STORE_CTX_cleanup(&store_ctx);
-  return ok;
-}
-
-#if OPENSSL_VERSION_NUMBER > 0x000907000L
-static int tls_verify_ocsp_url(X509_STORE_CTX *ctx, X509 *cert,
-    const char *url) {
-  BIO *conn;
-  X509 *issuing_cert = NULL;
-  X509_NAME *subj = NULL;
-  const char *subj_name;
-  char *host = NULL, *port = NULL, *uri = NULL;
-  int ok = FALSE, res = 0 , use_ssl = 0, ocsp_status, ocsp_cert_status,
-    ocsp_reason;
-  OCSP_REQUEST *req = NULL;
-  OCSP_CERTID *cert_id = NULL;
-  OCSP_RESPONSE *resp = NULL;
-  OCSP_BASICRESP *basic_resp = NULL;
-  SSL_CTX *ocsp_ssl_ctx = NULL;
-  ASN1_GENERALIZEDTIME *revtime, *thisupd, *nextupd;
+  resp = d2i_OCSP_RESPONSE_bio(bio, NULL);
+  BIO_free(bio);
 
-  if (cert == NULL ||
-      url == NULL) {
-    return FALSE;
+  if (resp != NULL &&
+      tls_ocsp_resp_is_current(resp, cert_id, 0,
+        TLS_OCSP_RESP_MAX_AGE_SECS) == TRUE) {
+    return resp;
   }
 
-  subj = X509_get_subject_name(cert);
-  subj_name = tls_x509_name_oneline(subj);
-
-  tls_log("checking OCSP URL '%s' for client cert '%s'", url, subj_name);
+  tls_log("removing stale OCSP response '%s' from cache", path);
+  ERR_clear_error();
 
-  if (OCSP_parse_url((char *) url, &host, &port, &uri, &use_ssl) != 1) {
-    tls_log("error parsing OCSP URL '%s': %s", url, tls_get_errors());
-    return FALSE;
+  if (resp != NULL) {
+    OCSP_RESPONSE_free(resp);
   }
 
-  /* XXX Need to check for NULL host, uri. */
+  PRIVS_ROOT
+  (void) unlink(path);
+  PRIVS_RELINQUISH
 
-  if (port == NULL) {
-    if (use_ssl == 1) {
-#ifdef OPENSSL_strdup
-      port = OPENSSL_strdup("443");
-#else
-      port = OPENSSL_malloc(4);
-      sstrncpy(port, "443", 3);
-#endif /* OPENSSL_strdup */
+  return NULL;
+}
 
-    } else {
-#ifdef OPENSSL_strdup
-      port = OPENSSL_strdup("80");
-#else
-      port = OPENSSL_malloc(3);
-      sstrncpy(port, "80", 2);
-#endif /* OPENSSL_strdup */
-    }
+/* Adds the given verified response for the given cert ID to the cache.  The
+ * response is written to a temporary file first, which is then renamed, so
+ * that other session processes never read a partially written response.
+ */
+static int tls_ocsp_cache_add(pool *p, OCSP_CERTID *cert_id,
+    OCSP_RESPONSE *resp) {
+  const char *path;
+  char *tmp_path;
+  BIO *bio;
+  int fd, res, xerrno;
+
+  path = tls_ocsp_cache_get_path(p, cert_id);
+  if (path == NULL) {
+    return 0;
   }
 
-  tls_log("connecting to OCSP responder at host '%s', port '%s', URI '%s'%s",
-    host, port, uri, use_ssl ? ", using SSL/TLS" : "");
+  /* Use mkstemp(3), so that the temporary file name cannot be predicted,
+   * and an existing file (or symlink) is never opened.
+   */
+  tmp_path = pstrcat(p, path, ".XXXXXX", NULL);
 
-  /* Connect to the OCSP responder indicated */
-  conn = BIO_new_connect(host);
-  if (conn == NULL) {
-    tls_log("error creating connection BIO: %s", tls_get_errors());
+  PRIVS_ROOT
+  fd = mkstemp(tmp_path);
+  xerrno = errno;
+  PRIVS_RELINQUISH
 
-    OPENSSL_free(host);
-    OPENSSL_free(port);
-    OPENSSL_free(uri);
+  if (fd < 0) {
+    tls_log("unable to cache OCSP response in '%s': %s", tmp_path,
+      strerror(xerrno));
 
-    return FALSE;
+    errno = xerrno;
+    return -1;
   }
 
-  BIO_set_conn_port(conn, port);
+  bio = BIO_new_fd(fd, BIO_CLOSE);
+  if (bio == NULL) {
+    (void) close(fd);
+    res = 0;
 
-  /* If use_ssl is true, we need to a) create an SSL_CTX object to use, and
-   * push it onto the BIO chain so that SSL/TLS actually happens.
-   * When doing so, what version of SSL/TLS should we use?
-   */
-  if (use_ssl == 1) {
-    BIO *ocsp_ssl_bio = NULL;
+  } else {
+    res = i2d_OCSP_RESPONSE_bio(bio, resp);
+    if (BIO_flush(bio) != 1) {
+      res = 0;
+    }
 
-    /* Note: this code used openssl/apps/ocsp.c as a model. */
-    ocsp_ssl_ctx = SSL_CTX_new(SSLv23_client_method());
-    if (ocsp_ssl_ctx != NULL) {
-      SSL_CTX_set_mode(ocsp_ssl_ctx, SSL_MODE_AUTO_RETRY);
+    BIO_free(bio);
+  }
 
-      ocsp_ssl_bio = BIO_new_ssl(ocsp_ssl_ctx, 1);
-      BIO_push(ocsp_ssl_bio, conn);
+  PRIVS_ROOT
+  if (res == 1) {
+    res = rename(tmp_path, path);
+    xerrno = errno;
 
-    } else {
-      tls_log("error allocating SSL_CTX object for OCSP verification: %s",
-        tls_get_errors());
-    }
+  } else {
+    (void) unlink(tmp_path);
+    res = -1;
+    xerrno = EIO;
   }
+  PRIVS_RELINQUISH
 
-  res = BIO_do_connect(conn);
-  if (res != 1) {
-    tls_log("error connecting to OCSP URL '%s': %s", url, tls_get_errors());
+  if (res < 0) {
+    tls_log("unable to cache OCSP response in '%s': %s", path,
+      strerror(xerrno));
+    ERR_clear_error();
 
-    if (ocsp_ssl_ctx != NULL) {
-      SSL_CTX_free(ocsp_ssl_ctx);
-    }
+    errno = xerrno;
+    return -1;
+  }
 
-    BIO_free_all(conn);
-    OPENSSL_free(host);
-    OPENSSL_free(port);
-    OPENSSL_free(uri);
+  pr_trace_msg(trace_channel, 17, "cached OCSP response in '%s'", path);
+  return 0;
+}
 
-    /* XXX Should we give the client the benefit of the doubt, and allow
-     * it to connect even though we can't talk to its OCSP responder?  Or
-     * do we fail-close, and penalize the client if the OCSP responder is
-     * down (e.g. for maintenance)?
-     */
+static int tls_verify_ocsp_url(pool *p, X509_STORE_CTX *ctx, X509 *cert,
+    const char *url) {
+  X509 *issuing_cert = NULL;
+  X509_NAME *subj = NULL;
+  const char *subj_name;
+  int ok = FALSE, res = 0, cached = FALSE, ocsp_status, ocsp_cert_status,
+    ocsp_reason;
+  OCSP_REQUEST *req = NULL;
+  OCSP_CERTID *cert_id = NULL, *req_cert_id = NULL;
+  OCSP_RESPONSE *resp = NULL;
+  OCSP_BASICRESP *basic_resp = NULL;
+  ASN1_GENERALIZEDTIME *revtime, *thisupd, *nextupd;
 
+  if (cert == NULL ||
+      url == NULL) {
     return FALSE;
   }
 
+  subj = X509_get_subject_name(cert);
+  subj_name = tls_x509_name_oneline(subj);
+
   /* XXX Why are we querying the OCSP responder about the client cert's
    * issuing CA, rather than querying about the client cert itself?
    */
@@ -6000,20 +8072,9 @@ static int tls_verify_ocsp_url(X509_STORE_CTX *ctx, X509 *cert,
   if (res != 1) {
     tls_log("error retrieving issuing cert for client cert '%s': %s",
       subj_name, tls_get_errors());
-
-    if (ocsp_ssl_ctx != NULL) {
-      SSL_CTX_free(ocsp_ssl_ctx);
-    }
-
-    BIO_free_all(conn);
-    OPENSSL_free(host);
-    OPENSSL_free(port);
-    OPENSSL_free(uri);
-
     return FALSE;
   }
 
-  /* Note that the cert_id value will be freed when the request is freed. */
   cert_id = OCSP_cert_to_id(NULL, cert, issuing_cert);
   if (cert_id == NULL) {
     const char *issuer_subj_name = tls_x509_name_oneline(
@@ -6022,216 +8083,137 @@ static int tls_verify_ocsp_url(X509_STORE_CTX *ctx, X509 *cert,
     tls_log("error converting client cert '%s' and its issuing cert '%s' "
       "to an OCSP cert ID: %s", subj_name, issuer_subj_name, tls_get_errors());
 
-    if (ocsp_ssl_ctx != NULL) {
-      SSL_CTX_free(ocsp_ssl_ctx);
-    }
-
-    X509_free(issuing_cert);
-    BIO_free_all(conn);
-    OPENSSL_free(host);
-    OPENSSL_free(port);
-    OPENSSL_free(uri);
-
-    return FALSE;
-  }
-
-  req = OCSP_REQUEST_new();
-  if (req == NULL) {
-    tls_log("unable to allocate OCSP request: %s", tls_get_errors());
-
-    if (ocsp_ssl_ctx != NULL) {
-      SSL_CTX_free(ocsp_ssl_ctx);
-    }
-
-    X509_free(issuing_cert);
-    BIO_free_all(conn);
-    OPENSSL_free(host);
-    OPENSSL_free(port);
-    OPENSSL_free(uri);
-
-    return FALSE;
-  }
-
-  if (OCSP_request_add0_id(req, cert_id) == NULL) {
-    tls_log("error adding cert ID to OCSP request: %s", tls_get_errors());
-
-    if (ocsp_ssl_ctx != NULL) {
-      SSL_CTX_free(ocsp_ssl_ctx);
-    }
-
-    OCSP_REQUEST_free(req);
     X509_free(issuing_cert);
-    BIO_free_all(conn);
-    OPENSSL_free(host);
-    OPENSSL_free(port);
-    OPENSSL_free(uri);
-
     return FALSE;
   }
 
-# if 0
-  /* XXX ideally we would set the requestor name to the subject name of the
-   * cert configured via TLS{DSA,RSA}CertificateFile here.
+  /* Check for a cached response from an earlier verification of this cert,
+   * possibly by another session process, first.
    */
-  if (OCSP_request_set1_name(req, /* server cert X509_NAME subj name */) != 1) {
-    tls_log("error adding requestor name '%s' to OCSP request: %s",
-      requestor_name, tls_get_errors());
-
-    if (ocsp_ssl_ctx != NULL) {
-      SSL_CTX_free(ocsp_ssl_ctx);
-    }
-
-    OCSP_REQUEST_free(req);
-    X509_free(issuing_cert);
-    BIO_free_all(conn);
-    OPENSSL_free(host);
-    OPENSSL_free(port);
-    OPENSSL_free(uri);
+  resp = tls_ocsp_cache_get(p, cert_id);
+  if (resp != NULL) {
+    tls_log("using cached OCSP response for client cert '%s'", subj_name);
+    cached = TRUE;
 
-    return FALSE;
-  }
-# endif
+  } else {
+    tls_log("checking OCSP URL '%s' for client cert '%s'", url, subj_name);
 
-  res = OCSP_request_add1_nonce(req, NULL, 0);
-  if (res != 1) {
-    tls_log("error adding nonce to OCSP request: %s", tls_get_errors());
+    req = OCSP_REQUEST_new();
+    if (req == NULL) {
+      tls_log("unable to allocate OCSP request: %s", tls_get_errors());
 
-    if (ocsp_ssl_ctx != NULL) {
-      SSL_CTX_free(ocsp_ssl_ctx);
+      OCSP_CERTID_free(cert_id);
+      X509_free(issuing_cert);
+      return FALSE;
     }
 
-    OCSP_REQUEST_free(req);
-    X509_free(issuing_cert);
-    BIO_free_all(conn);
-    OPENSSL_free(host);
-    OPENSSL_free(port);
-    OPENSSL_free(uri);
-
-    return FALSE;
-  }
-
-  if (tls_opts & TLS_OPT_ENABLE_DIAGS) {
-    BIO *bio;
-
-    bio = BIO_new(BIO_s_mem());
-    if (bio != NULL) {
-      if (OCSP_REQUEST_print(bio, req, 0) == 1) {
-        char *data = NULL;
-        long datalen;
+    /* Note that the req_cert_id value will be freed when the request is
+     * freed; we keep our cert_id for looking up the status in the response,
+     * and for caching the response.
+     */
+    req_cert_id = OCSP_CERTID_dup(cert_id);
+    if (req_cert_id == NULL ||
+        OCSP_request_add0_id(req, req_cert_id) == NULL) {
+      tls_log("error adding cert ID to OCSP request: %s", tls_get_errors());
 
-        datalen = BIO_get_mem_data(bio, &data);
-        if (data != NULL) {
-          data[datalen] = '\0';
-          tls_log("sending OCSP request (%ld bytes):\n%s", datalen, data);
-        }
+      if (req_cert_id != NULL) {
+        OCSP_CERTID_free(req_cert_id);
       }
 
-      BIO_free(bio);
+      OCSP_REQUEST_free(req);
+      OCSP_CERTID_free(cert_id);
+      X509_free(issuing_cert);
+      return FALSE;
     }
-  }
 
-  resp = OCSP_sendreq_bio(conn, uri, req);
-
-  if (resp == NULL) {
-    tls_log("error receiving response from OCSP responder at '%s': %s", url,
-      tls_get_errors());
+# if 0
+    /* XXX ideally we would set the requestor name to the subject name of the
+     * cert configured via TLS{DSA,RSA}CertificateFile here.
+     */
+    if (OCSP_request_set1_name(req, /* server cert X509_NAME subj name */) != 1) {
+      tls_log("error adding requestor name '%s' to OCSP request: %s",
+        requestor_name, tls_get_errors());
 
-    if (ocsp_ssl_ctx != NULL) {
-      SSL_CTX_free(ocsp_ssl_ctx);
+      OCSP_REQUEST_free(req);
+      OCSP_CERTID_free(cert_id);
+      X509_free(issuing_cert);
+      return FALSE;
     }
+# endif
 
-    OCSP_REQUEST_free(req);
-    X509_free(issuing_cert);
-    BIO_free_all(conn);
-    OPENSSL_free(host);
-    OPENSSL_free(port);
-    OPENSSL_free(uri);
-
-    return FALSE;
-  }
-
-  if (tls_opts & TLS_OPT_ENABLE_DIAGS) {
-    BIO *bio;
-
-    bio = BIO_new(BIO_s_mem());
-    if (bio != NULL) {
-      if (OCSP_RESPONSE_print(bio, resp, 0) == 1) {
-        char *data = NULL;
-        long datalen;
+    res = OCSP_request_add1_nonce(req, NULL, 0);
+    if (res != 1) {
+      tls_log("error adding nonce to OCSP request: %s", tls_get_errors());
 
-        datalen = BIO_get_mem_data(bio, &data);
-        if (data != NULL) {
-          data[datalen] = '\0';
-          tls_log("received OCSP response (%ld bytes):\n%s", datalen, data);
-        }
-      }
+      OCSP_REQUEST_free(req);
+      OCSP_CERTID_free(cert_id);
+      X509_free(issuing_cert);
+      return FALSE;
+    }
 
-      BIO_free(bio);
+    resp = tls_ocsp_query(url, req);
+    if (resp == NULL) {
+      OCSP_REQUEST_free(req);
+      OCSP_CERTID_free(cert_id);
+      X509_free(issuing_cert);
+      return FALSE;
     }
   }
 
-  tls_log("checking response from OCSP responder at URL '%s' for client cert "
-    "'%s'", url, subj_name);
+  tls_log("checking %sresponse from OCSP responder at URL '%s' for client "
+    "cert '%s'", cached ? "cached " : "", url, subj_name);
 
   basic_resp = OCSP_response_get1_basic(resp);
   if (basic_resp == NULL) {
     tls_log("error retrieving basic response from OCSP responder at '%s': %s",
       url, tls_get_errors());
 
-    if (ocsp_ssl_ctx != NULL) {
-      SSL_CTX_free(ocsp_ssl_ctx);
+    if (req != NULL) {
+      OCSP_REQUEST_free(req);
     }
 
     OCSP_RESPONSE_free(resp);
-    OCSP_REQUEST_free(req);
+    OCSP_CERTID_free(cert_id);
     X509_free(issuing_cert);
-    BIO_free_all(conn);
-    OPENSSL_free(host);
-    OPENSSL_free(port);
-    OPENSSL_free(uri);
-
     return FALSE;
   }
 
-  res = OCSP_check_nonce(req, basic_resp);
-  if (res != 1) {
-    tls_log("unable to use response from OCSP responder at '%s': bad nonce",
-      url);
-
-    if (ocsp_ssl_ctx != NULL) {
-      SSL_CTX_free(ocsp_ssl_ctx);
+  /* A cached response was given for an earlier request, thus we can only
+   * check the nonce of a fresh response.
+   */
+  if (req != NULL) {
+    res = OCSP_check_nonce(req, basic_resp);
+    if (res != 1) {
+      tls_log("unable to use response from OCSP responder at '%s': bad nonce",
+        url);
+
+      OCSP_BASICRESP_free(basic_resp);
+      OCSP_RESPONSE_free(resp);
+      OCSP_REQUEST_free(req);
+      OCSP_CERTID_free(cert_id);
+      X509_free(issuing_cert);
+      return FALSE;
     }
-
-    OCSP_BASICRESP_free(basic_resp);
-    OCSP_RESPONSE_free(resp);
-    OCSP_REQUEST_free(req);
-    X509_free(issuing_cert);
-    BIO_free_all(conn);
-    OPENSSL_free(host);
-    OPENSSL_free(port);
-    OPENSSL_free(uri);
-
-    return FALSE;
   }
 
-  res = OCSP_basic_verify(basic_resp, NULL, ctx->ctx, 0);
+  /* Cached responses are verified again as well; this is much cheaper than
+   * querying the responder, and means that we need not trust the contents
+   * of the cache.
+   */
+  res = OCSP_basic_verify(basic_resp, NULL, X509_STORE_CTX_get0_store(ctx),
+    0);
   if (res != 1) {
     tls_log("error verifying basic response from OCSP responder at '%s': %s",
       url, tls_get_errors());
 
-    if (ocsp_ssl_ctx != NULL) {
-      SSL_CTX_free(ocsp_ssl_ctx);
+    if (req != NULL) {
+      OCSP_REQUEST_free(req);
     }
 
-    OCSP_REQUEST_free(req);
     OCSP_BASICRESP_free(basic_resp);
     OCSP_RESPONSE_free(resp);
+    OCSP_CERTID_free(cert_id);
     X509_free(issuing_cert);
-    BIO_free_all(conn);
-    OPENSSL_free(host);
-    OPENSSL_free(port);
-    OPENSSL_free(uri);
-
     return FALSE;
   }
 
@@ -6248,18 +8230,14 @@ static int tls_verify_ocsp_url(X509_STORE_CTX *ctx, X509 *cert,
       "response status '%s' (%d)", subj_name, url,
       OCSP_response_status_str(ocsp_status), ocsp_status);
 
-    if (ocsp_ssl_ctx != NULL) {
-      SSL_CTX_free(ocsp_ssl_ctx);
+    if (req != NULL) {
+      OCSP_REQUEST_free(req);
     }
 
-    OCSP_REQUEST_free(req);
     OCSP_BASICRESP_free(basic_resp);
     OCSP_RESPONSE_free(resp);
+    OCSP_CERTID_free(cert_id);
     X509_free(issuing_cert);
-    BIO_free_all(conn);
-    OPENSSL_free(host);
-    OPENSSL_free(port);
-    OPENSSL_free(uri);
 
     switch (ocsp_status) {
       case OCSP_RESPONSE_STATUS_MALFORMEDREQUEST:
@@ -6289,19 +8267,14 @@ static int tls_verify_ocsp_url(X509_STORE_CTX *ctx, X509 *cert,
     tls_log("unable to retrieve cert status from OCSP response: %s",
       tls_get_errors());
 
-    if (ocsp_ssl_ctx != NULL) {
-      SSL_CTX_free(ocsp_ssl_ctx);
+    if (req != NULL) {
+      OCSP_REQUEST_free(req);
     }
 
-    OCSP_REQUEST_free(req);
     OCSP_BASICRESP_free(basic_resp);
     OCSP_RESPONSE_free(resp);
+    OCSP_CERTID_free(cert_id);
     X509_free(issuing_cert);
-    BIO_free_all(conn);
-    OPENSSL_free(host);
-    OPENSSL_free(port);
-    OPENSSL_free(uri);
-
     return FALSE;
   }
 
@@ -6311,19 +8284,14 @@ static int tls_verify_ocsp_url(X509_STORE_CTX *ctx, X509 *cert,
     tls_log("unable validate OCSP response timestamps: %s",
       tls_get_errors());
 
-    if (ocsp_ssl_ctx != NULL) {
-      SSL_CTX_free(ocsp_ssl_ctx);
+    if (req != NULL) {
+      OCSP_REQUEST_free(req);
     }
 
-    OCSP_REQUEST_free(req);
     OCSP_BASICRESP_free(basic_resp);
     OCSP_RESPONSE_free(resp);
+    OCSP_CERTID_free(cert_id);
     X509_free(issuing_cert);
-    BIO_free_all(conn);
-    OPENSSL_free(host);
-    OPENSSL_free(port);
-    OPENSSL_free(uri);
-
     return FALSE;
   }
 
@@ -6331,6 +8299,10 @@ static int tls_verify_ocsp_url(X509_STORE_CTX *ctx, X509 *cert,
     "at '%s'", subj_name, OCSP_cert_status_str(ocsp_cert_status),
     ocsp_cert_status, url);
 
+  if (cached == FALSE) {
+    (void) tls_ocsp_cache_add(p, cert_id, resp);
+  }
+
   switch (ocsp_cert_status) {
     case V_OCSP_CERTSTATUS_GOOD:
       ok = TRUE;
@@ -6338,7 +8310,8 @@ static int tls_verify_ocsp_url(X509_STORE_CTX *ctx, X509 *cert,
 
     case V_OCSP_CERTSTATUS_REVOKED:
       tls_log("client cert '%s' has '%s' status due to: %s", subj_name,
-        OCSP_cert_status_str(ocsp_status), OCSP_crl_reason_str(ocsp_reason));
+        OCSP_cert_status_str(ocsp_cert_status),
+        OCSP_crl_reason_str(ocsp_reason));
       ok = FALSE;
       break;
 
@@ -6356,18 +8329,14 @@ static int tls_verify_ocsp_url(X509_STORE_CTX *ctx, X509 *cert,
       ok = FALSE;
   }
 
-  if (ocsp_ssl_ctx != NULL) {
-    SSL_CTX_free(ocsp_ssl_ctx);
+  if (req != NULL) {
+    OCSP_REQUEST_free(req);
   }
 
-  OCSP_REQUEST_free(req);
   OCSP_BASICRESP_free(basic_resp);
   OCSP_RESPONSE_free(resp);
+  OCSP_CERTID_free(cert_id);
   X509_free(issuing_cert);
-  BIO_free_all(conn);
-  OPENSSL_free(host);
-  OPENSSL_free(port);
-  OPENSSL_free(uri);
 
   return ok;
 }
@@ -6401,54 +8370,429 @@ static int tls_verify_ocsp(int ok, X509_STORE_CTX *ctx) {
     return ok;
   }
 
-  for (i = 0; i < sk_ACCESS_DESCRIPTION_num(descs); i++) {
-    ACCESS_DESCRIPTION *desc = sk_ACCESS_DESCRIPTION_value(descs, i);
+  for (i = 0; i < sk_ACCESS_DESCRIPTION_num(descs); i++) {
+    ACCESS_DESCRIPTION *desc = sk_ACCESS_DESCRIPTION_value(descs, i);
+
+    if (OBJ_obj2nid(desc->method) == NID_ad_OCSP) {
+      /* Found an OCSP AuthorityInfoAccess attribute */
+
+      if (desc->location->type != GEN_URI) {
+        /* Not a valid URI, ignore it. */
+        continue;
+      }
+
+      /* Add this URL to the list of OCSP URLs to check. */
+      if (ocsp_urls == NULL) {
+        tmp_pool = make_sub_pool(session.pool);
+        ocsp_urls = make_array(tmp_pool, 1, sizeof(char *));
+      }
+
+      *((char **) push_array(ocsp_urls)) = pstrdup(tmp_pool,
+        (char *) desc->location->d.uniformResourceIdentifier->data);
+    }
+  }
+
+  if (ocsp_urls == NULL) {
+    tls_log("found no OCSP URLs in AuthorityInfoAccess attribute for client "
+      "cert '%s', unable to verify via OCSP", subj);
+    AUTHORITY_INFO_ACCESS_free(descs);
+    return ok;
+  }
+
+  tls_log("found %u OCSP %s in AuthorityInfoAccess attribute for client cert "
+    "'%s'", ocsp_urls->nelts, ocsp_urls->nelts != 1 ? "URLs" : "URL", subj);
+
+  /* Check each of the URLs. */
+  for (i = 0; i < ocsp_urls->nelts; i++) {
+    char *url = ((char **) ocsp_urls->elts)[i];
+
+    ok = tls_verify_ocsp_url(tmp_pool, ctx, cert, url);
+    if (ok)
+      break;
+  }
+
+  destroy_pool(tmp_pool);
+  AUTHORITY_INFO_ACCESS_free(descs);
+
+  return ok;
+#else
+  return ok;
+#endif
+}
+
+#ifdef TLS_USE_OCSP_STAPLING
+static void tls_ocsp_staples_free(void) {
+  struct tls_ocsp_staple *staple;
+
+  for (staple = tls_ocsp_staples; staple; staple = staple->next) {
+    X509_free(staple->cert);
+    OCSP_CERTID_free(staple->cert_id);
+
+    if (staple->resp != NULL) {
+      OCSP_RESPONSE_free(staple->resp);
+    }
+  }
+
+  tls_ocsp_staples = NULL;
+
+  if (tls_ocsp_staple_pool != NULL) {
+    destroy_pool(tls_ocsp_staple_pool);
+    tls_ocsp_staple_pool = NULL;
+  }
+}
+
+/* Looks up the issuer of the given server cert, using the certs in the
+ * TLSCertificateChainFile and TLSCACertificate{File,Path} of the server.
+ */
+static X509 *tls_ocsp_get_issuer(server_rec *s, X509 *cert) {
+  const char *ca_file, *ca_path, *chain_file;
+  X509 *issuer = NULL;
+  X509_STORE *store;
+  X509_STORE_CTX *store_ctx;
+
+  store = X509_STORE_new();
+  if (store == NULL) {
+    return NULL;
+  }
+
+  ca_file = get_param_ptr(s->conf, "TLSCACertificateFile", FALSE);
+  ca_path = get_param_ptr(s->conf, "TLSCACertificatePath", FALSE);
+
+  if (ca_file != NULL ||
+      ca_path != NULL) {
+    PRIVS_ROOT
+    (void) X509_STORE_load_locations(store, ca_file, ca_path);
+    PRIVS_RELINQUISH
+  }
+
+  chain_file = get_param_ptr(s->conf, "TLSCertificateChainFile", FALSE);
+  if (chain_file != NULL) {
+    BIO *bio;
+
+    PRIVS_ROOT
+    bio = BIO_new_file(chain_file, "r");
+    PRIVS_RELINQUISH
+
+    if (bio != NULL) {
+      X509 *chain_cert;
+
+      while ((chain_cert = PEM_read_bio_X509(bio, NULL, NULL, NULL)) != NULL) {
+        (void) X509_STORE_add_cert(store, chain_cert);
+        X509_free(chain_cert);
+      }
+
+      BIO_free(bio);
+    }
+  }
+
+  /* Errors from the above (e.g. duplicate certs, or reaching the end of the
+   * chain file) do not matter, so long as the issuer is found.
+   */
+  ERR_clear_error();
+
+  store_ctx = X509_STORE_CTX_new();
+  if (store_ctx != NULL) {
+    if (X509_STORE_CTX_init(store_ctx, store, cert, NULL) == 1) {
+      if (X509_STORE_CTX_get1_issuer(&issuer, store_ctx, cert) != 1) {
+        issuer = NULL;
+      }
+    }
+
+    X509_STORE_CTX_free(store_ctx);
+  }
+
+  X509_STORE_free(store);
+  return issuer;
+}
+
+static void tls_ocsp_staple_add(server_rec *s, const char *cert_file) {
+  struct tls_ocsp_staple *staple;
+  BIO *bio;
+  X509 *cert, *issuer;
+  OCSP_CERTID *cert_id;
+  const char *subj_name, *url;
+
+  PRIVS_ROOT
+  bio = BIO_new_file(cert_file, "r");
+  PRIVS_RELINQUISH
+
+  if (bio == NULL) {
+    pr_log_pri(PR_LOG_NOTICE, MOD_TLS_VERSION
+      ": unable to read server cert '%s' for OCSP stapling: %s", cert_file,
+      tls_get_errors());
+    return;
+  }
+
+  cert = PEM_read_bio_X509(bio, NULL, NULL, NULL);
+  BIO_free(bio);
+
+  if (cert == NULL) {
+    pr_log_pri(PR_LOG_NOTICE, MOD_TLS_VERSION
+      ": unable to read server cert '%s' for OCSP stapling: %s", cert_file,
+      tls_get_errors());
+    return;
+  }
+
+  subj_name = pstrdup(tls_ocsp_staple_pool,
+    tls_x509_name_oneline(X509_get_subject_name(cert)));
+
+  url = get_param_ptr(s->conf, "TLSStaplingResponder", FALSE);
+  if (url == NULL) {
+    STACK_OF(OPENSSL_STRING) *ocsp_urls;
+
+    ocsp_urls = X509_get1_ocsp(cert);
+    if (ocsp_urls != NULL) {
+      if (sk_OPENSSL_STRING_num(ocsp_urls) > 0) {
+        url = pstrdup(tls_ocsp_staple_pool,
+          sk_OPENSSL_STRING_value(ocsp_urls, 0));
+      }
+
+      X509_email_free(ocsp_urls);
+    }
+  }
+
+  if (url == NULL) {
+    pr_log_pri(PR_LOG_NOTICE, MOD_TLS_VERSION
+      ": server cert '%s' has no OCSP responder URL, and no "
+      "TLSStaplingResponder configured; not stapling OCSP responses",
+      subj_name);
+    X509_free(cert);
+    return;
+  }
+
+  issuer = tls_ocsp_get_issuer(s, cert);
+  if (issuer == NULL) {
+    pr_log_pri(PR_LOG_NOTICE, MOD_TLS_VERSION
+      ": unable to find issuing cert for server cert '%s' (check "
+      "TLSCertificateChainFile); not stapling OCSP responses", subj_name);
+    X509_free(cert);
+    return;
+  }
+
+  cert_id = OCSP_cert_to_id(NULL, cert, issuer);
+  X509_free(issuer);
+
+  if (cert_id == NULL) {
+    pr_log_pri(PR_LOG_NOTICE, MOD_TLS_VERSION
+      ": error converting server cert '%s' to an OCSP cert ID: %s", subj_name,
+      tls_get_errors());
+    X509_free(cert);
+    return;
+  }
+
+  staple = pcalloc(tls_ocsp_staple_pool, sizeof(struct tls_ocsp_staple));
+  staple->server = s;
+  staple->url = url;
+  staple->subj_name = subj_name;
+  staple->cert = cert;
+  staple->cert_id = cert_id;
+
+  staple->next = tls_ocsp_staples;
+  tls_ocsp_staples = staple;
+}
+
+/* Fetches a fresh response for the given staple.  The previous response, if
+ * any, is kept if this fails.  Note that the signature of the response is
+ * not verified here; that is left to the clients to which it is stapled.
+ */
+static int tls_ocsp_staple_fetch(struct tls_ocsp_staple *staple) {
+  OCSP_REQUEST *req;
+  OCSP_CERTID *req_cert_id;
+  OCSP_RESPONSE *resp;
+  OCSP_BASICRESP *basic_resp;
+  int ok = FALSE;
+
+  req = OCSP_REQUEST_new();
+  if (req == NULL) {
+    return -1;
+  }
+
+  /* Note that the req_cert_id value will be freed when the request is
+   * freed.
+   */
+  req_cert_id = OCSP_CERTID_dup(staple->cert_id);
+  if (req_cert_id != NULL &&
+      OCSP_request_add0_id(req, req_cert_id) == NULL) {
+    OCSP_CERTID_free(req_cert_id);
+    req_cert_id = NULL;
+  }
+
+  if (req_cert_id == NULL ||
+      OCSP_request_add1_nonce(req, NULL, 0) != 1) {
+    pr_log_pri(PR_LOG_NOTICE, MOD_TLS_VERSION
+      ": error creating OCSP request for server cert '%s': %s",
+      staple->subj_name, tls_get_errors());
+
+    OCSP_REQUEST_free(req);
+    return -1;
+  }
+
+  resp = tls_ocsp_query(staple->url, req);
+  if (resp == NULL) {
+    pr_log_pri(PR_LOG_NOTICE, MOD_TLS_VERSION
+      ": unable to fetch OCSP response for server cert '%s' from '%s'",
+      staple->subj_name, staple->url);
+    OCSP_REQUEST_free(req);
+    return -1;
+  }
+
+  if (OCSP_response_status(resp) == OCSP_RESPONSE_STATUS_SUCCESSFUL) {
+    basic_resp = OCSP_response_get1_basic(resp);
+    if (basic_resp != NULL) {
+      /* Not all responders include the nonce; only a mismatched nonce is
+       * a problem.
+       */
+      if (OCSP_check_nonce(req, basic_resp) != 0) {
+        ok = tls_ocsp_resp_is_current(resp, staple->cert_id, 0, -1);
+      }
+
+      OCSP_BASICRESP_free(basic_resp);
+    }
+  }
+
+  OCSP_REQUEST_free(req);
+  ERR_clear_error();
+
+  if (ok == FALSE) {
+    pr_log_pri(PR_LOG_NOTICE, MOD_TLS_VERSION
+      ": unusable OCSP response for server cert '%s' from '%s', ignoring",
+      staple->subj_name, staple->url);
+    OCSP_RESPONSE_free(resp);
+    return -1;
+  }
+
+  if (staple->resp != NULL) {
+    OCSP_RESPONSE_free(staple->resp);
+  }
+
+  staple->resp = resp;
+  staple->fetched = time(NULL);
+
+  pr_log_debug(DEBUG5, MOD_TLS_VERSION
+    ": fetched OCSP response for server cert '%s' from '%s'",
+    staple->subj_name, staple->url);
+  return 0;
+}
+
+static void tls_ocsp_staples_refresh(void) {
+  struct tls_ocsp_staple *staple;
+
+  for (staple = tls_ocsp_staples; staple; staple = staple->next) {
+    if (staple->resp != NULL &&
+        tls_ocsp_resp_is_current(staple->resp, staple->cert_id,
+          TLS_OCSP_STAPLING_REFRESH_SECS, TLS_OCSP_RESP_MAX_AGE_SECS) == TRUE) {
+      continue;
+    }
+
+    (void) tls_ocsp_staple_fetch(staple);
+  }
+}
+
+static int tls_ocsp_staple_timer_cb(CALLBACK_FRAME) {
+  tls_ocsp_staples_refresh();
+
+  /* Always restart the timer. */
+  return 1;
+}
+
+static int tls_ocsp_stapling_cb(SSL *ssl, void *user_data) {
+  struct tls_ocsp_staple *staple;
+  X509 *cert;
+  unsigned char *der = NULL;
+  int derlen;
+
+  cert = SSL_get_certificate(ssl);
+  if (cert == NULL) {
+    return SSL_TLSEXT_ERR_NOACK;
+  }
+
+  for (staple = tls_ocsp_staples; staple; staple = staple->next) {
+    if (staple->server == main_server &&
+        X509_cmp(staple->cert, cert) == 0) {
+      break;
+    }
+  }
+
+  if (staple == NULL ||
+      staple->resp == NULL) {
+    tls_log("%s", "no OCSP response available for stapling");
+    return SSL_TLSEXT_ERR_NOACK;
+  }
+
+  if (tls_ocsp_resp_is_current(staple->resp, staple->cert_id, 0,
+      -1) == FALSE) {
+    tls_log("OCSP response for server cert '%s' is no longer current, "
+      "not stapling", staple->subj_name);
+    return SSL_TLSEXT_ERR_NOACK;
+  }
+
+  derlen = i2d_OCSP_RESPONSE(staple->resp, &der);
+  if (derlen <= 0) {
+    tls_log("error encoding OCSP response for stapling: %s", tls_get_errors());
+    return SSL_TLSEXT_ERR_NOACK;
+  }
 
-    if (OBJ_obj2nid(desc->method) == NID_ad_OCSP) {
-      /* Found an OCSP AuthorityInfoAccess attribute */
+  /* OpenSSL takes ownership of the encoded response. */
+  SSL_set_tlsext_status_ocsp_resp(ssl, der, derlen);
 
-      if (desc->location->type != GEN_URI) {
-        /* Not a valid URI, ignore it. */
-        continue;
-      }
+  tls_log("stapled OCSP response (%d bytes) for server cert '%s'", derlen,
+    staple->subj_name);
+  return SSL_TLSEXT_ERR_OK;
+}
+#endif /* TLS_USE_OCSP_STAPLING */
 
-      /* Add this URL to the list of OCSP URLs to check. */
-      if (ocsp_urls == NULL) {
-        tmp_pool = make_sub_pool(session.pool);
-        ocsp_urls = make_array(tmp_pool, 1, sizeof(char *));
-      }
+/* Fetches the OCSP responses for stapling, and starts the refresh timer, in
+ * the daemon process.
+ */
+static void tls_ocsp_stapling_init(void) {
+#ifdef TLS_USE_OCSP_STAPLING
+  server_rec *s;
 
-      *((char **) push_array(ocsp_urls)) = pstrdup(tmp_pool,
-        (char *) desc->location->d.uniformResourceIdentifier->data);
+  pr_timer_remove(tls_ocsp_staple_timerno, &tls_module);
+  tls_ocsp_staple_timerno = -1;
+
+  tls_ocsp_staples_free();
+
+  for (s = (server_rec *) server_list->xas_list; s; s = s->next) {
+    register unsigned int i;
+    config_rec *c;
+    const char *cert_params[] = {
+      "TLSRSACertificateFile",
+      "TLSDSACertificateFile",
+      "TLSECCertificateFile",
+      NULL
+    };
+
+    c = find_config(s->conf, CONF_PARAM, "TLSStapling", FALSE);
+    if (c == NULL ||
+        *((int *) c->argv[0]) == FALSE) {
+      continue;
     }
-  }
 
-  if (ocsp_urls == NULL) {
-    tls_log("found no OCSP URLs in AuthorityInfoAccess attribute for client "
-      "cert '%s', unable to verify via OCSP", subj);
-    AUTHORITY_INFO_ACCESS_free(descs);
-    return ok;
-  }
+    if (tls_ocsp_staple_pool == NULL) {
+      tls_ocsp_staple_pool = make_sub_pool(permanent_pool);
+      pr_pool_tag(tls_ocsp_staple_pool, "TLS OCSP Stapling Pool");
+    }
 
-  tls_log("found %u OCSP %s in AuthorityInfoAccess attribute for client cert "
-    "'%s'", ocsp_urls->nelts, ocsp_urls->nelts != 1 ? "URLs" : "URL", subj);
+    for (i = 0; cert_params[i] != NULL; i++) {
+      const char *cert_file;
 
-  /* Check each of the URLs. */
-  for (i = 0; i < ocsp_urls->nelts; i++) {
-    char *url = ((char **) ocsp_urls->elts)[i];
+      cert_file = get_param_ptr(s->conf, cert_params[i], FALSE);
+      if (cert_file != NULL) {
+        tls_ocsp_staple_add(s, cert_file);
+      }
+    }
+  }
 
-    ok = tls_verify_ocsp_url(ctx, cert, url);
-    if (ok)
-      break;
+  if (tls_ocsp_staples == NULL) {
+    return;
   }
 
-  destroy_pool(tmp_pool);
-  AUTHORITY_INFO_ACCESS_free(descs);
+  tls_ocsp_staples_refresh();
 
-  return ok;
-#else
-  return ok;
-#endif
+  tls_ocsp_staple_timerno = pr_timer_add(TLS_OCSP_STAPLING_INTERVAL_SECS, -1,
+    &tls_module, tls_ocsp_staple_timer_cb, "TLS OCSP stapling refresh");
+#endif /* TLS_USE_OCSP_STAPLING */
 }
 
 static ssize_t tls_write(SSL *ssl, const void *buf, size_t len) {
@@ -6835,6 +9179,112 @@ static int tls_handle_sesscache(pr_ctrls_t *ctrl, int reqargc, char **reqargv) {
   return -1;
 }
 
+static int tls_handle_sesstickets(pr_ctrls_t *ctrl, int reqargc,
+    char **reqargv) {
+
+  /* Sanity check */
+  if (reqargc == 0 ||
+      reqargv == NULL) {
+    pr_ctrls_add_response(ctrl,
+      "tls sesstickets: missing required parameters");
+    return -1;
+  }
+
+  if (strncmp(reqargv[0], "rotate", 7) == 0) {
+
+    /* Check the ACLs. */
+    if (!pr_ctrls_check_acl(ctrl, tls_acttab, "rotate")) {
+      pr_ctrls_add_response(ctrl, "access denied");
+      return -1;
+    }
+
+#ifdef TLS_USE_SESSION_TICKETS
+    if (tls_ticket_key_count == 0) {
+      pr_ctrls_add_response(ctrl,
+        "tls sesstickets: session tickets not enabled");
+      return -1;
+    }
+
+    if (tls_ticket_key_rotate() < 0) {
+      pr_ctrls_add_response(ctrl,
+        "tls sesstickets: error rotating session ticket keys: %s",
+        strerror(errno));
+      return -1;
+    }
+
+    /* Restart the rotation schedule from now. */
+    pr_timer_reset(tls_ticket_key_timerno, &tls_module);
+
+    pr_ctrls_add_response(ctrl, "tls sesstickets: rotated session ticket "
+      "keys (%u %s kept)", tls_ticket_key_count,
+      tls_ticket_key_count != 1 ? "keys" : "key");
+    return 0;
+#else
+    pr_ctrls_add_response(ctrl,
+      "tls sesstickets: session tickets not supported");
+    return -1;
+#endif /* TLS_USE_SESSION_TICKETS */
+  }
+
+  pr_ctrls_add_response(ctrl,
+    "tls sesstickets: unknown sesstickets action: '%s'", reqargv[0]);
+  return -1;
+}
+
+static void tls_handle_handshakes_hist(pr_ctrls_t *ctrl, const char *label,
+    struct tls_handshake_hist *hist) {
+
+  if (hist->count == 0) {
+    pr_ctrls_add_response(ctrl, "tls handshakes: %s: 0", label);
+    return;
+  }
+
+  pr_ctrls_add_response(ctrl, "tls handshakes: %s: %lu (p50 < %lu ms, "
+    "p90 < %lu ms, p99 < %lu ms, max %lu ms)", label, hist->count,
+    tls_handshake_hist_percentile(hist, 50),
+    tls_handshake_hist_percentile(hist, 90),
+    tls_handshake_hist_percentile(hist, 99), hist->max_msecs);
+}
+
+static int tls_handle_handshakes(pr_ctrls_t *ctrl, int reqargc,
+    char **reqargv) {
+
+  if (tls_shared_stats == NULL) {
+    pr_ctrls_add_response(ctrl,
+      "tls handshakes: handshake statistics not available");
+    return -1;
+  }
+
+  if (reqargc > 0) {
+    if (strncmp(reqargv[0], "reset", 6) == 0) {
+      memset(tls_shared_stats, 0, sizeof(struct tls_shared_stats));
+      tls_shared_stats->since = time(NULL);
+
+      pr_ctrls_add_response(ctrl, "tls handshakes: statistics reset");
+      return 0;
+    }
+
+    pr_ctrls_add_response(ctrl,
+      "tls handshakes: unknown handshakes action: '%s'", reqargv[0]);
+    return -1;
+  }
+
+  pr_ctrls_add_response(ctrl, "tls handshakes: since %s",
+    pr_strtime(tls_shared_stats->since));
+  tls_handle_handshakes_hist(ctrl, "full", &(tls_shared_stats->full));
+  tls_handle_handshakes_hist(ctrl, "resumed", &(tls_shared_stats->resumed));
+
+  if (tls_key_worker_npids > 0) {
+    pr_ctrls_add_response(ctrl, "tls handshakes: key workers: %u, "
+      "requests: %lu, timed out: %lu, done locally: %lu",
+      tls_key_worker_npids, tls_shared_stats->key_worker_requests,
+      tls_shared_stats->key_worker_timeouts,
+      tls_shared_stats->key_worker_fallbacks);
+  }
+
+  return 0;
+}
+
 /* Our main ftpdctl action handler */
 static int tls_handle_tls(pr_ctrls_t *ctrl, int reqargc, char **reqargv) {
 
@@ -6845,7 +9295,17 @@ static int tls_handle_tls(pr_ctrls_t *ctrl, int reqargc, char **reqargv) {
     return -1;
   }
 
-  if (strncmp(reqargv[0], "sesscache", 10) == 0) {
+  if (strncmp(reqargv[0], "handshakes", 11) == 0) {
+
+    /* Check the ACLs. */
+    if (!pr_ctrls_check_acl(ctrl, tls_acttab, "handshakes")) {
+      pr_ctrls_add_response(ctrl, "access denied");
+      return -1;
+    }
+
+    return tls_handle_handshakes(ctrl, --reqargc, ++reqargv);
+
+  } else if (strncmp(reqargv[0], "sesscache", 10) == 0) {
 
     /* Check the ACLs. */
     if (!pr_ctrls_check_acl(ctrl, tls_acttab, "sesscache")) {
@@ -6854,6 +9314,16 @@ static int tls_handle_tls(pr_ctrls_t *ctrl, int reqargc, char **reqargv) {
     }
 
     return tls_handle_sesscache(ctrl, --reqargc, ++reqargv);
+
+  } else if (strncmp(reqargv[0], "sesstickets", 12) == 0) {
+
+    /* Check the ACLs. */
+    if (!pr_ctrls_check_acl(ctrl, tls_acttab, "sesstickets")) {
+      pr_ctrls_add_response(ctrl, "access denied");
+      return -1;
+    }
+
+    return tls_handle_sesstickets(ctrl, --reqargc, ++reqargv);
   }
 
   pr_ctrls_add_response(ctrl, "tls: unknown tls action: '%s'", reqargv[0]);
@@ -6897,91 +9367,293 @@ static int tls_sess_cache_add_sess_cb(SSL *ssl, SSL_SESSION *sess) {
     tls_log("error adding session to '%s' cache: %s",
       tls_sess_cache->cache_name, strerror(errno));
 
-    cache_mode = tls_sess_cache_get_cache_mode();
-#ifdef SSL_SESS_CACHE_NO_INTERNAL
-    if (cache_mode & SSL_SESS_CACHE_NO_INTERNAL) {
-      /* Call SSL_SESSION_free() here, and return 1.  We told OpenSSL that we
-       * are the only cache, so failing to call SSL_SESSION_free() could
-       * result in a memory leak.
-       */ 
-      SSL_SESSION_free(sess);
-      return 1;
+    cache_mode = tls_sess_cache_get_cache_mode();
+#ifdef SSL_SESS_CACHE_NO_INTERNAL
+    if (cache_mode & SSL_SESS_CACHE_NO_INTERNAL) {
+      /* Call SSL_SESSION_free() here, and return 1.  We told OpenSSL that we
+       * are the only cache, so failing to call SSL_SESSION_free() could
+       * result in a memory leak.
+       */ 
+      SSL_SESSION_free(sess);
+      return 1;
+    }
+#endif /* !SSL_SESS_CACHE_NO_INTERNAL */
+  }
+
+  /* Return zero to indicate to OpenSSL that we have not called
+   * SSL_SESSION_free().
+   */
+  return 0;
+}
+
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+static SSL_SESSION *tls_sess_cache_get_sess_cb(SSL *ssl,
+    const unsigned char *sess_id, int sess_id_len, int *do_copy) {
+#else
+static SSL_SESSION *tls_sess_cache_get_sess_cb(SSL *ssl,
+    unsigned char *sess_id, int sess_id_len, int *do_copy) {
+#endif /* OpenSSL-1.1.x and later */
+  SSL_SESSION *sess;
+
+  /* Indicate to OpenSSL that the ref count should not be incremented
+   * by setting the do_copy pointer to zero.
+   */
+  *do_copy = 0;
+
+  /* The actual session_id_length field in the OpenSSL SSL_SESSION struct
+   * is unsigned, not signed.  But for some reason, the expected callback
+   * signature uses 'int', not 'unsigned int'.  Hopefully the implicit
+   * cast below (our callback uses 'unsigned int') won't cause problems.
+   * Just to be sure, check if OpenSSL is giving us a negative ID length.
+   */
+  if (sess_id_len <= 0) {
+    tls_log("OpenSSL invoked SSL session cache 'get' callback with session "
+      "ID length %d, returning null", sess_id_len);
+    return NULL;
+  }
+
+  if (tls_sess_cache == NULL) {
+    tls_log("unable to get session from session cache: %s", strerror(ENOSYS));
+    return NULL;
+  }
+
+  sess = (tls_sess_cache->get)(tls_sess_cache, (unsigned char *) sess_id,
+    sess_id_len);
+  if (sess == NULL) {
+    tls_log("error retrieving session from '%s' cache: %s",
+      tls_sess_cache->cache_name, strerror(errno));
+  }
+
+  return sess;
+}
+
+static void tls_sess_cache_delete_sess_cb(SSL_CTX *ctx, SSL_SESSION *sess) {
+  unsigned char *sess_id;
+  unsigned int sess_id_len;
+  int res;
+
+  if (tls_sess_cache == NULL) {
+    tls_log("unable to remove session from session cache: %s",
+      strerror(ENOSYS));
+    return;
+  }
+
+#if OPENSSL_VERSION_NUMBER > 0x000908000L
+  sess_id = (unsigned char *) SSL_SESSION_get_id(sess, &sess_id_len);
+#else
+  /* XXX Directly accessing these fields cannot be a Good Thing. */
+  sess_id = sess->session_id;
+  sess_id_len = sess->session_id_length;
+#endif
+
+  res = (tls_sess_cache->delete)(tls_sess_cache, sess_id, sess_id_len);
+  if (res < 0) {
+    tls_log("error removing session from '%s' cache: %s",
+      tls_sess_cache->cache_name, strerror(errno));
+  }
+
+  return;
+}
+
+/* NetIO callbacks
+ */
+
+static SSL *tls_netio_get_ssl(pr_netio_stream_t *nstrm) {
+  struct tls_netio_strm *ts;
+
+  ts = nstrm->strm_data;
+  if (ts == NULL) {
+    return NULL;
+  }
+
+  return ts->ssl;
+}
+
+static void tls_netio_set_ssl(pr_netio_stream_t *nstrm, SSL *ssl) {
+  struct tls_netio_strm *ts;
+
+  ts = nstrm->strm_data;
+  if (ts == NULL) {
+    ts = pcalloc(nstrm->strm_pool, sizeof(struct tls_netio_strm));
+    nstrm->strm_data = ts;
+  }
+
+  ts->ssl = ssl;
+  ts->wbuflen = ts->wretry = 0;
+  ts->wsealed = 0;
+  ts->wlast = 0;
+  ts->ktls_tx = FALSE;
+
+  (void) pr_table_remove(nstrm->notes, TLS_NETIO_NOTE, NULL);
+  (void) pr_table_add(nstrm->notes, pstrdup(nstrm->strm_pool, TLS_NETIO_NOTE),
+    ssl, sizeof(SSL *));
+}
+
+static void tls_netio_clear_ssl(pr_netio_stream_t *nstrm) {
+  struct tls_netio_strm *ts;
+
+  ts = nstrm->strm_data;
+  if (ts != NULL) {
+    ts->ssl = NULL;
+
+    if (ts->wbuflen > 0) {
+      pr_trace_msg(trace_channel, 9,
+        "discarding %lu bytes of unsent data for stream",
+        (unsigned long) ts->wbuflen);
+      ts->wbuflen = 0;
+    }
+  }
+
+  (void) pr_table_remove(nstrm->notes, TLS_NETIO_NOTE, NULL);
+}
+
+/* Returns the size of the next record to write on a data stream. */
+static size_t tls_data_record_size(struct tls_netio_strm *ts) {
+  time_t now;
+
+  now = time(NULL);
+  if (ts->wlast > 0 &&
+      now - ts->wlast >= TLS_DATA_IDLE_RESET_SECS) {
+    /* The connection has been idle long enough for the TCP congestion
+     * window to have collapsed; restart the record size slow start.
+     */
+    ts->wsealed = 0;
+  }
+
+  if (ts->wsealed < TLS_DATA_SLOW_START_BYTES) {
+    return TLS_DATA_SMALL_RECORD_SIZE;
+  }
+
+  return TLS_DATA_MAX_RECORD_SIZE;
+}
+
+/* Seals the given plaintext into a single record.  Returns the number of
+ * bytes written, or -1 (with EINTR, if OpenSSL wants the same write
+ * retried).
+ */
+static ssize_t tls_data_write_record(struct tls_netio_strm *ts,
+    const void *buf, size_t len) {
+  ssize_t res;
+
+  res = tls_write(ts->ssl, buf, len);
+  if (res <= 0) {
+    if (res == 0) {
+      /* SSL_write(3) returns zero if the connection has been closed. */
+      errno = EPIPE;
+
+    } else if (errno == EINTR) {
+      ts->wretry = len;
+    }
+
+    return -1;
+  }
+
+  ts->wretry = 0;
+  ts->wsealed += res;
+  ts->wlast = time(NULL);
+
+  return res;
+}
+
+/* Writes out any plaintext held back in the stream's coalescing buffer,
+ * retrying writes which OpenSSL wants retried, so that nothing is lost when
+ * the stream is shut down.
+ */
+static int tls_data_flush(struct tls_netio_strm *ts) {
+  while (ts->wbuflen > 0) {
+    ssize_t res;
+
+    res = tls_data_write_record(ts, ts->wbuf, ts->wbuflen);
+    if (res < 0) {
+      int xerrno = errno;
+
+      if (xerrno == EINTR) {
+        pr_signals_handle();
+        continue;
+      }
+
+      tls_log("error writing %lu bytes of held-back data on data channel: %s",
+        (unsigned long) ts->wbuflen, strerror(xerrno));
+
+      errno = xerrno;
+      return -1;
     }
-#endif /* !SSL_SESS_CACHE_NO_INTERNAL */
+
+    if ((size_t) res < ts->wbuflen) {
+      memmove(ts->wbuf, ts->wbuf + res, ts->wbuflen - res);
+    }
+
+    ts->wbuflen -= res;
   }
 
-  /* Return zero to indicate to OpenSSL that we have not called
-   * SSL_SESSION_free().
-   */
   return 0;
 }
 
-static SSL_SESSION *tls_sess_cache_get_sess_cb(SSL *ssl,
-    unsigned char *sess_id, int sess_id_len, int *do_copy) {
-  SSL_SESSION *sess;
-
-  /* Indicate to OpenSSL that the ref count should not be incremented
-   * by setting the do_copy pointer to zero.
-   */
-  *do_copy = 0;
+/* Coalesces the given plaintext into full-sized records.  Caller buffers
+ * as small as the default transfer buffer would otherwise each become a
+ * record of their own, paying for the record header, MAC and padding (and
+ * the cipher setup) every time.  Any partial record is held back until the
+ * next write, or until the stream is shut down.
+ */
+static ssize_t tls_data_write(pr_netio_stream_t *nstrm,
+    struct tls_netio_strm *ts, const char *buf, size_t buflen) {
+  size_t total = 0;
+  ssize_t res;
 
-  /* The actual session_id_length field in the OpenSSL SSL_SESSION struct
-   * is unsigned, not signed.  But for some reason, the expected callback
-   * signature uses 'int', not 'unsigned int'.  Hopefully the implicit
-   * cast below (our callback uses 'unsigned int') won't cause problems.
-   * Just to be sure, check if OpenSSL is giving us a negative ID length.
-   */
-  if (sess_id_len <= 0) {
-    tls_log("OpenSSL invoked SSL session cache 'get' callback with session "
-      "ID length %d, returning null", sess_id_len);
-    return NULL;
+  if (ts->wbuf == NULL) {
+    ts->wbuf = palloc(nstrm->strm_pool, TLS_DATA_MAX_RECORD_SIZE);
   }
 
-  if (tls_sess_cache == NULL) {
-    tls_log("unable to get session from session cache: %s", strerror(ENOSYS));
-    return NULL;
-  }
+  while (total < buflen) {
+    size_t recsz, len;
 
-  sess = (tls_sess_cache->get)(tls_sess_cache, sess_id, sess_id_len);
-  if (sess == NULL) {
-    tls_log("error retrieving session from '%s' cache: %s",
-      tls_sess_cache->cache_name, strerror(errno));
-  }
+    recsz = tls_data_record_size(ts);
 
-  return sess;
-}
+    if (ts->wbuflen > 0 &&
+        (ts->wbuflen >= recsz || ts->wretry > 0)) {
+      if (tls_data_flush(ts) < 0) {
+        return total > 0 ? (ssize_t) total : -1;
+      }
 
-static void tls_sess_cache_delete_sess_cb(SSL_CTX *ctx, SSL_SESSION *sess) {
-  unsigned char *sess_id;
-  unsigned int sess_id_len;
-  int res;
+      continue;
+    }
 
-  if (tls_sess_cache == NULL) {
-    tls_log("unable to remove session from session cache: %s",
-      strerror(ENOSYS));
-    return;
-  }
+    len = buflen - total;
 
-#if OPENSSL_VERSION_NUMBER > 0x000908000L
-  sess_id = (unsigned char *) SSL_SESSION_get_id(sess, &sess_id_len);
-#else
-  /* XXX Directly accessing these fields cannot be a Good Thing. */
-  sess_id = sess->session_id;
-  sess_id_len = sess->session_id_length;
-#endif
+    if (ts->wbuflen == 0 &&
+        (len >= recsz || ts->wretry > 0)) {
+      /* A full record's worth (or a retried write); seal it straight from
+       * the caller's buffer.  OpenSSL requires a retry to be of the same
+       * length as the original write.
+       */
+      if (ts->wretry > 0) {
+        len = ts->wretry;
 
-  res = (tls_sess_cache->delete)(tls_sess_cache, sess_id, sess_id_len);
-  if (res < 0) {
-    tls_log("error removing session from '%s' cache: %s",
-      tls_sess_cache->cache_name, strerror(errno));
+      } else {
+        len = recsz;
+      }
+
+      res = tls_data_write_record(ts, buf + total, len);
+      if (res < 0) {
+        return total > 0 ? (ssize_t) total : -1;
+      }
+
+      total += res;
+      continue;
+    }
+
+    if (len > recsz - ts->wbuflen) {
+      len = recsz - ts->wbuflen;
+    }
+
+    memcpy(ts->wbuf + ts->wbuflen, buf + total, len);
+    ts->wbuflen += len;
+    total += len;
   }
 
-  return;
+  return (ssize_t) total;
 }
 
-/* NetIO callbacks
- */
-
 static void tls_netio_abort_cb(pr_netio_stream_t *nstrm) {
   nstrm->strm_flags |= PR_NETIO_SESS_ABORT;
 }
@@ -6990,21 +9662,21 @@ static int tls_netio_close_cb(pr_netio_stream_t *nstrm) {
   int res = 0;
   SSL *ssl = NULL;
 
-  ssl = pr_table_get(nstrm->notes, TLS_NETIO_NOTE, NULL);
+  ssl = tls_netio_get_ssl(nstrm);
   if (ssl != NULL) {
     if (nstrm->strm_type == PR_NETIO_STRM_CTRL &&
         nstrm->strm_mode == PR_NETIO_IO_WR) {
       tls_end_sess(ssl, nstrm->strm_type, 0);
-      pr_table_remove(tls_ctrl_rd_nstrm->notes, TLS_NETIO_NOTE, NULL);
-      pr_table_remove(tls_ctrl_wr_nstrm->notes, TLS_NETIO_NOTE, NULL);
+      tls_netio_clear_ssl(tls_ctrl_rd_nstrm);
+      tls_netio_clear_ssl(tls_ctrl_wr_nstrm);
       tls_ctrl_netio = NULL;
       tls_flags &= ~TLS_SESS_ON_CTRL;
     }
 
     if (nstrm->strm_type == PR_NETIO_STRM_DATA &&
         nstrm->strm_mode == PR_NETIO_IO_WR) {
-      pr_table_remove(tls_data_rd_nstrm->notes, TLS_NETIO_NOTE, NULL);
-      pr_table_remove(tls_data_wr_nstrm->notes, TLS_NETIO_NOTE, NULL);
+      tls_netio_clear_ssl(tls_data_rd_nstrm);
+      tls_netio_clear_ssl(tls_data_wr_nstrm);
       tls_data_netio = NULL;
       tls_flags &= ~TLS_SESS_ON_DATA;
     }
@@ -7111,7 +9783,7 @@ static int tls_netio_postopen_cb(pr_netio_stream_t *nstrm) {
         (tls_flags & TLS_SESS_NEED_DATA_PROT)) {
       SSL *ssl = NULL;
 
-      ssl = pr_table_get(nstrm->notes, TLS_NETIO_NOTE, NULL);
+      ssl = tls_netio_get_ssl(nstrm);
 
       /* XXX How to force 421 response code for failed secure FXP/SSCN? */
 
@@ -7148,8 +9820,8 @@ static int tls_netio_postopen_cb(pr_netio_stream_t *nstrm) {
 
             /* Properly shutdown the SSL session. */
             tls_end_sess(ssl, nstrm->strm_type, 0);
-            pr_table_remove(tls_data_rd_nstrm->notes, TLS_NETIO_NOTE, NULL);
-            pr_table_remove(tls_data_wr_nstrm->notes, TLS_NETIO_NOTE, NULL);
+            tls_netio_clear_ssl(tls_data_rd_nstrm);
+            tls_netio_clear_ssl(tls_data_wr_nstrm);
 
             tls_log("%s", "unable to open data connection: control/data "
               "certificate mismatch");
@@ -7195,7 +9867,7 @@ static int tls_netio_read_cb(pr_netio_stream_t *nstrm, char *buf,
     size_t buflen) {
   SSL *ssl;
 
-  ssl = pr_table_get(nstrm->notes, TLS_NETIO_NOTE, NULL);
+  ssl = tls_netio_get_ssl(nstrm);
   if (ssl != NULL) {
     BIO *rbio, *wbio;
     int bread = 0, bwritten = 0;
@@ -7264,7 +9936,7 @@ static int tls_netio_shutdown_cb(pr_netio_stream_t *nstrm, int how) {
          nstrm->strm_type == PR_NETIO_STRM_DATA)) {
       SSL *ssl;
 
-      ssl = pr_table_get(nstrm->notes, TLS_NETIO_NOTE, NULL);
+      ssl = tls_netio_get_ssl(nstrm);
       if (ssl != NULL) {
         BIO *rbio, *wbio;
         int bread = 0, bwritten = 0;
@@ -7278,6 +9950,16 @@ static int tls_netio_shutdown_cb(pr_netio_stream_t *nstrm, int how) {
         wbio_rbytes = BIO_number_read(wbio);
         wbio_wbytes = BIO_number_written(wbio);
 
+        if (nstrm->strm_type == PR_NETIO_STRM_DATA) {
+          struct tls_netio_strm *ts;
+
+          /* Send any partial record still held back before the
+           * 'close_notify'.
+           */
+          ts = nstrm->strm_data;
+          (void) tls_data_flush(ts);
+        }
+
         if (!(SSL_get_shutdown(ssl) & SSL_SENT_SHUTDOWN)) {
           /* We haven't sent a 'close_notify' alert yet; do so now. */
           SSL_shutdown(ssl);
@@ -7309,7 +9991,7 @@ static int tls_netio_write_cb(pr_netio_stream_t *nstrm, char *buf,
     size_t buflen) {
   SSL *ssl;
 
-  ssl = pr_table_get(nstrm->notes, TLS_NETIO_NOTE, NULL);
+  ssl = tls_netio_get_ssl(nstrm);
   if (ssl != NULL) {
     BIO *rbio, *wbio;
     int bread = 0, bwritten = 0;
@@ -7352,7 +10034,20 @@ static int tls_netio_write_cb(pr_netio_stream_t *nstrm, char *buf,
     }
 #endif
 
-    res = tls_write(ssl, buf, buflen);
+    if (nstrm->strm_type == PR_NETIO_STRM_DATA) {
+      struct tls_netio_strm *ts;
+
+      ts = nstrm->strm_data;
+      if (ts->ktls_tx == FALSE) {
+        res = tls_data_write(nstrm, ts, buf, buflen);
+
+      } else {
+        res = tls_write(ssl, buf, buflen);
+      }
+
+    } else {
+      res = tls_write(ssl, buf, buflen);
+    }
 
     bread = (BIO_number_read(rbio) - rbio_rbytes) +
       (BIO_number_read(wbio) - wbio_rbytes);
@@ -7868,8 +10563,8 @@ MODRET tls_ccc(cmd_rec *cmd) {
    */
 
   tls_end_sess(ctrl_ssl, PR_NETIO_STRM_CTRL, TLS_SHUTDOWN_BIDIRECTIONAL);
-  pr_table_remove(tls_ctrl_rd_nstrm->notes, TLS_NETIO_NOTE, NULL);
-  pr_table_remove(tls_ctrl_wr_nstrm->notes, TLS_NETIO_NOTE, NULL);
+  tls_netio_clear_ssl(tls_ctrl_rd_nstrm);
+  tls_netio_clear_ssl(tls_ctrl_wr_nstrm);
   ctrl_ssl = NULL;
 
   /* Remove our NetIO for the control channel. */
@@ -8064,6 +10759,11 @@ MODRET tls_prot(cmd_rec *cmd) {
        * connections.
        */
       tls_flags &= ~TLS_SESS_NEED_DATA_PROT;
+
+      /* Any data connection kept open from block mode transfers has the
+       * old protection; the next transfer needs a new connection.
+       */
+      pr_data_close_persistent();
       pr_response_add(R_200, "%s", mesg);
       tls_log("%s", mesg);
 
@@ -8084,6 +10784,7 @@ MODRET tls_prot(cmd_rec *cmd) {
        * connections.
        */
       tls_flags |= TLS_SESS_NEED_DATA_PROT;
+      pr_data_close_persistent();
       pr_response_add(R_200, "%s", mesg);
       tls_log("%s", mesg);
 
@@ -8511,6 +11212,55 @@ MODRET set_tlsengine(cmd_rec *cmd) {
   return PR_HANDLED(cmd);
 }
 
+/* usage: TLSKeyWorkers count|"off" [timeout] */
+MODRET set_tlskeyworkers(cmd_rec *cmd) {
+  config_rec *c;
+  unsigned int count = 0;
+  int timeout = TLS_KEY_WORKER_DEFAULT_TIMEOUT;
+
+  if (cmd->argc < 2 ||
+      cmd->argc > 3) {
+    CONF_ERROR(cmd, "wrong number of parameters");
+  }
+
+  CHECK_CONF(cmd, CONF_ROOT);
+
+  if (strcasecmp(cmd->argv[1], "off") != 0) {
+    char *ptr = NULL;
+    long n;
+
+    n = strtol(cmd->argv[1], &ptr, 10);
+    if ((ptr && *ptr) ||
+        n < 1 ||
+        n > TLS_KEY_WORKER_MAX_COUNT) {
+      CONF_ERROR(cmd, "count must be between 1 and 64");
+    }
+
+    count = (unsigned int) n;
+
+#ifndef TLS_USE_KEY_WORKERS
+    pr_log_pri(PR_LOG_NOTICE, MOD_TLS_VERSION ": TLSKeyWorkers not supported (OpenSSL version is too old)");
+    count = 0;
+#endif /* TLS_USE_KEY_WORKERS */
+  }
+
+  if (cmd->argc == 3) {
+    if (pr_str_get_duration(cmd->argv[2], &timeout) < 0 ||
+        timeout < 1) {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "error parsing timeout value '",
+        cmd->argv[2], "'", NULL));
+    }
+  }
+
+  c = add_config_param(cmd->argv[0], 2, NULL, NULL);
+  c->argv[0] = palloc(c->pool, sizeof(unsigned int));
+  *((unsigned int *) c->argv[0]) = count;
+  c->argv[1] = palloc(c->pool, sizeof(int));
+  *((int *) c->argv[1]) = timeout;
+
+  return PR_HANDLED(cmd);
+}
+
 /* usage: TLSLog file */
 MODRET set_tlslog(cmd_rec *cmd) {
   CHECK_ARGS(cmd, 1);
@@ -8545,6 +11295,44 @@ MODRET set_tlsmasqaddr(cmd_rec *cmd) {
   return PR_HANDLED(cmd);
 }
 
+/* usage: TLSOCSPCache path */
+MODRET set_tlsocspcache(cmd_rec *cmd) {
+  int res;
+  struct stat st;
+
+  CHECK_ARGS(cmd, 1);
+  CHECK_CONF(cmd, CONF_ROOT|CONF_VIRTUAL|CONF_GLOBAL);
+
+  if (*cmd->argv[1] != '/') {
+    CONF_ERROR(cmd, "parameter must be an absolute path");
+  }
+
+  PRIVS_ROOT
+  res = stat(cmd->argv[1], &st);
+  PRIVS_RELINQUISH
+
+  if (res < 0 ||
+      !S_ISDIR(st.st_mode)) {
+    CONF_ERROR(cmd, "parameter must be a directory path");
+  }
+
+  /* The cached responses are written as root, so the directory must not
+   * be writable by anyone else.
+   */
+  if (st.st_uid != 0) {
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "directory '", cmd->argv[1],
+      "' is not owned by root", NULL));
+  }
+
+  if (st.st_mode & (S_IWGRP|S_IWOTH)) {
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "directory '", cmd->argv[1],
+      "' is group- or world-writable", NULL));
+  }
+
+  add_config_param_str(cmd->argv[0], 1, cmd->argv[1]);
+  return PR_HANDLED(cmd);
+}
+
 /* usage: TLSOptions opt1 opt2 ... */
 MODRET set_tlsoptions(cmd_rec *cmd) {
   config_rec *c = NULL;
@@ -8578,6 +11366,14 @@ MODRET set_tlsoptions(cmd_rec *cmd) {
     } else if (strcmp(cmd->argv[i], "ExportCertData") == 0) {
       opts |= TLS_OPT_EXPORT_CERT_DATA;
 
+    } else if (strcmp(cmd->argv[i], "KernelTLS") == 0) {
+#ifdef SSL_OP_ENABLE_KTLS
+      opts |= TLS_OPT_KERNEL_TLS;
+#else
+      pr_log_pri(PR_LOG_NOTICE, MOD_TLS_VERSION
+        ": TLSOption KernelTLS not supported (OpenSSL version is too old)");
+#endif /* SSL_OP_ENABLE_KTLS */
+
     } else if (strcmp(cmd->argv[i], "NoCertRequest") == 0) {
       opts |= TLS_OPT_NO_CERT_REQUEST;
 
@@ -8596,6 +11392,9 @@ MODRET set_tlsoptions(cmd_rec *cmd) {
     } else if (strcmp(cmd->argv[i], "NoSessionReuseRequired") == 0) {
       opts |= TLS_OPT_NO_SESSION_REUSE_REQUIRED;
 
+    } else if (strcmp(cmd->argv[i], "PreferECDSA") == 0) {
+      opts |= TLS_OPT_PREFER_ECDSA;
+
     } else if (strcmp(cmd->argv[i], "StdEnvVars") == 0) {
       opts |= TLS_OPT_STD_ENV_VARS;
 
@@ -9039,6 +11838,118 @@ MODRET set_tlssessioncache(cmd_rec *cmd) {
   return PR_HANDLED(cmd);
 }
 
+/* usage: TLSSessionTicketKeys [age secs] [count num] */
+MODRET set_tlssessionticketkeys(cmd_rec *cmd) {
+  register unsigned int i;
+  config_rec *c;
+  int max_age = TLS_TICKET_KEY_DEFAULT_AGE;
+  unsigned int max_count = TLS_TICKET_KEY_DEFAULT_COUNT;
+
+  if (cmd->argc < 3 ||
+      (cmd->argc-1) % 2 != 0) {
+    CONF_ERROR(cmd, "wrong number of parameters");
+  }
+
+  CHECK_CONF(cmd, CONF_ROOT);
+
+  for (i = 1; i < cmd->argc; i += 2) {
+    if (strncasecmp(cmd->argv[i], "age", 4) == 0) {
+      if (pr_str_get_duration(cmd->argv[i+1], &max_age) < 0 ||
+          max_age < 1) {
+        CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "error parsing age value '",
+          cmd->argv[i+1], "'", NULL));
+      }
+
+    } else if (strncasecmp(cmd->argv[i], "count", 6) == 0) {
+      char *ptr = NULL;
+      long count;
+
+      count = strtol(cmd->argv[i+1], &ptr, 10);
+      if ((ptr && *ptr) ||
+          count < 1 ||
+          count > TLS_TICKET_KEY_MAX_COUNT) {
+        CONF_ERROR(cmd, "count must be between 1 and 100");
+      }
+
+      max_count = (unsigned int) count;
+
+    } else {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, ": unknown parameter: '",
+        cmd->argv[i], "'", NULL));
+    }
+  }
+
+  c = add_config_param(cmd->argv[0], 2, NULL, NULL);
+  c->argv[0] = palloc(c->pool, sizeof(int));
+  *((int *) c->argv[0]) = max_age;
+  c->argv[1] = palloc(c->pool, sizeof(unsigned int));
+  *((unsigned int *) c->argv[1]) = max_count;
+
+  return PR_HANDLED(cmd);
+}
+
+/* usage: TLSSessionTickets on|off */
+MODRET set_tlssessiontickets(cmd_rec *cmd) {
+  int bool = -1;
+  config_rec *c = NULL;
+
+  CHECK_ARGS(cmd, 1);
+  CHECK_CONF(cmd, CONF_ROOT|CONF_VIRTUAL|CONF_GLOBAL);
+
+  bool = get_boolean(cmd, 1);
+  if (bool == -1) {
+    CONF_ERROR(cmd, "expected Boolean parameter");
+  }
+
+  c = add_config_param(cmd->argv[0], 1, NULL);
+  c->argv[0] = pcalloc(c->pool, sizeof(int));
+  *((int *) c->argv[0]) = bool;
+
+  return PR_HANDLED(cmd);
+}
+
+/* usage: TLSStapling on|off */
+MODRET set_tlsstapling(cmd_rec *cmd) {
+  int bool = -1;
+  config_rec *c = NULL;
+
+  CHECK_ARGS(cmd, 1);
+  CHECK_CONF(cmd, CONF_ROOT|CONF_VIRTUAL|CONF_GLOBAL);
+
+  bool = get_boolean(cmd, 1);
+  if (bool == -1) {
+    CONF_ERROR(cmd, "expected Boolean parameter");
+  }
+
+#ifndef TLS_USE_OCSP_STAPLING
+  if (bool == TRUE) {
+    pr_log_pri(PR_LOG_NOTICE, MOD_TLS_VERSION
+      ": TLSStapling not supported (OpenSSL version is too old)");
+    bool = FALSE;
+  }
+#endif /* TLS_USE_OCSP_STAPLING */
+
+  c = add_config_param(cmd->argv[0], 1, NULL);
+  c->argv[0] = pcalloc(c->pool, sizeof(int));
+  *((int *) c->argv[0]) = bool;
+
+  return PR_HANDLED(cmd);
+}
+
+/* usage: TLSStaplingResponder url */
+MODRET set_tlsstaplingresponder(cmd_rec *cmd) {
+  CHECK_ARGS(cmd, 1);
+  CHECK_CONF(cmd, CONF_ROOT|CONF_VIRTUAL|CONF_GLOBAL);
+
+  if (strncasecmp(cmd->argv[1], "http://", 7) != 0 &&
+      strncasecmp(cmd->argv[1], "https://", 8) != 0) {
+    CONF_ERROR(cmd, "parameter must be an http:// or https:// URL");
+  }
+
+  add_config_param_str(cmd->argv[0], 1, cmd->argv[1]);
+  return PR_HANDLED(cmd);
+}
+
 /* usage: TLSTimeoutHandshake <secs> */
 MODRET set_tlstimeouthandshake(cmd_rec *cmd) {
   int timeout = -1;
@@ -9240,8 +12151,11 @@ extern pid_t mpid;
 static void tls_shutdown_ev(const void *event_data, void *user_data) {
   if (mpid == getpid()) {
     tls_scrub_pkeys();
+    tls_key_workers_stop();
   }
 
+  tls_ticket_keys_scrub();
+
   /* Write out a new RandomSeed file, for use later. */
   if (tls_rand_file) {
     int res;
@@ -9263,9 +12177,18 @@ static void tls_shutdown_ev(const void *event_data, void *user_data) {
     ssl_ctx = NULL;
   }
 
+  if (tls_ocsp_ssl_ctx != NULL) {
+    SSL_CTX_free(tls_ocsp_ssl_ctx);
+    tls_ocsp_ssl_ctx = NULL;
+  }
+
   RAND_cleanup();
 }
 
+static void tls_startup_ev(const void *event_data, void *user_data) {
+  tls_key_workers_start();
+}
+
 static void tls_restart_ev(const void *event_data, void *user_data) {
 #ifdef PR_USE_CTRLS
   register unsigned int i;
@@ -9273,6 +12196,12 @@ static void tls_restart_ev(const void *event_data, void *user_data) {
 
   tls_scrub_pkeys();
 
+  /* The key workers hold the old keys; start new ones once the new
+   * configuration has been parsed.
+   */
+  tls_key_workers_stop();
+  tls_key_workers_restarting = TRUE;
+
 #ifdef PR_USE_CTRLS
   if (tls_act_pool) {
     destroy_pool(tls_act_pool);
@@ -9292,8 +12221,34 @@ static void tls_restart_ev(const void *event_data, void *user_data) {
   tls_closelog();
 }
 
+/* A block mode transfer has ended, with the data connection kept open for
+ * the next transfer; write out any partial record held back for coalescing,
+ * as the client is waiting for the EOF block in it.
+ */
+static void tls_data_flush_ev(const void *event_data, void *user_data) {
+  pr_netio_stream_t *nstrm;
+  struct tls_netio_strm *ts;
+
+  nstrm = (pr_netio_stream_t *) event_data;
+  if (nstrm == NULL ||
+      nstrm->strm_type != PR_NETIO_STRM_DATA ||
+      tls_netio_get_ssl(nstrm) == NULL) {
+    return;
+  }
+
+  ts = nstrm->strm_data;
+  (void) tls_data_flush(ts);
+}
+
 static void tls_exit_ev(const void *event_data, void *user_data) {
 
+  if (tls_handshake_stats.count > 0) {
+    tls_log("[stat]: SSL handshakes: %u (%u resumed, %u using session "
+      "tickets), %lu ms CPU total", tls_handshake_stats.count,
+      tls_handshake_stats.resumed, tls_handshake_stats.ticket_resumed,
+      tls_handshake_stats.cpu_usecs / 1000);
+  }
+
   /* If diags are enabled, log some OpenSSL stats. */
   if (ssl_ctx != NULL && 
       (tls_opts & TLS_OPT_ENABLE_DIAGS)) {
@@ -9364,8 +12319,8 @@ static void tls_timeout_ev(const void *event_data, void *user_data) {
      * if there is one.
      */ 
     tls_end_sess(ctrl_ssl, PR_NETIO_STRM_CTRL, 0);
-    pr_table_remove(tls_ctrl_rd_nstrm->notes, TLS_NETIO_NOTE, NULL);
-    pr_table_remove(tls_ctrl_wr_nstrm->notes, TLS_NETIO_NOTE, NULL);
+    tls_netio_clear_ssl(tls_ctrl_rd_nstrm);
+    tls_netio_clear_ssl(tls_ctrl_wr_nstrm);
     ctrl_ssl = NULL;
   }
 }
@@ -9512,6 +12467,7 @@ static void tls_get_passphrases(void) {
 
 static void tls_postparse_ev(const void *event_data, void *user_data) {
   server_rec *s = NULL;
+  config_rec *c;
 
   /* Check for incompatible configurations.  For example, configuring:
    *
@@ -9637,6 +12593,11 @@ static void tls_postparse_ev(const void *event_data, void *user_data) {
     }
   }
 
+  /* Generate the session ticket keys, if needed, for inheriting by the
+   * session processes.
+   */
+  tls_ticket_keys_init();
+
   /* Initialize the OpenSSL context. */
   if (tls_init_ctx() < 0) {
     pr_log_pri(PR_LOG_NOTICE, MOD_TLS_VERSION
@@ -9649,6 +12610,35 @@ static void tls_postparse_ev(const void *event_data, void *user_data) {
    */
   tls_get_passphrases();
 
+  /* Parse and index the CRLs, if any, for inheriting by the session
+   * processes.
+   */
+  tls_crl_init();
+
+  /* Fetch the OCSP responses to be stapled, if needed, for inheriting by the
+   * session processes.
+   */
+  tls_ocsp_stapling_init();
+
+  tls_shared_stats_init();
+
+  tls_key_worker_count = 0;
+  tls_key_worker_timeout = TLS_KEY_WORKER_DEFAULT_TIMEOUT;
+
+  c = find_config(main_server->conf, CONF_PARAM, "TLSKeyWorkers", FALSE);
+  if (c != NULL) {
+    tls_key_worker_count = *((unsigned int *) c->argv[0]);
+    tls_key_worker_timeout = *((int *) c->argv[1]);
+  }
+
+  /* At startup, the key workers are started once the daemon process has
+   * daemonized; see tls_startup_ev().
+   */
+  if (tls_key_workers_restarting) {
+    tls_key_workers_start();
+    tls_key_workers_restarting = FALSE;
+  }
+
   /* Install our control channel NetIO handlers.  This is done here
    * specifically because we need to cache a pointer to the nstrm that
    * is passed to the open callback().  Ideally we'd only install our
@@ -9704,6 +12694,7 @@ static int tls_init(void) {
   pr_event_register(&tls_module, "core.postparse", tls_postparse_ev, NULL);
   pr_event_register(&tls_module, "core.restart", tls_restart_ev, NULL);
   pr_event_register(&tls_module, "core.shutdown", tls_shutdown_ev, NULL);
+  pr_event_register(&tls_module, "core.startup", tls_startup_ev, NULL);
 
   SSL_load_error_strings();
   SSL_library_init();
@@ -9741,6 +12732,9 @@ static int tls_sess_init(void) {
   unsigned char *tmp = NULL;
   config_rec *c = NULL;
 
+  /* The key workers are the daemon process's to manage. */
+  tls_key_worker_npids = 0;
+
   /* First, check to see whether mod_tls is even enabled. */
   tmp = get_param_ptr(main_server->conf, "TLSEngine", FALSE);
   if (tmp != NULL &&
@@ -9980,6 +12974,7 @@ static int tls_sess_init(void) {
   /* Install our data channel NetIO handlers. */
   tls_netio_install_data();
 
+  pr_event_register(&tls_module, "core.data-flush", tls_data_flush_ev, NULL);
   pr_event_register(&tls_module, "core.exit", tls_exit_ev, NULL);
 
   /* There are several timeouts which can cause the client to be disconnected;
@@ -10126,9 +13121,12 @@ static int tls_sess_init(void) {
 #ifdef PR_USE_CTRLS
 static ctrls_acttab_t tls_acttab[] = {
   { "clear", NULL, NULL, NULL },
+  { "handshakes", NULL, NULL, NULL },
   { "info", NULL, NULL, NULL },
   { "remove", NULL, NULL, NULL },
+  { "rotate", NULL, NULL, NULL },
   { "sesscache", NULL, NULL, NULL },
+  { "sesstickets", NULL, NULL, NULL },
  
   { NULL, NULL, NULL, NULL }
 };
@@ -10153,8 +13151,10 @@ static conftable tls_conftab[] = {
   { "TLSECCertificateFile",	set_tlseccertfile,	NULL },
   { "TLSECCertificateKeyFile",	set_tlseckeyfile,	NULL },
   { "TLSEngine",		set_tlsengine,		NULL },
+  { "TLSKeyWorkers",		set_tlskeyworkers,	NULL },
   { "TLSLog",			set_tlslog,		NULL },
   { "TLSMasqueradeAddress",	set_tlsmasqaddr,	NULL },
+  { "TLSOCSPCache",		set_tlsocspcache,	NULL },
   { "TLSOptions",		set_tlsoptions,		NULL },
   { "TLSPassPhraseProvider",	set_tlspassphraseprovider, NULL },
   { "TLSPKCS12File", 		set_tlspkcs12file,	NULL },
@@ -10166,6 +13166,10 @@ static conftable tls_conftab[] = {
   { "TLSRSACertificateKeyFile",	set_tlsrsakeyfile,	NULL },
   { "TLSServerCipherPreference",set_tlsservercipherpreference,NULL },
   { "TLSSessionCache",		set_tlssessioncache,	NULL },
+  { "TLSSessionTicketKeys",	set_tlssessionticketkeys,NULL },
+  { "TLSSessionTickets",	set_tlssessiontickets,	NULL },
+  { "TLSStapling",		set_tlsstapling,	NULL },
+  { "TLSStaplingResponder",	set_tlsstaplingresponder,NULL },
   { "TLSTimeoutHandshake",	set_tlstimeouthandshake,NULL },
   { "TLSUserName",		set_tlsusername,	NULL },
   { "TLSVerifyClient",		set_tlsverifyclient,	NULL },
@@ -786,6 +786,9 @@ static int tls_mcache_status(tls_sess_cache_t *cache,
       if (entry->expires > 0) {
         SSL_SESSION *sess;
         TLS_D2I_SSL_SESSION_CONST unsigned char *ptr;
+        const unsigned char *sess_id, *sid_ctx;
+        unsigned int sess_id_len = 0, sid_ctx_len = 0;
+        int ssl_version;
         time_t ts;
 
         ptr = entry->sess_data;
@@ -799,34 +802,44 @@ static int tls_mcache_status(tls_sess_cache_t *cache,
 
         statusf(arg, "%s", "  -----BEGIN SSL SESSION PARAMETERS-----");
 
+        sess_id = SSL_SESSION_get_id(sess, &sess_id_len);
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+        sid_ctx = SSL_SESSION_get0_id_context(sess, &sid_ctx_len);
+        ssl_version = SSL_SESSION_get_protocol_version(sess);
+#else
         /* XXX Directly accessing these fields cannot be a Good Thing. */
-        if (sess->session_id_length > 0) {
+        sid_ctx = sess->sid_ctx;
+        sid_ctx_len = sess->sid_ctx_length;
+        ssl_version = sess->ssl_version;
+#endif /* OpenSSL-1.1.x and later */
+
+        if (sess_id_len > 0) {
           register unsigned int j;
           char *sess_id_str;
 
-          sess_id_str = pcalloc(tmp_pool, (sess->session_id_length * 2) + 1);
+          sess_id_str = pcalloc(tmp_pool, (sess_id_len * 2) + 1);
 
-          for (j = 0; j < sess->session_id_length; j++) {
-            sprintf((char *) &(sess_id_str[j*2]), "%02X", sess->session_id[j]);
+          for (j = 0; j < sess_id_len; j++) {
+            sprintf((char *) &(sess_id_str[j*2]), "%02X", sess_id[j]);
           }
 
           statusf(arg, "    Session ID: %s", sess_id_str);
         }
 
-        if (sess->sid_ctx_length > 0) {
+        if (sid_ctx_len > 0) {
           register unsigned int j;
           char *sid_ctx_str;
 
-          sid_ctx_str = pcalloc(tmp_pool, (sess->sid_ctx_length * 2) + 1);
+          sid_ctx_str = pcalloc(tmp_pool, (sid_ctx_len * 2) + 1);
 
-          for (j = 0; j < sess->sid_ctx_length; j++) {
-            sprintf((char *) &(sid_ctx_str[j*2]), "%02X", sess->sid_ctx[j]);
+          for (j = 0; j < sid_ctx_len; j++) {
+            sprintf((char *) &(sid_ctx_str[j*2]), "%02X", sid_ctx[j]);
           }
 
           statusf(arg, "    Session ID Context: %s", sid_ctx_str);
         }
 
-        switch (sess->ssl_version) {
+        switch (ssl_version) {
           case SSL3_VERSION:
             statusf(arg, "    Protocol: %s", "SSLv3");
             break;
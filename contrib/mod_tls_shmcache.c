@@ -42,7 +42,7 @@
 # include <sys/mman.h>
 #endif
 
-#define MOD_TLS_SHMCACHE_VERSION		"mod_tls_shmcache/0.1"
+#define MOD_TLS_SHMCACHE_VERSION		"mod_tls_shmcache/0.2"
 
 /* Make sure the version of proftpd is as necessary. */
 #if PROFTPD_VERSION_NUMBER < 0x0001030301
@@ -73,8 +73,30 @@ module tls_shmcache_module;
  * bytes (500KB).
  */
 
+/* The shm segment is divided into stripes: each session ID hashes to a
+ * single stripe, and is cached in one of that stripe's entries (i.e. the
+ * cache is set-associative).  Each stripe is protected by its own fcntl(2)
+ * byte-range lock on the cache file, so that operations on different stripes
+ * do not contend with each other; unlike process-shared semaphores/mutexes,
+ * these locks are released by the kernel should a process die while holding
+ * them.  When a stripe is full, its least recently used entry is evicted.
+ */
+#define TLS_SHMCACHE_STRIPE_ENTRIES	8
+
+/* Identifies the layout of the shm segment, so that segments left behind by
+ * an older version of this module are reinitialized, rather than misread.
+ */
+#define TLS_SHMCACHE_MAGIC		0x544c5302
+
+/* Keep the stripe headers and entries suitably aligned within the segment. */
+#define TLS_SHMCACHE_ALIGN(sz)		(((sz) + 15) & ~((size_t) 15))
+
 struct shmcache_entry {
   time_t expires;
+
+  /* Value of the stripe's LRU clock when this entry was last used. */
+  unsigned long last_used;
+
   unsigned int sess_id_len;
   unsigned char sess_id[SSL_MAX_SSL_SESSION_ID_LENGTH];
   unsigned int sess_datalen;
@@ -95,44 +117,49 @@ struct shmcache_large_entry {
   unsigned char *sess_data;
 };
 
-/* The number of entries in the list is determined at run-time, based on
- * the maximum desired size of the shared memory segment.
- */
-struct shmcache_data {
+/* Per-stripe metadata; only accessed while holding that stripe's lock. */
+struct shmcache_stripe {
+  unsigned long clock;
+
+  /* Number of entries in this stripe currently in use. */
+  unsigned int nentries;
 
-  /* Cache metadata. */
   unsigned int nhits;
   unsigned int nmisses;
 
   unsigned int nstored;
   unsigned int ndeleted;
   unsigned int nexpired;
+  unsigned int nevicted;
   unsigned int nerrors;
+};
+
+/* The segment header, followed by the stripe headers, followed by the
+ * entries.  The number of stripes is determined at run-time, based on the
+ * maximum desired size of the shared memory segment.
+ */
+struct shmcache_data {
+  unsigned int sd_magic;
 
   /* This tracks the number of sessions that could not be added because
-   * they exceeded TLS_MAX_SSL_SESSION_SIZE.
+   * they exceeded TLS_MAX_SSL_SESSION_SIZE.  Protected by the header lock.
    */
   unsigned int nexceeded;
   unsigned int exceeded_maxsz;
 
-  /* Track the timestamp of the next session to expire in the cache; used
-   * as an optimization when flushing the cache of expired sessions.
-   */
-  time_t next_expiring;
-
-  /* These listlen/listsz track the number of entries in the cache and total
-   * entries possible, and thus can be used for determining the fullness of
-   * the cache.
-   */
-  unsigned int sd_listlen, sd_listsz;
+  /* Number of stripes, and of entries per stripe. */
+  unsigned int sd_nstripes;
+  unsigned int sd_nways;
 
-  /* It is important that this field be the last in the struct! */
-  struct shmcache_entry *sd_entries;
+  /* Total number of entries possible. */
+  unsigned int sd_listsz;
 };
 
 static tls_sess_cache_t shmcache;
 
 static struct shmcache_data *shmcache_data = NULL;
+static struct shmcache_stripe *shmcache_stripes = NULL;
+static struct shmcache_entry *shmcache_entries = NULL;
 static size_t shmcache_datasz = 0;
 static int shmcache_shmid = -1;
 static pr_fh_t *shmcache_fh = NULL;
@@ -199,29 +226,34 @@ static const char *shmcache_get_lock_desc(int lock_type) {
   return lock_desc;
 }
 
-/* XXX There is anecdotal (and real) evidence that using SysV semaphores
- * is faster than fcntl(2)/flock(3).  However, semaphores are not cleaned up
- * if the process dies tragically.  Could possibly deal with this in an
- * exit event handler, though.  Something to keep in mind.
+/* Byte 0 of the cache file is used for locking the segment header; byte
+ * (n + 1) for locking stripe n.  Locking a length of zero locks the entire
+ * file, i.e. the header and all of the stripes.
  */
-static int shmcache_lock_shm(int lock_type) {
+#define SHMCACHE_LOCK_HEADER		0
+#define SHMCACHE_LOCK_STRIPE(idx)	((off_t) (idx) + 1)
+
+static int shmcache_lock_shm(int lock_type, off_t lock_start, off_t lock_len) {
   const char *lock_desc;
   int fd;
   struct flock lock;
-  unsigned int nattempts = 1;
 
   lock.l_type = lock_type;
   lock.l_whence = SEEK_SET;
-  lock.l_start = 0;
-  lock.l_len = 0;
+  lock.l_start = lock_start;
+  lock.l_len = lock_len;
 
   fd = PR_FH_FD(shmcache_fh);
   lock_desc = shmcache_get_lock_desc(lock_type);
 
-  pr_trace_msg(trace_channel, 9, "attempting to %s shmcache fd %d", lock_desc,
-    fd);
+  pr_trace_msg(trace_channel, 19, "attempting to %s shmcache fd %d "
+    "(start %lu, len %lu)", lock_desc, fd, (unsigned long) lock_start,
+    (unsigned long) lock_len);
 
-  while (fcntl(fd, F_SETLK, &lock) < 0) {
+  /* Since each lock now covers only a small part of the cache, wait for the
+   * lock, rather than polling for it.
+   */
+  while (fcntl(fd, F_SETLKW, &lock) < 0) {
     int xerrno = errno;
 
     if (xerrno == EINTR) {
@@ -231,66 +263,87 @@ static int shmcache_lock_shm(int lock_type) {
 
     pr_trace_msg(trace_channel, 3, "%s of shmcache fd %d failed: %s",
       lock_desc, fd, strerror(xerrno));
-    if (xerrno == EACCES) {
-      struct flock locker;
-
-      /* Get the PID of the process blocking this lock. */
-      if (fcntl(fd, F_GETLK, &locker) == 0) {
-        pr_trace_msg(trace_channel, 3, "process ID %lu has blocking %s on "
-          "shmcache fd %d", (unsigned long) locker.l_pid,
-          shmcache_get_lock_desc(locker.l_type), fd);
-      }
-
-      /* Treat this as an interrupted call, call pr_signals_handle() (which
-       * will delay for a few msecs because of EINTR), and try again.
-       * After 10 attempts, give up altogether.
-       */
-
-      nattempts++;
-      if (nattempts <= 10) {
-        errno = EINTR;
-
-        pr_signals_handle();
-        continue;
-      }
-
-      errno = xerrno;
-      return -1;
-    }
 
     errno = xerrno;
     return -1;
   }
 
-  pr_trace_msg(trace_channel, 9, "%s of shmcache fd %d succeeded", lock_desc,
+  pr_trace_msg(trace_channel, 19, "%s of shmcache fd %d succeeded", lock_desc,
     fd);
   return 0;
 }
 
-/* Use a hash function to hash the given lookup key to a slot in the
- * sd_entries list.  This hash, module the number of entries, is the initial
- * iteration start point.  This will hopefully avoid having to do many linear
- * scans for the add/get/delete operations.
+static int shmcache_lock_stripe(int lock_type, unsigned int idx) {
+  return shmcache_lock_shm(lock_type, SHMCACHE_LOCK_STRIPE(idx), 1);
+}
+
+/* Use a hash function to hash the given lookup key to a stripe.
  *
- * Use Perl's hashing algorithm.
+ * This is the 32-bit FNV-1a hash, followed by the MurmurHash3 finalizer,
+ * so that every bit of the session ID affects the (modulo) stripe index.
  */
 static unsigned int shmcache_hash(unsigned char *sess_id,
     unsigned int sess_id_len) {
-  unsigned int i = 0;
-  size_t sz = sess_id_len;
+  register unsigned int i;
+  uint32_t h = 2166136261U;
+
+  for (i = 0; i < sess_id_len; i++) {
+    h ^= sess_id[i];
+    h *= 16777619U;
+  }
 
-  while (sz--) {
-    const unsigned char *k = sess_id;
-    unsigned int c = *k;
-    k++;
+  h ^= h >> 16;
+  h *= 0x85ebca6bU;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35U;
+  h ^= h >> 16;
 
-    /* Always handle signals in potentially long-running while loops. */
-    pr_signals_handle();
+  return (unsigned int) h;
+}
+
+/* Computes the layout of a segment holding at most the given number of
+ * bytes.  Returns the total segment size needed, or zero if not even a
+ * single entry fits.
+ */
+static size_t shmcache_get_layout(size_t requested_size,
+    unsigned int *nstripes, unsigned int *nways) {
+  size_t hdr_size, stripe_size, entry_size, avail;
+
+  hdr_size = TLS_SHMCACHE_ALIGN(sizeof(struct shmcache_data));
+  stripe_size = TLS_SHMCACHE_ALIGN(sizeof(struct shmcache_stripe));
+  entry_size = TLS_SHMCACHE_ALIGN(sizeof(struct shmcache_entry));
+
+  if (requested_size < hdr_size + stripe_size + entry_size) {
+    return 0;
+  }
+
+  avail = requested_size - hdr_size;
 
-    i = (i * 33) + c;
+  *nways = TLS_SHMCACHE_STRIPE_ENTRIES;
+  *nstripes = avail / (stripe_size + (*nways * entry_size));
+
+  if (*nstripes == 0) {
+    /* Not enough room for a full stripe; use a single, smaller stripe. */
+    *nstripes = 1;
+    *nways = (avail - stripe_size) / entry_size;
   }
 
-  return i;
+  return hdr_size + (*nstripes * stripe_size) +
+    (*nstripes * *nways * entry_size);
+}
+
+static void shmcache_set_layout(struct shmcache_data *data) {
+  shmcache_stripes = (struct shmcache_stripe *) (((char *) data) +
+    TLS_SHMCACHE_ALIGN(sizeof(struct shmcache_data)));
+  shmcache_entries = (struct shmcache_entry *) (((char *) shmcache_stripes) +
+    (data->sd_nstripes * TLS_SHMCACHE_ALIGN(sizeof(struct shmcache_stripe))));
+}
+
+static struct shmcache_entry *shmcache_get_entry(unsigned int stripe_idx,
+    unsigned int way) {
+  return (struct shmcache_entry *) (((char *) shmcache_entries) +
+    (((stripe_idx * shmcache_data->sd_nways) + way) *
+      TLS_SHMCACHE_ALIGN(sizeof(struct shmcache_entry))));
 }
 
 static struct shmcache_data *shmcache_get_shm(pr_fh_t *fh,
@@ -299,18 +352,19 @@ static struct shmcache_data *shmcache_get_shm(pr_fh_t *fh,
   int shm_existed = FALSE;
   struct shmcache_data *data = NULL;
   size_t shm_size;
-  unsigned int shm_sess_max = 0;
+  unsigned int shm_nstripes = 0, shm_nways = 0;
   key_t key;
 
-  /* Calculate the size to allocate.  First, calculate the maximum number
-   * of sessions we can cache, given the configured size.  Then
-   * calculate the shm segment size to allocate to hold that number of
-   * sessions.  Round the segment size up to the nearest SHMLBA boundary.
+  /* Calculate the size to allocate.  First, calculate the number of stripes
+   * (and entries per stripe) we can cache, given the configured size.  Then
+   * calculate the shm segment size to allocate to hold those stripes.  Round
+   * the segment size up to the nearest SHMLBA boundary.
    */
-  shm_sess_max = (requested_size - sizeof(struct shmcache_data)) /
-    (sizeof(struct shmcache_entry));
-  shm_size = sizeof(struct shmcache_data) +
-    (shm_sess_max * sizeof(struct shmcache_entry));
+  shm_size = shmcache_get_layout(requested_size, &shm_nstripes, &shm_nways);
+  if (shm_size == 0) {
+    errno = EINVAL;
+    return NULL;
+  }
 
   rem = shm_size % SHMLBA;
   if (rem != 0) {
@@ -459,111 +513,155 @@ static struct shmcache_data *shmcache_get_shm(pr_fh_t *fh,
         "unable to stat shm ID %d: %s", shmid, strerror(xerrno));
       errno = xerrno;
     }
+  }
 
-  } else {
-    /* Make sure the memory is initialized. */
-    if (shmcache_lock_shm(F_WRLCK) < 0) {
-      pr_trace_msg(trace_channel, 1,
-        "error write-locking shmcache: %s", strerror(errno));
+  /* Make sure the memory is initialized, including any existing segment
+   * which was laid out differently (e.g. by an older version of this module).
+   */
+  if (shmcache_lock_shm(F_WRLCK, 0, 0) < 0) {
+    pr_trace_msg(trace_channel, 1,
+      "error write-locking shmcache: %s", strerror(errno));
+  }
+
+  if (shm_existed == FALSE ||
+      data->sd_magic != TLS_SHMCACHE_MAGIC ||
+      data->sd_nstripes != shm_nstripes ||
+      data->sd_nways != shm_nways) {
+    if (shm_existed) {
+      pr_trace_msg(trace_channel, 3, "%s",
+        "existing shm has unexpected layout, reinitializing");
     }
 
     memset(data, 0, shm_size);
+    data->sd_nstripes = shm_nstripes;
+    data->sd_nways = shm_nways;
+    data->sd_listsz = shm_nstripes * shm_nways;
+    data->sd_magic = TLS_SHMCACHE_MAGIC;
+  }
 
-    if (shmcache_lock_shm(F_UNLCK) < 0) {
-      pr_trace_msg(trace_channel, 1,
-        "error unlocking shmcache: %s", strerror(errno));
-    }
+  if (shmcache_lock_shm(F_UNLCK, 0, 0) < 0) {
+    pr_trace_msg(trace_channel, 1,
+      "error unlocking shmcache: %s", strerror(errno));
   }
 
   shmcache_datasz = shm_size;
 
   shmcache_shmid = shmid;
   pr_trace_msg(trace_channel, 9,
-    "using shm ID %d for shmcache path '%s'", shmcache_shmid, fh->fh_path);
-
-  data->sd_entries = (struct shmcache_entry *) (data + sizeof(struct shmcache_data));
-  data->sd_listsz = shm_sess_max;
+    "using shm ID %d for shmcache path '%s' (%u stripes of %u sessions)",
+    shmcache_shmid, fh->fh_path, shm_nstripes, shm_nways);
 
+  shmcache_set_layout(data);
   return data;
 }
 
-/* Scan the entire list, clearing out expired sessions.  Logs the number
- * of sessions that expired and updates the header stat.
+/* Scan the in-memory large session list, clearing out expired sessions. */
+static void shmcache_flush_large_sess(void) {
+  register unsigned int i;
+  struct shmcache_large_entry *entries;
+  time_t now;
+
+  if (shmcache_sess_list == NULL) {
+    return;
+  }
+
+  now = time(NULL);
+
+  entries = shmcache_sess_list->elts;
+  for (i = 0; i < shmcache_sess_list->nelts; i++) {
+    struct shmcache_large_entry *entry;
+
+    entry = &(entries[i]);
+
+    if (entry->expires > 0 &&
+        entry->expires <= now) {
+      /* This entry has expired; clear its slot. */
+      entry->expires = 0;
+      pr_memscrub(entry->sess_data, entry->sess_datalen);
+    }
+  }
+}
+
+/* Find the entry in the given stripe to use for a new session: a free or
+ * expired entry if there is one, otherwise the least recently used entry,
+ * which is evicted.  Updates the stripe stats.
  *
- * NOTE: Callers are assumed to handle the locking of the shm before/after
+ * NOTE: Callers are assumed to handle the locking of the stripe before/after
  * calling this function!
  */
-static unsigned int shmcache_flush(void) {
+static struct shmcache_entry *shmcache_get_free_entry(unsigned int stripe_idx) {
   register unsigned int i;
-  unsigned int flushed = 0;
-  time_t now, next_expiring = 0;
+  struct shmcache_stripe *stripe;
+  struct shmcache_entry *lru_entry = NULL;
+  time_t now;
 
+  stripe = &(shmcache_stripes[stripe_idx]);
   now = time(NULL);
 
-  /* We always scan the in-memory large session entry list. */
-  if (shmcache_sess_list != NULL) {
-    struct shmcache_large_entry *entries;
+  for (i = 0; i < shmcache_data->sd_nways; i++) {
+    struct shmcache_entry *entry;
 
-    entries = shmcache_sess_list->elts;
-    for (i = 0; i < shmcache_sess_list->nelts; i++) {
-      struct shmcache_large_entry *entry;
+    entry = shmcache_get_entry(stripe_idx, i);
+    if (entry->expires == 0) {
+      return entry;
+    }
 
-      entry = &(entries[i]);
+    if (entry->expires <= now) {
+      /* This entry has expired; clear and reuse its slot. */
+      pr_memscrub(entry->sess_data, entry->sess_datalen);
+      entry->expires = 0;
 
-      if (entry->expires > now) {
-        /* This entry has expired; clear its slot. */
-        entry->expires = 0;
-        pr_memscrub(entry->sess_data, entry->sess_datalen);
+      stripe->nexpired++;
+      if (stripe->nentries > 0) {
+        stripe->nentries--;
       }
-    }
-  }
 
-  /* If now is earlier than the earliest expiring session in the cache,
-   * then a scan will be pointless.
-   */
-  if (now < shmcache_data->next_expiring) {
-    unsigned int secs;
+      return entry;
+    }
 
-    secs = shmcache_data->next_expiring - now;
-    tls_log("shmcache: no expired sessions to flush; %u secs to next "
-      "expiration", secs);
-    return 0;
+    if (lru_entry == NULL ||
+        entry->last_used < lru_entry->last_used) {
+      lru_entry = entry;
+    }
   }
 
-  tls_log("shmcache: flushing cache of expired sessions");
+  if (lru_entry != NULL) {
+    pr_trace_msg(trace_channel, 17,
+      "stripe %u full, evicting least recently used session", stripe_idx);
 
-  for (i = 0; i < shmcache_data->sd_listsz; i++) {
-    struct shmcache_entry *entry;
+    pr_memscrub(lru_entry->sess_data, lru_entry->sess_datalen);
+    lru_entry->expires = 0;
 
-    entry = &(shmcache_data->sd_entries[i]);
-    if (entry->expires > 0) {
-      if (entry->expires > now) {
-        if (entry->expires < next_expiring) {
-          next_expiring = entry->expires;
-        }
+    stripe->nevicted++;
+    if (stripe->nentries > 0) {
+      stripe->nentries--;
+    }
+  }
 
-      } else {
-        /* This entry has expired; clear its slot. */
-        entry->expires = 0;
-        pr_memscrub(entry->sess_data, entry->sess_datalen);
+  return lru_entry;
+}
 
-        /* Don't forget to update the stats. */
-        shmcache_data->nexpired++;
+/* Look up the entry for the given session ID in the given stripe.
+ *
+ * NOTE: Callers are assumed to handle the locking of the stripe before/after
+ * calling this function!
+ */
+static struct shmcache_entry *shmcache_find_entry(unsigned int stripe_idx,
+    unsigned char *sess_id, unsigned int sess_id_len) {
+  register unsigned int i;
 
-        if (shmcache_data->sd_listlen > 0) {
-          shmcache_data->sd_listlen--;
-        }
+  for (i = 0; i < shmcache_data->sd_nways; i++) {
+    struct shmcache_entry *entry;
 
-        flushed++;
-      }
+    entry = shmcache_get_entry(stripe_idx, i);
+    if (entry->expires > 0 &&
+        entry->sess_id_len == sess_id_len &&
+        memcmp(entry->sess_id, sess_id, sess_id_len) == 0) {
+      return entry;
     }
-
-    shmcache_data->next_expiring = next_expiring;
   }
 
-  tls_log("shmcache: flushed %u expired %s from cache", flushed,
-    flushed != 1 ? "sessions" : "session");
-  return flushed;
+  return NULL;
 }
 
 /* Cache implementation callbacks.
@@ -615,8 +713,9 @@ static int shmcache_open(tls_sess_cache_t *cache, char *info, long timeout) {
         size_t min_size;
 
         /* The bare minimum size MUST be able to hold at least one session. */
-        min_size = sizeof(struct shmcache_data) +
-          sizeof(struct shmcache_entry);
+        min_size = TLS_SHMCACHE_ALIGN(sizeof(struct shmcache_data)) +
+          TLS_SHMCACHE_ALIGN(sizeof(struct shmcache_stripe)) +
+          TLS_SHMCACHE_ALIGN(sizeof(struct shmcache_entry));
 
         if (size < min_size) {
           pr_trace_msg(trace_channel, 1,
@@ -813,6 +912,8 @@ static int shmcache_close(tls_sess_cache_t *cache) {
     }
 
     shmcache_data = NULL;
+    shmcache_stripes = NULL;
+    shmcache_entries = NULL;
   }
 
   pr_fsio_close(shmcache_fh);
@@ -824,6 +925,7 @@ static int shmcache_add_large_sess(tls_sess_cache_t *cache,
     unsigned char *sess_id, unsigned int sess_id_len, time_t expires,
     SSL_SESSION *sess, int sess_len) {
   struct shmcache_large_entry *entry = NULL;
+  unsigned char *ptr;
 
   if (sess_len > TLS_MAX_SSL_SESSION_SIZE) {
     /* We may get sessions to add to the list which do not exceed the max
@@ -831,13 +933,13 @@ static int shmcache_add_large_sess(tls_sess_cache_t *cache,
      * shmcache.  Don't track these in the 'exceeded' stats'.
      */
 
-    if (shmcache_lock_shm(F_WRLCK) == 0) {
+    if (shmcache_lock_shm(F_WRLCK, SHMCACHE_LOCK_HEADER, 1) == 0) {
       shmcache_data->nexceeded++;
-      if (sess_len > shmcache_data->exceeded_maxsz) {
+      if ((unsigned int) sess_len > shmcache_data->exceeded_maxsz) {
         shmcache_data->exceeded_maxsz = sess_len;
       }
 
-      if (shmcache_lock_shm(F_UNLCK) < 0) {
+      if (shmcache_lock_shm(F_UNLCK, SHMCACHE_LOCK_HEADER, 1) < 0) {
         tls_log("shmcache: error unlocking shmcache: %s",
         strerror(errno));
       }
@@ -851,23 +953,22 @@ static int shmcache_add_large_sess(tls_sess_cache_t *cache,
   if (shmcache_sess_list != NULL) {
     register unsigned int i;
     struct shmcache_large_entry *entries;
-    time_t now;
 
     /* Look for any expired sessions in the list to overwrite/reuse. */
+    shmcache_flush_large_sess();
+
     entries = shmcache_sess_list->elts;
-    now = time(NULL);
     for (i = 0; i < shmcache_sess_list->nelts; i++) {
-      entry = &(entries[i]);
-
-      if (entry->expires > now) {
-        /* This entry has expired; clear and reuse its slot. */
-        entry->expires = 0;
-        pr_memscrub(entry->sess_data, entry->sess_datalen);
-
+      if (entries[i].expires == 0) {
+        entry = &(entries[i]);
         break;
       }
     }
 
+    if (entry == NULL) {
+      entry = push_array(shmcache_sess_list);
+    }
+
   } else {
     shmcache_sess_list = make_array(cache->cache_pool, 1,
       sizeof(struct shmcache_large_entry));
@@ -886,16 +987,21 @@ static int shmcache_add_large_sess(tls_sess_cache_t *cache,
   memcpy(entry->sess_id, sess_id, sess_id_len);
   entry->sess_datalen = sess_len;
   entry->sess_data = palloc(cache->cache_pool, sess_len);
-  i2d_SSL_SESSION(sess, &(entry->sess_data));
+
+  /* Note that i2d_SSL_SESSION() advances the given pointer. */
+  ptr = entry->sess_data;
+  i2d_SSL_SESSION(sess, &ptr);
 
   return 0;
 }
 
 static int shmcache_add(tls_sess_cache_t *cache, unsigned char *sess_id,
     unsigned int sess_id_len, time_t expires, SSL_SESSION *sess) {
-  register unsigned int i;
-  unsigned int h, idx, last;
-  int found_slot = FALSE, need_lock = TRUE, res = 0, sess_len;
+  unsigned int stripe_idx;
+  int sess_len;
+  struct shmcache_stripe *stripe;
+  struct shmcache_entry *entry;
+  unsigned char *ptr;
 
   pr_trace_msg(trace_channel, 9, "adding session to shmcache cache %p", cache);
 
@@ -922,120 +1028,66 @@ static int shmcache_add(tls_sess_cache_t *cache, unsigned char *sess_id,
       sess, sess_len);
   }
 
-  if (shmcache_data->sd_listlen == shmcache_data->sd_listsz) {
-    /* It appears that the cache is full.  Try flushing any expired
-     * sessions.
-     */
-
-    if (shmcache_lock_shm(F_WRLCK) == 0) {
-      if (shmcache_flush() > 0) {
-        /* If we made room, then do NOT release the lock; we keep the lock
-         * so that we can add the session.
-         */
-        need_lock = FALSE;
-
-      } else {
-        /* Release the lock, and use the "large session" list fallback. */
-        if (shmcache_lock_shm(F_UNLCK) < 0) {
-          tls_log("shmcache: error unlocking shmcache: %s", strerror(errno));
-        }
-
-        return shmcache_add_large_sess(cache, sess_id, sess_id_len, expires,
-          sess, sess_len);
-      }
+  /* Hash the key to find its stripe. */
+  stripe_idx = shmcache_hash(sess_id, sess_id_len) %
+    shmcache_data->sd_nstripes;
+  stripe = &(shmcache_stripes[stripe_idx]);
 
-    } else {
-      tls_log("shmcache: unable to flush shm cache: error write-locking "
-        "shmcache: %s", strerror(errno));
+  if (shmcache_lock_stripe(F_WRLCK, stripe_idx) < 0) {
+    tls_log("shmcache: unable to add session to shm cache: error "
+      "write-locking shmcache: %s", strerror(errno));
 
-      /* Add this session to the "large session" list instead as a fallback. */
-      return shmcache_add_large_sess(cache, sess_id, sess_id_len, expires,
-        sess, sess_len);
-    }
+    /* Add this session to the "large session" list instead as a fallback. */
+    return shmcache_add_large_sess(cache, sess_id, sess_id_len, expires,
+      sess, sess_len);
   }
 
-  /* Hash the key, start looking for an open slot. */
-  h = shmcache_hash(sess_id, sess_id_len);
-  idx = h % shmcache_data->sd_listsz;
-
-  if (need_lock) {
-    if (shmcache_lock_shm(F_WRLCK) < 0) {
-      tls_log("shmcache: unable to add session to shm cache: error "
-        "write-locking shmcache: %s", strerror(errno));
+  /* Replace any existing entry for this session ID; otherwise use a free
+   * entry, evicting the least recently used entry if the stripe is full.
+   */
+  entry = shmcache_find_entry(stripe_idx, sess_id, sess_id_len);
+  if (entry != NULL) {
+    pr_memscrub(entry->sess_data, entry->sess_datalen);
+    entry->expires = 0;
 
-      /* Add this session to the "large session" list instead as a fallback. */
-      return shmcache_add_large_sess(cache, sess_id, sess_id_len, expires,
-        sess, sess_len);
+    if (stripe->nentries > 0) {
+      stripe->nentries--;
     }
-  }
-
-  i = idx;
-  last = idx > 0 ? (idx - 1) : 0;
-
-  do {
-    struct shmcache_entry *entry;
-
-    pr_signals_handle();
-
-    /* Look for the first open slot (i.e. expires == 0). */
-    entry = &(shmcache_data->sd_entries[i]);
-    if (entry->expires == 0) {
-      unsigned char *ptr;
-
-      entry->expires = expires;
-      entry->sess_id_len = sess_id_len;
-      memcpy(entry->sess_id, sess_id, sess_id_len);
-      entry->sess_datalen = sess_len;
-
-      ptr = entry->sess_data;
-      i2d_SSL_SESSION(sess, &ptr);
-
-      shmcache_data->sd_listlen++;
-      shmcache_data->nstored++;
-
-      if (shmcache_data->next_expiring > 0) {
-        if (expires < shmcache_data->next_expiring) {
-          shmcache_data->next_expiring = expires;
-        }
-
-      } else {
-        shmcache_data->next_expiring = expires;
-      }
 
-      found_slot = TRUE;
-      break;
-    }
+  } else {
+    entry = shmcache_get_free_entry(stripe_idx);
+  }
 
-    if (i < shmcache_data->sd_listsz) {
-      i++;
+  if (entry != NULL) {
+    entry->expires = expires;
+    entry->last_used = ++(stripe->clock);
+    entry->sess_id_len = sess_id_len;
+    memcpy(entry->sess_id, sess_id, sess_id_len);
+    entry->sess_datalen = sess_len;
 
-    } else {
-      i = 0;
-    }
+    ptr = entry->sess_data;
+    i2d_SSL_SESSION(sess, &ptr);
 
-  } while (i != last);
+    stripe->nentries++;
+    stripe->nstored++;
+  }
 
-  /* There is a race condition possible between the open slots check
-   * above and the scan through the slots.  So if we didn't actually find
-   * an open slot at this point, add it to the "large session" list.
-   */
-  if (!found_slot) {
-    res = shmcache_add_large_sess(cache, sess_id, sess_id_len, expires, sess,
-      sess_len);
+  if (shmcache_lock_stripe(F_UNLCK, stripe_idx) < 0) {
+    tls_log("shmcache: error unlocking shmcache: %s", strerror(errno));
   }
 
-  if (need_lock) {
-    if (shmcache_lock_shm(F_UNLCK) < 0) {
-      tls_log("shmcache: error unlocking shmcache: %s", strerror(errno));
-    }
+  if (entry == NULL) {
+    /* Should never happen; every stripe has at least one entry. */
+    return shmcache_add_large_sess(cache, sess_id, sess_id_len, expires,
+      sess, sess_len);
   }
 
-  return res;
+  return 0;
 }
 
 static SSL_SESSION *shmcache_get(tls_sess_cache_t *cache,
     unsigned char *sess_id, unsigned int sess_id_len) {
-  unsigned int h, idx;
+  unsigned int stripe_idx;
   SSL_SESSION *sess = NULL;
 
   pr_trace_msg(trace_channel, 9, "getting session from shmcache cache %p",
@@ -1045,30 +1097,28 @@ static SSL_SESSION *shmcache_get(tls_sess_cache_t *cache,
   if (shmcache_sess_list != NULL) {
     register unsigned int i;
     struct shmcache_large_entry *entries;
+    time_t now;
+
+    now = time(NULL);
 
     entries = shmcache_sess_list->elts;
     for (i = 0; i < shmcache_sess_list->nelts; i++) {
       struct shmcache_large_entry *entry;
 
       entry = &(entries[i]);
-      if (entry->expires > 0 &&
+      if (entry->expires > now &&
           entry->sess_id_len == sess_id_len &&
           memcmp(entry->sess_id, sess_id, entry->sess_id_len) == 0) {
-        time_t now;
-
-        now = time(NULL);
-        if (entry->expires <= now) {
-          TLS_D2I_SSL_SESSION_CONST unsigned char *ptr;
+        TLS_D2I_SSL_SESSION_CONST unsigned char *ptr;
 
-          ptr = entry->sess_data;
-          sess = d2i_SSL_SESSION(NULL, &ptr, entry->sess_datalen);
-          if (sess == NULL) {
-            tls_log("shmcache: error retrieving session from cache: %s",
-              shmcache_get_crypto_errors());
+        ptr = entry->sess_data;
+        sess = d2i_SSL_SESSION(NULL, &ptr, entry->sess_datalen);
+        if (sess == NULL) {
+          tls_log("shmcache: error retrieving session from cache: %s",
+            shmcache_get_crypto_errors());
 
-          } else {
-            break;
-          }
+        } else {
+          break;
         }
       }
     }
@@ -1078,63 +1128,56 @@ static SSL_SESSION *shmcache_get(tls_sess_cache_t *cache,
     return sess;
   }
 
-  h = shmcache_hash(sess_id, sess_id_len);
-  idx = h % shmcache_data->sd_listsz;
+  stripe_idx = shmcache_hash(sess_id, sess_id_len) %
+    shmcache_data->sd_nstripes;
 
-  if (shmcache_lock_shm(F_WRLCK) == 0) {
-    register unsigned int i;
-    unsigned int last;
-
-    i = idx;
-    last = idx > 0 ? (idx -1) : 0;
-
-    do {
-      struct shmcache_entry *entry;
+  /* We need a write lock even for lookups, as they update the LRU state. */
+  if (shmcache_lock_stripe(F_WRLCK, stripe_idx) == 0) {
+    struct shmcache_stripe *stripe;
+    struct shmcache_entry *entry;
 
-      pr_signals_handle();
+    stripe = &(shmcache_stripes[stripe_idx]);
 
-      entry = &(shmcache_data->sd_entries[i]);
-      if (entry->expires > 0 &&
-          entry->sess_id_len == sess_id_len &&
-          memcmp(entry->sess_id, sess_id, entry->sess_id_len) == 0) {
-        time_t now;
+    entry = shmcache_find_entry(stripe_idx, sess_id, sess_id_len);
+    if (entry != NULL) {
+      time_t now;
 
-        /* Don't forget to update the stats. */
-        now = time(NULL);
+      /* Don't forget to update the stats. */
+      now = time(NULL);
 
-        if (entry->expires > now) {
-          TLS_D2I_SSL_SESSION_CONST unsigned char *ptr;
+      if (entry->expires > now) {
+        TLS_D2I_SSL_SESSION_CONST unsigned char *ptr;
 
-          ptr = entry->sess_data;
-          sess = d2i_SSL_SESSION(NULL, &ptr, entry->sess_datalen);
-          if (sess != NULL) {
-            shmcache_data->nhits++;
+        ptr = entry->sess_data;
+        sess = d2i_SSL_SESSION(NULL, &ptr, entry->sess_datalen);
+        if (sess != NULL) {
+          entry->last_used = ++(stripe->clock);
+          stripe->nhits++;
 
-          } else {
-            tls_log("shmcache: error retrieving session from cache: %s",
-              shmcache_get_crypto_errors());
-            shmcache_data->nerrors++;
-          }
+        } else {
+          tls_log("shmcache: error retrieving session from cache: %s",
+            shmcache_get_crypto_errors());
+          stripe->nerrors++;
         }
 
-        break;
-      }
-
-      if (i < shmcache_data->sd_listsz) {
-        i++;
-
       } else {
-        i = 0;
-      }
+        /* This entry has expired; clear its slot. */
+        pr_memscrub(entry->sess_data, entry->sess_datalen);
+        entry->expires = 0;
 
-    } while (i != last);
+        stripe->nexpired++;
+        if (stripe->nentries > 0) {
+          stripe->nentries--;
+        }
+      }
+    }
 
     if (sess == NULL) {
-      shmcache_data->nmisses++;
+      stripe->nmisses++;
       errno = ENOENT;
     }
 
-    if (shmcache_lock_shm(F_UNLCK) < 0) {
+    if (shmcache_lock_stripe(F_UNLCK, stripe_idx) < 0) {
       tls_log("shmcache: error unlocking shmcache: %s", strerror(errno));
     }
 
@@ -1150,7 +1193,7 @@ static SSL_SESSION *shmcache_get(tls_sess_cache_t *cache,
 
 static int shmcache_delete(tls_sess_cache_t *cache,
     unsigned char *sess_id, unsigned int sess_id_len) {
-  unsigned int h, idx;
+  unsigned int stripe_idx;
   int res;
 
   pr_trace_msg(trace_channel, 9, "removing session from shmcache cache %p",
@@ -1176,55 +1219,38 @@ static int shmcache_delete(tls_sess_cache_t *cache,
     }
   }
 
-  h = shmcache_hash(sess_id, sess_id_len);
-  idx = h % shmcache_data->sd_listsz;
+  stripe_idx = shmcache_hash(sess_id, sess_id_len) %
+    shmcache_data->sd_nstripes;
 
-  if (shmcache_lock_shm(F_WRLCK) == 0) {
-    register unsigned int i;
-    unsigned int last;
-
-    i = idx;
-    last = idx > 0 ? (idx - 1) : 0;
-
-    do {
-      struct shmcache_entry *entry;
-
-      pr_signals_handle();
-
-      entry = &(shmcache_data->sd_entries[i]);
-      if (entry->sess_id_len == sess_id_len &&
-          memcmp(entry->sess_id, sess_id, entry->sess_id_len) == 0) {
-        time_t now;
-
-        pr_memscrub(entry->sess_data, entry->sess_datalen);
+  if (shmcache_lock_stripe(F_WRLCK, stripe_idx) == 0) {
+    struct shmcache_stripe *stripe;
+    struct shmcache_entry *entry;
 
-        if (shmcache_data->sd_listlen > 0) {
-          shmcache_data->sd_listlen--;
-        }
+    stripe = &(shmcache_stripes[stripe_idx]);
 
-        /* Don't forget to update the stats. */
-        now = time(NULL);
-        if (entry->expires > now) {
-          shmcache_data->ndeleted++;
+    entry = shmcache_find_entry(stripe_idx, sess_id, sess_id_len);
+    if (entry != NULL) {
+      time_t now;
 
-        } else {
-          shmcache_data->nexpired++;
-        }
+      pr_memscrub(entry->sess_data, entry->sess_datalen);
 
-        entry->expires = 0;
-        break;
+      if (stripe->nentries > 0) {
+        stripe->nentries--;
       }
 
-      if (i < shmcache_data->sd_listsz) {
-        i++;
+      /* Don't forget to update the stats. */
+      now = time(NULL);
+      if (entry->expires > now) {
+        stripe->ndeleted++;
 
       } else {
-        i = 0;
+        stripe->nexpired++;
       }
 
-    } while (i != last);
+      entry->expires = 0;
+    }
 
-    if (shmcache_lock_shm(F_UNLCK) < 0) {
+    if (shmcache_lock_stripe(F_UNLCK, stripe_idx) < 0) {
       tls_log("shmcache: error unlocking shmcache: %s", strerror(errno));
     }
 
@@ -1243,7 +1269,7 @@ static int shmcache_delete(tls_sess_cache_t *cache,
 
 static int shmcache_clear(tls_sess_cache_t *cache) {
   register unsigned int i;
-  int res;
+  int res = 0;
 
   pr_trace_msg(trace_channel, 9, "clearing shmcache cache %p", cache); 
 
@@ -1265,25 +1291,31 @@ static int shmcache_clear(tls_sess_cache_t *cache) {
     }
   }
 
-  if (shmcache_lock_shm(F_WRLCK) < 0) {
+  if (shmcache_lock_shm(F_WRLCK, 0, 0) < 0) {
     tls_log("shmcache: unable to clear cache: error write-locking shmcache: %s",
       strerror(errno));
     return -1;
   }
 
-  for (i = 0; i < shmcache_data->sd_listsz; i++) {
-    struct shmcache_entry *entry;
+  for (i = 0; i < shmcache_data->sd_nstripes; i++) {
+    register unsigned int j;
+    struct shmcache_stripe *stripe;
 
-    entry = &(shmcache_data->sd_entries[i]);
+    stripe = &(shmcache_stripes[i]);
 
-    entry->expires = 0;
-    pr_memscrub(entry->sess_data, entry->sess_datalen);
-  }
+    for (j = 0; j < shmcache_data->sd_nways; j++) {
+      struct shmcache_entry *entry;
+
+      entry = shmcache_get_entry(i, j);
+      entry->expires = 0;
+      pr_memscrub(entry->sess_data, entry->sess_datalen);
+    }
 
-  res = shmcache_data->sd_listlen; 
-  shmcache_data->sd_listlen = 0;
+    res += stripe->nentries;
+    stripe->nentries = 0;
+  }
 
-  if (shmcache_lock_shm(F_UNLCK) < 0) {
+  if (shmcache_lock_shm(F_UNLCK, 0, 0) < 0) {
     tls_log("shmcache: error unlocking shmcache: %s", strerror(errno));
   }
 
@@ -1336,13 +1368,15 @@ static int shmcache_remove(tls_sess_cache_t *cache) {
 
 static int shmcache_status(tls_sess_cache_t *cache,
     void (*statusf)(void *, const char *, ...), void *arg, int flags) {
+  register unsigned int i;
   int res, xerrno = 0;
   struct shmid_ds ds;
+  struct shmcache_stripe totals;
   pool *tmp_pool;
 
   pr_trace_msg(trace_channel, 9, "checking shmcache cache %p", cache); 
 
-  if (shmcache_lock_shm(F_RDLCK) < 0) {
+  if (shmcache_lock_shm(F_RDLCK, 0, 0) < 0) {
     pr_log_debug(DEBUG1, MOD_TLS_SHMCACHE_VERSION
       ": error read-locking shmcache: %s", strerror(errno));
     return -1;
@@ -1373,19 +1407,37 @@ static int shmcache_status(tls_sess_cache_t *cache,
       shmcache_shmid, strerror(xerrno));
   } 
 
+  memset(&totals, 0, sizeof(totals));
+  for (i = 0; i < shmcache_data->sd_nstripes; i++) {
+    struct shmcache_stripe *stripe;
+
+    stripe = &(shmcache_stripes[i]);
+    totals.nentries += stripe->nentries;
+    totals.nhits += stripe->nhits;
+    totals.nmisses += stripe->nmisses;
+    totals.nstored += stripe->nstored;
+    totals.ndeleted += stripe->ndeleted;
+    totals.nexpired += stripe->nexpired;
+    totals.nevicted += stripe->nevicted;
+    totals.nerrors += stripe->nerrors;
+  }
+
   statusf(arg, "%s", "");
-  statusf(arg, "Max session cache size: %u", shmcache_data->sd_listsz);
-  statusf(arg, "Current session cache size: %u", shmcache_data->sd_listlen);
+  statusf(arg, "Max session cache size: %u (%u stripes of %u sessions)",
+    shmcache_data->sd_listsz, shmcache_data->sd_nstripes,
+    shmcache_data->sd_nways);
+  statusf(arg, "Current session cache size: %u", totals.nentries);
   statusf(arg, "%s", "");
-  statusf(arg, "Cache lifetime hits: %u", shmcache_data->nhits);
-  statusf(arg, "Cache lifetime misses: %u", shmcache_data->nmisses);
+  statusf(arg, "Cache lifetime hits: %u", totals.nhits);
+  statusf(arg, "Cache lifetime misses: %u", totals.nmisses);
   statusf(arg, "%s", "");
-  statusf(arg, "Cache lifetime sessions stored: %u", shmcache_data->nstored);
-  statusf(arg, "Cache lifetime sessions deleted: %u", shmcache_data->ndeleted);
-  statusf(arg, "Cache lifetime sessions expired: %u", shmcache_data->nexpired);
+  statusf(arg, "Cache lifetime sessions stored: %u", totals.nstored);
+  statusf(arg, "Cache lifetime sessions deleted: %u", totals.ndeleted);
+  statusf(arg, "Cache lifetime sessions expired: %u", totals.nexpired);
+  statusf(arg, "Cache lifetime sessions evicted: %u", totals.nevicted);
   statusf(arg, "%s", "");
   statusf(arg, "Cache lifetime errors handling sessions in cache: %u",
-    shmcache_data->nerrors);
+    totals.nerrors);
   statusf(arg, "Cache lifetime sessions exceeding max entry size: %u",
     shmcache_data->nexceeded);
   if (shmcache_data->nexceeded > 0) {
@@ -1394,12 +1446,10 @@ static int shmcache_status(tls_sess_cache_t *cache,
   }
 
   if (flags & TLS_SESS_CACHE_STATUS_FL_SHOW_SESSIONS) {
-    register unsigned int i;
-
     statusf(arg, "%s", "");
     statusf(arg, "%s", "Cached sessions:");
 
-    if (shmcache_data->sd_listlen == 0) {
+    if (totals.nentries == 0) {
       statusf(arg, "%s", "  (none)");
     }
 
@@ -1418,10 +1468,14 @@ static int shmcache_status(tls_sess_cache_t *cache,
 
       pr_signals_handle();
 
-      entry = &(shmcache_data->sd_entries[i]);
+      entry = shmcache_get_entry(i / shmcache_data->sd_nways,
+        i % shmcache_data->sd_nways);
       if (entry->expires > 0) {
         SSL_SESSION *sess;
         TLS_D2I_SSL_SESSION_CONST unsigned char *ptr;
+        const unsigned char *sess_id, *sid_ctx;
+        unsigned int sess_id_len = 0, sid_ctx_len = 0;
+        int ssl_version;
         time_t ts;
 
         ptr = entry->sess_data;
@@ -1435,34 +1489,44 @@ static int shmcache_status(tls_sess_cache_t *cache,
 
         statusf(arg, "%s", "  -----BEGIN SSL SESSION PARAMETERS-----");
 
+        sess_id = SSL_SESSION_get_id(sess, &sess_id_len);
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+        sid_ctx = SSL_SESSION_get0_id_context(sess, &sid_ctx_len);
+        ssl_version = SSL_SESSION_get_protocol_version(sess);
+#else
         /* XXX Directly accessing these fields cannot be a Good Thing. */
-        if (sess->session_id_length > 0) {
+        sid_ctx = sess->sid_ctx;
+        sid_ctx_len = sess->sid_ctx_length;
+        ssl_version = sess->ssl_version;
+#endif /* OpenSSL-1.1.x and later */
+
+        if (sess_id_len > 0) {
           register unsigned int j;
           char *sess_id_str;
 
-          sess_id_str = pcalloc(tmp_pool, (sess->session_id_length * 2) + 1);
+          sess_id_str = pcalloc(tmp_pool, (sess_id_len * 2) + 1);
 
-          for (j = 0; j < sess->session_id_length; j++) {
-            sprintf((char *) &(sess_id_str[j*2]), "%02X", sess->session_id[j]);
+          for (j = 0; j < sess_id_len; j++) {
+            sprintf((char *) &(sess_id_str[j*2]), "%02X", sess_id[j]);
           }
 
           statusf(arg, "    Session ID: %s", sess_id_str);
         }
 
-        if (sess->sid_ctx_length > 0) {
+        if (sid_ctx_len > 0) {
           register unsigned int j;
           char *sid_ctx_str;
 
-          sid_ctx_str = pcalloc(tmp_pool, (sess->sid_ctx_length * 2) + 1);
+          sid_ctx_str = pcalloc(tmp_pool, (sid_ctx_len * 2) + 1);
 
-          for (j = 0; j < sess->sid_ctx_length; j++) {
-            sprintf((char *) &(sid_ctx_str[j*2]), "%02X", sess->sid_ctx[j]);
+          for (j = 0; j < sid_ctx_len; j++) {
+            sprintf((char *) &(sid_ctx_str[j*2]), "%02X", sid_ctx[j]);
           }
 
           statusf(arg, "    Session ID Context: %s", sid_ctx_str);
         }
 
-        switch (sess->ssl_version) {
+        switch (ssl_version) {
           case SSL3_VERSION:
             statusf(arg, "    Protocol: %s", "SSLv3");
             break;
@@ -1488,7 +1552,7 @@ static int shmcache_status(tls_sess_cache_t *cache,
     }
   }
 
-  if (shmcache_lock_shm(F_UNLCK) < 0) {
+  if (shmcache_lock_shm(F_UNLCK, 0, 0) < 0) {
     pr_log_debug(DEBUG1, MOD_TLS_SHMCACHE_VERSION
       ": error unlocking shmcache: %s", strerror(errno));
   }
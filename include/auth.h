@@ -119,6 +119,20 @@ int pr_auth_cache_set(int, unsigned int);
 #define PR_AUTH_CACHE_FL_GID2NAME	0x00002
 #define PR_AUTH_CACHE_FL_AUTH_MODULE	0x00004
 
+/* Opens the given file as a table of lookup results (getpwnam, getgroups,
+ * uid2name, etc) shared by all session processes, with room for the given
+ * number of entries.  Password hashes are never stored in the table.
+ */
+int pr_auth_cache_table_open(const char *path, unsigned int nents, int flags);
+#define PR_AUTH_CACHE_TABLE_FL_RESET	0x001
+
+int pr_auth_cache_table_close(void);
+
+/* Sets how long, in seconds, found and not-found results stay in the shared
+ * table.
+ */
+int pr_auth_cache_table_set_timeouts(int ttl, int negative_ttl);
+
 /* Wrapper function for retrieving the user's home directory.  This handles
  * any possible RewriteHome configuration.
  */
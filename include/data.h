@@ -45,6 +45,34 @@ void pr_data_set_linger(long);
  */
 void pr_data_clear_xfer_pool(void);
 
+/* Transfer modes, as set by the MODE command.  In block mode, each transfer
+ * is framed as a series of RFC 959 blocks, ending with an EOF block, and the
+ * data connection is kept open for use by the next transfer.
+ */
+#define PR_DATA_MODE_STREAM			1
+#define PR_DATA_MODE_BLOCK			2
+
+int pr_data_get_mode(void);
+int pr_data_set_mode(int);
+
+/* Close the data connection kept open after the last block mode transfer,
+ * if any.  This should be called whenever the client negotiates a new data
+ * connection (e.g. PASV, PORT), or changes the data channel protection.
+ */
+void pr_data_close_persistent(void);
+
+/* Returns TRUE if the data connection was kept open after the last block
+ * mode transfer, FALSE otherwise.  The final reply for that transfer is then
+ * 250, rather than 226.
+ */
+int pr_data_has_persistent(void);
+
+/* Set the file offset at which the next transfer starts (e.g. from REST),
+ * for the restart markers used in block mode.  Transfers for which this is
+ * not set (e.g. directory listings) do not use restart markers.
+ */
+void pr_data_set_offset(off_t);
+
 int pr_data_get_timeout(int);
 void pr_data_set_timeout(int, int);
 #define PR_DATA_TIMEOUT_IDLE			0x001
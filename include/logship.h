@@ -0,0 +1,133 @@
+/*
+ * ProFTPD - FTP server daemon
+ * Copyright (c) 2015 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project team and other respective
+ * copyright holders give permission to link this program with OpenSSL, and
+ * distribute the resulting executable, without including the source code for
+ * OpenSSL in the source distribution.
+ */
+
+/* Log shipping
+ *
+ * The daemon process can create a shared memory ring buffer for each
+ * configured log file, and start a log shipper process.  Writes to those
+ * logs, by any process, are then appended to the ring buffers, without
+ * any syscalls, and the log shipper writes them out to the log files.
+ */
+
+#ifndef PR_LOGSHIP_H
+#define PR_LOGSHIP_H
+
+#include "conf.h"
+
+/* The ring buffers are lock-free, and need atomic compare-and-swap. */
+#if defined(__GNUC__) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 1))
+# define PR_USE_LOGSHIP	1
+#endif
+
+/* Maximum number of log files which can be shipped. */
+#define PR_LOGSHIP_MAX_LOGS		32
+
+/* What to do with a record when its ring buffer is full. */
+#define PR_LOGSHIP_OVERFLOW_WRITE	1
+#define PR_LOGSHIP_OVERFLOW_DROP	2
+
+struct pr_logship_stats {
+  /* Bytes currently waiting in the ring buffer. */
+  unsigned long backlog;
+
+  /* The most bytes which have been waiting in the ring buffer. */
+  unsigned long max_backlog;
+
+  /* Records and bytes written out by the log shipper, and the number of
+   * write(2) calls it used.
+   */
+  unsigned long nrecords;
+  unsigned long nbytes;
+  unsigned long nwrites;
+
+  /* Records which found the ring buffer full (i.e. back-pressure), and of
+   * those, the ones which were dropped.
+   */
+  unsigned long nfull;
+  unsigned long ndropped;
+
+  /* Records lost because of write errors, or because the process writing
+   * them died before finishing.
+   */
+  unsigned long nerrors;
+};
+
+/* Creates the shared memory, in the daemon process, with ring buffers of
+ * the given size (rounded up to a power of two).  The shared memory is only
+ * created once; later calls are no-ops, unless a different size is
+ * requested, in which case -1 is returned, with errno set to EEXIST.
+ */
+int pr_logship_create(size_t ringsz);
+
+/* Adds a ring buffer for the given log file path, if there is not one
+ * already.  Returns the index of the log's ring buffer, or -1 (with errno
+ * set to ENOSPC) if there are no more ring buffers.
+ */
+int pr_logship_add(const char *path);
+
+/* Starts the log shipper process, and enables shipping of writes to the
+ * logs added so far.  Writes which find a ring buffer full are handled
+ * according to the overflow policy.
+ */
+int pr_logship_start(int overflow);
+
+/* Disables shipping, and stops the log shipper process, once it has
+ * written out all of the records in the ring buffers.
+ */
+void pr_logship_stop(void);
+
+/* Notes that the given fd has been opened for the given log file, so that
+ * writes to that fd can be shipped; a NULL path means that writes to the fd
+ * are not to be shipped.  Called by pr_log_openfile(), for every log file it
+ * opens, so log files opened by other means should be passed here too,
+ * lest their fd be mistaken for that of an earlier, closed log file.
+ */
+int pr_logship_open(int fd, const char *path);
+
+/* Writes the given record to the log file open on the fd, either by
+ * appending it to the log's ring buffer, or by writing it directly.
+ * Returns the number of bytes written/queued, or -1 on error.
+ */
+int pr_logship_write(int fd, const char *buf, size_t buflen);
+
+/* Called by the daemon process for each child process it reaps, with the
+ * wait(2) status.  If the child is the log shipper, and it was not stopped
+ * via pr_logship_stop(), shipping is disabled (so that writes go directly
+ * to the log files again), an error is logged, and TRUE is returned;
+ * otherwise FALSE is returned.  The log shipper is started again on the
+ * next restart.
+ */
+int pr_logship_reap(pid_t pid, int status);
+
+/* Returns the PID of the log shipper process, or 0 if it is not running. */
+pid_t pr_logship_get_pid(void);
+
+/* Returns the path of the log file with the given ring buffer index, and
+ * fills in its stats; returns NULL if there is no such index.
+ */
+const char *pr_logship_get_stats(unsigned int idx,
+  struct pr_logship_stats *stats);
+
+#endif /* PR_LOGSHIP_H */
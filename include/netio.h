@@ -146,6 +146,49 @@ typedef struct {
 
 } pr_netio_t;
 
+/* Network I/O filters.  Filters are layered over the NetIO registered for a
+ * stream type, and transform the data read from and written to streams of
+ * that type (e.g. for MODE B framing, or MODE Z compression).  The most
+ * recently pushed filter is the top of the stack: it sees the data written
+ * first, and the data read last.
+ */
+typedef struct netio_filter_rec {
+  struct netio_filter_rec *next;
+
+  /* Memory pool for this object. */
+  struct pool_rec *pool;
+
+  /* Name, used for looking up/removing the filter. */
+  const char *name;
+
+  /* Filter callbacks.
+   *
+   * The start callback is called before each transfer on the stream, and
+   * the finish callback after each successful transfer; the latter is where
+   * any trailing data is written, or checked for having been read.
+   *
+   * The read callback returns the number of bytes read (at least one), zero
+   * on EOF, or -1 (setting errno) on error; EAGAIN will cause it to be
+   * called again.  The write callback returns the number of bytes of the
+   * given buffer which were consumed, or -1 on error.
+   *
+   * The pr_netio_filter_read() and pr_netio_filter_write() functions are
+   * used by the callbacks for reading from/writing to the layer beneath.
+   */
+  int (*start)(struct netio_filter_rec *, pr_netio_stream_t *);
+  int (*finish)(struct netio_filter_rec *, pr_netio_stream_t *);
+  int (*read)(struct netio_filter_rec *, pr_netio_stream_t *, char *, size_t);
+  int (*write)(struct netio_filter_rec *, pr_netio_stream_t *, char *,
+    size_t);
+
+  /* Arbitrary data for the owning module's use. */
+  void *data;
+
+  /* Registering/owning module */
+  module *owner;
+
+} pr_netio_filter_t;
+
 /* Network IO function prototypes */
 pr_buffer_t *pr_netio_buffer_alloc(pr_netio_stream_t *nstrm);
 
@@ -234,6 +277,37 @@ int pr_unregister_netio(int);
 /* Peek at the NetIO registered for the given stream type. */
 pr_netio_t *pr_get_netio(int);
 
+/* Allocate a NetIO filter, with pass-through callbacks. */
+pr_netio_filter_t *pr_alloc_netio_filter(pool *, module *, const char *);
+
+/* Push the given filter onto the top of the filter stack for the given
+ * stream type.  A filter can only be on one stack at a time.
+ */
+int pr_push_netio_filter(pr_netio_filter_t *, int);
+
+/* Remove the named filter from the filter stack for the given stream type.
+ */
+int pr_remove_netio_filter(int, const char *);
+
+/* Peek at the named filter for the given stream type, or at the top of its
+ * filter stack if the name is NULL.
+ */
+pr_netio_filter_t *pr_get_netio_filter(int, const char *);
+
+/* Read from, or write to, the given stream through the layers beneath the
+ * given filter.  These behave like pr_netio_read() and pr_netio_write().
+ */
+int pr_netio_filter_read(pr_netio_filter_t *, pr_netio_stream_t *, char *,
+  size_t, int);
+int pr_netio_filter_write(pr_netio_filter_t *, pr_netio_stream_t *, char *,
+  size_t);
+
+/* Call the start, or finish, callbacks of the filters for the given stream,
+ * from the top of the stack down.  Returns -1 if any of them fail.
+ */
+int pr_netio_start(pr_netio_stream_t *);
+int pr_netio_finish(pr_netio_stream_t *);
+
 /* Initialize the network I/O layer.
  */
 void init_netio(void);
@@ -64,4 +64,47 @@ int pr_trace_msg(const char *, int, const char *, ...)
 
 int pr_trace_vmsg(const char *, int, const char *, va_list);
 
+/* Trace channel handles.  A handle caches the levels of its channel, so
+ * that hot code paths can check whether a message would be logged, before
+ * formatting it (and computing its arguments), at the cost of a couple of
+ * comparisons:
+ *
+ *   static pr_trace_chan_t trace_chan = PR_TRACE_CHAN("data");
+ *
+ *   if (pr_trace_chan_enabled(&trace_chan, 19)) {
+ *     pr_trace_msg(trace_chan.channel, 19, ...);
+ *   }
+ *
+ * The cached levels are refreshed whenever the Trace configuration, the
+ * TraceLog, or the listeners for TraceLog messages change.
+ */
+typedef struct {
+  const char *channel;
+  unsigned int gen;
+  int min_level;
+  int max_level;
+} pr_trace_chan_t;
+
+#define PR_TRACE_CHAN(channel)	{ (channel), 0, 1, 0 }
+
+/* Bumped whenever the cached levels of handles become stale; never zero. */
+extern unsigned int pr_trace_gen;
+
+#ifdef PR_USE_TRACE
+# define pr_trace_chan_enabled(chan, level) \
+  ((chan)->gen == pr_trace_gen ? \
+    ((level) <= (chan)->max_level && (level) >= (chan)->min_level) : \
+    pr_trace_chan_refresh((chan), (level)))
+#else
+# define pr_trace_chan_enabled(chan, level)	FALSE
+#endif /* PR_USE_TRACE */
+
+/* Marks the cached levels of all handles as stale. */
+void pr_trace_invalidate(void);
+
+/* Refreshes the handle's cached levels, and returns TRUE if a message at
+ * the given level would be logged.  Use pr_trace_chan_enabled() instead.
+ */
+int pr_trace_chan_refresh(pr_trace_chan_t *chan, int level);
+
 #endif /* PR_TRACE_H */
@@ -1,6 +1,6 @@
 /*
  * ProFTPD - FTP server daemon
- * Copyright (c) 2003-2011 The ProFTPD Project team
+ * Copyright (c) 2003-2015 The ProFTPD Project team
  *
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -29,9 +29,66 @@
 #ifndef PR_XFERLOG_H
 #define PR_XFERLOG_H
 
+/* TransferLog formats: the classic xferlog(5) text lines, or binary
+ * records (see below).
+ */
+#define PR_XFERLOG_FMT_TEXT		1
+#define PR_XFERLOG_FMT_BINARY		2
+
+/* Binary TransferLog records.  Each record is a fixed-size header, whose
+ * fields are at the offsets below, in network byte order, followed by
+ * strings, each prefixed by its 16-bit length (and not NUL-terminated), in
+ * the order given below.  The record length includes the header and the
+ * strings, so that readers can skip records of unknown versions or types.
+ *
+ * Use ftpxferlog(1) to convert binary TransferLogs to text.
+ */
+#define PR_XFERLOG_BIN_VERSION		1
+
+#define PR_XFERLOG_BIN_TYPE_START	1
+#define PR_XFERLOG_BIN_TYPE_END		2
+
+#define PR_XFERLOG_BIN_OFF_LEN		0	/* 32-bit record length */
+#define PR_XFERLOG_BIN_OFF_VERSION	4	/* 8-bit record version */
+#define PR_XFERLOG_BIN_OFF_TYPE		5	/* 8-bit record type */
+#define PR_XFERLOG_BIN_OFF_XFERTYPE	6	/* 'a' or 'b' */
+#define PR_XFERLOG_BIN_OFF_DIRECTION	7	/* 'i', 'o' or 'd' */
+#define PR_XFERLOG_BIN_OFF_ACCESS_MODE	8	/* 'a', 'g' or 'r' */
+#define PR_XFERLOG_BIN_OFF_COMPLETION	9	/* 'c' or 'i'; '-' for starts */
+#define PR_XFERLOG_BIN_OFF_IDENT	10	/* 1 if RFC1413 ident, else 0 */
+#define PR_XFERLOG_BIN_OFF_PID		12	/* 32-bit PID of the session */
+#define PR_XFERLOG_BIN_OFF_TIME		16	/* 32-bit time(2) of the record */
+#define PR_XFERLOG_BIN_OFF_TIME_USEC	20	/* 32-bit microseconds */
+#define PR_XFERLOG_BIN_OFF_SECS		24	/* 32-bit duration, seconds */
+#define PR_XFERLOG_BIN_OFF_USECS	28	/* 32-bit duration, microseconds */
+#define PR_XFERLOG_BIN_OFF_BYTES_HI	32	/* High 32 bits of byte count */
+#define PR_XFERLOG_BIN_OFF_BYTES_LO	36	/* Low 32 bits of byte count */
+#define PR_XFERLOG_BIN_HDR_LEN		40
+
+/* The strings: remote host, user, path, protocol, RFC1413 ident (or "*"),
+ * and the special action flags.
+ */
+#define PR_XFERLOG_BIN_NSTRS		6
+
+/* For start records, the byte count is the offset at which the transfer
+ * started (i.e. from REST), and the duration is zero.
+ */
+
 int xferlog_open(const char *);
 void xferlog_close(void);
+
+/* Sets the format in which xferlog_write() writes records, one of the
+ * PR_XFERLOG_FMT values; the default is PR_XFERLOG_FMT_TEXT.
+ */
+int xferlog_set_format(int);
+
 int xferlog_write(long, const char *, off_t, char *, char, char, char, char *,
   char, const char *);
 
+/* Writes a start record for a transfer, for binary TransferLogs; a no-op
+ * for text TransferLogs, which only record finished transfers.
+ */
+int xferlog_write_start(const char *, off_t, char *, char, char, char,
+  char *);
+
 #endif /* PR_XFERLOG_H */
@@ -119,6 +119,39 @@ static void auth_exit_ev(const void *event_data, void *user_data) {
   (void) pr_close_scoreboard(FALSE);
 }
 
+static void auth_postparse_ev(const void *event_data, void *user_data) {
+  config_rec *c;
+  int flags = 0;
+
+  c = find_config(main_server->conf, CONF_PARAM, "AuthCacheTimeout", FALSE);
+  if (c != NULL) {
+    (void) pr_auth_cache_table_set_timeouts(*((int *) c->argv[0]),
+      *((int *) c->argv[1]));
+  }
+
+  c = find_config(main_server->conf, CONF_PARAM, "AuthCacheTable", FALSE);
+  if (c == NULL) {
+    return;
+  }
+
+  /* A standalone daemon starts with an empty table; inetd-spawned processes
+   * share whatever their predecessors have cached.
+   */
+  if (ServerType == SERVER_STANDALONE) {
+    flags |= PR_AUTH_CACHE_TABLE_FL_RESET;
+  }
+
+  if (pr_auth_cache_table_open(c->argv[0], *((unsigned int *) c->argv[1]),
+      flags) < 0) {
+    pr_log_pri(PR_LOG_NOTICE, "notice: unable to use AuthCacheTable '%s': %s",
+      (char *) c->argv[0], strerror(errno));
+  }
+}
+
+static void auth_restart_ev(const void *event_data, void *user_data) {
+  (void) pr_auth_cache_table_close();
+}
+
 static int auth_sess_init(void) {
   config_rec *c = NULL;
   unsigned char *tmp = NULL;
@@ -235,6 +268,9 @@ static int auth_init(void) {
   /* By default, enable auth checking */
   set_auth_check(auth_cmd_chk_cb);
 
+  pr_event_register(&auth_module, "core.postparse", auth_postparse_ev, NULL);
+  pr_event_register(&auth_module, "core.restart", auth_restart_ev, NULL);
+
   return 0;
 }
 
@@ -856,6 +892,7 @@ static int setup_env(pool *p, cmd_rec *cmd, char *user, char *pass) {
   config_rec *c, *tmpc;
   char *origuser, *ourname,*anonname = NULL,*anongroup = NULL,*ugroup = NULL;
   char *defaulttransfermode, *defroot = NULL,*defchdir = NULL,*xferlog = NULL;
+  config_rec *xferlog_config = NULL;
   const char *sess_ttyname;
   int aclp, i, res = 0, allow_chroot_symlinks = TRUE, showsymlinks;
   unsigned char *wtmp_log = NULL, *anon_require_passwd = NULL;
@@ -1335,7 +1372,7 @@ static int setup_env(pool *p, cmd_rec *cmd, char *user, char *pass) {
     }
 
     sstrncpy(session.cwd, "/", sizeof(session.cwd));
-    xferlog = get_param_ptr(c->subset, "TransferLog", FALSE);
+    xferlog_config = find_config(c->subset, CONF_PARAM, "TransferLog", FALSE);
 
     if (anongroup) {
       grp = pr_auth_getgrnam(p, anongroup);
@@ -1464,15 +1501,23 @@ static int setup_env(pool *p, cmd_rec *cmd, char *user, char *pass) {
 #endif /* PR_USE_LASTLOG */
 
   /* Open any TransferLogs */
-  if (!xferlog) {
+  if (!xferlog_config) {
     if (c)
-      xferlog = get_param_ptr(c->subset, "TransferLog", FALSE);
+      xferlog_config = find_config(c->subset, CONF_PARAM, "TransferLog",
+        FALSE);
+
+    if (!xferlog_config)
+      xferlog_config = find_config(main_server->conf, CONF_PARAM,
+        "TransferLog", FALSE);
+  }
 
-    if (!xferlog)
-      xferlog = get_param_ptr(main_server->conf, "TransferLog", FALSE);
+  if (xferlog_config) {
+    xferlog = xferlog_config->argv[0];
+    xferlog_set_format(*((int *) xferlog_config->argv[1]));
 
-    if (!xferlog)
-      xferlog = PR_XFERLOG_PATH;
+  } else {
+    xferlog = PR_XFERLOG_PATH;
+    xferlog_set_format(PR_XFERLOG_FMT_TEXT);
   }
 
   if (strcasecmp(xferlog, "NONE") == 0) {
@@ -2599,6 +2644,80 @@ MODRET set_authaliasonly(cmd_rec *cmd) {
   return PR_HANDLED(cmd);
 }
 
+/* usage: AuthCacheTable path [max-entries] */
+MODRET set_authcachetable(cmd_rec *cmd) {
+  config_rec *c;
+  unsigned int nents = 4096;
+
+  if (cmd->argc < 2 ||
+      cmd->argc > 3) {
+    CONF_ERROR(cmd, "wrong number of parameters");
+  }
+
+  CHECK_CONF(cmd, CONF_ROOT);
+
+  if (pr_fs_valid_path(cmd->argv[1]) < 0) {
+    CONF_ERROR(cmd, "must be an absolute path");
+  }
+
+  if (cmd->argc == 3) {
+    char *ptr = NULL;
+    long n;
+
+    n = strtol(cmd->argv[2], &ptr, 10);
+    if (ptr && *ptr) {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "badly formatted number: ",
+        cmd->argv[2], NULL));
+    }
+
+    if (n < 1) {
+      CONF_ERROR(cmd, "max-entries must be greater than zero");
+    }
+
+    nents = (unsigned int) n;
+  }
+
+  c = add_config_param(cmd->argv[0], 2, NULL, NULL);
+  c->argv[0] = pstrdup(c->pool, cmd->argv[1]);
+  c->argv[1] = palloc(c->pool, sizeof(unsigned int));
+  *((unsigned int *) c->argv[1]) = nents;
+
+  return PR_HANDLED(cmd);
+}
+
+/* usage: AuthCacheTimeout secs [negative-secs] */
+MODRET set_authcachetimeout(cmd_rec *cmd) {
+  config_rec *c;
+  int timeout = -1, negative_timeout = 10;
+
+  if (cmd->argc < 2 ||
+      cmd->argc > 3) {
+    CONF_ERROR(cmd, "wrong number of parameters");
+  }
+
+  CHECK_CONF(cmd, CONF_ROOT);
+
+  if (pr_str_get_duration(cmd->argv[1], &timeout) < 0) {
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "error parsing timeout value '",
+      cmd->argv[1], "': ", strerror(errno), NULL));
+  }
+
+  if (cmd->argc == 3) {
+    if (pr_str_get_duration(cmd->argv[2], &negative_timeout) < 0) {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "error parsing timeout value '",
+        cmd->argv[2], "': ", strerror(errno), NULL));
+    }
+  }
+
+  c = add_config_param(cmd->argv[0], 2, NULL, NULL);
+  c->argv[0] = palloc(c->pool, sizeof(int));
+  *((int *) c->argv[0]) = timeout;
+  c->argv[1] = palloc(c->pool, sizeof(int));
+  *((int *) c->argv[1]) = negative_timeout;
+
+  return PR_HANDLED(cmd);
+}
+
 MODRET set_authusingalias(cmd_rec *cmd) {
   int bool = -1;
   config_rec *c = NULL;
@@ -3520,6 +3639,8 @@ static conftable auth_conftab[] = {
   { "AnonRequirePassword",	set_anonrequirepassword,	NULL },
   { "AnonRejectPasswords",	set_anonrejectpasswords,	NULL },
   { "AuthAliasOnly",		set_authaliasonly,		NULL },
+  { "AuthCacheTable",		set_authcachetable,		NULL },
+  { "AuthCacheTimeout",		set_authcachetimeout,		NULL },
   { "AuthUsingAlias",		set_authusingalias,		NULL },
   { "CreateHome",		set_createhome,			NULL },
   { "DefaultChdir",		add_defaultchdir,		NULL },
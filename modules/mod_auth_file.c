@@ -45,6 +45,8 @@
 # define BUFSIZ          PR_TUNABLE_BUFFER_SIZE
 #endif /* !BUFSIZ */
 
+extern xaset_t *server_list;
+
 module auth_file_module;
 
 typedef union {
@@ -89,6 +91,14 @@ static int authfile_sess_init(void);
 static int af_setpwent(void);
 static int af_setgrent(void);
 
+struct af_index;
+static struct af_index *af_index_get_user(void);
+static struct af_index *af_index_get_group(void);
+static struct passwd *af_index_getpwnam(struct af_index *, const char *);
+static struct passwd *af_index_getpwuid(struct af_index *, uid_t);
+static struct group *af_index_getgrnam(struct af_index *, const char *);
+static struct group *af_index_getgrgid(struct af_index *, gid_t);
+
 static const char *trace_channel = "authfile";
 
 /* Support routines.  Move the passwd/group functions out of lib/ into here. */
@@ -494,54 +504,62 @@ static void af_endgrent(void) {
   return;
 }
 
-static struct group *af_getgrent(void) {
-  struct group *grp = NULL, *res = NULL;
-
-  if (!af_group_file ||
-      !af_group_file->af_file) {
-    errno = EINVAL;
-    return NULL;
-  }
+/* Reads the next entry from the given group file, without applying any of
+ * the configured AuthGroupFile restrictions.
+ */
+static struct group *af_readgrent(FILE *fh, unsigned int *lineno) {
+  struct group *grp = NULL;
 
-  while (TRUE) {
 #ifdef HAVE_FGETGRENT
-    pr_signals_handle();
-    grp = fgetgrent(af_group_file->af_file);
+  pr_signals_handle();
+  grp = fgetgrent(fh);
 #else
-    char *cp = NULL, *buf = NULL;
-    int buflen = BUFSIZ;
+  char *cp = NULL, *buf = NULL;
+  int buflen = BUFSIZ;
+
+  pr_signals_handle();
 
+  buf = malloc(BUFSIZ);
+  if (buf == NULL) {
+    pr_log_pri(PR_LOG_ALERT, "Out of memory!");
+    _exit(1);
+  }
+
+  while (af_getgrentline(&buf, &buflen, fh, lineno) != NULL) {
     pr_signals_handle();
 
-    buf = malloc(BUFSIZ);
-    if (buf == NULL) {
-      pr_log_pri(PR_LOG_ALERT, "Out of memory!");
-      _exit(1);
+    /* Ignore comment and empty lines */
+    if (buf[0] == '\0' ||
+        buf[0] == '#') {
+      continue;
     }
-    grp = NULL;
 
-    while (af_getgrentline(&buf, &buflen, af_group_file->af_file,
-        &(af_group_file->af_lineno)) != NULL) {
+    cp = strchr(buf, '\n');
+    if (cp != NULL) {
+      *cp = '\0';
+    }
 
-      pr_signals_handle();
+    grp = af_getgrp(buf, *lineno);
+    free(buf);
 
-      /* Ignore comment and empty lines */
-      if (buf[0] == '\0' ||
-          buf[0] == '#') {
-        continue;
-      }
+    break;
+  }
+#endif /* !HAVE_FGETGRENT */
 
-      cp = strchr(buf, '\n');
-      if (cp != NULL) {
-        *cp = '\0';
-      }
+  return grp;
+}
 
-      grp = af_getgrp(buf, af_group_file->af_lineno);
-      free(buf);
+static struct group *af_getgrent(void) {
+  struct group *grp = NULL, *res = NULL;
 
-      break;
-    }
-#endif /* !HAVE_FGETGRENT */
+  if (!af_group_file ||
+      !af_group_file->af_file) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  while (TRUE) {
+    grp = af_readgrent(af_group_file->af_file, &(af_group_file->af_lineno));
 
     /* If grp is NULL now, the file is empty - nothing more to be read. */
     if (grp == NULL) {
@@ -561,11 +579,17 @@ static struct group *af_getgrent(void) {
 
 static struct group *af_getgrnam(const char *name) {
   struct group *grp = NULL;
+  struct af_index *idx;
 
   if (af_setgrent() < 0) {
     return NULL;
   }
 
+  idx = af_index_get_group();
+  if (idx != NULL) {
+    return af_index_getgrnam(idx, name);
+  }
+
   while ((grp = af_getgrent()) != NULL) {
     if (strcmp(name, grp->gr_name) == 0) {
 
@@ -579,11 +603,17 @@ static struct group *af_getgrnam(const char *name) {
 
 static struct group *af_getgrgid(gid_t gid) {
   struct group *grp = NULL;
+  struct af_index *idx;
 
   if (af_setgrent() < 0) {
     return NULL;
   }
 
+  idx = af_index_get_group();
+  if (idx != NULL) {
+    return af_index_getgrgid(idx, gid);
+  }
+
   while ((grp = af_getgrent()) != NULL) {
     if (grp->gr_gid == gid) {
 
@@ -729,54 +759,61 @@ static void af_endpwent(void) {
   return;
 }
 
-static struct passwd *af_getpwent(void) {
-  struct passwd *pwd = NULL, *res = NULL;
-
-  if (af_user_file == NULL ||
-      af_user_file->af_file == NULL) {
-    errno = EINVAL;
-    return NULL;
-  }
+/* Reads the next entry from the given passwd file, without applying any of
+ * the configured AuthUserFile restrictions.
+ */
+static struct passwd *af_readpwent(FILE *fh, unsigned int *lineno) {
+  struct passwd *pwd = NULL;
 
-  while (TRUE) {
 #ifdef HAVE_FGETPWENT
-    pr_signals_handle();
-    pwd = fgetpwent(af_user_file->af_file);
+  pr_signals_handle();
+  pwd = fgetpwent(fh);
 #else
-    char buf[BUFSIZ+1] = {'\0'};
-
-    pr_signals_handle();
+  char buf[BUFSIZ+1] = {'\0'};
 
-    memset(buf, '\0', sizeof(buf));
-    pwd = NULL;
+  pr_signals_handle();
 
-    while (fgets(buf, sizeof(buf)-1, af_user_file->af_file) != NULL) {
-      pr_signals_handle();
+  memset(buf, '\0', sizeof(buf));
 
-      af_user_file->af_lineno++;
+  while (fgets(buf, sizeof(buf)-1, fh) != NULL) {
+    pr_signals_handle();
 
-      /* Ignore empty and comment lines */
-      if (buf[0] == '\0' ||
-          buf[0] == '#') {
-        memset(buf, '\0', sizeof(buf));
-        continue;
-      }
+    (*lineno)++;
 
-      buf[strlen(buf)-1] = '\0';
-      pwd = af_getpasswd(buf, af_user_file->af_lineno);
-      break;
+    /* Ignore empty and comment lines */
+    if (buf[0] == '\0' ||
+        buf[0] == '#') {
+      memset(buf, '\0', sizeof(buf));
+      continue;
     }
+
+    buf[strlen(buf)-1] = '\0';
+    pwd = af_getpasswd(buf, *lineno);
+    break;
+  }
 #endif /* !HAVE_FGETPWENT */
 
+  return pwd;
+}
+
+static struct passwd *af_getpwent(void) {
+  struct passwd *pwd = NULL, *res = NULL;
+
+  if (af_user_file == NULL ||
+      af_user_file->af_file == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  while (TRUE) {
+    pwd = af_readpwent(af_user_file->af_file, &(af_user_file->af_lineno));
+
     /* If pwd is NULL now, the file is empty - nothing more to be read. */
     if (pwd == NULL) {
       break;
     }
 
     if (af_allow_pwent(pwd) < 0) {
-#ifndef HAVE_FGETPWENT
-      memset(buf, '\0', sizeof(buf));
-#endif
       continue;
     }
 
@@ -789,11 +826,17 @@ static struct passwd *af_getpwent(void) {
 
 static struct passwd *af_getpwnam(const char *name) {
   struct passwd *pwd = NULL;
+  struct af_index *idx;
 
   if (af_setpwent() < 0) {
     return NULL;
   }
 
+  idx = af_index_get_user();
+  if (idx != NULL) {
+    return af_index_getpwnam(idx, name);
+  }
+
   while ((pwd = af_getpwent()) != NULL) {
     pr_signals_handle();
 
@@ -814,11 +857,17 @@ static char *af_getpwpass(const char *name) {
 
 static struct passwd *af_getpwuid(uid_t uid) {
   struct passwd *pwd = NULL;
+  struct af_index *idx;
 
   if (af_setpwent() < 0) {
     return NULL;
   }
 
+  idx = af_index_get_user();
+  if (idx != NULL) {
+    return af_index_getpwuid(idx, uid);
+  }
+
   while ((pwd = af_getpwent()) != NULL) {
     if (pwd->pw_uid == uid) {
 
@@ -886,6 +935,482 @@ static int af_setpwent(void) {
   return -1;
 }
 
+/* AuthUserFile/AuthGroupFile indices.
+ *
+ * Scanning the whole file for every lookup is slow for large files, so each
+ * configured file is parsed into an in-memory index, hashed by name and by
+ * ID (and, for AuthGroupFiles, by member name).  In a standalone server, the
+ * daemon process builds the indices after parsing the configuration, and
+ * periodically checks the files for changes; the session processes thus
+ * inherit a ready-built index, sharing its pages with the daemon.  A session
+ * whose index is stale (or missing) builds its own when needed.
+ */
+
+#define AUTHFILE_INDEX_TYPE_PASSWD	1
+#define AUTHFILE_INDEX_TYPE_GROUP	2
+
+/* How often, in seconds, the daemon checks the indexed files for changes. */
+#define AUTHFILE_INDEX_CHECK_INTERVAL	30
+
+struct af_index_ent {
+  struct af_index_ent *name_next;
+  struct af_index_ent *id_next;
+  unsigned int name_hash;
+
+  struct passwd *pwd;
+  struct group *grp;
+};
+
+struct af_index_member {
+  struct af_index_member *next;
+  unsigned int name_hash;
+  const char *name;
+  struct af_index_ent *ent;
+};
+
+struct af_index {
+  struct af_index *next;
+  pool *pool;
+  const char *path;
+  int type;
+
+  /* The identity of the file when it was indexed. */
+  dev_t dev;
+  ino_t ino;
+  time_t mtime;
+  off_t size;
+
+  unsigned int nents;
+  unsigned int mask;
+  struct af_index_ent **names;
+  struct af_index_ent **ids;
+
+  /* These are AuthGroupFile-specific */
+  unsigned int nmembers;
+  unsigned int member_mask;
+  struct af_index_member **members;
+};
+
+static struct af_index *af_indices = NULL;
+static int af_index_timer_id = -1;
+
+/* The lookup functions return copies of the indexed entries, as the
+ * getpw*(3)/getgr*(3) functions do.
+ */
+static struct passwd af_index_pwent;
+static struct group af_index_grent;
+
+static unsigned int af_index_hash_name(const char *name) {
+  unsigned int h = 2166136261U;
+
+  /* FNV-1a */
+  while (*name) {
+    h ^= (unsigned char) *name++;
+    h *= 16777619U;
+  }
+
+  return h;
+}
+
+static unsigned int af_index_hash_id(unsigned long id) {
+  unsigned int h = (unsigned int) id;
+
+  h ^= (h >> 16);
+  h *= 0x45d9f3bU;
+  h ^= (h >> 16);
+
+  return h;
+}
+
+static unsigned int af_index_size(unsigned int count) {
+  unsigned int size = 64;
+
+  while (size < count) {
+    size <<= 1;
+  }
+
+  return size;
+}
+
+static struct passwd *af_index_dup_pwent(pool *p, struct passwd *pwd) {
+  struct passwd *dup;
+
+  dup = palloc(p, sizeof(struct passwd));
+  memcpy(dup, pwd, sizeof(struct passwd));
+
+  dup->pw_name = pstrdup(p, pwd->pw_name);
+  dup->pw_passwd = pstrdup(p, pwd->pw_passwd);
+  dup->pw_gecos = pstrdup(p, pwd->pw_gecos);
+  dup->pw_dir = pstrdup(p, pwd->pw_dir);
+  dup->pw_shell = pstrdup(p, pwd->pw_shell);
+
+  return dup;
+}
+
+static struct group *af_index_dup_grent(pool *p, struct group *grp,
+    unsigned int *nmembers) {
+  struct group *dup;
+  unsigned int i, count = 0;
+
+  dup = palloc(p, sizeof(struct group));
+  memcpy(dup, grp, sizeof(struct group));
+
+  dup->gr_name = pstrdup(p, grp->gr_name);
+  dup->gr_passwd = pstrdup(p, grp->gr_passwd);
+
+  if (grp->gr_mem != NULL) {
+    while (grp->gr_mem[count] != NULL) {
+      count++;
+    }
+  }
+
+  dup->gr_mem = pcalloc(p, sizeof(char *) * (count + 1));
+  for (i = 0; i < count; i++) {
+    dup->gr_mem[i] = pstrdup(p, grp->gr_mem[i]);
+  }
+
+  *nmembers = count;
+  return dup;
+}
+
+static struct af_index *af_index_build(const char *path, int type,
+    struct stat *st) {
+  struct af_index *idx;
+  struct af_index_ent **ents;
+  array_header *list;
+  FILE *fh;
+  pool *p;
+  unsigned int i, lineno = 0, nbuckets;
+  int xerrno;
+
+  PRIVS_ROOT
+  fh = fopen(path, "r");
+  xerrno = errno;
+  PRIVS_RELINQUISH
+
+  if (fh == NULL) {
+    pr_trace_msg(trace_channel, 3, "unable to open '%s' for indexing: %s",
+      path, strerror(xerrno));
+    errno = xerrno;
+    return NULL;
+  }
+
+  p = make_sub_pool(permanent_pool);
+  pr_pool_tag(p, "AuthFile index pool");
+
+  idx = pcalloc(p, sizeof(struct af_index));
+  idx->pool = p;
+  idx->path = pstrdup(p, path);
+  idx->type = type;
+  idx->dev = st->st_dev;
+  idx->ino = st->st_ino;
+  idx->mtime = st->st_mtime;
+  idx->size = st->st_size;
+
+  list = make_array(p, 1024, sizeof(struct af_index_ent *));
+
+  while (TRUE) {
+    struct af_index_ent *ent;
+
+    if (type == AUTHFILE_INDEX_TYPE_PASSWD) {
+      struct passwd *pwd;
+
+      pwd = af_readpwent(fh, &lineno);
+      if (pwd == NULL) {
+        break;
+      }
+
+      ent = pcalloc(p, sizeof(struct af_index_ent));
+      ent->pwd = af_index_dup_pwent(p, pwd);
+      ent->name_hash = af_index_hash_name(ent->pwd->pw_name);
+
+    } else {
+      struct group *grp;
+      unsigned int nmembers = 0;
+
+      grp = af_readgrent(fh, &lineno);
+      if (grp == NULL) {
+        break;
+      }
+
+      ent = pcalloc(p, sizeof(struct af_index_ent));
+      ent->grp = af_index_dup_grent(p, grp, &nmembers);
+      ent->name_hash = af_index_hash_name(ent->grp->gr_name);
+      idx->nmembers += nmembers;
+    }
+
+    *((struct af_index_ent **) push_array(list)) = ent;
+  }
+
+  fclose(fh);
+
+  idx->nents = list->nelts;
+  ents = list->elts;
+
+  nbuckets = af_index_size(idx->nents);
+  idx->mask = nbuckets - 1;
+  idx->names = pcalloc(p, sizeof(struct af_index_ent *) * nbuckets);
+  idx->ids = pcalloc(p, sizeof(struct af_index_ent *) * nbuckets);
+
+  if (type == AUTHFILE_INDEX_TYPE_GROUP) {
+    nbuckets = af_index_size(idx->nmembers);
+    idx->member_mask = nbuckets - 1;
+    idx->members = pcalloc(p, sizeof(struct af_index_member *) * nbuckets);
+  }
+
+  /* Link the entries in reverse order, so that each hash chain lists its
+   * entries in file order; the first matching entry in the file wins, as it
+   * does when scanning the file.
+   */
+  for (i = idx->nents; i > 0; i--) {
+    struct af_index_ent *ent;
+    unsigned int b;
+    unsigned long id;
+
+    ent = ents[i-1];
+
+    b = ent->name_hash & idx->mask;
+    ent->name_next = idx->names[b];
+    idx->names[b] = ent;
+
+    id = (type == AUTHFILE_INDEX_TYPE_PASSWD ?
+      (unsigned long) ent->pwd->pw_uid : (unsigned long) ent->grp->gr_gid);
+    b = af_index_hash_id(id) & idx->mask;
+    ent->id_next = idx->ids[b];
+    idx->ids[b] = ent;
+
+    if (type == AUTHFILE_INDEX_TYPE_GROUP) {
+      unsigned int j, nmembers = 0;
+
+      while (ent->grp->gr_mem[nmembers] != NULL) {
+        nmembers++;
+      }
+
+      for (j = nmembers; j > 0; j--) {
+        struct af_index_member *mem;
+
+        mem = palloc(p, sizeof(struct af_index_member));
+        mem->name = ent->grp->gr_mem[j-1];
+        mem->name_hash = af_index_hash_name(mem->name);
+        mem->ent = ent;
+
+        b = mem->name_hash & idx->member_mask;
+        mem->next = idx->members[b];
+        idx->members[b] = mem;
+      }
+    }
+  }
+
+  pr_trace_msg(trace_channel, 5, "indexed %u %s from '%s'", idx->nents,
+    type == AUTHFILE_INDEX_TYPE_PASSWD ? "users" : "groups", path);
+  return idx;
+}
+
+/* Returns the index for the given file, (re)building it first if the file
+ * has changed since it was indexed.  If free_stale is TRUE, a replaced index
+ * is destroyed; otherwise it is left alone, as entries returned from it may
+ * still be in use.  Returns NULL if the file cannot be indexed.
+ */
+static struct af_index *af_index_get(const char *path, int type,
+    int free_stale) {
+  struct af_index *idx, *prev = NULL;
+  struct stat st;
+  int res;
+
+  for (idx = af_indices; idx; idx = idx->next) {
+    if (idx->type == type &&
+        strcmp(idx->path, path) == 0) {
+      break;
+    }
+
+    prev = idx;
+  }
+
+  PRIVS_ROOT
+  res = stat(path, &st);
+  PRIVS_RELINQUISH
+
+  if (res < 0) {
+    /* If the file is not reachable, e.g. because the session has since been
+     * chrooted, keep using the index we have, if any.
+     */
+    return idx;
+  }
+
+  if (idx != NULL &&
+      idx->dev == st.st_dev &&
+      idx->ino == st.st_ino &&
+      idx->mtime == st.st_mtime &&
+      idx->size == st.st_size) {
+    return idx;
+  }
+
+  if (idx != NULL) {
+    pr_trace_msg(trace_channel, 7, "'%s' has changed, reindexing", path);
+
+    if (prev != NULL) {
+      prev->next = idx->next;
+
+    } else {
+      af_indices = idx->next;
+    }
+
+    if (free_stale) {
+      destroy_pool(idx->pool);
+    }
+  }
+
+  idx = af_index_build(path, type, &st);
+  if (idx != NULL) {
+    idx->next = af_indices;
+    af_indices = idx;
+  }
+
+  return idx;
+}
+
+static void af_index_free(void) {
+  struct af_index *idx, *next;
+
+  for (idx = af_indices; idx; idx = next) {
+    next = idx->next;
+    destroy_pool(idx->pool);
+  }
+
+  af_indices = NULL;
+}
+
+/* Indexes the AuthUserFiles and AuthGroupFiles of all of the configured
+ * servers, in the daemon process.
+ */
+static void af_index_update(void) {
+  server_rec *s;
+
+  for (s = (server_rec *) server_list->xas_list; s; s = s->next) {
+    config_rec *c;
+
+    c = find_config(s->conf, CONF_PARAM, "AuthUserFile", FALSE);
+    if (c != NULL) {
+      authfile_file_t *file = c->argv[0];
+
+      (void) af_index_get(file->af_path, AUTHFILE_INDEX_TYPE_PASSWD, TRUE);
+    }
+
+    c = find_config(s->conf, CONF_PARAM, "AuthGroupFile", FALSE);
+    if (c != NULL) {
+      authfile_file_t *file = c->argv[0];
+
+      (void) af_index_get(file->af_path, AUTHFILE_INDEX_TYPE_GROUP, TRUE);
+    }
+  }
+}
+
+static struct af_index *af_index_get_user(void) {
+  return af_index_get(af_user_file->af_path, AUTHFILE_INDEX_TYPE_PASSWD,
+    FALSE);
+}
+
+static struct af_index *af_index_get_group(void) {
+  return af_index_get(af_group_file->af_path, AUTHFILE_INDEX_TYPE_GROUP,
+    FALSE);
+}
+
+static struct passwd *af_index_getpwnam(struct af_index *idx,
+    const char *name) {
+  struct af_index_ent *ent;
+  unsigned int h;
+
+  h = af_index_hash_name(name);
+
+  for (ent = idx->names[h & idx->mask]; ent; ent = ent->name_next) {
+    if (ent->name_hash == h &&
+        strcmp(ent->pwd->pw_name, name) == 0 &&
+        af_allow_pwent(ent->pwd) == 0) {
+      memcpy(&af_index_pwent, ent->pwd, sizeof(struct passwd));
+      return &af_index_pwent;
+    }
+  }
+
+  return NULL;
+}
+
+static struct passwd *af_index_getpwuid(struct af_index *idx, uid_t uid) {
+  struct af_index_ent *ent;
+  unsigned int h;
+
+  h = af_index_hash_id((unsigned long) uid);
+
+  for (ent = idx->ids[h & idx->mask]; ent; ent = ent->id_next) {
+    if (ent->pwd->pw_uid == uid &&
+        af_allow_pwent(ent->pwd) == 0) {
+      memcpy(&af_index_pwent, ent->pwd, sizeof(struct passwd));
+      return &af_index_pwent;
+    }
+  }
+
+  return NULL;
+}
+
+static struct group *af_index_getgrnam(struct af_index *idx,
+    const char *name) {
+  struct af_index_ent *ent;
+  unsigned int h;
+
+  h = af_index_hash_name(name);
+
+  for (ent = idx->names[h & idx->mask]; ent; ent = ent->name_next) {
+    if (ent->name_hash == h &&
+        strcmp(ent->grp->gr_name, name) == 0 &&
+        af_allow_grent(ent->grp) == 0) {
+      memcpy(&af_index_grent, ent->grp, sizeof(struct group));
+      return &af_index_grent;
+    }
+  }
+
+  return NULL;
+}
+
+static struct group *af_index_getgrgid(struct af_index *idx, gid_t gid) {
+  struct af_index_ent *ent;
+  unsigned int h;
+
+  h = af_index_hash_id((unsigned long) gid);
+
+  for (ent = idx->ids[h & idx->mask]; ent; ent = ent->id_next) {
+    if (ent->grp->gr_gid == gid &&
+        af_allow_grent(ent->grp) == 0) {
+      memcpy(&af_index_grent, ent->grp, sizeof(struct group));
+      return &af_index_grent;
+    }
+  }
+
+  return NULL;
+}
+
+/* Adds the groups which list the given user as a member, in file order. */
+static void af_index_getgroups(struct af_index *idx, const char *name,
+    array_header *gids, array_header *groups) {
+  struct af_index_member *mem;
+  unsigned int h;
+
+  h = af_index_hash_name(name);
+
+  for (mem = idx->members[h & idx->member_mask]; mem; mem = mem->next) {
+    if (mem->name_hash != h ||
+        strcmp(mem->name, name) != 0 ||
+        af_allow_grent(mem->ent->grp) < 0) {
+      continue;
+    }
+
+    if (gids)
+      *((gid_t *) push_array(gids)) = mem->ent->grp->gr_gid;
+
+    if (groups)
+      *((char **) push_array(groups)) = pstrdup(session.pool,
+        mem->ent->grp->gr_name);
+  }
+}
+
 /* Authentication handlers.
  */
 
@@ -910,14 +1435,7 @@ MODRET authfile_getpwnam(cmd_rec *cmd) {
     return PR_DECLINED(cmd);
   }
 
-  /* Ugly -- we iterate through the file.  Time-consuming. */
-  while ((pwd = af_getpwent()) != NULL) {
-    if (strcmp(name, pwd->pw_name) == 0) {
-
-      /* Found the requested name */
-      break;
-    }
-  }
+  pwd = af_getpwnam(name);
 
   return pwd ? mod_create_data(cmd, pwd) : PR_DECLINED(cmd);
 }
@@ -1001,13 +1519,7 @@ MODRET authfile_getgrnam(cmd_rec *cmd) {
     return PR_DECLINED(cmd);
   }
 
-  while ((grp = af_getgrent()) != NULL) {
-    if (strcmp(name, grp->gr_name) == 0) {
-
-      /* Found the name requested */
-      break;
-    }
-  }
+  grp = af_getgrnam(name);
 
   return grp ? mod_create_data(cmd, grp) : PR_DECLINED(cmd);
 }
@@ -1015,6 +1527,7 @@ MODRET authfile_getgrnam(cmd_rec *cmd) {
 MODRET authfile_getgroups(cmd_rec *cmd) {
   struct passwd *pwd = NULL;
   struct group *grp = NULL;
+  struct af_index *idx;
   array_header *gids = NULL, *groups = NULL;
   char *name = cmd->argv[0];
 
@@ -1053,29 +1566,36 @@ MODRET authfile_getgroups(cmd_rec *cmd) {
     *((char **) push_array(groups)) = pstrdup(session.pool, grp->gr_name);
   }
 
-  af_setgrent();
+  idx = af_index_get_group();
+  if (idx != NULL) {
+    af_index_getgroups(idx, pwd->pw_name, gids, groups);
 
-  /* This is where things get slow, expensive, and ugly.  Loop through
-   * everything, checking to make sure we haven't already added it.
-   */
-  while ((grp = af_getgrent()) != NULL &&
-      grp->gr_mem) {
-    char **gr_mems = NULL;
+  } else {
+    af_setgrent();
 
-    pr_signals_handle();
+    /* This is where things get slow, expensive, and ugly.  Loop through
+     * everything, checking to make sure we haven't already added it.
+     */
+    while ((grp = af_getgrent()) != NULL &&
+        grp->gr_mem) {
+      char **gr_mems = NULL;
 
-    /* Loop through each member name listed */
-    for (gr_mems = grp->gr_mem; *gr_mems; gr_mems++) {
+      pr_signals_handle();
+
+      /* Loop through each member name listed */
+      for (gr_mems = grp->gr_mem; *gr_mems; gr_mems++) {
 
-      /* If it matches the given username... */
-      if (strcmp(*gr_mems, pwd->pw_name) == 0) {
+        /* If it matches the given username... */
+        if (strcmp(*gr_mems, pwd->pw_name) == 0) {
 
-        /* ...add the GID and name */
-        if (gids)
-          *((gid_t *) push_array(gids)) = grp->gr_gid;
+          /* ...add the GID and name */
+          if (gids)
+            *((gid_t *) push_array(gids)) = grp->gr_gid;
 
-        if (groups)
-          *((char **) push_array(groups)) = pstrdup(session.pool, grp->gr_name);
+          if (groups)
+            *((char **) push_array(groups)) = pstrdup(session.pool,
+              grp->gr_name);
+        }
       }
     }
   }
@@ -1502,6 +2022,41 @@ MODRET set_authuserfile(cmd_rec *cmd) {
   return PR_HANDLED(cmd);
 }
 
+/* Event handlers
+ */
+
+static int authfile_index_timer_cb(CALLBACK_FRAME) {
+  af_index_update();
+
+  /* Always return 1, so that the timer gets called again. */
+  return 1;
+}
+
+static void authfile_postparse_ev(const void *event_data, void *user_data) {
+
+  /* For inetd-run servers, there is no daemon process to share the indices
+   * with; each session indexes the files when first needed.
+   */
+  if (ServerType != SERVER_STANDALONE) {
+    return;
+  }
+
+  af_index_update();
+
+  if (af_index_timer_id != -1) {
+    pr_timer_remove(af_index_timer_id, &auth_file_module);
+  }
+
+  af_index_timer_id = pr_timer_add(AUTHFILE_INDEX_CHECK_INTERVAL, -1,
+    &auth_file_module, authfile_index_timer_cb, "AuthFile index checking");
+}
+
+static void authfile_restart_ev(const void *event_data, void *user_data) {
+
+  /* The indices are rebuilt from the new configuration, once parsed. */
+  af_index_free();
+}
+
 /* Initialization routines
  */
 
@@ -1532,12 +2087,23 @@ static int authfile_init(void) {
     }
   }
 
+  pr_event_register(&auth_file_module, "core.postparse",
+    authfile_postparse_ev, NULL);
+  pr_event_register(&auth_file_module, "core.restart", authfile_restart_ev,
+    NULL);
+
   return 0;
 }
 
 static int authfile_sess_init(void) {
   config_rec *c = NULL;
 
+  /* The index checking timer only runs in the daemon process. */
+  if (af_index_timer_id != -1) {
+    pr_timer_remove(af_index_timer_id, &auth_file_module);
+    af_index_timer_id = -1;
+  }
+
   c = find_config(main_server->conf, CONF_PARAM, "AuthUserFile", FALSE);
   if (c) {
     af_user_file = c->argv[0];
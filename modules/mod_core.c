@@ -555,13 +555,32 @@ MODRET set_setenv(cmd_rec *cmd) {
   return PR_HANDLED(cmd);
 }
 
+/* usage: TransferLog path|"none" ["binary"] */
 MODRET add_transferlog(cmd_rec *cmd) {
   config_rec *c = NULL;
+  int format = PR_XFERLOG_FMT_TEXT;
+
+  if (cmd->argc < 2 ||
+      cmd->argc > 3) {
+    CONF_ERROR(cmd, "wrong number of parameters");
+  }
 
-  CHECK_ARGS(cmd, 1);
   CHECK_CONF(cmd, CONF_ROOT|CONF_VIRTUAL|CONF_GLOBAL|CONF_ANON);
 
-  c = add_config_param_str(cmd->argv[0], 1, cmd->argv[1]);
+  if (cmd->argc == 3) {
+    if (strcasecmp(cmd->argv[2], "binary") == 0) {
+      format = PR_XFERLOG_FMT_BINARY;
+
+    } else if (strcasecmp(cmd->argv[2], "text") != 0) {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "unknown TransferLog format: ",
+        cmd->argv[2], NULL));
+    }
+  }
+
+  c = add_config_param(cmd->argv[0], 2, NULL, NULL);
+  c->argv[0] = pstrdup(c->pool, cmd->argv[1]);
+  c->argv[1] = palloc(c->pool, sizeof(int));
+  *((int *) c->argv[1]) = format;
   c->flags |= CF_MERGEDOWN;
 
   return PR_HANDLED(cmd);
@@ -3384,6 +3403,9 @@ MODRET core_pasv(cmd_rec *cmd) {
     session.d = NULL;
   }
 
+  /* Likewise any data connection kept open from block mode transfers. */
+  pr_data_close_persistent();
+
   if (pr_netaddr_get_family(session.c->local_addr) == pr_netaddr_get_family(session.c->remote_addr)) {
 
 #ifdef PR_USE_IPV6
@@ -3728,6 +3750,9 @@ MODRET core_port(cmd_rec *cmd) {
     session.d = NULL;
   }
 
+  /* Likewise any data connection kept open from block mode transfers. */
+  pr_data_close_persistent();
+
   session.sf_flags |= SF_PORT;
   pr_response_add(R_200, _("PORT command successful"));
 
@@ -4021,6 +4046,9 @@ MODRET core_eprt(cmd_rec *cmd) {
     session.d = NULL;
   }
 
+  /* Likewise any data connection kept open from block mode transfers. */
+  pr_data_close_persistent();
+
   session.sf_flags |= SF_PORT;
   pr_response_add(R_200, _("EPRT command successful"));
 
@@ -4128,6 +4156,9 @@ MODRET core_epsv(cmd_rec *cmd) {
     session.d = NULL;
   }
 
+  /* Likewise any data connection kept open from block mode transfers. */
+  pr_data_close_persistent();
+
   if (pr_netaddr_get_family(session.c->local_addr) == pr_netaddr_get_family(session.c->remote_addr)) {
     bind_addr = session.c->local_addr;
 
@@ -30,6 +30,10 @@
 #include "privs.h"
 #include "mod_log.h"
 
+#if defined(PR_USE_CTRLS)
+# include <mod_ctrls.h>
+#endif /* PR_USE_CTRLS */
+
 module log_module;
 
 /* Max path length plus 128 bytes for additional info. */
@@ -38,14 +42,49 @@ module log_module;
 #define EXTENDED_LOG_MODE			0644
 #define EXTENDED_LOG_FORMAT_DEFAULT		"default"
 
+/* Default ExtendedLogBuffer flush interval, in seconds. */
+#define EXTENDED_LOG_BUFFER_INTERVAL		1
+
 typedef struct logformat_struc	logformat_t;
 typedef struct logfile_struc 	logfile_t;
+typedef struct logformat_step_struc	logformat_step_t;
+
+/* LogFormats are compiled, once, into a list of steps for rendering a
+ * record: runs of literal text, timestamps (which are cached for the second
+ * in which they were rendered), and the remaining variables, which are
+ * expanded by get_next_meta().
+ */
+#define LOGFMT_STEP_TEXT		1
+#define LOGFMT_STEP_TIME		2
+#define LOGFMT_STEP_ISO8601		3
+#define LOGFMT_STEP_META		4
+
+struct logformat_step_struc {
+  int			type;
+
+  /* For TEXT steps, the literal text; for TIME steps, the strftime(3)
+   * format (NULL for the default format).
+   */
+  const char		*text;
+  size_t		textlen;
+
+  /* For META steps, the start of the variable in the format. */
+  unsigned char		*meta;
+
+  /* For TIME and ISO8601 steps, the last rendered timestamp. */
+  time_t		cached_time;
+  char			cached_str[128];
+  size_t		cached_len;
+};
 
 struct logformat_struc {
   logformat_t		*next,*prev;
 
   char			*lf_nickname;
   unsigned char		*lf_format;
+
+  logformat_step_t	*lf_steps;
+  unsigned int		lf_nsteps;
 };
 
 struct logfile_struc {
@@ -59,6 +98,10 @@ struct logfile_struc {
 
   int			lf_classes;
 
+  /* Records waiting to be written, when ExtendedLogBuffer is used. */
+  char			*lf_buf;
+  size_t		lf_buflen;
+
   /* Pointer to the "owning" configuration */
   config_rec		*lf_conf;
 };
@@ -77,6 +120,20 @@ static xaset_t *format_set = NULL;
 static logfile_t *logs = NULL;
 static xaset_t *log_set = NULL;
 
+/* ExtendedLogBuffer settings; a buffer size of zero means that records are
+ * written as they are logged.
+ */
+static size_t extlog_bufsz = 0;
+static int extlog_buf_interval = EXTENDED_LOG_BUFFER_INTERVAL;
+
+/* LogShipper overflow policy; zero if there is no LogShipper. */
+static int log_shipper_overflow = 0;
+static int log_shipper_daemon_started = FALSE;
+
+#if defined(PR_USE_CTRLS)
+static ctrls_acttab_t log_shipper_acttab[];
+#endif /* PR_USE_CTRLS */
+
 /* format string args:
    %A			- Anonymous username (password given)
    %a			- Remote client IP address
@@ -167,6 +224,103 @@ static char *preparse_arg(char **s) {
   return ret;
 }
 
+static void compile_logformat(pool *p, logformat_t *lf) {
+  unsigned char *f;
+  unsigned int nsteps = 0;
+  logformat_step_t *steps;
+
+  /* Count the steps first; each variable is one step, as is each run of
+   * literal text between them.
+   */
+  for (f = lf->lf_format; *f; ) {
+    if (*f == LOGFMT_META_START) {
+      nsteps++;
+      f += 2;
+
+      if (*f == LOGFMT_META_START &&
+          *(f+1) == LOGFMT_META_ARG) {
+        while (*f && *f != LOGFMT_META_ARG_END) {
+          f++;
+        }
+
+        if (*f) {
+          f++;
+        }
+      }
+
+    } else {
+      nsteps++;
+      while (*f && *f != LOGFMT_META_START) {
+        f++;
+      }
+    }
+  }
+
+  steps = pcalloc(p, (nsteps ? nsteps : 1) * sizeof(logformat_step_t));
+  nsteps = 0;
+
+  for (f = lf->lf_format; *f; ) {
+    logformat_step_t *step = &(steps[nsteps++]);
+
+    if (*f == LOGFMT_META_START) {
+      unsigned char meta, *arg = NULL;
+      size_t arglen = 0;
+
+      step->meta = f;
+      meta = *(f+1);
+      f += 2;
+
+      /* The variable's argument, if any (e.g. "%{format}t"), is a separate
+       * LOGFMT_META_ARG variable which immediately follows it.
+       */
+      if (*f == LOGFMT_META_START &&
+          *(f+1) == LOGFMT_META_ARG) {
+        f += 2;
+        arg = f;
+
+        while (*f && *f != LOGFMT_META_ARG_END) {
+          f++;
+        }
+
+        arglen = f - arg;
+        if (*f) {
+          f++;
+        }
+      }
+
+      switch (meta) {
+        case LOGFMT_META_TIME:
+          step->type = LOGFMT_STEP_TIME;
+          if (arg != NULL) {
+            step->text = pstrndup(p, (char *) arg, arglen);
+          }
+          break;
+
+        case LOGFMT_META_ISO8601:
+          step->type = LOGFMT_STEP_ISO8601;
+          break;
+
+        default:
+          step->type = LOGFMT_STEP_META;
+          break;
+      }
+
+    } else {
+      step->type = LOGFMT_STEP_TEXT;
+      step->text = (const char *) f;
+
+      while (*f && *f != LOGFMT_META_START) {
+        f++;
+      }
+
+      step->textlen = (f - (unsigned char *) step->text);
+    }
+  }
+
+  lf->lf_steps = steps;
+  lf->lf_nsteps = nsteps;
+}
+
 static void logformat(const char *directive, char *nickname, char *fmts) {
   char *tmp, *arg;
   unsigned char format[4096] = {'\0'}, *outs;
@@ -431,6 +585,7 @@ static void logformat(const char *directive, char *nickname, char *fmts) {
   lf->lf_nickname = pstrdup(log_pool, nickname);
   lf->lf_format = palloc(log_pool, outs - format);
   memcpy(lf->lf_format, format, outs - format);
+  compile_logformat(log_pool, lf);
 
   if (format_set == NULL) {
     format_set = xaset_create(log_pool, NULL);
@@ -583,6 +738,119 @@ MODRET set_extendedlog(cmd_rec *cmd) {
   return PR_HANDLED(cmd);
 }
 
+/* Syntax: ExtendedLogBuffer size [interval] */
+MODRET set_extendedlogbuffer(cmd_rec *cmd) {
+  config_rec *c;
+  off_t nbytes;
+  int interval = EXTENDED_LOG_BUFFER_INTERVAL;
+
+  if (cmd->argc < 2 ||
+      cmd->argc > 3) {
+    CONF_ERROR(cmd, "wrong number of parameters");
+  }
+
+  CHECK_CONF(cmd, CONF_ROOT|CONF_VIRTUAL|CONF_GLOBAL);
+
+  if (pr_str_get_nbytes(cmd->argv[1], NULL, &nbytes) < 0) {
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "invalid buffer size '",
+      cmd->argv[1], "': ", strerror(errno), NULL));
+  }
+
+  if (cmd->argc == 3) {
+    if (pr_str_get_duration(cmd->argv[2], &interval) < 0 ||
+        interval < 1) {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "invalid interval '",
+        cmd->argv[2], "'", NULL));
+    }
+  }
+
+  c = add_config_param(cmd->argv[0], 2, NULL, NULL);
+  c->argv[0] = palloc(c->pool, sizeof(size_t));
+  *((size_t *) c->argv[0]) = (size_t) nbytes;
+  c->argv[1] = palloc(c->pool, sizeof(int));
+  *((int *) c->argv[1]) = interval;
+
+  return PR_HANDLED(cmd);
+}
+
+/* Syntax: LogShipper size ["write"|"drop"] */
+MODRET set_logshipper(cmd_rec *cmd) {
+  config_rec *c;
+  off_t nbytes;
+  int overflow = PR_LOGSHIP_OVERFLOW_WRITE;
+
+  if (cmd->argc < 2 ||
+      cmd->argc > 3) {
+    CONF_ERROR(cmd, "wrong number of parameters");
+  }
+
+  CHECK_CONF(cmd, CONF_ROOT);
+
+#if defined(PR_USE_LOGSHIP)
+  if (pr_str_get_nbytes(cmd->argv[1], NULL, &nbytes) < 0 ||
+      nbytes == 0) {
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "invalid ring buffer size '",
+      cmd->argv[1], "'", NULL));
+  }
+
+  if (cmd->argc == 3) {
+    if (strcasecmp(cmd->argv[2], "write") == 0) {
+      overflow = PR_LOGSHIP_OVERFLOW_WRITE;
+
+    } else if (strcasecmp(cmd->argv[2], "drop") == 0) {
+      overflow = PR_LOGSHIP_OVERFLOW_DROP;
+
+    } else {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "unknown overflow policy '",
+        cmd->argv[2], "'", NULL));
+    }
+  }
+
+  c = add_config_param(cmd->argv[0], 2, NULL, NULL);
+  c->argv[0] = palloc(c->pool, sizeof(size_t));
+  *((size_t *) c->argv[0]) = (size_t) nbytes;
+  c->argv[1] = palloc(c->pool, sizeof(int));
+  *((int *) c->argv[1]) = overflow;
+
+  return PR_HANDLED(cmd);
+#else
+  CONF_ERROR(cmd, "not supported on this platform");
+#endif /* PR_USE_LOGSHIP */
+}
+
+/* Syntax: LogShipperControlsACLs actions|all allow|deny user|group list */
+MODRET set_logshipperctrlsacls(cmd_rec *cmd) {
+#if defined(PR_USE_CTRLS)
+  char *bad_action = NULL, **actions = NULL;
+
+  CHECK_ARGS(cmd, 4);
+  CHECK_CONF(cmd, CONF_ROOT);
+
+  actions = ctrls_parse_acl(cmd->tmp_pool, cmd->argv[1]);
+
+  if (strcmp(cmd->argv[2], "allow") != 0 &&
+      strcmp(cmd->argv[2], "deny") != 0) {
+    CONF_ERROR(cmd, "second parameter must be 'allow' or 'deny'");
+  }
+
+  if (strcmp(cmd->argv[3], "user") != 0 &&
+      strcmp(cmd->argv[3], "group") != 0) {
+    CONF_ERROR(cmd, "third parameter must be 'user' or 'group'");
+  }
+
+  bad_action = pr_ctrls_set_module_acls(log_shipper_acttab, log_pool,
+    actions, cmd->argv[2], cmd->argv[3], cmd->argv[4]);
+  if (bad_action != NULL) {
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, ": unknown logship action: '",
+      bad_action, "'", NULL));
+  }
+
+  return PR_HANDLED(cmd);
+#else
+  CONF_ERROR(cmd, "requires Controls support (--enable-ctrls)")
+#endif /* PR_USE_CTRLS */
+}
+
 /* Syntax: AllowLogSymlinks <on|off> */
 MODRET set_allowlogsymlinks(cmd_rec *cmd) {
   int bool = -1;
@@ -621,8 +889,7 @@ MODRET set_systemlog(cmd_rec *cmd) {
   return PR_HANDLED(cmd);
 }
 
-static struct tm *_get_gmtoff(int *tz) {
-  time_t tt = time(NULL);
+static struct tm *_get_gmtoff(time_t tt, int *tz) {
   struct tm gmt;
   struct tm *t;
   int days, hours, minutes;
@@ -1205,65 +1472,6 @@ static char *get_next_meta(pool *p, cmd_rec *cmd, unsigned char **f) {
       break;
     }
 
-    case LOGFMT_META_TIME:
-      {
-        char *time_fmt = "[%d/%b/%Y:%H:%M:%S ";
-        struct tm t;
-        int internal_fmt = 1;
-        int timz;
-        char sign;
-
-        argp = arg;
-        m++;
-
-        if (*m == LOGFMT_META_START &&
-            *(m+1) == LOGFMT_META_ARG) {
-          time_fmt = get_next_meta(p, cmd, &m);
-          internal_fmt = 0;
-        }
-
-        t = *_get_gmtoff(&timz);
-        sign = (timz < 0 ? '-' : '+');
-        if (timz < 0)
-          timz = -timz;
-
-        if (time_fmt) {
-          strftime(argp, 80, time_fmt, &t);
-          if (internal_fmt) {
-            if (strlen(argp) < sizeof(arg)) {
-              snprintf(argp + strlen(argp), sizeof(arg) - strlen(argp),
-                "%c%.2d%.2d]", sign, timz/60, timz%60);
-
-            } else {
-              pr_log_pri(PR_LOG_NOTICE,
-                "notice: %%t expansion yields excessive string, ignoring");
-            }
-          }
-        }
-      }
-      break;
-
-    case LOGFMT_META_ISO8601: {
-      struct tm *tm;
-      struct timeval now;
-      unsigned long millis;
-      size_t len;
-
-      argp = arg;
-
-      gettimeofday(&now, NULL);
-      tm = pr_localtime(NULL, (const time_t *) &(now.tv_sec));
-
-      len = strftime(argp, sizeof(arg), "%Y-%m-%d %H:%M:%S", tm);
-
-      /* Convert microsecs to millisecs. */
-      millis = now.tv_usec / 1000;
-
-      snprintf(argp + len, sizeof(arg), ",%03lu", millis);
-      m++;
-      break;
-    }
-
     case LOGFMT_META_SECONDS:
       argp = arg;
       if (session.xfer.p) {
@@ -1643,41 +1851,189 @@ static char *get_next_meta(pool *p, cmd_rec *cmd, unsigned char **f) {
   return NULL;
 }
 
+/* Renders a %t timestamp.  The same text is used for every record logged
+ * within the same second.
+ */
+static const char *get_time_step(logformat_step_t *step, size_t *len) {
+  time_t now;
+
+  now = time(NULL);
+  if (step->cached_len == 0 ||
+      step->cached_time != now) {
+    const char *time_fmt = "[%d/%b/%Y:%H:%M:%S ";
+    struct tm t;
+    int timz;
+    char sign;
+    size_t tslen;
+
+    if (step->text != NULL) {
+      time_fmt = step->text;
+    }
+
+    t = *_get_gmtoff(now, &timz);
+    sign = (timz < 0 ? '-' : '+');
+    if (timz < 0)
+      timz = -timz;
+
+    tslen = strftime(step->cached_str, 80, time_fmt, &t);
+    if (step->text == NULL) {
+      tslen += snprintf(step->cached_str + tslen,
+        sizeof(step->cached_str) - tslen, "%c%.2d%.2d]", sign, timz/60,
+        timz%60);
+    }
+
+    step->cached_time = now;
+    step->cached_len = tslen;
+  }
+
+  *len = step->cached_len;
+  return step->cached_str;
+}
+
+/* Renders a %{iso8601} timestamp; only the milliseconds are rendered anew
+ * for every record logged within the same second.
+ */
+static const char *get_iso8601_step(logformat_step_t *step, size_t *len) {
+  struct timeval now;
+  unsigned int millis;
+
+  gettimeofday(&now, NULL);
+  if (step->cached_len == 0 ||
+      step->cached_time != now.tv_sec) {
+    struct tm *tm;
+    time_t now_secs;
+
+    now_secs = now.tv_sec;
+    tm = pr_localtime(NULL, &now_secs);
+
+    /* Leave room for the trailing ",SSS". */
+    step->cached_len = strftime(step->cached_str,
+      sizeof(step->cached_str) - 5, "%Y-%m-%d %H:%M:%S", tm);
+    step->cached_time = now.tv_sec;
+  }
+
+  /* Convert microsecs to millisecs. */
+  millis = (now.tv_usec / 1000) % 1000;
+  snprintf(step->cached_str + step->cached_len, 5, ",%03u", millis);
+
+  *len = step->cached_len + 4;
+  return step->cached_str;
+}
+
+/* Writes out any records buffered for the given ExtendedLog. */
+static int extlog_flush(logfile_t *lf) {
+  char *ptr;
+  size_t len;
+
+  if (lf->lf_buf == NULL ||
+      lf->lf_buflen == 0) {
+    return 0;
+  }
+
+  ptr = lf->lf_buf;
+  len = lf->lf_buflen;
+  lf->lf_buflen = 0;
+
+  /* The buffered records belong to the session process; a process forked
+   * from it (e.g. by mod_exec) must not write them out a second time.
+   */
+  if (getpid() != session.pid) {
+    return 0;
+  }
+
+  while (len > 0) {
+    ssize_t res;
+
+    res = pr_logship_write(lf->lf_fd, ptr, len);
+    if (res < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      pr_log_pri(PR_LOG_ALERT, "error: cannot write ExtendedLog to fd %d: %s",
+        lf->lf_fd, strerror(errno));
+      return -1;
+    }
+
+    ptr += res;
+    len -= res;
+  }
+
+  return 0;
+}
+
+static void extlog_flush_all(void) {
+  logfile_t *lf;
+
+  for (lf = logs; lf; lf = lf->next) {
+    if (lf->lf_fd >= 0) {
+      (void) extlog_flush(lf);
+    }
+  }
+}
+
+static int extlog_flush_cb(CALLBACK_FRAME) {
+  extlog_flush_all();
+
+  /* Always restart the timer. */
+  return 1;
+}
+
 /* from src/log.c */
 extern int syslog_sockfd;
 
 static void do_log(cmd_rec *cmd, logfile_t *lf) {
-  unsigned char *f = NULL;
+  register unsigned int i;
   size_t size = EXTENDED_LOG_BUFFER_SIZE-2;
   char logbuf[EXTENDED_LOG_BUFFER_SIZE] = {'\0'};
   logformat_t *fmt = NULL;
-  char *s, *bp;
+  char *bp;
   size_t logbuflen;
 
   fmt = lf->lf_format;
-  f = fmt->lf_format;
   bp = logbuf;
 
-  while (*f && size) {
+  for (i = 0; i < fmt->lf_nsteps && size; i++) {
+    logformat_step_t *step;
+    const char *s = NULL;
+    size_t len = 0;
+
     pr_signals_handle();
 
-    if (*f == LOGFMT_META_START) {
-      s = get_next_meta(cmd->tmp_pool, cmd, &f);
-      if (s) {
-        size_t tmp;
+    step = &(fmt->lf_steps[i]);
+    switch (step->type) {
+      case LOGFMT_STEP_TEXT:
+        s = step->text;
+        len = step->textlen;
+        break;
+
+      case LOGFMT_STEP_TIME:
+        s = get_time_step(step, &len);
+        break;
+
+      case LOGFMT_STEP_ISO8601:
+        s = get_iso8601_step(step, &len);
+        break;
 
-        tmp = strlen(s);
-        if (tmp > size)
-          tmp = size;
+      case LOGFMT_STEP_META: {
+        unsigned char *f;
 
-        memcpy(bp, s, tmp);
-        size -= tmp;
-        bp += tmp;
+        f = step->meta;
+        s = get_next_meta(cmd->tmp_pool, cmd, &f);
+        if (s) {
+          len = strlen(s);
+        }
+        break;
       }
+    }
 
-    } else {
-      *bp++ = (char) *f++;
-      size--;
+    if (s) {
+      if (len > size)
+        len = size;
+
+      memcpy(bp, s, len);
+      size -= len;
+      bp += len;
     }
   }
 
@@ -1689,7 +2045,19 @@ static void do_log(cmd_rec *cmd, logfile_t *lf) {
   if (lf->lf_fd != EXTENDED_LOG_SYSLOG) {
     pr_log_event_generate(PR_LOG_TYPE_EXTLOG, lf->lf_fd, -1, logbuf, logbuflen);
 
-    if (write(lf->lf_fd, logbuf, logbuflen) < 0) {
+    if (lf->lf_buf != NULL) {
+      if (lf->lf_buflen + logbuflen > extlog_bufsz) {
+        (void) extlog_flush(lf);
+      }
+
+      if (logbuflen <= extlog_bufsz) {
+        memcpy(lf->lf_buf + lf->lf_buflen, logbuf, logbuflen);
+        lf->lf_buflen += logbuflen;
+        return;
+      }
+    }
+
+    if (pr_logship_write(lf->lf_fd, logbuf, logbuflen) < 0) {
       pr_log_pri(PR_LOG_ALERT, "error: cannot write ExtendedLog to fd %d: %s",
         lf->lf_fd, strerror(errno));
     }
@@ -1732,6 +2100,180 @@ MODRET log_any(cmd_rec *cmd) {
   return PR_DECLINED(cmd);
 }
 
+/* Log shipper
+ */
+
+extern xaset_t *server_list;
+
+/* Returns TRUE if the configuration directive names a log file, e.g.
+ * ExtendedLog, TransferLog, SQLLogFile et al.
+ */
+static int log_shipper_is_log(const char *name) {
+  size_t len;
+
+  len = strlen(name);
+  if (len > 3 &&
+      strcmp(name + len - 3, "Log") == 0) {
+    return TRUE;
+  }
+
+  if (len > 7 &&
+      strcmp(name + len - 7, "LogFile") == 0) {
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
+static void log_shipper_add_logs(xaset_t *set) {
+  config_rec *c;
+
+  if (set == NULL) {
+    return;
+  }
+
+  for (c = (config_rec *) set->xas_list; c; c = c->next) {
+    if (c->config_type == CONF_PARAM &&
+        c->name != NULL &&
+        c->argc > 0 &&
+        c->argv[0] != NULL &&
+        log_shipper_is_log(c->name)) {
+      const char *path;
+
+      path = c->argv[0];
+      if (*path == '/' &&
+          pr_logship_add(path) < 0 &&
+          errno == ENOSPC) {
+        pr_log_debug(DEBUG3, "mod_log: too many logs for LogShipper, "
+          "not shipping %s '%s'", c->name, path);
+      }
+    }
+
+    if (c->subset != NULL) {
+      log_shipper_add_logs(c->subset);
+    }
+  }
+}
+
+/* Creates the log shipper's ring buffers, for all of the configured log
+ * files, before any of them are opened.
+ */
+static void log_shipper_postparse(void) {
+  config_rec *c;
+  server_rec *s;
+  size_t ringsz;
+
+  log_shipper_overflow = 0;
+
+  c = find_config(main_server->conf, CONF_PARAM, "LogShipper", FALSE);
+  if (c == NULL) {
+    return;
+  }
+
+  if (ServerType != SERVER_STANDALONE) {
+    pr_log_debug(DEBUG0,
+      "mod_log: LogShipper not supported for ServerType inetd, ignoring");
+    return;
+  }
+
+  ringsz = *((size_t *) c->argv[0]);
+
+  if (pr_logship_create(ringsz) < 0) {
+    if (errno == EEXIST) {
+      pr_log_pri(PR_LOG_NOTICE, "notice: LogShipper size cannot be changed "
+        "by a restart, using the previous size");
+
+    } else {
+      pr_log_pri(PR_LOG_NOTICE, "notice: unable to create LogShipper: %s",
+        strerror(errno));
+      return;
+    }
+  }
+
+  for (s = (server_rec *) server_list->xas_list; s; s = s->next) {
+    log_shipper_add_logs(s->conf);
+  }
+
+  /* The TransferLog used when none is configured. */
+  (void) pr_logship_add(PR_XFERLOG_PATH);
+
+  log_shipper_overflow = *((int *) c->argv[1]);
+}
+
+static void log_shipper_start(void) {
+  if (log_shipper_overflow == 0 ||
+      log_shipper_daemon_started == FALSE) {
+    return;
+  }
+
+  if (pr_logship_start(log_shipper_overflow) < 0) {
+    pr_log_pri(PR_LOG_NOTICE, "notice: unable to start LogShipper: %s",
+      strerror(errno));
+    return;
+  }
+
+  pr_log_debug(DEBUG2, "mod_log: started LogShipper process %lu",
+    (unsigned long) pr_logship_get_pid());
+}
+
+#if defined(PR_USE_CTRLS)
+static int log_shipper_handle_info(pr_ctrls_t *ctrl, int reqargc,
+    char **reqargv) {
+  register unsigned int i;
+  struct pr_logship_stats stats;
+  const char *path;
+  pid_t pid;
+
+  pid = pr_logship_get_pid();
+  if (pid == 0) {
+    pr_ctrls_add_response(ctrl, "LogShipper not running");
+    return 0;
+  }
+
+  pr_ctrls_add_response(ctrl, "LogShipper process %lu", (unsigned long) pid);
+
+  for (i = 0; (path = pr_logship_get_stats(i, &stats)) != NULL; i++) {
+    pr_ctrls_add_response(ctrl, "%s: backlog %lu bytes (max %lu), "
+      "%lu records, %lu bytes, %lu writes, %lu full, %lu dropped, %lu errors",
+      path, stats.backlog, stats.max_backlog, stats.nrecords, stats.nbytes,
+      stats.nwrites, stats.nfull, stats.ndropped, stats.nerrors);
+  }
+
+  return 0;
+}
+
+static int log_shipper_handle_logship(pr_ctrls_t *ctrl, int reqargc,
+    char **reqargv) {
+
+  if (reqargc == 0 ||
+      reqargv == NULL) {
+    pr_ctrls_add_response(ctrl, "logship: missing required parameters");
+    return -1;
+  }
+
+  if (strcmp(reqargv[0], "info") == 0) {
+    if (!pr_ctrls_check_acl(ctrl, log_shipper_acttab, "info")) {
+      pr_ctrls_add_response(ctrl, "access denied");
+      return -1;
+    }
+
+    return log_shipper_handle_info(ctrl, --reqargc, ++reqargv);
+  }
+
+  pr_ctrls_add_response(ctrl, "unknown logship action: '%s'", reqargv[0]);
+  return -1;
+}
+
+static void log_shipper_init_acls(void) {
+  register unsigned int i;
+
+  for (i = 0; log_shipper_acttab[i].act_action; i++) {
+    log_shipper_acttab[i].act_acl = pcalloc(log_pool, sizeof(ctrls_acl_t));
+    pr_ctrls_init_acl(log_shipper_acttab[i].act_acl);
+  }
+}
+#endif /* PR_USE_CTRLS */
+
 /* Event handlers
  */
 
@@ -1742,11 +2284,14 @@ static void log_exit_ev(const void *event_data, void *user_data) {
   cmd->cmd_class |= CL_EXIT;
 
   (void) log_any(cmd);
+  extlog_flush_all();
 }
 
 static void log_postparse_ev(const void *event_data, void *user_data) {
   config_rec *c;
 
+  log_shipper_postparse();
+
   c = find_config(main_server->conf, CONF_PARAM, "SystemLog", FALSE);
   if (c != NULL) {
     char *path;
@@ -1795,9 +2340,12 @@ static void log_postparse_ev(const void *event_data, void *user_data) {
       log_discard();
     }
   }
+
+  log_shipper_start();
 }
 
 static void log_restart_ev(const void *event_data, void *user_data) {
+  pr_logship_stop();
   destroy_pool(log_pool);
 
   formats = NULL;
@@ -1809,9 +2357,23 @@ static void log_restart_ev(const void *event_data, void *user_data) {
   pr_pool_tag(log_pool, "mod_log pool");
 
   logformat(NULL, "", "%h %l %u %t \"%r\" %s %b");
+
+#if defined(PR_USE_CTRLS)
+  log_shipper_init_acls();
+#endif /* PR_USE_CTRLS */
+
   return;
 }
 
+static void log_shutdown_ev(const void *event_data, void *user_data) {
+  pr_logship_stop();
+}
+
+static void log_startup_ev(const void *event_data, void *user_data) {
+  log_shipper_daemon_started = TRUE;
+  log_shipper_start();
+}
+
 static void log_xfer_stalled_ev(const void *event_data, void *user_data) {
   if (session.curr_cmd_rec != NULL) {
     /* Automatically dispatch the current command, at the LOG_CMD_ERR phase,
@@ -1834,6 +2396,20 @@ static int log_init(void) {
 
   pr_event_register(&log_module, "core.postparse", log_postparse_ev, NULL);
   pr_event_register(&log_module, "core.restart", log_restart_ev, NULL);
+  pr_event_register(&log_module, "core.shutdown", log_shutdown_ev, NULL);
+  pr_event_register(&log_module, "core.startup", log_startup_ev, NULL);
+
+#if defined(PR_USE_CTRLS)
+  if (pr_ctrls_register(&log_module, "logship", "show LogShipper stats",
+      log_shipper_handle_logship) < 0) {
+    pr_log_pri(PR_LOG_NOTICE,
+      "mod_log: error registering 'logship' control: %s", strerror(errno));
+
+  } else {
+    log_shipper_init_acls();
+  }
+#endif /* PR_USE_CTRLS */
+
   return 0;
 }
 
@@ -1973,11 +2549,16 @@ MODRET log_post_host(cmd_rec *cmd) {
 
     /* XXX If ServerLog configured, close/reopen syslog? */
 
+    if (extlog_bufsz > 0) {
+      (void) pr_timer_remove(-1, &log_module);
+    }
+
     /* XXX Close all ExtendedLog files, to prevent duplicate fds. */
     for (lf = logs; lf; lf = lf->next) {
       if (lf->lf_fd > -1) {
         /* No need to close the special EXTENDED_LOG_SYSLOG (i.e. fake) fd. */
         if (lf->lf_fd != EXTENDED_LOG_SYSLOG) {
+          (void) extlog_flush(lf);
           (void) close(lf->lf_fd);
         }
 
@@ -2009,6 +2590,7 @@ MODRET log_post_pass(cmd_rec *cmd) {
           lf->lf_conf->config_type == CONF_ANON) {
         pr_log_debug(DEBUG7, "mod_log: closing ExtendedLog '%s' (fd %d)",
           lf->lf_filename, lf->lf_fd);
+        (void) extlog_flush(lf);
         close(lf->lf_fd);
         lf->lf_fd = -1;
       }
@@ -2025,6 +2607,7 @@ MODRET log_post_pass(cmd_rec *cmd) {
           lf->lf_conf != session.anon_config) {
         pr_log_debug(DEBUG7, "mod_log: closing ExtendedLog '%s' (fd %d)",
           lf->lf_filename, lf->lf_fd);
+        (void) extlog_flush(lf);
         close(lf->lf_fd);
         lf->lf_fd = -1;
       }
@@ -2048,6 +2631,7 @@ MODRET log_post_pass(cmd_rec *cmd) {
               strcmp(lfi->lf_filename, lf->lf_filename) == 0) {
             pr_log_debug(DEBUG7, "mod_log: closing ExtendedLog '%s' (fd %d)",
               lf->lf_filename, lfi->lf_fd);
+            (void) extlog_flush(lfi);
             close(lfi->lf_fd);
             lfi->lf_fd = -1;
           }
@@ -2059,6 +2643,7 @@ MODRET log_post_pass(cmd_rec *cmd) {
             lf->lf_classes == CL_NONE) {
           pr_log_debug(DEBUG7, "mod_log: closing ExtendedLog '%s' (fd %d)",
             lf->lf_filename, lf->lf_fd);
+          (void) extlog_flush(lf);
           close(lf->lf_fd);
           lf->lf_fd = -1;
         }
@@ -2071,6 +2656,7 @@ MODRET log_post_pass(cmd_rec *cmd) {
 
 /* Open all the log files */
 static int log_sess_init(void) {
+  config_rec *c;
   char *serverlog_name = NULL;
   logfile_t *lf = NULL;
 
@@ -2101,8 +2687,6 @@ static int log_sess_init(void) {
     }
 
   } else {
-    config_rec *c;
-
     c = find_config(main_server->conf, CONF_PARAM, "SystemLog", FALSE);
     if (c != NULL) {
       char *path;
@@ -2152,6 +2736,15 @@ static int log_sess_init(void) {
     }
   }
 
+  extlog_bufsz = 0;
+  extlog_buf_interval = EXTENDED_LOG_BUFFER_INTERVAL;
+
+  c = find_config(main_server->conf, CONF_PARAM, "ExtendedLogBuffer", FALSE);
+  if (c != NULL) {
+    extlog_bufsz = *((size_t *) c->argv[0]);
+    extlog_buf_interval = *((int *) c->argv[1]);
+  }
+
   /* Open all the ExtendedLog files. */
   find_extendedlogs();
 
@@ -2200,6 +2793,21 @@ static int log_sess_init(void) {
         lf->lf_fd = EXTENDED_LOG_SYSLOG;
       }
     }
+
+    if (extlog_bufsz > 0 &&
+        lf->lf_fd >= 0 &&
+        lf->lf_buf == NULL) {
+      lf->lf_buf = palloc(session.pool, extlog_bufsz);
+      lf->lf_buflen = 0;
+    }
+  }
+
+  if (extlog_bufsz > 0) {
+    if (pr_timer_add(extlog_buf_interval, -1, &log_module, extlog_flush_cb,
+        "ExtendedLogBuffer flush") < 0) {
+      pr_log_debug(DEBUG3, "mod_log: error adding ExtendedLogBuffer timer: %s",
+        strerror(errno));
+    }
   }
 
   /* Register event handlers for the session. */
@@ -2213,10 +2821,20 @@ static int log_sess_init(void) {
 /* Module API tables
  */
 
+#if defined(PR_USE_CTRLS)
+static ctrls_acttab_t log_shipper_acttab[] = {
+  { "info",	NULL, NULL, NULL },
+  { NULL,	NULL, NULL, NULL }
+};
+#endif /* PR_USE_CTRLS */
+
 static conftable log_conftab[] = {
   { "AllowLogSymlinks",	set_allowlogsymlinks,			NULL },
   { "ExtendedLog",	set_extendedlog,			NULL },
+  { "ExtendedLogBuffer",set_extendedlogbuffer,			NULL },
   { "LogFormat",	set_logformat,				NULL },
+  { "LogShipper",	set_logshipper,				NULL },
+  { "LogShipperControlsACLs",set_logshipperctrlsacls,		NULL },
   { "ServerLog",	set_serverlog,				NULL },
   { "SystemLog",	set_systemlog,				NULL },
   { NULL,		NULL,					NULL }
@@ -2024,15 +2024,15 @@ static int dolist(cmd_rec *cmd, const char *opt, int clearflags) {
 
     } else if (!skiparg) {
       if (a == GLOB_NOSPACE) {
-        pr_response_add(R_226, _("Out of memory during globbing of %s"),
+        pr_response_add(R_DUP, _("Out of memory during globbing of %s"),
           pr_fs_encode_path(cmd->tmp_pool, arg));
 
       } else if (a == GLOB_ABORTED) {
-        pr_response_add(R_226, _("Read error during globbing of %s"),
+        pr_response_add(R_DUP, _("Read error during globbing of %s"),
           pr_fs_encode_path(cmd->tmp_pool, arg));
 
       } else if (a != GLOB_NOMATCH) {
-        pr_response_add(R_226, _("Unknown error during globbing of %s"),
+        pr_response_add(R_DUP, _("Unknown error during globbing of %s"),
           pr_fs_encode_path(cmd->tmp_pool, arg));
       }
     }
@@ -2848,7 +2848,7 @@ MODRET ls_nlst(cmd_rec *cmd) {
             }
 
             session.sf_flags |= SF_ASCII_OVERRIDE;
-            pr_response_add(R_226, _("Transfer complete"));
+            pr_response_add(R_DUP, _("Transfer complete"));
             ls_done(cmd);
 
             return PR_HANDLED(cmd);
@@ -2871,7 +2871,7 @@ MODRET ls_nlst(cmd_rec *cmd) {
           }
 
           session.sf_flags |= SF_ASCII_OVERRIDE;
-          pr_response_add(R_226, _("Transfer complete"));
+          pr_response_add(R_DUP, _("Transfer complete"));
           ls_done(cmd);
 
           return PR_HANDLED(cmd);
@@ -2974,7 +2974,7 @@ MODRET ls_nlst(cmd_rec *cmd) {
           return PR_ERROR(cmd);
         }
         session.sf_flags |= SF_ASCII_OVERRIDE;
-        pr_response_add(R_226, _("Transfer complete"));
+        pr_response_add(R_DUP, _("Transfer complete"));
         ls_done(cmd);
 
         return PR_HANDLED(cmd);
@@ -3009,7 +3009,7 @@ MODRET ls_nlst(cmd_rec *cmd) {
               return PR_ERROR(cmd);
             }
             session.sf_flags |= SF_ASCII_OVERRIDE;
-            pr_response_add(R_226, _("Transfer complete"));
+            pr_response_add(R_DUP, _("Transfer complete"));
             ls_done(cmd);
 
             return PR_HANDLED(cmd);
@@ -3046,7 +3046,7 @@ MODRET ls_nlst(cmd_rec *cmd) {
           return PR_ERROR(cmd);
         }
         session.sf_flags |= SF_ASCII_OVERRIDE;
-        pr_response_add(R_226, _("Transfer complete"));
+        pr_response_add(R_DUP, _("Transfer complete"));
         ls_done(cmd);
 
         return PR_HANDLED(cmd);
@@ -185,6 +185,23 @@ static off_t find_max_nbytes(char *directive) {
   return max_nbytes;
 }
 
+static void _log_transfer_start(char direction, off_t offset) {
+  char *fullpath = NULL;
+
+  fullpath = dir_abs_path(session.xfer.p, session.xfer.path, TRUE);
+
+  if ((session.sf_flags & SF_ANON) != 0) {
+    xferlog_write_start(pr_netaddr_get_sess_remote_name(), offset, fullpath,
+      (session.sf_flags & SF_ASCII ? 'a' : 'b'), direction, 'a',
+      session.anon_user);
+
+  } else {
+    xferlog_write_start(pr_netaddr_get_sess_remote_name(), offset, fullpath,
+      (session.sf_flags & SF_ASCII ? 'a' : 'b'), direction, 'r',
+      session.user);
+  }
+}
+
 static void _log_transfer(char direction, char abort_flag) {
   struct timeval end_time;
   char *fullpath = NULL;
@@ -429,11 +446,11 @@ static int xfer_check_limit(cmd_rec *cmd) {
   return 0;
 }
 
-static int xfer_displayfile(void) {
+static int xfer_displayfile(const char *resp_code) {
   int res = -1;
 
   if (displayfilexfer_fh) {
-    if (pr_display_fh(displayfilexfer_fh, session.vwd, R_226, 0) < 0) {
+    if (pr_display_fh(displayfilexfer_fh, session.vwd, resp_code, 0) < 0) {
       pr_log_debug(DEBUG6, "unable to display DisplayFileTransfer "
         "file '%s': %s", displayfilexfer_fh->fh_path, strerror(errno));
     }
@@ -450,7 +467,7 @@ static int xfer_displayfile(void) {
     char *displayfilexfer = get_param_ptr(main_server->conf,
       "DisplayFileTransfer", FALSE);
     if (displayfilexfer) {
-      if (pr_display_file(displayfilexfer, session.vwd, R_226, 0) < 0) {
+      if (pr_display_file(displayfilexfer, session.vwd, resp_code, 0) < 0) {
         pr_log_debug(DEBUG6, "unable to display DisplayFileTransfer "
           "file '%s': %s", displayfilexfer, strerror(errno));
       }
@@ -462,6 +479,23 @@ static int xfer_displayfile(void) {
   return res;
 }
 
+/* Close the data connection after a successful transfer, then send the
+ * DisplayFileTransfer file, if any, as the final reply.  The reply code
+ * depends on whether the data connection was kept open for block mode.
+ */
+static void xfer_data_close(void) {
+  pr_data_close(TRUE);
+
+  if (xfer_displayfile(pr_data_has_persistent() ? R_250 : R_226) < 0) {
+    if (pr_data_has_persistent()) {
+      pr_response_add(R_250, _("Transfer complete"));
+
+    } else {
+      pr_response_add(R_226, _("Transfer complete"));
+    }
+  }
+}
+
 static int xfer_prio_adjust(void) {
   int res;
 
@@ -595,19 +629,33 @@ static int transmit_normal(char *buf, long bufsz) {
 static int transmit_sendfile(off_t data_len, off_t *data_offset,
     pr_sendfile_t *sent_len) {
   off_t send_len;
+  unsigned char have_protected_data = have_rfc2228_data;
+
+  /* RFC2228 data channel protection does not preclude sendfile() if the
+   * kernel itself is producing the protected records, as mod_tls arranges
+   * when using kernel TLS (kTLS).
+   */
+  if (have_protected_data &&
+      session.d != NULL &&
+      session.d->outstrm != NULL &&
+      pr_table_get(session.d->outstrm->notes, "mod_tls.ktls-tx", NULL) != NULL) {
+    have_protected_data = FALSE;
+  }
 
   /* We don't use sendfile() if:
    * - We're using bandwidth throttling.
    * - We're transmitting an ASCII file.
-   * - We're using RFC2228 data channel protection
+   * - We're using RFC2228 data channel protection (unless kTLS is in use)
    * - We're using MODE Z compression
+   * - We're using MODE B, which frames the data into blocks
    * - There's no data left to transmit.
    * - UseSendfile is set to off.
    */
   if (pr_throttle_have_rate() ||
      !(session.xfer.file_size - data_len) ||
      (session.sf_flags & (SF_ASCII|SF_ASCII_OVERRIDE)) ||
-     have_rfc2228_data || have_zmode ||
+     have_protected_data || have_zmode ||
+     pr_data_get_mode() == PR_DATA_MODE_BLOCK ||
      !use_sendfile) {
 
     if (!xfer_logged_sendfile_decline_msg) {
@@ -622,7 +670,7 @@ static int transmit_sendfile(off_t data_len, off_t *data_offset,
       } else if (session.sf_flags & (SF_ASCII|SF_ASCII_OVERRIDE)) {
         pr_log_debug(DEBUG10, "declining use of sendfile for ASCII data");
 
-      } else if (have_rfc2228_data) {
+      } else if (have_protected_data) {
         pr_log_debug(DEBUG10, "declining use of sendfile due to RFC2228 data "
           "channel protections");
 
@@ -630,6 +678,10 @@ static int transmit_sendfile(off_t data_len, off_t *data_offset,
         pr_log_debug(DEBUG10, "declining use of sendfile due to MODE Z "
           "restrictions");
 
+      } else if (pr_data_get_mode() == PR_DATA_MODE_BLOCK) {
+        pr_log_debug(DEBUG10, "declining use of sendfile due to MODE B "
+          "restrictions");
+
       } else {
         pr_log_debug(DEBUG10, "declining use of sendfile due to lack of data "
           "to transmit");
@@ -1675,6 +1727,10 @@ MODRET xfer_stor(cmd_rec *cmd) {
     "mod_xfer.store-hidden-path", NULL);
   session.xfer.file_size = curr_pos;
 
+  /* Appended data starts at the current end of the file. */
+  pr_data_set_offset(session.xfer.xfer_type == STOR_APPEND ? st.st_size :
+    curr_pos);
+
   /* First, make sure the uploaded file has the requested ownership. */
   stor_chown();
 
@@ -1684,6 +1740,9 @@ MODRET xfer_stor(cmd_rec *cmd) {
     return PR_ERROR(cmd);
   }
 
+  _log_transfer_start('i', session.xfer.xfer_type == STOR_APPEND ?
+    st.st_size : curr_pos);
+
   /* Initialize the number of bytes stored */
   nbytes_stored = 0;
 
@@ -1870,12 +1929,7 @@ MODRET xfer_stor(cmd_rec *cmd) {
       }
     }
 
-    if (xfer_displayfile() < 0) {
-      pr_data_close(FALSE);
-
-    } else {
-      pr_data_close(TRUE);
-    } 
+    xfer_data_close();
   }
 
   return PR_HANDLED(cmd);
@@ -2114,6 +2168,7 @@ MODRET xfer_retr(cmd_rec *cmd) {
 
   session.xfer.path = dir;
   session.xfer.file_size = st.st_size;
+  pr_data_set_offset(curr_pos);
 
   cnt_steps = session.xfer.file_size / 100;
   if (cnt_steps == 0)
@@ -2125,6 +2180,8 @@ MODRET xfer_retr(cmd_rec *cmd) {
     return PR_ERROR(cmd);
   }
 
+  _log_transfer_start('o', curr_pos);
+
   /* Retrieve the number of bytes to retrieve, maximum, if present */
   nbytes_max_retrieve = find_max_nbytes("MaxRetrieveFileSize");
   if (nbytes_max_retrieve == 0UL) {
@@ -2223,12 +2280,7 @@ MODRET xfer_retr(cmd_rec *cmd) {
 
     retr_complete();
 
-    if (xfer_displayfile() < 0) {
-      pr_data_close(FALSE);
-
-    } else {
-      pr_data_close(TRUE);
-    }
+    xfer_data_close();
   }
 
   return PR_HANDLED(cmd);
@@ -2357,12 +2409,35 @@ MODRET xfer_mode(cmd_rec *cmd) {
 
   switch ((int) cmd->argv[1][0]) {
     case 'S':
-      /* Should 202 be returned instead??? */
-      pr_response_add(R_200, _("Mode set to S"));
-      return PR_HANDLED(cmd);
+    case 'B': {
+      int mode, res;
 
-    case 'B':
-      /* FALLTHROUGH */
+      mode = cmd->argv[1][0] == 'B' ? PR_DATA_MODE_BLOCK : PR_DATA_MODE_STREAM;
+
+      res = pr_data_set_mode(mode);
+      if (res < 0) {
+        int xerrno = errno;
+
+        pr_log_debug(DEBUG3, "error setting transfer mode %c: %s",
+          cmd->argv[1][0], strerror(xerrno));
+
+        pr_response_add_err(R_550, "%s: %s",
+          pr_cmd_get_displayable_str(cmd, NULL), strerror(xerrno));
+
+        errno = xerrno;
+        return PR_ERROR(cmd);
+      }
+
+      if (mode == PR_DATA_MODE_BLOCK) {
+        pr_response_add(R_200, _("Mode set to B"));
+
+      } else {
+        /* Should 202 be returned instead??? */
+        pr_response_add(R_200, _("Mode set to S"));
+      }
+
+      return PR_HANDLED(cmd);
+    }
 
     case 'C':
       pr_response_add_err(R_504, _("'%s' unsupported transfer mode"),
@@ -3367,7 +3442,7 @@ static int xfer_init(void) {
   /* Add the commands handled by this module to the HELP list. */
   pr_help_add(C_TYPE, _("<sp> type-code (A, I, L 7, L 8)"), TRUE);
   pr_help_add(C_STRU, _("is not implemented (always F)"), TRUE);
-  pr_help_add(C_MODE, _("is not implemented (always S)"), TRUE);
+  pr_help_add(C_MODE, _("<sp> mode-code (S, B)"), TRUE);
   pr_help_add(C_RETR, _("<sp> pathname"), TRUE);
   pr_help_add(C_STOR, _("<sp> pathname"), TRUE);
   pr_help_add(C_STOU, _("(store unique filename)"), TRUE);
@@ -3375,6 +3450,11 @@ static int xfer_init(void) {
   pr_help_add(C_REST, _("<sp> byte-count"), TRUE);
   pr_help_add(C_ABOR, _("(abort current operation)"), TRUE);
 
+  /* Add the additional features implemented by this module into the
+   * list, to be displayed in response to a FEAT command.
+   */
+  pr_feat_add("MODE B");
+
   return 0;
 }
 
@@ -31,6 +31,14 @@
 #include "conf.h"
 #include "privs.h"
 
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
+
+#ifndef MAP_FAILED
+# define MAP_FAILED	((void *) -1)
+#endif
+
 static pool *auth_pool = NULL;
 static pr_table_t *auth_tab = NULL, *uid_tab = NULL, *gid_tab = NULL;
 static xaset_t *auth_module_list = NULL;
@@ -223,6 +231,577 @@ static void gidcache_add(gid_t gid, const char *name) {
   }
 }
 
+/* Shared cache of lookup results.
+ *
+ * The uidcache, gidcache, and authcache only live as long as their session
+ * process.  If configured, the results of the user/group lookups are also
+ * kept in a table shared by all of the session processes: a file, mapped
+ * into memory, which the daemon process maps before forking the sessions.
+ * The table is a hash table of buckets, each holding a few entries; a bucket
+ * is locked (using fcntl(2) locks on the table file) while it is read or
+ * written.  Entries expire after a configurable lifetime; lookups which found
+ * nothing are cached as well, with a separate (usually shorter) lifetime.
+ *
+ * Entries are keyed by the SID of the server (since different <VirtualHost>s
+ * may use different auth modules/files/databases), the lookup type, and the
+ * name/ID looked up.  Password hashes are never cached.
+ */
+
+#define AUTH_CACHE_TABLE_MAGIC		0x41435431
+#define AUTH_CACHE_TABLE_VERSION	1
+
+/* The number of entries per bucket. */
+#define AUTH_CACHE_BUCKET_NENTS		4
+
+/* The maximum size of a cached key and its value. */
+#define AUTH_CACHE_ENTRY_DATASZ		1024
+
+#define AUTH_CACHE_TYPE_PWNAM		1
+#define AUTH_CACHE_TYPE_PWUID		2
+#define AUTH_CACHE_TYPE_GRNAM		3
+#define AUTH_CACHE_TYPE_GRGID		4
+#define AUTH_CACHE_TYPE_GROUPS		5
+#define AUTH_CACHE_TYPE_UID2NAME	6
+#define AUTH_CACHE_TYPE_GID2NAME	7
+#define AUTH_CACHE_TYPE_NAME2UID	8
+#define AUTH_CACHE_TYPE_NAME2GID	9
+
+struct auth_cache_header {
+  unsigned int magic;
+  unsigned int version;
+  unsigned int nbuckets;
+  unsigned int entsz;
+};
+
+/* The header is padded, so that the buckets are suitably aligned. */
+#define AUTH_CACHE_HEADER_SIZE		64
+
+struct auth_cache_entry {
+  time_t expires;
+  unsigned int hash;
+  unsigned int sid;
+  unsigned char type;
+  unsigned char negative;
+  unsigned short keylen;
+  unsigned short datalen;
+
+  /* The name of the module which provided the value, if any. */
+  char module[32];
+
+  /* The key, followed by the value. */
+  char data[AUTH_CACHE_ENTRY_DATASZ];
+};
+
+#define AUTH_CACHE_BUCKET_SIZE \
+  (sizeof(struct auth_cache_entry) * AUTH_CACHE_BUCKET_NENTS)
+
+static int auth_cache_fd = -1;
+static void *auth_cache_data = NULL;
+static size_t auth_cache_datasz = 0;
+static unsigned int auth_cache_nbuckets = 0;
+
+/* Default lifetimes, in seconds, of cached results, and of cached "not found"
+ * results.
+ */
+static int auth_cache_ttl = 60;
+static int auth_cache_negative_ttl = 10;
+
+static int auth_cache_lock(int lock_type, off_t lock_start, off_t lock_len) {
+  struct flock lock;
+
+  lock.l_type = lock_type;
+  lock.l_whence = SEEK_SET;
+  lock.l_start = lock_start;
+  lock.l_len = lock_len;
+
+  while (fcntl(auth_cache_fd, F_SETLKW, &lock) < 0) {
+    int xerrno = errno;
+
+    if (xerrno == EINTR) {
+      pr_signals_handle();
+      continue;
+    }
+
+    pr_trace_msg(trace_channel, 3, "error %s auth cache table (fd %d): %s",
+      lock_type == F_UNLCK ? "unlocking" : "locking", auth_cache_fd,
+      strerror(xerrno));
+
+    errno = xerrno;
+    return -1;
+  }
+
+  return 0;
+}
+
+static int auth_cache_lock_bucket(int lock_type, unsigned int idx) {
+  return auth_cache_lock(lock_type,
+    AUTH_CACHE_HEADER_SIZE + ((off_t) idx * AUTH_CACHE_BUCKET_SIZE),
+    AUTH_CACHE_BUCKET_SIZE);
+}
+
+static unsigned int auth_cache_hash(int type, const char *key,
+    size_t keylen) {
+  register unsigned int i;
+  unsigned int h = 2166136261U;
+
+  /* FNV-1a, over the SID, type, and key. */
+  h = (h ^ (unsigned char) type) * 16777619U;
+  h = (h ^ (main_server ? main_server->sid : 0)) * 16777619U;
+
+  for (i = 0; i < keylen; i++) {
+    h = (h ^ (unsigned char) key[i]) * 16777619U;
+  }
+
+  return h;
+}
+
+static struct auth_cache_entry *auth_cache_get_bucket(unsigned int idx) {
+  return (struct auth_cache_entry *) ((char *) auth_cache_data +
+    AUTH_CACHE_HEADER_SIZE + ((size_t) idx * AUTH_CACHE_BUCKET_SIZE));
+}
+
+/* Looks up the given key in the shared cache.  Returns 1 if a current entry
+ * was found, copying its value into the given buffer (which must be at least
+ * AUTH_CACHE_ENTRY_DATASZ bytes), and 0 otherwise.
+ */
+static int auth_cache_get(int type, const char *key, size_t keylen,
+    char *buf, size_t *buflen, char *module_name, int *negative) {
+  struct auth_cache_entry *ents;
+  unsigned int h, idx, sid;
+  register unsigned int i;
+  time_t now;
+  int found = FALSE;
+
+  if (auth_cache_data == NULL ||
+      keylen > AUTH_CACHE_ENTRY_DATASZ) {
+    return 0;
+  }
+
+  h = auth_cache_hash(type, key, keylen);
+  idx = h % auth_cache_nbuckets;
+  sid = main_server ? main_server->sid : 0;
+  time(&now);
+
+  if (auth_cache_lock_bucket(F_RDLCK, idx) < 0) {
+    return 0;
+  }
+
+  ents = auth_cache_get_bucket(idx);
+  for (i = 0; i < AUTH_CACHE_BUCKET_NENTS; i++) {
+    struct auth_cache_entry *ent = &(ents[i]);
+
+    if (ent->hash != h ||
+        ent->type != type ||
+        ent->sid != sid ||
+        ent->keylen != keylen ||
+        ent->expires <= now ||
+        memcmp(ent->data, key, keylen) != 0) {
+      continue;
+    }
+
+    memcpy(buf, ent->data + keylen, ent->datalen);
+    *buflen = ent->datalen;
+
+    if (module_name != NULL) {
+      sstrncpy(module_name, ent->module, sizeof(ent->module));
+    }
+
+    *negative = ent->negative;
+    found = TRUE;
+    break;
+  }
+
+  auth_cache_lock_bucket(F_UNLCK, idx);
+  return found;
+}
+
+/* Adds the given key and value to the shared cache, replacing any existing
+ * entry for that key, or else an expired entry, or else the entry closest to
+ * expiring.
+ */
+static void auth_cache_put(int type, const char *key, size_t keylen,
+    const char *value, size_t valuelen, module *m, int negative) {
+  struct auth_cache_entry *ents, *ent = NULL;
+  unsigned int h, idx, sid;
+  register unsigned int i;
+  time_t now;
+
+  if (auth_cache_data == NULL) {
+    return;
+  }
+
+  if (keylen + valuelen > AUTH_CACHE_ENTRY_DATASZ) {
+    pr_trace_msg(trace_channel, 9, "not caching %lu-byte result, too large",
+      (unsigned long) valuelen);
+    return;
+  }
+
+  h = auth_cache_hash(type, key, keylen);
+  idx = h % auth_cache_nbuckets;
+  sid = main_server ? main_server->sid : 0;
+  time(&now);
+
+  if (auth_cache_lock_bucket(F_WRLCK, idx) < 0) {
+    return;
+  }
+
+  ents = auth_cache_get_bucket(idx);
+  for (i = 0; i < AUTH_CACHE_BUCKET_NENTS; i++) {
+    if (ents[i].hash == h &&
+        ents[i].type == type &&
+        ents[i].sid == sid &&
+        ents[i].keylen == keylen &&
+        memcmp(ents[i].data, key, keylen) == 0) {
+      ent = &(ents[i]);
+      break;
+    }
+
+    if (ent == NULL ||
+        ents[i].expires < ent->expires) {
+      ent = &(ents[i]);
+    }
+  }
+
+  ent->hash = h;
+  ent->type = type;
+  ent->sid = sid;
+  ent->negative = negative;
+  ent->expires = now + (negative ? auth_cache_negative_ttl : auth_cache_ttl);
+  ent->keylen = keylen;
+  ent->datalen = valuelen;
+  memcpy(ent->data, key, keylen);
+  memcpy(ent->data + keylen, value, valuelen);
+
+  memset(ent->module, '\0', sizeof(ent->module));
+  if (m != NULL) {
+    sstrncpy(ent->module, m->name, sizeof(ent->module));
+  }
+
+  auth_cache_lock_bucket(F_UNLCK, idx);
+}
+
+/* Appends the given string, including its NUL, to the buffer. */
+static int auth_cache_buf_add(char *buf, size_t bufsz, size_t *buflen,
+    const char *str) {
+  size_t len;
+
+  if (str == NULL) {
+    str = "";
+  }
+
+  len = strlen(str) + 1;
+  if (*buflen + len > bufsz) {
+    errno = ENOSPC;
+    return -1;
+  }
+
+  memcpy(buf + *buflen, str, len);
+  *buflen += len;
+  return 0;
+}
+
+static int auth_cache_buf_add_id(char *buf, size_t bufsz, size_t *buflen,
+    unsigned long id) {
+  char idstr[32];
+
+  snprintf(idstr, sizeof(idstr)-1, "%lu", id);
+  idstr[sizeof(idstr)-1] = '\0';
+
+  return auth_cache_buf_add(buf, bufsz, buflen, idstr);
+}
+
+/* Returns the next NUL-terminated string from the buffer, or NULL if the
+ * buffer is exhausted.
+ */
+static const char *auth_cache_buf_next(const char *buf, size_t buflen,
+    size_t *pos) {
+  const char *str, *end;
+
+  if (*pos >= buflen) {
+    return NULL;
+  }
+
+  str = buf + *pos;
+  end = memchr(str, '\0', buflen - *pos);
+  if (end == NULL) {
+    return NULL;
+  }
+
+  *pos += (end - str) + 1;
+  return str;
+}
+
+static void auth_cache_put_pw(int type, const char *key, size_t keylen,
+    struct passwd *pw, module *m) {
+  char buf[AUTH_CACHE_ENTRY_DATASZ];
+  size_t buflen = 0;
+
+  if (pw == NULL) {
+    auth_cache_put(type, key, keylen, NULL, 0, NULL, TRUE);
+    return;
+  }
+
+  if (auth_cache_buf_add_id(buf, sizeof(buf), &buflen, pw->pw_uid) < 0 ||
+      auth_cache_buf_add_id(buf, sizeof(buf), &buflen, pw->pw_gid) < 0 ||
+      auth_cache_buf_add(buf, sizeof(buf), &buflen, pw->pw_name) < 0 ||
+      auth_cache_buf_add(buf, sizeof(buf), &buflen, pw->pw_gecos) < 0 ||
+      auth_cache_buf_add(buf, sizeof(buf), &buflen, pw->pw_dir) < 0 ||
+      auth_cache_buf_add(buf, sizeof(buf), &buflen, pw->pw_shell) < 0) {
+    return;
+  }
+
+  auth_cache_put(type, key, keylen, buf, buflen, m, FALSE);
+}
+
+/* Returns 1 if the shared cache has a result for the given key, setting
+ * the given struct passwd pointer (to NULL, for a cached "not found" result),
+ * and 0 otherwise.
+ */
+static int auth_cache_get_pw(pool *p, int type, const char *key,
+    size_t keylen, struct passwd **pw, module **m) {
+  char buf[AUTH_CACHE_ENTRY_DATASZ], module_name[32];
+  const char *fields[6];
+  size_t buflen = 0, pos = 0;
+  register unsigned int i;
+  int negative = FALSE;
+  struct passwd *res;
+
+  if (auth_cache_get(type, key, keylen, buf, &buflen, module_name,
+      &negative) == 0) {
+    return 0;
+  }
+
+  if (negative) {
+    *pw = NULL;
+    return 1;
+  }
+
+  for (i = 0; i < 6; i++) {
+    fields[i] = auth_cache_buf_next(buf, buflen, &pos);
+    if (fields[i] == NULL) {
+      return 0;
+    }
+  }
+
+  res = pcalloc(p, sizeof(struct passwd));
+  res->pw_uid = (uid_t) strtoul(fields[0], NULL, 10);
+  res->pw_gid = (gid_t) strtoul(fields[1], NULL, 10);
+  res->pw_name = pstrdup(p, fields[2]);
+  res->pw_passwd = pstrdup(p, "*");
+  res->pw_gecos = pstrdup(p, fields[3]);
+  res->pw_dir = pstrdup(p, fields[4]);
+  res->pw_shell = pstrdup(p, fields[5]);
+
+  if (m != NULL &&
+      *module_name) {
+    *m = pr_module_get(pstrcat(p, "mod_", module_name, ".c", NULL));
+  }
+
+  *pw = res;
+  return 1;
+}
+
+static void auth_cache_put_gr(int type, const char *key, size_t keylen,
+    struct group *gr) {
+  char buf[AUTH_CACHE_ENTRY_DATASZ];
+  size_t buflen = 0;
+
+  if (gr == NULL) {
+    auth_cache_put(type, key, keylen, NULL, 0, NULL, TRUE);
+    return;
+  }
+
+  if (auth_cache_buf_add_id(buf, sizeof(buf), &buflen, gr->gr_gid) < 0 ||
+      auth_cache_buf_add(buf, sizeof(buf), &buflen, gr->gr_name) < 0 ||
+      auth_cache_buf_add(buf, sizeof(buf), &buflen, gr->gr_passwd) < 0) {
+    return;
+  }
+
+  if (gr->gr_mem != NULL) {
+    char **mem;
+
+    for (mem = gr->gr_mem; *mem; mem++) {
+      if (auth_cache_buf_add(buf, sizeof(buf), &buflen, *mem) < 0) {
+        return;
+      }
+    }
+  }
+
+  auth_cache_put(type, key, keylen, buf, buflen, NULL, FALSE);
+}
+
+static int auth_cache_get_gr(pool *p, int type, const char *key,
+    size_t keylen, struct group **gr) {
+  char buf[AUTH_CACHE_ENTRY_DATASZ];
+  const char *gid, *name, *passwd, *member;
+  size_t buflen = 0, pos = 0;
+  array_header *members;
+  int negative = FALSE;
+  struct group *res;
+
+  if (auth_cache_get(type, key, keylen, buf, &buflen, NULL, &negative) == 0) {
+    return 0;
+  }
+
+  if (negative) {
+    *gr = NULL;
+    return 1;
+  }
+
+  gid = auth_cache_buf_next(buf, buflen, &pos);
+  name = auth_cache_buf_next(buf, buflen, &pos);
+  passwd = auth_cache_buf_next(buf, buflen, &pos);
+  if (gid == NULL ||
+      name == NULL ||
+      passwd == NULL) {
+    return 0;
+  }
+
+  members = make_array(p, 2, sizeof(char *));
+  while ((member = auth_cache_buf_next(buf, buflen, &pos)) != NULL) {
+    *((char **) push_array(members)) = pstrdup(p, member);
+  }
+  *((char **) push_array(members)) = NULL;
+
+  res = pcalloc(p, sizeof(struct group));
+  res->gr_gid = (gid_t) strtoul(gid, NULL, 10);
+  res->gr_name = pstrdup(p, name);
+  res->gr_passwd = pstrdup(p, passwd);
+  res->gr_mem = members->elts;
+
+  *gr = res;
+  return 1;
+}
+
+/* Caches a getgroups result: the result count, the number of GIDs, the GIDs,
+ * and the group names.  The GIDs, or the names, may not have been requested.
+ */
+static void auth_cache_put_groups(const char *name, int count,
+    array_header *group_ids, array_header *group_names) {
+  char buf[AUTH_CACHE_ENTRY_DATASZ];
+  size_t buflen = 0;
+  register unsigned int i;
+
+  if (count < 0) {
+    auth_cache_put(AUTH_CACHE_TYPE_GROUPS, name, strlen(name), NULL, 0, NULL,
+      TRUE);
+    return;
+  }
+
+  /* We need both the GIDs and names, so that any request can be answered. */
+  if (group_ids == NULL ||
+      group_names == NULL) {
+    return;
+  }
+
+  if (auth_cache_buf_add_id(buf, sizeof(buf), &buflen, count) < 0 ||
+      auth_cache_buf_add_id(buf, sizeof(buf), &buflen,
+        group_ids->nelts) < 0) {
+    return;
+  }
+
+  for (i = 0; i < group_ids->nelts; i++) {
+    if (auth_cache_buf_add_id(buf, sizeof(buf), &buflen,
+        ((gid_t *) group_ids->elts)[i]) < 0) {
+      return;
+    }
+  }
+
+  for (i = 0; i < group_names->nelts; i++) {
+    if (auth_cache_buf_add(buf, sizeof(buf), &buflen,
+        ((char **) group_names->elts)[i]) < 0) {
+      return;
+    }
+  }
+
+  auth_cache_put(AUTH_CACHE_TYPE_GROUPS, name, strlen(name), buf, buflen,
+    NULL, FALSE);
+}
+
+static int auth_cache_get_groups(const char *name, int *count,
+    array_header *group_ids, array_header *group_names) {
+  char buf[AUTH_CACHE_ENTRY_DATASZ];
+  const char *str;
+  size_t buflen = 0, pos = 0;
+  unsigned long ngids;
+  register unsigned int i;
+  int negative = FALSE;
+
+  if (auth_cache_get(AUTH_CACHE_TYPE_GROUPS, name, strlen(name), buf, &buflen,
+      NULL, &negative) == 0) {
+    return 0;
+  }
+
+  if (negative) {
+    *count = -1;
+    return 1;
+  }
+
+  str = auth_cache_buf_next(buf, buflen, &pos);
+  if (str == NULL) {
+    return 0;
+  }
+  *count = atoi(str);
+
+  str = auth_cache_buf_next(buf, buflen, &pos);
+  if (str == NULL) {
+    return 0;
+  }
+  ngids = strtoul(str, NULL, 10);
+
+  for (i = 0; i < ngids; i++) {
+    str = auth_cache_buf_next(buf, buflen, &pos);
+    if (str == NULL) {
+      return 0;
+    }
+
+    if (group_ids != NULL) {
+      *((gid_t *) push_array(group_ids)) = (gid_t) strtoul(str, NULL, 10);
+    }
+  }
+
+  while ((str = auth_cache_buf_next(buf, buflen, &pos)) != NULL) {
+    if (group_names != NULL) {
+      *((char **) push_array(group_names)) = pstrdup(
+        session.pool ? session.pool : permanent_pool, str);
+    }
+  }
+
+  return 1;
+}
+
+/* Caches a name (e.g. from uid2name) or ID (e.g. from name2uid) result. */
+static void auth_cache_put_str(int type, const char *key, size_t keylen,
+    const char *value) {
+  if (value == NULL) {
+    auth_cache_put(type, key, keylen, NULL, 0, NULL, TRUE);
+    return;
+  }
+
+  auth_cache_put(type, key, keylen, value, strlen(value) + 1, NULL, FALSE);
+}
+
+static int auth_cache_get_str(int type, const char *key, size_t keylen,
+    char *value, size_t valuesz, int *negative) {
+  char buf[AUTH_CACHE_ENTRY_DATASZ];
+  size_t buflen = 0;
+
+  if (auth_cache_get(type, key, keylen, buf, &buflen, NULL, negative) == 0) {
+    return 0;
+  }
+
+  if (!*negative) {
+    if (buflen == 0 ||
+        buf[buflen-1] != '\0') {
+      return 0;
+    }
+
+    sstrncpy(value, buf, valuesz);
+  }
+
+  return 1;
+}
+
 /* The difference between this function, and pr_cmd_alloc(), is that this
  * allocates the cmd_rec directly from the given pool, whereas pr_cmd_alloc()
  * will allocate a subpool from the given pool, and allocate its cmd_rec
@@ -472,17 +1051,28 @@ struct passwd *pr_auth_getpwnam(pool *p, const char *name) {
   struct passwd *res = NULL;
   module *m = NULL;
 
-  cmd = make_cmd(p, 1, name);
-  mr = dispatch_auth(cmd, "getpwnam", &m);
+  if (auth_cache_get_pw(p, AUTH_CACHE_TYPE_PWNAM, name, strlen(name), &res,
+      &m) == 1) {
+    pr_trace_msg(trace_channel, 9, "using cached getpwnam result for '%s'",
+      name);
 
-  if (MODRET_ISHANDLED(mr) &&
-      MODRET_HASDATA(mr)) {
-    res = mr->data;
-  }
+  } else {
+    cmd = make_cmd(p, 1, name);
+    mr = dispatch_auth(cmd, "getpwnam", &m);
 
-  if (cmd->tmp_pool) {
-    destroy_pool(cmd->tmp_pool);
-    cmd->tmp_pool = NULL;
+    if (MODRET_ISHANDLED(mr) &&
+        MODRET_HASDATA(mr)) {
+      res = mr->data;
+    }
+
+    if (!MODRET_ISERROR(mr)) {
+      auth_cache_put_pw(AUTH_CACHE_TYPE_PWNAM, name, strlen(name), res, m);
+    }
+
+    if (cmd->tmp_pool) {
+      destroy_pool(cmd->tmp_pool);
+      cmd->tmp_pool = NULL;
+    }
   }
 
   /* Sanity check */
@@ -559,18 +1149,33 @@ struct passwd *pr_auth_getpwuid(pool *p, uid_t uid) {
   cmd_rec *cmd = NULL;
   modret_t *mr = NULL;
   struct passwd *res = NULL;
+  char key[32];
 
-  cmd = make_cmd(p, 1, (void *) &uid);
-  mr = dispatch_auth(cmd, "getpwuid", NULL);
+  snprintf(key, sizeof(key)-1, "%lu", (unsigned long) uid);
+  key[sizeof(key)-1] = '\0';
 
-  if (MODRET_ISHANDLED(mr) &&
-      MODRET_HASDATA(mr)) {
-    res = mr->data;
-  }
+  if (auth_cache_get_pw(p, AUTH_CACHE_TYPE_PWUID, key, strlen(key), &res,
+      NULL) == 1) {
+    pr_trace_msg(trace_channel, 9, "using cached getpwuid result for UID %s",
+      key);
 
-  if (cmd->tmp_pool) {
-    destroy_pool(cmd->tmp_pool);
-    cmd->tmp_pool = NULL;
+  } else {
+    cmd = make_cmd(p, 1, (void *) &uid);
+    mr = dispatch_auth(cmd, "getpwuid", NULL);
+
+    if (MODRET_ISHANDLED(mr) &&
+        MODRET_HASDATA(mr)) {
+      res = mr->data;
+    }
+
+    if (!MODRET_ISERROR(mr)) {
+      auth_cache_put_pw(AUTH_CACHE_TYPE_PWUID, key, strlen(key), res, NULL);
+    }
+
+    if (cmd->tmp_pool) {
+      destroy_pool(cmd->tmp_pool);
+      cmd->tmp_pool = NULL;
+    }
   }
 
   /* Sanity check */
@@ -600,17 +1205,28 @@ struct group *pr_auth_getgrnam(pool *p, const char *name) {
   modret_t *mr = NULL;
   struct group *res = NULL;
 
-  cmd = make_cmd(p, 1, name);
-  mr = dispatch_auth(cmd, "getgrnam", NULL);
+  if (auth_cache_get_gr(p, AUTH_CACHE_TYPE_GRNAM, name, strlen(name),
+      &res) == 1) {
+    pr_trace_msg(trace_channel, 9, "using cached getgrnam result for '%s'",
+      name);
 
-  if (MODRET_ISHANDLED(mr) &&
-      MODRET_HASDATA(mr)) {
-    res = mr->data;
-  }
+  } else {
+    cmd = make_cmd(p, 1, name);
+    mr = dispatch_auth(cmd, "getgrnam", NULL);
 
-  if (cmd->tmp_pool) {
-    destroy_pool(cmd->tmp_pool);
-    cmd->tmp_pool = NULL;
+    if (MODRET_ISHANDLED(mr) &&
+        MODRET_HASDATA(mr)) {
+      res = mr->data;
+    }
+
+    if (!MODRET_ISERROR(mr)) {
+      auth_cache_put_gr(AUTH_CACHE_TYPE_GRNAM, name, strlen(name), res);
+    }
+
+    if (cmd->tmp_pool) {
+      destroy_pool(cmd->tmp_pool);
+      cmd->tmp_pool = NULL;
+    }
   }
 
   /* Sanity check */
@@ -636,18 +1252,33 @@ struct group *pr_auth_getgrgid(pool *p, gid_t gid) {
   cmd_rec *cmd = NULL;
   modret_t *mr = NULL;
   struct group *res = NULL;
+  char key[32];
 
-  cmd = make_cmd(p, 1, (void *) &gid);
-  mr = dispatch_auth(cmd, "getgrgid", NULL);
+  snprintf(key, sizeof(key)-1, "%lu", (unsigned long) gid);
+  key[sizeof(key)-1] = '\0';
 
-  if (MODRET_ISHANDLED(mr) &&
-      MODRET_HASDATA(mr)) {
-    res = mr->data;
-  }
+  if (auth_cache_get_gr(p, AUTH_CACHE_TYPE_GRGID, key, strlen(key),
+      &res) == 1) {
+    pr_trace_msg(trace_channel, 9, "using cached getgrgid result for GID %s",
+      key);
 
-  if (cmd->tmp_pool) {
-    destroy_pool(cmd->tmp_pool);
-    cmd->tmp_pool = NULL;
+  } else {
+    cmd = make_cmd(p, 1, (void *) &gid);
+    mr = dispatch_auth(cmd, "getgrgid", NULL);
+
+    if (MODRET_ISHANDLED(mr) &&
+        MODRET_HASDATA(mr)) {
+      res = mr->data;
+    }
+
+    if (!MODRET_ISERROR(mr)) {
+      auth_cache_put_gr(AUTH_CACHE_TYPE_GRGID, key, strlen(key), res);
+    }
+
+    if (cmd->tmp_pool) {
+      destroy_pool(cmd->tmp_pool);
+      cmd->tmp_pool = NULL;
+    }
   }
 
   /* Sanity check */
@@ -900,8 +1531,8 @@ const char *pr_auth_uid2name(pool *p, uid_t uid) {
   static char namebuf[64];
   cmd_rec *cmd = NULL;
   modret_t *mr = NULL;
-  char *res = NULL;
-  int have_name = FALSE;
+  char *res = NULL, key[32];
+  int have_name = FALSE, negative = FALSE;
 
   memset(namebuf, '\0', sizeof(namebuf));
 
@@ -929,22 +1560,42 @@ const char *pr_auth_uid2name(pool *p, uid_t uid) {
     }
   }
 
-  cmd = make_cmd(p, 1, (void *) &uid);
-  mr = dispatch_auth(cmd, "uid2name", NULL);
+  snprintf(key, sizeof(key)-1, "%lu", (unsigned long) uid);
+  key[sizeof(key)-1] = '\0';
 
-  if (MODRET_ISHANDLED(mr) &&
-      MODRET_HASDATA(mr)) {
-    res = mr->data;
-    sstrncpy(namebuf, res, sizeof(namebuf));
-    res = namebuf;
+  if (auth_cache_get_str(AUTH_CACHE_TYPE_UID2NAME, key, strlen(key),
+      namebuf, sizeof(namebuf), &negative) == 1) {
+    pr_trace_msg(trace_channel, 9, "using cached uid2name result for UID %s",
+      key);
 
-    uidcache_add(uid, res);
-    have_name = TRUE;
-  }
+    if (!negative) {
+      uidcache_add(uid, namebuf);
+      have_name = TRUE;
+    }
 
-  if (cmd->tmp_pool) {
-    destroy_pool(cmd->tmp_pool);
-    cmd->tmp_pool = NULL;
+  } else {
+    cmd = make_cmd(p, 1, (void *) &uid);
+    mr = dispatch_auth(cmd, "uid2name", NULL);
+
+    if (MODRET_ISHANDLED(mr) &&
+        MODRET_HASDATA(mr)) {
+      res = mr->data;
+      sstrncpy(namebuf, res, sizeof(namebuf));
+      res = namebuf;
+
+      uidcache_add(uid, res);
+      have_name = TRUE;
+    }
+
+    if (!MODRET_ISERROR(mr)) {
+      auth_cache_put_str(AUTH_CACHE_TYPE_UID2NAME, key, strlen(key),
+        have_name ? namebuf : NULL);
+    }
+
+    if (cmd->tmp_pool) {
+      destroy_pool(cmd->tmp_pool);
+      cmd->tmp_pool = NULL;
+    }
   }
 
   if (!have_name) {
@@ -959,8 +1610,8 @@ const char *pr_auth_gid2name(pool *p, gid_t gid) {
   cmd_rec *cmd = NULL;
   modret_t *mr = NULL;
   static char namebuf[64];
-  char *res = NULL;
-  int have_name = FALSE;
+  char *res = NULL, key[32];
+  int have_name = FALSE, negative = FALSE;
 
   memset(namebuf, '\0', sizeof(namebuf));
 
@@ -988,22 +1639,42 @@ const char *pr_auth_gid2name(pool *p, gid_t gid) {
     }
   }
 
-  cmd = make_cmd(p, 1, (void *) &gid);
-  mr = dispatch_auth(cmd, "gid2name", NULL);
+  snprintf(key, sizeof(key)-1, "%lu", (unsigned long) gid);
+  key[sizeof(key)-1] = '\0';
 
-  if (MODRET_ISHANDLED(mr) &&
-      MODRET_HASDATA(mr)) {
-    res = mr->data;
-    sstrncpy(namebuf, res, sizeof(namebuf));
-    res = namebuf;
+  if (auth_cache_get_str(AUTH_CACHE_TYPE_GID2NAME, key, strlen(key),
+      namebuf, sizeof(namebuf), &negative) == 1) {
+    pr_trace_msg(trace_channel, 9, "using cached gid2name result for GID %s",
+      key);
 
-    gidcache_add(gid, res);
-    have_name = TRUE;
-  }
+    if (!negative) {
+      gidcache_add(gid, namebuf);
+      have_name = TRUE;
+    }
 
-  if (cmd->tmp_pool) {
-    destroy_pool(cmd->tmp_pool);
-    cmd->tmp_pool = NULL;
+  } else {
+    cmd = make_cmd(p, 1, (void *) &gid);
+    mr = dispatch_auth(cmd, "gid2name", NULL);
+
+    if (MODRET_ISHANDLED(mr) &&
+        MODRET_HASDATA(mr)) {
+      res = mr->data;
+      sstrncpy(namebuf, res, sizeof(namebuf));
+      res = namebuf;
+
+      gidcache_add(gid, res);
+      have_name = TRUE;
+    }
+
+    if (!MODRET_ISERROR(mr)) {
+      auth_cache_put_str(AUTH_CACHE_TYPE_GID2NAME, key, strlen(key),
+        have_name ? namebuf : NULL);
+    }
+
+    if (cmd->tmp_pool) {
+      destroy_pool(cmd->tmp_pool);
+      cmd->tmp_pool = NULL;
+    }
   }
 
   if (!have_name) {
@@ -1018,6 +1689,23 @@ uid_t pr_auth_name2uid(pool *p, const char *name) {
   cmd_rec *cmd = NULL;
   modret_t *mr = NULL;
   uid_t res = (uid_t) -1;
+  char value[32];
+  int negative = FALSE;
+
+  if (auth_cache_get_str(AUTH_CACHE_TYPE_NAME2UID, name, strlen(name), value,
+      sizeof(value), &negative) == 1) {
+    pr_trace_msg(trace_channel, 9, "using cached name2uid result for '%s'",
+      name);
+
+    if (negative) {
+      errno = EINVAL;
+
+    } else {
+      res = (uid_t) strtoul(value, NULL, 10);
+    }
+
+    return res;
+  }
 
   cmd = make_cmd(p, 1, name);
   mr = dispatch_auth(cmd, "name2uid", NULL);
@@ -1025,7 +1713,15 @@ uid_t pr_auth_name2uid(pool *p, const char *name) {
   if (MODRET_ISHANDLED(mr)) {
     res = *((uid_t *) mr->data);
 
+    snprintf(value, sizeof(value)-1, "%lu", (unsigned long) res);
+    value[sizeof(value)-1] = '\0';
+    auth_cache_put_str(AUTH_CACHE_TYPE_NAME2UID, name, strlen(name), value);
+
   } else {
+    if (!MODRET_ISERROR(mr)) {
+      auth_cache_put_str(AUTH_CACHE_TYPE_NAME2UID, name, strlen(name), NULL);
+    }
+
     errno = EINVAL;
   }
 
@@ -1041,6 +1737,23 @@ gid_t pr_auth_name2gid(pool *p, const char *name) {
   cmd_rec *cmd = NULL;
   modret_t *mr = NULL;
   gid_t res = (gid_t) -1;
+  char value[32];
+  int negative = FALSE;
+
+  if (auth_cache_get_str(AUTH_CACHE_TYPE_NAME2GID, name, strlen(name), value,
+      sizeof(value), &negative) == 1) {
+    pr_trace_msg(trace_channel, 9, "using cached name2gid result for '%s'",
+      name);
+
+    if (negative) {
+      errno = EINVAL;
+
+    } else {
+      res = (gid_t) strtoul(value, NULL, 10);
+    }
+
+    return res;
+  }
 
   cmd = make_cmd(p, 1, name);
   mr = dispatch_auth(cmd, "name2gid", NULL);
@@ -1048,7 +1761,15 @@ gid_t pr_auth_name2gid(pool *p, const char *name) {
   if (MODRET_ISHANDLED(mr)) {
     res = *((gid_t *) mr->data);
 
+    snprintf(value, sizeof(value)-1, "%lu", (unsigned long) res);
+    value[sizeof(value)-1] = '\0';
+    auth_cache_put_str(AUTH_CACHE_TYPE_NAME2GID, name, strlen(name), value);
+
   } else {
+    if (!MODRET_ISERROR(mr)) {
+      auth_cache_put_str(AUTH_CACHE_TYPE_NAME2GID, name, strlen(name), NULL);
+    }
+
     errno = EINVAL;
   }
 
@@ -1065,7 +1786,7 @@ int pr_auth_getgroups(pool *p, const char *name, array_header **group_ids,
 
   cmd_rec *cmd = NULL;
   modret_t *mr = NULL;
-  int res = -1;
+  int found = FALSE, res = -1;
 
   /* Allocate memory for the array_headers of GIDs and group names. */
   if (group_ids)
@@ -1074,14 +1795,36 @@ int pr_auth_getgroups(pool *p, const char *name, array_header **group_ids,
   if (group_names)
     *group_names = make_array(permanent_pool, 2, sizeof(char *));
 
-  cmd = make_cmd(p, 3, name, group_ids ? *group_ids : NULL,
-    group_names ? *group_names : NULL);
+  if (auth_cache_get_groups(name, &res, group_ids ? *group_ids : NULL,
+      group_names ? *group_names : NULL) == 1) {
+    pr_trace_msg(trace_channel, 9, "using cached getgroups result for '%s'",
+      name);
+    found = (res >= 0);
 
-  mr = dispatch_auth(cmd, "getgroups", NULL);
+  } else {
+    cmd = make_cmd(p, 3, name, group_ids ? *group_ids : NULL,
+      group_names ? *group_names : NULL);
 
-  if (MODRET_ISHANDLED(mr) &&
-      MODRET_HASDATA(mr)) {
-    res = *((int *) mr->data);
+    mr = dispatch_auth(cmd, "getgroups", NULL);
+
+    if (MODRET_ISHANDLED(mr) &&
+        MODRET_HASDATA(mr)) {
+      res = *((int *) mr->data);
+      found = TRUE;
+    }
+
+    if (!MODRET_ISERROR(mr)) {
+      auth_cache_put_groups(name, found ? res : -1,
+        group_ids ? *group_ids : NULL, group_names ? *group_names : NULL);
+    }
+
+    if (cmd->tmp_pool) {
+      destroy_pool(cmd->tmp_pool);
+      cmd->tmp_pool = NULL;
+    }
+  }
+
+  if (found) {
 
     /* Note: the number of groups returned should, barring error,
      * always be at least 1, as per getgroups(2) behavior.  This one
@@ -1125,11 +1868,6 @@ int pr_auth_getgroups(pool *p, const char *name, array_header **group_ids,
     }
   }
 
-  if (cmd->tmp_pool) {
-    destroy_pool(cmd->tmp_pool);
-    cmd->tmp_pool = NULL;
-  }
-
   return res;
 }
 
@@ -1586,6 +2324,150 @@ int pr_auth_cache_set(int bool, unsigned int flags) {
   return 0;
 }
 
+int pr_auth_cache_table_open(const char *path, unsigned int nents,
+    int flags) {
+  struct auth_cache_header hdr;
+  struct stat st;
+  unsigned int nbuckets;
+  size_t datasz;
+  void *data;
+  int fd, res, reset = TRUE, xerrno;
+
+  if (path == NULL ||
+      nents == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  (void) pr_auth_cache_table_close();
+
+  nbuckets = (nents + AUTH_CACHE_BUCKET_NENTS - 1) / AUTH_CACHE_BUCKET_NENTS;
+  datasz = AUTH_CACHE_HEADER_SIZE + ((size_t) nbuckets *
+    AUTH_CACHE_BUCKET_SIZE);
+
+  PRIVS_ROOT
+  fd = open(path, O_RDWR|O_CREAT, 0600);
+  xerrno = errno;
+  PRIVS_RELINQUISH
+
+  if (fd < 0) {
+    pr_log_pri(PR_LOG_WARNING, "unable to open AuthCacheTable '%s': %s",
+      path, strerror(xerrno));
+    errno = xerrno;
+    return -1;
+  }
+
+  /* Use the existing table, unless asked to reset it, or its layout differs
+   * from what is now configured.
+   */
+  if (!(flags & PR_AUTH_CACHE_TABLE_FL_RESET) &&
+      fstat(fd, &st) == 0 &&
+      (size_t) st.st_size == datasz &&
+      pread(fd, &hdr, sizeof(hdr), 0) == sizeof(hdr) &&
+      hdr.magic == AUTH_CACHE_TABLE_MAGIC &&
+      hdr.version == AUTH_CACHE_TABLE_VERSION &&
+      hdr.nbuckets == nbuckets &&
+      hdr.entsz == sizeof(struct auth_cache_entry)) {
+    reset = FALSE;
+  }
+
+  if (reset) {
+    /* Rather than truncating the existing file, which other processes (e.g.
+     * sessions started before a restart) may have mapped, replace it.
+     */
+    (void) close(fd);
+
+    PRIVS_ROOT
+    (void) unlink(path);
+    fd = open(path, O_RDWR|O_CREAT|O_EXCL, 0600);
+    xerrno = errno;
+    PRIVS_RELINQUISH
+
+    if (fd < 0) {
+      pr_log_pri(PR_LOG_WARNING, "unable to create AuthCacheTable '%s': %s",
+        path, strerror(xerrno));
+      errno = xerrno;
+      return -1;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = AUTH_CACHE_TABLE_MAGIC;
+    hdr.version = AUTH_CACHE_TABLE_VERSION;
+    hdr.nbuckets = nbuckets;
+    hdr.entsz = sizeof(struct auth_cache_entry);
+
+    res = ftruncate(fd, datasz);
+    if (res == 0) {
+      res = (pwrite(fd, &hdr, sizeof(hdr), 0) == sizeof(hdr)) ? 0 : -1;
+    }
+
+    if (res < 0) {
+      xerrno = errno;
+
+      pr_log_pri(PR_LOG_WARNING, "error initializing AuthCacheTable '%s': %s",
+        path, strerror(xerrno));
+      (void) close(fd);
+
+      errno = xerrno;
+      return -1;
+    }
+  }
+
+  (void) fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+  data = mmap(NULL, datasz, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED) {
+    xerrno = errno;
+
+    pr_log_pri(PR_LOG_WARNING, "error mapping AuthCacheTable '%s': %s", path,
+      strerror(xerrno));
+    (void) close(fd);
+
+    errno = xerrno;
+    return -1;
+  }
+
+  auth_cache_fd = fd;
+  auth_cache_data = data;
+  auth_cache_datasz = datasz;
+  auth_cache_nbuckets = nbuckets;
+
+  pr_trace_msg(trace_channel, 5,
+    "%s AuthCacheTable '%s' (%u entries, %lu bytes)",
+    reset ? "created" : "using", path, nbuckets * AUTH_CACHE_BUCKET_NENTS,
+    (unsigned long) datasz);
+  return 0;
+}
+
+int pr_auth_cache_table_close(void) {
+  if (auth_cache_data == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  (void) munmap(auth_cache_data, auth_cache_datasz);
+  (void) close(auth_cache_fd);
+
+  auth_cache_fd = -1;
+  auth_cache_data = NULL;
+  auth_cache_datasz = 0;
+  auth_cache_nbuckets = 0;
+
+  return 0;
+}
+
+int pr_auth_cache_table_set_timeouts(int ttl, int negative_ttl) {
+  if (ttl < 0 ||
+      negative_ttl < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  auth_cache_ttl = ttl;
+  auth_cache_negative_ttl = negative_ttl;
+  return 0;
+}
+
 int pr_auth_add_auth_only_module(const char *name) {
   struct auth_module_elt *elt = NULL;
 
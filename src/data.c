@@ -39,6 +39,7 @@
 #endif /* HAVE_SYS_UIO_H */
 
 static const char *trace_channel = "data";
+static pr_trace_chan_t trace_chan = PR_TRACE_CHAN("data");
 
 /* local macro */
 
@@ -52,6 +53,48 @@ static pr_netio_stream_t *nstrm = NULL;
 
 static long timeout_linger = PR_TUNABLE_TIMEOUTLINGER;
 
+/* RFC 959 block mode descriptor codes. */
+#define DATA_BLOCK_DESC_EOR		0x80
+#define DATA_BLOCK_DESC_EOF		0x40
+#define DATA_BLOCK_DESC_ERRORS		0x20
+#define DATA_BLOCK_DESC_RESTART		0x10
+
+#define DATA_BLOCK_HEADER_SIZE		3
+#define DATA_BLOCK_MAX_COUNT		65535
+
+/* How often, in bytes of file data, to send a restart marker on block mode
+ * downloads.
+ */
+#define DATA_BLOCK_MARKER_INTERVAL	(1024 * 1024)
+
+static int data_mode = PR_DATA_MODE_STREAM;
+
+/* In block mode, the data connection kept open between transfers. */
+static conn_t *persistent_conn = NULL;
+
+/* The NetIO filter which does the block mode framing. */
+static pr_netio_filter_t *block_filter = NULL;
+
+/* Block mode state for the current transfer: the number of bytes left in
+ * the block being read, whether the EOF block has been read, and the buffer
+ * used for assembling the blocks being written.
+ */
+static size_t block_remaining = 0;
+static int block_have_eof = FALSE;
+static char *block_buf = NULL;
+static size_t block_bufsz = 0;
+
+/* Restart markers are only used when the block filter sees the file data
+ * itself, i.e. for binary file transfers with no other filter on top.  The
+ * markers are the file offsets of the data sent/received so far.
+ */
+static int block_use_markers = FALSE;
+static off_t block_offset = 0;
+static off_t block_next_marker = 0;
+
+/* The file offset of the next transfer, as set by pr_data_set_offset(). */
+static off_t data_xfer_offset = -1;
+
 static int timeout_idle = PR_TUNABLE_TIMEOUTIDLE;
 static int timeout_noxfer = PR_TUNABLE_TIMEOUTNOXFER;
 static int timeout_stalled = PR_TUNABLE_TIMEOUTSTALLED;
@@ -221,6 +264,324 @@ static unsigned int xfrm_ascii_write(char **buf, unsigned int *buflen,
   return added;
 }
 
+static void data_block_reset(void) {
+  block_remaining = 0;
+  block_have_eof = FALSE;
+
+  /* The block buffer is allocated out of session.xfer.p. */
+  block_buf = NULL;
+  block_bufsz = 0;
+
+  block_use_markers = FALSE;
+  block_offset = block_next_marker = 0;
+}
+
+/* Writes the given data as one or more blocks, with the given descriptor
+ * on the last block.  Each block is assembled, header and data, in a single
+ * buffer, so that it goes out in a single write; a small header written on
+ * its own could otherwise be held back by Nagle.
+ */
+static int data_block_write(pr_netio_filter_t *filter,
+    pr_netio_stream_t *strm, unsigned char desc, char *buf, size_t buflen) {
+  size_t total = 0;
+
+  do {
+    int res;
+    size_t count;
+
+    count = buflen - total;
+    if (count > DATA_BLOCK_MAX_COUNT) {
+      count = DATA_BLOCK_MAX_COUNT;
+    }
+
+    if (block_buf == NULL ||
+        block_bufsz < count + DATA_BLOCK_HEADER_SIZE) {
+      block_bufsz = count + DATA_BLOCK_HEADER_SIZE;
+      block_buf = palloc(session.xfer.p ? session.xfer.p : session.pool,
+        block_bufsz);
+    }
+
+    block_buf[0] = (total + count == buflen ? desc : 0);
+    block_buf[1] = (char) ((count >> 8) & 0xff);
+    block_buf[2] = (char) (count & 0xff);
+
+    if (count > 0) {
+      memcpy(block_buf + DATA_BLOCK_HEADER_SIZE, buf + total, count);
+    }
+
+    res = pr_netio_filter_write(filter, strm, block_buf,
+      count + DATA_BLOCK_HEADER_SIZE);
+    if (res < 0) {
+      return res;
+    }
+
+    total += count;
+
+  } while (total < buflen);
+
+  return (int) total;
+}
+
+/* Handles a restart marker block sent by the client: the marker is read, and
+ * acknowledged on the control connection with the file offset to which it
+ * corresponds, which the client can later use with REST.
+ */
+static int data_block_read_marker(pr_netio_filter_t *filter,
+    pr_netio_stream_t *strm) {
+  char marker[256];
+  size_t markerlen = 0;
+  int valid = TRUE;
+
+  while (block_remaining > 0) {
+    int res;
+    size_t len;
+
+    len = block_remaining;
+    if (len > sizeof(marker) - 1) {
+      len = sizeof(marker) - 1;
+    }
+
+    res = pr_netio_filter_read(filter, strm, marker, len, len);
+    if (res < 0) {
+      return res;
+    }
+
+    if (res == 0) {
+      /* The connection was closed in the middle of the block. */
+      errno = EPIPE;
+      return -1;
+    }
+
+    /* Longer markers than we can hold are not acknowledged. */
+    if (markerlen > 0) {
+      valid = FALSE;
+    }
+
+    markerlen = res;
+    block_remaining -= res;
+  }
+
+  if (markerlen > 0) {
+    register unsigned int i;
+
+    marker[markerlen] = '\0';
+
+    /* The marker is echoed back on the control connection, so it had better
+     * be printable.
+     */
+    for (i = 0; i < markerlen; i++) {
+      if (!PR_ISPRINT(marker[i])) {
+        valid = FALSE;
+        break;
+      }
+    }
+
+  } else {
+    valid = FALSE;
+  }
+
+  if (!valid ||
+      !block_use_markers) {
+    pr_trace_msg(trace_channel, 9, "ignoring %s restart marker from client",
+      valid ? "unusable" : "invalid");
+    return 0;
+  }
+
+  pr_trace_msg(trace_channel, 9,
+    "received restart marker '%s' from client at offset %" PR_LU, marker,
+    (pr_off_t) block_offset);
+  pr_response_send(R_110, "MARK %s = %" PR_LU, marker,
+    (pr_off_t) block_offset);
+
+  return 0;
+}
+
+/* Block mode NetIO filter callbacks */
+
+static int data_block_start_cb(pr_netio_filter_t *filter,
+    pr_netio_stream_t *strm) {
+  data_block_reset();
+
+  if (data_xfer_offset >= 0 &&
+      pr_get_netio_filter(strm->strm_type, NULL) == filter &&
+      !(session.sf_flags & (SF_ASCII|SF_ASCII_OVERRIDE))) {
+    block_use_markers = TRUE;
+    block_offset = data_xfer_offset;
+    block_next_marker = block_offset + DATA_BLOCK_MARKER_INTERVAL;
+  }
+
+  data_xfer_offset = -1;
+  return 0;
+}
+
+/* Reads the data of the current block, reading the next block header first
+ * if needed.  Returns zero once the EOF block has been read.
+ */
+static int data_block_read_cb(pr_netio_filter_t *filter,
+    pr_netio_stream_t *strm, char *buf, size_t bufsz) {
+  int res;
+
+  while (block_remaining == 0) {
+    unsigned char hdr[DATA_BLOCK_HEADER_SIZE];
+    unsigned char desc;
+
+    if (block_have_eof) {
+      return 0;
+    }
+
+    res = pr_netio_filter_read(filter, strm, (char *) hdr, sizeof(hdr),
+      sizeof(hdr));
+    if (res <= 0) {
+      return res;
+    }
+
+    desc = hdr[0];
+    block_remaining = (hdr[1] << 8) | hdr[2];
+
+    if (pr_trace_chan_enabled(&trace_chan, 19)) {
+      pr_trace_msg(trace_channel, 19,
+        "read block header: descriptor 0x%02x, count %lu", desc,
+        (unsigned long) block_remaining);
+    }
+
+    if (desc & DATA_BLOCK_DESC_EOF) {
+      block_have_eof = TRUE;
+    }
+
+    if (desc & DATA_BLOCK_DESC_RESTART) {
+      res = data_block_read_marker(filter, strm);
+      if (res < 0) {
+        return res;
+      }
+    }
+  }
+
+  if (bufsz > block_remaining) {
+    bufsz = block_remaining;
+  }
+
+  res = pr_netio_filter_read(filter, strm, buf, bufsz, 1);
+  if (res > 0) {
+    block_remaining -= res;
+
+    if (block_use_markers) {
+      block_offset += res;
+    }
+  }
+
+  return res;
+}
+
+static int data_block_write_cb(pr_netio_filter_t *filter,
+    pr_netio_stream_t *strm, char *buf, size_t buflen) {
+  int res;
+
+  res = data_block_write(filter, strm, 0, buf, buflen);
+  if (res < 0) {
+    return res;
+  }
+
+  if (block_use_markers) {
+    block_offset += res;
+
+    if (block_offset >= block_next_marker) {
+      char marker[32];
+
+      memset(marker, '\0', sizeof(marker));
+      snprintf(marker, sizeof(marker)-1, "%" PR_LU, (pr_off_t) block_offset);
+
+      pr_trace_msg(trace_channel, 19, "sending restart marker '%s'", marker);
+      if (data_block_write(filter, strm, DATA_BLOCK_DESC_RESTART, marker,
+          strlen(marker)) < 0) {
+        return -1;
+      }
+
+      block_next_marker = block_offset + DATA_BLOCK_MARKER_INTERVAL;
+    }
+  }
+
+  return res;
+}
+
+/* Ends a block mode transfer: writes the EOF block for a download, or checks
+ * that the EOF block was read for an upload.  Returns 0 if the data
+ * connection can be kept open for the next transfer, -1 otherwise.
+ */
+static int data_block_finish_cb(pr_netio_filter_t *filter,
+    pr_netio_stream_t *strm) {
+  int res = 0;
+
+  if (strm->strm_mode == PR_NETIO_IO_WR) {
+    if (data_block_write(filter, strm, DATA_BLOCK_DESC_EOF, "", 0) < 0) {
+      pr_trace_msg(trace_channel, 3, "error writing EOF block: %s",
+        strerror(errno));
+      res = -1;
+
+    } else {
+      /* Let any NetIO which holds back written data (e.g. to fill out
+       * records) know that no more is coming for this transfer.
+       */
+      pr_event_generate("core.data-flush", strm);
+    }
+
+  } else {
+    char buf[64];
+
+    /* A filter above us (e.g. MODE Z) may have seen the end of its data
+     * before the EOF block was read; anything other than the EOF block
+     * following it is an error.
+     */
+    while (!block_have_eof) {
+      int len;
+
+      len = data_block_read_cb(filter, strm, buf, sizeof(buf));
+      if (len == 0 &&
+          block_have_eof) {
+        break;
+      }
+
+      pr_trace_msg(trace_channel, 3, "data connection %s without EOF block",
+        len > 0 ? "had unexpected data" : "closed by client");
+      res = -1;
+      break;
+    }
+  }
+
+  data_block_reset();
+  return res;
+}
+
+/* Reuses the data connection kept open after the last block mode transfer. */
+static int data_persistent_open(char *reason, off_t size) {
+  if (!reason && session.xfer.filename)
+    reason = session.xfer.filename;
+
+  session.d = persistent_conn;
+  persistent_conn = NULL;
+
+  pr_log_debug(DEBUG4, "reusing data connection - remote : %s:%d",
+    pr_netaddr_get_ipstr(session.d->remote_addr), session.d->remote_port);
+
+  if (session.xfer.xfer_type != STOR_UNIQUE) {
+    if (size) {
+      pr_response_send(R_125, _("Data connection already open; transfer "
+        "starting for %s (%" PR_LU " bytes)"), reason, (pr_off_t) size);
+
+    } else {
+      pr_response_send(R_125, _("Data connection already open; transfer "
+        "starting for %s"), reason);
+    }
+
+  } else {
+    /* See the comments in data_pasv_open() on the format of STOU
+     * responses.
+     */
+    pr_response_send(R_125, "FILE: %s", reason);
+  }
+
+  return 0;
+}
+
 static void data_new_xfer(char *filename, int direction) {
   pr_data_clear_xfer_pool();
 
@@ -557,6 +918,9 @@ void pr_data_clear_xfer_pool(void) {
   if (session.xfer.p)
     destroy_pool(session.xfer.p);
 
+  data_block_reset();
+  data_xfer_offset = -1;
+
   /* Note that session.xfer.xfer_type may have been set already, e.g.
    * for STOR_UNIQUE uploads.  To support this, we need to preserve that
    * value.
@@ -567,12 +931,80 @@ void pr_data_clear_xfer_pool(void) {
   session.xfer.xfer_type = xfer_type;  
 }
 
+int pr_data_get_mode(void) {
+  return data_mode;
+}
+
+int pr_data_set_mode(int mode) {
+  if (mode != PR_DATA_MODE_STREAM &&
+      mode != PR_DATA_MODE_BLOCK) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  pr_data_close_persistent();
+
+  if (mode == data_mode) {
+    return 0;
+  }
+
+  if (mode == PR_DATA_MODE_BLOCK) {
+    if (block_filter == NULL) {
+      block_filter = pr_alloc_netio_filter(session.pool, NULL, "block");
+      block_filter->start = data_block_start_cb;
+      block_filter->finish = data_block_finish_cb;
+      block_filter->read = data_block_read_cb;
+      block_filter->write = data_block_write_cb;
+    }
+
+    if (pr_push_netio_filter(block_filter, PR_NETIO_STRM_DATA) < 0) {
+      int xerrno = errno;
+
+      pr_trace_msg(trace_channel, 3, "error adding block mode filter: %s",
+        strerror(xerrno));
+
+      errno = xerrno;
+      return -1;
+    }
+
+  } else {
+    (void) pr_remove_netio_filter(PR_NETIO_STRM_DATA, "block");
+  }
+
+  data_mode = mode;
+  return 0;
+}
+
+void pr_data_set_offset(off_t offset) {
+  data_xfer_offset = offset;
+}
+
+void pr_data_close_persistent(void) {
+  if (persistent_conn == NULL) {
+    return;
+  }
+
+  /* Everything written on the connection has already been read by the
+   * client, so there is nothing to linger for.
+   */
+  pr_trace_msg(trace_channel, 9,
+    "closing data connection kept open for block mode transfers");
+  pr_inet_lingering_close(session.pool, persistent_conn, 0);
+  persistent_conn = NULL;
+}
+
+int pr_data_has_persistent(void) {
+  return persistent_conn != NULL ? TRUE : FALSE;
+}
+
 void pr_data_reset(void) {
   if (session.d &&
       session.d->pool) {
     destroy_pool(session.d->pool);
   }
 
+  pr_data_close_persistent();
+
   /* Clear any leftover state from previous transfers. */
   have_dangling_cr = FALSE;
 
@@ -598,7 +1030,7 @@ void pr_data_init(char *filename, int direction) {
 }
 
 int pr_data_open(char *filename, char *reason, int direction, off_t size) {
-  int res = 0;
+  int res = 0, reused = FALSE;
 
   /* Make sure that any abort flags have been cleared. */
   session.sf_flags &= ~(SF_ABORT|SF_POST_ABORT);
@@ -613,8 +1045,15 @@ int pr_data_open(char *filename, char *reason, int direction, off_t size) {
   if (!reason)
     reason = filename;
 
+  /* Block mode transfers on the data connection kept open from the last
+   * transfer...
+   */
+  if (persistent_conn != NULL) {
+    res = data_persistent_open(reason, size);
+    reused = TRUE;
+
   /* Passive data transfers... */
-  if (session.sf_flags & SF_PASSIVE ||
+  } else if (session.sf_flags & SF_PASSIVE ||
       session.sf_flags & SF_EPSV_ALL) {
     if (session.d == NULL) {
       pr_log_pri(PR_LOG_ERR, "Internal error: PASV mode set, but no data "
@@ -638,7 +1077,11 @@ int pr_data_open(char *filename, char *reason, int direction, off_t size) {
   if (res >= 0) {
     struct sigaction act;
 
-    if (pr_netio_postopen(session.d->instrm) < 0) {
+    /* A reused connection has already been through the NetIO postopen
+     * callbacks (e.g. the TLS handshake).
+     */
+    if (!reused &&
+        pr_netio_postopen(session.d->instrm) < 0) {
       pr_response_add_err(R_425, _("Unable to build data connection: %s"),
         strerror(session.d->xerrno));
       destroy_pool(session.d->pool);
@@ -647,7 +1090,8 @@ int pr_data_open(char *filename, char *reason, int direction, off_t size) {
       return -1;
     }
 
-    if (pr_netio_postopen(session.d->outstrm) < 0) {
+    if (!reused &&
+        pr_netio_postopen(session.d->outstrm) < 0) {
       pr_response_add_err(R_425, _("Unable to build data connection: %s"),
         strerror(session.d->xerrno));
       destroy_pool(session.d->pool);
@@ -665,6 +1109,22 @@ int pr_data_open(char *filename, char *reason, int direction, off_t size) {
     else
       nstrm = session.d->outstrm;
 
+    /* Let any NetIO filters (e.g. for MODE B, MODE Z) set up for the
+     * transfer.
+     */
+    if (pr_netio_start(nstrm) < 0) {
+      int xerrno = errno;
+
+      pr_response_add_err(R_425, _("Unable to build data connection: %s"),
+        strerror(xerrno));
+      nstrm = NULL;
+      destroy_pool(session.d->pool);
+      session.d = NULL;
+
+      errno = xerrno;
+      return -1;
+    }
+
     session.sf_flags |= SF_XFER;
 
     if (timeout_noxfer)
@@ -709,10 +1169,28 @@ int pr_data_open(char *filename, char *reason, int direction, off_t size) {
 
 /* close == successful transfer */
 void pr_data_close(int quiet) {
+  pr_netio_stream_t *xfer_strm = nstrm;
+
   nstrm = NULL;
 
   if (session.d) {
-    pr_inet_lingering_close(session.pool, session.d, timeout_linger);
+    int res;
+
+    /* Let any NetIO filters write out, or check, the end of the transfer;
+     * in block mode, the data connection can then be kept open.
+     */
+    res = pr_netio_finish(xfer_strm);
+
+    if (data_mode == PR_DATA_MODE_BLOCK &&
+        res == 0) {
+      pr_trace_msg(trace_channel, 9,
+        "keeping data connection open for next block mode transfer");
+      persistent_conn = session.d;
+
+    } else {
+      pr_inet_lingering_close(session.pool, session.d, timeout_linger);
+    }
+
     session.d = NULL;
   }
 
@@ -732,7 +1210,15 @@ void pr_data_close(int quiet) {
   pr_session_set_idle();
 
   if (!quiet) {
-    pr_response_add(R_226, _("Transfer complete"));
+    /* RFC 959 uses 250 when the data connection is left open, and 226 when
+     * it is closed.
+     */
+    if (persistent_conn != NULL) {
+      pr_response_add(R_250, _("Transfer complete"));
+
+    } else {
+      pr_response_add(R_226, _("Transfer complete"));
+    }
   }
 }
 
@@ -976,7 +1462,10 @@ int pr_data_xfer(char *cl_buf, size_t cl_size) {
   /* Poll the control channel for any commands we should handle, like
    * QUIT or ABOR.
    */
-  pr_trace_msg(trace_channel, 4, "polling for commands on control channel");
+  if (pr_trace_chan_enabled(&trace_chan, 4)) {
+    pr_trace_msg(trace_channel, 4, "polling for commands on control channel");
+  }
+
   pr_netio_set_poll_interval(session.c->instrm, 0);
   res = pr_netio_poll(session.c->instrm);
   pr_netio_reset_poll_interval(session.c->instrm);
@@ -195,6 +195,13 @@ int pr_event_register(module *m, const char *event,
   curr_evl = NULL;
   curr_evh = NULL;
 
+  /* Listeners for log events see trace messages which would otherwise not
+   * be logged.
+   */
+  if (strncmp(event, "core.log.", 9) == 0) {
+    pr_trace_invalidate();
+  }
+
   return 0;
 }
 
@@ -264,6 +271,12 @@ int pr_event_unregister(module *m, const char *event,
   curr_evl = NULL;
   curr_evh = NULL;
 
+  if (unregistered &&
+      (event == NULL ||
+       strncmp(event, "core.log.", 9) == 0)) {
+    pr_trace_invalidate();
+  }
+
   if (!unregistered) {
     errno = ENOENT;
     return -1;
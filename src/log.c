@@ -269,6 +269,8 @@ int pr_log_openfile(const char *log_file, int *log_fd, mode_t log_mode) {
   fd_set_block(*log_fd);
 #endif /* PR_USE_NONBLOCKING_LOG_OPEN */
 
+  (void) pr_logship_open(*log_fd, log_file);
+
   destroy_pool(tmp_pool);
   return 0;
 }
@@ -324,7 +326,7 @@ int pr_log_vwritefile(int logfd, const char *ident, const char *fmt,
 
   pr_log_event_generate(PR_LOG_TYPE_UNSPEC, logfd, -1, buf, buflen);
 
-  while (write(logfd, buf, buflen) < 0) {
+  while (pr_logship_write(logfd, buf, buflen) < 0) {
     if (errno == EINTR) {
       pr_signals_handle();
       continue;
@@ -565,7 +567,7 @@ static void log_write(int priority, int f, char *s, int discard) {
       return;
     }
 
-    while (write(systemlog_fd, buf, buflen) < 0) {
+    while (pr_logship_write(systemlog_fd, buf, buflen) < 0) {
       if (errno == EINTR) {
         pr_signals_handle();
         continue;
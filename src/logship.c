@@ -0,0 +1,918 @@
+/*
+ * ProFTPD - FTP server daemon
+ * Copyright (c) 2015 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project team and other respective
+ * copyright holders give permission to link this program with OpenSSL, and
+ * distribute the resulting executable, without including the source code for
+ * OpenSSL in the source distribution.
+ */
+
+/* Log shipping */
+
+#include "conf.h"
+#include "privs.h"
+
+#ifdef PR_USE_LOGSHIP
+
+#include <sys/mman.h>
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+# define MAP_ANONYMOUS	MAP_ANON
+#endif
+
+/* Each record in a ring buffer starts with an 8-byte header: the length of
+ * the record's data, and a flag which is set once the data has been written
+ * in full.  Records are padded to a multiple of 8 bytes, so that headers
+ * never wrap around the end of the ring buffer.
+ */
+#define LOGSHIP_REC_HDRSZ		8
+#define LOGSHIP_REC_SIZE(len)		\
+  (LOGSHIP_REC_HDRSZ + (((len) + 7) & ~((size_t) 7)))
+
+#define LOGSHIP_MIN_RINGSZ		4096
+#define LOGSHIP_MAX_RINGSZ		(64 * 1024 * 1024)
+
+/* How long the shipper waits for an unfinished record, before deciding
+ * that the process writing it has died.
+ */
+#define LOGSHIP_STALL_TIMEOUT		3
+
+/* How often the shipper checks whether its log files have been rotated. */
+#define LOGSHIP_REOPEN_INTERVAL		5
+
+/* How long the shipper sleeps, in millisecs, when there is nothing to
+ * ship; the sleep doubles, up to the maximum, while it stays idle.
+ */
+#define LOGSHIP_MIN_SLEEP_MS		1
+#define LOGSHIP_MAX_SLEEP_MS		100
+
+#define LOGSHIP_WRITE_BUFSZ		(64 * 1024)
+
+#ifdef O_NOFOLLOW
+# define LOGSHIP_OPEN_FLAGS	(O_WRONLY|O_APPEND|O_NOCTTY|O_NONBLOCK|O_NOFOLLOW)
+#else
+# define LOGSHIP_OPEN_FLAGS	(O_WRONLY|O_APPEND|O_NOCTTY|O_NONBLOCK)
+#endif /* O_NOFOLLOW */
+
+/* Only fds below this can be shipped. */
+#define LOGSHIP_MAX_FDS			1024
+
+struct logship_header {
+  volatile int enabled;
+  volatile int overflow;
+  unsigned int nlogs;
+  size_t ringsz;
+};
+
+struct logship_log {
+  /* Bytes reserved by writers, and bytes consumed by the shipper, since the
+   * ring buffer was created; the difference is the backlog.
+   */
+  volatile unsigned long reserved;
+  volatile unsigned long consumed;
+
+  volatile unsigned long max_backlog;
+  volatile unsigned long nrecords;
+  volatile unsigned long nbytes;
+  volatile unsigned long nwrites;
+  volatile unsigned long nfull;
+  volatile unsigned long ndropped;
+  volatile unsigned long nerrors;
+
+  char path[PR_TUNABLE_PATH_MAX+1];
+};
+
+/* The log shipper's state for a log file. */
+struct logship_file {
+  int fd;
+  dev_t dev;
+  ino_t ino;
+  time_t checked;
+  time_t stalled;
+  int open_errno;
+
+  unsigned long nrecs;
+  size_t buflen;
+  char buf[LOGSHIP_WRITE_BUFSZ];
+};
+
+static struct logship_header *logship_hdr = NULL;
+static struct logship_log *logship_logs = NULL;
+static char *logship_rings = NULL;
+
+/* Our own copies of the log paths.  The shared memory can be written to by
+ * any session process, so the shipper only ever opens the paths which the
+ * daemon added, not the paths in the shared memory.
+ */
+static char *logship_paths[PR_LOGSHIP_MAX_LOGS];
+
+/* Maps fds to ring buffer indices, plus one (so that zero means "not
+ * shipped").
+ */
+static unsigned char logship_fds[LOGSHIP_MAX_FDS];
+
+static pid_t logship_pid = 0;
+static int logship_stopping = FALSE;
+static volatile int logship_terminated = FALSE;
+
+/* Ring buffer helpers; offsets are taken modulo the (power of two) ring
+ * buffer size.
+ */
+static void ring_copy_in(char *ring, size_t ringsz, unsigned long off,
+    const char *buf, size_t len) {
+  size_t n;
+
+  off &= (ringsz - 1);
+  n = ringsz - off;
+  if (n > len) {
+    n = len;
+  }
+
+  memcpy(ring + off, buf, n);
+  if (n < len) {
+    memcpy(ring, buf + n, len - n);
+  }
+}
+
+static void ring_copy_out(char *ring, size_t ringsz, unsigned long off,
+    char *buf, size_t len) {
+  size_t n;
+
+  off &= (ringsz - 1);
+  n = ringsz - off;
+  if (n > len) {
+    n = len;
+  }
+
+  memcpy(buf, ring + off, n);
+  if (n < len) {
+    memcpy(buf + n, ring, len - n);
+  }
+}
+
+static void ring_zero(char *ring, size_t ringsz, unsigned long off,
+    size_t len) {
+  size_t n;
+
+  off &= (ringsz - 1);
+  n = ringsz - off;
+  if (n > len) {
+    n = len;
+  }
+
+  memset(ring + off, '\0', n);
+  if (n < len) {
+    memset(ring, '\0', len - n);
+  }
+}
+
+/* Appends a record to the ring buffer; returns -1 if it is full. */
+static int logship_put(unsigned int idx, const char *buf, size_t buflen) {
+  struct logship_log *log;
+  char *ring;
+  size_t ringsz, recsz;
+  unsigned long consumed, reserved;
+  volatile uint32_t *hdr;
+
+  ringsz = logship_hdr->ringsz;
+  recsz = LOGSHIP_REC_SIZE(buflen);
+
+  /* Very large records would hog the ring buffer, and the shipper cannot
+   * buffer records larger than its write buffer.
+   */
+  if (recsz > ringsz / 4 ||
+      recsz > LOGSHIP_WRITE_BUFSZ) {
+    return -1;
+  }
+
+  log = &(logship_logs[idx]);
+  ring = logship_rings + (idx * ringsz);
+
+  /* Reserve space for the record.  The consumed count is read first, so
+   * that it can never be ahead of the reserved count we read.
+   */
+  do {
+    consumed = log->consumed;
+    __sync_synchronize();
+    reserved = log->reserved;
+
+    if (reserved - consumed + recsz > ringsz) {
+      return -1;
+    }
+
+  } while (!__sync_bool_compare_and_swap(&(log->reserved), reserved,
+    reserved + recsz));
+
+  hdr = (volatile uint32_t *) (ring + (reserved & (ringsz - 1)));
+  hdr[0] = (uint32_t) buflen;
+  ring_copy_in(ring, ringsz, reserved + LOGSHIP_REC_HDRSZ, buf, buflen);
+
+  /* Make sure the data is visible before the record is marked as done. */
+  __sync_synchronize();
+  hdr[1] = 1;
+
+  return 0;
+}
+
+/* Log shipper process functions */
+
+static void logship_signal_cb(int signo) {
+  logship_terminated = TRUE;
+}
+
+static void logship_close_file(struct logship_file *lf) {
+  if (lf->fd >= 0) {
+    (void) close(lf->fd);
+    lf->fd = -1;
+  }
+}
+
+static void logship_open_file(unsigned int idx, struct logship_file *lf) {
+  struct stat st;
+  int fd, xerrno;
+
+  /* Only existing log files are opened; creating them, with the right
+   * permissions, is left to the processes logging to them.
+   */
+  PRIVS_ROOT
+  fd = open(logship_paths[idx], LOGSHIP_OPEN_FLAGS);
+  xerrno = errno;
+  PRIVS_RELINQUISH
+
+  if (fd < 0) {
+    if (lf->open_errno != xerrno) {
+      pr_log_pri(PR_LOG_NOTICE, "log shipper: unable to open '%s': %s",
+        logship_paths[idx], strerror(xerrno));
+      lf->open_errno = xerrno;
+    }
+
+    return;
+  }
+
+  /* Never follow symlinks, or block on FIFOs, which might have been put in
+   * place of the log file.
+   */
+  if (fstat(fd, &st) < 0 ||
+      !S_ISREG(st.st_mode)) {
+    (void) close(fd);
+
+    if (lf->open_errno != EINVAL) {
+      pr_log_pri(PR_LOG_NOTICE, "log shipper: '%s' is not a regular file",
+        logship_paths[idx]);
+      lf->open_errno = EINVAL;
+    }
+
+    return;
+  }
+
+  (void) fcntl(fd, F_SETFD, FD_CLOEXEC);
+  (void) fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+
+  lf->fd = fd;
+  lf->checked = time(NULL);
+  lf->dev = st.st_dev;
+  lf->ino = st.st_ino;
+  lf->open_errno = 0;
+}
+
+/* Reopens the log file if it has been rotated, i.e. its path now refers
+ * to a different file.
+ */
+static void logship_check_file(unsigned int idx, struct logship_file *lf,
+    time_t now) {
+  struct stat st;
+  int res;
+
+  if (lf->fd < 0 ||
+      now - lf->checked < LOGSHIP_REOPEN_INTERVAL) {
+    return;
+  }
+
+  lf->checked = now;
+
+  PRIVS_ROOT
+  res = stat(logship_paths[idx], &st);
+  PRIVS_RELINQUISH
+
+  /* If the log file has been moved aside, but not yet replaced, keep on
+   * writing to it.
+   */
+  if (res < 0 ||
+      (st.st_dev == lf->dev && st.st_ino == lf->ino)) {
+    return;
+  }
+
+  logship_close_file(lf);
+  logship_open_file(idx, lf);
+}
+
+static void logship_flush_file(struct logship_log *log,
+    struct logship_file *lf) {
+  size_t off = 0;
+
+  if (lf->buflen == 0) {
+    return;
+  }
+
+  if (lf->fd >= 0) {
+    while (off < lf->buflen) {
+      int res;
+
+      res = write(lf->fd, lf->buf + off, lf->buflen - off);
+      if (res < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+
+        break;
+      }
+
+      log->nwrites++;
+      off += res;
+    }
+  }
+
+  if (off == lf->buflen) {
+    log->nrecords += lf->nrecs;
+    log->nbytes += lf->buflen;
+
+  } else {
+    log->nerrors += lf->nrecs;
+  }
+
+  lf->nrecs = 0;
+  lf->buflen = 0;
+}
+
+/* Ships the finished records in a ring buffer; returns the number of bytes
+ * consumed.
+ */
+static size_t logship_ship(unsigned int idx, struct logship_file *lf,
+    time_t now) {
+  struct logship_log *log;
+  char *ring;
+  size_t ringsz, total = 0;
+  unsigned long consumed, reserved;
+
+  ringsz = logship_hdr->ringsz;
+  log = &(logship_logs[idx]);
+  ring = logship_rings + (idx * ringsz);
+
+  consumed = log->consumed;
+  reserved = log->reserved;
+
+  if (consumed == reserved) {
+    return 0;
+  }
+
+  if (reserved - consumed > log->max_backlog) {
+    log->max_backlog = reserved - consumed;
+  }
+
+  /* The log file is opened once there is something to write to it.  If it
+   * cannot be opened, the records are left in the ring buffer; once it is
+   * full, writers fall back to the overflow policy.
+   */
+  if (lf->fd < 0) {
+    logship_open_file(idx, lf);
+
+    if (lf->fd < 0) {
+      return 0;
+    }
+  }
+
+  while (consumed != reserved) {
+    volatile uint32_t *hdr;
+    size_t len, recsz;
+
+    hdr = (volatile uint32_t *) (ring + (consumed & (ringsz - 1)));
+
+    if (hdr[1] == 0) {
+      /* The record is still being written, or the process writing it has
+       * died.
+       */
+      if (lf->stalled == 0) {
+        lf->stalled = now;
+        break;
+      }
+
+      if (now - lf->stalled < LOGSHIP_STALL_TIMEOUT) {
+        break;
+      }
+
+      /* Skip the record if we know its length; otherwise, we have no
+       * choice but to skip everything reserved so far.
+       */
+      recsz = LOGSHIP_REC_SIZE(hdr[0]);
+      if (hdr[0] == 0 ||
+          recsz > reserved - consumed) {
+        recsz = reserved - consumed;
+      }
+
+      ring_zero(ring, ringsz, consumed, recsz);
+      __sync_synchronize();
+      consumed += recsz;
+      log->consumed = consumed;
+
+      log->nerrors++;
+      lf->stalled = 0;
+      total += recsz;
+      continue;
+    }
+
+    lf->stalled = 0;
+    __sync_synchronize();
+
+    /* Any session can write to the shared memory, so the record length
+     * cannot be trusted.  Skip records which overrun the reserved space,
+     * or which would not fit in our write buffer, as for stalled records.
+     */
+    len = hdr[0];
+    recsz = LOGSHIP_REC_SIZE(len);
+
+    if (recsz > reserved - consumed ||
+        len > sizeof(lf->buf)) {
+      if (recsz > reserved - consumed) {
+        recsz = reserved - consumed;
+      }
+
+      ring_zero(ring, ringsz, consumed, recsz);
+      __sync_synchronize();
+      consumed += recsz;
+      log->consumed = consumed;
+
+      log->nerrors++;
+      total += recsz;
+      continue;
+    }
+
+    if (lf->buflen + len > sizeof(lf->buf)) {
+      logship_flush_file(log, lf);
+    }
+
+    ring_copy_out(ring, ringsz, consumed + LOGSHIP_REC_HDRSZ,
+      lf->buf + lf->buflen, len);
+    lf->buflen += len;
+    lf->nrecs++;
+
+    /* Clear the record, so that its space can be reused. */
+    ring_zero(ring, ringsz, consumed, recsz);
+    __sync_synchronize();
+    consumed += recsz;
+    log->consumed = consumed;
+
+    total += recsz;
+
+    if (consumed == reserved) {
+      reserved = log->reserved;
+    }
+  }
+
+  logship_flush_file(log, lf);
+  return total;
+}
+
+static size_t logship_ship_all(struct logship_file **files, time_t now) {
+  register unsigned int i;
+  size_t total = 0;
+
+  for (i = 0; i < logship_hdr->nlogs; i++) {
+    if (files[i] == NULL) {
+      files[i] = pcalloc(permanent_pool, sizeof(struct logship_file));
+      files[i]->fd = -1;
+    }
+
+    logship_check_file(i, files[i], now);
+    total += logship_ship(i, files[i], now);
+  }
+
+  return total;
+}
+
+static void logship_loop(void) {
+  register unsigned int i;
+  struct logship_file *files[PR_LOGSHIP_MAX_LOGS];
+  unsigned long sleep_ms = LOGSHIP_MIN_SLEEP_MS;
+  pid_t ppid;
+  time_t now, start_time;
+
+  memset(files, 0, sizeof(files));
+  ppid = getppid();
+
+  while (!logship_terminated) {
+    now = time(NULL);
+
+    if (logship_ship_all(files, now) > 0) {
+      sleep_ms = LOGSHIP_MIN_SLEEP_MS;
+
+    } else {
+      /* Don't outlive the daemon process. */
+      if (getppid() != ppid) {
+        break;
+      }
+
+      if (sleep_ms < LOGSHIP_MAX_SLEEP_MS) {
+        sleep_ms *= 2;
+      }
+    }
+
+    pr_timer_usleep(sleep_ms * 1000);
+  }
+
+  /* Shipping has been disabled; ship whatever is left, allowing for
+   * processes which are still finishing their records.
+   */
+  start_time = time(NULL);
+  while (TRUE) {
+    int empty = TRUE;
+
+    now = time(NULL);
+    (void) logship_ship_all(files, now);
+
+    for (i = 0; i < logship_hdr->nlogs; i++) {
+      if (logship_logs[i].reserved != logship_logs[i].consumed) {
+        empty = FALSE;
+        break;
+      }
+    }
+
+    if (empty ||
+        now - start_time > LOGSHIP_STALL_TIMEOUT) {
+      break;
+    }
+
+    pr_timer_usleep(10 * 1000);
+  }
+
+  for (i = 0; i < logship_hdr->nlogs; i++) {
+    if (files[i] != NULL) {
+      logship_close_file(files[i]);
+    }
+  }
+}
+
+/* Daemon process functions */
+
+int pr_logship_create(size_t ringsz) {
+  size_t sz, hdrsz;
+  void *shm;
+
+  sz = LOGSHIP_MIN_RINGSZ;
+  while (sz < ringsz &&
+         sz < LOGSHIP_MAX_RINGSZ) {
+    sz <<= 1;
+  }
+
+  if (logship_hdr != NULL) {
+    if (logship_hdr->ringsz != sz) {
+      errno = EEXIST;
+      return -1;
+    }
+
+    return 0;
+  }
+
+  /* The header and log structures are rounded up to a page boundary, so
+   * that the ring buffers are aligned.
+   */
+  hdrsz = sizeof(struct logship_header) +
+    (sizeof(struct logship_log) * PR_LOGSHIP_MAX_LOGS);
+  hdrsz = (hdrsz + 4095) & ~((size_t) 4095);
+
+  shm = mmap(NULL, hdrsz + (sz * PR_LOGSHIP_MAX_LOGS), PROT_READ|PROT_WRITE,
+    MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+  if (shm == MAP_FAILED) {
+    return -1;
+  }
+
+  logship_hdr = shm;
+  logship_hdr->enabled = FALSE;
+  logship_hdr->overflow = PR_LOGSHIP_OVERFLOW_WRITE;
+  logship_hdr->nlogs = 0;
+  logship_hdr->ringsz = sz;
+
+  logship_logs = (struct logship_log *) (logship_hdr + 1);
+  logship_rings = ((char *) shm) + hdrsz;
+
+  return 0;
+}
+
+int pr_logship_add(const char *path) {
+  register unsigned int i;
+
+  if (path == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (logship_hdr == NULL) {
+    errno = EPERM;
+    return -1;
+  }
+
+  for (i = 0; i < logship_hdr->nlogs; i++) {
+    if (strcmp(logship_paths[i], path) == 0) {
+      return i;
+    }
+  }
+
+  if (logship_hdr->nlogs == PR_LOGSHIP_MAX_LOGS) {
+    errno = ENOSPC;
+    return -1;
+  }
+
+  logship_paths[i] = pstrdup(permanent_pool, path);
+  sstrncpy(logship_logs[i].path, path, sizeof(logship_logs[i].path));
+  logship_hdr->nlogs++;
+
+  return i;
+}
+
+int pr_logship_start(int overflow) {
+  pid_t pid;
+
+  if (logship_hdr == NULL) {
+    errno = EPERM;
+    return -1;
+  }
+
+  if (overflow != PR_LOGSHIP_OVERFLOW_WRITE &&
+      overflow != PR_LOGSHIP_OVERFLOW_DROP) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (logship_pid != 0) {
+    errno = EEXIST;
+    return -1;
+  }
+
+  logship_terminated = FALSE;
+
+  pid = fork();
+  switch (pid) {
+    case -1:
+      return -1;
+
+    case 0:
+      /* We're the child. */
+      break;
+
+    default:
+      /* We're the parent. */
+      logship_pid = pid;
+      logship_hdr->overflow = overflow;
+      logship_hdr->enabled = TRUE;
+      return 0;
+  }
+
+  /* Reset the cached PID, so that it is correctly reflected in the logs. */
+  session.pid = getpid();
+
+  (void) signal(SIGALRM, SIG_IGN);
+  (void) signal(SIGHUP, SIG_IGN);
+  (void) signal(SIGUSR1, SIG_IGN);
+  (void) signal(SIGUSR2, SIG_IGN);
+  (void) signal(SIGCHLD, SIG_DFL);
+  (void) signal(SIGINT, logship_signal_cb);
+  (void) signal(SIGTERM, logship_signal_cb);
+
+  pr_proctitle_set("(log shipper)");
+
+  pr_log_debug(DEBUG2, "log shipper process %lu started",
+    (unsigned long) session.pid);
+
+  logship_loop();
+  exit(0);
+}
+
+void pr_logship_stop(void) {
+  time_t start_time;
+  pid_t pid;
+
+  if (logship_hdr != NULL) {
+    logship_hdr->enabled = FALSE;
+  }
+
+  if (logship_pid == 0) {
+    return;
+  }
+
+  /* The shipper may be reaped by the daemon's SIGCHLD handling, rather
+   * than by us, while we wait for it.
+   */
+  pid = logship_pid;
+  logship_stopping = TRUE;
+
+  if (kill(pid, SIGTERM) == 0) {
+    start_time = time(NULL);
+
+    while (waitpid(pid, NULL, WNOHANG) == 0) {
+      if (time(NULL) - start_time > LOGSHIP_STALL_TIMEOUT + 2) {
+        (void) kill(pid, SIGKILL);
+        (void) waitpid(pid, NULL, 0);
+        break;
+      }
+
+      pr_timer_usleep(10 * 1000);
+    }
+  }
+
+  logship_pid = 0;
+  logship_stopping = FALSE;
+}
+
+int pr_logship_reap(pid_t pid, int status) {
+  if (logship_pid == 0 ||
+      pid != logship_pid) {
+    return FALSE;
+  }
+
+  logship_pid = 0;
+
+  if (logship_stopping) {
+    return TRUE;
+  }
+
+  /* Nothing is shipping the ring buffers any more, so have all processes
+   * write directly to the log files again.  Records still in the ring
+   * buffers are lost.
+   */
+  if (logship_hdr != NULL) {
+    logship_hdr->enabled = FALSE;
+  }
+
+  if (WIFSIGNALED(status)) {
+    pr_log_pri(PR_LOG_ERR, "LogShipper process %lu died from signal %d, "
+      "writing logs directly until restarted", (unsigned long) pid,
+      WTERMSIG(status));
+
+  } else if (WIFEXITED(status) &&
+             WEXITSTATUS(status) == 0) {
+    /* The shipper only exits cleanly when told to, e.g. when the whole
+     * process group is being terminated.
+     */
+    pr_log_pri(PR_LOG_NOTICE, "LogShipper process %lu exited, writing logs "
+      "directly until restarted", (unsigned long) pid);
+
+  } else {
+    pr_log_pri(PR_LOG_ERR, "LogShipper process %lu exited (status %d), "
+      "writing logs directly until restarted", (unsigned long) pid,
+      WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+  }
+
+  return TRUE;
+}
+
+pid_t pr_logship_get_pid(void) {
+  return logship_pid;
+}
+
+const char *pr_logship_get_stats(unsigned int idx,
+    struct pr_logship_stats *stats) {
+  struct logship_log *log;
+
+  if (logship_hdr == NULL ||
+      idx >= logship_hdr->nlogs) {
+    errno = ENOENT;
+    return NULL;
+  }
+
+  log = &(logship_logs[idx]);
+
+  if (stats != NULL) {
+    unsigned long consumed;
+
+    consumed = log->consumed;
+    __sync_synchronize();
+    stats->backlog = log->reserved - consumed;
+    stats->max_backlog = log->max_backlog;
+    stats->nrecords = log->nrecords;
+    stats->nbytes = log->nbytes;
+    stats->nwrites = log->nwrites;
+    stats->nfull = log->nfull;
+    stats->ndropped = log->ndropped;
+    stats->nerrors = log->nerrors;
+  }
+
+  return logship_paths[idx];
+}
+
+/* Writer functions, used by all processes */
+
+int pr_logship_open(int fd, const char *path) {
+  register unsigned int i;
+  struct stat st;
+
+  if (fd < 0 ||
+      fd >= LOGSHIP_MAX_FDS) {
+    return 0;
+  }
+
+  logship_fds[fd] = 0;
+
+  if (logship_hdr == NULL ||
+      path == NULL) {
+    return 0;
+  }
+
+  /* Only regular files are shipped; FIFOs, devices et al are written to
+   * directly.
+   */
+  if (fstat(fd, &st) < 0 ||
+      !S_ISREG(st.st_mode)) {
+    return 0;
+  }
+
+  for (i = 0; i < logship_hdr->nlogs; i++) {
+    if (strcmp(logship_paths[i], path) == 0) {
+      logship_fds[fd] = i + 1;
+      break;
+    }
+  }
+
+  return 0;
+}
+
+int pr_logship_write(int fd, const char *buf, size_t buflen) {
+  if (fd >= 0 &&
+      fd < LOGSHIP_MAX_FDS &&
+      logship_fds[fd] != 0 &&
+      buflen > 0 &&
+      logship_hdr->enabled) {
+    unsigned int idx;
+
+    idx = logship_fds[fd] - 1;
+    if (logship_put(idx, buf, buflen) == 0) {
+      return buflen;
+    }
+
+    __sync_fetch_and_add(&(logship_logs[idx].nfull), 1);
+
+    if (logship_hdr->overflow == PR_LOGSHIP_OVERFLOW_DROP) {
+      __sync_fetch_and_add(&(logship_logs[idx].ndropped), 1);
+      return buflen;
+    }
+  }
+
+  return write(fd, buf, buflen);
+}
+
+#else
+
+int pr_logship_create(size_t ringsz) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int pr_logship_add(const char *path) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int pr_logship_start(int overflow) {
+  errno = ENOSYS;
+  return -1;
+}
+
+void pr_logship_stop(void) {
+}
+
+int pr_logship_open(int fd, const char *path) {
+  return 0;
+}
+
+int pr_logship_write(int fd, const char *buf, size_t buflen) {
+  return write(fd, buf, buflen);
+}
+
+int pr_logship_reap(pid_t pid, int status) {
+  return FALSE;
+}
+
+pid_t pr_logship_get_pid(void) {
+  return 0;
+}
+
+const char *pr_logship_get_stats(unsigned int idx,
+    struct pr_logship_stats *stats) {
+  errno = ENOSYS;
+  return NULL;
+}
+
+#endif /* PR_USE_LOGSHIP */
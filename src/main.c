@@ -1995,6 +1995,7 @@ static RETSIGTYPE sig_terminate(int signo) {
 static void handle_chld(void) {
   sigset_t sig_set;
   pid_t pid;
+  int status;
 
   sigemptyset(&sig_set);
   sigaddset(&sig_set, SIGTERM);
@@ -2010,9 +2011,14 @@ static void handle_chld(void) {
       "unable to block signal set: %s", strerror(errno));
   }
 
-  while ((pid = waitpid(-1, NULL, WNOHANG)) > 0) {
-    if (child_remove(pid) == 0)
+  while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+    if (child_remove(pid) == 0) {
       have_dead_child = TRUE;
+
+    } else {
+      /* Not a session process; it may be the LogShipper. */
+      (void) pr_logship_reap(pid, status);
+    }
   }
 
   if (sigprocmask(SIG_UNBLOCK, &sig_set, NULL) < 0) {
@@ -67,6 +67,11 @@ static pr_netio_t *default_ctrl_netio = NULL, *ctrl_netio = NULL;
 static pr_netio_t *default_data_netio = NULL, *data_netio = NULL;
 static pr_netio_t *default_othr_netio = NULL, *othr_netio = NULL;
 
+/* The top of the filter stack for each stream type. */
+static pr_netio_filter_t *ctrl_filters = NULL;
+static pr_netio_filter_t *data_filters = NULL;
+static pr_netio_filter_t *othr_filters = NULL;
+
 /* Used to track whether the previous text read from the client's control
  * connection was a properly-terminated command.  If so, then read in the
  * next/current text as per normal.  If NOT (e.g. the client sent a too-long
@@ -241,6 +246,22 @@ static int core_netio_write_cb(pr_netio_stream_t *nstrm, char *buf,
 /* NetIO API wrapper functions.
  */
 
+static pr_netio_filter_t **netio_filters(int strm_type) {
+  switch (strm_type) {
+    case PR_NETIO_STRM_CTRL:
+      return &ctrl_filters;
+
+    case PR_NETIO_STRM_DATA:
+      return &data_filters;
+
+    case PR_NETIO_STRM_OTHR:
+      return &othr_filters;
+  }
+
+  errno = EINVAL;
+  return NULL;
+}
+
 void pr_netio_abort(pr_netio_stream_t *nstrm) {
 
   if (nstrm == NULL) {
@@ -733,10 +754,48 @@ int pr_netio_printf_async(pr_netio_stream_t *nstrm, char *fmt, ...) {
   return pr_netio_write_async(nstrm, buf, strlen(buf));
 }
 
+static int netio_write(pr_netio_stream_t *, char *, size_t);
+
+/* Writes all of the given data through the given filter, and the layers
+ * beneath it.
+ */
+static int netio_filter_write(pr_netio_filter_t *filter,
+    pr_netio_stream_t *nstrm, char *buf, size_t buflen) {
+  int total = 0;
+
+  while (buflen > 0) {
+    int bwritten;
+
+    pr_signals_handle();
+
+    bwritten = (filter->write)(filter, nstrm, buf, buflen);
+    if (bwritten < 0) {
+      if (bwritten == -1 &&
+          (errno == EINTR || errno == EAGAIN)) {
+        errno = EINTR;
+        pr_signals_handle();
+        continue;
+      }
+
+      if (bwritten == -1) {
+        nstrm->strm_errno = errno;
+      }
+
+      return bwritten;
+    }
+
+    buf += bwritten;
+    total += bwritten;
+    buflen -= bwritten;
+  }
+
+  return total;
+}
+
 int pr_netio_write(pr_netio_stream_t *nstrm, char *buf, size_t buflen) {
-  int bwritten = 0, total = 0;
   pr_buffer_t *pbuf;
   pool *sub_pool;
+  pr_netio_filter_t **filters;
 
   /* Sanity check */
   if (!nstrm) {
@@ -786,6 +845,21 @@ int pr_netio_write(pr_netio_stream_t *nstrm, char *buf, size_t buflen) {
   buflen = pbuf->buflen - pbuf->remaining;
   destroy_pool(sub_pool);
 
+  filters = netio_filters(nstrm->strm_type);
+  if (filters != NULL &&
+      *filters != NULL) {
+    return netio_filter_write(*filters, nstrm, buf, buflen);
+  }
+
+  return netio_write(nstrm, buf, buflen);
+}
+
+/* Writes the given data using the registered NetIO, i.e. beneath any
+ * filters.
+ */
+static int netio_write(pr_netio_stream_t *nstrm, char *buf, size_t buflen) {
+  int bwritten = 0, total = 0;
+
   while (buflen) {
 
     switch (pr_netio_poll(nstrm)) {
@@ -825,6 +899,20 @@ int pr_netio_write(pr_netio_stream_t *nstrm, char *buf, size_t buflen) {
         break;
     }
 
+#ifdef EAGAIN
+    if (bwritten == -1 &&
+        errno == EAGAIN) {
+      /* Retry the remainder here, as with reads, rather than returning
+       * EAGAIN to a caller which cannot tell how much was already written.
+       */
+      errno = EINTR;
+      pr_signals_handle();
+
+      bwritten = 0;
+      continue;
+    }
+#endif
+
     if (bwritten == -1) {
       nstrm->strm_errno = errno;
       return -1;
@@ -941,21 +1029,62 @@ int pr_netio_write_async(pr_netio_stream_t *nstrm, char *buf, size_t buflen) {
   return total;
 }
 
-int pr_netio_read(pr_netio_stream_t *nstrm, char *buf, size_t buflen,
-    int bufmin) {
-  int bread = 0, total = 0;
+/* Reads from the given stream through the given filter, and the layers
+ * beneath it, until at least bufmin bytes have been read, or EOF.
+ */
+static int netio_filter_read(pr_netio_filter_t *filter,
+    pr_netio_stream_t *nstrm, char *buf, size_t buflen, int bufmin) {
+  int total = 0;
 
-  /* Sanity check. */
-  if (!nstrm) {
-    errno = EINVAL;
-    return -1;
-  }
+  if (bufmin < 1)
+    bufmin = 1;
 
-  if (nstrm->strm_fd == -1) {
-    errno = (nstrm->strm_errno ? nstrm->strm_errno : EBADF);
-    return -1;
+  if (bufmin > buflen)
+    bufmin = buflen;
+
+  while (bufmin > 0) {
+    int bread;
+
+    pr_signals_handle();
+
+    bread = (filter->read)(filter, nstrm, buf, buflen);
+    if (bread < 0) {
+      if (bread == -1 &&
+          (errno == EINTR || errno == EAGAIN)) {
+        errno = EINTR;
+        pr_signals_handle();
+        continue;
+      }
+
+      if (bread == -1) {
+        nstrm->strm_errno = errno;
+      }
+
+      return bread;
+    }
+
+    /* EOF? */
+    if (bread == 0) {
+      nstrm->strm_errno = 0;
+      break;
+    }
+
+    buf += bread;
+    total += bread;
+    bufmin -= bread;
+    buflen -= bread;
   }
 
+  return total;
+}
+
+/* Reads from the given stream using the registered NetIO, i.e. beneath any
+ * filters.
+ */
+static int netio_read(pr_netio_stream_t *nstrm, char *buf, size_t buflen,
+    int bufmin) {
+  int bread = 0, total = 0;
+
   if (bufmin < 1)
     bufmin = 1;
 
@@ -1050,6 +1179,120 @@ int pr_netio_read(pr_netio_stream_t *nstrm, char *buf, size_t buflen,
   return total;
 }
 
+int pr_netio_read(pr_netio_stream_t *nstrm, char *buf, size_t buflen,
+    int bufmin) {
+  pr_netio_filter_t **filters;
+
+  /* Sanity check. */
+  if (!nstrm) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (nstrm->strm_fd == -1) {
+    errno = (nstrm->strm_errno ? nstrm->strm_errno : EBADF);
+    return -1;
+  }
+
+  filters = netio_filters(nstrm->strm_type);
+  if (filters != NULL &&
+      *filters != NULL) {
+    return netio_filter_read(*filters, nstrm, buf, buflen, bufmin);
+  }
+
+  return netio_read(nstrm, buf, buflen, bufmin);
+}
+
+int pr_netio_filter_read(pr_netio_filter_t *filter, pr_netio_stream_t *nstrm,
+    char *buf, size_t buflen, int bufmin) {
+
+  if (filter == NULL ||
+      nstrm == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (nstrm->strm_fd == -1) {
+    errno = (nstrm->strm_errno ? nstrm->strm_errno : EBADF);
+    return -1;
+  }
+
+  if (filter->next != NULL) {
+    return netio_filter_read(filter->next, nstrm, buf, buflen, bufmin);
+  }
+
+  return netio_read(nstrm, buf, buflen, bufmin);
+}
+
+int pr_netio_filter_write(pr_netio_filter_t *filter, pr_netio_stream_t *nstrm,
+    char *buf, size_t buflen) {
+
+  if (filter == NULL ||
+      nstrm == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (nstrm->strm_fd == -1) {
+    errno = (nstrm->strm_errno ? nstrm->strm_errno : EBADF);
+    return -1;
+  }
+
+  if (filter->next != NULL) {
+    return netio_filter_write(filter->next, nstrm, buf, buflen);
+  }
+
+  return netio_write(nstrm, buf, buflen);
+}
+
+int pr_netio_start(pr_netio_stream_t *nstrm) {
+  pr_netio_filter_t **filters, *filter;
+
+  if (nstrm == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  filters = netio_filters(nstrm->strm_type);
+  if (filters == NULL) {
+    return -1;
+  }
+
+  for (filter = *filters; filter; filter = filter->next) {
+    if ((filter->start)(filter, nstrm) < 0) {
+      pr_trace_msg(trace_channel, 3, "error starting '%s' filter: %s",
+        filter->name, strerror(errno));
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+int pr_netio_finish(pr_netio_stream_t *nstrm) {
+  pr_netio_filter_t **filters, *filter;
+
+  if (nstrm == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  filters = netio_filters(nstrm->strm_type);
+  if (filters == NULL) {
+    return -1;
+  }
+
+  for (filter = *filters; filter; filter = filter->next) {
+    if ((filter->finish)(filter, nstrm) < 0) {
+      pr_trace_msg(trace_channel, 3, "error finishing '%s' filter: %s",
+        filter->name, strerror(errno));
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
 int pr_netio_shutdown(pr_netio_stream_t *nstrm, int how) {
   int res = -1;
 
@@ -1452,6 +1695,130 @@ pr_netio_t *pr_get_netio(int strm_type) {
   return netio;
 }
 
+int pr_push_netio_filter(pr_netio_filter_t *filter, int strm_type) {
+  pr_netio_filter_t **filters, *f;
+
+  if (filter == NULL ||
+      filter->name == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  filters = netio_filters(strm_type);
+  if (filters == NULL) {
+    return -1;
+  }
+
+  for (f = *filters; f; f = f->next) {
+    if (f == filter ||
+        strcmp(f->name, filter->name) == 0) {
+      errno = EEXIST;
+      return -1;
+    }
+  }
+
+  filter->next = *filters;
+  *filters = filter;
+
+  pr_trace_msg(trace_channel, 9, "pushed '%s' filter", filter->name);
+  return 0;
+}
+
+int pr_remove_netio_filter(int strm_type, const char *name) {
+  pr_netio_filter_t **filters, **f;
+
+  if (name == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  filters = netio_filters(strm_type);
+  if (filters == NULL) {
+    return -1;
+  }
+
+  for (f = filters; *f; f = &((*f)->next)) {
+    if (strcmp((*f)->name, name) == 0) {
+      pr_netio_filter_t *filter = *f;
+
+      *f = filter->next;
+      filter->next = NULL;
+
+      pr_trace_msg(trace_channel, 9, "removed '%s' filter", name);
+      return 0;
+    }
+  }
+
+  errno = ENOENT;
+  return -1;
+}
+
+pr_netio_filter_t *pr_get_netio_filter(int strm_type, const char *name) {
+  pr_netio_filter_t **filters, *f;
+
+  filters = netio_filters(strm_type);
+  if (filters == NULL) {
+    return NULL;
+  }
+
+  for (f = *filters; f; f = f->next) {
+    if (name == NULL ||
+        strcmp(f->name, name) == 0) {
+      return f;
+    }
+  }
+
+  errno = ENOENT;
+  return NULL;
+}
+
+static int core_netio_filter_start_cb(pr_netio_filter_t *filter,
+    pr_netio_stream_t *nstrm) {
+  return 0;
+}
+
+static int core_netio_filter_finish_cb(pr_netio_filter_t *filter,
+    pr_netio_stream_t *nstrm) {
+  return 0;
+}
+
+static int core_netio_filter_read_cb(pr_netio_filter_t *filter,
+    pr_netio_stream_t *nstrm, char *buf, size_t buflen) {
+  return pr_netio_filter_read(filter, nstrm, buf, buflen, 1);
+}
+
+static int core_netio_filter_write_cb(pr_netio_filter_t *filter,
+    pr_netio_stream_t *nstrm, char *buf, size_t buflen) {
+  return pr_netio_filter_write(filter, nstrm, buf, buflen);
+}
+
+pr_netio_filter_t *pr_alloc_netio_filter(pool *parent_pool, module *owner,
+    const char *name) {
+  pr_netio_filter_t *filter;
+  pool *filter_pool;
+
+  if (parent_pool == NULL ||
+      name == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  filter_pool = make_sub_pool(parent_pool);
+  pr_pool_tag(filter_pool, "netio filter pool");
+
+  filter = pcalloc(filter_pool, sizeof(pr_netio_filter_t));
+  filter->pool = filter_pool;
+  filter->name = pstrdup(filter_pool, name);
+  filter->owner = owner;
+
+  filter->start = core_netio_filter_start_cb;
+  filter->finish = core_netio_filter_finish_cb;
+  filter->read = core_netio_filter_read_cb;
+  filter->write = core_netio_filter_write_cb;
+
+  return filter;
+}
+
 extern pid_t mpid;
 
 pr_netio_t *pr_alloc_netio2(pool *parent_pool, module *owner) {
@@ -30,6 +30,15 @@
 #include "conf.h"
 #include "privs.h"
 
+unsigned int pr_trace_gen = 1;
+
+void pr_trace_invalidate(void) {
+  pr_trace_gen++;
+  if (pr_trace_gen == 0) {
+    pr_trace_gen = 1;
+  }
+}
+
 #ifdef PR_USE_TRACE
 
 static int trace_logfd = -1;
@@ -76,6 +85,7 @@ static const char *trace_channels[] = {
 
 static void trace_restart_ev(const void *event_data, void *user_data) {
   trace_opts = PR_TRACE_OPT_DEFAULT;
+  pr_trace_invalidate();
 
   close(trace_logfd);
   trace_logfd = -1;
@@ -323,6 +333,8 @@ int pr_trace_parse_levels(char *str, int *min_level, int *max_level) {
 int pr_trace_set_file(const char *path) {
   int res;
 
+  pr_trace_invalidate();
+
   if (!path) {
     if (trace_logfd < 0) {
       errno = EINVAL;
@@ -364,6 +376,8 @@ int pr_trace_set_file(const char *path) {
 
 int pr_trace_set_levels(const char *channel, int min_level, int max_level) {
 
+  pr_trace_invalidate();
+
   if (channel == NULL) {
     void *v;
 
@@ -464,11 +478,39 @@ int pr_trace_use_stderr(int use_stderr) {
     /* Avoid a file descriptor leak by closing any existing fd. */
     (void) close(trace_logfd);
     trace_logfd = res;
+    pr_trace_invalidate();
   }
 
   return 0;
 }
 
+int pr_trace_chan_refresh(pr_trace_chan_t *chan, int level) {
+  struct trace_levels *levels;
+
+  /* By default, no levels are logged. */
+  chan->min_level = 1;
+  chan->max_level = 0;
+
+  if (trace_tab != NULL) {
+    levels = trace_get_levels(chan->channel);
+    if (levels != NULL) {
+      chan->min_level = levels->min_level;
+      chan->max_level = levels->max_level;
+    }
+
+    /* Listeners for TraceLog messages see the messages which are not
+     * logged, too.
+     */
+    if (pr_log_event_listening(PR_LOG_TYPE_TRACELOG) > 0) {
+      chan->min_level = 1;
+      chan->max_level = INT_MAX;
+    }
+  }
+
+  chan->gen = pr_trace_gen;
+  return (level <= chan->max_level && level >= chan->min_level);
+}
+
 int pr_trace_msg(const char *channel, int level, const char *fmt, ...) {
   int res;
   va_list msg;
@@ -550,6 +592,10 @@ int pr_trace_vmsg(const char *channel, int level, const char *fmt,
 
 #else
 
+int pr_trace_chan_refresh(pr_trace_chan_t *chan, int level) {
+  return FALSE;
+}
+
 pr_table_t *pr_trace_get_table(void) {
   errno = ENOSYS;
   return NULL;
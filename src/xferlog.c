@@ -31,6 +31,7 @@
 #define LOGBUFFER_SIZE	2048
 
 static int xferlogfd = -1;
+static int xferlog_format = PR_XFERLOG_FMT_TEXT;
 
 void xferlog_close(void) {
   if (xferlogfd != -1)
@@ -61,31 +62,24 @@ int xferlog_open(const char *path) {
   return xferlogfd;
 }
 
-int xferlog_write(long xfertime, const char *remhost, off_t fsize, char *fname,
-    char xfertype, char direction, char access_mode, char *user,
-    char abort_flag, const char *action_flags) {
-  const char *xfer_proto;
-  char buf[LOGBUFFER_SIZE] = {'\0'}, fbuf[LOGBUFFER_SIZE] = {'\0'};
-  int have_ident = FALSE, len;
-  char *rfc1413_ident = NULL;
-  register unsigned int i = 0;
-
-  if (xferlogfd == -1 ||
-      remhost == NULL ||
-      user == NULL ||
-      fname == NULL) {
-    return 0;
+int xferlog_set_format(int format) {
+  if (format != PR_XFERLOG_FMT_TEXT &&
+      format != PR_XFERLOG_FMT_BINARY) {
+    errno = EINVAL;
+    return -1;
   }
 
-  for (i = 0; (i + 1 < sizeof(fbuf)) && fname[i] != '\0'; i++) {
-    fbuf[i] = (PR_ISSPACE(fname[i]) || PR_ISCNTRL(fname[i])) ? '_' :
-      fname[i];
-  }
-  fbuf[i] = '\0';
+  xferlog_format = format;
+  return 0;
+}
+
+/* Returns the RFC1413 ident to be logged, i.e. "*" if there is none. */
+static const char *get_ident(int *have_ident) {
+  char *rfc1413_ident = NULL;
 
   rfc1413_ident = pr_table_get(session.notes, "mod_ident.rfc1413-ident", NULL);
   if (rfc1413_ident) {
-    have_ident = TRUE;
+    *have_ident = TRUE;
 
     /* If the retrieved identity is "UNKNOWN", then change the string to be
      * "*", since "*" is to be logged in the xferlog, as per the doc, when
@@ -98,12 +92,31 @@ int xferlog_write(long xfertime, const char *remhost, off_t fsize, char *fname,
     /* If an authenticated user ID is not available, log "*", as per the
      * xferlog man page/spec.
      */
+    *have_ident = FALSE;
     rfc1413_ident = "*";
   }
 
-  xfer_proto = pr_session_get_protocol(0);
+  return rfc1413_ident;
+}
 
-  len = snprintf(buf, sizeof(buf),
+static int xferlog_text(char *buf, size_t bufsz, long xfertime,
+    const char *remhost, off_t fsize, char *fname, char xfertype,
+    char direction, char access_mode, char *user, char abort_flag,
+    const char *action_flags) {
+  char fbuf[LOGBUFFER_SIZE] = {'\0'};
+  const char *rfc1413_ident;
+  int have_ident = FALSE, len;
+  register unsigned int i = 0;
+
+  for (i = 0; (i + 1 < sizeof(fbuf)) && fname[i] != '\0'; i++) {
+    fbuf[i] = (PR_ISSPACE(fname[i]) || PR_ISCNTRL(fname[i])) ? '_' :
+      fname[i];
+  }
+  fbuf[i] = '\0';
+
+  rfc1413_ident = get_ident(&have_ident);
+
+  len = snprintf(buf, bufsz,
     "%s %ld %s %" PR_LU " %s %c %s %c %c %s %s %c %s %c\n",
       pr_strtime(time(NULL)),
       xfertime,
@@ -115,13 +128,174 @@ int xferlog_write(long xfertime, const char *remhost, off_t fsize, char *fname,
       direction,
       access_mode,
       user,
-      xfer_proto,
+      pr_session_get_protocol(0),
       have_ident ? '1' : '0',
       rfc1413_ident,
       abort_flag);
 
-  buf[sizeof(buf)-1] = '\0';
+  buf[bufsz-1] = '\0';
+
+  if (len < 0) {
+    len = 0;
+
+  } else if ((size_t) len >= bufsz) {
+    len = bufsz - 1;
+  }
+
+  return len;
+}
+
+static void bin_put32(unsigned char *ptr, unsigned long val) {
+  uint32_t nval;
+
+  nval = htonl((uint32_t) val);
+  memcpy(ptr, &nval, sizeof(nval));
+}
+
+/* Appends a string to the record, truncating it (as the text format does)
+ * to fewer than LOGBUFFER_SIZE bytes.
+ */
+static size_t bin_put_str(unsigned char *buf, size_t len, const char *str) {
+  size_t slen;
+  uint16_t nlen;
+
+  slen = strlen(str);
+  if (slen >= LOGBUFFER_SIZE) {
+    slen = LOGBUFFER_SIZE - 1;
+  }
+
+  nlen = htons((uint16_t) slen);
+  memcpy(buf + len, &nlen, sizeof(nlen));
+  memcpy(buf + len + sizeof(nlen), str, slen);
+
+  return len + sizeof(nlen) + slen;
+}
+
+/* Writes a binary record.  Most fields are stored as is, without any
+ * formatting; the path in particular is not escaped, and it is left to
+ * ftpxferlog(1) to do so.
+ */
+static int xferlog_binary(int type, struct timeval *duration,
+    const char *remhost, off_t fsize, char *fname, char xfertype,
+    char direction, char access_mode, char *user, char abort_flag,
+    const char *action_flags) {
+  unsigned char buf[PR_XFERLOG_BIN_HDR_LEN +
+    (PR_XFERLOG_BIN_NSTRS * (2 + LOGBUFFER_SIZE))];
+  const char *rfc1413_ident;
+  int have_ident = FALSE;
+  struct timeval now;
+  size_t len;
+
+  rfc1413_ident = get_ident(&have_ident);
+  gettimeofday(&now, NULL);
+
+  memset(buf, '\0', PR_XFERLOG_BIN_HDR_LEN);
+  buf[PR_XFERLOG_BIN_OFF_VERSION] = PR_XFERLOG_BIN_VERSION;
+  buf[PR_XFERLOG_BIN_OFF_TYPE] = (unsigned char) type;
+  buf[PR_XFERLOG_BIN_OFF_XFERTYPE] = (unsigned char) xfertype;
+  buf[PR_XFERLOG_BIN_OFF_DIRECTION] = (unsigned char) direction;
+  buf[PR_XFERLOG_BIN_OFF_ACCESS_MODE] = (unsigned char) access_mode;
+  buf[PR_XFERLOG_BIN_OFF_COMPLETION] = (unsigned char) abort_flag;
+  buf[PR_XFERLOG_BIN_OFF_IDENT] = have_ident ? 1 : 0;
+  bin_put32(buf + PR_XFERLOG_BIN_OFF_PID, (unsigned long) session.pid);
+  bin_put32(buf + PR_XFERLOG_BIN_OFF_TIME, (unsigned long) now.tv_sec);
+  bin_put32(buf + PR_XFERLOG_BIN_OFF_TIME_USEC, (unsigned long) now.tv_usec);
+  bin_put32(buf + PR_XFERLOG_BIN_OFF_SECS, (unsigned long) duration->tv_sec);
+  bin_put32(buf + PR_XFERLOG_BIN_OFF_USECS,
+    (unsigned long) duration->tv_usec);
+
+  /* Shift twice, lest pr_off_t be only 32 bits wide. */
+  bin_put32(buf + PR_XFERLOG_BIN_OFF_BYTES_HI,
+    (unsigned long) ((((pr_off_t) fsize) >> 16) >> 16));
+  bin_put32(buf + PR_XFERLOG_BIN_OFF_BYTES_LO,
+    (unsigned long) (((pr_off_t) fsize) & 0xffffffffUL));
+
+  len = PR_XFERLOG_BIN_HDR_LEN;
+  len = bin_put_str(buf, len, remhost);
+  len = bin_put_str(buf, len, user);
+  len = bin_put_str(buf, len, fname);
+  len = bin_put_str(buf, len, pr_session_get_protocol(0));
+  len = bin_put_str(buf, len, rfc1413_ident);
+  len = bin_put_str(buf, len, action_flags);
+
+  bin_put32(buf + PR_XFERLOG_BIN_OFF_LEN, (unsigned long) len);
+
+  return pr_logship_write(xferlogfd, (const char *) buf, len);
+}
+
+int xferlog_write(long xfertime, const char *remhost, off_t fsize, char *fname,
+    char xfertype, char direction, char access_mode, char *user,
+    char abort_flag, const char *action_flags) {
+  char buf[LOGBUFFER_SIZE] = {'\0'};
+  int len;
+
+  if (xferlogfd == -1 ||
+      remhost == NULL ||
+      user == NULL ||
+      fname == NULL) {
+    return 0;
+  }
+
+  if (xferlog_format == PR_XFERLOG_FMT_BINARY) {
+    struct timeval duration;
+
+    /* The caller only provides whole seconds; for transfers, compute the
+     * duration more precisely, from the transfer start time.
+     */
+    duration.tv_sec = xfertime;
+    duration.tv_usec = 0;
+
+    if (direction != 'd' &&
+        session.xfer.start_time.tv_sec != 0) {
+      struct timeval now;
+
+      gettimeofday(&now, NULL);
+      duration.tv_sec = now.tv_sec - session.xfer.start_time.tv_sec;
+
+      if (now.tv_usec >= session.xfer.start_time.tv_usec) {
+        duration.tv_usec = now.tv_usec - session.xfer.start_time.tv_usec;
+
+      } else {
+        duration.tv_usec = 1000000L - (session.xfer.start_time.tv_usec -
+          now.tv_usec);
+        duration.tv_sec--;
+      }
+    }
+
+    /* Listeners for TransferLog events expect text, so only format the
+     * text line if there are any.
+     */
+    if (pr_log_event_listening(PR_LOG_TYPE_XFERLOG) > 0) {
+      len = xferlog_text(buf, sizeof(buf), xfertime, remhost, fsize, fname,
+        xfertype, direction, access_mode, user, abort_flag, action_flags);
+      pr_log_event_generate(PR_LOG_TYPE_XFERLOG, xferlogfd, -1, buf, len);
+    }
+
+    return xferlog_binary(PR_XFERLOG_BIN_TYPE_END, &duration, remhost, fsize,
+      fname, xfertype, direction, access_mode, user, abort_flag,
+      action_flags);
+  }
+
+  len = xferlog_text(buf, sizeof(buf), xfertime, remhost, fsize, fname,
+    xfertype, direction, access_mode, user, abort_flag, action_flags);
 
   pr_log_event_generate(PR_LOG_TYPE_XFERLOG, xferlogfd, -1, buf, len);
-  return write(xferlogfd, buf, len);
+  return pr_logship_write(xferlogfd, buf, len);
+}
+
+int xferlog_write_start(const char *remhost, off_t offset, char *fname,
+    char xfertype, char direction, char access_mode, char *user) {
+  struct timeval duration;
+
+  if (xferlogfd == -1 ||
+      xferlog_format != PR_XFERLOG_FMT_BINARY ||
+      remhost == NULL ||
+      user == NULL ||
+      fname == NULL) {
+    return 0;
+  }
+
+  duration.tv_sec = duration.tv_usec = 0;
+  return xferlog_binary(PR_XFERLOG_BIN_TYPE_START, &duration, remhost, offset,
+    fname, xfertype, direction, access_mode, user, '-', "_");
 }
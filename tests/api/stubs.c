@@ -110,6 +110,9 @@ void pr_signals_block(void) {
 void pr_signals_unblock(void) {
 }
 
+void pr_trace_invalidate(void) {
+}
+
 int pr_trace_get_level(const char *channel) {
   return 0;
 }
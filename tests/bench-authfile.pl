@@ -0,0 +1,556 @@
+#!/usr/bin/env perl
+
+# Benchmark harness for the mod_auth_file lookup code paths.
+#
+# This generates an AuthUserFile with the configured number of users, and an
+# AuthGroupFile with one group per 100 users (each listing those users as
+# members), then starts the uninstalled proftpd on the loopback interface
+# using those files.  A number of concurrent clients then repeatedly connect,
+# log in as a randomly chosen user, LIST a directory of files owned by other
+# users, and disconnect, for the configured duration.
+#
+# Logging in looks up the user by name, and their groups by GID and by
+# membership; the LIST looks up the names of the file owners by UID and GID.
+# The login and LIST latencies thus show the cost of the lookups for the
+# given file size.
+#
+# The results are printed, and can be written out as JSON (using --output)
+# for comparison against the results of a different build (using --compare).
+
+use strict;
+
+use Cwd qw(abs_path);
+use File::Path qw(rmtree);
+use File::Spec;
+use Getopt::Long;
+use IO::Handle;
+use IO::Socket::INET;
+use POSIX qw(:sys_wait_h);
+use Time::HiRes qw(gettimeofday tv_interval);
+
+my $opts = {};
+GetOptions($opts, 'h|help', 'c|clients=i', 'd|duration=i', 'u|users=i',
+  'o|output=s', 'compare=s', 'label=s', 'K|keep-tmpfiles', 'V|verbose');
+
+if ($opts->{h}) {
+  usage();
+}
+
+if ($opts->{K}) {
+  $ENV{KEEP_TMPFILES} = 1;
+}
+
+if ($opts->{V}) {
+  $ENV{TEST_VERBOSE} = 1;
+}
+
+my $test_dir = (File::Spec->splitpath(abs_path(__FILE__)))[1];
+push(@INC, "$test_dir/t/lib");
+
+require ProFTPD::TestSuite::Utils;
+import ProFTPD::TestSuite::Utils qw(:config :features :running :testsuite);
+
+unless (defined($ENV{PROFTPD_TEST_BIN})) {
+  $ENV{PROFTPD_TEST_BIN} = File::Spec->catfile($test_dir, '..', 'proftpd');
+}
+
+$ENV{PROFTPD_TEST_PATH} = $test_dir;
+
+$| = 1;
+
+my $nclients = $opts->{c} || 4;
+my $duration = $opts->{d} || 10;
+my $nusers = $opts->{u} || 400000;
+
+# The number of users listed as members of each group.
+my $group_size = 100;
+
+# The number of files, owned by different users, in the LISTed directory.
+my $nfiles = 20;
+
+my $results = {
+  version => scalar(feature_get_version()),
+  label => defined($opts->{label}) ? $opts->{label} : '',
+  date => scalar(gmtime()),
+  clients => $nclients,
+  duration => $duration,
+  users => $nusers,
+};
+
+my $res = bench_run();
+$results->{results} = [$res];
+
+print_results($results);
+
+if ($opts->{o}) {
+  require JSON::PP;
+
+  my $json = JSON::PP->new->canonical(1)->pretty(1);
+  if (open(my $fh, "> $opts->{o}")) {
+    print $fh $json->encode($results);
+
+    unless (close($fh)) {
+      die("Can't write $opts->{o}: $!\n");
+    }
+
+  } else {
+    die("Can't open $opts->{o}: $!\n");
+  }
+}
+
+if ($opts->{compare}) {
+  compare_results($opts->{compare}, $results);
+}
+
+exit 0;
+
+sub bench_run {
+  my $tmpdir = testsuite_get_tmp_dir();
+
+  my $config_file = "$tmpdir/bench.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/bench.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/bench.scoreboard");
+  my $log_file = File::Spec->rel2abs("$tmpdir/bench.log");
+
+  my $auth_user_file = File::Spec->rel2abs("$tmpdir/bench.passwd");
+  my $auth_group_file = File::Spec->rel2abs("$tmpdir/bench.group");
+
+  my $passwd = 'test';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+  my $list_dir = File::Spec->rel2abs("$tmpdir/list");
+
+  # When run as root, each user gets their own UID, and each group its own
+  # GID; otherwise, the users all have to map to the current user.
+  my $is_root = ($< == 0);
+  my ($uid, $gid) = ($<, (split(' ', $())[0]);
+
+  mkdir($list_dir);
+  chmod(0755, $home_dir, $list_dir);
+
+  print STDOUT "Generating $nusers users...\n";
+  write_auth_files($auth_user_file, $auth_group_file, $passwd, $home_dir,
+    $is_root ? undef : [$uid, $gid]);
+
+  for (my $i = 0; $i < $nfiles; $i++) {
+    my $path = "$list_dir/file-$i.dat";
+    write_file($path, 0);
+
+    if ($is_root) {
+      my $user_idx = int(rand($nusers));
+      unless (chown(user_uid($user_idx), user_gid($user_idx), $path)) {
+        die("Can't set owner of $path: $!\n");
+      }
+    }
+  }
+
+  my $config = {
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+
+    AuthUserFile => $auth_user_file,
+    AuthGroupFile => $auth_group_file,
+    AuthOrder => 'mod_auth_file.c',
+
+    MaxInstances => $nclients * 4,
+    MaxClients => 'none',
+    MaxClientsPerHost => 'none',
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($config_file,
+    $config);
+
+  print STDOUT "Benchmarking lookups with $nclients clients...\n";
+
+  server_start($config_file, $pid_file);
+
+  my $res = {
+    users => $nusers,
+  };
+
+  eval {
+    wait_for_server($port);
+
+    my $client = {
+      port => $port,
+      passwd => $passwd,
+    };
+
+    my $sessions = run_clients($client);
+
+    my $nsessions = 0;
+    my $errors = 0;
+    my $login_latencies = [];
+    my $list_latencies = [];
+
+    foreach my $stats (@$sessions) {
+      $nsessions += $stats->{sessions};
+      $errors += $stats->{errors};
+      push(@$login_latencies, @{ $stats->{login_latencies} });
+      push(@$list_latencies, @{ $stats->{list_latencies} });
+    }
+
+    $res->{sessions} = $nsessions;
+    $res->{sessions_per_sec} = round($nsessions / $duration);
+    $res->{login_ms_p50} = round(percentile($login_latencies, 50));
+    $res->{login_ms_p99} = round(percentile($login_latencies, 99));
+    $res->{list_ms_p50} = round(percentile($list_latencies, 50));
+    $res->{list_ms_p99} = round(percentile($list_latencies, 99));
+    $res->{errors} = $errors;
+  };
+  my $ex = $@;
+
+  server_stop($pid_file);
+
+  if ($ex) {
+    print STDERR "lookups: $ex";
+    $res->{error} = "$ex";
+    chomp($res->{error});
+  }
+
+  unless ($ENV{KEEP_TMPFILES}) {
+    rmtree($tmpdir);
+  }
+
+  return $res;
+}
+
+sub user_uid {
+  my $idx = shift;
+  return 10000 + $idx;
+}
+
+sub user_gid {
+  my $idx = shift;
+  return 20000 + int($idx / $group_size);
+}
+
+sub write_auth_files {
+  my $user_file = shift;
+  my $group_file = shift;
+  my $passwd = shift;
+  my $home_dir = shift;
+  my $ids = shift;
+
+  # Hashing the password is slow, so all of the users share the same hash.
+  my $hash = ProFTPD::TestSuite::Utils::get_passwd($passwd);
+
+  if (open(my $fh, "> $user_file")) {
+    for (my $i = 0; $i < $nusers; $i++) {
+      my ($uid, $gid) = $ids ? @$ids : (user_uid($i), user_gid($i));
+      print $fh "user$i:$hash:$uid:${gid}::$home_dir:/bin/bash\n";
+    }
+
+    unless (close($fh)) {
+      die("Can't write $user_file: $!\n");
+    }
+
+  } else {
+    die("Can't open $user_file: $!\n");
+  }
+
+  # AuthUserFiles must not be world-readable.
+  chmod(0400, $user_file);
+
+  if (open(my $fh, "> $group_file")) {
+    for (my $i = 0; $i < $nusers; $i += $group_size) {
+      my $gid = $ids ? $ids->[1] : user_gid($i);
+
+      my $last = $i + $group_size - 1;
+      $last = $nusers - 1 if $last >= $nusers;
+
+      my $members = join(',', map { "user$_" } ($i..$last));
+      print $fh "group" . int($i / $group_size) . ":x:$gid:$members\n";
+    }
+
+    unless (close($fh)) {
+      die("Can't write $group_file: $!\n");
+    }
+
+  } else {
+    die("Can't open $group_file: $!\n");
+  }
+}
+
+# The daemon indexes the AuthUserFile and AuthGroupFile at startup, which may
+# take longer than server_start() waits for, so wait for the server to accept
+# connections before starting the clients.
+sub wait_for_server {
+  my $port = shift;
+
+  for (my $i = 0; $i < 300; $i++) {
+    my $sock = IO::Socket::INET->new(
+      PeerAddr => '127.0.0.1',
+      PeerPort => $port,
+      Proto => 'tcp',
+    );
+
+    if ($sock) {
+      close($sock);
+      return;
+    }
+
+    select(undef, undef, undef, 0.1);
+  }
+
+  die("Server not accepting connections on port $port\n");
+}
+
+# Forks a client process per configured client, and collects their results.
+# Each client reports a single line of "key=value" pairs back to the parent
+# over a pipe.
+sub run_clients {
+  my $client = shift;
+
+  my $children = {};
+
+  for (my $i = 0; $i < $nclients; $i++) {
+    my ($rfh, $wfh);
+    unless (pipe($rfh, $wfh)) {
+      die("Can't open pipe: $!\n");
+    }
+
+    my $pid = fork();
+    unless (defined($pid)) {
+      die("Can't fork: $!\n");
+    }
+
+    if ($pid == 0) {
+      close($rfh);
+
+      # Make sure each client picks a different sequence of users.
+      srand($$ ^ time());
+
+      my $stats = client_sessions($client, $i);
+
+      my @pairs;
+      foreach my $key (sort(keys(%$stats))) {
+        my $val = $stats->{$key};
+        $val = join(',', @$val) if ref($val) eq 'ARRAY';
+        push(@pairs, "$key=$val");
+      }
+
+      print $wfh join(' ', @pairs), "\n";
+      $wfh->flush();
+      close($wfh);
+
+      # Use POSIX::_exit, so that the parent's END blocks and temporary
+      # file cleanup are not run in the child.
+      POSIX::_exit(0);
+    }
+
+    close($wfh);
+    $children->{$pid} = $rfh;
+  }
+
+  my $results = [];
+
+  foreach my $pid (keys(%$children)) {
+    my $rfh = $children->{$pid};
+    my $line = <$rfh>;
+    close($rfh);
+    waitpid($pid, 0);
+
+    my $stats = {
+      sessions => 0,
+      errors => 1,
+      login_latencies => [],
+      list_latencies => [],
+    };
+
+    if (defined($line)) {
+      chomp($line);
+
+      foreach my $pair (split(' ', $line)) {
+        my ($key, $val) = split(/=/, $pair, 2);
+        $val = [split(/,/, $val)] if $key =~ /_latencies$/;
+        $stats->{$key} = $val;
+      }
+    }
+
+    push(@$results, $stats);
+  }
+
+  return $results;
+}
+
+sub client_sessions {
+  my $client = shift;
+  my $idx = shift;
+
+  require Net::FTP;
+
+  my $stats = {
+    sessions => 0,
+    errors => 0,
+    login_latencies => [],
+    list_latencies => [],
+  };
+
+  my $deadline = [gettimeofday()];
+
+  while (tv_interval($deadline) < $duration) {
+    my $user = 'user' . int(rand($nusers));
+
+    eval {
+      my $ftp = Net::FTP->new('127.0.0.1', Port => $client->{port});
+      unless ($ftp) {
+        die("Can't connect to FTP server: $@");
+      }
+
+      my $start = [gettimeofday()];
+      unless ($ftp->login($user, $client->{passwd})) {
+        die("Can't login as $user: " . $ftp->message());
+      }
+
+      push(@{ $stats->{login_latencies} }, round(tv_interval($start) * 1000));
+
+      $start = [gettimeofday()];
+      my $list = $ftp->dir('list');
+      unless ($list) {
+        die("LIST failed: " . $ftp->message());
+      }
+
+      push(@{ $stats->{list_latencies} }, round(tv_interval($start) * 1000));
+
+      $ftp->quit();
+      $stats->{sessions}++;
+    };
+
+    if ($@) {
+      $stats->{errors}++;
+      print STDERR "client #$idx: $@" if $ENV{TEST_VERBOSE};
+    }
+  }
+
+  return $stats;
+}
+
+sub print_results {
+  my $results = shift;
+
+  printf STDOUT "\nproftpd %s%s, %d clients, %ds, %d users\n\n",
+    $results->{version},
+    $results->{label} ne '' ? " ($results->{label})" : '',
+    $results->{clients}, $results->{duration}, $results->{users};
+
+  printf STDOUT "%10s %12s %12s %12s %12s %6s\n", 'sess/sec',
+    'login p50 ms', 'login p99 ms', 'LIST p50 ms', 'LIST p99 ms', 'errors';
+
+  foreach my $res (@{ $results->{results} }) {
+    printf STDOUT "%10s %12s %12s %12s %12s %6s\n",
+      fmt($res->{sessions_per_sec}), fmt($res->{login_ms_p50}),
+      fmt($res->{login_ms_p99}), fmt($res->{list_ms_p50}),
+      fmt($res->{list_ms_p99}), fmt($res->{errors});
+  }
+
+  print STDOUT "\n";
+}
+
+# Compares the given results against those previously written out using
+# --output, printing the relative change of each metric.
+sub compare_results {
+  my $path = shift;
+  my $results = shift;
+
+  require JSON::PP;
+
+  my $prev;
+  if (open(my $fh, "< $path")) {
+    local $/;
+    $prev = JSON::PP->new->decode(<$fh>);
+    close($fh);
+
+  } else {
+    die("Can't open $path: $!\n");
+  }
+
+  my $metrics = [qw(
+    sessions_per_sec
+    login_ms_p50
+    login_ms_p99
+    list_ms_p50
+    list_ms_p99
+  )];
+
+  printf STDOUT "Compared with %s%s:\n\n", $prev->{version},
+    $prev->{label} ne '' ? " ($prev->{label})" : '';
+
+  foreach my $res (@{ $results->{results} }) {
+    my ($old) = grep { $_->{users} == $res->{users} } @{ $prev->{results} };
+    next unless $old;
+
+    my @changes;
+    foreach my $metric (@$metrics) {
+      next unless defined($res->{$metric}) && defined($old->{$metric});
+      next if $old->{$metric} == 0;
+
+      push(@changes, sprintf("%s %+.1f%%", $metric,
+        ($res->{$metric} - $old->{$metric}) * 100 / $old->{$metric}));
+    }
+
+    printf STDOUT "%d users: %s\n", $res->{users}, join(', ', @changes);
+  }
+
+  print STDOUT "\n";
+}
+
+sub percentile {
+  my $samples = shift;
+  my $pct = shift;
+
+  return 0 unless scalar(@$samples) > 0;
+
+  my @sorted = sort { $a <=> $b } @$samples;
+  my $idx = int(($pct / 100) * (scalar(@sorted) - 1) + 0.5);
+  return $sorted[$idx];
+}
+
+sub round {
+  my $val = shift;
+  return sprintf("%.2f", $val) + 0;
+}
+
+sub fmt {
+  my $val = shift;
+  return defined($val) ? $val : '-';
+}
+
+sub write_file {
+  my $path = shift;
+  my $size = shift;
+
+  if (open(my $fh, "> $path")) {
+    print $fh 'A' x $size;
+
+    unless (close($fh)) {
+      die("Can't write $path: $!\n");
+    }
+
+  } else {
+    die("Can't open $path: $!\n");
+  }
+}
+
+sub usage {
+  print STDOUT <<EOH;
+
+$0: [--help] [--clients=\$n] [--duration=\$secs] [--users=\$n]
+  [--output=\$file] [--compare=\$file] [--label=\$text] [--keep-tmpfiles]
+  [--verbose]
+
+Examples:
+
+  perl $0
+  perl $0 --users 10000 --clients 16
+  perl $0 --output new.json --compare old.json
+
+EOH
+  exit 0;
+}
@@ -0,0 +1,1036 @@
+#!/usr/bin/env perl
+
+# Benchmark harness for the mod_ldap lookup code paths.
+#
+# This generates an LDIF file with the configured number of users (each with
+# a quota and an SSH public key), and one group per 100 users (each listing
+# those users as members), and serves it using a small LDAP server built into
+# this script; no slapd is needed.  The mock server implements just enough of
+# LDAPv3 for mod_ldap: simple binds, searches (with equality, presence,
+# substring, AND, OR and NOT filters), and unbinds.  Each operation can be
+# delayed (using --latency) to model a loaded directory server.
+#
+# The uninstalled proftpd (which must have been built with mod_ldap) is then
+# started on the loopback interface, using that server for its users and
+# groups.  A number of concurrent clients repeatedly connect, log in as a
+# randomly chosen user, and disconnect, for the configured duration.
+#
+# Besides the login latencies, the mock server counts the connections, binds
+# and searches it sees, so that the LDAP operations needed per login can be
+# compared.  Use --tuned to enable mod_ldap's combined user lookups,
+# persistent connections and entry cache.
+#
+# The results are printed, and can be written out as JSON (using --output)
+# for comparison against the results of a different build (using --compare).
+
+use strict;
+
+use Cwd qw(abs_path);
+use File::Path qw(rmtree);
+use File::Spec;
+use Getopt::Long;
+use IO::Handle;
+use IO::Socket::INET;
+use Socket qw(IPPROTO_TCP TCP_NODELAY);
+use POSIX qw(:sys_wait_h);
+use Time::HiRes qw(gettimeofday tv_interval usleep);
+
+my $opts = {};
+GetOptions($opts, 'h|help', 'c|clients=i', 'd|duration=i', 'u|users=i',
+  'latency=f', 'tuned', 'o|output=s', 'compare=s', 'label=s',
+  'K|keep-tmpfiles', 'V|verbose');
+
+if ($opts->{h}) {
+  usage();
+}
+
+if ($opts->{K}) {
+  $ENV{KEEP_TMPFILES} = 1;
+}
+
+if ($opts->{V}) {
+  $ENV{TEST_VERBOSE} = 1;
+}
+
+my $test_dir = (File::Spec->splitpath(abs_path(__FILE__)))[1];
+push(@INC, "$test_dir/t/lib");
+
+require ProFTPD::TestSuite::Utils;
+import ProFTPD::TestSuite::Utils qw(:config :features :running :testsuite);
+
+unless (defined($ENV{PROFTPD_TEST_BIN})) {
+  $ENV{PROFTPD_TEST_BIN} = File::Spec->catfile($test_dir, '..', 'proftpd');
+}
+
+$ENV{PROFTPD_TEST_PATH} = $test_dir;
+
+$| = 1;
+
+my $nclients = $opts->{c} || 4;
+my $duration = $opts->{d} || 10;
+my $nusers = $opts->{u} || 1000;
+
+# The per-operation delay of the mock LDAP server, in milliseconds.
+my $latency = $opts->{latency} || 0;
+
+# The number of users listed as members of each group.
+my $group_size = 100;
+
+my $base_dn = 'dc=example,dc=com';
+my $bind_dn = "cn=admin,$base_dn";
+my $bind_passwd = 'secret';
+
+my $results = {
+  version => scalar(feature_get_version()),
+  label => defined($opts->{label}) ? $opts->{label} : '',
+  date => scalar(gmtime()),
+  clients => $nclients,
+  duration => $duration,
+  users => $nusers,
+  latency => $latency,
+  tuned => $opts->{tuned} ? 1 : 0,
+};
+
+my $res = bench_run();
+$results->{results} = [$res];
+
+print_results($results);
+
+if ($opts->{o}) {
+  require JSON::PP;
+
+  my $json = JSON::PP->new->canonical(1)->pretty(1);
+  if (open(my $fh, "> $opts->{o}")) {
+    print $fh $json->encode($results);
+
+    unless (close($fh)) {
+      die("Can't write $opts->{o}: $!\n");
+    }
+
+  } else {
+    die("Can't open $opts->{o}: $!\n");
+  }
+}
+
+if ($opts->{compare}) {
+  compare_results($opts->{compare}, $results);
+}
+
+exit 0;
+
+sub bench_run {
+  my $tmpdir = testsuite_get_tmp_dir();
+
+  my $config_file = "$tmpdir/bench.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/bench.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/bench.scoreboard");
+  my $log_file = File::Spec->rel2abs("$tmpdir/bench.log");
+  my $ldif_file = File::Spec->rel2abs("$tmpdir/bench.ldif");
+  my $stats_file = File::Spec->rel2abs("$tmpdir/ldap.stats");
+
+  my $passwd = 'test';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+
+  # When run as root, each user gets their own UID, and each group its own
+  # GID; otherwise, the users all have to map to the current user.
+  my $is_root = ($< == 0);
+  my ($uid, $gid) = ($<, (split(' ', $())[0]);
+
+  chmod(0755, $home_dir);
+
+  print STDOUT "Generating $nusers users...\n";
+  write_ldif($ldif_file, $passwd, $home_dir, $is_root ? undef : [$uid, $gid]);
+
+  my $entries = read_ldif($ldif_file);
+
+  my $listen = IO::Socket::INET->new(
+    LocalAddr => '127.0.0.1',
+    LocalPort => 0,
+    Listen => 128,
+    Proto => 'tcp',
+    ReuseAddr => 1,
+  );
+  unless ($listen) {
+    die("Can't listen for LDAP connections: $!\n");
+  }
+
+  my $ldap_port = $listen->sockport();
+
+  my $ldap_pid = fork();
+  unless (defined($ldap_pid)) {
+    die("Can't fork: $!\n");
+  }
+
+  if ($ldap_pid == 0) {
+    ldap_serve($listen, $entries, $stats_file);
+    POSIX::_exit(0);
+  }
+
+  close($listen);
+
+  my $config = {
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+
+    AuthOrder => 'mod_ldap.c',
+    RequireValidShell => 'off',
+
+    MaxInstances => $nclients * 4,
+    MaxClients => 'none',
+    MaxClientsPerHost => 'none',
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_ldap.c' => {
+        LDAPServer => "127.0.0.1:$ldap_port",
+        LDAPBindDN => "\"$bind_dn\" $bind_passwd",
+        LDAPUsers => "ou=people,$base_dn",
+        LDAPGroups => "ou=groups,$base_dn",
+      },
+    },
+  };
+
+  if ($opts->{tuned}) {
+    $config->{IfModules}->{'mod_ldap.c'}->{LDAPOptions} =
+      'CombinedUserLookup PersistentConnection';
+    $config->{IfModules}->{'mod_ldap.c'}->{LDAPCacheTTL} = 60;
+  }
+
+  if ($ENV{TEST_VERBOSE}) {
+    $config->{IfModules}->{'mod_ldap.c'}->{LDAPLog} = $log_file;
+  }
+
+  my ($port, $config_user, $config_group) = config_write($config_file,
+    $config);
+
+  print STDOUT "Benchmarking logins with $nclients clients...\n";
+
+  server_start($config_file, $pid_file);
+
+  my $res = {
+    users => $nusers,
+  };
+
+  eval {
+    wait_for_server($port);
+
+    my $client = {
+      port => $port,
+      passwd => $passwd,
+    };
+
+    my $sessions = run_clients($client);
+
+    my $nsessions = 0;
+    my $errors = 0;
+    my $login_latencies = [];
+
+    foreach my $stats (@$sessions) {
+      $nsessions += $stats->{sessions};
+      $errors += $stats->{errors};
+      push(@$login_latencies, @{ $stats->{login_latencies} });
+    }
+
+    $res->{sessions} = $nsessions;
+    $res->{sessions_per_sec} = round($nsessions / $duration);
+    $res->{login_ms_p50} = round(percentile($login_latencies, 50));
+    $res->{login_ms_p99} = round(percentile($login_latencies, 99));
+    $res->{errors} = $errors;
+  };
+  my $ex = $@;
+
+  server_stop($pid_file);
+
+  # Give the sessions a moment to unbind, before stopping the LDAP server.
+  sleep(1);
+  kill('TERM', $ldap_pid);
+  waitpid($ldap_pid, 0);
+
+  if ($ex) {
+    print STDERR "lookups: $ex";
+    $res->{error} = "$ex";
+    chomp($res->{error});
+
+  } else {
+    my $ops = read_stats($stats_file);
+    my $nsessions = $res->{sessions} || 1;
+
+    foreach my $op (qw(connections binds searches)) {
+      $res->{"${op}_per_login"} = round(($ops->{$op} || 0) / $nsessions);
+    }
+  }
+
+  unless ($ENV{KEEP_TMPFILES}) {
+    rmtree($tmpdir);
+  }
+
+  return $res;
+}
+
+sub user_uid {
+  my $idx = shift;
+  return 10000 + $idx;
+}
+
+sub user_gid {
+  my $idx = shift;
+  return 20000 + int($idx / $group_size);
+}
+
+sub write_ldif {
+  my $path = shift;
+  my $passwd = shift;
+  my $home_dir = shift;
+  my $ids = shift;
+
+  if (open(my $fh, "> $path")) {
+    print $fh <<EOL;
+dn: $bind_dn
+objectClass: person
+cn: admin
+userPassword: $bind_passwd
+
+EOL
+
+    for (my $i = 0; $i < $nusers; $i++) {
+      my ($uid, $gid) = $ids ? @$ids : (user_uid($i), user_gid($i));
+
+      print $fh <<EOL;
+dn: uid=user$i,ou=people,$base_dn
+objectClass: posixAccount
+uid: user$i
+userPassword: $passwd
+uidNumber: $uid
+gidNumber: $gid
+homeDirectory: $home_dir
+loginShell: /bin/bash
+ftpQuota: false,hard,user,0,0,0,0,0,0
+sshPublicKey: ssh-rsa AAAAB3NzaC1yc2EAAAADAQABAAAAgQC$i user$i
+
+EOL
+    }
+
+    for (my $i = 0; $i < $nusers; $i += $group_size) {
+      my $gid = $ids ? $ids->[1] : user_gid($i);
+      my $name = 'group' . int($i / $group_size);
+
+      my $last = $i + $group_size - 1;
+      $last = $nusers - 1 if $last >= $nusers;
+
+      print $fh "dn: cn=$name,ou=groups,$base_dn\n",
+        "objectClass: posixGroup\n",
+        "cn: $name\n",
+        "gidNumber: $gid\n";
+      print $fh "memberUid: user$_\n" foreach ($i..$last);
+      print $fh "\n";
+    }
+
+    unless (close($fh)) {
+      die("Can't write $path: $!\n");
+    }
+
+  } else {
+    die("Can't open $path: $!\n");
+  }
+}
+
+# Reads the entries from the given LDIF file, as a list of
+# { dn => $dn, attrs => { lc($name) => [$name, [@values]] } } hashes.  Only
+# plain "name: value" lines are supported.
+sub read_ldif {
+  my $path = shift;
+
+  my $entries = [];
+  my $entry;
+
+  if (open(my $fh, "< $path")) {
+    while (my $line = <$fh>) {
+      chomp($line);
+
+      if ($line eq '') {
+        $entry = undef;
+        next;
+      }
+
+      my ($name, $value) = split(/:\s*/, $line, 2);
+
+      if (lc($name) eq 'dn') {
+        $entry = { dn => $value, attrs => {} };
+        push(@$entries, $entry);
+        next;
+      }
+
+      my $attr = ($entry->{attrs}->{lc($name)} ||= [$name, []]);
+      push(@{ $attr->[1] }, $value);
+    }
+
+    close($fh);
+
+  } else {
+    die("Can't open $path: $!\n");
+  }
+
+  return $entries;
+}
+
+# The mock LDAP server.  Each connection is handled by its own process, which
+# appends its operation counts to the stats file when the connection closes.
+sub ldap_serve {
+  my $listen = shift;
+  my $entries = shift;
+  my $stats_file = shift;
+
+  # Index the entries by DN, and by each attribute value, so that searches
+  # with equality filters need not scan every entry.
+  my $index = {
+    dn => {},
+    values => {},
+  };
+
+  foreach my $entry (@$entries) {
+    $index->{dn}->{lc($entry->{dn})} = $entry;
+
+    foreach my $name (keys(%{ $entry->{attrs} })) {
+      foreach my $value (@{ $entry->{attrs}->{$name}->[1] }) {
+        push(@{ $index->{values}->{"$name=" . lc($value)} }, $entry);
+      }
+    }
+  }
+
+  $SIG{CHLD} = sub {
+    while (waitpid(-1, WNOHANG) > 0) {
+    }
+  };
+
+  my $children = {};
+  $SIG{TERM} = sub {
+    kill('TERM', keys(%$children));
+    POSIX::_exit(0);
+  };
+
+  while (1) {
+    my $conn = $listen->accept();
+    next unless $conn;
+
+    my $pid = fork();
+    if (defined($pid) && $pid == 0) {
+      $SIG{TERM} = sub {
+        POSIX::_exit(0);
+      };
+
+      close($listen);
+
+      # Send each response message right away, as an LDAP server would.
+      setsockopt($conn, IPPROTO_TCP, TCP_NODELAY, 1);
+
+      ldap_session($conn, $entries, $index, $stats_file);
+      POSIX::_exit(0);
+    }
+
+    $children->{$pid} = 1 if $pid;
+    close($conn);
+  }
+}
+
+sub ldap_session {
+  my $conn = shift;
+  my $entries = shift;
+  my $index = shift;
+  my $stats_file = shift;
+
+  my $ops = {
+    connections => 1,
+    binds => 0,
+    searches => 0,
+  };
+
+  my $bound_dn = '';
+
+  while (defined(my $msg = ber_read_message($conn))) {
+    my ($msgid, $op_tag, $op) = ldap_parse_message($msg);
+    last unless defined($op_tag);
+
+    if ($latency > 0) {
+      usleep($latency * 1000);
+    }
+
+    if ($op_tag == 0x60) {
+      # BindRequest
+      $ops->{binds}++;
+
+      my ($version, $name, $cred) = map { $_->[1] } ber_parse_seq($op);
+      my $code = 0;
+
+      if ($name ne '') {
+        my $entry = $index->{dn}->{lc($name)};
+        my $passwd = $entry ? $entry->{attrs}->{userpassword} : undef;
+
+        unless ($passwd && $passwd->[1]->[0] eq $cred) {
+          # invalidCredentials
+          $code = 49;
+        }
+      }
+
+      $bound_dn = $name if $code == 0;
+      ldap_send($conn, $msgid, ldap_result(0x61, $code));
+
+    } elsif ($op_tag == 0x42) {
+      # UnbindRequest
+      last;
+
+    } elsif ($op_tag == 0x63) {
+      # SearchRequest
+      $ops->{searches}++;
+
+      my @fields = ber_parse_seq($op);
+      my $base = lc($fields[0]->[1]);
+      my $scope = ber_int_value($fields[1]->[1]);
+      my $filter = [$fields[6]->[0], $fields[6]->[1]];
+      my @attrs = map { lc($_->[1]) } ber_parse_seq($fields[7]->[1]);
+
+      foreach my $entry (ldap_search_entries($entries, $index, $base, $scope,
+          $filter)) {
+        my $attr_list = '';
+
+        foreach my $name (@attrs ? @attrs : keys(%{ $entry->{attrs} })) {
+          my $attr = $entry->{attrs}->{$name};
+          next unless $attr;
+
+          $attr_list .= ber_encode(0x30, ber_encode(0x04, $attr->[0]) .
+            ber_encode(0x31, join('', map { ber_encode(0x04, $_) }
+              @{ $attr->[1] })));
+        }
+
+        ldap_send($conn, $msgid, ber_encode(0x64,
+          ber_encode(0x04, $entry->{dn}) . ber_encode(0x30, $attr_list)));
+      }
+
+      ldap_send($conn, $msgid, ldap_result(0x65, 0));
+
+    } else {
+      # Anything else (e.g. StartTLS) is unsupported; unwillingToPerform.
+      ldap_send($conn, $msgid, ldap_result(($op_tag & 0x1f) + 1 | 0x60, 53));
+    }
+  }
+
+  close($conn);
+
+  if (open(my $fh, ">> $stats_file")) {
+    syswrite($fh, join(' ', map { "$_=$ops->{$_}" } sort(keys(%$ops))) . "\n");
+    close($fh);
+  }
+}
+
+sub ldap_search_entries {
+  my $entries = shift;
+  my $index = shift;
+  my $base = shift;
+  my $scope = shift;
+  my $filter = shift;
+
+  my $candidates = $entries;
+
+  # Use the index for the first equality match in a top-level AND (or for
+  # a top-level equality match).
+  my @filters = ($filter);
+  if ($filter->[0] == 0xa0) {
+    @filters = map { [$_->[0], $_->[1]] } ber_parse_seq($filter->[1]);
+  }
+
+  foreach my $f (@filters) {
+    if ($f->[0] == 0xa3) {
+      my ($name, $value) = map { $_->[1] } ber_parse_seq($f->[1]);
+      $candidates = $index->{values}->{lc($name) . '=' . lc($value)} || [];
+      last;
+    }
+  }
+
+  my @found;
+  foreach my $entry (@$candidates) {
+    my $dn = lc($entry->{dn});
+
+    if ($scope == 0) {
+      next unless $dn eq $base;
+
+    } elsif ($scope == 1) {
+      next unless $dn =~ /^[^,]+,\Q$base\E$/;
+
+    } else {
+      next unless $dn eq $base || $dn =~ /,\Q$base\E$/;
+    }
+
+    push(@found, $entry) if ldap_filter_match($entry, $filter);
+  }
+
+  return @found;
+}
+
+sub ldap_filter_match {
+  my $entry = shift;
+  my $filter = shift;
+
+  my ($tag, $content) = @$filter;
+
+  if ($tag == 0xa0 || $tag == 0xa1) {
+    # and, or
+    foreach my $f (ber_parse_seq($content)) {
+      my $matched = ldap_filter_match($entry, $f);
+      return $matched if ($tag == 0xa0 && !$matched) ||
+                         ($tag == 0xa1 && $matched);
+    }
+
+    return $tag == 0xa0 ? 1 : 0;
+  }
+
+  if ($tag == 0xa2) {
+    # not
+    my ($f) = ber_parse_seq($content);
+    return ldap_filter_match($entry, $f) ? 0 : 1;
+  }
+
+  if ($tag == 0x87) {
+    # present
+    return exists($entry->{attrs}->{lc($content)}) ? 1 : 0;
+  }
+
+  if ($tag == 0xa3) {
+    # equalityMatch
+    my ($name, $value) = map { $_->[1] } ber_parse_seq($content);
+    my $attr = $entry->{attrs}->{lc($name)};
+    return 0 unless $attr;
+    return (grep { lc($_) eq lc($value) } @{ $attr->[1] }) ? 1 : 0;
+  }
+
+  if ($tag == 0xa4) {
+    # substrings
+    my ($name, $subs) = ber_parse_seq($content);
+    my $attr = $entry->{attrs}->{lc($name->[1])};
+    return 0 unless $attr;
+
+    my $pattern = '';
+    foreach my $sub (ber_parse_seq($subs->[1])) {
+      my $part = quotemeta($sub->[1]);
+
+      if ($sub->[0] == 0x80) {
+        $pattern = "^$part";
+
+      } elsif ($sub->[0] == 0x81) {
+        $pattern .= ".*$part";
+
+      } else {
+        $pattern .= ".*$part\$";
+      }
+    }
+
+    return (grep { /$pattern/i } @{ $attr->[1] }) ? 1 : 0;
+  }
+
+  return 0;
+}
+
+sub ldap_parse_message {
+  my $msg = shift;
+
+  my @fields = ber_parse_seq($msg);
+  return () unless scalar(@fields) >= 2;
+
+  return (ber_int_value($fields[0]->[1]), $fields[1]->[0], $fields[1]->[1]);
+}
+
+sub ldap_result {
+  my $tag = shift;
+  my $code = shift;
+
+  return ber_encode($tag, ber_encode(0x0a, chr($code)) . ber_encode(0x04, '') .
+    ber_encode(0x04, ''));
+}
+
+sub ldap_send {
+  my $conn = shift;
+  my $msgid = shift;
+  my $op = shift;
+
+  my $msg = ber_encode(0x30, ber_encode_int($msgid) . $op);
+  syswrite($conn, $msg);
+}
+
+# Reads the next BER-encoded message from the given socket, returning its
+# contents, or undef on EOF.
+sub ber_read_message {
+  my $conn = shift;
+
+  my $hdr = ber_read_bytes($conn, 2);
+  return undef unless defined($hdr);
+
+  my $len = ord(substr($hdr, 1, 1));
+  if ($len & 0x80) {
+    my $bytes = ber_read_bytes($conn, $len & 0x7f);
+    return undef unless defined($bytes);
+
+    $len = 0;
+    $len = ($len << 8) | ord($_) foreach split(//, $bytes);
+  }
+
+  return ber_read_bytes($conn, $len);
+}
+
+sub ber_read_bytes {
+  my $conn = shift;
+  my $len = shift;
+
+  my $buf = '';
+  while (length($buf) < $len) {
+    my $res = sysread($conn, $buf, $len - length($buf), length($buf));
+    return undef unless $res;
+  }
+
+  return $buf;
+}
+
+# Splits BER-encoded contents into a list of [$tag, $contents] pairs.
+sub ber_parse_seq {
+  my $buf = shift;
+
+  my @items;
+  my $pos = 0;
+
+  while ($pos + 2 <= length($buf)) {
+    my $tag = ord(substr($buf, $pos, 1));
+    my $len = ord(substr($buf, $pos + 1, 1));
+    $pos += 2;
+
+    if ($len & 0x80) {
+      my $n = $len & 0x7f;
+      $len = 0;
+      $len = ($len << 8) | ord(substr($buf, $pos++, 1)) for (1..$n);
+    }
+
+    push(@items, [$tag, substr($buf, $pos, $len)]);
+    $pos += $len;
+  }
+
+  return @items;
+}
+
+sub ber_int_value {
+  my $buf = shift;
+
+  my $val = 0;
+  $val = ($val << 8) | ord($_) foreach split(//, $buf);
+  return $val;
+}
+
+sub ber_encode {
+  my $tag = shift;
+  my $contents = shift;
+
+  my $len = length($contents);
+  my $len_bytes;
+
+  if ($len < 0x80) {
+    $len_bytes = chr($len);
+
+  } else {
+    my $bytes = '';
+    while ($len > 0) {
+      $bytes = chr($len & 0xff) . $bytes;
+      $len >>= 8;
+    }
+
+    $len_bytes = chr(0x80 | length($bytes)) . $bytes;
+  }
+
+  return chr($tag) . $len_bytes . $contents;
+}
+
+sub ber_encode_int {
+  my $val = shift;
+
+  my $bytes = '';
+  do {
+    $bytes = chr($val & 0xff) . $bytes;
+    $val >>= 8;
+  } while ($val > 0);
+
+  $bytes = "\0$bytes" if ord($bytes) & 0x80;
+  return ber_encode(0x02, $bytes);
+}
+
+sub read_stats {
+  my $path = shift;
+
+  my $ops = {};
+
+  if (open(my $fh, "< $path")) {
+    while (my $line = <$fh>) {
+      chomp($line);
+
+      foreach my $pair (split(' ', $line)) {
+        my ($key, $val) = split(/=/, $pair, 2);
+        $ops->{$key} += $val;
+      }
+    }
+
+    close($fh);
+  }
+
+  return $ops;
+}
+
+# Wait for the server to accept connections before starting the clients.
+sub wait_for_server {
+  my $port = shift;
+
+  for (my $i = 0; $i < 300; $i++) {
+    my $sock = IO::Socket::INET->new(
+      PeerAddr => '127.0.0.1',
+      PeerPort => $port,
+      Proto => 'tcp',
+    );
+
+    if ($sock) {
+      close($sock);
+      return;
+    }
+
+    select(undef, undef, undef, 0.1);
+  }
+
+  die("Server not accepting connections on port $port\n");
+}
+
+# Forks a client process per configured client, and collects their results.
+# Each client reports a single line of "key=value" pairs back to the parent
+# over a pipe.
+sub run_clients {
+  my $client = shift;
+
+  my $children = {};
+
+  for (my $i = 0; $i < $nclients; $i++) {
+    my ($rfh, $wfh);
+    unless (pipe($rfh, $wfh)) {
+      die("Can't open pipe: $!\n");
+    }
+
+    my $pid = fork();
+    unless (defined($pid)) {
+      die("Can't fork: $!\n");
+    }
+
+    if ($pid == 0) {
+      close($rfh);
+
+      # Make sure each client picks a different sequence of users.
+      srand($$ ^ time());
+
+      my $stats = client_sessions($client, $i);
+
+      my @pairs;
+      foreach my $key (sort(keys(%$stats))) {
+        my $val = $stats->{$key};
+        $val = join(',', @$val) if ref($val) eq 'ARRAY';
+        push(@pairs, "$key=$val");
+      }
+
+      print $wfh join(' ', @pairs), "\n";
+      $wfh->flush();
+      close($wfh);
+
+      # Use POSIX::_exit, so that the parent's END blocks and temporary
+      # file cleanup are not run in the child.
+      POSIX::_exit(0);
+    }
+
+    close($wfh);
+    $children->{$pid} = $rfh;
+  }
+
+  my $results = [];
+
+  foreach my $pid (keys(%$children)) {
+    my $rfh = $children->{$pid};
+    my $line = <$rfh>;
+    close($rfh);
+    waitpid($pid, 0);
+
+    my $stats = {
+      sessions => 0,
+      errors => 1,
+      login_latencies => [],
+    };
+
+    if (defined($line)) {
+      chomp($line);
+
+      foreach my $pair (split(' ', $line)) {
+        my ($key, $val) = split(/=/, $pair, 2);
+        $val = [split(/,/, $val)] if $key =~ /_latencies$/;
+        $stats->{$key} = $val;
+      }
+    }
+
+    push(@$results, $stats);
+  }
+
+  return $results;
+}
+
+sub client_sessions {
+  my $client = shift;
+  my $idx = shift;
+
+  require Net::FTP;
+
+  my $stats = {
+    sessions => 0,
+    errors => 0,
+    login_latencies => [],
+  };
+
+  my $deadline = [gettimeofday()];
+
+  while (tv_interval($deadline) < $duration) {
+    my $user = 'user' . int(rand($nusers));
+
+    eval {
+      my $ftp = Net::FTP->new('127.0.0.1', Port => $client->{port});
+      unless ($ftp) {
+        die("Can't connect to FTP server: $@");
+      }
+
+      my $start = [gettimeofday()];
+      unless ($ftp->login($user, $client->{passwd})) {
+        die("Can't login as $user: " . $ftp->message());
+      }
+
+      push(@{ $stats->{login_latencies} }, round(tv_interval($start) * 1000));
+
+      $ftp->quit();
+      $stats->{sessions}++;
+    };
+
+    if ($@) {
+      $stats->{errors}++;
+      print STDERR "client #$idx: $@" if $ENV{TEST_VERBOSE};
+    }
+  }
+
+  return $stats;
+}
+
+sub print_results {
+  my $results = shift;
+
+  printf STDOUT "\nproftpd %s%s, %d clients, %ds, %d users, %sms LDAP "
+    . "latency%s\n\n",
+    $results->{version},
+    $results->{label} ne '' ? " ($results->{label})" : '',
+    $results->{clients}, $results->{duration}, $results->{users},
+    $results->{latency}, $results->{tuned} ? ', tuned' : '';
+
+  printf STDOUT "%10s %12s %12s %8s %8s %8s %6s\n", 'sess/sec',
+    'login p50 ms', 'login p99 ms', 'conns', 'binds', 'searches', 'errors';
+
+  foreach my $res (@{ $results->{results} }) {
+    printf STDOUT "%10s %12s %12s %8s %8s %8s %6s\n",
+      fmt($res->{sessions_per_sec}), fmt($res->{login_ms_p50}),
+      fmt($res->{login_ms_p99}), fmt($res->{connections_per_login}),
+      fmt($res->{binds_per_login}), fmt($res->{searches_per_login}),
+      fmt($res->{errors});
+  }
+
+  print STDOUT "\n(LDAP connections, binds and searches are per login)\n\n";
+}
+
+# Compares the given results against those previously written out using
+# --output, printing the relative change of each metric.
+sub compare_results {
+  my $path = shift;
+  my $results = shift;
+
+  require JSON::PP;
+
+  my $prev;
+  if (open(my $fh, "< $path")) {
+    local $/;
+    $prev = JSON::PP->new->decode(<$fh>);
+    close($fh);
+
+  } else {
+    die("Can't open $path: $!\n");
+  }
+
+  my $metrics = [qw(
+    sessions_per_sec
+    login_ms_p50
+    login_ms_p99
+    connections_per_login
+    binds_per_login
+    searches_per_login
+  )];
+
+  printf STDOUT "Compared with %s%s:\n\n", $prev->{version},
+    $prev->{label} ne '' ? " ($prev->{label})" : '';
+
+  foreach my $res (@{ $results->{results} }) {
+    my ($old) = grep { $_->{users} == $res->{users} } @{ $prev->{results} };
+    next unless $old;
+
+    my @changes;
+    foreach my $metric (@$metrics) {
+      next unless defined($res->{$metric}) && defined($old->{$metric});
+      next if $old->{$metric} == 0;
+
+      push(@changes, sprintf("%s %+.1f%%", $metric,
+        ($res->{$metric} - $old->{$metric}) * 100 / $old->{$metric}));
+    }
+
+    printf STDOUT "%d users: %s\n", $res->{users}, join(', ', @changes);
+  }
+
+  print STDOUT "\n";
+}
+
+sub percentile {
+  my $samples = shift;
+  my $pct = shift;
+
+  return 0 unless scalar(@$samples) > 0;
+
+  my @sorted = sort { $a <=> $b } @$samples;
+  my $idx = int(($pct / 100) * (scalar(@sorted) - 1) + 0.5);
+  return $sorted[$idx];
+}
+
+sub round {
+  my $val = shift;
+  return sprintf("%.2f", $val) + 0;
+}
+
+sub fmt {
+  my $val = shift;
+  return defined($val) ? $val : '-';
+}
+
+sub usage {
+  print STDOUT <<EOH;
+
+$0: [--help] [--clients=\$n] [--duration=\$secs] [--users=\$n]
+  [--latency=\$ms] [--tuned] [--output=\$file] [--compare=\$file]
+  [--label=\$text] [--keep-tmpfiles] [--verbose]
+
+Examples:
+
+  perl $0
+  perl $0 --users 10000 --clients 16 --latency 2
+  perl $0 --output old.json
+  perl $0 --tuned --output new.json --compare old.json
+
+EOH
+  exit 0;
+}
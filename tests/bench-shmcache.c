@@ -0,0 +1,414 @@
+/*
+ * ProFTPD - FTP server testsuite
+ * Copyright (c) 2015 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project team and other respective
+ * copyright holders give permission to link this program with OpenSSL, and
+ * distribute the resulting executable, without including the source code for
+ * OpenSSL in the source distribution.
+ */
+
+/* Throughput benchmark for the mod_tls_shmcache session cache.
+ *
+ * This opens a "shm" session cache, as the daemon process would, then forks
+ * the given numbers of processes (as session processes would be), each of
+ * which adds sessions under its own session IDs, and looks up the session it
+ * added a little earlier, for the given number of iterations.  The IDs are
+ * spread over the cache stripes by the cache's own hash, so processes only
+ * contend when their IDs land on the same stripe.  For each process count,
+ * the total add+get operations/sec and the lookup hit rate are printed.
+ *
+ * This links against modules/mod_tls_shmcache.o, and thus needs proftpd to
+ * be configured with mod_tls_shmcache as a static module; run it using
+ * "make bench-shmcache".
+ */
+
+#include "conf.h"
+#include "privs.h"
+#include "contrib/mod_tls.h"
+
+#include <sys/time.h>
+
+#define BENCH_SHMCACHE_SESS_ID_LEN	32
+
+/* How many iterations back each process looks for its own session. */
+#define BENCH_SHMCACHE_GET_LAG		16
+
+extern module tls_shmcache_module;
+
+static tls_sess_cache_t *bench_cache = NULL;
+
+/* Stubs */
+
+session_t session;
+
+char ServerType = SERVER_STANDALONE;
+server_rec *main_server = NULL;
+pid_t mpid = 1;
+
+char *dir_realpath(pool *p, const char *path) {
+  return NULL;
+}
+
+void *get_param_ptr(xaset_t *set, const char *name, int recurse) {
+  errno = ENOENT;
+  return NULL;
+}
+
+struct passwd *pr_auth_getpwnam(pool *p, const char *name) {
+  errno = ENOENT;
+  return NULL;
+}
+
+void pr_alarms_block(void) {
+}
+
+void pr_alarms_unblock(void) {
+}
+
+void pr_log_debug(int level, const char *fmt, ...) {
+}
+
+void pr_log_pri(int prio, const char *fmt, ...) {
+  va_list msg;
+
+  fprintf(stderr, "PRI%d: ", prio);
+
+  va_start(msg, fmt);
+  vfprintf(stderr, fmt, msg);
+  va_end(msg);
+
+  fprintf(stderr, "\n");
+}
+
+void pr_memscrub(void *ptr, size_t ptrlen) {
+  memset(ptr, 0, ptrlen);
+}
+
+void pr_signals_handle(void) {
+}
+
+void pr_signals_block(void) {
+}
+
+void pr_signals_unblock(void) {
+}
+
+const char *pr_strtime(time_t t) {
+  return "";
+}
+
+void pr_trace_invalidate(void) {
+}
+
+int pr_trace_msg(const char *channel, int level, const char *fmt, ...) {
+  return 0;
+}
+
+int tls_log(const char *fmt, ...) {
+  va_list msg;
+
+  fprintf(stderr, "tls: ");
+
+  va_start(msg, fmt);
+  vfprintf(stderr, fmt, msg);
+  va_end(msg);
+
+  fprintf(stderr, "\n");
+  return 0;
+}
+
+int tls_sess_cache_register(const char *name, tls_sess_cache_t *cache) {
+  bench_cache = cache;
+  return 0;
+}
+
+/* Benchmark */
+
+static double bench_now(void) {
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + (tv.tv_usec / 1000000.0);
+}
+
+static void bench_sess_id(unsigned char *sess_id, unsigned int proc_idx,
+    unsigned int iter) {
+  memset(sess_id, 0x5a, BENCH_SHMCACHE_SESS_ID_LEN);
+  memcpy(sess_id, &proc_idx, sizeof(proc_idx));
+  memcpy(sess_id + sizeof(proc_idx), &iter, sizeof(iter));
+}
+
+/* Runs in each forked process; writes "ops hits secs" to the given fd. */
+static void bench_proc(int fd, unsigned int proc_idx, unsigned int niters,
+    SSL_SESSION *sess) {
+  register unsigned int i;
+  unsigned char sess_id[BENCH_SHMCACHE_SESS_ID_LEN];
+  unsigned long nops = 0, nhits = 0;
+  time_t expires;
+  double start;
+  char buf[128];
+  int len;
+
+  expires = time(NULL) + 3600;
+  start = bench_now();
+
+  for (i = 0; i < niters; i++) {
+    bench_sess_id(sess_id, proc_idx, i);
+    if (bench_cache->add(bench_cache, sess_id, sizeof(sess_id), expires,
+        sess) == 0) {
+      nops++;
+    }
+
+    if (i >= BENCH_SHMCACHE_GET_LAG) {
+      SSL_SESSION *found;
+
+      bench_sess_id(sess_id, proc_idx, i - BENCH_SHMCACHE_GET_LAG);
+      found = bench_cache->get(bench_cache, sess_id, sizeof(sess_id));
+      if (found != NULL) {
+        SSL_SESSION_free(found);
+        nhits++;
+      }
+
+      nops++;
+    }
+  }
+
+  len = snprintf(buf, sizeof(buf), "%lu %lu %f\n", nops, nhits,
+    bench_now() - start);
+  if (write(fd, buf, len) != len) {
+    _exit(1);
+  }
+
+  _exit(0);
+}
+
+static int bench_run(unsigned int nprocs, unsigned int niters,
+    SSL_SESSION *sess) {
+  register unsigned int i;
+  unsigned long total_ops = 0, total_hits = 0;
+  double max_secs = 0.0;
+  int fds[2];
+  FILE *fh;
+
+  if (bench_cache->clear(bench_cache) < 0) {
+    fprintf(stderr, "error clearing cache: %s\n", strerror(errno));
+    return -1;
+  }
+
+  if (pipe(fds) < 0) {
+    fprintf(stderr, "error opening pipe: %s\n", strerror(errno));
+    return -1;
+  }
+
+  for (i = 0; i < nprocs; i++) {
+    pid_t pid;
+
+    pid = fork();
+    if (pid < 0) {
+      fprintf(stderr, "error forking: %s\n", strerror(errno));
+      return -1;
+    }
+
+    if (pid == 0) {
+      close(fds[0]);
+      bench_proc(fds[1], i, niters, sess);
+    }
+  }
+
+  close(fds[1]);
+
+  fh = fdopen(fds[0], "r");
+  for (i = 0; i < nprocs; i++) {
+    unsigned long nops, nhits;
+    double secs;
+
+    if (fscanf(fh, "%lu %lu %lf", &nops, &nhits, &secs) != 3) {
+      fprintf(stderr, "error reading results of process #%u\n", i);
+      break;
+    }
+
+    total_ops += nops;
+    total_hits += nhits;
+
+    /* The processes run concurrently, so the aggregate rate is the total
+     * operations over the time taken by the slowest process.
+     */
+    if (secs > max_secs) {
+      max_secs = secs;
+    }
+  }
+  fclose(fh);
+
+  while (wait(NULL) > 0) {
+  }
+
+  printf("%5u %14.0f %10.2f %8.1f%%\n", nprocs,
+    max_secs > 0.0 ? total_ops / max_secs : 0.0, max_secs,
+    niters > BENCH_SHMCACHE_GET_LAG ?
+      (total_hits * 100.0) /
+        ((double) nprocs * (niters - BENCH_SHMCACHE_GET_LAG)) : 0.0);
+  return 0;
+}
+
+static SSL_SESSION *bench_get_sess(void) {
+  SSL_CTX *ssl_ctx;
+  SSL *ssl;
+  const SSL_CIPHER *cipher;
+  SSL_SESSION *sess;
+  unsigned char master_key[SSL_MAX_MASTER_KEY_LENGTH];
+
+  ssl_ctx = SSL_CTX_new(SSLv23_server_method());
+  if (ssl_ctx == NULL) {
+    return NULL;
+  }
+
+  ssl = SSL_new(ssl_ctx);
+  if (ssl == NULL) {
+    SSL_CTX_free(ssl_ctx);
+    return NULL;
+  }
+
+  cipher = sk_SSL_CIPHER_value(SSL_get_ciphers(ssl), 0);
+  memset(master_key, 0x2a, sizeof(master_key));
+
+  sess = SSL_SESSION_new();
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+  SSL_SESSION_set_protocol_version(sess, TLS1_2_VERSION);
+  SSL_SESSION_set_cipher(sess, cipher);
+  SSL_SESSION_set1_master_key(sess, master_key, sizeof(master_key));
+#else
+  sess->ssl_version = TLS1_2_VERSION;
+  sess->cipher = (SSL_CIPHER *) cipher;
+  sess->cipher_id = SSL_CIPHER_get_id(cipher);
+  memcpy(sess->master_key, master_key, sizeof(master_key));
+  sess->master_key_length = sizeof(master_key);
+#endif /* OpenSSL-1.1.1 and later */
+
+  SSL_free(ssl);
+  SSL_CTX_free(ssl_ctx);
+  return sess;
+}
+
+static void usage(const char *prog) {
+  fprintf(stdout, "usage: %s [-f path] [-n iterations] [-p nprocs,...] "
+    "[-s size]\n", prog);
+  exit(0);
+}
+
+int main(int argc, char *argv[]) {
+  char *path = NULL, *procs = "1,2,4,8,16", *info, *ptr;
+  unsigned int niters = 100000;
+  unsigned long size = 32 * 1024 * 1024;
+  SSL_SESSION *sess;
+  int c, res = 0;
+
+  while ((c = getopt(argc, argv, "f:hn:p:s:")) != -1) {
+    switch (c) {
+      case 'f':
+        path = optarg;
+        break;
+
+      case 'n':
+        niters = atoi(optarg);
+        break;
+
+      case 'p':
+        procs = optarg;
+        break;
+
+      case 's':
+        size = strtoul(optarg, NULL, 10);
+        break;
+
+      default:
+        usage(argv[0]);
+    }
+  }
+
+  init_pools();
+  init_fs();
+  session.pool = make_sub_pool(permanent_pool);
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+  SSL_library_init();
+#endif /* OpenSSL-1.1.x and later */
+
+  if (path == NULL) {
+    path = pcalloc(permanent_pool, 64);
+    snprintf(path, 63, "/tmp/bench-shmcache.%lu", (unsigned long) getpid());
+  }
+
+  info = pcalloc(permanent_pool, strlen(path) + 64);
+  snprintf(info, strlen(path) + 63, "/file=%s&size=%lu", path, size);
+
+  mpid = getpid();
+  tls_shmcache_module.init();
+  if (bench_cache == NULL) {
+    fprintf(stderr, "mod_tls_shmcache did not register its cache\n");
+    return 1;
+  }
+
+  if (bench_cache->open(bench_cache, info, 3600) < 0) {
+    fprintf(stderr, "error opening cache '%s': %s\n", info, strerror(errno));
+    return 1;
+  }
+
+  /* Every process adds the same session data, under its own session IDs;
+   * only the IDs matter to the cache.  The session needs a cipher and a
+   * master key, so that it can be deserialized again.
+   */
+  sess = bench_get_sess();
+  if (sess == NULL) {
+    fprintf(stderr, "error creating SSL session\n");
+    return 1;
+  }
+
+  printf("%u iterations (add + get) per process, %lu byte cache\n\n", niters,
+    size);
+  printf("%5s %14s %10s %9s\n", "procs", "ops/sec", "secs", "get hits");
+
+  ptr = procs;
+  while (ptr != NULL &&
+         *ptr) {
+    unsigned int nprocs;
+
+    nprocs = strtoul(ptr, &ptr, 10);
+    if (nprocs > 0) {
+      res = bench_run(nprocs, niters, sess);
+      if (res < 0) {
+        break;
+      }
+    }
+
+    if (*ptr == ',') {
+      ptr++;
+
+    } else if (*ptr != '\0') {
+      fprintf(stderr, "badly formatted process counts '%s'\n", procs);
+      res = -1;
+      break;
+    }
+  }
+
+  SSL_SESSION_free(sess);
+
+  bench_cache->remove(bench_cache);
+  unlink(path);
+
+  return res < 0 ? 1 : 0;
+}
@@ -0,0 +1,164 @@
+/*
+ * ProFTPD - FTP server testsuite
+ * Copyright (c) 2015 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project team and other respective
+ * copyright holders give permission to link this program with OpenSSL, and
+ * distribute the resulting executable, without including the source code for
+ * OpenSSL in the source distribution.
+ */
+
+/* Benchmark for trace points which do not log.
+ *
+ * This measures the cost of a "data" trace point at level 4, which is not
+ * logged, when called directly using pr_trace_msg(), and when guarded by a
+ * trace channel handle, i.e. pr_trace_chan_enabled().  This is done with no
+ * Trace configured, with only another channel configured, and with the
+ * "data" channel configured below level 4.  Run it using "make bench-trace".
+ */
+
+#include "conf.h"
+#include "privs.h"
+
+#include <sys/time.h>
+
+static pr_trace_chan_t bench_chan = PR_TRACE_CHAN("data");
+static const char *trace_channel = "data";
+
+/* Stubs */
+
+session_t session;
+
+void pr_alarms_block(void) {
+}
+
+void pr_alarms_unblock(void) {
+}
+
+struct tm *pr_localtime(pool *p, const time_t *t) {
+  return localtime(t);
+}
+
+void pr_log_debug(int level, const char *fmt, ...) {
+}
+
+void pr_log_pri(int prio, const char *fmt, ...) {
+}
+
+int pr_log_event_generate(unsigned int log_type, int log_fd, int log_level,
+    const char *log_msg, size_t log_msglen) {
+  return 0;
+}
+
+/* Same as the real thing, so that its cost is included in pr_trace_msg(). */
+int pr_log_event_listening(unsigned int log_type) {
+  return pr_event_listening("core.log.tracelog") > 0 ? TRUE : FALSE;
+}
+
+int pr_log_openfile(const char *path, int *log_fd, mode_t log_mode) {
+  *log_fd = open(path, O_WRONLY|O_CREAT|O_APPEND, log_mode);
+  return *log_fd < 0 ? -1 : 0;
+}
+
+const char *pr_netaddr_get_ipstr(pr_netaddr_t *addr) {
+  return "127.0.0.1";
+}
+
+unsigned int pr_netaddr_get_port(const pr_netaddr_t *addr) {
+  return 0;
+}
+
+int pr_privs_relinquish(const char *file, int lineno) {
+  return 0;
+}
+
+int pr_privs_root(const char *file, int lineno) {
+  return 0;
+}
+
+void pr_signals_block(void) {
+}
+
+void pr_signals_handle(void) {
+}
+
+void pr_signals_unblock(void) {
+}
+
+/* Benchmark */
+
+static double bench_now(void) {
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + (tv.tv_usec / 1000000.0);
+}
+
+static void bench_run(const char *label, unsigned int niters) {
+  register unsigned int i;
+  double start, msg_ns, chan_ns;
+
+  start = bench_now();
+  for (i = 0; i < niters; i++) {
+    pr_trace_msg(trace_channel, 4,
+      "read %u bytes from data connection", i);
+  }
+  msg_ns = (bench_now() - start) * 1000000000.0 / niters;
+
+  start = bench_now();
+  for (i = 0; i < niters; i++) {
+    if (pr_trace_chan_enabled(&bench_chan, 4)) {
+      pr_trace_msg(bench_chan.channel, 4,
+        "read %u bytes from data connection", i);
+    }
+  }
+  chan_ns = (bench_now() - start) * 1000000000.0 / niters;
+
+  printf("%-32s %15.1f %15.1f\n", label, msg_ns, chan_ns);
+}
+
+int main(int argc, char *argv[]) {
+  unsigned int niters = 10000000;
+
+  if (argc > 1) {
+    niters = atoi(argv[1]);
+    if (niters == 0) {
+      fprintf(stdout, "usage: %s [iterations]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  init_pools();
+
+  printf("%u calls each, ns/call\n\n", niters);
+  printf("%-32s %15s %15s\n", "", "pr_trace_msg", "handle");
+
+  bench_run("no Trace configured", niters);
+
+  if (pr_trace_set_file("/dev/null") < 0) {
+    fprintf(stderr, "error setting trace file: %s\n", strerror(errno));
+    return 1;
+  }
+
+  pr_trace_set_levels("auth", 1, 10);
+  bench_run("Trace auth:10", niters);
+
+  pr_trace_set_levels("data", 1, 3);
+  bench_run("Trace auth:10 data:3", niters);
+
+  return 0;
+}
@@ -0,0 +1,170 @@
+/*
+ * ProFTPD - FTP server testsuite
+ * Copyright (c) 2015 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project team and other respective
+ * copyright holders give permission to link this program with OpenSSL, and
+ * distribute the resulting executable, without including the source code for
+ * OpenSSL in the source distribution.
+ */
+
+/* Benchmark for the TransferLog formats.
+ *
+ * This times xferlog_write() for the same transfer, in the text and in the
+ * binary TransferLog formats, writing to /dev/null (or to the given file),
+ * so that the cost of formatting each record can be compared.  Run it using
+ * "make bench-xferlog".
+ */
+
+#include "conf.h"
+
+#include <sys/time.h>
+
+/* Stubs */
+
+session_t session;
+
+void pr_alarms_block(void) {
+}
+
+void pr_alarms_unblock(void) {
+}
+
+void pr_log_debug(int level, const char *fmt, ...) {
+}
+
+void pr_log_pri(int prio, const char *fmt, ...) {
+}
+
+int pr_log_event_generate(unsigned int log_type, int log_fd, int log_level,
+    const char *log_msg, size_t log_msglen) {
+  return 0;
+}
+
+int pr_log_event_listening(unsigned int log_type) {
+  return FALSE;
+}
+
+int pr_log_openfile(const char *path, int *log_fd, mode_t log_mode) {
+  *log_fd = open(path, O_WRONLY|O_CREAT|O_APPEND, log_mode);
+  return *log_fd < 0 ? -1 : 0;
+}
+
+/* Without a LogShipper, records are written directly. */
+int pr_logship_write(int fd, const char *buf, size_t buflen) {
+  return write(fd, buf, buflen);
+}
+
+const char *pr_session_get_protocol(int flags) {
+  return "ftp";
+}
+
+void pr_signals_handle(void) {
+}
+
+/* Same as pr_strtime() in src/support.c, which the text format uses. */
+const char *pr_strtime(time_t t) {
+  static char buf[64];
+  static char *mons[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul",
+    "Aug", "Sep", "Oct", "Nov", "Dec" };
+  static char *days[] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+  struct tm *tr;
+
+  memset(buf, '\0', sizeof(buf));
+
+  tr = localtime(&t);
+  if (tr != NULL) {
+    snprintf(buf, sizeof(buf), "%s %s %02d %02d:%02d:%02d %d",
+      days[tr->tm_wday], mons[tr->tm_mon], tr->tm_mday, tr->tm_hour,
+      tr->tm_min, tr->tm_sec, tr->tm_year + 1900);
+  }
+
+  buf[sizeof(buf)-1] = '\0';
+  return buf;
+}
+
+int pr_trace_msg(const char *channel, int level, const char *fmt, ...) {
+  return 0;
+}
+
+/* Benchmark */
+
+static double bench_now(void) {
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + (tv.tv_usec / 1000000.0);
+}
+
+static void bench_run(const char *label, int fmt, unsigned int niters) {
+  register unsigned int i;
+  double start;
+
+  xferlog_set_format(fmt);
+
+  start = bench_now();
+  for (i = 0; i < niters; i++) {
+    xferlog_write(3, "203.0.113.45", 1048576 + i,
+      "/home/customer/uploads/data file.bin", 'b', 'i', 'r', "customer",
+      'c', "_");
+  }
+
+  printf("%-8s %10.0f ns/record\n", label,
+    (bench_now() - start) * 1000000000.0 / niters);
+}
+
+int main(int argc, char *argv[]) {
+  const char *path = "/dev/null";
+  unsigned int niters = 1000000;
+
+  if (argc > 1) {
+    niters = atoi(argv[1]);
+    if (niters == 0) {
+      fprintf(stdout, "usage: %s [iterations [path]]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  if (argc > 2) {
+    path = argv[2];
+  }
+
+  init_pools();
+
+  /* Like pr_auth_chroot(), make sure TZ is set, so that localtime(3) does
+   * not check the zoneinfo file for every record.
+   */
+  tzset();
+  if (getenv("TZ") == NULL) {
+    setenv("TZ", tzname[0], 1);
+  }
+
+  session.xfer.start_time.tv_sec = 1;
+
+  if (xferlog_open(path) < 0) {
+    fprintf(stderr, "error opening '%s': %s\n", path, strerror(errno));
+    return 1;
+  }
+
+  printf("%u records each, to %s\n\n", niters, path);
+
+  bench_run("text", PR_XFERLOG_FMT_TEXT, niters);
+  bench_run("binary", PR_XFERLOG_FMT_BINARY, niters);
+
+  xferlog_close();
+  return 0;
+}
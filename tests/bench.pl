@@ -0,0 +1,898 @@
+#!/usr/bin/env perl
+
+# Benchmark harness for the mod_tls (FTPS) and mod_sftp code paths.
+#
+# For each requested mode (explicit FTPS, implicit FTPS, SFTP) and cipher,
+# this starts the uninstalled proftpd on the loopback interface with a
+# generated configuration, then drives a number of concurrent clients
+# against it in two phases:
+#
+#   handshake   clients repeatedly connect, log in, LIST, and disconnect, for
+#               the configured duration; this measures handshakes/sec, connect
+#               latency, and (for FTPS) the data channel session resumption
+#               hit rate, as reported by mod_tls in the TLSLog.
+#
+#   transfer    each client does one RETR and one STOR of a file of the
+#               configured size; this measures bulk crypto throughput.
+#
+# The FTPS session cache (--session-cache), session tickets
+# (--session-tickets), and whether clients try to resume sessions at all
+# (--resume) can be set, so that their effect on handshakes/sec and the
+# resumption rate can be measured.
+#
+# The results are printed as a table, and can be written out as JSON (using
+# --output) for comparison against the results of a different build (using
+# --compare).
+
+use strict;
+
+use Cwd qw(abs_path);
+use File::Path qw(rmtree);
+use File::Spec;
+use Getopt::Long;
+use IO::Handle;
+use POSIX qw(:sys_wait_h);
+use Time::HiRes qw(gettimeofday tv_interval);
+
+my $opts = {};
+GetOptions($opts, 'h|help', 'c|clients=i', 'd|duration=i', 's|size=i',
+  'm|mode=s@', 'cipher=s@', 'sftp-cipher=s@', 'session-cache=s',
+  'session-tickets=s', 'resume=s', 'o|output=s', 'compare=s', 'label=s',
+  'K|keep-tmpfiles', 'V|verbose');
+
+if ($opts->{h}) {
+  usage();
+}
+
+if ($opts->{K}) {
+  $ENV{KEEP_TMPFILES} = 1;
+}
+
+if ($opts->{V}) {
+  $ENV{TEST_VERBOSE} = 1;
+}
+
+my $test_dir = (File::Spec->splitpath(abs_path(__FILE__)))[1];
+push(@INC, "$test_dir/t/lib");
+
+require ProFTPD::TestSuite::Utils;
+import ProFTPD::TestSuite::Utils qw(:auth :config :features :running
+  :testsuite);
+
+unless (defined($ENV{PROFTPD_TEST_BIN})) {
+  $ENV{PROFTPD_TEST_BIN} = File::Spec->catfile($test_dir, '..', 'proftpd');
+}
+
+$ENV{PROFTPD_TEST_PATH} = $test_dir;
+
+$| = 1;
+
+my $nclients = $opts->{c} || 4;
+my $duration = $opts->{d} || 10;
+
+# The transfer file size is given in MB.
+my $file_size = ($opts->{s} || 8) * 1024 * 1024;
+
+my $modes = [qw(explicit implicit sftp)];
+if (defined($opts->{m})) {
+  $modes = [split(/,/, join(',', @{ $opts->{m} }))];
+}
+
+# An empty FTPS cipher means "use the server's default TLSCipherSuite"; an
+# empty SFTP cipher means "let the client and server negotiate".
+my $ftps_ciphers = [''];
+if (defined($opts->{cipher})) {
+  $ftps_ciphers = [split(/,/, join(',', @{ $opts->{cipher} }))];
+}
+
+my $sftp_ciphers = [''];
+if (defined($opts->{'sftp-cipher'})) {
+  $sftp_ciphers = [split(/,/, join(',', @{ $opts->{'sftp-cipher'} }))];
+}
+
+# The FTPS session cache is one of "off", "internal" (OpenSSL's own
+# per-process cache), or "shm" (mod_tls_shmcache); by default, none is
+# configured.  Session tickets are left at the server's default unless
+# --session-tickets is given.
+my $session_cache = $opts->{'session-cache'};
+if (defined($session_cache) &&
+    $session_cache !~ /^(off|internal|shm)$/) {
+  die("Unknown session cache '$session_cache' (use off, internal, or shm)\n");
+}
+
+my $session_tickets = $opts->{'session-tickets'};
+if (defined($session_tickets) &&
+    $session_tickets !~ /^(on|off)$/) {
+  die("Bad --session-tickets value '$session_tickets' (use on or off)\n");
+}
+
+# With resumption on (the default), each FTPS client reuses its control
+# channel session for its data channels, and offers its last session when
+# it reconnects.  With resumption off, every handshake is a full one, and
+# the server is configured not to require data channel session reuse.
+my $resume = defined($opts->{resume}) ? $opts->{resume} : 'on';
+unless ($resume =~ /^(on|off)$/) {
+  die("Bad --resume value '$resume' (use on or off)\n");
+}
+
+my $results = {
+  version => scalar(feature_get_version()),
+  label => defined($opts->{label}) ? $opts->{label} : '',
+  date => scalar(gmtime()),
+  clients => $nclients,
+  duration => $duration,
+  file_size => $file_size,
+  session_cache => defined($session_cache) ? $session_cache : 'default',
+  session_tickets => defined($session_tickets) ? $session_tickets : 'default',
+  resume => $resume,
+  results => [],
+};
+
+foreach my $mode (@$modes) {
+  unless ($mode =~ /^(explicit|implicit|sftp)$/) {
+    die("Unknown benchmark mode '$mode' (use explicit, implicit, or sftp)\n");
+  }
+
+  my $module = ($mode eq 'sftp' ? 'mod_sftp.c' : 'mod_tls.c');
+  unless (feature_have_module_compiled($module)) {
+    print STDERR "$module not compiled into proftpd, skipping $mode\n";
+    next;
+  }
+
+  my $ciphers = ($mode eq 'sftp' ? $sftp_ciphers : $ftps_ciphers);
+  foreach my $cipher (@$ciphers) {
+    my $res = bench_run($mode, $cipher);
+    push(@{ $results->{results} }, $res);
+  }
+}
+
+print_results($results);
+
+if ($opts->{o}) {
+  require JSON::PP;
+
+  my $json = JSON::PP->new->canonical(1)->pretty(1);
+  if (open(my $fh, "> $opts->{o}")) {
+    print $fh $json->encode($results);
+
+    unless (close($fh)) {
+      die("Can't write $opts->{o}: $!\n");
+    }
+
+  } else {
+    die("Can't open $opts->{o}: $!\n");
+  }
+}
+
+if ($opts->{compare}) {
+  compare_results($opts->{compare}, $results);
+}
+
+exit 0;
+
+sub bench_run {
+  my $mode = shift;
+  my $cipher = shift;
+
+  my $tmpdir = testsuite_get_tmp_dir();
+
+  my $config_file = "$tmpdir/bench.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/bench.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/bench.scoreboard");
+  my $log_file = File::Spec->rel2abs("$tmpdir/bench.log");
+  my $tls_log_file = File::Spec->rel2abs("$tmpdir/tls.log");
+
+  my $auth_user_file = File::Spec->rel2abs("$tmpdir/bench.passwd");
+  my $auth_group_file = File::Spec->rel2abs("$tmpdir/bench.group");
+
+  my $user = 'proftpd';
+  my $passwd = 'test';
+  my $group = 'ftpd';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+  my $uid = 500;
+  my $gid = 500;
+
+  if ($< == 0) {
+    unless (chown($uid, $gid, $home_dir)) {
+      die("Can't set owner of $home_dir to $uid/$gid: $!\n");
+    }
+
+  } else {
+    $uid = $<;
+    $gid = (split(' ', $())[0];
+  }
+
+  auth_user_write($auth_user_file, $user, $passwd, $uid, $gid, $home_dir,
+    '/bin/bash');
+  auth_group_write($auth_group_file, $group, $gid, $user);
+
+  # Every client RETRs the same file; each STORs to its own file.
+  my $src_file = File::Spec->rel2abs("$tmpdir/bench.dat");
+  write_file($src_file, $file_size);
+
+  my $config = {
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+
+    AuthUserFile => $auth_user_file,
+    AuthGroupFile => $auth_group_file,
+
+    MaxInstances => $nclients * 4,
+    MaxClients => 'none',
+    MaxClientsPerHost => 'none',
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+    },
+  };
+
+  if ($mode eq 'sftp') {
+    # mod_sftp insists on restrictive permissions for its host keys, so
+    # use a copy rather than changing the files in the tree.
+    my $rsa_host_key = File::Spec->rel2abs("$tmpdir/ssh_host_rsa_key");
+    copy_file("$test_dir/t/etc/modules/mod_sftp/ssh_host_rsa_key",
+      $rsa_host_key);
+    chmod(0400, $rsa_host_key);
+
+    $config->{IfModules}->{'mod_sftp.c'} = [
+      "SFTPEngine on",
+      "SFTPLog $tls_log_file",
+      "SFTPHostKey $rsa_host_key",
+    ];
+
+  } else {
+    my $cert_file = "$test_dir/t/etc/modules/mod_tls/server-cert.pem";
+    my $ca_file = "$test_dir/t/etc/modules/mod_tls/ca-cert.pem";
+
+    $config->{IfModules}->{'mod_tls.c'} = {
+      TLSEngine => 'on',
+      TLSLog => $tls_log_file,
+      TLSRequired => 'on',
+      TLSRSACertificateFile => $cert_file,
+      TLSCACertificateFile => $ca_file,
+    };
+
+    if ($cipher ne '') {
+      $config->{IfModules}->{'mod_tls.c'}->{TLSCipherSuite} = $cipher;
+    }
+
+    my $tls_opts = [];
+
+    if ($mode eq 'implicit') {
+      push(@$tls_opts, 'UseImplicitSSL');
+    }
+
+    if ($resume eq 'off') {
+      push(@$tls_opts, 'NoSessionReuseRequired');
+    }
+
+    if (scalar(@$tls_opts) > 0) {
+      $config->{IfModules}->{'mod_tls.c'}->{TLSOptions} =
+        join(' ', @$tls_opts);
+    }
+
+    if (defined($session_cache)) {
+      if ($session_cache eq 'off') {
+        $config->{IfModules}->{'mod_tls.c'}->{TLSSessionCache} = 'off';
+
+      } elsif ($session_cache eq 'internal') {
+        $config->{IfModules}->{'mod_tls.c'}->{TLSSessionCache} = 'internal:';
+
+      } else {
+        unless (feature_have_module_compiled('mod_tls_shmcache.c')) {
+          die("mod_tls_shmcache.c not compiled into proftpd, " .
+            "cannot use --session-cache=shm\n");
+        }
+
+        my $shm_path = File::Spec->rel2abs("$tmpdir/sesscache");
+        $config->{IfModules}->{'mod_tls.c'}->{TLSSessionCache} =
+          "shm:/file=$shm_path";
+      }
+    }
+
+    if (defined($session_tickets)) {
+      $config->{IfModules}->{'mod_tls.c'}->{TLSSessionTickets} =
+        $session_tickets;
+    }
+  }
+
+  my ($port, $config_user, $config_group) = config_write($config_file,
+    $config);
+
+  my $label = ($cipher ne '' ? $cipher : 'default');
+  print STDOUT "Benchmarking $mode ($label) with $nclients clients...\n";
+
+  server_start($config_file, $pid_file);
+
+  my $client = {
+    mode => $mode,
+    cipher => $cipher,
+    port => $port,
+    user => $user,
+    passwd => $passwd,
+    src_file => $src_file,
+    tmpdir => $tmpdir,
+  };
+
+  my $res = {
+    mode => $mode,
+    cipher => $label,
+  };
+
+  eval {
+    my $handshakes = run_clients($client, 'handshake');
+
+    my $nsessions = 0;
+    my $errors = 0;
+    my $latencies = [];
+
+    foreach my $stats (@$handshakes) {
+      $nsessions += $stats->{sessions};
+      $errors += $stats->{errors};
+      push(@$latencies, @{ $stats->{latencies} });
+    }
+
+    # Each FTPS session does a control and a data channel handshake; each
+    # SFTP session does a single key exchange.
+    my $per_session = ($mode eq 'sftp' ? 1 : 2);
+
+    $res->{sessions} = $nsessions;
+    $res->{handshakes_per_sec} = round($nsessions * $per_session / $duration);
+    $res->{connect_ms_p50} = round(percentile($latencies, 50));
+    $res->{connect_ms_p99} = round(percentile($latencies, 99));
+
+    my $transfers = run_clients($client, 'transfer');
+
+    my ($retr_bytes, $retr_secs, $stor_bytes, $stor_secs) = (0, 0, 0, 0);
+    foreach my $stats (@$transfers) {
+      $errors += $stats->{errors};
+      $retr_bytes += $stats->{retr_bytes};
+      $stor_bytes += $stats->{stor_bytes};
+
+      # The clients run concurrently, so the aggregate rate is the total
+      # bytes moved over the time taken by the slowest client.
+      $retr_secs = $stats->{retr_secs} if $stats->{retr_secs} > $retr_secs;
+      $stor_secs = $stats->{stor_secs} if $stats->{stor_secs} > $stor_secs;
+    }
+
+    $res->{retr_mb_per_sec} = $retr_secs > 0 ?
+      round($retr_bytes / $retr_secs / (1024 * 1024)) : 0;
+    $res->{stor_mb_per_sec} = $stor_secs > 0 ?
+      round($stor_bytes / $stor_secs / (1024 * 1024)) : 0;
+    $res->{errors} = $errors;
+  };
+  my $ex = $@;
+
+  server_stop($pid_file);
+
+  if ($mode ne 'sftp') {
+    # mod_tls logs its handshake counts when each session ends, so this has
+    # to wait until the server, and thus all of the sessions, have stopped.
+    my ($nhandshakes, $nresumed) = tls_log_handshakes($tls_log_file);
+    $res->{resumption_rate} = $nhandshakes > 0 ?
+      round($nresumed / $nhandshakes) : 0;
+  }
+
+  if ($ex) {
+    print STDERR "$mode ($label): $ex";
+    $res->{error} = "$ex";
+    chomp($res->{error});
+  }
+
+  unless ($ENV{KEEP_TMPFILES}) {
+    rmtree($tmpdir);
+  }
+
+  return $res;
+}
+
+# Forks a client process per configured client, each running the given
+# phase, and collects their results.  Each client reports a single line of
+# "key=value" pairs back to the parent over a pipe.
+sub run_clients {
+  my $client = shift;
+  my $phase = shift;
+
+  my $children = {};
+
+  for (my $i = 0; $i < $nclients; $i++) {
+    my ($rfh, $wfh);
+    unless (pipe($rfh, $wfh)) {
+      die("Can't open pipe: $!\n");
+    }
+
+    my $pid = fork();
+    unless (defined($pid)) {
+      die("Can't fork: $!\n");
+    }
+
+    if ($pid == 0) {
+      close($rfh);
+
+      my $stats;
+      if ($phase eq 'handshake') {
+        $stats = client_handshakes($client, $i);
+
+      } else {
+        $stats = client_transfers($client, $i);
+      }
+
+      my @pairs;
+      foreach my $key (sort(keys(%$stats))) {
+        my $val = $stats->{$key};
+        $val = join(',', @$val) if ref($val) eq 'ARRAY';
+        push(@pairs, "$key=$val");
+      }
+
+      print $wfh join(' ', @pairs), "\n";
+      $wfh->flush();
+      close($wfh);
+
+      # Use POSIX::_exit, so that the parent's END blocks and temporary
+      # file cleanup are not run in the child.
+      POSIX::_exit(0);
+    }
+
+    close($wfh);
+    $children->{$pid} = $rfh;
+  }
+
+  my $results = [];
+
+  foreach my $pid (keys(%$children)) {
+    my $rfh = $children->{$pid};
+    my $line = <$rfh>;
+    close($rfh);
+    waitpid($pid, 0);
+
+    my $stats = {
+      sessions => 0,
+      errors => 1,
+      latencies => [],
+      retr_bytes => 0,
+      retr_secs => 0,
+      stor_bytes => 0,
+      stor_secs => 0,
+    };
+
+    if (defined($line)) {
+      chomp($line);
+
+      foreach my $pair (split(' ', $line)) {
+        my ($key, $val) = split(/=/, $pair, 2);
+        $val = [split(/,/, $val)] if $key eq 'latencies';
+        $stats->{$key} = $val;
+      }
+    }
+
+    push(@$results, $stats);
+  }
+
+  return $results;
+}
+
+sub client_handshakes {
+  my $client = shift;
+  my $idx = shift;
+
+  my $stats = {
+    sessions => 0,
+    errors => 0,
+    latencies => [],
+  };
+
+  my $deadline = [gettimeofday()];
+
+  while (tv_interval($deadline) < $duration) {
+    my $start = [gettimeofday()];
+
+    eval {
+      if ($client->{mode} eq 'sftp') {
+        my $ssh2 = sftp_connect($client);
+
+        # Measure the latency of the connect, key exchange, and
+        # authentication, matching what is measured for FTPS.
+        push(@{ $stats->{latencies} },
+          round(tv_interval($start) * 1000));
+
+        my $sftp = $ssh2->sftp();
+        unless ($sftp) {
+          die("Can't start SFTP session: " . join(' ', $ssh2->error()));
+        }
+
+        my $dir = $sftp->opendir('.');
+        unless ($dir) {
+          die("Can't open directory: " . join(' ', $sftp->error()));
+        }
+
+        while ($dir->read()) {
+        }
+
+        $dir = undef;
+        $sftp = undef;
+        $ssh2->disconnect();
+
+      } else {
+        my $ftps = ftps_connect($client);
+
+        push(@{ $stats->{latencies} },
+          round(tv_interval($start) * 1000));
+
+        my $list = $ftps->nlst();
+        unless ($list) {
+          die("NLST failed: " . $ftps->last_message());
+        }
+
+        $ftps->quit();
+      }
+
+      $stats->{sessions}++;
+    };
+
+    if ($@) {
+      $stats->{errors}++;
+      print STDERR "client #$idx: $@" if $ENV{TEST_VERBOSE};
+    }
+  }
+
+  return $stats;
+}
+
+sub client_transfers {
+  my $client = shift;
+  my $idx = shift;
+
+  my $stats = {
+    errors => 0,
+    retr_bytes => 0,
+    retr_secs => 0,
+    stor_bytes => 0,
+    stor_secs => 0,
+  };
+
+  my $dst_file = "bench-$idx.dat";
+
+  eval {
+    if ($client->{mode} eq 'sftp') {
+      my $ssh2 = sftp_connect($client);
+
+      my $sftp = $ssh2->sftp();
+      unless ($sftp) {
+        die("Can't start SFTP session: " . join(' ', $ssh2->error()));
+      }
+
+      my $start = [gettimeofday()];
+      my $fh = $sftp->open('bench.dat', POSIX::O_RDONLY());
+      unless ($fh) {
+        die("Can't open bench.dat: " . join(' ', $sftp->error()));
+      }
+
+      my $buf;
+      my $nread = 0;
+      while (my $len = $fh->read($buf, 32768)) {
+        $nread += $len;
+      }
+      $fh = undef;
+
+      $stats->{retr_secs} = tv_interval($start);
+      $stats->{retr_bytes} = $nread;
+
+      $start = [gettimeofday()];
+      $fh = $sftp->open($dst_file,
+        POSIX::O_WRONLY()|POSIX::O_CREAT()|POSIX::O_TRUNC(), 0644);
+      unless ($fh) {
+        die("Can't open $dst_file: " . join(' ', $sftp->error()));
+      }
+
+      $buf = 'A' x 32768;
+      my $nwritten = 0;
+      while ($nwritten < $file_size) {
+        my $len = $file_size - $nwritten;
+        $len = 32768 if $len > 32768;
+        print $fh substr($buf, 0, $len);
+        $nwritten += $len;
+      }
+
+      # Closing the handle waits for the outstanding writes.
+      $fh = undef;
+
+      $stats->{stor_secs} = tv_interval($start);
+      $stats->{stor_bytes} = $nwritten;
+
+      $sftp = undef;
+      $ssh2->disconnect();
+
+    } else {
+      my $ftps = ftps_connect($client);
+
+      my $start = [gettimeofday()];
+      unless ($ftps->get('bench.dat', '/dev/null')) {
+        die("RETR failed: " . $ftps->last_message());
+      }
+
+      $stats->{retr_secs} = tv_interval($start);
+      $stats->{retr_bytes} = $file_size;
+
+      $start = [gettimeofday()];
+      unless ($ftps->put($client->{src_file}, $dst_file)) {
+        die("STOR failed: " . $ftps->last_message());
+      }
+
+      $stats->{stor_secs} = tv_interval($start);
+      $stats->{stor_bytes} = $file_size;
+
+      $ftps->quit();
+    }
+  };
+
+  if ($@) {
+    $stats->{errors}++;
+    print STDERR "client #$idx: $@" if $ENV{TEST_VERBOSE};
+  }
+
+  return $stats;
+}
+
+sub ftps_connect {
+  my $client = shift;
+
+  require Net::FTPSSL;
+
+  my $ssl_opts = {};
+
+  if ($resume eq 'on') {
+    # Keep one client session cache for the life of this client process, so
+    # that each new connection offers the session (or ticket) from the
+    # last one.
+    unless (defined($client->{session_cache})) {
+      $client->{session_cache} = IO::Socket::SSL::Session_Cache->new(16);
+    }
+
+    $ssl_opts->{SSL_session_cache} = $client->{session_cache};
+    $ssl_opts->{SSL_session_key} = "127.0.0.1:$client->{port}";
+  }
+
+  my $ftps = Net::FTPSSL->new('127.0.0.1',
+    Encryption => ($client->{mode} eq 'implicit' ? 'I' : 'E'),
+    Port => $client->{port},
+    ReuseSession => ($resume eq 'on' ? 1 : 0),
+    SSL_Client_Certificate => $ssl_opts,
+  );
+
+  unless ($ftps) {
+    die("Can't connect to FTPS server: " . IO::Socket::SSL::errstr());
+  }
+
+  unless ($ftps->login($client->{user}, $client->{passwd})) {
+    die("Can't login: " . $ftps->last_message());
+  }
+
+  $ftps->binary();
+  return $ftps;
+}
+
+sub sftp_connect {
+  my $client = shift;
+
+  require Net::SSH2;
+
+  my $ssh2 = Net::SSH2->new();
+
+  if ($client->{cipher} ne '') {
+    $ssh2->method('crypt_cs', $client->{cipher});
+    $ssh2->method('crypt_sc', $client->{cipher});
+  }
+
+  unless ($ssh2->connect('127.0.0.1', $client->{port})) {
+    die("Can't connect to SSH2 server: " . join(' ', $ssh2->error()));
+  }
+
+  unless ($ssh2->auth_password($client->{user}, $client->{passwd})) {
+    die("Can't login to SSH2 server: " . join(' ', $ssh2->error()));
+  }
+
+  return $ssh2;
+}
+
+# Sums the per-session handshake counts which mod_tls logs at session end,
+# e.g. "[stat]: SSL handshakes: 2 (1 resumed, 0 using session tickets)".
+sub tls_log_handshakes {
+  my $log_file = shift;
+
+  my ($nhandshakes, $nresumed) = (0, 0);
+
+  if (open(my $fh, "< $log_file")) {
+    while (my $line = <$fh>) {
+      if ($line =~ /SSL handshakes: (\d+) \((\d+) resumed/) {
+        $nhandshakes += $1;
+        $nresumed += $2;
+      }
+    }
+
+    close($fh);
+  }
+
+  return ($nhandshakes, $nresumed);
+}
+
+sub print_results {
+  my $results = shift;
+
+  printf STDOUT "\nproftpd %s%s, %d clients, %ds handshake phase, " .
+    "%d MB transfers\n", $results->{version},
+    $results->{label} ne '' ? " ($results->{label})" : '',
+    $results->{clients}, $results->{duration},
+    $results->{file_size} / (1024 * 1024);
+  printf STDOUT "FTPS session cache %s, session tickets %s, resumption " .
+    "%s\n\n", $results->{session_cache}, $results->{session_tickets},
+    $results->{resume};
+
+  printf STDOUT "%-9s %-28s %10s %8s %8s %7s %9s %9s %6s\n", 'mode',
+    'cipher', 'hs/sec', 'p50 ms', 'p99 ms', 'resume', 'RETR MB/s',
+    'STOR MB/s', 'errors';
+
+  foreach my $res (@{ $results->{results} }) {
+    printf STDOUT "%-9s %-28s %10s %8s %8s %7s %9s %9s %6s\n", $res->{mode},
+      $res->{cipher}, fmt($res->{handshakes_per_sec}),
+      fmt($res->{connect_ms_p50}), fmt($res->{connect_ms_p99}),
+      fmt($res->{resumption_rate}), fmt($res->{retr_mb_per_sec}),
+      fmt($res->{stor_mb_per_sec}), fmt($res->{errors});
+  }
+
+  print STDOUT "\n";
+}
+
+# Compares the given results against those previously written out using
+# --output, printing the relative change of each metric.
+sub compare_results {
+  my $path = shift;
+  my $results = shift;
+
+  require JSON::PP;
+
+  my $prev;
+  if (open(my $fh, "< $path")) {
+    local $/;
+    $prev = JSON::PP->new->decode(<$fh>);
+    close($fh);
+
+  } else {
+    die("Can't open $path: $!\n");
+  }
+
+  my $metrics = [qw(
+    handshakes_per_sec
+    connect_ms_p50
+    connect_ms_p99
+    resumption_rate
+    retr_mb_per_sec
+    stor_mb_per_sec
+  )];
+
+  printf STDOUT "Compared with %s%s", $prev->{version},
+    $prev->{label} ne '' ? " ($prev->{label})" : '';
+
+  # Results written by older versions of this script do not record the
+  # session settings.
+  if (defined($prev->{resume})) {
+    printf STDOUT " (session cache %s, session tickets %s, resumption %s)",
+      $prev->{session_cache}, $prev->{session_tickets}, $prev->{resume};
+  }
+
+  print STDOUT ":\n\n";
+
+  foreach my $res (@{ $results->{results} }) {
+    my ($old) = grep { $_->{mode} eq $res->{mode} &&
+      $_->{cipher} eq $res->{cipher} } @{ $prev->{results} };
+    next unless $old;
+
+    my @changes;
+    foreach my $metric (@$metrics) {
+      next unless defined($res->{$metric}) && defined($old->{$metric});
+      next if $old->{$metric} == 0;
+
+      push(@changes, sprintf("%s %+.1f%%", $metric,
+        ($res->{$metric} - $old->{$metric}) * 100 / $old->{$metric}));
+    }
+
+    printf STDOUT "%-9s %-28s %s\n", $res->{mode}, $res->{cipher},
+      join(', ', @changes);
+  }
+
+  print STDOUT "\n";
+}
+
+sub percentile {
+  my $samples = shift;
+  my $pct = shift;
+
+  return 0 unless scalar(@$samples) > 0;
+
+  my @sorted = sort { $a <=> $b } @$samples;
+  my $idx = int(($pct / 100) * (scalar(@sorted) - 1) + 0.5);
+  return $sorted[$idx];
+}
+
+sub round {
+  my $val = shift;
+  return sprintf("%.2f", $val) + 0;
+}
+
+sub fmt {
+  my $val = shift;
+  return defined($val) ? $val : '-';
+}
+
+sub write_file {
+  my $path = shift;
+  my $size = shift;
+
+  if (open(my $fh, "> $path")) {
+    my $buf = 'ABCDefgh' x 4096;
+
+    my $nwritten = 0;
+    while ($nwritten < $size) {
+      my $len = $size - $nwritten;
+      $len = length($buf) if $len > length($buf);
+      print $fh substr($buf, 0, $len);
+      $nwritten += $len;
+    }
+
+    unless (close($fh)) {
+      die("Can't write $path: $!\n");
+    }
+
+  } else {
+    die("Can't open $path: $!\n");
+  }
+}
+
+sub copy_file {
+  my $src = shift;
+  my $dst = shift;
+
+  if (open(my $in, "< $src")) {
+    if (open(my $out, "> $dst")) {
+      local $/;
+      my $data = <$in>;
+      print $out $data;
+
+      unless (close($out)) {
+        die("Can't write $dst: $!\n");
+      }
+
+    } else {
+      die("Can't open $dst: $!\n");
+    }
+
+    close($in);
+
+  } else {
+    die("Can't open $src: $!\n");
+  }
+}
+
+sub usage {
+  print STDOUT <<EOH;
+
+$0: [--help] [--clients=\$n] [--duration=\$secs] [--size=\$mb]
+  [--mode=explicit,implicit,sftp] [--cipher=\$name] [--sftp-cipher=\$name]
+  [--session-cache=off|internal|shm] [--session-tickets=on|off]
+  [--resume=on|off] [--output=\$file] [--compare=\$file] [--label=\$text]
+  [--keep-tmpfiles] [--verbose]
+
+Examples:
+
+  perl $0
+  perl $0 --mode explicit --cipher ECDHE-RSA-AES128-GCM-SHA256 --cipher AES256-SHA
+  perl $0 --mode sftp --sftp-cipher aes128-ctr --sftp-cipher aes256-ctr
+  perl $0 --clients 16 --output new.json --compare old.json
+  perl $0 --mode explicit --session-cache shm --session-tickets off
+  perl $0 --mode explicit --resume off --label no-resume
+
+EOH
+  exit 0;
+}
@@ -80,8 +80,8 @@ sub feat_ok {
     },
   };
 
-  # By default, we expect to see 9 lines in the FEAT response
-  my $expected_nfeat = 9;
+  # By default, we expect to see 10 lines in the FEAT response
+  my $expected_nfeat = 10;
 
   my $have_nls = feature_have_feature_enabled('nls');
   if ($have_nls) {
@@ -141,6 +141,7 @@ sub feat_ok {
         ' TVFS' => 1,
         ' MFF modify;UNIX.group;UNIX.mode;' => 1,
         ' MLST modify*;perm*;size*;type*;unique*;UNIX.group*;UNIX.mode*;UNIX.owner*;' => 1,
+        ' MODE B' => 1,
         ' REST STREAM' => 1,
         ' SIZE' => 1,
         'End' => 1,
@@ -20,7 +20,17 @@ my $TESTS = {
     test_class => [qw(forking)],
   },
 
-  mode_block_fails => {
+  mode_block_ok => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
+  mode_block_persistent_data_conn => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
+  mode_block_restart_markers => {
     order => ++$order,
     test_class => [qw(forking)],
   },
@@ -163,7 +173,7 @@ sub mode_stream_ok {
   unlink($log_file);
 }
 
-sub mode_block_fails {
+sub mode_block_ok {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -234,24 +244,392 @@ sub mode_block_fails {
       $client->login($user, $passwd);
 
       my ($resp_code, $resp_msg);
-      eval { ($resp_code, $resp_msg) = $client->mode('block') };
-      unless ($@) {
-        die("MODE succeeded unexpectedly");
+      ($resp_code, $resp_msg) = $client->mode('block');
+
+      my $expected;
+
+      $expected = 200;
+      $self->assert($expected == $resp_code,
+        test_msg("Expected $expected, got $resp_code"));
+
+      $expected = "Mode set to B";
+      $self->assert($expected eq $resp_msg,
+        test_msg("Expected '$expected', got '$resp_msg'"));
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($config_file, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($pid_file);
+
+  $self->assert_child_ok($pid);
+
+  if ($ex) {
+    test_append_logfile($log_file, $ex);
+    unlink($log_file);
+
+    die($ex);
+  }
+
+  unlink($log_file);
+}
+
+sub mode_block_persistent_data_conn {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+
+  my $config_file = "$tmpdir/cmds.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/cmds.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/cmds.scoreboard");
+
+  my $log_file = test_get_logfile();
+
+  my $auth_user_file = File::Spec->rel2abs("$tmpdir/cmds.passwd");
+  my $auth_group_file = File::Spec->rel2abs("$tmpdir/cmds.group");
+
+  my $user = 'proftpd';
+  my $passwd = 'test';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+  my $uid = 500;
+  my $gid = 500;
+
+  # Make sure that, if we're running as root, that the home directory has
+  # permissions/privs set for the account we create
+  if ($< == 0) {
+    unless (chmod(0755, $home_dir)) {
+      die("Can't set perms on $home_dir to 0755: $!");
+    }
+
+    unless (chown($uid, $gid, $home_dir)) {
+      die("Can't set owner of $home_dir to $uid/$gid: $!");
+    }
+  }
+
+  auth_user_write($auth_user_file, $user, $passwd, $uid, $gid, $home_dir,
+    '/bin/bash');
+  auth_group_write($auth_group_file, 'ftpd', $gid, $user);
+
+  my $test_files = {
+    'a.txt' => "Hello, World!\n",
+    'b.txt' => ("ABCDefgh" x 16384),
+  };
+
+  foreach my $name (keys(%$test_files)) {
+    my $path = File::Spec->rel2abs("$tmpdir/$name");
+    if (open(my $fh, "> $path")) {
+      print $fh $test_files->{$name};
+      unless (close($fh)) {
+        die("Can't write $path: $!");
+      }
+
+    } else {
+      die("Can't open $path: $!");
+    }
+  }
+
+  my $config = {
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+
+    AuthUserFile => $auth_user_file,
+    AuthGroupFile => $auth_group_file,
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($config_file, $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      require IO::Socket::INET;
+
+      my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+      $client->login($user, $passwd);
+      $client->type('binary');
+      $client->mode('block');
+
+      # Open the data connection once, then use it for several transfers.
+      my ($resp_code, $resp_msg) = $client->pasv();
+
+      my @pasv_info;
+      if ($resp_msg =~ /\((\d+,\d+,\d+,\d+,\d+,\d+)\)/) {
+        @pasv_info = split(',', $1);
 
       } else {
-        $resp_code = $client->response_code();
-        $resp_msg = $client->response_msg();
+        die("Unexpected PASV response: $resp_msg");
+      }
+
+      my $data_conn = IO::Socket::INET->new(
+        PeerAddr => join('.', @pasv_info[0..3]),
+        PeerPort => ($pasv_info[4] * 256) + $pasv_info[5],
+        Proto => 'tcp',
+        Timeout => 5,
+      );
+      unless ($data_conn) {
+        die("Can't connect to data port: $!");
       }
 
       my $expected;
 
-      $expected = 504;
+      # The first transfer opens the data connection; the others reuse it.
+      my $expected_codes = [150, 125, 125];
+
+      my $ftp = $client->{ftp};
+      foreach my $name ('a.txt', 'b.txt', 'a.txt') {
+        $ftp->command('RETR', $name);
+
+        $resp_code = ($ftp->response() ? $ftp->code : 0);
+        $expected = shift(@$expected_codes);
+        $self->assert($expected == $resp_code,
+          test_msg("Expected $expected, got $resp_code"));
+
+        my $data = read_blocks($data_conn);
+
+        $expected = $test_files->{$name};
+        $self->assert($expected eq $data,
+          test_msg("Expected " . length($expected) . " bytes of $name, got " .
+            length($data)));
+
+        $resp_code = ($ftp->response() ? $ftp->code : 0);
+        $expected = 250;
+        $self->assert($expected == $resp_code,
+          test_msg("Expected $expected, got $resp_code"));
+      }
+
+      $data_conn->close();
+      $client->quit();
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($config_file, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($pid_file);
+
+  $self->assert_child_ok($pid);
+
+  if ($ex) {
+    test_append_logfile($log_file, $ex);
+    unlink($log_file);
+
+    die($ex);
+  }
+
+  unlink($log_file);
+}
+
+sub mode_block_restart_markers {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+
+  my $config_file = "$tmpdir/cmds.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/cmds.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/cmds.scoreboard");
+
+  my $log_file = test_get_logfile();
+
+  my $auth_user_file = File::Spec->rel2abs("$tmpdir/cmds.passwd");
+  my $auth_group_file = File::Spec->rel2abs("$tmpdir/cmds.group");
+
+  my $user = 'proftpd';
+  my $passwd = 'test';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+  my $uid = 500;
+  my $gid = 500;
+
+  # Make sure that, if we're running as root, that the home directory has
+  # permissions/privs set for the account we create
+  if ($< == 0) {
+    unless (chmod(0755, $home_dir)) {
+      die("Can't set perms on $home_dir to 0755: $!");
+    }
+
+    unless (chown($uid, $gid, $home_dir)) {
+      die("Can't set owner of $home_dir to $uid/$gid: $!");
+    }
+  }
+
+  auth_user_write($auth_user_file, $user, $passwd, $uid, $gid, $home_dir,
+    '/bin/bash');
+  auth_group_write($auth_group_file, 'ftpd', $gid, $user);
+
+  # Large enough for one restart marker, every megabyte.
+  my $test_files = {
+    'a.txt' => ("ABCDefgh" x 196608),
+  };
+
+  foreach my $name (keys(%$test_files)) {
+    my $path = File::Spec->rel2abs("$tmpdir/$name");
+    if (open(my $fh, "> $path")) {
+      print $fh $test_files->{$name};
+      unless (close($fh)) {
+        die("Can't write $path: $!");
+      }
+
+    } else {
+      die("Can't open $path: $!");
+    }
+  }
+
+  my $config = {
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+
+    AuthUserFile => $auth_user_file,
+    AuthGroupFile => $auth_group_file,
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($config_file, $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      require IO::Socket::INET;
+
+      my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+      $client->login($user, $passwd);
+      $client->type('binary');
+      $client->mode('block');
+
+      # Open the data connection once, then use it for several transfers.
+      my ($resp_code, $resp_msg) = $client->pasv();
+
+      my @pasv_info;
+      if ($resp_msg =~ /\((\d+,\d+,\d+,\d+,\d+,\d+)\)/) {
+        @pasv_info = split(',', $1);
+
+      } else {
+        die("Unexpected PASV response: $resp_msg");
+      }
+
+      my $data_conn = IO::Socket::INET->new(
+        PeerAddr => join('.', @pasv_info[0..3]),
+        PeerPort => ($pasv_info[4] * 256) + $pasv_info[5],
+        Proto => 'tcp',
+        Timeout => 5,
+      );
+      unless ($data_conn) {
+        die("Can't connect to data port: $!");
+      }
+
+      my $expected;
+      my $ftp = $client->{ftp};
+
+      $ftp->command('RETR', 'a.txt');
+      $resp_code = ($ftp->response() ? $ftp->code : 0);
+      $expected = 150;
       $self->assert($expected == $resp_code,
         test_msg("Expected $expected, got $resp_code"));
 
-      $expected = "'MODE B' unsupported transfer mode";
-      $self->assert($expected eq $resp_msg,
-        test_msg("Expected '$expected', got '$resp_msg'"));
+      my $markers = [];
+      my $data = read_blocks($data_conn, $markers);
+
+      $expected = length($test_files->{'a.txt'});
+      $self->assert($expected == length($data),
+        test_msg("Expected $expected bytes, got " . length($data)));
+
+      $resp_code = ($ftp->response() ? $ftp->code : 0);
+      $expected = 250;
+      $self->assert($expected == $resp_code,
+        test_msg("Expected $expected, got $resp_code"));
+
+      # The marker is the file offset of the data sent before it.
+      $self->assert(scalar(@$markers) == 1,
+        test_msg("Expected 1 restart marker, got " . scalar(@$markers)));
+
+      $expected = '1048576';
+      $self->assert($expected eq $markers->[0],
+        test_msg("Expected marker '$expected', got '$markers->[0]'"));
+
+      # Resume the download from the marker.
+      $client->rest($markers->[0]);
+
+      $ftp->command('RETR', 'a.txt');
+      $resp_code = ($ftp->response() ? $ftp->code : 0);
+      $expected = 125;
+      $self->assert($expected == $resp_code,
+        test_msg("Expected $expected, got $resp_code"));
+
+      $data = read_blocks($data_conn);
+
+      $expected = substr($test_files->{'a.txt'}, 1048576);
+      $self->assert($expected eq $data,
+        test_msg("Expected " . length($expected) . " bytes, got " .
+          length($data)));
+
+      $resp_code = ($ftp->response() ? $ftp->code : 0);
+      $expected = 250;
+      $self->assert($expected == $resp_code,
+        test_msg("Expected $expected, got $resp_code"));
+
+      $data_conn->close();
+      $client->quit();
     };
 
     if ($@) {
@@ -286,6 +664,51 @@ sub mode_block_fails {
   unlink($log_file);
 }
 
+# Reads RFC 959 blocks from the given data connection, up to and including
+# the EOF block, and returns their data.  Restart markers are collected into
+# the given array, if any.
+sub read_blocks {
+  my $data_conn = shift;
+  my $markers = shift;
+
+  my $data = '';
+
+  while (1) {
+    my $hdr = read_bytes($data_conn, 3);
+    my ($desc, $count) = unpack('Cn', $hdr);
+
+    my $buf = ($count > 0 ? read_bytes($data_conn, $count) : '');
+
+    # Restart marker descriptor
+    if ($desc & 0x10) {
+      push(@$markers, $buf) if $markers;
+
+    } else {
+      $data .= $buf;
+    }
+
+    # EOF descriptor
+    last if $desc & 0x40;
+  }
+
+  return $data;
+}
+
+sub read_bytes {
+  my $data_conn = shift;
+  my $len = shift;
+
+  my $buf = '';
+  while (length($buf) < $len) {
+    my $res = $data_conn->sysread($buf, $len - length($buf), length($buf));
+    unless ($res) {
+      die("Can't read from data connection: " . (defined($res) ? "EOF" : $!));
+    }
+  }
+
+  return $buf;
+}
+
 sub mode_compressed_fails {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
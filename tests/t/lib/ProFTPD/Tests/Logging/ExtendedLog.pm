@@ -366,6 +366,21 @@ my $TESTS = {
     test_class => [qw(bug forking)],
   },
 
+  extlog_buffered => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
+  extlog_log_shipper => {
+    order => ++$order,
+    test_class => [qw(forking mod_ctrls)],
+  },
+
+  extlog_log_shipper_died => {
+    order => ++$order,
+    test_class => [qw(forking mod_ctrls)],
+  },
+
   # XXX Need unit tests for all LogFormat variables
 };
 
@@ -12105,4 +12120,549 @@ sub extlog_var_basename_bug3987 {
   unlink($log_file);
 }
 
+sub extlog_buffered {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+
+  my $config_file = "$tmpdir/extlog.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/extlog.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/extlog.scoreboard");
+
+  my $log_file = test_get_logfile();
+
+  my $auth_user_file = File::Spec->rel2abs("$tmpdir/extlog.passwd");
+  my $auth_group_file = File::Spec->rel2abs("$tmpdir/extlog.group");
+
+  my $user = 'proftpd';
+  my $passwd = 'test';
+  my $group = 'ftpd';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+  my $uid = 500;
+  my $gid = 500;
+
+  # Make sure that, if we're running as root, that the home directory has
+  # permissions/privs set for the account we create
+  if ($< == 0) {
+    unless (chmod(0755, $home_dir)) {
+      die("Can't set perms on $home_dir to 0755: $!");
+    }
+
+    unless (chown($uid, $gid, $home_dir)) {
+      die("Can't set owner of $home_dir to $uid/$gid: $!");
+    }
+  }
+
+  auth_user_write($auth_user_file, $user, $passwd, $uid, $gid, $home_dir,
+    '/bin/bash');
+  auth_group_write($auth_group_file, $group, $gid, $user);
+
+  my $ext_log = File::Spec->rel2abs("$tmpdir/custom.log");
+
+  my $config = {
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+
+    AuthUserFile => $auth_user_file,
+    AuthGroupFile => $auth_group_file,
+
+    LogFormat => 'custom "%m %s %{%Y}t"',
+    ExtendedLog => "$ext_log ALL custom",
+
+    # Use a flush interval longer than the test, so that the records are
+    # only written out when the session ends.
+    ExtendedLogBuffer => '65536 60',
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($config_file, $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+      $client->login($user, $passwd);
+      $client->pwd();
+
+      # Nothing should have been written out yet.
+      my $size = -s $ext_log;
+      $self->assert($size == 0,
+        test_msg("Expected empty ExtendedLog, got $size bytes"));
+
+      $client->quit();
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($config_file, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($pid_file);
+
+  $self->assert_child_ok($pid);
+
+  if (open(my $fh, "< $ext_log")) {
+    my $lines = [];
+
+    while (my $line = <$fh>) {
+      chomp($line);
+      push(@$lines, $line);
+    }
+
+    close($fh);
+
+    my $year = (localtime())[5] + 1900;
+    my $expected = [
+      "USER 331 $year",
+      "PASS 230 $year",
+      "PWD 257 $year",
+      "QUIT 221 $year",
+    ];
+
+    my $nlines = scalar(@$lines);
+    $self->assert(scalar(@$expected) == $nlines,
+      test_msg("Expected " . scalar(@$expected) . " lines, got $nlines"));
+
+    for (my $i = 0; $i < $nlines; $i++) {
+      $self->assert($expected->[$i] eq $lines->[$i],
+        test_msg("Expected '$expected->[$i]', got '$lines->[$i]'"));
+    }
+
+  } else {
+    die("Can't read $ext_log: $!");
+  }
+
+  if ($ex) {
+    test_append_logfile($log_file, $ex);
+    unlink($log_file);
+
+    die($ex);
+  }
+
+  unlink($log_file);
+}
+
+sub extlog_log_shipper {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+
+  my $config_file = "$tmpdir/extlog.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/extlog.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/extlog.scoreboard");
+
+  my $log_file = test_get_logfile();
+
+  my $auth_user_file = File::Spec->rel2abs("$tmpdir/extlog.passwd");
+  my $auth_group_file = File::Spec->rel2abs("$tmpdir/extlog.group");
+
+  my $ctrls_sock = File::Spec->rel2abs("$tmpdir/ctrls.sock");
+
+  my $user = 'proftpd';
+  my $passwd = 'test';
+  my $group = 'ftpd';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+  my $uid = 500;
+  my $gid = 500;
+
+  # Make sure that, if we're running as root, that the home directory has
+  # permissions/privs set for the account we create
+  if ($< == 0) {
+    unless (chmod(0755, $home_dir)) {
+      die("Can't set perms on $home_dir to 0755: $!");
+    }
+
+    unless (chown($uid, $gid, $home_dir)) {
+      die("Can't set owner of $home_dir to $uid/$gid: $!");
+    }
+  }
+
+  auth_user_write($auth_user_file, $user, $passwd, $uid, $gid, $home_dir,
+    '/bin/bash');
+  auth_group_write($auth_group_file, $group, $gid, $user);
+
+  my $ext_log = File::Spec->rel2abs("$tmpdir/custom.log");
+
+  my $config = {
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+
+    AuthUserFile => $auth_user_file,
+    AuthGroupFile => $auth_group_file,
+
+    LogFormat => 'custom "%m %s"',
+    ExtendedLog => "$ext_log ALL custom",
+    LogShipper => '65536',
+    LogShipperControlsACLs => 'all allow user root',
+
+    IfModules => {
+      'mod_ctrls.c' => {
+        ControlsEngine => 'on',
+        ControlsInterval => 1,
+        ControlsLog => $log_file,
+        ControlsSocket => $ctrls_sock,
+        ControlsACLs => 'all allow user root',
+        ControlsSocketACL => 'allow user root',
+      },
+
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($config_file, $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      # The SIGCHLD handler would wait for the server process, as well as
+      # for ftpdctl.
+      local $SIG{CHLD} = 'DEFAULT';
+
+      my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+      $client->login($user, $passwd);
+      $client->pwd();
+      $client->quit();
+
+      # Give the log shipper time to write out the records.
+      sleep(1);
+
+      my $ftpdctl_bin = '../ftpdctl';
+      if ($ENV{PROFTPD_TEST_PATH}) {
+        $ftpdctl_bin = "$ENV{PROFTPD_TEST_PATH}/ftpdctl";
+      }
+
+      my @lines = `$ftpdctl_bin -s $ctrls_sock logship info`;
+
+      my $expected = "ftpdctl: $ext_log: backlog 0 bytes";
+      my $found = grep { index($_, $expected) == 0 } @lines;
+      $self->assert($found,
+        test_msg("Expected '$expected' in 'logship info' output"));
+
+      $expected = '4 records, 35 bytes';
+      $found = grep { index($_, $expected) != -1 } @lines;
+      $self->assert($found,
+        test_msg("Expected '$expected' in 'logship info' output"));
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($config_file, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($pid_file);
+
+  $self->assert_child_ok($pid);
+
+  if (open(my $fh, "< $ext_log")) {
+    my $lines = [];
+
+    while (my $line = <$fh>) {
+      chomp($line);
+      push(@$lines, $line);
+    }
+
+    close($fh);
+
+    my $expected = [
+      "USER 331",
+      "PASS 230",
+      "PWD 257",
+      "QUIT 221",
+    ];
+
+    my $nlines = scalar(@$lines);
+    $self->assert(scalar(@$expected) == $nlines,
+      test_msg("Expected " . scalar(@$expected) . " lines, got $nlines"));
+
+    for (my $i = 0; $i < $nlines; $i++) {
+      $self->assert($expected->[$i] eq $lines->[$i],
+        test_msg("Expected '$expected->[$i]', got '$lines->[$i]'"));
+    }
+
+  } else {
+    die("Can't read $ext_log: $!");
+  }
+
+  if ($ex) {
+    test_append_logfile($log_file, $ex);
+    unlink($log_file);
+
+    die($ex);
+  }
+
+  unlink($log_file);
+}
+
+sub extlog_log_shipper_died {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+
+  my $config_file = "$tmpdir/extlog.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/extlog.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/extlog.scoreboard");
+
+  my $log_file = test_get_logfile();
+
+  my $auth_user_file = File::Spec->rel2abs("$tmpdir/extlog.passwd");
+  my $auth_group_file = File::Spec->rel2abs("$tmpdir/extlog.group");
+
+  my $ctrls_sock = File::Spec->rel2abs("$tmpdir/ctrls.sock");
+
+  my $user = 'proftpd';
+  my $passwd = 'test';
+  my $group = 'ftpd';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+  my $uid = 500;
+  my $gid = 500;
+
+  # Make sure that, if we're running as root, that the home directory has
+  # permissions/privs set for the account we create
+  if ($< == 0) {
+    unless (chmod(0755, $home_dir)) {
+      die("Can't set perms on $home_dir to 0755: $!");
+    }
+
+    unless (chown($uid, $gid, $home_dir)) {
+      die("Can't set owner of $home_dir to $uid/$gid: $!");
+    }
+  }
+
+  auth_user_write($auth_user_file, $user, $passwd, $uid, $gid, $home_dir,
+    '/bin/bash');
+  auth_group_write($auth_group_file, $group, $gid, $user);
+
+  my $ext_log = File::Spec->rel2abs("$tmpdir/custom.log");
+
+  my $config = {
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+
+    AuthUserFile => $auth_user_file,
+    AuthGroupFile => $auth_group_file,
+
+    LogFormat => 'custom "%m %s"',
+    ExtendedLog => "$ext_log ALL custom",
+    LogShipper => '65536',
+    LogShipperControlsACLs => 'all allow user root',
+
+    IfModules => {
+      'mod_ctrls.c' => {
+        ControlsEngine => 'on',
+        ControlsInterval => 1,
+        ControlsLog => $log_file,
+        ControlsSocket => $ctrls_sock,
+        ControlsACLs => 'all allow user root',
+        ControlsSocketACL => 'allow user root',
+      },
+
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($config_file, $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  my $ex;
+  my $shipper_pid;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      # The SIGCHLD handler would wait for the server process, as well as
+      # for ftpdctl.
+      local $SIG{CHLD} = 'DEFAULT';
+
+      my $ftpdctl_bin = '../ftpdctl';
+      if ($ENV{PROFTPD_TEST_PATH}) {
+        $ftpdctl_bin = "$ENV{PROFTPD_TEST_PATH}/ftpdctl";
+      }
+
+      sleep(1);
+
+      my @lines = `$ftpdctl_bin -s $ctrls_sock logship info`;
+      foreach my $line (@lines) {
+        if ($line =~ /LogShipper process (\d+)/) {
+          $shipper_pid = $1;
+          last;
+        }
+      }
+
+      unless ($shipper_pid) {
+        die("Can't find LogShipper PID in 'logship info' output");
+      }
+
+      # Kill the log shipper; the daemon should notice, and logging should
+      # go directly to the log file.
+      kill('KILL', $shipper_pid);
+      sleep(1);
+
+      @lines = `$ftpdctl_bin -s $ctrls_sock logship info`;
+
+      my $expected = 'ftpdctl: LogShipper not running';
+      my $found = grep { index($_, $expected) == 0 } @lines;
+      $self->assert($found,
+        test_msg("Expected '$expected' in 'logship info' output"));
+
+      my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+      $client->login($user, $passwd);
+      $client->pwd();
+      $client->quit();
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($config_file, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($pid_file);
+
+  $self->assert_child_ok($pid);
+
+  eval {
+    if (open(my $fh, "< $ext_log")) {
+      my $lines = [];
+
+      while (my $line = <$fh>) {
+        chomp($line);
+        push(@$lines, $line);
+      }
+
+      close($fh);
+
+      my $expected = [
+        "USER 331",
+        "PASS 230",
+        "PWD 257",
+        "QUIT 221",
+      ];
+
+      my $nlines = scalar(@$lines);
+      $self->assert(scalar(@$expected) == $nlines,
+        test_msg("Expected " . scalar(@$expected) . " lines, got $nlines"));
+
+      for (my $i = 0; $i < $nlines; $i++) {
+        $self->assert($expected->[$i] eq $lines->[$i],
+          test_msg("Expected '$expected->[$i]', got '$lines->[$i]'"));
+      }
+
+    } else {
+      die("Can't read $ext_log: $!");
+    }
+
+    if (open(my $fh, "< $log_file")) {
+      my $found = 0;
+
+      while (my $line = <$fh>) {
+        if ($line =~ /LogShipper process $shipper_pid died from signal 9/) {
+          $found = 1;
+          last;
+        }
+      }
+
+      close($fh);
+
+      $self->assert($found,
+        test_msg("Did not see expected LogShipper error in $log_file"));
+
+    } else {
+      die("Can't read $log_file: $!");
+    }
+  };
+
+  if ($@) {
+    $ex = $@ unless $ex;
+  }
+
+  if ($ex) {
+    test_append_logfile($log_file, $ex);
+    unlink($log_file);
+
+    die($ex);
+  }
+
+  unlink($log_file);
+}
+
 1;
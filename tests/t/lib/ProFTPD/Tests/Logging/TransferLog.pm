@@ -65,6 +65,11 @@ my $TESTS = {
     test_class => [qw(forking os_linux)],
   },
 
+  xferlog_binary_format => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
 };
 
 sub new {
@@ -1721,4 +1726,197 @@ sub xferlog_device_full_for_upload {
   unlink($log_file);
 }
 
+sub xferlog_binary_format {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+
+  my $config_file = "$tmpdir/xferlog.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/xferlog.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/xferlog.scoreboard");
+
+  my $log_file = test_get_logfile();
+
+  my $auth_user_file = File::Spec->rel2abs("$tmpdir/xferlog.passwd");
+  my $auth_group_file = File::Spec->rel2abs("$tmpdir/xferlog.group");
+
+  my $test_file = File::Spec->rel2abs($config_file);
+
+  my $user = 'proftpd';
+  my $passwd = 'test';
+  my $group = 'ftpd';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+  my $uid = 500;
+  my $gid = 500;
+
+  # Make sure that, if we're running as root, that the home directory has
+  # permissions/privs set for the account we create
+  if ($< == 0) {
+    unless (chmod(0755, $home_dir)) {
+      die("Can't set perms on $home_dir to 0755: $!");
+    }
+
+    unless (chown($uid, $gid, $home_dir)) {
+      die("Can't set owner of $home_dir to $uid/$gid: $!");
+    }
+  }
+
+  auth_user_write($auth_user_file, $user, $passwd, $uid, $gid, $home_dir,
+    '/bin/bash');
+  auth_group_write($auth_group_file, $group, $gid, $user);
+
+  my $xfer_log = File::Spec->rel2abs("$tmpdir/xfer.log");
+
+  my $config = {
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+
+    AuthUserFile => $auth_user_file,
+    AuthGroupFile => $auth_group_file,
+
+    TransferLog => "$xfer_log binary",
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($config_file, $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+      $client->login($user, $passwd);
+      $client->type('binary');
+
+      my $conn = $client->retr_raw($test_file);
+      unless ($conn) {
+        die("Failed to RETR: " . $client->response_code() . " " .
+          $client->response_msg());
+      }
+
+      my $buf;
+      $conn->read($buf, 8192, 30);
+      eval { $conn->close() };
+
+      my $resp_code = $client->response_code();
+      my $resp_msg = $client->response_msg();
+      $self->assert_transfer_ok($resp_code, $resp_msg);
+
+      $client->quit();
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($config_file, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($pid_file);
+
+  $self->assert_child_ok($pid);
+
+  eval {
+    my $ftpxferlog_bin;
+    if ($ENV{PROFTPD_TEST_PATH}) {
+      $ftpxferlog_bin = "$ENV{PROFTPD_TEST_PATH}/../ftpxferlog";
+
+    } else {
+      $ftpxferlog_bin = '../ftpxferlog';
+    }
+
+    # The binary TransferLog has a start and an end record for the transfer;
+    # the xferlog format only shows the end records.
+    my @lines = `$ftpxferlog_bin $xfer_log`;
+    $self->assert($? == 0,
+      test_msg("Failed to convert $xfer_log (exit status " . ($? >> 8) .
+        ")"));
+
+    my $count = scalar(@lines);
+    $self->assert($count == 1,
+      test_msg("Expected 1 xferlog line, got $count"));
+
+    my $line = $lines[0];
+    chomp($line);
+
+    my $expected = '^\S+\s+\S+\s+\d+\s+\d+:\d+:\d+\s+\d+\s+\d+\s+(\S+)\s+(\d+)\s+(\S+)\s+b\s+_\s+o\s+r\s+(\S+)\s+ftp\s+0\s+\*\s+c$';
+    $self->assert(qr/$expected/, $line,
+      test_msg("Expected '$expected', got '$line'"));
+
+    if ($line =~ /$expected/) {
+      my $remote_host = $1;
+      my $filesz = $2;
+      my $filename = $3;
+      my $user_name = $4;
+
+      $expected = '127.0.0.1';
+      $self->assert($expected eq $remote_host,
+        test_msg("Expected '$expected', got '$remote_host'"));
+
+      $expected = -s $test_file;
+      $self->assert($expected == $filesz,
+        test_msg("Expected '$expected', got '$filesz'"));
+
+      $expected = $test_file;
+      $self->assert($expected eq $filename,
+        test_msg("Expected '$expected', got '$filename'"));
+
+      $expected = $user;
+      $self->assert($expected eq $user_name,
+        test_msg("Expected '$expected', got '$user_name'"));
+    }
+
+    @lines = `$ftpxferlog_bin -f csv -s $xfer_log`;
+    $count = scalar(@lines);
+
+    # The CSV header line, then the start and end records.
+    $self->assert($count == 3,
+      test_msg("Expected 3 CSV lines, got $count"));
+
+    $self->assert(qr/^start,/, $lines[1],
+      test_msg("Expected start record, got '$lines[1]'"));
+    $self->assert(qr/^end,/, $lines[2],
+      test_msg("Expected end record, got '$lines[2]'"));
+  };
+  if ($@) {
+    $ex = $@;
+  }
+
+  if ($ex) {
+    test_append_logfile($log_file, $ex);
+    unlink($log_file);
+
+    die($ex);
+  }
+
+  unlink($log_file);
+}
+
 1;
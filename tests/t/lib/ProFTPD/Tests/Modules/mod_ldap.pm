@@ -36,6 +36,14 @@ my $TESTS = {
     order => ++$order,
     test_class => [qw(forking)],
   },
+  ldap_users_persistent_authallowed => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+  ldap_users_persistent_authdenied => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
   ldap_genhomedir_with_username => {
     order => ++$order,
     test_class => [qw(forking)],
@@ -114,6 +122,7 @@ sub list_tests {
 sub ldap_auth {
   my $self = shift;
   my $allow_auth = shift;
+  my $ldap_config = shift;
   my $tmpdir = $self->{tmpdir};
 
   my $config_file = "$tmpdir/ldap.conf";
@@ -189,6 +198,12 @@ sub ldap_auth {
     },
   };
 
+  if ($ldap_config) {
+    foreach my $key (keys(%$ldap_config)) {
+      $config->{IfModules}->{'mod_ldap.c'}->{$key} = $ldap_config->{$key};
+    }
+  }
+
   my ($port, $config_user, $config_group) = config_write($config_file, $config);
 
   # Open pipes, for use between the parent and child processes.  Specifically,
@@ -231,6 +246,9 @@ sub ldap_auth {
         $expected = "User $user logged in";
         $self->assert($expected eq $resp_msg,
           test_msg("Expected '$expected', got '$resp_msg'"));
+
+        # Listing the home directory looks up its owner, after the auth bind.
+        $client->list();
       } else {
           $expected = 530;
           $self->assert($expected == $resp_code,
@@ -282,6 +300,24 @@ sub ldap_users_authdenied {
   ldap_auth($self, 0);
 }
 
+sub ldap_users_persistent_authallowed {
+  my $self = shift;
+
+  ldap_auth($self, 1, {
+    LDAPOptions => 'CombinedUserLookup PersistentConnection',
+    LDAPCacheTTL => 60,
+  });
+}
+
+sub ldap_users_persistent_authdenied {
+  my $self = shift;
+
+  ldap_auth($self, 0, {
+    LDAPOptions => 'CombinedUserLookup PersistentConnection',
+    LDAPCacheTTL => 60,
+  });
+}
+
 sub ldap_genhomedir {
   my $self = shift;
   my $with_username = shift;
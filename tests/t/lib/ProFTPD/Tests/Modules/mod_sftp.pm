@@ -67,6 +67,11 @@ my $TESTS = {
     test_class => [qw(forking ssh2)],
   },
 
+  ssh2_ext_kex_curve25519_sha256 => {
+    order => ++$order,
+    test_class => [qw(forking ssh2)],
+  },
+
   ssh2_hostkey_rsa => {
     order => ++$order,
     test_class => [qw(forking ssh2)],
@@ -557,6 +562,11 @@ my $TESTS = {
     test_class => [qw(forking sftp ssh2)],
   },
 
+  sftp_upload_largefile_auto_channel_window => {
+    order => ++$order,
+    test_class => [qw(forking sftp ssh2)],
+  },
+
   sftp_upload_device_full => {
     order => ++$order,
     test_class => [qw(forking os_linux sftp ssh2)],
@@ -598,6 +608,11 @@ my $TESTS = {
     test_class => [qw(forking sftp ssh2)],
   },
 
+  sftp_download_largefile_fast_data_path => {
+    order => ++$order,
+    test_class => [qw(forking sftp ssh2)],
+  },
+
   sftp_download_fifo_bug3314 => {
     order => ++$order,
     test_class => [qw(forking inprogress sftp ssh2)],
@@ -3053,7 +3068,7 @@ EOC
   unlink($log_file);
 }
 
-sub ssh2_hostkey_rsa {
+sub ssh2_ext_kex_curve25519_sha256 {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -3091,6 +3106,58 @@ sub ssh2_hostkey_rsa {
 
   my $rsa_host_key = File::Spec->rel2abs('t/etc/modules/mod_sftp/ssh_host_rsa_key');
   my $dsa_host_key = File::Spec->rel2abs('t/etc/modules/mod_sftp/ssh_host_dsa_key');
+  my $ecdsa521_host_key = File::Spec->rel2abs('t/etc/modules/mod_sftp/ssh_host_ecdsa521_key');
+
+  my $rsa_priv_key = File::Spec->rel2abs('t/etc/modules/mod_sftp/test_rsa_key');
+  my $rsa_pub_key = File::Spec->rel2abs('t/etc/modules/mod_sftp/test_rsa_key.pub');
+  my $rsa_rfc4716_key = File::Spec->rel2abs('t/etc/modules/mod_sftp/authorized_rsa_keys');
+
+  my $authorized_keys = File::Spec->rel2abs("$tmpdir/.authorized_keys");
+  unless (copy($rsa_rfc4716_key, $authorized_keys)) {
+    die("Can't copy $rsa_rfc4716_key to $authorized_keys: $!");
+  }
+
+  my $src_file = File::Spec->rel2abs("$tmpdir/src.txt");
+  if (open(my $fh, "> $src_file")) {
+    print $fh "Hello, World!\n";
+
+    unless (close($fh)) {
+      die("Can't write $src_file: $!");
+    }
+
+  } else {
+    die("Can't open $src_file: $!");
+  }
+
+  my $src_sz = (stat($src_file))[7];
+
+  my $dst_file = File::Spec->rel2abs("$tmpdir/dst.txt");
+
+  my $ssh_config = File::Spec->rel2abs("$tmpdir/ssh.conf");
+  if (open(my $fh, "> $ssh_config")) {
+    print $fh <<EOC;
+HostKeyAlgorithms ssh-rsa
+KexAlgorithms curve25519-sha256\@libssh.org
+EOC
+    unless (close($fh)) {
+      die("Can't write $ssh_config: $!");
+    }
+
+  } else {
+    die("Can't open $ssh_config: $!");
+  }
+
+  my $batch_file = File::Spec->rel2abs("$tmpdir/sftp-batch.conf");
+  if (open(my $fh, "> $batch_file")) {
+    print $fh "put -P $src_file $dst_file\n";
+
+    unless (close($fh)) {
+      die("Can't write $batch_file: $!");
+    }
+
+  } else {
+    die("Can't open $batch_file: $!");
+  }
 
   my $config = {
     PidFile => $pid_file,
@@ -3110,8 +3177,12 @@ sub ssh2_hostkey_rsa {
       'mod_sftp.c' => [
         "SFTPEngine on",
         "SFTPLog $log_file",
+
         "SFTPHostKey $rsa_host_key",
         "SFTPHostKey $dsa_host_key",
+        "SFTPHostKey $ecdsa521_host_key",
+
+        "SFTPAuthorizedUserKeys file:~/.authorized_keys",
       ],
     },
   };
@@ -3135,23 +3206,84 @@ sub ssh2_hostkey_rsa {
   defined(my $pid = fork()) or die("Can't fork: $!");
   if ($pid) {
     eval {
-      my $ssh2 = Net::SSH2->new();
+
+      # libssh2, and thus Net::SSH2, don't support Curve25519 yet.  So we
+      # use the external sftp(1) client (e.g. OpenSSH-6.5p1) to test.
+
+      my $sftp = '/home/tj/local/openssh-6.5p1/bin/sftp';
+
+      my @cmd = (
+        $sftp,
+        '-F',
+        $ssh_config,
+        '-oBatchMode=yes',
+        '-oCheckHostIP=no',
+        '-oCompression=yes',
+        "-oPort=$port",
+        "-oIdentityFile=$rsa_priv_key",
+        '-oPubkeyAuthentication=yes',
+        '-oStrictHostKeyChecking=no',
+        '-vvv',
+        '-b',
+        $batch_file,
+        "$user\@127.0.0.1",
+      );
+
+      my $sftp_rh = IO::Handle->new();
+      my $sftp_wh = IO::Handle->new();
+      my $sftp_eh = IO::Handle->new();
+
+      $sftp_wh->autoflush(1);
 
       sleep(1);
 
-      my $hostkey = 'ssh-rsa';
-      $ssh2->method('hostkey', $hostkey);
+      local $SIG{CHLD} = 'DEFAULT';
 
-      unless ($ssh2->connect('127.0.0.1', $port)) {
-        my ($err_code, $err_name, $err_str) = $ssh2->error();
-        die("Can't connect to SSH2 server: [$err_name] ($err_code) $err_str");
+      # Make sure that the perms on the priv key are what OpenSSH wants
+      unless (chmod(0400, $rsa_priv_key)) {
+        die("Can't set perms on $rsa_priv_key to 0400: $!");
       }
 
-      my $hostkey_used = $ssh2->method('hostkey');
-      $self->assert($hostkey eq $hostkey_used,
-        test_msg("Expected '$hostkey', got '$hostkey_used'"));
+      if ($ENV{TEST_VERBOSE}) {
+        print STDERR "Executing: ", join(' ', @cmd), "\n";
+      }
+
+      my $sftp_pid = open3($sftp_wh, $sftp_rh, $sftp_eh, @cmd);
+      waitpid($sftp_pid, 0);
+      my $exit_status = $?;
+
+      # Restore the perms on the priv key
+      unless (chmod(0644, $rsa_priv_key)) {
+        die("Can't set perms on $rsa_priv_key to 0644: $!");
+      }
+
+      my ($res, $errstr);
+      if ($exit_status >> 8 == 0) {
+        $errstr = join('', <$sftp_eh>);
+        $res = 0;
+
+      } else {
+        if ($ENV{TEST_VERBOSE}) {
+          $errstr = join('', <$sftp_eh>);
+          print STDERR "Stderr: $errstr\n";
+        }
+
+        $res = 1;
+      }
+
+      unless ($res == 0) {
+        die("Can't upload $src_file to server: $errstr");
+      }
+
+      unless (-f $dst_file) {
+        die("File '$dst_file' does not exist as expected");
+      }
+
+      my $sz = (stat($dst_file))[7];
+      my $expected_sz = $src_sz;
+      $self->assert($expected_sz == $sz,
+        test_msg("Expected file size $expected_sz, got $sz"));
 
-      $ssh2->disconnect();
     };
 
     if ($@) {
@@ -3186,7 +3318,7 @@ sub ssh2_hostkey_rsa {
   unlink($log_file);
 }
 
-sub ssh2_hostkey_rsa_only {
+sub ssh2_hostkey_rsa {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -3223,6 +3355,7 @@ sub ssh2_hostkey_rsa_only {
   auth_group_write($auth_group_file, $group, $gid, $user);
 
   my $rsa_host_key = File::Spec->rel2abs('t/etc/modules/mod_sftp/ssh_host_rsa_key');
+  my $dsa_host_key = File::Spec->rel2abs('t/etc/modules/mod_sftp/ssh_host_dsa_key');
 
   my $config = {
     PidFile => $pid_file,
@@ -3243,6 +3376,7 @@ sub ssh2_hostkey_rsa_only {
         "SFTPEngine on",
         "SFTPLog $log_file",
         "SFTPHostKey $rsa_host_key",
+        "SFTPHostKey $dsa_host_key",
       ],
     },
   };
@@ -3283,22 +3417,6 @@ sub ssh2_hostkey_rsa_only {
         test_msg("Expected '$hostkey', got '$hostkey_used'"));
 
       $ssh2->disconnect();
-
-      # Test that using ssh-dss does NOT work
-      $hostkey = 'ssh-dss';
-      $ssh2->method('hostkey', $hostkey);
-
-      if ($ssh2->connect('127.0.0.1', $port)) {
-        die("Connect to SSH2 server unexpectedly");
-      }
-
-      my ($err_code, $err_name, $err_str) = $ssh2->error();
-
-      # The expected error messages depend on the version of libssh2 being
-      # used.
-      $self->assert($err_name eq 'LIBSSH2_ERROR_KEX_FAILURE' or
-                    $err_name eq 'LIBSSH2_ERROR_KEY_EXCHANGE_FAILURE',
-        test_msg("Expected 'LIBSSH2_ERROR_KEX_FAILURE' or 'LIBSSH2_ERROR_KEY_EXCHANGE_FAILURE', got '$err_name'"));
     };
 
     if ($@) {
@@ -3333,7 +3451,7 @@ sub ssh2_hostkey_rsa_only {
   unlink($log_file);
 }
 
-sub ssh2_hostkey_dss {
+sub ssh2_hostkey_rsa_only {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -3370,7 +3488,6 @@ sub ssh2_hostkey_dss {
   auth_group_write($auth_group_file, $group, $gid, $user);
 
   my $rsa_host_key = File::Spec->rel2abs('t/etc/modules/mod_sftp/ssh_host_rsa_key');
-  my $dsa_host_key = File::Spec->rel2abs('t/etc/modules/mod_sftp/ssh_host_dsa_key');
 
   my $config = {
     PidFile => $pid_file,
@@ -3391,7 +3508,6 @@ sub ssh2_hostkey_dss {
         "SFTPEngine on",
         "SFTPLog $log_file",
         "SFTPHostKey $rsa_host_key",
-        "SFTPHostKey $dsa_host_key",
       ],
     },
   };
@@ -3419,7 +3535,7 @@ sub ssh2_hostkey_dss {
 
       sleep(1);
 
-      my $hostkey = 'ssh-dss';
+      my $hostkey = 'ssh-rsa';
       $ssh2->method('hostkey', $hostkey);
 
       unless ($ssh2->connect('127.0.0.1', $port)) {
@@ -3432,6 +3548,22 @@ sub ssh2_hostkey_dss {
         test_msg("Expected '$hostkey', got '$hostkey_used'"));
 
       $ssh2->disconnect();
+
+      # Test that using ssh-dss does NOT work
+      $hostkey = 'ssh-dss';
+      $ssh2->method('hostkey', $hostkey);
+
+      if ($ssh2->connect('127.0.0.1', $port)) {
+        die("Connect to SSH2 server unexpectedly");
+      }
+
+      my ($err_code, $err_name, $err_str) = $ssh2->error();
+
+      # The expected error messages depend on the version of libssh2 being
+      # used.
+      $self->assert($err_name eq 'LIBSSH2_ERROR_KEX_FAILURE' or
+                    $err_name eq 'LIBSSH2_ERROR_KEY_EXCHANGE_FAILURE',
+        test_msg("Expected 'LIBSSH2_ERROR_KEX_FAILURE' or 'LIBSSH2_ERROR_KEY_EXCHANGE_FAILURE', got '$err_name'"));
     };
 
     if ($@) {
@@ -3466,7 +3598,7 @@ sub ssh2_hostkey_dss {
   unlink($log_file);
 }
 
-sub ssh2_hostkey_dss_only {
+sub ssh2_hostkey_dss {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -3502,6 +3634,7 @@ sub ssh2_hostkey_dss_only {
     '/bin/bash');
   auth_group_write($auth_group_file, $group, $gid, $user);
 
+  my $rsa_host_key = File::Spec->rel2abs('t/etc/modules/mod_sftp/ssh_host_rsa_key');
   my $dsa_host_key = File::Spec->rel2abs('t/etc/modules/mod_sftp/ssh_host_dsa_key');
 
   my $config = {
@@ -3522,6 +3655,7 @@ sub ssh2_hostkey_dss_only {
       'mod_sftp.c' => [
         "SFTPEngine on",
         "SFTPLog $log_file",
+        "SFTPHostKey $rsa_host_key",
         "SFTPHostKey $dsa_host_key",
       ],
     },
@@ -3563,22 +3697,6 @@ sub ssh2_hostkey_dss_only {
         test_msg("Expected '$hostkey', got '$hostkey_used'"));
 
       $ssh2->disconnect();
-
-      # Test that using ssh-rsa does NOT work
-      $hostkey = 'ssh-rsa';
-      $ssh2->method('hostkey', $hostkey);
-
-      if ($ssh2->connect('127.0.0.1', $port)) {
-        die("Connect to SSH2 server unexpectedly");
-      }
-
-      my ($err_code, $err_name, $err_str) = $ssh2->error();
-
-      # The expected error messages depend on the version of libssh2 being
-      # used.
-      $self->assert($err_name eq 'LIBSSH2_ERROR_KEX_FAILURE' or
-                    $err_name eq 'LIBSSH2_ERROR_KEY_EXCHANGE_FAILURE',
-        test_msg("Expected 'LIBSSH2_ERROR_KEX_FAILURE' or 'LIBSSH2_ERROR_KEY_EXCHANGE_FAILURE', got '$err_name'"));
     };
 
     if ($@) {
@@ -3613,7 +3731,7 @@ sub ssh2_hostkey_dss_only {
   unlink($log_file);
 }
 
-sub ssh2_hostkey_dss_bug3634 {
+sub ssh2_hostkey_dss_only {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -3649,39 +3767,14 @@ sub ssh2_hostkey_dss_bug3634 {
     '/bin/bash');
   auth_group_write($auth_group_file, $group, $gid, $user);
 
-  my $rsa_host_key = File::Spec->rel2abs('t/etc/modules/mod_sftp/ssh_host_rsa_key');
   my $dsa_host_key = File::Spec->rel2abs('t/etc/modules/mod_sftp/ssh_host_dsa_key');
 
-  my $dsa_priv_key = File::Spec->rel2abs('t/etc/modules/mod_sftp/test_dsa_key');
-  my $dsa_pub_key = File::Spec->rel2abs('t/etc/modules/mod_sftp/test_dsa_key.pub');
-  my $dsa_rfc4716_key = File::Spec->rel2abs('t/etc/modules/mod_sftp/authorized_dsa_keys');
-
-  my $authorized_keys = File::Spec->rel2abs("$tmpdir/.authorized_keys");
-  unless (copy($dsa_rfc4716_key, $authorized_keys)) {
-    die("Can't copy $dsa_rfc4716_key to $authorized_keys: $!");
-  }
-
-  my $batch_file = File::Spec->rel2abs("$tmpdir/sftp-batch.txt");
-  if (open(my $fh, "> $batch_file")) {
-    print $fh "pwd\n";
-
-    unless (close($fh)) {
-      die("Can't write $batch_file: $!");
-    }
-
-  } else {
-    die("Can't open $batch_file: $!");
-  }
-
-  my $count = 250;
-  my $timeout = ($count * 2);
-
   my $config = {
     PidFile => $pid_file,
     ScoreboardFile => $scoreboard_file,
     SystemLog => $log_file,
     TraceLog => $log_file,
-    Trace => 'DEFAULT:10 ssh2:20 sftp:20',
+    Trace => 'DEFAULT:10 ssh2:20 sftp:20 scp:20',
 
     AuthUserFile => $auth_user_file,
     AuthGroupFile => $auth_group_file,
@@ -3694,9 +3787,7 @@ sub ssh2_hostkey_dss_bug3634 {
       'mod_sftp.c' => [
         "SFTPEngine on",
         "SFTPLog $log_file",
-        "SFTPHostKey $rsa_host_key",
         "SFTPHostKey $dsa_host_key",
-        "SFTPAuthorizedUserKeys file:~/.authorized_keys",
       ],
     },
   };
@@ -3715,28 +3806,202 @@ sub ssh2_hostkey_dss_bug3634 {
 
   my $ex;
 
-  # Ignore SIGPIPE
-  local $SIG{PIPE} = sub { };
-
   # Fork child
   $self->handle_sigchld();
   defined(my $pid = fork()) or die("Can't fork: $!");
   if ($pid) {
     eval {
+      my $ssh2 = Net::SSH2->new();
+
       sleep(1);
 
-      my @cmd = (
-        'sftp',
-        '-oBatchMode=yes',
-        '-oCheckHostIP=no',
-        '-oCompression=yes',
-        "-oPort=$port",
-        '-oHostKeyAlgorithms=ssh-dss',
-        "-oIdentityFile=$dsa_priv_key",
-        '-oPubkeyAuthentication=yes',
-        '-oStrictHostKeyChecking=no',
-        '-vvv',
-        '-b',
+      my $hostkey = 'ssh-dss';
+      $ssh2->method('hostkey', $hostkey);
+
+      unless ($ssh2->connect('127.0.0.1', $port)) {
+        my ($err_code, $err_name, $err_str) = $ssh2->error();
+        die("Can't connect to SSH2 server: [$err_name] ($err_code) $err_str");
+      }
+
+      my $hostkey_used = $ssh2->method('hostkey');
+      $self->assert($hostkey eq $hostkey_used,
+        test_msg("Expected '$hostkey', got '$hostkey_used'"));
+
+      $ssh2->disconnect();
+
+      # Test that using ssh-rsa does NOT work
+      $hostkey = 'ssh-rsa';
+      $ssh2->method('hostkey', $hostkey);
+
+      if ($ssh2->connect('127.0.0.1', $port)) {
+        die("Connect to SSH2 server unexpectedly");
+      }
+
+      my ($err_code, $err_name, $err_str) = $ssh2->error();
+
+      # The expected error messages depend on the version of libssh2 being
+      # used.
+      $self->assert($err_name eq 'LIBSSH2_ERROR_KEX_FAILURE' or
+                    $err_name eq 'LIBSSH2_ERROR_KEY_EXCHANGE_FAILURE',
+        test_msg("Expected 'LIBSSH2_ERROR_KEX_FAILURE' or 'LIBSSH2_ERROR_KEY_EXCHANGE_FAILURE', got '$err_name'"));
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($config_file, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($pid_file);
+
+  $self->assert_child_ok($pid);
+
+  if ($ex) {
+    test_append_logfile($log_file, $ex);
+    unlink($log_file);
+
+    die($ex);
+  }
+
+  unlink($log_file);
+}
+
+sub ssh2_hostkey_dss_bug3634 {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+
+  my $config_file = "$tmpdir/sftp.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/sftp.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/sftp.scoreboard");
+
+  my $log_file = test_get_logfile();
+
+  my $auth_user_file = File::Spec->rel2abs("$tmpdir/sftp.passwd");
+  my $auth_group_file = File::Spec->rel2abs("$tmpdir/sftp.group");
+
+  my $user = 'proftpd';
+  my $passwd = 'test';
+  my $group = 'ftpd';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+  my $uid = 500;
+  my $gid = 500;
+
+  # Make sure that, if we're running as root, that the home directory has
+  # permissions/privs set for the account we create
+  if ($< == 0) {
+    unless (chmod(0755, $home_dir)) {
+      die("Can't set perms on $home_dir to 0755: $!");
+    }
+
+    unless (chown($uid, $gid, $home_dir)) {
+      die("Can't set owner of $home_dir to $uid/$gid: $!");
+    }
+  }
+
+  auth_user_write($auth_user_file, $user, $passwd, $uid, $gid, $home_dir,
+    '/bin/bash');
+  auth_group_write($auth_group_file, $group, $gid, $user);
+
+  my $rsa_host_key = File::Spec->rel2abs('t/etc/modules/mod_sftp/ssh_host_rsa_key');
+  my $dsa_host_key = File::Spec->rel2abs('t/etc/modules/mod_sftp/ssh_host_dsa_key');
+
+  my $dsa_priv_key = File::Spec->rel2abs('t/etc/modules/mod_sftp/test_dsa_key');
+  my $dsa_pub_key = File::Spec->rel2abs('t/etc/modules/mod_sftp/test_dsa_key.pub');
+  my $dsa_rfc4716_key = File::Spec->rel2abs('t/etc/modules/mod_sftp/authorized_dsa_keys');
+
+  my $authorized_keys = File::Spec->rel2abs("$tmpdir/.authorized_keys");
+  unless (copy($dsa_rfc4716_key, $authorized_keys)) {
+    die("Can't copy $dsa_rfc4716_key to $authorized_keys: $!");
+  }
+
+  my $batch_file = File::Spec->rel2abs("$tmpdir/sftp-batch.txt");
+  if (open(my $fh, "> $batch_file")) {
+    print $fh "pwd\n";
+
+    unless (close($fh)) {
+      die("Can't write $batch_file: $!");
+    }
+
+  } else {
+    die("Can't open $batch_file: $!");
+  }
+
+  my $count = 250;
+  my $timeout = ($count * 2);
+
+  my $config = {
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+    TraceLog => $log_file,
+    Trace => 'DEFAULT:10 ssh2:20 sftp:20',
+
+    AuthUserFile => $auth_user_file,
+    AuthGroupFile => $auth_group_file,
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_sftp.c' => [
+        "SFTPEngine on",
+        "SFTPLog $log_file",
+        "SFTPHostKey $rsa_host_key",
+        "SFTPHostKey $dsa_host_key",
+        "SFTPAuthorizedUserKeys file:~/.authorized_keys",
+      ],
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($config_file, $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  require Net::SSH2;
+
+  my $ex;
+
+  # Ignore SIGPIPE
+  local $SIG{PIPE} = sub { };
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      sleep(1);
+
+      my @cmd = (
+        'sftp',
+        '-oBatchMode=yes',
+        '-oCheckHostIP=no',
+        '-oCompression=yes',
+        "-oPort=$port",
+        '-oHostKeyAlgorithms=ssh-dss',
+        "-oIdentityFile=$dsa_priv_key",
+        '-oPubkeyAuthentication=yes',
+        '-oStrictHostKeyChecking=no',
+        '-vvv',
+        '-b',
         "$batch_file",
         "$user\@127.0.0.1",
       );
@@ -18008,7 +18273,7 @@ sub sftp_upload_largefile {
   unlink($log_file);
 }
 
-sub sftp_upload_device_full {
+sub sftp_upload_largefile_auto_channel_window {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -18047,6 +18312,39 @@ sub sftp_upload_device_full {
   my $rsa_host_key = File::Spec->rel2abs('t/etc/modules/mod_sftp/ssh_host_rsa_key');
   my $dsa_host_key = File::Spec->rel2abs('t/etc/modules/mod_sftp/ssh_host_dsa_key');
 
+  my $fh;
+
+  my $test_file = File::Spec->rel2abs("$tmpdir/test.txt");
+  if (open($fh, "> $test_file")) {
+    # Make a file that's larger than the maximum SSH2 packet size, forcing
+    # the scp code to loop properly entire the entire large file is sent.
+
+    print $fh "ABCDefgh" x 16384;
+    unless (close($fh)) {
+      die("Can't write $test_file: $!");
+    }
+
+  } else {
+    die("Can't open $test_file: $!");
+  }
+
+  # Calculate the MD5 checksum of this file, for comparison with the
+  # downloaded file.
+  my $ctx = Digest::MD5->new();
+  my $expected_md5;
+
+  if (open($fh, "< $test_file")) {
+    binmode($fh);
+    $ctx->addfile($fh);
+    $expected_md5 = $ctx->hexdigest();
+    close($fh);
+
+  } else {
+    die("Can't read $test_file: $!");
+  }
+
+  my $test_file2 = File::Spec->rel2abs("$tmpdir/test2.txt");
+
   my $config = {
     PidFile => $pid_file,
     ScoreboardFile => $scoreboard_file,
@@ -18056,7 +18354,6 @@ sub sftp_upload_device_full {
 
     AuthUserFile => $auth_user_file,
     AuthGroupFile => $auth_group_file,
-    AllowOverwrite => 'on',
 
     IfModules => {
       'mod_delay.c' => {
@@ -18068,7 +18365,11 @@ sub sftp_upload_device_full {
         "SFTPLog $log_file",
         "SFTPHostKey $rsa_host_key",
         "SFTPHostKey $dsa_host_key",
-        "SFTPOptions IgnoreSFTPUploadPerms",
+        "SFTPOptions AutoChannelWindow",
+
+        # The default window is already the largest allowed, so start from
+        # a smaller one, which the auto-tuning can then grow.
+        "SFTPClientMatch \".*\" channelWindowSize 256KB",
       ],
     },
   };
@@ -18094,6 +18395,11 @@ sub sftp_upload_device_full {
   $self->handle_sigchld();
   defined(my $pid = fork()) or die("Can't fork: $!");
   if ($pid) {
+    my $test_rfh;
+    unless (open($test_rfh, "< $test_file")) {
+      die("Can't read $test_file: $!");
+    }
+
     eval {
       my $ssh2 = Net::SSH2->new();
 
@@ -18115,30 +18421,234 @@ sub sftp_upload_device_full {
         die("Can't use SFTP on SSH2 server: [$err_name] ($err_code) $err_str");
       }
 
-      # XXX The /dev/full device only exists on Linux, as far as I know
-      my $fh = $sftp->open('/dev/full', O_WRONLY|O_CREAT|O_TRUNC, 0644);
-      unless ($fh) {
+      my $test_wfh = $sftp->open('test2.txt', O_WRONLY|O_CREAT|O_TRUNC, 0644);
+      unless ($test_wfh) {
         my ($err_code, $err_name) = $sftp->error();
-        die("Can't open /dev/full: [$err_name] ($err_code)");
+        die("Can't open test2.txt: [$err_name] ($err_code)");
       }
 
-      my $count = 20;
-      for (my $i = 0; $i < $count; $i++) {
-        unless (print $fh "ABCD" x 8192) {
-          die("Failed to write to /dev/full: $!");
-        }
+
+      my $buf;
+      my $bufsz = 8192;
+
+      while (read($test_rfh, $buf, $bufsz)) {
+        print $test_wfh $buf;
       }
 
-      # XXX Hrm.  Looks like the Net::SSH2::File interface does not actually
-      # inform the user if there was a CLOSE error, or if there was an
-      # error writing (e.g. if the disk was full).  Will have to file
-      # a bug report with them about this.
-      #
-      # This means that, for now, you have to double-check the generated
-      # logs to make sure that mod_sftp is sending the correct error/response.
+      close($test_rfh);
 
       # To issue the FXP_CLOSE, we have to explicitly destroy the filehandle
-      $fh = undef;
+      $test_wfh = undef;
+
+      # To close the SFTP channel, we have to explicitly destroy the object
+      $sftp = undef;
+
+      $ssh2->disconnect();
+
+      unless (-f $test_file2) {
+        die("$test_file2 file does not exist as expected");
+      }
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($config_file, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($pid_file);
+
+  $self->assert_child_ok($pid);
+
+  if ($ex) {
+    test_append_logfile($log_file, $ex);
+    unlink($log_file);
+
+    die($ex);
+  }
+
+  # Calculate the MD5 checksum of the uploaded file, for comparison with the
+  # file that was uploaded.
+  $ctx->reset();
+  my $md5;
+
+  if (open($fh, "< $test_file2")) {
+    binmode($fh);
+    $ctx->addfile($fh);
+    $md5 = $ctx->hexdigest();
+    close($fh);
+
+  } else {
+    die("Can't read $test_file2: $!");
+  }
+
+  $self->assert($expected_md5 eq $md5,
+    test_msg("Expected '$expected_md5', got '$md5'"));
+
+  my $found = 0;
+  if (open(my $log_fh, "< $log_file")) {
+    while (my $line = <$log_fh>) {
+      if ($line =~ /channel ID \d+: received \d+ bytes, \d+ window adjusts/) {
+        $found = 1;
+        last;
+      }
+    }
+
+    close($log_fh);
+
+  } else {
+    die("Can't read $log_file: $!");
+  }
+
+  $self->assert($found,
+    test_msg("Expected channel window stats in SFTPLog, did not see them"));
+
+  unlink($log_file);
+}
+
+sub sftp_upload_device_full {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+
+  my $config_file = "$tmpdir/sftp.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/sftp.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/sftp.scoreboard");
+
+  my $log_file = test_get_logfile();
+
+  my $auth_user_file = File::Spec->rel2abs("$tmpdir/sftp.passwd");
+  my $auth_group_file = File::Spec->rel2abs("$tmpdir/sftp.group");
+
+  my $user = 'proftpd';
+  my $passwd = 'test';
+  my $group = 'ftpd';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+  my $uid = 500;
+  my $gid = 500;
+
+  # Make sure that, if we're running as root, that the home directory has
+  # permissions/privs set for the account we create
+  if ($< == 0) {
+    unless (chmod(0755, $home_dir)) {
+      die("Can't set perms on $home_dir to 0755: $!");
+    }
+
+    unless (chown($uid, $gid, $home_dir)) {
+      die("Can't set owner of $home_dir to $uid/$gid: $!");
+    }
+  }
+
+  auth_user_write($auth_user_file, $user, $passwd, $uid, $gid, $home_dir,
+    '/bin/bash');
+  auth_group_write($auth_group_file, $group, $gid, $user);
+
+  my $rsa_host_key = File::Spec->rel2abs('t/etc/modules/mod_sftp/ssh_host_rsa_key');
+  my $dsa_host_key = File::Spec->rel2abs('t/etc/modules/mod_sftp/ssh_host_dsa_key');
+
+  my $config = {
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+    TraceLog => $log_file,
+    Trace => 'DEFAULT:10 ssh2:20 sftp:20 scp:20',
+
+    AuthUserFile => $auth_user_file,
+    AuthGroupFile => $auth_group_file,
+    AllowOverwrite => 'on',
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_sftp.c' => [
+        "SFTPEngine on",
+        "SFTPLog $log_file",
+        "SFTPHostKey $rsa_host_key",
+        "SFTPHostKey $dsa_host_key",
+        "SFTPOptions IgnoreSFTPUploadPerms",
+      ],
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($config_file, $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  require Net::SSH2;
+
+  my $ex;
+
+  # Ignore SIGPIPE
+  local $SIG{PIPE} = sub { };
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      my $ssh2 = Net::SSH2->new();
+
+      sleep(1);
+
+      unless ($ssh2->connect('127.0.0.1', $port)) {
+        my ($err_code, $err_name, $err_str) = $ssh2->error();
+        die("Can't connect to SSH2 server: [$err_name] ($err_code) $err_str");
+      }
+
+      unless ($ssh2->auth_password($user, $passwd)) {
+        my ($err_code, $err_name, $err_str) = $ssh2->error();
+        die("Can't login to SSH2 server: [$err_name] ($err_code) $err_str");
+      }
+
+      my $sftp = $ssh2->sftp();
+      unless ($sftp) {
+        my ($err_code, $err_name, $err_str) = $ssh2->error();
+        die("Can't use SFTP on SSH2 server: [$err_name] ($err_code) $err_str");
+      }
+
+      # XXX The /dev/full device only exists on Linux, as far as I know
+      my $fh = $sftp->open('/dev/full', O_WRONLY|O_CREAT|O_TRUNC, 0644);
+      unless ($fh) {
+        my ($err_code, $err_name) = $sftp->error();
+        die("Can't open /dev/full: [$err_name] ($err_code)");
+      }
+
+      my $count = 20;
+      for (my $i = 0; $i < $count; $i++) {
+        unless (print $fh "ABCD" x 8192) {
+          die("Failed to write to /dev/full: $!");
+        }
+      }
+
+      # XXX Hrm.  Looks like the Net::SSH2::File interface does not actually
+      # inform the user if there was a CLOSE error, or if there was an
+      # error writing (e.g. if the disk was full).  Will have to file
+      # a bug report with them about this.
+      #
+      # This means that, for now, you have to double-check the generated
+      # logs to make sure that mod_sftp is sending the correct error/response.
+
+      # To issue the FXP_CLOSE, we have to explicitly destroy the filehandle
+      $fh = undef;
 
       # To close the SFTP channel, we have to explicitly destroy the object
       $sftp = undef;
@@ -19536,6 +20046,251 @@ sub sftp_download_largefile {
   unlink($log_file);
 }
 
+sub sftp_download_largefile_fast_data_path {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+
+  my $config_file = "$tmpdir/sftp.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/sftp.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/sftp.scoreboard");
+
+  my $log_file = test_get_logfile();
+
+  my $auth_user_file = File::Spec->rel2abs("$tmpdir/sftp.passwd");
+  my $auth_group_file = File::Spec->rel2abs("$tmpdir/sftp.group");
+
+  my $user = 'proftpd';
+  my $passwd = 'test';
+  my $group = 'ftpd';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+  my $uid = 500;
+  my $gid = 500;
+
+  # Make sure that, if we're running as root, that the home directory has
+  # permissions/privs set for the account we create
+  if ($< == 0) {
+    unless (chmod(0755, $home_dir)) {
+      die("Can't set perms on $home_dir to 0755: $!");
+    }
+
+    unless (chown($uid, $gid, $home_dir)) {
+      die("Can't set owner of $home_dir to $uid/$gid: $!");
+    }
+  }
+
+  auth_user_write($auth_user_file, $user, $passwd, $uid, $gid, $home_dir,
+    '/bin/bash');
+  auth_group_write($auth_group_file, $group, $gid, $user);
+
+  my $rsa_host_key = File::Spec->rel2abs('t/etc/modules/mod_sftp/ssh_host_rsa_key');
+  my $dsa_host_key = File::Spec->rel2abs('t/etc/modules/mod_sftp/ssh_host_dsa_key');
+
+  my $fh;
+
+  my $test_file = File::Spec->rel2abs("$tmpdir/test.txt");
+  if (open($fh, "> $test_file")) {
+    # Make a file that's larger than the maximum SSH2 packet size, forcing
+    # the scp code to loop properly entire the entire large file is sent.
+
+    print $fh "ABCDefgh" x 16384;
+    unless (close($fh)) {
+      die("Can't write $test_file: $!");
+    }
+
+  } else {
+    die("Can't open $test_file: $!");
+  }
+
+  # Calculate the MD5 checksum of this file, for comparison with the
+  # downloaded file.
+  my $ctx = Digest::MD5->new();
+  my $expected_md5;
+
+  if (open($fh, "< $test_file")) {
+    binmode($fh);
+    $ctx->addfile($fh);
+    $expected_md5 = $ctx->hexdigest();
+    close($fh);
+
+  } else {
+    die("Can't read $test_file: $!");
+  }
+
+  my $test_file2 = File::Spec->rel2abs("$tmpdir/test2.txt");
+
+  my $config = {
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+    TraceLog => $log_file,
+    Trace => 'DEFAULT:10 ssh2:20 sftp:20 scp:20',
+
+    AuthUserFile => $auth_user_file,
+    AuthGroupFile => $auth_group_file,
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_sftp.c' => [
+        "SFTPEngine on",
+        "SFTPLog $log_file",
+        "SFTPHostKey $rsa_host_key",
+        "SFTPHostKey $dsa_host_key",
+        "SFTPOptions FastDataPath",
+      ],
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($config_file, $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  require Net::SSH2;
+
+  my $ex;
+
+  # Ignore SIGPIPE
+  local $SIG{PIPE} = sub { };
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    my $test_wfh;
+    unless (open($test_wfh, "> $test_file2")) {
+      die("Can't open $test_file2: $!");
+    }
+
+    binmode($test_wfh);
+
+    eval {
+      my $ssh2 = Net::SSH2->new();
+
+      sleep(1);
+
+      unless ($ssh2->connect('127.0.0.1', $port)) {
+        my ($err_code, $err_name, $err_str) = $ssh2->error();
+        die("Can't connect to SSH2 server: [$err_name] ($err_code) $err_str");
+      }
+
+      unless ($ssh2->auth_password($user, $passwd)) {
+        my ($err_code, $err_name, $err_str) = $ssh2->error();
+        die("Can't login to SSH2 server: [$err_name] ($err_code) $err_str");
+      }
+
+      my $sftp = $ssh2->sftp();
+      unless ($sftp) {
+        my ($err_code, $err_name, $err_str) = $ssh2->error();
+        die("Can't use SFTP on SSH2 server: [$err_name] ($err_code) $err_str");
+      }
+
+      my $test_rfh = $sftp->open('test.txt', O_RDONLY);
+      unless ($test_rfh) {
+        my ($err_code, $err_name) = $sftp->error();
+        die("Can't open test.txt: [$err_name] ($err_code)");
+      }
+
+      my $buf;
+      my $bufsz = 8192;
+
+      my $res = $test_rfh->read($buf, $bufsz);
+      while ($res) {
+        print $test_wfh $buf;
+
+        $res = $test_rfh->read($buf, $bufsz);
+      }
+
+      unless (close($test_wfh)) {
+        die("Can't write $test_file2: $!");
+      }
+
+      # To issue the FXP_CLOSE, we have to explicitly destroy the filehandle
+      $test_rfh = undef;
+
+      # To close the SFTP channel, we have to explicitly destroy the object
+      $sftp = undef;
+
+      $ssh2->disconnect();
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($config_file, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($pid_file);
+
+  $self->assert_child_ok($pid);
+
+  if ($ex) {
+    test_append_logfile($log_file, $ex);
+    unlink($log_file);
+
+    die($ex);
+  }
+
+  # Calculate the MD5 checksum of the downloaded file, for comparison with the
+  # downloaded file.
+  $ctx->reset();
+  my $md5;
+
+  if (open($fh, "< $test_file2")) {
+    binmode($fh);
+    $ctx->addfile($fh);
+    $md5 = $ctx->hexdigest();
+    close($fh);
+
+  } else {
+    die("Can't read $test_file2: $!");
+  }
+
+  $self->assert($expected_md5 eq $md5,
+    test_msg("Expected '$expected_md5', got '$md5'"));
+
+  # The first READ takes the full path; the rest should have been counted
+  # and logged when the handle was closed.
+  my $found = 0;
+  if (open($fh, "< $log_file")) {
+    while (my $line = <$fh>) {
+      if ($line =~ /FastDataPath: \d+ READ requests? for/) {
+        $found = 1;
+        last;
+      }
+    }
+
+    close($fh);
+
+  } else {
+    die("Can't read $log_file: $!");
+  }
+
+  $self->assert($found,
+    test_msg("Expected FastDataPath SFTPLog message, did not see one"));
+
+  unlink($log_file);
+}
+
 sub sftp_download_fifo_bug3314 {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
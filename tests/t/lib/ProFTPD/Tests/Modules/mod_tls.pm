@@ -8,6 +8,7 @@ use File::Copy;
 use File::Path qw(mkpath);
 use File::Spec;
 use IO::Handle;
+use IPC::Open3;
 
 use ProFTPD::TestSuite::FTP;
 use ProFTPD::TestSuite::Utils qw(:auth :config :running :test :testsuite);
@@ -47,6 +48,11 @@ my $TESTS = {
     test_class => [qw(forking)],
   },
 
+  tls_crl_path_ok => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
   tls_list_no_session_reuse => {
     order => ++$order,
     test_class => [qw(forking)],
@@ -163,6 +169,21 @@ my $TESTS = {
     test_class => [qw(forking)],
   },
 
+  tls_session_tickets => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
+  tls_opts_kernel_tls_retr => {
+    order => ++$order,
+    test_class => [qw(feat_sendfile forking)],
+  },
+
+  tls_retr_coalesced_records => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
   tls_required_on_feat_allowed_bug3420 => {
     order => ++$order,
     test_class => [qw(bug forking)],
@@ -257,6 +278,16 @@ my $TESTS = {
     test_class => [qw(bug forking inprogress)],
   },
 
+  tls_stapling => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
+  tls_key_workers => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
   tls_client_cert_verify_failed_selfsigned_cert_only_bug3742 => {
     order => ++$order,
     test_class => [qw(bug forking)],
@@ -1190,6 +1221,194 @@ sub tls_crl_file_ok {
   unlink($log_file);
 }
 
+sub tls_crl_path_ok {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+
+  my $config_file = "$tmpdir/tls.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/tls.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/tls.scoreboard");
+
+  my $log_file = test_get_logfile();
+
+  my $auth_user_file = File::Spec->rel2abs("$tmpdir/tls.passwd");
+  my $auth_group_file = File::Spec->rel2abs("$tmpdir/tls.group");
+
+  my $user = 'proftpd';
+  my $passwd = 'test';
+  my $group = 'ftpd';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+  my $uid = 500;
+  my $gid = 500;
+
+  # Make sure that, if we're running as root, that the home directory has
+  # permissions/privs set for the account we create
+  if ($< == 0) {
+    unless (chmod(0755, $home_dir)) {
+      die("Can't set perms on $home_dir to 0755: $!");
+    }
+
+    unless (chown($uid, $gid, $home_dir)) {
+      die("Can't set owner of $home_dir to $uid/$gid: $!");
+    }
+  }
+
+  auth_user_write($auth_user_file, $user, $passwd, $uid, $gid, $home_dir,
+    '/bin/bash');
+  auth_group_write($auth_group_file, $group, $gid, $user);
+
+  my $server_cert = File::Spec->rel2abs('t/etc/modules/mod_tls/crl-server-cert.pem');
+  my $client_cert = File::Spec->rel2abs('t/etc/modules/mod_tls/crl-client-cert.pem');
+  my $ca_cert = File::Spec->rel2abs('t/etc/modules/mod_tls/crl-ca.pem');
+  my $crl_file = File::Spec->rel2abs('t/etc/modules/mod_tls/crl-ca-revoked.pem');
+
+  # Set up a hashed CRL directory, as c_rehash(1) would: the CRL file, and
+  # a hash-value.r0 symlink to it.  The CRL must only be indexed once.
+  my $crl_dir = File::Spec->rel2abs("$tmpdir/crl");
+  mkpath($crl_dir);
+
+  unless (copy($crl_file, "$crl_dir/crl-ca-revoked.pem")) {
+    die("Can't copy $crl_file to $crl_dir: $!");
+  }
+
+  my $crl_hash = `openssl crl -hash -noout -in $crl_file`;
+  chomp($crl_hash);
+
+  unless (symlink('crl-ca-revoked.pem', "$crl_dir/$crl_hash.r0")) {
+    die("Can't symlink $crl_dir/$crl_hash.r0: $!");
+  }
+
+  my $config = {
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+
+    AuthUserFile => $auth_user_file,
+    AuthGroupFile => $auth_group_file,
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_tls.c' => {
+        TLSEngine => 'on',
+        TLSLog => $log_file,
+        TLSProtocol => 'SSLv3 TLSv1',
+        TLSRequired => 'on',
+        TLSRSACertificateFile => $server_cert,
+        TLSCACertificateFile => $ca_cert,
+
+        # Verifying clients via CRLs only works when verification is
+        # explicitly enabled.
+        TLSCARevocationPath => $crl_dir,
+        TLSVerifyClient => 'on',
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($config_file, $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  require Net::FTPSSL;
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      # Give the server a chance to start up
+      sleep(2);
+
+      my $client;
+
+      eval {
+        # IO::Socket::SSL options
+        my $ssl_opts = {
+          SSL_use_cert => 1,
+          SSL_cert_file => $client_cert,
+          SSL_key_file => $client_cert,
+        };
+
+        $client = Net::FTPSSL->new('127.0.0.1',
+          Croak => 1,
+          Encryption => 'E',
+          Port => $port,
+          SSL_Client_Certificate => $ssl_opts,
+        );
+      };
+
+      my $ex = $@;
+      unless ($ex) {
+        die("SSL connection succeeded unexpectedly");
+      }
+
+      my $errstr = IO::Socket::SSL::errstr();
+
+      my $expected = 'certificate revoked';
+      $self->assert(qr/$expected/, $errstr,
+        test_msg("Expected '$expected', got '$errstr'"));
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($config_file, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($pid_file);
+
+  $self->assert_child_ok($pid);
+
+  if ($ex) {
+    test_append_logfile($log_file, $ex);
+    unlink($log_file);
+
+    die($ex);
+  }
+
+  my $found = 0;
+  if (open(my $log_fh, "< $log_file")) {
+    while (my $line = <$log_fh>) {
+      if ($line =~ /using 1 CRL \(\d+ revoked serials?\)/) {
+        $found = 1;
+        last;
+      }
+    }
+
+    close($log_fh);
+
+  } else {
+    die("Can't read $log_file: $!");
+  }
+
+  $self->assert($found,
+    test_msg("Did not see expected indexed CRL in TLSLog"));
+
+  unlink($log_file);
+}
+
 sub tls_list_no_session_reuse {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
@@ -4895,7 +5114,7 @@ sub tls_retr_empty_file {
   unlink($log_file);
 }
 
-sub tls_required_on_feat_allowed_bug3420 {
+sub tls_session_tickets {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -4954,12 +5173,24 @@ sub tls_required_on_feat_allowed_bug3420 {
         TLSRequired => 'on',
         TLSRSACertificateFile => $cert_file,
         TLSCACertificateFile => $ca_file,
+        TLSOptions => 'NoSessionReuseRequired',
+        TLSSessionTickets => 'on',
       },
     },
   };
 
   my ($port, $config_user, $config_group) = config_write($config_file, $config);
 
+  my $empty_file = File::Spec->rel2abs("$tmpdir/empty.txt");
+  if (open(my $fh, "> $empty_file")) {
+    close($fh);
+
+  } else {
+    die("Can't open $empty_file: $!");
+  }
+
+  my $test_file = File::Spec->rel2abs("$tmpdir/test.txt");
+
   # Open pipes, for use between the parent and child processes.  Specifically,
   # the child will indicate when it's done with its test by writing a message
   # to the parent.
@@ -4980,16 +5211,38 @@ sub tls_required_on_feat_allowed_bug3420 {
       # Give the server a chance to start up
       sleep(2);
 
-      # We use a non-FTPS client here, to make sure that we can at least
-      # get the FEAT data, as per Bug#3420.
+      my $client = Net::FTPSSL->new('127.0.0.1',
+        Encryption => 'E',
+        Port => $port,
+      );
 
-      my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
-      $client->feat();
+      unless ($client) {
+        die("Can't connect to FTPS server: " . IO::Socket::SSL::errstr());
+      }
+
+      unless ($client->login($user, $passwd)) {
+        die("Can't login: " . $client->last_message());
+      }
+
+      unless ($client->binary()) {
+        die("Can't set transfer mode to binary: " . $client->last_message());
+      }
+
+      unless ($client->get($empty_file, $test_file)) {
+        die("Can't download '$empty_file' to '$test_file': " .
+          $client->last_message());
+      }
+
+      $client->quit();
+
+      unless (-f $test_file) {
+        die("File $test_file does not exist as expected");
+      }
+
+      unless (-z $test_file) {
+        die("File $test_file is not empty as expected");
+      }
 
-      my $resp_msgs = $client->response_msgs();
-      my $count = scalar(@$resp_msgs);
-      $self->assert($count > 0,
-        test_msg("Expected > 0, got $count"));
     };
 
     if ($@) {
@@ -5021,10 +5274,28 @@ sub tls_required_on_feat_allowed_bug3420 {
     die($ex);
   }
 
+  my $found = 0;
+  if (open(my $log_fh, "< $log_file")) {
+    while (my $line = <$log_fh>) {
+      if ($line =~ /\[stat\]: SSL handshakes: \d+/) {
+        $found = 1;
+        last;
+      }
+    }
+
+    close($log_fh);
+
+  } else {
+    die("Can't read $log_file: $!");
+  }
+
+  $self->assert($found,
+    test_msg("Did not see expected handshake statistics in TLSLog"));
+
   unlink($log_file);
 }
 
-sub tls_implicit_ssl_bug3437 {
+sub tls_opts_kernel_tls_retr {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -5064,20 +5335,19 @@ sub tls_implicit_ssl_bug3437 {
   my $ca_file = File::Spec->rel2abs('t/etc/modules/mod_tls/ca-cert.pem');
 
   my $config = {
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+    TraceLog => $log_file,
+    Trace => 'tls:20',
 
-    # The stupid Net::FTPSSL client requires port 990 when implicit
-    # FTPS is used, regardless of the port we pass to the constructor.
-    # (What kind of client API does not allow the port to be changed??)
-    Port => 990,
-
-    PidFile => $pid_file,
-    ScoreboardFile => $scoreboard_file,
-    SystemLog => $log_file,
-    TraceLog => $log_file,
-    Trace => 'DEFAULT:10',
+    # We explicitly use DebugLevel 10 here, to get the sendfile log
+    # message emitted by mod_xfer.
+    DebugLevel => 10,
 
     AuthUserFile => $auth_user_file,
     AuthGroupFile => $auth_group_file,
+    UseSendfile => 'on',
 
     IfModules => {
       'mod_delay.c' => {
@@ -5087,17 +5357,45 @@ sub tls_implicit_ssl_bug3437 {
       'mod_tls.c' => {
         TLSEngine => 'on',
         TLSLog => $log_file,
-        TLSProtocol => 'SSLv3 TLSv1',
-        TLSRequired => 'off',
-        TLSOptions => 'UseImplicitSSL',
+        TLSProtocol => 'TLSv1.2',
+        TLSRequired => 'on',
         TLSRSACertificateFile => $cert_file,
         TLSCACertificateFile => $ca_file,
+        TLSOptions => 'NoSessionReuseRequired KernelTLS',
       },
     },
   };
 
   my ($port, $config_user, $config_group) = config_write($config_file, $config);
 
+  # Without kTLS support in OpenSSL, mod_tls ignores the KernelTLS option
+  # (with a notice), and there is nothing to test.
+  my $proftpd_bin = ProFTPD::TestSuite::Utils::get_proftpd_bin();
+  my $syntax = `$proftpd_bin -t -c $config_file 2>&1`;
+  if ($syntax =~ /TLSOption KernelTLS not supported/) {
+    print STDERR " + unable to run 'tls_opts_kernel_tls_retr' test without kTLS support in OpenSSL, skipping\n";
+    unlink($log_file);
+    return;
+  }
+
+  # Whether or not the kernel accepts the keys, the downloaded data must
+  # be intact.
+  my $src_file = File::Spec->rel2abs("$tmpdir/src.bin");
+  my $src_len = 1024 * 1024;
+  if (open(my $fh, "> $src_file")) {
+    binmode($fh);
+    print $fh "ABCDefgh" x ($src_len / 8);
+
+    unless (close($fh)) {
+      die("Can't write $src_file: $!");
+    }
+
+  } else {
+    die("Can't open $src_file: $!");
+  }
+
+  my $test_file = File::Spec->rel2abs("$tmpdir/test.txt");
+
   # Open pipes, for use between the parent and child processes.  Specifically,
   # the child will indicate when it's done with its test by writing a message
   # to the parent.
@@ -5118,16 +5416,10 @@ sub tls_implicit_ssl_bug3437 {
       # Give the server a chance to start up
       sleep(2);
 
-      my $client_opts = {
-        Encryption => 'I',
+      my $client = Net::FTPSSL->new('127.0.0.1',
+        Encryption => 'E',
         Port => $port,
-      };
-
-      if ($ENV{TEST_VERBOSE}) {
-        $client_opts->{Debug} = 1;
-      }
-
-      my $client = Net::FTPSSL->new('127.0.0.1', %$client_opts);
+      );
 
       unless ($client) {
         die("Can't connect to FTPS server: " . IO::Socket::SSL::errstr());
@@ -5137,11 +5429,38 @@ sub tls_implicit_ssl_bug3437 {
         die("Can't login: " . $client->last_message());
       }
 
-      unless ($client->ccc('P')) {
-        die("CCC failed: " . $client->last_message());
+      unless ($client->binary()) {
+        die("Can't set transfer mode to binary: " . $client->last_message());
+      }
+
+      unless ($client->get($src_file, $test_file)) {
+        die("Can't download '$src_file' to '$test_file': " .
+          $client->last_message());
       }
 
       $client->quit();
+
+      unless (-f $test_file) {
+        die("File $test_file does not exist as expected");
+      }
+
+      my $test_len = -s $test_file;
+      $self->assert($src_len == $test_len,
+        test_msg("Expected file size $src_len, got $test_len"));
+
+      if (open(my $fh, "< $test_file")) {
+        binmode($fh);
+        local $/;
+        my $data = <$fh>;
+        close($fh);
+
+        $self->assert($data eq ("ABCDefgh" x ($src_len / 8)),
+          test_msg("Downloaded data does not match expected data"));
+
+      } else {
+        die("Can't read $test_file: $!");
+      }
+
     };
 
     if ($@) {
@@ -5173,10 +5492,47 @@ sub tls_implicit_ssl_bug3437 {
     die($ex);
   }
 
+  # Now make sure that the kernel sealed the records, and that mod_xfer
+  # used sendfile(2) for them.  The kernel needs the 'tls' module (ULP)
+  # for this; without it, OpenSSL falls back to encrypting the data itself.
+  if (open(my $fh, "< $log_file")) {
+    my ($have_ktls, $no_ktls, $have_sendfile) = (0, 0, 0);
+
+    while (my $line = <$fh>) {
+      chomp($line);
+
+      if ($line =~ /using kernel TLS \(kTLS\) for sending data/) {
+        $have_ktls = 1;
+
+      } elsif ($line =~ /kernel TLS \(kTLS\) not available for sending data/) {
+        $no_ktls = 1;
+
+      } elsif ($line =~ /using sendfile capability for transmitting data/) {
+        $have_sendfile = 1;
+      }
+    }
+
+    close($fh);
+
+    if ($no_ktls) {
+      print STDERR " + unable to run 'tls_opts_kernel_tls_retr' test without kTLS support in the kernel, skipping\n";
+      unlink($log_file);
+      return;
+    }
+
+    $self->assert($have_ktls,
+      test_msg("Expected log message 'using kernel TLS (kTLS) for sending data' did not appear in TraceLog"));
+    $self->assert($have_sendfile,
+      test_msg("Expected log message 'using sendfile capability for transmitting data' did not appear in SystemLog"));
+
+  } else {
+    die("Can't read $log_file: $!");
+  }
+
   unlink($log_file);
 }
 
-sub tls_ccc_list_bug3465 {
+sub tls_retr_coalesced_records {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -5219,11 +5575,10 @@ sub tls_ccc_list_bug3465 {
     PidFile => $pid_file,
     ScoreboardFile => $scoreboard_file,
     SystemLog => $log_file,
-    TraceLog => $log_file,
-    Trace => 'DEFAULT:10',
 
     AuthUserFile => $auth_user_file,
     AuthGroupFile => $auth_group_file,
+    UseSendfile => 'off',
 
     IfModules => {
       'mod_delay.c' => {
@@ -5233,17 +5588,37 @@ sub tls_ccc_list_bug3465 {
       'mod_tls.c' => {
         TLSEngine => 'on',
         TLSLog => $log_file,
-        TLSProtocol => 'SSLv3 TLSv1',
-        TLSRequired => 'off',
-        TLSOptions => 'NoSessionReuseRequired',
+        TLSProtocol => 'TLSv1.2',
+        TLSRequired => 'on',
         TLSRSACertificateFile => $cert_file,
         TLSCACertificateFile => $ca_file,
+        TLSOptions => 'NoSessionReuseRequired',
       },
     },
   };
 
   my ($port, $config_user, $config_group) = config_write($config_file, $config);
 
+  # The data channel writes are coalesced into TLS records, with the last,
+  # partial record held back until the data channel is closed.  Use a
+  # length which is not a multiple of any record size, to make sure that
+  # the held-back data is not lost.
+  my $src_file = File::Spec->rel2abs("$tmpdir/src.bin");
+  my $src_len = (1024 * 1024) + 8 + 1;
+  if (open(my $fh, "> $src_file")) {
+    binmode($fh);
+    print $fh "ABCDefgh" x int($src_len / 8), "Z";
+
+    unless (close($fh)) {
+      die("Can't write $src_file: $!");
+    }
+
+  } else {
+    die("Can't open $src_file: $!");
+  }
+
+  my $test_file = File::Spec->rel2abs("$tmpdir/test.txt");
+
   # Open pipes, for use between the parent and child processes.  Specifically,
   # the child will indicate when it's done with its test by writing a message
   # to the parent.
@@ -5264,16 +5639,10 @@ sub tls_ccc_list_bug3465 {
       # Give the server a chance to start up
       sleep(2);
 
-      my $client_opts = {
+      my $client = Net::FTPSSL->new('127.0.0.1',
         Encryption => 'E',
         Port => $port,
-      };
-
-      if ($ENV{TEST_VERBOSE}) {
-        $client_opts->{Debug} = 1;
-      }
-
-      my $client = Net::FTPSSL->new('127.0.0.1', %$client_opts);
+      );
 
       unless ($client) {
         die("Can't connect to FTPS server: " . IO::Socket::SSL::errstr());
@@ -5283,16 +5652,38 @@ sub tls_ccc_list_bug3465 {
         die("Can't login: " . $client->last_message());
       }
 
-      unless ($client->ccc()) {
-        die("CCC failed: " . $client->last_message());
+      unless ($client->binary()) {
+        die("Can't set transfer mode to binary: " . $client->last_message());
       }
 
-      my $res = $client->list('.');
-      unless ($res) {
-        die("LIST failed: " . $client->message());
+      unless ($client->get($src_file, $test_file)) {
+        die("Can't download '$src_file' to '$test_file': " .
+          $client->last_message());
       }
 
       $client->quit();
+
+      unless (-f $test_file) {
+        die("File $test_file does not exist as expected");
+      }
+
+      my $test_len = -s $test_file;
+      $self->assert($src_len == $test_len,
+        test_msg("Expected file size $src_len, got $test_len"));
+
+      if (open(my $fh, "< $test_file")) {
+        binmode($fh);
+        local $/;
+        my $data = <$fh>;
+        close($fh);
+
+        $self->assert($data eq (("ABCDefgh" x int($src_len / 8)) . "Z"),
+          test_msg("Downloaded data does not match expected data"));
+
+      } else {
+        die("Can't read $test_file: $!");
+      }
+
     };
 
     if ($@) {
@@ -5327,7 +5718,7 @@ sub tls_ccc_list_bug3465 {
   unlink($log_file);
 }
 
-sub tls_opts_commonname_required_bug3512 {
+sub tls_required_on_feat_allowed_bug3420 {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -5363,9 +5754,6 @@ sub tls_opts_commonname_required_bug3512 {
     '/bin/bash');
   auth_group_write($auth_group_file, $group, $gid, $user);
 
-  my $bad_client_cert = File::Spec->rel2abs('t/etc/modules/mod_tls/client-cert.pem');
-  my $good_client_cert = File::Spec->rel2abs('t/etc/modules/mod_tls/client-cert-localhost.pem');
-
   my $cert_file = File::Spec->rel2abs('t/etc/modules/mod_tls/server-cert.pem');
   my $ca_file = File::Spec->rel2abs('t/etc/modules/mod_tls/ca-cert.pem');
 
@@ -5376,7 +5764,6 @@ sub tls_opts_commonname_required_bug3512 {
 
     AuthUserFile => $auth_user_file,
     AuthGroupFile => $auth_group_file,
-    UseReverseDNS => 'on',
 
     IfModules => {
       'mod_delay.c' => {
@@ -5390,8 +5777,6 @@ sub tls_opts_commonname_required_bug3512 {
         TLSRequired => 'on',
         TLSRSACertificateFile => $cert_file,
         TLSCACertificateFile => $ca_file,
-        TLSOptions => 'CommonNameRequired',
-        TLSVerifyClient => 'on',
       },
     },
   };
@@ -5418,47 +5803,16 @@ sub tls_opts_commonname_required_bug3512 {
       # Give the server a chance to start up
       sleep(2);
 
-      # IO::Socket::SSL options
-      my $ssl_opts = {
-        SSL_use_cert => 1,
-        SSL_cert_file => $bad_client_cert,
-        SSL_key_file => $bad_client_cert,
-      };
-
-      my $client;
-      eval {
-        $client = Net::FTPSSL->new('127.0.0.1',
-          Croak => 1,
-          Encryption => 'E',
-          Port => $port,
-          SSL_Client_Certificate => $ssl_opts,
-        );
-      };
-
-      unless ($@) { 
-        eval { $client->login($user, $passwd) };
-        unless ($@) {
-          die("Login succeeded unexpectedly");
-        }
-      }
-
-      $ssl_opts->{SSL_cert_file} = $good_client_cert;
-      $ssl_opts->{SSL_key_file} = $good_client_cert;
-
-      $client = Net::FTPSSL->new('127.0.0.1',
-        Croak => 1,
-        Encryption => 'E',
-        Port => $port,
-        SSL_Client_Certificate => $ssl_opts,
-      );
-
-      sleep(1);
+      # We use a non-FTPS client here, to make sure that we can at least
+      # get the FEAT data, as per Bug#3420.
 
-      unless ($client->login($user, $passwd)) {
-        die("Can't login: " . $client->last_message());
-      }
+      my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+      $client->feat();
 
-      $client->quit();
+      my $resp_msgs = $client->response_msgs();
+      my $count = scalar(@$resp_msgs);
+      $self->assert($count > 0,
+        test_msg("Expected > 0, got $count"));
     };
 
     if ($@) {
@@ -5469,7 +5823,7 @@ sub tls_opts_commonname_required_bug3512 {
     $wfh->flush();
 
   } else {
-    eval { server_wait($config_file, $rfh, 30) };
+    eval { server_wait($config_file, $rfh) };
     if ($@) {
       warn($@);
       exit 1;
@@ -5493,7 +5847,7 @@ sub tls_opts_commonname_required_bug3512 {
   unlink($log_file);
 }
 
-sub tls_opts_dns_name_required {
+sub tls_implicit_ssl_bug3437 {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -5529,20 +5883,24 @@ sub tls_opts_dns_name_required {
     '/bin/bash');
   auth_group_write($auth_group_file, $group, $gid, $user);
 
-  my $bad_client_cert = File::Spec->rel2abs('t/etc/modules/mod_tls/client-cert.pem');
-  my $good_client_cert = File::Spec->rel2abs('t/etc/modules/mod_tls/client-cert-localhost.pem');
-
   my $cert_file = File::Spec->rel2abs('t/etc/modules/mod_tls/server-cert.pem');
   my $ca_file = File::Spec->rel2abs('t/etc/modules/mod_tls/ca-cert.pem');
 
   my $config = {
+
+    # The stupid Net::FTPSSL client requires port 990 when implicit
+    # FTPS is used, regardless of the port we pass to the constructor.
+    # (What kind of client API does not allow the port to be changed??)
+    Port => 990,
+
     PidFile => $pid_file,
     ScoreboardFile => $scoreboard_file,
     SystemLog => $log_file,
+    TraceLog => $log_file,
+    Trace => 'DEFAULT:10',
 
     AuthUserFile => $auth_user_file,
     AuthGroupFile => $auth_group_file,
-    UseReverseDNS => 'on',
 
     IfModules => {
       'mod_delay.c' => {
@@ -5553,11 +5911,10 @@ sub tls_opts_dns_name_required {
         TLSEngine => 'on',
         TLSLog => $log_file,
         TLSProtocol => 'SSLv3 TLSv1',
-        TLSRequired => 'on',
+        TLSRequired => 'off',
+        TLSOptions => 'UseImplicitSSL',
         TLSRSACertificateFile => $cert_file,
         TLSCACertificateFile => $ca_file,
-        TLSOptions => 'dNSNameRequired',
-        TLSVerifyClient => 'on',
       },
     },
   };
@@ -5584,46 +5941,29 @@ sub tls_opts_dns_name_required {
       # Give the server a chance to start up
       sleep(2);
 
-      # IO::Socket::SSL options
-      my $ssl_opts = {
-        SSL_use_cert => 1,
-        SSL_cert_file => $bad_client_cert,
-        SSL_key_file => $bad_client_cert,
-      };
-
-      my $client;
-      eval {
-        $client = Net::FTPSSL->new('127.0.0.1',
-          Croak => 1,
-          Encryption => 'E',
-          Port => $port,
-          SSL_Client_Certificate => $ssl_opts,
-        );
+      my $client_opts = {
+        Encryption => 'I',
+        Port => $port,
       };
 
-      unless ($@) { 
-        eval { $client->login($user, $passwd) };
-        unless ($@) {
-          die("Login succeeded unexpectedly");
-        }
+      if ($ENV{TEST_VERBOSE}) {
+        $client_opts->{Debug} = 1;
       }
 
-      $ssl_opts->{SSL_cert_file} = $good_client_cert;
-      $ssl_opts->{SSL_key_file} = $good_client_cert;
-
-      $client = Net::FTPSSL->new('127.0.0.1',
-        Croak => 1,
-        Encryption => 'E',
-        Port => $port,
-        SSL_Client_Certificate => $ssl_opts,
-      );
+      my $client = Net::FTPSSL->new('127.0.0.1', %$client_opts);
 
-      sleep(1);
+      unless ($client) {
+        die("Can't connect to FTPS server: " . IO::Socket::SSL::errstr());
+      }
 
       unless ($client->login($user, $passwd)) {
         die("Can't login: " . $client->last_message());
       }
 
+      unless ($client->ccc('P')) {
+        die("CCC failed: " . $client->last_message());
+      }
+
       $client->quit();
     };
 
@@ -5635,7 +5975,7 @@ sub tls_opts_dns_name_required {
     $wfh->flush();
 
   } else {
-    eval { server_wait($config_file, $rfh, 30) };
+    eval { server_wait($config_file, $rfh) };
     if ($@) {
       warn($@);
       exit 1;
@@ -5659,7 +5999,7 @@ sub tls_opts_dns_name_required {
   unlink($log_file);
 }
 
-sub tls_opts_ip_addr_dns_name_cn_required {
+sub tls_ccc_list_bug3465 {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -5695,9 +6035,6 @@ sub tls_opts_ip_addr_dns_name_cn_required {
     '/bin/bash');
   auth_group_write($auth_group_file, $group, $gid, $user);
 
-  my $bad_client_cert = File::Spec->rel2abs('t/etc/modules/mod_tls/client-cert.pem');
-  my $good_client_cert = File::Spec->rel2abs('t/etc/modules/mod_tls/client-cert-localhost.pem');
-
   my $cert_file = File::Spec->rel2abs('t/etc/modules/mod_tls/server-cert.pem');
   my $ca_file = File::Spec->rel2abs('t/etc/modules/mod_tls/ca-cert.pem');
 
@@ -5705,10 +6042,11 @@ sub tls_opts_ip_addr_dns_name_cn_required {
     PidFile => $pid_file,
     ScoreboardFile => $scoreboard_file,
     SystemLog => $log_file,
+    TraceLog => $log_file,
+    Trace => 'DEFAULT:10',
 
     AuthUserFile => $auth_user_file,
     AuthGroupFile => $auth_group_file,
-    UseReverseDNS => 'on',
 
     IfModules => {
       'mod_delay.c' => {
@@ -5719,11 +6057,10 @@ sub tls_opts_ip_addr_dns_name_cn_required {
         TLSEngine => 'on',
         TLSLog => $log_file,
         TLSProtocol => 'SSLv3 TLSv1',
-        TLSRequired => 'on',
+        TLSRequired => 'off',
+        TLSOptions => 'NoSessionReuseRequired',
         TLSRSACertificateFile => $cert_file,
         TLSCACertificateFile => $ca_file,
-        TLSOptions => 'iPAddressRequired dNSNameRequired CommonNameRequired',
-        TLSVerifyClient => 'on',
       },
     },
   };
@@ -5750,46 +6087,34 @@ sub tls_opts_ip_addr_dns_name_cn_required {
       # Give the server a chance to start up
       sleep(2);
 
-      # IO::Socket::SSL options
-      my $ssl_opts = {
-        SSL_use_cert => 1,
-        SSL_cert_file => $bad_client_cert,
-        SSL_key_file => $bad_client_cert,
-      };
-
-      my $client;
-      eval {
-        $client = Net::FTPSSL->new('127.0.0.1',
-          Croak => 1,
-          Encryption => 'E',
-          Port => $port,
-          SSL_Client_Certificate => $ssl_opts,
-        );
+      my $client_opts = {
+        Encryption => 'E',
+        Port => $port,
       };
 
-      unless ($@) { 
-        eval { $client->login($user, $passwd) };
-        unless ($@) {
-          die("Login succeeded unexpectedly");
-        }
+      if ($ENV{TEST_VERBOSE}) {
+        $client_opts->{Debug} = 1;
       }
 
-      $ssl_opts->{SSL_cert_file} = $good_client_cert;
-      $ssl_opts->{SSL_key_file} = $good_client_cert;
-
-      $client = Net::FTPSSL->new('127.0.0.1',
-        Croak => 1,
-        Encryption => 'E',
-        Port => $port,
-        SSL_Client_Certificate => $ssl_opts,
-      );
+      my $client = Net::FTPSSL->new('127.0.0.1', %$client_opts);
 
-      sleep(1);
+      unless ($client) {
+        die("Can't connect to FTPS server: " . IO::Socket::SSL::errstr());
+      }
 
       unless ($client->login($user, $passwd)) {
         die("Can't login: " . $client->last_message());
       }
 
+      unless ($client->ccc()) {
+        die("CCC failed: " . $client->last_message());
+      }
+
+      my $res = $client->list('.');
+      unless ($res) {
+        die("LIST failed: " . $client->message());
+      }
+
       $client->quit();
     };
 
@@ -5801,7 +6126,7 @@ sub tls_opts_ip_addr_dns_name_cn_required {
     $wfh->flush();
 
   } else {
-    eval { server_wait($config_file, $rfh, 30) };
+    eval { server_wait($config_file, $rfh) };
     if ($@) {
       warn($@);
       exit 1;
@@ -5825,7 +6150,7 @@ sub tls_opts_ip_addr_dns_name_cn_required {
   unlink($log_file);
 }
 
-sub tls_site_chmod_ok {
+sub tls_opts_commonname_required_bug3512 {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -5845,14 +6170,6 @@ sub tls_site_chmod_ok {
   my $uid = 500;
   my $gid = 500;
 
-  my $test_file = File::Spec->rel2abs("$tmpdir/test.txt");
-  if (open(my $fh, "> $test_file")) {
-    close($fh);
-
-  } else {
-    die("Can't open $test_file: $!");
-  }
-
   # Make sure that, if we're running as root, that the home directory has
   # permissions/privs set for the account we create
   if ($< == 0) {
@@ -5860,7 +6177,7 @@ sub tls_site_chmod_ok {
       die("Can't set perms on $home_dir to 0755: $!");
     }
 
-    unless (chown($uid, $gid, $home_dir, $test_file)) {
+    unless (chown($uid, $gid, $home_dir)) {
       die("Can't set owner of $home_dir to $uid/$gid: $!");
     }
   }
@@ -5869,6 +6186,9 @@ sub tls_site_chmod_ok {
     '/bin/bash');
   auth_group_write($auth_group_file, $group, $gid, $user);
 
+  my $bad_client_cert = File::Spec->rel2abs('t/etc/modules/mod_tls/client-cert.pem');
+  my $good_client_cert = File::Spec->rel2abs('t/etc/modules/mod_tls/client-cert-localhost.pem');
+
   my $cert_file = File::Spec->rel2abs('t/etc/modules/mod_tls/server-cert.pem');
   my $ca_file = File::Spec->rel2abs('t/etc/modules/mod_tls/ca-cert.pem');
 
@@ -5879,6 +6199,7 @@ sub tls_site_chmod_ok {
 
     AuthUserFile => $auth_user_file,
     AuthGroupFile => $auth_group_file,
+    UseReverseDNS => 'on',
 
     IfModules => {
       'mod_delay.c' => {
@@ -5892,6 +6213,8 @@ sub tls_site_chmod_ok {
         TLSRequired => 'on',
         TLSRSACertificateFile => $cert_file,
         TLSCACertificateFile => $ca_file,
+        TLSOptions => 'CommonNameRequired',
+        TLSVerifyClient => 'on',
       },
     },
   };
@@ -5918,38 +6241,47 @@ sub tls_site_chmod_ok {
       # Give the server a chance to start up
       sleep(2);
 
-      my $client = Net::FTPSSL->new('127.0.0.1',
+      # IO::Socket::SSL options
+      my $ssl_opts = {
+        SSL_use_cert => 1,
+        SSL_cert_file => $bad_client_cert,
+        SSL_key_file => $bad_client_cert,
+      };
+
+      my $client;
+      eval {
+        $client = Net::FTPSSL->new('127.0.0.1',
+          Croak => 1,
+          Encryption => 'E',
+          Port => $port,
+          SSL_Client_Certificate => $ssl_opts,
+        );
+      };
+
+      unless ($@) { 
+        eval { $client->login($user, $passwd) };
+        unless ($@) {
+          die("Login succeeded unexpectedly");
+        }
+      }
+
+      $ssl_opts->{SSL_cert_file} = $good_client_cert;
+      $ssl_opts->{SSL_key_file} = $good_client_cert;
+
+      $client = Net::FTPSSL->new('127.0.0.1',
+        Croak => 1,
         Encryption => 'E',
         Port => $port,
+        SSL_Client_Certificate => $ssl_opts,
       );
 
-      unless ($client) {
-        die("Can't connect to FTPS server: " . IO::Socket::SSL::errstr());
-      }
+      sleep(1);
 
       unless ($client->login($user, $passwd)) {
         die("Can't login: " . $client->last_message());
       }
 
-      unless ($client->site("CHMOD 777 test.txt")) {
-        die("SITE CHMOD failed: " . $client->last_message());
-      } 
-
-      my $resp = $client->last_message();
-
-      my $expected;
-
-      $expected = '200 SITE CHMOD command successful';
-      $self->assert($expected eq $resp,
-        test_msg("Expected '$expected', got '$resp'"));
-
       $client->quit();
-
-      my $perms = ((stat($test_file))[2] &07777);
-
-      $expected = 0777;
-      $self->assert($expected == $perms,
-        test_msg("Expected '$expected', got '$perms'"));
     };
 
     if ($@) {
@@ -5960,7 +6292,7 @@ sub tls_site_chmod_ok {
     $wfh->flush();
 
   } else {
-    eval { server_wait($config_file, $rfh) };
+    eval { server_wait($config_file, $rfh, 30) };
     if ($@) {
       warn($@);
       exit 1;
@@ -5984,7 +6316,7 @@ sub tls_site_chmod_ok {
   unlink($log_file);
 }
 
-sub tls_default_tlsrequired {
+sub tls_opts_dns_name_required {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -6020,6 +6352,9 @@ sub tls_default_tlsrequired {
     '/bin/bash');
   auth_group_write($auth_group_file, $group, $gid, $user);
 
+  my $bad_client_cert = File::Spec->rel2abs('t/etc/modules/mod_tls/client-cert.pem');
+  my $good_client_cert = File::Spec->rel2abs('t/etc/modules/mod_tls/client-cert-localhost.pem');
+
   my $cert_file = File::Spec->rel2abs('t/etc/modules/mod_tls/server-cert.pem');
   my $ca_file = File::Spec->rel2abs('t/etc/modules/mod_tls/ca-cert.pem');
 
@@ -6030,6 +6365,7 @@ sub tls_default_tlsrequired {
 
     AuthUserFile => $auth_user_file,
     AuthGroupFile => $auth_group_file,
+    UseReverseDNS => 'on',
 
     IfModules => {
       'mod_delay.c' => {
@@ -6040,8 +6376,11 @@ sub tls_default_tlsrequired {
         TLSEngine => 'on',
         TLSLog => $log_file,
         TLSProtocol => 'SSLv3 TLSv1',
+        TLSRequired => 'on',
         TLSRSACertificateFile => $cert_file,
         TLSCACertificateFile => $ca_file,
+        TLSOptions => 'dNSNameRequired',
+        TLSVerifyClient => 'on',
       },
     },
   };
@@ -6068,26 +6407,47 @@ sub tls_default_tlsrequired {
       # Give the server a chance to start up
       sleep(2);
 
-      # Login first with FTPS...
-      my $client = Net::FTPSSL->new('127.0.0.1',
+      # IO::Socket::SSL options
+      my $ssl_opts = {
+        SSL_use_cert => 1,
+        SSL_cert_file => $bad_client_cert,
+        SSL_key_file => $bad_client_cert,
+      };
+
+      my $client;
+      eval {
+        $client = Net::FTPSSL->new('127.0.0.1',
+          Croak => 1,
+          Encryption => 'E',
+          Port => $port,
+          SSL_Client_Certificate => $ssl_opts,
+        );
+      };
+
+      unless ($@) { 
+        eval { $client->login($user, $passwd) };
+        unless ($@) {
+          die("Login succeeded unexpectedly");
+        }
+      }
+
+      $ssl_opts->{SSL_cert_file} = $good_client_cert;
+      $ssl_opts->{SSL_key_file} = $good_client_cert;
+
+      $client = Net::FTPSSL->new('127.0.0.1',
+        Croak => 1,
         Encryption => 'E',
         Port => $port,
+        SSL_Client_Certificate => $ssl_opts,
       );
 
-      unless ($client) {
-        die("Can't connect to FTPS server: " . IO::Socket::SSL::errstr());
-      }
+      sleep(1);
 
       unless ($client->login($user, $passwd)) {
         die("Can't login: " . $client->last_message());
       }
 
       $client->quit();
-
-      # Now log in using plain FTP
-      $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
-      $client->login($user, $passwd);
-      $client->quit();
     };
 
     if ($@) {
@@ -6098,7 +6458,7 @@ sub tls_default_tlsrequired {
     $wfh->flush();
 
   } else {
-    eval { server_wait($config_file, $rfh) };
+    eval { server_wait($config_file, $rfh, 30) };
     if ($@) {
       warn($@);
       exit 1;
@@ -6122,7 +6482,7 @@ sub tls_default_tlsrequired {
   unlink($log_file);
 }
 
-sub tls_protocols_default {
+sub tls_opts_ip_addr_dns_name_cn_required {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -6158,6 +6518,9 @@ sub tls_protocols_default {
     '/bin/bash');
   auth_group_write($auth_group_file, $group, $gid, $user);
 
+  my $bad_client_cert = File::Spec->rel2abs('t/etc/modules/mod_tls/client-cert.pem');
+  my $good_client_cert = File::Spec->rel2abs('t/etc/modules/mod_tls/client-cert-localhost.pem');
+
   my $cert_file = File::Spec->rel2abs('t/etc/modules/mod_tls/server-cert.pem');
   my $ca_file = File::Spec->rel2abs('t/etc/modules/mod_tls/ca-cert.pem');
 
@@ -6168,6 +6531,7 @@ sub tls_protocols_default {
 
     AuthUserFile => $auth_user_file,
     AuthGroupFile => $auth_group_file,
+    UseReverseDNS => 'on',
 
     IfModules => {
       'mod_delay.c' => {
@@ -6181,6 +6545,8 @@ sub tls_protocols_default {
         TLSRequired => 'on',
         TLSRSACertificateFile => $cert_file,
         TLSCACertificateFile => $ca_file,
+        TLSOptions => 'iPAddressRequired dNSNameRequired CommonNameRequired',
+        TLSVerifyClient => 'on',
       },
     },
   };
@@ -6207,23 +6573,46 @@ sub tls_protocols_default {
       # Give the server a chance to start up
       sleep(2);
 
-      my $client = Net::FTPSSL->new('127.0.0.1',
+      # IO::Socket::SSL options
+      my $ssl_opts = {
+        SSL_use_cert => 1,
+        SSL_cert_file => $bad_client_cert,
+        SSL_key_file => $bad_client_cert,
+      };
+
+      my $client;
+      eval {
+        $client = Net::FTPSSL->new('127.0.0.1',
+          Croak => 1,
+          Encryption => 'E',
+          Port => $port,
+          SSL_Client_Certificate => $ssl_opts,
+        );
+      };
+
+      unless ($@) { 
+        eval { $client->login($user, $passwd) };
+        unless ($@) {
+          die("Login succeeded unexpectedly");
+        }
+      }
+
+      $ssl_opts->{SSL_cert_file} = $good_client_cert;
+      $ssl_opts->{SSL_key_file} = $good_client_cert;
+
+      $client = Net::FTPSSL->new('127.0.0.1',
+        Croak => 1,
         Encryption => 'E',
         Port => $port,
+        SSL_Client_Certificate => $ssl_opts,
       );
 
-      unless ($client) {
-        die("Can't connect to FTPS server: " . IO::Socket::SSL::errstr());
-      }
+      sleep(1);
 
       unless ($client->login($user, $passwd)) {
         die("Can't login: " . $client->last_message());
       }
 
-      unless ($client->noop()) {
-        die("NOOP failed: " . $client->last_message());
-      }
-
       $client->quit();
     };
 
@@ -6235,7 +6624,7 @@ sub tls_protocols_default {
     $wfh->flush();
 
   } else {
-    eval { server_wait($config_file, $rfh) };
+    eval { server_wait($config_file, $rfh, 30) };
     if ($@) {
       warn($@);
       exit 1;
@@ -6259,7 +6648,7 @@ sub tls_protocols_default {
   unlink($log_file);
 }
 
-sub tls_protocols_with_ftps {
+sub tls_site_chmod_ok {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -6279,6 +6668,14 @@ sub tls_protocols_with_ftps {
   my $uid = 500;
   my $gid = 500;
 
+  my $test_file = File::Spec->rel2abs("$tmpdir/test.txt");
+  if (open(my $fh, "> $test_file")) {
+    close($fh);
+
+  } else {
+    die("Can't open $test_file: $!");
+  }
+
   # Make sure that, if we're running as root, that the home directory has
   # permissions/privs set for the account we create
   if ($< == 0) {
@@ -6286,7 +6683,7 @@ sub tls_protocols_with_ftps {
       die("Can't set perms on $home_dir to 0755: $!");
     }
 
-    unless (chown($uid, $gid, $home_dir)) {
+    unless (chown($uid, $gid, $home_dir, $test_file)) {
       die("Can't set owner of $home_dir to $uid/$gid: $!");
     }
   }
@@ -6306,8 +6703,6 @@ sub tls_protocols_with_ftps {
     AuthUserFile => $auth_user_file,
     AuthGroupFile => $auth_group_file,
 
-    Protocols => 'ftps',
-
     IfModules => {
       'mod_delay.c' => {
         DelayEngine => 'off',
@@ -6359,21 +6754,35 @@ sub tls_protocols_with_ftps {
         die("Can't login: " . $client->last_message());
       }
 
-      unless ($client->noop()) {
-        die("NOOP failed: " . $client->last_message());
-      }
+      unless ($client->site("CHMOD 777 test.txt")) {
+        die("SITE CHMOD failed: " . $client->last_message());
+      } 
 
-      $client->quit();
-    };
+      my $resp = $client->last_message();
 
-    if ($@) {
-      $ex = $@;
-    }
+      my $expected;
 
-    $wfh->print("done\n");
-    $wfh->flush();
+      $expected = '200 SITE CHMOD command successful';
+      $self->assert($expected eq $resp,
+        test_msg("Expected '$expected', got '$resp'"));
 
-  } else {
+      $client->quit();
+
+      my $perms = ((stat($test_file))[2] &07777);
+
+      $expected = 0777;
+      $self->assert($expected == $perms,
+        test_msg("Expected '$expected', got '$perms'"));
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
     eval { server_wait($config_file, $rfh) };
     if ($@) {
       warn($@);
@@ -6398,7 +6807,7 @@ sub tls_protocols_with_ftps {
   unlink($log_file);
 }
 
-sub tls_protocols_without_ftps {
+sub tls_default_tlsrequired {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -6445,8 +6854,6 @@ sub tls_protocols_without_ftps {
     AuthUserFile => $auth_user_file,
     AuthGroupFile => $auth_group_file,
 
-    Protocols => 'ftp',
-
     IfModules => {
       'mod_delay.c' => {
         DelayEngine => 'off',
@@ -6456,7 +6863,6 @@ sub tls_protocols_without_ftps {
         TLSEngine => 'on',
         TLSLog => $log_file,
         TLSProtocol => 'SSLv3 TLSv1',
-        TLSRequired => 'on',
         TLSRSACertificateFile => $cert_file,
         TLSCACertificateFile => $ca_file,
       },
@@ -6485,6 +6891,7 @@ sub tls_protocols_without_ftps {
       # Give the server a chance to start up
       sleep(2);
 
+      # Login first with FTPS...
       my $client = Net::FTPSSL->new('127.0.0.1',
         Encryption => 'E',
         Port => $port,
@@ -6494,15 +6901,16 @@ sub tls_protocols_without_ftps {
         die("Can't connect to FTPS server: " . IO::Socket::SSL::errstr());
       }
 
-      if ($client->login($user, $passwd)) {
-        die("Login succeeded unexpectedly");
+      unless ($client->login($user, $passwd)) {
+        die("Can't login: " . $client->last_message());
       }
 
-      my $resp_msg = $client->last_message();
+      $client->quit();
 
-      my $expected = '530 Login incorrect.';
-      $self->assert($expected eq $resp_msg,
-        test_msg("Expected '$expected', got '$resp_msg'"));
+      # Now log in using plain FTP
+      $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+      $client->login($user, $passwd);
+      $client->quit();
     };
 
     if ($@) {
@@ -6537,7 +6945,7 @@ sub tls_protocols_without_ftps {
   unlink($log_file);
 }
 
-sub tls_ifsess_protocols_with_ftps {
+sub tls_protocols_default {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -6602,27 +7010,6 @@ sub tls_ifsess_protocols_with_ftps {
 
   my ($port, $config_user, $config_group) = config_write($config_file, $config);
 
-  if (open(my $fh, ">> $config_file")) {
-    print $fh <<EOC;
-
-<IfModule mod_ifsession.c>
-  <IfUser foo>
-    Protocols bar baz
-  </IfUser>
-
-  <IfUser $user>
-    Protocols ftps
-  </IfUser>
-</IfModule>
-EOC
-    unless (close($fh)) {
-      die("Can't write $config_file: $!");
-    }
-
-  } else {
-    die("Can't open $config_file: $!");
-  }
-
   # Open pipes, for use between the parent and child processes.  Specifically,
   # the child will indicate when it's done with its test by writing a message
   # to the parent.
@@ -6695,7 +7082,7 @@ EOC
   unlink($log_file);
 }
 
-sub tls_ifsess_protocols_without_ftps {
+sub tls_protocols_with_ftps {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -6742,6 +7129,8 @@ sub tls_ifsess_protocols_without_ftps {
     AuthUserFile => $auth_user_file,
     AuthGroupFile => $auth_group_file,
 
+    Protocols => 'ftps',
+
     IfModules => {
       'mod_delay.c' => {
         DelayEngine => 'off',
@@ -6760,27 +7149,6 @@ sub tls_ifsess_protocols_without_ftps {
 
   my ($port, $config_user, $config_group) = config_write($config_file, $config);
 
-  if (open(my $fh, ">> $config_file")) {
-    print $fh <<EOC;
-
-<IfModule mod_ifsession.c>
-  <IfUser foo>
-    Protocols ftps
-  </IfUser>
-
-  <IfUser $user>
-    Protocols foo bar
-  </IfUser>
-</IfModule>
-EOC
-    unless (close($fh)) {
-      die("Can't write $config_file: $!");
-    }
-
-  } else {
-    die("Can't open $config_file: $!");
-  }
-
   # Open pipes, for use between the parent and child processes.  Specifically,
   # the child will indicate when it's done with its test by writing a message
   # to the parent.
@@ -6810,15 +7178,15 @@ EOC
         die("Can't connect to FTPS server: " . IO::Socket::SSL::errstr());
       }
 
-      if ($client->login($user, $passwd)) {
-        die("Login succeeded unexpectedly");
+      unless ($client->login($user, $passwd)) {
+        die("Can't login: " . $client->last_message());
       }
 
-      my $resp_msg = $client->last_message();
+      unless ($client->noop()) {
+        die("NOOP failed: " . $client->last_message());
+      }
 
-      my $expected = '530 Login incorrect.';
-      $self->assert($expected eq $resp_msg,
-        test_msg("Expected '$expected', got '$resp_msg'"));
+      $client->quit();
     };
 
     if ($@) {
@@ -6853,7 +7221,7 @@ EOC
   unlink($log_file);
 }
 
-sub tls_sess_cache_internal_bug3580 {
+sub tls_protocols_without_ftps {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -6900,6 +7268,8 @@ sub tls_sess_cache_internal_bug3580 {
     AuthUserFile => $auth_user_file,
     AuthGroupFile => $auth_group_file,
 
+    Protocols => 'ftp',
+
     IfModules => {
       'mod_delay.c' => {
         DelayEngine => 'off',
@@ -6912,8 +7282,6 @@ sub tls_sess_cache_internal_bug3580 {
         TLSRequired => 'on',
         TLSRSACertificateFile => $cert_file,
         TLSCACertificateFile => $ca_file,
-
-        TLSSessionCache => 'internal: 1800'
       },
     },
   };
@@ -6949,9 +7317,15 @@ sub tls_sess_cache_internal_bug3580 {
         die("Can't connect to FTPS server: " . IO::Socket::SSL::errstr());
       }
 
-      unless ($client->login($user, $passwd)) {
-        die("Can't login: " . $client->last_message());
+      if ($client->login($user, $passwd)) {
+        die("Login succeeded unexpectedly");
       }
+
+      my $resp_msg = $client->last_message();
+
+      my $expected = '530 Login incorrect.';
+      $self->assert($expected eq $resp_msg,
+        test_msg("Expected '$expected', got '$resp_msg'"));
     };
 
     if ($@) {
@@ -6986,7 +7360,7 @@ sub tls_sess_cache_internal_bug3580 {
   unlink($log_file);
 }
 
-sub tls_passphraseprovider {
+sub tls_ifsess_protocols_with_ftps {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -7022,16 +7396,13 @@ sub tls_passphraseprovider {
     '/bin/bash');
   auth_group_write($auth_group_file, $group, $gid, $user);
 
-  my $cert_file = File::Spec->rel2abs('t/etc/modules/mod_tls/server-cert-passwd.pem');
+  my $cert_file = File::Spec->rel2abs('t/etc/modules/mod_tls/server-cert.pem');
   my $ca_file = File::Spec->rel2abs('t/etc/modules/mod_tls/ca-cert.pem');
-  my $passphrase_provider = File::Spec->rel2abs('t/etc/modules/mod_tls/tls-get-passphrase.pl');
 
   my $config = {
     PidFile => $pid_file,
     ScoreboardFile => $scoreboard_file,
     SystemLog => $log_file,
-    TraceLog => $log_file,
-    Trace => 'DEFAULT:20 tls:20',
 
     AuthUserFile => $auth_user_file,
     AuthGroupFile => $auth_group_file,
@@ -7048,14 +7419,33 @@ sub tls_passphraseprovider {
         TLSRequired => 'on',
         TLSRSACertificateFile => $cert_file,
         TLSCACertificateFile => $ca_file,
-
-        TLSPassPhraseProvider => $passphrase_provider,
       },
     },
   };
 
   my ($port, $config_user, $config_group) = config_write($config_file, $config);
 
+  if (open(my $fh, ">> $config_file")) {
+    print $fh <<EOC;
+
+<IfModule mod_ifsession.c>
+  <IfUser foo>
+    Protocols bar baz
+  </IfUser>
+
+  <IfUser $user>
+    Protocols ftps
+  </IfUser>
+</IfModule>
+EOC
+    unless (close($fh)) {
+      die("Can't write $config_file: $!");
+    }
+
+  } else {
+    die("Can't open $config_file: $!");
+  }
+
   # Open pipes, for use between the parent and child processes.  Specifically,
   # the child will indicate when it's done with its test by writing a message
   # to the parent.
@@ -7074,7 +7464,7 @@ sub tls_passphraseprovider {
   if ($pid) {
     eval {
       # Give the server a chance to start up
-      sleep(5);
+      sleep(2);
 
       my $client = Net::FTPSSL->new('127.0.0.1',
         Encryption => 'E',
@@ -7088,6 +7478,12 @@ sub tls_passphraseprovider {
       unless ($client->login($user, $passwd)) {
         die("Can't login: " . $client->last_message());
       }
+
+      unless ($client->noop()) {
+        die("NOOP failed: " . $client->last_message());
+      }
+
+      $client->quit();
     };
 
     if ($@) {
@@ -7122,7 +7518,7 @@ sub tls_passphraseprovider {
   unlink($log_file);
 }
 
-sub tls_verify_order_crl_bug3658 {
+sub tls_ifsess_protocols_without_ftps {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -7158,10 +7554,8 @@ sub tls_verify_order_crl_bug3658 {
     '/bin/bash');
   auth_group_write($auth_group_file, $group, $gid, $user);
 
-  my $server_cert = File::Spec->rel2abs('t/etc/modules/mod_tls/crl-server-cert.pem');
-  my $client_cert = File::Spec->rel2abs('t/etc/modules/mod_tls/crl-client-cert.pem');
-  my $ca_cert = File::Spec->rel2abs('t/etc/modules/mod_tls/crl-ca.pem');
-  my $crl_file = File::Spec->rel2abs('t/etc/modules/mod_tls/crl-ca-revoked.pem');
+  my $cert_file = File::Spec->rel2abs('t/etc/modules/mod_tls/server-cert.pem');
+  my $ca_file = File::Spec->rel2abs('t/etc/modules/mod_tls/ca-cert.pem');
 
   my $config = {
     PidFile => $pid_file,
@@ -7181,20 +7575,35 @@ sub tls_verify_order_crl_bug3658 {
         TLSLog => $log_file,
         TLSProtocol => 'SSLv3 TLSv1',
         TLSRequired => 'on',
-        TLSRSACertificateFile => $server_cert,
-        TLSCACertificateFile => $ca_cert,
-
-        # Verifying clients via CRLs only works when verification is
-        # explicitly enabled.
-        TLSCARevocationFile => $crl_file,
-        TLSVerifyClient => 'on',
-        TLSVerifyOrder => 'crl',
+        TLSRSACertificateFile => $cert_file,
+        TLSCACertificateFile => $ca_file,
       },
     },
   };
 
   my ($port, $config_user, $config_group) = config_write($config_file, $config);
 
+  if (open(my $fh, ">> $config_file")) {
+    print $fh <<EOC;
+
+<IfModule mod_ifsession.c>
+  <IfUser foo>
+    Protocols ftps
+  </IfUser>
+
+  <IfUser $user>
+    Protocols foo bar
+  </IfUser>
+</IfModule>
+EOC
+    unless (close($fh)) {
+      die("Can't write $config_file: $!");
+    }
+
+  } else {
+    die("Can't open $config_file: $!");
+  }
+
   # Open pipes, for use between the parent and child processes.  Specifically,
   # the child will indicate when it's done with its test by writing a message
   # to the parent.
@@ -7215,34 +7624,24 @@ sub tls_verify_order_crl_bug3658 {
       # Give the server a chance to start up
       sleep(2);
 
-      my $client;
-
-      eval {
-        # IO::Socket::SSL options
-        my $ssl_opts = {
-          SSL_use_cert => 1,
-          SSL_cert_file => $client_cert,
-          SSL_key_file => $client_cert,
-        };
+      my $client = Net::FTPSSL->new('127.0.0.1',
+        Encryption => 'E',
+        Port => $port,
+      );
 
-        $client = Net::FTPSSL->new('127.0.0.1',
-          Croak => 1,
-          Encryption => 'E',
-          Port => $port,
-          SSL_Client_Certificate => $ssl_opts,
-        );
-      };
+      unless ($client) {
+        die("Can't connect to FTPS server: " . IO::Socket::SSL::errstr());
+      }
 
-      my $ex = $@;
-      unless ($ex) {
-        die("SSL connection succeeded unexpectedly");
+      if ($client->login($user, $passwd)) {
+        die("Login succeeded unexpectedly");
       }
 
-      my $errstr = IO::Socket::SSL::errstr();
+      my $resp_msg = $client->last_message();
 
-      my $expected = 'certificate revoked';
-      $self->assert(qr/$expected/, $errstr,
-        test_msg("Expected '$expected', got '$errstr'"));
+      my $expected = '530 Login incorrect.';
+      $self->assert($expected eq $resp_msg,
+        test_msg("Expected '$expected', got '$resp_msg'"));
     };
 
     if ($@) {
@@ -7277,7 +7676,7 @@ sub tls_verify_order_crl_bug3658 {
   unlink($log_file);
 }
 
-sub tls_verify_order_ocsp {
+sub tls_sess_cache_internal_bug3580 {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -7313,20 +7712,8 @@ sub tls_verify_order_ocsp {
     '/bin/bash');
   auth_group_write($auth_group_file, $group, $gid, $user);
 
-  my $server_cert = File::Spec->rel2abs('t/etc/modules/mod_tls/ocsp-server.pem');
-  my $client_cert = File::Spec->rel2abs('t/etc/modules/mod_tls/ocsp-client.pem');
-  my $ca_cert = File::Spec->rel2abs('t/etc/modules/mod_tls/ocsp-ca.pem');
-
-  # XXX NOTE: Make sure the OCSP responder is running, at URL:
-  #
-  #  http://localhost:7777
-  #
-  # since that is the OCSP URI baked into the OCSP client cert.
-  #
-  # To do this, go to the cert-tool/ directory, and run:
-  #
-  #  openssl ocsp -index etc/cert-tool.index -CA ocsp-ca.pem \
-  #    -rsigner ocsp-ca.pem -url http://localhost:7777
+  my $cert_file = File::Spec->rel2abs('t/etc/modules/mod_tls/server-cert.pem');
+  my $ca_file = File::Spec->rel2abs('t/etc/modules/mod_tls/ca-cert.pem');
 
   my $config = {
     PidFile => $pid_file,
@@ -7346,16 +7733,10 @@ sub tls_verify_order_ocsp {
         TLSLog => $log_file,
         TLSProtocol => 'SSLv3 TLSv1',
         TLSRequired => 'on',
-        TLSRSACertificateFile => $server_cert,
-        TLSCACertificateFile => $ca_cert,
-
-        TLSOptions => 'EnableDiags',
-
-        # Verifying clients via OCSP only works when verification is
-        # explicitly enabled.
-        TLSVerifyClient => 'on',
+        TLSRSACertificateFile => $cert_file,
+        TLSCACertificateFile => $ca_file,
 
-        TLSVerifyOrder => 'ocsp',
+        TLSSessionCache => 'internal: 1800'
       },
     },
   };
@@ -7382,7 +7763,619 @@ sub tls_verify_order_ocsp {
       # Give the server a chance to start up
       sleep(2);
 
-      my $client;
+      my $client = Net::FTPSSL->new('127.0.0.1',
+        Encryption => 'E',
+        Port => $port,
+      );
+
+      unless ($client) {
+        die("Can't connect to FTPS server: " . IO::Socket::SSL::errstr());
+      }
+
+      unless ($client->login($user, $passwd)) {
+        die("Can't login: " . $client->last_message());
+      }
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($config_file, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($pid_file);
+
+  $self->assert_child_ok($pid);
+
+  if ($ex) {
+    test_append_logfile($log_file, $ex);
+    unlink($log_file);
+
+    die($ex);
+  }
+
+  unlink($log_file);
+}
+
+sub tls_passphraseprovider {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+
+  my $config_file = "$tmpdir/tls.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/tls.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/tls.scoreboard");
+
+  my $log_file = test_get_logfile();
+
+  my $auth_user_file = File::Spec->rel2abs("$tmpdir/tls.passwd");
+  my $auth_group_file = File::Spec->rel2abs("$tmpdir/tls.group");
+
+  my $user = 'proftpd';
+  my $passwd = 'test';
+  my $group = 'ftpd';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+  my $uid = 500;
+  my $gid = 500;
+
+  # Make sure that, if we're running as root, that the home directory has
+  # permissions/privs set for the account we create
+  if ($< == 0) {
+    unless (chmod(0755, $home_dir)) {
+      die("Can't set perms on $home_dir to 0755: $!");
+    }
+
+    unless (chown($uid, $gid, $home_dir)) {
+      die("Can't set owner of $home_dir to $uid/$gid: $!");
+    }
+  }
+
+  auth_user_write($auth_user_file, $user, $passwd, $uid, $gid, $home_dir,
+    '/bin/bash');
+  auth_group_write($auth_group_file, $group, $gid, $user);
+
+  my $cert_file = File::Spec->rel2abs('t/etc/modules/mod_tls/server-cert-passwd.pem');
+  my $ca_file = File::Spec->rel2abs('t/etc/modules/mod_tls/ca-cert.pem');
+  my $passphrase_provider = File::Spec->rel2abs('t/etc/modules/mod_tls/tls-get-passphrase.pl');
+
+  my $config = {
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+    TraceLog => $log_file,
+    Trace => 'DEFAULT:20 tls:20',
+
+    AuthUserFile => $auth_user_file,
+    AuthGroupFile => $auth_group_file,
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_tls.c' => {
+        TLSEngine => 'on',
+        TLSLog => $log_file,
+        TLSProtocol => 'SSLv3 TLSv1',
+        TLSRequired => 'on',
+        TLSRSACertificateFile => $cert_file,
+        TLSCACertificateFile => $ca_file,
+
+        TLSPassPhraseProvider => $passphrase_provider,
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($config_file, $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  require Net::FTPSSL;
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      # Give the server a chance to start up
+      sleep(5);
+
+      my $client = Net::FTPSSL->new('127.0.0.1',
+        Encryption => 'E',
+        Port => $port,
+      );
+
+      unless ($client) {
+        die("Can't connect to FTPS server: " . IO::Socket::SSL::errstr());
+      }
+
+      unless ($client->login($user, $passwd)) {
+        die("Can't login: " . $client->last_message());
+      }
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($config_file, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($pid_file);
+
+  $self->assert_child_ok($pid);
+
+  if ($ex) {
+    test_append_logfile($log_file, $ex);
+    unlink($log_file);
+
+    die($ex);
+  }
+
+  unlink($log_file);
+}
+
+sub tls_verify_order_crl_bug3658 {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+
+  my $config_file = "$tmpdir/tls.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/tls.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/tls.scoreboard");
+
+  my $log_file = test_get_logfile();
+
+  my $auth_user_file = File::Spec->rel2abs("$tmpdir/tls.passwd");
+  my $auth_group_file = File::Spec->rel2abs("$tmpdir/tls.group");
+
+  my $user = 'proftpd';
+  my $passwd = 'test';
+  my $group = 'ftpd';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+  my $uid = 500;
+  my $gid = 500;
+
+  # Make sure that, if we're running as root, that the home directory has
+  # permissions/privs set for the account we create
+  if ($< == 0) {
+    unless (chmod(0755, $home_dir)) {
+      die("Can't set perms on $home_dir to 0755: $!");
+    }
+
+    unless (chown($uid, $gid, $home_dir)) {
+      die("Can't set owner of $home_dir to $uid/$gid: $!");
+    }
+  }
+
+  auth_user_write($auth_user_file, $user, $passwd, $uid, $gid, $home_dir,
+    '/bin/bash');
+  auth_group_write($auth_group_file, $group, $gid, $user);
+
+  my $server_cert = File::Spec->rel2abs('t/etc/modules/mod_tls/crl-server-cert.pem');
+  my $client_cert = File::Spec->rel2abs('t/etc/modules/mod_tls/crl-client-cert.pem');
+  my $ca_cert = File::Spec->rel2abs('t/etc/modules/mod_tls/crl-ca.pem');
+  my $crl_file = File::Spec->rel2abs('t/etc/modules/mod_tls/crl-ca-revoked.pem');
+
+  my $config = {
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+
+    AuthUserFile => $auth_user_file,
+    AuthGroupFile => $auth_group_file,
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_tls.c' => {
+        TLSEngine => 'on',
+        TLSLog => $log_file,
+        TLSProtocol => 'SSLv3 TLSv1',
+        TLSRequired => 'on',
+        TLSRSACertificateFile => $server_cert,
+        TLSCACertificateFile => $ca_cert,
+
+        # Verifying clients via CRLs only works when verification is
+        # explicitly enabled.
+        TLSCARevocationFile => $crl_file,
+        TLSVerifyClient => 'on',
+        TLSVerifyOrder => 'crl',
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($config_file, $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  require Net::FTPSSL;
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      # Give the server a chance to start up
+      sleep(2);
+
+      my $client;
+
+      eval {
+        # IO::Socket::SSL options
+        my $ssl_opts = {
+          SSL_use_cert => 1,
+          SSL_cert_file => $client_cert,
+          SSL_key_file => $client_cert,
+        };
+
+        $client = Net::FTPSSL->new('127.0.0.1',
+          Croak => 1,
+          Encryption => 'E',
+          Port => $port,
+          SSL_Client_Certificate => $ssl_opts,
+        );
+      };
+
+      my $ex = $@;
+      unless ($ex) {
+        die("SSL connection succeeded unexpectedly");
+      }
+
+      my $errstr = IO::Socket::SSL::errstr();
+
+      my $expected = 'certificate revoked';
+      $self->assert(qr/$expected/, $errstr,
+        test_msg("Expected '$expected', got '$errstr'"));
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($config_file, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($pid_file);
+
+  $self->assert_child_ok($pid);
+
+  if ($ex) {
+    test_append_logfile($log_file, $ex);
+    unlink($log_file);
+
+    die($ex);
+  }
+
+  unlink($log_file);
+}
+
+sub tls_verify_order_ocsp {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+
+  my $config_file = "$tmpdir/tls.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/tls.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/tls.scoreboard");
+
+  my $log_file = test_get_logfile();
+
+  my $auth_user_file = File::Spec->rel2abs("$tmpdir/tls.passwd");
+  my $auth_group_file = File::Spec->rel2abs("$tmpdir/tls.group");
+
+  my $user = 'proftpd';
+  my $passwd = 'test';
+  my $group = 'ftpd';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+  my $uid = 500;
+  my $gid = 500;
+
+  # Make sure that, if we're running as root, that the home directory has
+  # permissions/privs set for the account we create
+  if ($< == 0) {
+    unless (chmod(0755, $home_dir)) {
+      die("Can't set perms on $home_dir to 0755: $!");
+    }
+
+    unless (chown($uid, $gid, $home_dir)) {
+      die("Can't set owner of $home_dir to $uid/$gid: $!");
+    }
+  }
+
+  auth_user_write($auth_user_file, $user, $passwd, $uid, $gid, $home_dir,
+    '/bin/bash');
+  auth_group_write($auth_group_file, $group, $gid, $user);
+
+  my $server_cert = File::Spec->rel2abs('t/etc/modules/mod_tls/ocsp-server.pem');
+  my $client_cert = File::Spec->rel2abs('t/etc/modules/mod_tls/ocsp-client.pem');
+  my $ca_cert = File::Spec->rel2abs('t/etc/modules/mod_tls/ocsp-ca.pem');
+
+  # XXX NOTE: Make sure the OCSP responder is running, at URL:
+  #
+  #  http://localhost:7777
+  #
+  # since that is the OCSP URI baked into the OCSP client cert.
+  #
+  # To do this, go to the cert-tool/ directory, and run:
+  #
+  #  openssl ocsp -index etc/cert-tool.index -CA ocsp-ca.pem \
+  #    -rsigner ocsp-ca.pem -url http://localhost:7777
+
+  my $config = {
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+
+    AuthUserFile => $auth_user_file,
+    AuthGroupFile => $auth_group_file,
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_tls.c' => {
+        TLSEngine => 'on',
+        TLSLog => $log_file,
+        TLSProtocol => 'SSLv3 TLSv1',
+        TLSRequired => 'on',
+        TLSRSACertificateFile => $server_cert,
+        TLSCACertificateFile => $ca_cert,
+
+        TLSOptions => 'EnableDiags',
+
+        # Verifying clients via OCSP only works when verification is
+        # explicitly enabled.
+        TLSVerifyClient => 'on',
+
+        TLSVerifyOrder => 'ocsp',
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($config_file, $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  require Net::FTPSSL;
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      # Give the server a chance to start up
+      sleep(2);
+
+      my $client;
+
+      eval {
+        # IO::Socket::SSL options
+        my $ssl_opts = {
+          SSL_use_cert => 1,
+          SSL_cert_file => $client_cert,
+          SSL_key_file => $client_cert,
+        };
+
+        $client = Net::FTPSSL->new('127.0.0.1',
+          Croak => 1,
+          Encryption => 'E',
+          Port => $port,
+          SSL_Client_Certificate => $ssl_opts,
+        );
+      };
+
+      my $ex = $@;
+      unless ($ex) {
+        die("SSL connection succeeded unexpectedly");
+      }
+
+      my $errstr = IO::Socket::SSL::errstr();
+
+      # In this case, since the CA which is needed to verify the OCSP
+      # response has been revoked, the OCSP response can't be verified,
+      # which results in a handshake failure.
+      my $expected = 'handshake failure';
+      $self->assert(qr/$expected/, $errstr,
+        test_msg("Expected '$expected', got '$errstr'"));
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($config_file, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($pid_file);
+
+  $self->assert_child_ok($pid);
+
+  if ($ex) {
+    test_append_logfile($log_file, $ex);
+    unlink($log_file);
+
+    die($ex);
+  }
+
+  unlink($log_file);
+}
+
+sub tls_verify_order_ocsp_https {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+
+  my $config_file = "$tmpdir/tls.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/tls.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/tls.scoreboard");
+
+  my $log_file = test_get_logfile();
+
+  my $auth_user_file = File::Spec->rel2abs("$tmpdir/tls.passwd");
+  my $auth_group_file = File::Spec->rel2abs("$tmpdir/tls.group");
+
+  my $user = 'proftpd';
+  my $passwd = 'test';
+  my $group = 'ftpd';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+  my $uid = 500;
+  my $gid = 500;
+
+  # Make sure that, if we're running as root, that the home directory has
+  # permissions/privs set for the account we create
+  if ($< == 0) {
+    unless (chmod(0755, $home_dir)) {
+      die("Can't set perms on $home_dir to 0755: $!");
+    }
+
+    unless (chown($uid, $gid, $home_dir)) {
+      die("Can't set owner of $home_dir to $uid/$gid: $!");
+    }
+  }
+
+  auth_user_write($auth_user_file, $user, $passwd, $uid, $gid, $home_dir,
+    '/bin/bash');
+  auth_group_write($auth_group_file, $group, $gid, $user);
+
+  my $server_cert = File::Spec->rel2abs('t/etc/modules/mod_tls/ocsp-https-server.pem');
+  my $client_cert = File::Spec->rel2abs('t/etc/modules/mod_tls/ocsp-https-client.pem');
+  my $ca_cert = File::Spec->rel2abs('t/etc/modules/mod_tls/ocsp-https-ca.pem');
+
+  # XXX NOTE: Make sure the OCSP responder is running, at URL:
+  #
+  #  https://localhost:7777
+  #
+  # since that is the OCSP URI baked into the OCSP client cert.
+  #
+  # To do this, go to the cert-tool/ directory, and run:
+  #
+  #  openssl ocsp -index etc/cert-tool.index -CA ocsp-https-ca.pem \
+  #    -rsigner ocsp-https-ca.pem -url https://localhost:7777
+
+  my $config = {
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+
+    AuthUserFile => $auth_user_file,
+    AuthGroupFile => $auth_group_file,
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_tls.c' => {
+        TLSEngine => 'on',
+        TLSLog => $log_file,
+        TLSProtocol => 'SSLv3 TLSv1',
+        TLSRequired => 'on',
+        TLSRSACertificateFile => $server_cert,
+        TLSCACertificateFile => $ca_cert,
+
+        TLSOptions => 'EnableDiags',
+
+        # Verifying clients via OCSP only works when verification is
+        # explicitly enabled.
+        TLSVerifyClient => 'on',
+
+        TLSVerifyOrder => 'ocsp',
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($config_file, $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  require Net::FTPSSL;
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      # Give the server a chance to start up
+      sleep(2);
+
+      my $client;
 
       eval {
         # IO::Socket::SSL options
@@ -7447,7 +8440,7 @@ sub tls_verify_order_ocsp {
   unlink($log_file);
 }
 
-sub tls_verify_order_ocsp_https {
+sub tls_stapling {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -7483,20 +8476,23 @@ sub tls_verify_order_ocsp_https {
     '/bin/bash');
   auth_group_write($auth_group_file, $group, $gid, $user);
 
-  my $server_cert = File::Spec->rel2abs('t/etc/modules/mod_tls/ocsp-https-server.pem');
-  my $client_cert = File::Spec->rel2abs('t/etc/modules/mod_tls/ocsp-https-client.pem');
-  my $ca_cert = File::Spec->rel2abs('t/etc/modules/mod_tls/ocsp-https-ca.pem');
+  my $server_cert = File::Spec->rel2abs('t/etc/modules/mod_tls/ocsp-server.pem');
+  my $ca_cert = File::Spec->rel2abs('t/etc/modules/mod_tls/ocsp-ca.pem');
 
-  # XXX NOTE: Make sure the OCSP responder is running, at URL:
-  #
-  #  https://localhost:7777
-  #
-  # since that is the OCSP URI baked into the OCSP client cert.
-  #
-  # To do this, go to the cert-tool/ directory, and run:
-  #
-  #  openssl ocsp -index etc/cert-tool.index -CA ocsp-https-ca.pem \
-  #    -rsigner ocsp-https-ca.pem -url https://localhost:7777
+  # Run our own OCSP responder (OpenSSL's ocsp(1)), using an index in which
+  # the server cert (serial 0x18) is valid.
+  my $index_file = File::Spec->rel2abs("$tmpdir/ocsp-index.txt");
+  if (open(my $fh, "> $index_file")) {
+    print $fh "V\t210516212739Z\t\t18\tunknown\t/CN=ocsp-server\n";
+    unless (close($fh)) {
+      die("Can't write $index_file: $!");
+    }
+
+  } else {
+    die("Can't open $index_file: $!");
+  }
+
+  my $ocsp_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
 
   my $config = {
     PidFile => $pid_file,
@@ -7514,18 +8510,182 @@ sub tls_verify_order_ocsp_https {
       'mod_tls.c' => {
         TLSEngine => 'on',
         TLSLog => $log_file,
-        TLSProtocol => 'SSLv3 TLSv1',
         TLSRequired => 'on',
         TLSRSACertificateFile => $server_cert,
         TLSCACertificateFile => $ca_cert,
 
-        TLSOptions => 'EnableDiags',
+        TLSStapling => 'on',
+        TLSStaplingResponder => "http://127.0.0.1:$ocsp_port",
+      },
+    },
+  };
 
-        # Verifying clients via OCSP only works when verification is
-        # explicitly enabled.
-        TLSVerifyClient => 'on',
+  my ($port, $config_user, $config_group) = config_write($config_file, $config);
 
-        TLSVerifyOrder => 'ocsp',
+  my $ocsp_pid = fork();
+  unless (defined($ocsp_pid)) {
+    die("Can't fork: $!");
+  }
+
+  if ($ocsp_pid == 0) {
+    open(STDOUT, '>', '/dev/null');
+    open(STDERR, '>', '/dev/null');
+
+    exec('openssl', 'ocsp', '-index', $index_file, '-port', $ocsp_port,
+      '-CA', $ca_cert, '-rsigner', $ca_cert, '-rkey', $ca_cert,
+      '-ndays', '1');
+    exit 1;
+  }
+
+  # Give the responder a chance to start up, since the server fetches the
+  # response to staple when it starts.
+  sleep(1);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      # Give the server a chance to start up
+      sleep(2);
+
+      my @cmd = (
+        'openssl',
+        's_client',
+        '-connect',
+        "127.0.0.1:$port",
+        '-starttls',
+        'ftp',
+        '-status',
+      );
+
+      my $tls_rh = IO::Handle->new();
+      my $tls_wh = IO::Handle->new();
+      my $tls_eh = IO::Handle->new();
+
+      $tls_wh->autoflush(1);
+
+      my $tls_pid = open3($tls_wh, $tls_rh, $tls_eh, @cmd);
+      print $tls_wh "quit\n";
+      waitpid($tls_pid, 0);
+
+      my $ocsp_status = '';
+      foreach my $line (<$tls_rh>) {
+        if ($line =~ /OCSP Response Status: (\S+)/) {
+          $ocsp_status = $1;
+        }
+      }
+
+      my $expected = 'successful';
+      $self->assert($expected eq $ocsp_status,
+        test_msg("Expected stapled OCSP response status '$expected', got '$ocsp_status'"));
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($config_file, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($pid_file);
+
+  $self->assert_child_ok($pid);
+
+  kill('TERM', $ocsp_pid);
+  waitpid($ocsp_pid, 0);
+
+  if ($ex) {
+    test_append_logfile($log_file, $ex);
+    unlink($log_file);
+
+    die($ex);
+  }
+
+  unlink($log_file);
+}
+
+sub tls_key_workers {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+
+  my $config_file = "$tmpdir/tls.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/tls.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/tls.scoreboard");
+
+  my $log_file = test_get_logfile();
+
+  my $auth_user_file = File::Spec->rel2abs("$tmpdir/tls.passwd");
+  my $auth_group_file = File::Spec->rel2abs("$tmpdir/tls.group");
+
+  my $user = 'proftpd';
+  my $passwd = 'test';
+  my $group = 'ftpd';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+  my $uid = 500;
+  my $gid = 500;
+
+  # Make sure that, if we're running as root, that the home directory has
+  # permissions/privs set for the account we create
+  if ($< == 0) {
+    unless (chmod(0755, $home_dir)) {
+      die("Can't set perms on $home_dir to 0755: $!");
+    }
+
+    unless (chown($uid, $gid, $home_dir)) {
+      die("Can't set owner of $home_dir to $uid/$gid: $!");
+    }
+  }
+
+  auth_user_write($auth_user_file, $user, $passwd, $uid, $gid, $home_dir,
+    '/bin/bash');
+  auth_group_write($auth_group_file, $group, $gid, $user);
+
+  my $cert_file = File::Spec->rel2abs('t/etc/modules/mod_tls/server-cert.pem');
+  my $ca_file = File::Spec->rel2abs('t/etc/modules/mod_tls/ca-cert.pem');
+
+  my $config = {
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+
+    AuthUserFile => $auth_user_file,
+    AuthGroupFile => $auth_group_file,
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_tls.c' => {
+        TLSEngine => 'on',
+        TLSLog => $log_file,
+        TLSProtocol => 'SSLv3 TLSv1',
+        TLSRequired => 'on',
+        TLSRSACertificateFile => $cert_file,
+        TLSCACertificateFile => $ca_file,
+        TLSKeyWorkers => 2,
       },
     },
   };
@@ -7552,37 +8712,26 @@ sub tls_verify_order_ocsp_https {
       # Give the server a chance to start up
       sleep(2);
 
-      my $client;
-
-      eval {
-        # IO::Socket::SSL options
-        my $ssl_opts = {
-          SSL_use_cert => 1,
-          SSL_cert_file => $client_cert,
-          SSL_key_file => $client_cert,
-        };
+      my $client = Net::FTPSSL->new('127.0.0.1',
+        Encryption => 'E',
+        Port => $port,
+      );
 
-        $client = Net::FTPSSL->new('127.0.0.1',
-          Croak => 1,
-          Encryption => 'E',
-          Port => $port,
-          SSL_Client_Certificate => $ssl_opts,
-        );
-      };
+      unless ($client) {
+        die("Can't connect to FTPS server: " . IO::Socket::SSL::errstr());
+      }
 
-      my $ex = $@;
-      unless ($ex) {
-        die("SSL connection succeeded unexpectedly");
+      unless ($client->login($user, $passwd)) {
+        die("Can't login: " . $client->last_message());
       }
 
-      my $errstr = IO::Socket::SSL::errstr();
+      # The data connection needs a handshake of its own.
+      my $res = $client->list();
+      unless ($res) {
+        die("LIST failed unexpectedly: " . $client->last_message());
+      }
 
-      # In this case, since the CA which is needed to verify the OCSP
-      # response has been revoked, the OCSP response can't be verified,
-      # which results in a handshake failure.
-      my $expected = 'handshake failure';
-      $self->assert(qr/$expected/, $errstr,
-        test_msg("Expected '$expected', got '$errstr'"));
+      $client->quit();
     };
 
     if ($@) {
@@ -21,6 +21,11 @@ my $TESTS = {
     test_class => [qw(forking)],
   },
 
+  tls_sess_cache_shm_concurrent_clients => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
 };
 
 sub new {
@@ -124,7 +129,7 @@ sub tls_sess_cache_shm {
       },
 
       'mod_tls_shmcache.c' => {
-        # 10332 is the minimum number of bytes for shmcache
+        # 10384 is the minimum number of bytes for shmcache
         TLSSessionCache => "shm:/file=$shm_path&size=20664",
       },
     },
@@ -328,4 +333,218 @@ sub tls_sess_cache_shm {
   unlink($log_file);
 }
 
+sub tls_sess_cache_shm_concurrent_clients {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+
+  my $config_file = "$tmpdir/tls.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/tls.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/tls.scoreboard");
+
+  my $log_file = test_get_logfile();
+
+  my $auth_user_file = File::Spec->rel2abs("$tmpdir/tls.passwd");
+  my $auth_group_file = File::Spec->rel2abs("$tmpdir/tls.group");
+
+  my $user = 'proftpd';
+  my $passwd = 'test';
+  my $group = 'ftpd';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+  my $uid = 500;
+  my $gid = 500;
+
+  # Make sure that, if we're running as root, that the home directory has
+  # permissions/privs set for the account we create
+  if ($< == 0) {
+    unless (chmod(0755, $home_dir)) {
+      die("Can't set perms on $home_dir to 0755: $!");
+    }
+
+    unless (chown($uid, $gid, $home_dir)) {
+      die("Can't set owner of $home_dir to $uid/$gid: $!");
+    }
+  }
+
+  auth_user_write($auth_user_file, $user, $passwd, $uid, $gid, $home_dir,
+    '/bin/bash');
+  auth_group_write($auth_group_file, $group, $gid, $user);
+
+  my $cert_file = File::Spec->rel2abs('t/etc/modules/mod_tls/server-cert.pem');
+  my $ca_file = File::Spec->rel2abs('t/etc/modules/mod_tls/ca-cert.pem');
+
+  my $shm_path = File::Spec->rel2abs("$tmpdir/tls-shmcache");
+
+  my $config = {
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+    TraceLog => $log_file,
+    Trace => 'tls_shmcache:20',
+
+    AuthUserFile => $auth_user_file,
+    AuthGroupFile => $auth_group_file,
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_tls.c' => {
+        TLSEngine => 'on',
+        TLSLog => $log_file,
+        TLSProtocol => 'SSLv3 TLSv1',
+        TLSRequired => 'on',
+        TLSRSACertificateFile => $cert_file,
+        TLSCACertificateFile => $ca_file,
+        TLSVerifyClient => 'off',
+      },
+
+      'mod_tls_shmcache.c' => {
+        TLSSessionCache => "shm:/file=$shm_path",
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($config_file, $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  my $ex;
+
+  # Runs the openssl s_client tool, returning the 'Cipher is' line.
+  my $run_client = sub {
+    my $sess_opt = shift;
+    my $sessid_file = shift;
+
+    my @cmd = (
+      'openssl',
+      's_client',
+      '-connect',
+      "127.0.0.1:$port",
+      '-starttls',
+      'ftp',
+      $sess_opt,
+      $sessid_file,
+      '-CAfile',
+      $ca_file,
+    );
+
+    my $tls_rh = IO::Handle->new();
+    my $tls_wh = IO::Handle->new();
+    my $tls_eh = IO::Handle->new();
+
+    $tls_wh->autoflush(1);
+
+    my $tls_pid = open3($tls_wh, $tls_rh, $tls_eh, @cmd);
+    print $tls_wh "quit\n";
+    waitpid($tls_pid, 0);
+
+    if ($? >> 8) {
+      my $err_str = join('', <$tls_eh>);
+      die("Can't talk to server: $err_str");
+    }
+
+    my $cipher_str = '';
+    foreach my $line (<$tls_rh>) {
+      if ($line =~ /Cipher is/) {
+        $cipher_str = $line;
+        chomp($cipher_str);
+      }
+    }
+
+    return $cipher_str;
+  };
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      # Give the server a chance to start up
+      sleep(2);
+
+      local $SIG{CHLD} = 'DEFAULT';
+
+      # Have several clients concurrently adding sessions to, and resuming
+      # sessions from, the cache.
+      my $nclients = 8;
+      my $client_pids = [];
+
+      for (my $i = 0; $i < $nclients; $i++) {
+        my $client_pid = fork();
+        unless (defined($client_pid)) {
+          die("Can't fork: $!");
+        }
+
+        if ($client_pid == 0) {
+          my $sessid_file = File::Spec->rel2abs("$tmpdir/sessid-$i.pem");
+          my $ok = 0;
+
+          eval {
+            my $cipher_str = $run_client->('-sess_out', $sessid_file);
+            if ($cipher_str =~ /^New/) {
+              $cipher_str = $run_client->('-sess_in', $sessid_file);
+              if ($cipher_str =~ /^Reused/) {
+                $ok = 1;
+              }
+            }
+          };
+
+          exit($ok ? 0 : 1);
+        }
+
+        push(@$client_pids, $client_pid);
+      }
+
+      my $failed = 0;
+      foreach my $client_pid (@$client_pids) {
+        waitpid($client_pid, 0);
+        if ($? >> 8) {
+          $failed++;
+        }
+      }
+
+      $self->assert($failed == 0,
+        test_msg("Expected all $nclients clients to resume sessions, " .
+          "$failed failed"));
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($config_file, $rfh, 45) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($pid_file);
+
+  $self->assert_child_ok($pid);
+
+  if ($ex) {
+    test_append_logfile($log_file, $ex);
+    unlink($log_file);
+
+    die($ex);
+  }
+
+  unlink($log_file);
+}
+
 1;
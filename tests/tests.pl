@@ -105,6 +105,7 @@ if (scalar(@ARGV) > 0) {
     t/config/anonrejectpasswords.t
     t/config/anonrequirepassword.t
     t/config/authaliasonly.t
+    t/config/authcachetable.t
     t/config/authgroupfile.t
     t/config/authorder.t
     t/config/authuserfile.t
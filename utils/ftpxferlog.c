@@ -0,0 +1,493 @@
+/*
+ * ProFTPD - FTP server daemon
+ * Copyright (c) 2015 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project team and other respective
+ * copyright holders give permission to link this program with OpenSSL, and
+ * distribute the resulting executable, without including the source code for
+ * OpenSSL in the source distribution.
+ */
+
+/* Converts binary TransferLogs (i.e. "TransferLog path binary") to text. */
+
+#include "utils.h"
+#include "xferlog.h"
+
+#define FTPXFERLOG_FMT_XFERLOG		1
+#define FTPXFERLOG_FMT_CSV		2
+#define FTPXFERLOG_FMT_JSON		3
+
+/* Sanity limit on record lengths; the server never writes records anywhere
+ * near this large.
+ */
+#define FTPXFERLOG_MAX_RECORD_LEN	(1024 * 1024)
+
+#if defined(HAVE_LLU)
+# define FTPXFERLOG_LU		"llu"
+typedef unsigned long long xferlog_off_t;
+#else
+# define FTPXFERLOG_LU		"lu"
+typedef unsigned long xferlog_off_t;
+#endif
+
+struct xferlog_str {
+  const unsigned char *ptr;
+  size_t len;
+};
+
+struct xferlog_rec {
+  unsigned int type;
+  char xfertype, direction, access_mode, completion;
+  int have_ident;
+  unsigned long pid;
+  unsigned long time, time_usec;
+  unsigned long secs, usecs;
+  xferlog_off_t bytes;
+
+  struct xferlog_str remhost, user, path, protocol, ident, action_flags;
+};
+
+static int output_format = FTPXFERLOG_FMT_XFERLOG;
+static int show_starts = FALSE;
+static int use_gmtime = FALSE;
+
+static unsigned long get32(const unsigned char *ptr) {
+  return ((unsigned long) ptr[0] << 24) | ((unsigned long) ptr[1] << 16) |
+    ((unsigned long) ptr[2] << 8) | (unsigned long) ptr[3];
+}
+
+/* Parses the strings of a record; returns -1 if they overrun the record. */
+static int parse_strs(const unsigned char *buf, size_t buflen,
+    struct xferlog_rec *rec) {
+  struct xferlog_str *strs[PR_XFERLOG_BIN_NSTRS];
+  size_t off = PR_XFERLOG_BIN_HDR_LEN;
+  register unsigned int i;
+
+  strs[0] = &(rec->remhost);
+  strs[1] = &(rec->user);
+  strs[2] = &(rec->path);
+  strs[3] = &(rec->protocol);
+  strs[4] = &(rec->ident);
+  strs[5] = &(rec->action_flags);
+
+  for (i = 0; i < PR_XFERLOG_BIN_NSTRS; i++) {
+    size_t len;
+
+    if (off + 2 > buflen) {
+      return -1;
+    }
+
+    len = ((size_t) buf[off] << 8) | (size_t) buf[off+1];
+    off += 2;
+
+    if (off + len > buflen) {
+      return -1;
+    }
+
+    strs[i]->ptr = buf + off;
+    strs[i]->len = len;
+    off += len;
+  }
+
+  return 0;
+}
+
+static const char *get_timestamp(unsigned long t) {
+  static char buf[64];
+  static char *mons[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul",
+    "Aug", "Sep", "Oct", "Nov", "Dec" };
+  static char *days[] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+  time_t now = (time_t) t;
+  struct tm *tr;
+
+  tr = use_gmtime ? gmtime(&now) : localtime(&now);
+  if (tr == NULL) {
+    return "-";
+  }
+
+  /* The same format as the text TransferLog. */
+  snprintf(buf, sizeof(buf), "%s %s %02d %02d:%02d:%02d %d",
+    days[tr->tm_wday], mons[tr->tm_mon], tr->tm_mday, tr->tm_hour,
+    tr->tm_min, tr->tm_sec, tr->tm_year + 1900);
+  buf[sizeof(buf)-1] = '\0';
+
+  return buf;
+}
+
+/* Writes the string, with whitespace and control characters replaced, as
+ * the text TransferLog does.
+ */
+static void print_word(struct xferlog_str *str) {
+  register unsigned int i;
+
+  if (str->len == 0) {
+    fputc('-', stdout);
+    return;
+  }
+
+  for (i = 0; i < str->len; i++) {
+    int c = str->ptr[i];
+
+    fputc((isspace(c) || iscntrl(c)) ? '_' : c, stdout);
+  }
+}
+
+static void print_csv(struct xferlog_str *str) {
+  register unsigned int i;
+
+  fputc('"', stdout);
+  for (i = 0; i < str->len; i++) {
+    if (str->ptr[i] == '"') {
+      fputc('"', stdout);
+    }
+
+    fputc(str->ptr[i], stdout);
+  }
+  fputc('"', stdout);
+}
+
+static void print_json(struct xferlog_str *str) {
+  register unsigned int i;
+
+  fputc('"', stdout);
+  for (i = 0; i < str->len; i++) {
+    int c = str->ptr[i];
+
+    if (c == '"' ||
+        c == '\\') {
+      fputc('\\', stdout);
+      fputc(c, stdout);
+
+    } else if (c < 0x20) {
+      fprintf(stdout, "\\u%04x", c);
+
+    } else {
+      fputc(c, stdout);
+    }
+  }
+  fputc('"', stdout);
+}
+
+static void print_xferlog(struct xferlog_rec *rec) {
+  /* The text TransferLog has no start records. */
+  if (rec->type != PR_XFERLOG_BIN_TYPE_END) {
+    return;
+  }
+
+  fprintf(stdout, "%s %lu ", get_timestamp(rec->time), rec->secs);
+  print_word(&(rec->remhost));
+  fprintf(stdout, " %" FTPXFERLOG_LU " ", rec->bytes);
+  print_word(&(rec->path));
+  fprintf(stdout, " %c ", rec->xfertype);
+  print_word(&(rec->action_flags));
+  fprintf(stdout, " %c %c ", rec->direction, rec->access_mode);
+  print_word(&(rec->user));
+  fputc(' ', stdout);
+  print_word(&(rec->protocol));
+  fprintf(stdout, " %c ", rec->have_ident ? '1' : '0');
+  print_word(&(rec->ident));
+  fprintf(stdout, " %c\n", rec->completion);
+}
+
+static void print_csv_rec(struct xferlog_rec *rec) {
+  fprintf(stdout, "%s,%lu,%lu.%06lu,%lu.%06lu,",
+    rec->type == PR_XFERLOG_BIN_TYPE_START ? "start" : "end", rec->pid,
+    rec->time, rec->time_usec, rec->secs, rec->usecs);
+  print_csv(&(rec->remhost));
+  fputc(',', stdout);
+  print_csv(&(rec->user));
+  fputc(',', stdout);
+  print_csv(&(rec->path));
+  fprintf(stdout, ",%" FTPXFERLOG_LU ",%c,%c,%c,%c,", rec->bytes,
+    rec->xfertype, rec->direction, rec->access_mode, rec->completion);
+  print_csv(&(rec->protocol));
+  fputc(',', stdout);
+  print_csv(&(rec->ident));
+  fputc(',', stdout);
+  print_csv(&(rec->action_flags));
+  fputc('\n', stdout);
+}
+
+static void print_json_rec(struct xferlog_rec *rec) {
+  fprintf(stdout, "{\"type\":\"%s\",\"pid\":%lu,\"time\":%lu.%06lu,"
+    "\"duration\":%lu.%06lu,\"remote_host\":",
+    rec->type == PR_XFERLOG_BIN_TYPE_START ? "start" : "end", rec->pid,
+    rec->time, rec->time_usec, rec->secs, rec->usecs);
+  print_json(&(rec->remhost));
+  fputs(",\"user\":", stdout);
+  print_json(&(rec->user));
+  fputs(",\"path\":", stdout);
+  print_json(&(rec->path));
+  fprintf(stdout, ",\"bytes\":%" FTPXFERLOG_LU ",\"transfer_type\":\"%c\","
+    "\"direction\":\"%c\",\"access_mode\":\"%c\",\"completion\":\"%c\","
+    "\"protocol\":", rec->bytes, rec->xfertype, rec->direction,
+    rec->access_mode, rec->completion);
+  print_json(&(rec->protocol));
+  fputs(",\"ident\":", stdout);
+  print_json(&(rec->ident));
+  fputs(",\"action_flags\":", stdout);
+  print_json(&(rec->action_flags));
+  fputs("}\n", stdout);
+}
+
+static void print_rec(const unsigned char *buf, size_t buflen) {
+  struct xferlog_rec rec;
+
+  memset(&rec, 0, sizeof(rec));
+  rec.type = buf[PR_XFERLOG_BIN_OFF_TYPE];
+  rec.xfertype = (char) buf[PR_XFERLOG_BIN_OFF_XFERTYPE];
+  rec.direction = (char) buf[PR_XFERLOG_BIN_OFF_DIRECTION];
+  rec.access_mode = (char) buf[PR_XFERLOG_BIN_OFF_ACCESS_MODE];
+  rec.completion = (char) buf[PR_XFERLOG_BIN_OFF_COMPLETION];
+  rec.have_ident = buf[PR_XFERLOG_BIN_OFF_IDENT] ? TRUE : FALSE;
+  rec.pid = get32(buf + PR_XFERLOG_BIN_OFF_PID);
+  rec.time = get32(buf + PR_XFERLOG_BIN_OFF_TIME);
+  rec.time_usec = get32(buf + PR_XFERLOG_BIN_OFF_TIME_USEC);
+  rec.secs = get32(buf + PR_XFERLOG_BIN_OFF_SECS);
+  rec.usecs = get32(buf + PR_XFERLOG_BIN_OFF_USECS);
+
+  /* Shift twice, lest xferlog_off_t be only 32 bits wide. */
+  rec.bytes = (((xferlog_off_t) get32(buf + PR_XFERLOG_BIN_OFF_BYTES_HI)
+    << 16) << 16) | (xferlog_off_t) get32(buf + PR_XFERLOG_BIN_OFF_BYTES_LO);
+
+  if (parse_strs(buf, buflen, &rec) < 0) {
+    fprintf(stderr, "ftpxferlog: skipping malformed record\n");
+    return;
+  }
+
+  if (rec.type == PR_XFERLOG_BIN_TYPE_START &&
+      show_starts == FALSE) {
+    return;
+  }
+
+  switch (output_format) {
+    case FTPXFERLOG_FMT_CSV:
+      print_csv_rec(&rec);
+      break;
+
+    case FTPXFERLOG_FMT_JSON:
+      print_json_rec(&rec);
+      break;
+
+    default:
+      print_xferlog(&rec);
+      break;
+  }
+}
+
+/* Converts the records in the given file; returns -1 if the file could not
+ * be read, or is corrupted.
+ */
+static int convert_file(const char *path, FILE *fp) {
+  unsigned char *buf = NULL;
+  size_t bufsz = 0;
+  unsigned long offset = 0;
+
+  while (TRUE) {
+    unsigned char hdr[PR_XFERLOG_BIN_HDR_LEN];
+    unsigned long reclen;
+    size_t n;
+
+    n = fread(hdr, 1, sizeof(hdr), fp);
+    if (n == 0) {
+      break;
+    }
+
+    if (n < sizeof(hdr)) {
+      fprintf(stderr, "ftpxferlog: %s: truncated record at offset %lu\n",
+        path, offset);
+      free(buf);
+      return -1;
+    }
+
+    reclen = get32(hdr + PR_XFERLOG_BIN_OFF_LEN);
+    if (reclen < PR_XFERLOG_BIN_HDR_LEN ||
+        reclen > FTPXFERLOG_MAX_RECORD_LEN) {
+      fprintf(stderr, "ftpxferlog: %s: bad record length %lu at offset %lu "
+        "(not a binary TransferLog?)\n", path, reclen, offset);
+      free(buf);
+      return -1;
+    }
+
+    if (reclen > bufsz) {
+      unsigned char *ptr;
+
+      ptr = realloc(buf, reclen);
+      if (ptr == NULL) {
+        fprintf(stderr, "ftpxferlog: out of memory\n");
+        free(buf);
+        return -1;
+      }
+
+      buf = ptr;
+      bufsz = reclen;
+    }
+
+    memcpy(buf, hdr, sizeof(hdr));
+    n = fread(buf + sizeof(hdr), 1, reclen - sizeof(hdr), fp);
+    if (n < reclen - sizeof(hdr)) {
+      fprintf(stderr, "ftpxferlog: %s: truncated record at offset %lu\n",
+        path, offset);
+      free(buf);
+      return -1;
+    }
+
+    /* Skip records from later versions, or of unknown types. */
+    if (hdr[PR_XFERLOG_BIN_OFF_VERSION] == PR_XFERLOG_BIN_VERSION &&
+        (hdr[PR_XFERLOG_BIN_OFF_TYPE] == PR_XFERLOG_BIN_TYPE_START ||
+         hdr[PR_XFERLOG_BIN_OFF_TYPE] == PR_XFERLOG_BIN_TYPE_END)) {
+      print_rec(buf, reclen);
+    }
+
+    offset += reclen;
+  }
+
+  free(buf);
+
+  if (ferror(fp)) {
+    fprintf(stderr, "ftpxferlog: error reading %s: %s\n", path,
+      strerror(errno));
+    return -1;
+  }
+
+  return 0;
+}
+
+static struct option_help {
+  char *long_opt, *short_opt, *desc;
+} opts_help[] = {
+  { "--format",	"-f",	"output format: xferlog (default), csv or json" },
+  { "--gmt",	"-g",	"use GMT, rather than local time, for xferlog times" },
+  { "--help",	"-h",	NULL },
+  { "--starts",	"-s",	"include transfer start records (csv/json only)" },
+  { NULL }
+};
+
+#ifdef HAVE_GETOPT_LONG
+static struct option opts[] = {
+  { "format",  1, NULL, 'f' },
+  { "gmt",     0, NULL, 'g' },
+  { "help",    0, NULL, 'h' },
+  { "starts",  0, NULL, 's' },
+  { NULL,      0, NULL, 0   }
+};
+#endif /* HAVE_GETOPT_LONG */
+
+static void show_usage(const char *progname, int exit_code) {
+  struct option_help *h = NULL;
+
+  printf("usage: %s [options] [file ...]\n", progname);
+  for (h = opts_help; h->long_opt; h++) {
+#ifdef HAVE_GETOPT_LONG
+    printf("  %s, %s\n", h->short_opt, h->long_opt);
+#else /* HAVE_GETOPT_LONG */
+    printf("  %s\n", h->short_opt);
+#endif
+    if (!h->desc)
+      printf("    display %s usage\n", progname);
+    else
+      printf("    %s\n", h->desc);
+  }
+
+  exit(exit_code);
+}
+
+int main(int argc, char **argv) {
+  int c = 0, res = 0;
+  char *cp, *progname = *argv;
+  const char *cmdopts = "f:ghs";
+
+  cp = strrchr(progname, '/');
+  if (cp != NULL)
+    progname = cp + 1;
+
+  opterr = 0;
+  while ((c =
+#ifdef HAVE_GETOPT_LONG
+	 getopt_long(argc, argv, cmdopts, opts, NULL)
+#else /* HAVE_GETOPT_LONG */
+	 getopt(argc, argv, cmdopts)
+#endif /* HAVE_GETOPT_LONG */
+	 ) != -1) {
+    switch (c) {
+      case 'h':
+        show_usage(progname, 0);
+
+      case 'f':
+        if (strcasecmp(optarg, "xferlog") == 0) {
+          output_format = FTPXFERLOG_FMT_XFERLOG;
+
+        } else if (strcasecmp(optarg, "csv") == 0) {
+          output_format = FTPXFERLOG_FMT_CSV;
+
+        } else if (strcasecmp(optarg, "json") == 0) {
+          output_format = FTPXFERLOG_FMT_JSON;
+
+        } else {
+          fprintf(stderr, "unknown format: %s\n", optarg);
+          show_usage(progname, 1);
+        }
+        break;
+
+      case 'g':
+        use_gmtime = TRUE;
+        break;
+
+      case 's':
+        show_starts = TRUE;
+        break;
+
+      case '?':
+        fprintf(stderr, "unknown option: %c\n", (char) optopt);
+        show_usage(progname, 1);
+    }
+  }
+
+  if (output_format == FTPXFERLOG_FMT_CSV) {
+    fprintf(stdout, "type,pid,time,duration,remote_host,user,path,bytes,"
+      "transfer_type,direction,access_mode,completion,protocol,ident,"
+      "action_flags\n");
+  }
+
+  if (optind == argc) {
+    if (convert_file("stdin", stdin) < 0) {
+      res = 1;
+    }
+
+  } else {
+    for (; optind < argc; optind++) {
+      FILE *fp;
+
+      fp = fopen(argv[optind], "rb");
+      if (fp == NULL) {
+        fprintf(stderr, "ftpxferlog: unable to open %s: %s\n", argv[optind],
+          strerror(errno));
+        res = 1;
+        continue;
+      }
+
+      if (convert_file(argv[optind], fp) < 0) {
+        res = 1;
+      }
+
+      fclose(fp);
+    }
+  }
+
+  fflush(stdout);
+  return res;
+}